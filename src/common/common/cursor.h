@@ -44,6 +44,15 @@ typedef struct guac_common_cursor {
      */
     guac_client* client;
 
+    /**
+     * The socket over which changes to the cursor image are sent to all
+     * users. This is the socket of the client unless the output of the
+     * display owning the cursor is pipelined, in which case this is the
+     * socket of that pipeline, such that cursor images are sent in order
+     * with all other output of the display.
+     */
+    guac_socket* socket;
+
     /**
      * The buffer containing the current cursor image.
      */
@@ -145,6 +154,20 @@ guac_common_cursor* guac_common_cursor_alloc(guac_client* client);
  */
 void guac_common_cursor_free(guac_common_cursor* cursor);
 
+/**
+ * Sets the socket over which all further changes to the cursor image are sent
+ * to all users, such as the socket of a pipeline through which all other
+ * output of the display owning the cursor is sent.
+ *
+ * @param cursor
+ *     The cursor whose socket should be set.
+ *
+ * @param socket
+ *     The socket over which changes to the cursor image should be sent.
+ */
+void guac_common_cursor_set_socket(guac_common_cursor* cursor,
+        guac_socket* socket);
+
 /**
  * Sends the current state of this cursor across the given socket, including
  * the current cursor image. The resulting cursor on the remote display will
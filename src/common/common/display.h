@@ -21,6 +21,9 @@
 #define GUAC_COMMON_DISPLAY_H
 
 #include "cursor.h"
+#include "image_cache.h"
+#include "pipeline.h"
+#include "snapshot.h"
 #include "surface.h"
 
 #include <guacamole/client.h>
@@ -99,6 +102,26 @@ typedef struct guac_common_display {
      */
     guac_common_display_layer* buffers;
 
+    /**
+     * The pipeline through which all output of the display's surfaces is
+     * encoded and sent, or NULL if output is encoded and sent by the thread
+     * flushing the display.
+     */
+    guac_common_pipeline* pipeline;
+
+    /**
+     * The cache of recently-sent images shared by all of the display's
+     * surfaces, or NULL if images are always encoded and sent.
+     */
+    guac_common_image_cache* image_cache;
+
+    /**
+     * The snapshot of the display shared by all users joining at about the
+     * same time, or NULL if each joining user is sent the entire display
+     * separately.
+     */
+    guac_common_snapshot* snapshot;
+
     /**
      * Mutex which is locked internally when access to the display must be
      * synchronized. All public functions of guac_common_display should be
@@ -141,6 +164,12 @@ void guac_common_display_free(guac_common_display* display);
  * Duplicates the state of the given display to the given socket. Any pending
  * changes to buffers, layers, or the default layer are not flushed.
  *
+ * The visible layers are sent as a snapshot which is captured under the
+ * display's lock but encoded without holding it, and which is shared with
+ * any other users joining at about the same time. Only changes made since the
+ * snapshot was captured are then sent under the lock. Offscreen buffers are
+ * sent only once a visible layer actually references them.
+ *
  * @param display
  *     The display whose state should be sent along the given socket.
  *
@@ -153,6 +182,21 @@ void guac_common_display_free(guac_common_display* display);
 void guac_common_display_dup(guac_common_display* display, guac_user* user,
         guac_socket* socket);
 
+/**
+ * Updates the state of the given display to reflect that the given user is
+ * leaving, such that nothing further is sent to that user on behalf of the
+ * display, including the shared cursor and any buffers whose duplication was
+ * deferred when the user joined.
+ *
+ * @param display
+ *     The display which the user is leaving.
+ *
+ * @param user
+ *     The user which is leaving.
+ */
+void guac_common_display_remove_user(guac_common_display* display,
+        guac_user* user);
+
 /**
  * Flushes pending changes to the given display. All pending operations will
  * become visible to any connected users.
@@ -162,6 +206,32 @@ void guac_common_display_dup(guac_common_display* display, guac_user* user,
  */
 void guac_common_display_flush(guac_common_display* display);
 
+/**
+ * Flushes pending changes to the given display and ends the current frame,
+ * flushing the client's socket. If the display is pipelined, the frame is
+ * ended by the pipeline once all changes within the frame have been encoded
+ * and sent, and this function returns without waiting for that to happen
+ * unless the pipeline is too far behind.
+ *
+ * @param display
+ *     The display whose current frame should be ended.
+ */
+void guac_common_display_end_frame(guac_common_display* display);
+
+/**
+ * Routes all further output of the given display through a newly-allocated
+ * pipeline, such that the encoding and sending of each frame overlaps with
+ * the building of the next. Once enabled, frames must be ended with
+ * guac_common_display_end_frame().
+ *
+ * @param display
+ *     The display whose output should be pipelined.
+ *
+ * @return
+ *     Zero if the pipeline was enabled successfully, non-zero otherwise.
+ */
+int guac_common_display_enable_pipeline(guac_common_display* display);
+
 /**
  * Allocates a new layer, returning a new wrapped layer and corresponding
  * surface. The layer may be reused from a previous allocation, if that layer
@@ -0,0 +1,88 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_ENCODER_H
+#define __GUAC_COMMON_ENCODER_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * The maximum number of threads, including the calling thread, which may be
+ * used to run a single batch of encoding tasks.
+ */
+#define GUAC_COMMON_ENCODER_MAX_THREADS 16
+
+/**
+ * A single encoding task, such as the encoding of one tile of an image.
+ * Encoding tasks may be run concurrently with each other, and must not touch
+ * any data other than their own without synchronization.
+ *
+ * @param data
+ *     The data associated with the task being run.
+ */
+typedef void guac_common_encoder_task(void* data);
+
+/**
+ * Sets the number of threads, including the calling thread, which should be
+ * used to run each batch of encoding tasks. The default, zero, uses one
+ * thread per online CPU, up to GUAC_COMMON_ENCODER_MAX_THREADS. A value of
+ * one runs all tasks serially within the calling thread. This setting is
+ * shared by all connections within the current process.
+ *
+ * @param threads
+ *     The number of threads to use, or zero to choose automatically.
+ */
+void guac_common_encoder_set_threads(int threads);
+
+/**
+ * Returns the number of threads, including the calling thread, which will be
+ * used to run the next batch of encoding tasks.
+ *
+ * @return
+ *     The number of threads which will be used, which is always at least one.
+ */
+int guac_common_encoder_get_threads();
+
+/**
+ * Runs the given task once for each element of the given array, distributing
+ * the elements across the process-wide pool of encoder threads, and returns
+ * only once every element has been handled. The calling thread handles
+ * elements alongside the pool. If the pool is already in use by another
+ * batch, all elements are instead handled serially within the calling thread.
+ * Worker threads are started as needed upon first use.
+ *
+ * @param task
+ *     The task to run for each element.
+ *
+ * @param data
+ *     The first element of the array of elements.
+ *
+ * @param size
+ *     The size of each element of the array, in bytes.
+ *
+ * @param count
+ *     The number of elements in the array.
+ */
+void guac_common_encoder_run(guac_common_encoder_task* task, void* data,
+        size_t size, int count);
+
+#endif
+
@@ -0,0 +1,293 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_IMAGE_CACHE_H
+#define __GUAC_COMMON_IMAGE_CACHE_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The default maximum number of bytes of image data which may be held by an
+ * image cache at any one time. The same amount of memory is used by the
+ * client-side buffers holding that data.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_DEFAULT_SIZE 16777216
+
+/**
+ * The maximum number of images which may be held by an image cache at any one
+ * time, and thus the maximum number of client-side buffers used by the cache.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_MAX_ENTRIES 1024
+
+/**
+ * The minimum number of pixels an image must contain to be cached. Smaller
+ * images are cheap enough to encode that caching them gains little.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_MIN_PIXELS 256
+
+/**
+ * The number of buckets within the hash table of cached images. This must be
+ * a power of two.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_BUCKETS 2048
+
+/**
+ * The number of hashes of recently-seen images which are remembered by an
+ * image cache. An image is cached only once it has been seen twice, such that
+ * content which is drawn only once does not evict content which repeats. This
+ * must be a power of two.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_SEEN 4096
+
+typedef struct guac_common_image_cache_entry guac_common_image_cache_entry;
+
+/**
+ * A single image held by an image cache, along with the client-side buffer
+ * containing a copy of that image.
+ */
+struct guac_common_image_cache_entry {
+
+    /**
+     * The hash of the image, as produced by guac_hash_image().
+     */
+    uint64_t hash;
+
+    /**
+     * The width of the image, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the image, in pixels.
+     */
+    int height;
+
+    /**
+     * The pixel data of the image, in 32-bit pixels with no padding between
+     * rows. This copy is used to verify that images with matching hashes are
+     * actually identical, and to synchronize the cache with joining users.
+     */
+    unsigned char* image;
+
+    /**
+     * The client-side buffer containing a copy of the image at its upper-left
+     * corner.
+     */
+    guac_layer* buffer;
+
+    /**
+     * The next entry within the same hash table bucket, or NULL if this is
+     * the last entry in the bucket.
+     */
+    guac_common_image_cache_entry* next_in_bucket;
+
+    /**
+     * The next more recently used entry, or NULL if this is the most recently
+     * used entry.
+     */
+    guac_common_image_cache_entry* newer;
+
+    /**
+     * The next less recently used entry, or NULL if this is the least
+     * recently used entry.
+     */
+    guac_common_image_cache_entry* older;
+
+};
+
+/**
+ * A cache of recently-sent images, each mapped to a client-side buffer
+ * containing a copy of that image, such that a repeat of an image can be
+ * drawn with a copy from the corresponding buffer rather than being encoded
+ * and sent again. Least recently used images are evicted once the cache
+ * exceeds its size limit, with their buffers reused for newly-cached images.
+ */
+typedef struct guac_common_image_cache {
+
+    /**
+     * The client associated with this cache.
+     */
+    guac_client* client;
+
+    /**
+     * The maximum number of bytes of image data which may be cached.
+     */
+    size_t max_size;
+
+    /**
+     * The number of bytes of image data currently cached.
+     */
+    size_t size;
+
+    /**
+     * The number of images currently cached.
+     */
+    int length;
+
+    /**
+     * Hash table of all cached images, indexed by the low bits of each
+     * image's hash.
+     */
+    guac_common_image_cache_entry* buckets[GUAC_COMMON_IMAGE_CACHE_BUCKETS];
+
+    /**
+     * The most recently used entry, or NULL if the cache is empty.
+     */
+    guac_common_image_cache_entry* newest;
+
+    /**
+     * The least recently used entry, or NULL if the cache is empty.
+     */
+    guac_common_image_cache_entry* oldest;
+
+    /**
+     * Hashes of recently-seen images which have not yet been cached, indexed
+     * by the low bits of each hash.
+     */
+    uint64_t seen[GUAC_COMMON_IMAGE_CACHE_SEEN];
+
+    /**
+     * Client-side buffers which were used by evicted images and are free for
+     * reuse by newly-cached images.
+     */
+    guac_layer** free_buffers;
+
+    /**
+     * The number of buffers within free_buffers.
+     */
+    int free_buffers_length;
+
+    /**
+     * The number of times an image was found within the cache.
+     */
+    unsigned long hits;
+
+    /**
+     * The number of times an image was looked up but not found.
+     */
+    unsigned long misses;
+
+    /**
+     * The number of images evicted to make room for other images.
+     */
+    unsigned long evictions;
+
+    /**
+     * Lock which is acquired when the cache is being accessed or modified.
+     */
+    pthread_mutex_t _lock;
+
+} guac_common_image_cache;
+
+/**
+ * Allocates a new, empty image cache.
+ *
+ * @param client
+ *     The client whose buffers will hold the cached images.
+ *
+ * @param max_size
+ *     The maximum number of bytes of image data which may be cached.
+ *
+ * @return
+ *     A newly-allocated image cache, or NULL if the cache could not be
+ *     allocated.
+ */
+guac_common_image_cache* guac_common_image_cache_alloc(guac_client* client,
+        size_t max_size);
+
+/**
+ * Frees the given image cache, disposing of and freeing all client-side
+ * buffers used by the cache. Any output which copies from those buffers must
+ * already have been sent.
+ *
+ * @param cache
+ *     The image cache to free.
+ *
+ * @param socket
+ *     The socket over which the buffers should be disposed.
+ */
+void guac_common_image_cache_free(guac_common_image_cache* cache,
+        guac_socket* socket);
+
+/**
+ * Looks up the given image within the given cache. If an identical image is
+ * already cached, its buffer is returned and hit is set to non-zero. If not,
+ * and the image has been seen recently, the image is added to the cache, its
+ * newly-assigned buffer is returned and hit is set to zero; the caller must
+ * then copy the image into that buffer once the image has been drawn. If the
+ * image is not to be cached at all, NULL is returned.
+ *
+ * Buffers are assigned in the order images are looked up, and a buffer may be
+ * reassigned to a different image by any later lookup. Output involving the
+ * returned buffer must therefore be sent in the same order as the lookups.
+ *
+ * @param cache
+ *     The image cache to look up the image within.
+ *
+ * @param image
+ *     The first pixel of the image, in 32-bit pixels.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image.
+ *
+ * @param hit
+ *     Set to non-zero if the returned buffer already contains the image, or
+ *     to zero otherwise.
+ *
+ * @return
+ *     The client-side buffer which contains or should contain the image at
+ *     its upper-left corner, or NULL if the image is not cached.
+ */
+const guac_layer* guac_common_image_cache_lookup(
+        guac_common_image_cache* cache, const unsigned char* image,
+        int width, int height, int stride, int* hit);
+
+/**
+ * Sends the contents of every client-side buffer used by the given image
+ * cache to the given user, such that the user's copies of those buffers match
+ * those of all other users.
+ *
+ * @param cache
+ *     The image cache to synchronize.
+ *
+ * @param user
+ *     The user to send the cached images to.
+ *
+ * @param socket
+ *     The socket over which the cached images should be sent.
+ */
+void guac_common_image_cache_dup(guac_common_image_cache* cache,
+        guac_user* user, guac_socket* socket);
+
+#endif
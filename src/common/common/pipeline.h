@@ -0,0 +1,319 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_PIPELINE_H
+#define __GUAC_COMMON_PIPELINE_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * The maximum number of submitted jobs which may be awaiting encoding or
+ * sending at any one time. Further submissions block until earlier jobs have
+ * been sent. As each job typically holds a stream until sent, this must be
+ * comfortably less than GUAC_CLIENT_MAX_STREAMS.
+ */
+#define GUAC_COMMON_PIPELINE_MAX_JOBS 32
+
+/**
+ * The maximum number of completed frames which may be awaiting encoding or
+ * sending while the next frame is being built. Ending a frame blocks until no
+ * more than this many frames remain.
+ */
+#define GUAC_COMMON_PIPELINE_MAX_FRAMES 1
+
+/**
+ * The processing lag, in milliseconds, above which ending a frame blocks
+ * until all previous frames have been sent, allowing the lag of the client
+ * to slow the thread building frames.
+ */
+#define GUAC_COMMON_PIPELINE_LAG_THRESHOLD 500
+
+/**
+ * Encodes the data associated with a submitted job. Jobs may be encoded
+ * concurrently with each other, and concurrently with the thread which
+ * submitted them.
+ *
+ * @param data
+ *     The data associated with the job.
+ */
+typedef void guac_common_pipeline_encode_handler(void* data);
+
+/**
+ * Sends a previously-encoded job over the given socket, freeing any data
+ * associated with the job. Jobs are sent one at a time, in the order they
+ * were submitted relative to all other output of the pipeline.
+ *
+ * @param data
+ *     The data associated with the job.
+ *
+ * @param socket
+ *     The socket which the job should be sent over.
+ */
+typedef void guac_common_pipeline_send_handler(void* data,
+        guac_socket* socket);
+
+/**
+ * The type of an item awaiting processing within a pipeline.
+ */
+typedef enum guac_common_pipeline_item_type {
+
+    /**
+     * Instruction data which was written directly to the pipeline socket.
+     */
+    GUAC_COMMON_PIPELINE_DATA,
+
+    /**
+     * A job which must be encoded and then sent.
+     */
+    GUAC_COMMON_PIPELINE_JOB,
+
+    /**
+     * The end of a frame.
+     */
+    GUAC_COMMON_PIPELINE_FRAME
+
+} guac_common_pipeline_item_type;
+
+typedef struct guac_common_pipeline_item guac_common_pipeline_item;
+
+/**
+ * A single item awaiting processing within a pipeline.
+ */
+struct guac_common_pipeline_item {
+
+    /**
+     * The type of this item.
+     */
+    guac_common_pipeline_item_type type;
+
+    /**
+     * The instruction data of a GUAC_COMMON_PIPELINE_DATA item.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of instruction data within buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for buffer.
+     */
+    size_t size;
+
+    /**
+     * The function which encodes a GUAC_COMMON_PIPELINE_JOB item.
+     */
+    guac_common_pipeline_encode_handler* encode_handler;
+
+    /**
+     * The function which sends a GUAC_COMMON_PIPELINE_JOB item.
+     */
+    guac_common_pipeline_send_handler* send_handler;
+
+    /**
+     * The data associated with a GUAC_COMMON_PIPELINE_JOB item.
+     */
+    void* data;
+
+    /**
+     * The next item in the pipeline, or NULL if this is the last item.
+     */
+    guac_common_pipeline_item* next;
+
+};
+
+/**
+ * A double-buffered pipeline which decouples the encoding and sending of
+ * display updates from the thread which builds them. All output written to
+ * the pipeline's socket, all submitted jobs, and all frame boundaries are
+ * processed by a dedicated thread in the order they were added, with jobs
+ * encoded in parallel ahead of being sent.
+ */
+typedef struct guac_common_pipeline {
+
+    /**
+     * The client whose frames are being sent.
+     */
+    guac_client* client;
+
+    /**
+     * The socket to which all output of the pipeline is ultimately written.
+     */
+    guac_socket* target;
+
+    /**
+     * A socket which adds all data written to it to the pipeline, such that
+     * the data is written to the target socket in order with submitted jobs.
+     */
+    guac_socket* socket;
+
+    /**
+     * The first item awaiting processing, or NULL if there are no such items.
+     */
+    guac_common_pipeline_item* head;
+
+    /**
+     * The last item awaiting processing, or NULL if there are no such items.
+     */
+    guac_common_pipeline_item* tail;
+
+    /**
+     * The number of jobs which have been submitted but not yet sent.
+     */
+    int pending_jobs;
+
+    /**
+     * The number of frames which have been ended but not yet sent.
+     */
+    int pending_frames;
+
+    /**
+     * The number of items of any kind which have been added but not yet
+     * processed, including items currently being processed.
+     */
+    int pending_items;
+
+    /**
+     * Non-zero if the pipeline is being freed, in which case the pipeline
+     * thread must process all remaining items and then terminate.
+     */
+    int stopping;
+
+    /**
+     * Lock which is acquired when an instruction is being written to the
+     * pipeline socket, and released when the instruction is finished being
+     * written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which guards the list of items and all counters.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled when items are added or the pipeline is
+     * being freed.
+     */
+    pthread_cond_t items_added;
+
+    /**
+     * Condition which is signalled when items have been processed.
+     */
+    pthread_cond_t items_processed;
+
+    /**
+     * The thread which encodes and sends all items.
+     */
+    pthread_t thread;
+
+} guac_common_pipeline;
+
+/**
+ * Allocates a new pipeline which writes all output to the given socket,
+ * starting the thread which processes that output.
+ *
+ * @param client
+ *     The client whose frames will be sent through the pipeline.
+ *
+ * @param target
+ *     The socket to which all output of the pipeline should be written.
+ *
+ * @return
+ *     A newly-allocated pipeline, or NULL if the pipeline could not be
+ *     allocated.
+ */
+guac_common_pipeline* guac_common_pipeline_alloc(guac_client* client,
+        guac_socket* target);
+
+/**
+ * Waits for all output previously added to the given pipeline to be written
+ * to the target socket, stops the pipeline thread, and frees the pipeline.
+ * The target socket is not freed.
+ *
+ * @param pipeline
+ *     The pipeline to free.
+ */
+void guac_common_pipeline_free(guac_common_pipeline* pipeline);
+
+/**
+ * Adds a job to the given pipeline. The job is encoded in parallel with other
+ * jobs by the pipeline thread and the encoder pool, and is then sent in order
+ * with all other output of the pipeline. If too many jobs are pending, this
+ * function blocks until earlier jobs have been sent.
+ *
+ * @param pipeline
+ *     The pipeline to add the job to.
+ *
+ * @param encode_handler
+ *     The function which encodes the job.
+ *
+ * @param send_handler
+ *     The function which sends the job and frees the job's data.
+ *
+ * @param data
+ *     The data associated with the job.
+ */
+void guac_common_pipeline_submit(guac_common_pipeline* pipeline,
+        guac_common_pipeline_encode_handler* encode_handler,
+        guac_common_pipeline_send_handler* send_handler, void* data);
+
+/**
+ * Ends the current frame, such that the pipeline thread ends the frame and
+ * flushes the target socket once all previous output has been written. If
+ * more than GUAC_COMMON_PIPELINE_MAX_FRAMES frames are pending, or if the
+ * client is lagging, this function blocks until earlier frames have been
+ * sent.
+ *
+ * @param pipeline
+ *     The pipeline whose current frame should be ended.
+ */
+void guac_common_pipeline_end_frame(guac_common_pipeline* pipeline);
+
+/**
+ * Waits for all output previously added to the given pipeline to be written
+ * to the target socket.
+ *
+ * @param pipeline
+ *     The pipeline to wait for.
+ */
+void guac_common_pipeline_wait(guac_common_pipeline* pipeline);
+
+/**
+ * Returns whether all output previously added to the given pipeline has been
+ * written to the target socket. Unlike guac_common_pipeline_wait(), this
+ * function never blocks.
+ *
+ * @param pipeline
+ *     The pipeline to check.
+ *
+ * @return
+ *     Non-zero if no output of the given pipeline is pending, zero otherwise.
+ */
+int guac_common_pipeline_is_idle(guac_common_pipeline* pipeline);
+
+#endif
+
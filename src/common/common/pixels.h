@@ -0,0 +1,212 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_PIXELS_H
+#define __GUAC_COMMON_PIXELS_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+/**
+ * The number of distinct transfer functions. Each guac_transfer_function is
+ * a four-bit truth table, and thus a value less than this number.
+ */
+#define GUAC_COMMON_PIXELS_TRANSFER_FUNCTIONS 16
+
+/**
+ * The maximum number of kernel sets which may be compiled into a single
+ * build, including the scalar kernels.
+ */
+#define GUAC_COMMON_PIXELS_MAX_KERNELS 4
+
+/**
+ * A function which combines a single row of 32-bit ARGB source pixels with
+ * the same number of destination pixels, storing the result within the
+ * destination. The range of pixels actually changed by the operation is
+ * determined in the same pass.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param src
+ *     The first pixel of the source row. The source row must not overlap
+ *     the destination row unless both are identical.
+ *
+ * @param width
+ *     The number of pixels in each row.
+ *
+ * @param first
+ *     Pointer to an int which will receive the index of the first changed
+ *     pixel, if any pixel changed.
+ *
+ * @param last
+ *     Pointer to an int which will receive the index of the last changed
+ *     pixel, if any pixel changed.
+ *
+ * @return
+ *     Non-zero if any destination pixel changed, zero otherwise.
+ */
+typedef int guac_common_pixels_span(uint32_t* dst, const uint32_t* src,
+        int width, int* first, int* last);
+
+/**
+ * A function which sets each pixel of a row of 32-bit ARGB destination
+ * pixels to the given color wherever the corresponding source pixel is not
+ * fully transparent. The range of pixels actually changed by the operation
+ * is determined in the same pass.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param src
+ *     The first pixel of the source (mask) row.
+ *
+ * @param width
+ *     The number of pixels in each row.
+ *
+ * @param color
+ *     The ARGB color to assign to each masked destination pixel.
+ *
+ * @param first
+ *     Pointer to an int which will receive the index of the first changed
+ *     pixel, if any pixel changed.
+ *
+ * @param last
+ *     Pointer to an int which will receive the index of the last changed
+ *     pixel, if any pixel changed.
+ *
+ * @return
+ *     Non-zero if any destination pixel changed, zero otherwise.
+ */
+typedef int guac_common_pixels_fill(uint32_t* dst, const uint32_t* src,
+        int width, uint32_t color, int* first, int* last);
+
+/**
+ * A function which classifies a single row of 32-bit ARGB pixels in a single
+ * pass, determining whether all pixels are identical, whether all pixels are
+ * fully opaque, and how many pixels have the same color as the pixel before
+ * them.
+ *
+ * @param src
+ *     The first pixel of the row.
+ *
+ * @param width
+ *     The number of pixels in the row, which must be at least 1.
+ *
+ * @param same
+ *     Pointer to an int which will receive the number of pixels, excluding
+ *     the first, whose color (ignoring the alpha channel) is identical to
+ *     that of the pixel before them.
+ *
+ * @param opaque
+ *     Pointer to an int which will be set to non-zero if every pixel is fully
+ *     opaque, or zero otherwise.
+ *
+ * @return
+ *     Non-zero if every pixel, including its alpha channel, is identical to
+ *     the first pixel, zero otherwise.
+ */
+typedef int guac_common_pixels_scan(const uint32_t* src, int width,
+        int* same, int* opaque);
+
+/**
+ * A set of pixel kernels implementing the per-row operations of
+ * guac_common_surface using a particular instruction set. All kernel sets
+ * produce results which are bit-identical to the scalar kernels.
+ */
+typedef struct guac_common_pixel_kernels {
+
+    /**
+     * A human-readable name for the instruction set used by these kernels,
+     * such as "scalar" or "avx2".
+     */
+    const char* name;
+
+    /**
+     * Copies each source pixel to the destination, ignoring the source alpha
+     * channel and storing all pixels as fully opaque.
+     */
+    guac_common_pixels_span* put_opaque;
+
+    /**
+     * Composites each source pixel over the corresponding destination pixel
+     * using the Porter-Duff "over" operator, assuming premultiplied alpha.
+     */
+    guac_common_pixels_span* put_blend;
+
+    /**
+     * Fills each destination pixel with a color wherever the corresponding
+     * source pixel is not fully transparent.
+     */
+    guac_common_pixels_fill* fill_mask;
+
+    /**
+     * Transfers each source pixel to the destination using a binary transfer
+     * function, indexed by guac_transfer_function. Each transfer function
+     * has its own kernel, such that the function need not be evaluated per
+     * pixel.
+     */
+    guac_common_pixels_span* transfer[GUAC_COMMON_PIXELS_TRANSFER_FUNCTIONS];
+
+    /**
+     * Classifies each row of a flushed update, such that uniform regions may
+     * be sent as solid rectangles and the format of the remainder chosen,
+     * without a separate pass over the image data for each test.
+     */
+    guac_common_pixels_scan* scan;
+
+} guac_common_pixel_kernels;
+
+/**
+ * The scalar pixel kernels, which are available on all platforms and define
+ * the results which all other kernels must reproduce.
+ */
+extern const guac_common_pixel_kernels guac_common_pixels_scalar;
+
+/**
+ * Returns the fastest set of pixel kernels supported by the current CPU.
+ * The CPU is only inspected on the first call.
+ *
+ * @return
+ *     The fastest set of pixel kernels supported by the current CPU.
+ */
+const guac_common_pixel_kernels* guac_common_pixels_get_kernels();
+
+/**
+ * Stores each set of pixel kernels which is both compiled into this build
+ * and supported by the current CPU, fastest first. The scalar kernels are
+ * always included, last.
+ *
+ * @param kernels
+ *     An array which will receive pointers to each supported set of pixel
+ *     kernels.
+ *
+ * @param max
+ *     The number of entries available in the given array. An array of
+ *     GUAC_COMMON_PIXELS_MAX_KERNELS entries is always sufficient.
+ *
+ * @return
+ *     The number of kernel sets stored.
+ */
+int guac_common_pixels_list_kernels(const guac_common_pixel_kernels** kernels,
+        int max);
+
+#endif
+
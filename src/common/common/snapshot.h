@@ -0,0 +1,311 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_SNAPSHOT_H
+#define __GUAC_COMMON_SNAPSHOT_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * The maximum age of a snapshot, in milliseconds, for that snapshot to be
+ * sent to a newly-joining user. Changes made since a snapshot was captured
+ * must be sent to each joining user separately, so older snapshots are
+ * replaced rather than reused.
+ */
+#define GUAC_COMMON_SNAPSHOT_MAX_AGE 1000
+
+/**
+ * The state of a single visible layer at the moment a snapshot was captured.
+ */
+typedef struct guac_common_snapshot_layer {
+
+    /**
+     * The layer whose state was captured.
+     */
+    guac_layer layer;
+
+    /**
+     * The layer which contained the captured layer.
+     */
+    guac_layer parent;
+
+    /**
+     * Whether the layer existed on the client when captured. Layers which
+     * did not yet exist are neither encoded nor sent.
+     */
+    int realized;
+
+    /**
+     * The X coordinate of the upper-left corner of the layer, relative to
+     * its parent.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the layer, relative to
+     * its parent.
+     */
+    int y;
+
+    /**
+     * The Z-order of the layer, relative to sibling layers.
+     */
+    int z;
+
+    /**
+     * The opacity of the layer, where 255 is fully opaque.
+     */
+    int opacity;
+
+    /**
+     * The width of the layer, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the layer, in pixels.
+     */
+    int height;
+
+    /**
+     * The size of each row of the captured image data, in bytes.
+     */
+    int stride;
+
+    /**
+     * A copy of the image data of the layer, or NULL if the layer is empty
+     * or was not realized.
+     */
+    unsigned char* buffer;
+
+} guac_common_snapshot_layer;
+
+/**
+ * The state of all visible layers of a display at a single point in time,
+ * along with the instructions which reproduce that state on a newly-joined
+ * client. A frame is encoded once and then written, unchanged, to every user
+ * joining while it is in use. Offscreen buffers are not part of a frame, and
+ * are instead sent only once a joined user needs them.
+ */
+typedef struct guac_common_snapshot_frame {
+
+    /**
+     * The number of joining users currently using this frame. The frame is
+     * freed once no joining user is using it.
+     */
+    int refs;
+
+    /**
+     * Whether this frame has been captured and encoded. Users joining while
+     * a frame is being captured wait for the frame to become ready.
+     */
+    int ready;
+
+    /**
+     * Whether capturing or encoding this frame failed, in which case it must
+     * not be sent.
+     */
+    int failed;
+
+    /**
+     * The time at which this frame was captured.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The captured state of each layer, including the default layer.
+     */
+    guac_common_snapshot_layer* layers;
+
+    /**
+     * The number of layers within the layers array.
+     */
+    int layers_length;
+
+    /**
+     * The number of layers for which space has been allocated within the
+     * layers array.
+     */
+    int layers_available;
+
+    /**
+     * The encoded instructions which reproduce the captured layers.
+     */
+    char* data;
+
+    /**
+     * The number of bytes of encoded instructions within data.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for data.
+     */
+    size_t size;
+
+} guac_common_snapshot_frame;
+
+/**
+ * Shares the most recently captured snapshot of a display between all users
+ * joining at about the same time, such that the display is captured and
+ * encoded only once for all of them.
+ */
+typedef struct guac_common_snapshot {
+
+    /**
+     * The client associated with the display being captured.
+     */
+    guac_client* client;
+
+    /**
+     * The most recently captured frame, or NULL if no joining user is
+     * currently using a frame.
+     */
+    guac_common_snapshot_frame* current;
+
+    /**
+     * Condition which is signalled when the current frame becomes ready.
+     */
+    pthread_cond_t _ready;
+
+    /**
+     * Mutex which is locked internally when access to the snapshot must be
+     * synchronized. All public functions of guac_common_snapshot should be
+     * considered threadsafe.
+     */
+    pthread_mutex_t _lock;
+
+} guac_common_snapshot;
+
+/**
+ * Allocates a new snapshot, which initially has no frame.
+ *
+ * @param client
+ *     The client associated with the display being captured.
+ *
+ * @return
+ *     A newly-allocated snapshot, or NULL if allocation fails.
+ */
+guac_common_snapshot* guac_common_snapshot_alloc(guac_client* client);
+
+/**
+ * Frees the given snapshot. No frame of the snapshot may still be in use.
+ *
+ * @param snapshot
+ *     The snapshot to free.
+ */
+void guac_common_snapshot_free(guac_common_snapshot* snapshot);
+
+/**
+ * Acquires a frame for a joining user. If a recent frame is in use by other
+ * joining users, that frame is returned once ready. Otherwise, a new, empty
+ * frame is returned which is not yet ready, and the caller must capture each
+ * layer with guac_common_snapshot_add_layer() and then call
+ * guac_common_snapshot_encode(). Each acquired frame must be released with
+ * guac_common_snapshot_release().
+ *
+ * @param snapshot
+ *     The snapshot to acquire a frame from.
+ *
+ * @return
+ *     The acquired frame, or NULL if no frame could be allocated.
+ */
+guac_common_snapshot_frame* guac_common_snapshot_acquire(
+        guac_common_snapshot* snapshot);
+
+/**
+ * Adds a layer to the given frame, which has not yet been encoded. The
+ * returned layer is zeroed and must be populated by the caller.
+ *
+ * @param frame
+ *     The frame to add a layer to.
+ *
+ * @return
+ *     The added layer, or NULL if the frame could not be grown, in which case
+ *     the frame is marked as failed.
+ */
+guac_common_snapshot_layer* guac_common_snapshot_add_layer(
+        guac_common_snapshot_frame* frame);
+
+/**
+ * Encodes each layer of the given, newly-captured frame, and marks the frame
+ * as ready, waking any users waiting for it. No lock of the display needs to
+ * be held while encoding.
+ *
+ * @param snapshot
+ *     The snapshot which the frame was acquired from.
+ *
+ * @param frame
+ *     The frame to encode.
+ */
+void guac_common_snapshot_encode(guac_common_snapshot* snapshot,
+        guac_common_snapshot_frame* frame);
+
+/**
+ * Returns the captured state of the given layer within the given frame.
+ *
+ * @param frame
+ *     The frame to search.
+ *
+ * @param layer
+ *     The layer to find.
+ *
+ * @return
+ *     The captured state of the given layer, or NULL if the layer is not part
+ *     of the frame.
+ */
+const guac_common_snapshot_layer* guac_common_snapshot_find_layer(
+        const guac_common_snapshot_frame* frame, const guac_layer* layer);
+
+/**
+ * Writes the encoded instructions of the given frame, which must be ready and
+ * must not have failed, over the given socket.
+ *
+ * @param frame
+ *     The frame to write.
+ *
+ * @param socket
+ *     The socket of the joining user.
+ */
+void guac_common_snapshot_write(const guac_common_snapshot_frame* frame,
+        guac_socket* socket);
+
+/**
+ * Releases a frame acquired with guac_common_snapshot_acquire(), freeing the
+ * frame if no other joining user is using it.
+ *
+ * @param snapshot
+ *     The snapshot which the frame was acquired from.
+ *
+ * @param frame
+ *     The frame to release.
+ */
+void guac_common_snapshot_release(guac_common_snapshot* snapshot,
+        guac_common_snapshot_frame* frame);
+
+#endif
+
@@ -21,20 +21,50 @@
 #define __GUAC_COMMON_SURFACE_H
 
 #include "config.h"
+#include "image_cache.h"
+#include "pipeline.h"
 #include "rect.h"
+#include "snapshot.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
 #include <guacamole/layer.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/stats.h>
+#include <guacamole/stream.h>
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
- * The maximum number of updates to allow within the bitmap queue.
+ * The maximum width or height of each tile of a flushed update, in pixels.
+ * Updates larger than this are split into tiles which are encoded in
+ * parallel. This must be a multiple of both the JPEG and WebP block sizes.
  */
-#define GUAC_COMMON_SURFACE_QUEUE_SIZE 256
+#define GUAC_COMMON_SURFACE_TILE_SIZE 256
+
+/**
+ * The minimum area of a flushed update, in pixels, for that update to be
+ * split into tiles. Smaller updates gain too little from parallel encoding to
+ * outweigh the overhead of sending several images, and are encoded whole.
+ */
+#define GUAC_COMMON_SURFACE_MIN_TILED_AREA \
+    (GUAC_COMMON_SURFACE_TILE_SIZE * GUAC_COMMON_SURFACE_TILE_SIZE * 2)
+
+/**
+ * The maximum number of tiles to encode in parallel at any one time. As each
+ * tile requires its own stream until it has been sent, this must be
+ * comfortably less than GUAC_CLIENT_MAX_STREAMS.
+ */
+#define GUAC_COMMON_SURFACE_MAX_PARALLEL_TILES 32
+
+/**
+ * The minimum width and height of an update, in pixels, for which motion
+ * detection is attempted. Smaller updates are cheap enough to simply resend.
+ */
+#define GUAC_COMMON_SURFACE_MOTION_MIN_SIZE 64
 
 /**
  * Heat map cell size in pixels. Each side of each heat map cell will consist
@@ -51,6 +81,42 @@
             / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE      \
 )
 
+/**
+ * The width or height of each block of a heat map cell within which damage is
+ * tracked, in pixels. Each heat map cell contains 8x8 such blocks, such that
+ * the damage of an entire cell fits within a single 64-bit mask.
+ */
+#define GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE 8
+
+/**
+ * The width or height of each heat map cell, in damage blocks.
+ */
+#define GUAC_COMMON_SURFACE_DAMAGE_BLOCKS (                                  \
+        GUAC_COMMON_SURFACE_HEAT_CELL_SIZE                                   \
+            / GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE                          \
+)
+
+/**
+ * The number of 64-bit words required to store one bit for each cell of a
+ * row of the heat map, given the width of the heat map (in cells).
+ */
+#define GUAC_COMMON_SURFACE_DAMAGE_INDEX_WORDS(x) ((x + 63) / 64)
+
+/**
+ * The number of pixels of lossy content which may be re-sent losslessly by
+ * each flush while the client is keeping up. Pixels of any other updates
+ * within the same flush count against this budget, such that lossy content
+ * is refreshed mainly while the surface is otherwise idle.
+ */
+#define GUAC_COMMON_SURFACE_REFRESH_BUDGET (512 * 512)
+
+/**
+ * The processing lag, in milliseconds, at or beyond which lossy content is
+ * not re-sent at all. The refresh budget shrinks linearly as the processing
+ * lag of the client approaches this value.
+ */
+#define GUAC_COMMON_SURFACE_REFRESH_MAX_LAG 250
+
 /**
  * The number of entries to collect within each heat map cell. Collected
  * history entries are used to determine the framerate of the region associated
@@ -79,25 +145,308 @@ typedef struct guac_common_surface_heat_cell {
      */
     int oldest_entry;
 
+    /**
+     * The time at which lossy image data covering any part of the location
+     * associated with this heat map cell was last sent, or zero if the client
+     * displays that location losslessly.
+     */
+    guac_timestamp lossy;
+
 } guac_common_surface_heat_cell;
 
 /**
- * Representation of a bitmap update, having a rectangle of image data (stored
- * elsewhere) and a flushed/not-flushed state.
+ * The damage within a single heat map cell which has not yet been flushed.
+ */
+typedef struct guac_common_surface_damage_cell {
+
+    /**
+     * A mask in which each bit represents one
+     * GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE square block of the cell, in
+     * row-major order starting with the least significant bit. A set bit
+     * indicates that the block is at least partly damaged. If zero, the cell
+     * has no damage.
+     */
+    uint64_t blocks;
+
+    /**
+     * The smallest rectangle containing all damage within the cell. This
+     * rectangle is only meaningful if blocks is non-zero.
+     */
+    guac_common_rect rect;
+
+} guac_common_surface_damage_cell;
+
+/**
+ * A rectangle of damage which is being built up while a surface is flushed,
+ * and which may be extended downward by the damage of the next row of heat
+ * map cells.
+ */
+typedef struct guac_common_surface_damage_rect {
+
+    /**
+     * A value identifying this rectangle among all rectangles built up while
+     * flushing the same surface. Identifiers start at one.
+     */
+    int id;
+
+    /**
+     * Whether this rectangle has been extended by the damage of the row of
+     * heat map cells currently being flushed.
+     */
+    int continued;
+
+    /**
+     * The damaged rectangle.
+     */
+    guac_common_rect rect;
+
+} guac_common_surface_damage_rect;
+
+/**
+ * The lowest rectangle of damage covering any part of a column of heat map
+ * cells, tracked while a surface is flushed such that no two rectangles of
+ * damage flushed together ever overlap.
+ */
+typedef struct guac_common_surface_damage_column {
+
+    /**
+     * The Y coordinate immediately below the lowest rectangle of damage
+     * covering any part of this column, or zero if no rectangle covers this
+     * column.
+     */
+    int bottom;
+
+    /**
+     * The identifier of the lowest rectangle of damage covering any part of
+     * this column, or zero if no rectangle covers this column.
+     */
+    int owner;
+
+} guac_common_surface_damage_column;
+
+/**
+ * The content of a block of a flushed update, where each block is the portion
+ * of the update lying within a single heat map cell. Blocks are classified in
+ * a single pass over the image data of the update.
+ */
+typedef struct guac_common_surface_block {
+
+    /**
+     * The number of pixels whose color, ignoring alpha, is identical to that
+     * of the pixel before them within the same row of the update.
+     */
+    int same;
+
+    /**
+     * The number of pixels whose color, ignoring alpha, differs from that of
+     * the pixel before them within the same row of the update.
+     */
+    int different;
+
+    /**
+     * Non-zero if every pixel of the block is fully opaque, zero otherwise.
+     */
+    int opaque;
+
+    /**
+     * Non-zero if every pixel of the block, including its alpha channel, is
+     * identical to color, zero otherwise.
+     */
+    int uniform;
+
+    /**
+     * The ARGB color of the first pixel of the block.
+     */
+    uint32_t color;
+
+    /**
+     * Non-zero if this block is part of a uniform, opaque region large
+     * enough to be sent as a solid rectangle rather than as an image.
+     */
+    int fill;
+
+} guac_common_surface_block;
+
+/**
+ * A region of a flushed update which is being built up from blocks, and
+ * which may be extended downward by the blocks of the next row.
  */
-typedef struct guac_common_surface_bitmap_rect {
+typedef struct guac_common_surface_region {
 
     /**
-     * Whether this rectangle has been flushed.
+     * The number of consecutive columns of blocks covered by this region, or
+     * zero if no region begins at the corresponding column.
      */
-    int flushed;
+    int columns;
 
     /**
-     * The rectangle containing the bitmap update.
+     * Whether this region has been extended by the row of blocks currently
+     * being processed.
+     */
+    int continued;
+
+    /**
+     * The rectangle covered by this region.
      */
     guac_common_rect rect;
 
-} guac_common_surface_bitmap_rect;
+    /**
+     * The combined content of all blocks within this region.
+     */
+    guac_common_surface_block content;
+
+} guac_common_surface_region;
+
+/**
+ * The image formats which may be used to encode a tile of a flushed update.
+ */
+typedef enum guac_common_surface_tile_format {
+
+    /**
+     * The tile is encoded losslessly as PNG.
+     */
+    GUAC_COMMON_SURFACE_TILE_PNG,
+
+    /**
+     * The tile is encoded lossily as JPEG.
+     */
+    GUAC_COMMON_SURFACE_TILE_JPEG,
+
+    /**
+     * The tile is encoded lossily as WebP.
+     */
+    GUAC_COMMON_SURFACE_TILE_WEBP,
+
+    /**
+     * The tile is not encoded at all, and is instead drawn by copying an
+     * identical image from a client-side buffer of the image cache.
+     */
+    GUAC_COMMON_SURFACE_TILE_CACHED,
+
+    /**
+     * The tile is not encoded at all, and is instead drawn by copying content
+     * which the client already has from elsewhere within the same layer.
+     */
+    GUAC_COMMON_SURFACE_TILE_MOVE,
+
+    /**
+     * The tile is not encoded at all, as every pixel has the same opaque
+     * color, and is instead drawn as a solid rectangle of that color.
+     */
+    GUAC_COMMON_SURFACE_TILE_FILL
+
+} guac_common_surface_tile_format;
+
+/**
+ * A portion of a flushed update which is encoded independently of all other
+ * portions, possibly in parallel, and sent in order once encoded.
+ */
+typedef struct guac_common_surface_tile {
+
+    /**
+     * The client associated with the surface being flushed.
+     */
+    guac_client* client;
+
+    /**
+     * A copy of the layer of the surface being flushed. A copy is kept as the
+     * layer may be freed before a pipelined tile is sent.
+     */
+    guac_layer layer;
+
+    /**
+     * The statistics of the socket which this tile will be sent over, or NULL
+     * if statistics are not being collected.
+     */
+    guac_stats* stats;
+
+    /**
+     * The rectangle covered by this tile.
+     */
+    guac_common_rect rect;
+
+    /**
+     * The first pixel of the image data covered by this tile. This is either
+     * within the buffer of the surface being flushed, or, if the tile is
+     * pipelined, within a copy of that data owned by the tile.
+     */
+    unsigned char* image;
+
+    /**
+     * The number of bytes in each row of the image data.
+     */
+    int stride;
+
+    /**
+     * The format to encode this tile with.
+     */
+    guac_common_surface_tile_format format;
+
+    /**
+     * Whether this tile contains only fully-opaque pixels.
+     */
+    int opaque;
+
+    /**
+     * A copy of the client-side buffer of the image cache which is associated
+     * with this tile, if any. If the tile's format is
+     * GUAC_COMMON_SURFACE_TILE_CACHED, the tile is drawn by copying from this
+     * buffer. Otherwise, if cache_store is non-zero, the tile is copied into
+     * this buffer once drawn.
+     */
+    guac_layer cache_buffer;
+
+    /**
+     * Non-zero if the tile must be copied into cache_buffer once drawn, zero
+     * otherwise.
+     */
+    int cache_store;
+
+    /**
+     * The X coordinate of the upper-left corner of the region of the layer
+     * which is copied to draw a tile of format GUAC_COMMON_SURFACE_TILE_MOVE.
+     */
+    int src_x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the region of the layer
+     * which is copied to draw a tile of format GUAC_COMMON_SURFACE_TILE_MOVE.
+     */
+    int src_y;
+
+    /**
+     * The ARGB color of every pixel of a tile of format
+     * GUAC_COMMON_SURFACE_TILE_FILL.
+     */
+    uint32_t color;
+
+    /**
+     * The stream allocated for this tile, or NULL if this tile cannot be
+     * encoded in advance and must instead be streamed directly when sent.
+     */
+    guac_stream* stream;
+
+    /**
+     * Non-zero if encoding this tile failed, in which case nothing is sent.
+     */
+    int failed;
+
+    /**
+     * The encoded instructions for this tile.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of encoded instructions within buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for buffer.
+     */
+    size_t size;
+
+} guac_common_surface_tile;
 
 /**
  * Surface which backs a Guacamole buffer or layer, automatically
@@ -187,15 +536,63 @@ typedef struct guac_common_surface {
     int opacity_dirty;
 
     /**
-     * Non-zero if this surface is dirty and needs to be flushed, 0 otherwise.
+     * Non-zero if the update described by dirty_rect is currently being
+     * flushed and has not yet been encoded, 0 otherwise.
      */
     int dirty;
 
     /**
-     * The dirty rectangle.
+     * The rectangle of the update currently being flushed. Updates are
+     * chosen from the damage of the surface only when the surface is
+     * flushed.
      */
     guac_common_rect dirty_rect;
 
+    /**
+     * The damage of each heat map cell which has not yet been flushed, in
+     * the same order as the heat map.
+     */
+    guac_common_surface_damage_cell* damage;
+
+    /**
+     * For each row of the heat map, a bitmap of the cells within that row
+     * which have any damage, such that damaged cells can be found without
+     * inspecting every cell. Each row occupies
+     * GUAC_COMMON_SURFACE_DAMAGE_INDEX_WORDS() words.
+     */
+    uint64_t* damage_index;
+
+    /**
+     * The number of heat map cells which have any damage.
+     */
+    int damaged_cells;
+
+    /**
+     * Storage for the rectangles of damage built up while flushing, with
+     * space for twice as many rectangles as there are heat map cells within
+     * each row of the heat map.
+     */
+    guac_common_surface_damage_rect* damage_rects;
+
+    /**
+     * Storage for the lowest rectangle of damage within each column of heat
+     * map cells, used while flushing.
+     */
+    guac_common_surface_damage_column* damage_columns;
+
+    /**
+     * Storage for the content of each block of the update currently being
+     * flushed, with space for one block per heat map cell.
+     */
+    guac_common_surface_block* blocks;
+
+    /**
+     * Storage for the regions built up from blocks while the update currently
+     * being flushed is divided into images and solid rectangles, with space
+     * for one region per column of the heat map.
+     */
+    guac_common_surface_region* regions;
+
     /**
      * Whether the surface actually exists on the client.
      */
@@ -213,14 +610,66 @@ typedef struct guac_common_surface {
     guac_common_rect clip_rect;
 
     /**
-     * The number of updates in the bitmap queue.
+     * All tiles of the current flush which have not yet been sent, in the
+     * order they must be sent.
+     */
+    guac_common_surface_tile* tiles;
+
+    /**
+     * The number of tiles within the tiles array.
+     */
+    int tiles_length;
+
+    /**
+     * The number of tiles for which space has been allocated within the tiles
+     * array.
+     */
+    int tiles_available;
+
+    /**
+     * The pipeline through which tiles are encoded and sent, or NULL if tiles
+     * are encoded and sent while the surface is being flushed.
+     */
+    guac_common_pipeline* pipeline;
+
+    /**
+     * The cache of recently-sent images through which repeated tiles are
+     * drawn as copies, or NULL if tiles are always encoded.
+     */
+    guac_common_image_cache* image_cache;
+
+    /**
+     * The contents of this surface as currently displayed by the client, with
+     * the same dimensions and stride as buffer, or NULL if motion detection
+     * is disabled. Flushed updates are compared against this copy to find
+     * content which has merely moved.
+     */
+    unsigned char* previous;
+
+    /**
+     * Non-zero if previous may not match the contents of the surface as
+     * displayed by all users, in which case motion detection is skipped
+     * until the next flush has completed.
      */
-    int bitmap_queue_length;
+    int previous_stale;
 
     /**
-     * All queued bitmap updates.
+     * The users which joined without receiving the contents of this surface,
+     * and to which those contents are sent before the surface is next used
+     * as the source of a copy or transfer to another surface.
      */
-    guac_common_surface_bitmap_rect bitmap_queue[GUAC_COMMON_SURFACE_QUEUE_SIZE];
+    guac_user** dup_pending;
+
+    /**
+     * The number of users within the dup_pending array.
+     */
+    int dup_pending_length;
+
+    /**
+     * The number of users for which space has been allocated within the
+     * dup_pending array.
+     */
+    int dup_pending_available;
 
     /**
      * A heat map keeping track of the refresh frequency of
@@ -228,6 +677,19 @@ typedef struct guac_common_surface {
      */
     guac_common_surface_heat_cell* heat_map;
 
+    /**
+     * The number of milliseconds that content last sent with a lossy format
+     * must remain unchanged before it is re-sent losslessly, or zero if lossy
+     * content is never re-sent.
+     */
+    int lossless_refresh;
+
+    /**
+     * The number of heat map cells whose location was last sent with a lossy
+     * format, as recorded within each cell of the heat map.
+     */
+    int lossy_cells;
+
     /**
      * Mutex which is locked internally when access to the surface must be
      * synchronized. All public functions of guac_common_surface should be
@@ -461,6 +923,73 @@ void guac_common_surface_set_parent(guac_common_surface* surface,
  */
 void guac_common_surface_set_opacity(guac_common_surface* surface, int opacity);
 
+/**
+ * Routes all further output of the given surface through the given pipeline,
+ * such that flushed updates are encoded and sent by the pipeline rather than
+ * by the thread flushing the surface. The socket of the surface is replaced
+ * with the socket of the pipeline.
+ *
+ * @param surface
+ *     The surface whose output should be pipelined.
+ *
+ * @param pipeline
+ *     The pipeline to route output through.
+ */
+void guac_common_surface_set_pipeline(guac_common_surface* surface,
+        guac_common_pipeline* pipeline);
+
+/**
+ * Routes all further lossless updates of the given surface through the given
+ * image cache, such that images which were recently sent are drawn by copying
+ * from a client-side buffer rather than being encoded and sent again. The
+ * image cache must use the same client-side buffers as the surface, and must
+ * outlive the surface's output.
+ *
+ * @param surface
+ *     The surface whose updates should be cached.
+ *
+ * @param image_cache
+ *     The image cache to use, or NULL to stop caching updates.
+ */
+void guac_common_surface_set_image_cache(guac_common_surface* surface,
+        guac_common_image_cache* image_cache);
+
+/**
+ * Enables or disables motion detection for the given surface. When enabled,
+ * each flushed update is compared against the contents of the surface as
+ * already displayed by the client. If the update consists largely of content
+ * which has shifted vertically or horizontally, such as a scrolled document,
+ * that content is drawn with a single copy, and only the remainder of the
+ * update is encoded. Motion detection requires a second copy of the
+ * surface's image data.
+ *
+ * @param surface
+ *     The surface to enable or disable motion detection for.
+ *
+ * @param enabled
+ *     Non-zero to enable motion detection, zero to disable it.
+ */
+void guac_common_surface_set_motion_detection(guac_common_surface* surface,
+        int enabled);
+
+/**
+ * Sets the interval after which content of the given surface which was sent
+ * with a lossy format, and has not changed since, is re-sent losslessly.
+ * Such content is re-sent only by flushes which have bandwidth to spare,
+ * such that lossy updates may be freely used while content is changing
+ * without leaving the client with a permanently degraded image.
+ *
+ * @param surface
+ *     The surface to set the lossless refresh interval of.
+ *
+ * @param interval
+ *     The number of milliseconds that lossy content must remain unchanged
+ *     before it is re-sent losslessly, or zero to never re-send lossy
+ *     content.
+ */
+void guac_common_surface_set_lossless_refresh(guac_common_surface* surface,
+        int interval);
+
 /**
  * Flushes the given surface, including any applicable properties, drawing any
  * pending operations on the remote display.
@@ -486,5 +1015,76 @@ void guac_common_surface_flush(guac_common_surface* surface);
 void guac_common_surface_dup(guac_common_surface* surface, guac_user* user,
         guac_socket* socket);
 
+/**
+ * Captures the current contents and properties of the given surface within
+ * the given snapshot layer, such that the surface can be encoded for joining
+ * users without holding the surface's lock. Pending changes are not flushed,
+ * and are thus part of the captured contents.
+ *
+ * @param surface
+ *     The surface to capture.
+ *
+ * @param captured
+ *     The snapshot layer which should receive the state of the surface.
+ *
+ * @return
+ *     Zero if the surface was captured successfully, non-zero if the
+ *     captured contents could not be allocated.
+ */
+int guac_common_surface_capture(guac_common_surface* surface,
+        guac_common_snapshot_layer* captured);
+
+/**
+ * Sends only the changes made to the given surface since it was captured to
+ * the given socket, for a user which has already received the captured
+ * state. Changed contents are sent as a single image covering all changed
+ * pixels. If the surface has been resized since it was captured, the entire
+ * surface is sent as with guac_common_surface_dup().
+ *
+ * @param surface
+ *     The surface to duplicate.
+ *
+ * @param user
+ *     The user receiving the surface.
+ *
+ * @param socket
+ *     The socket over which the surface changes should be sent.
+ *
+ * @param captured
+ *     The state of the surface already sent to the user.
+ */
+void guac_common_surface_dup_changes(guac_common_surface* surface,
+        guac_user* user, guac_socket* socket,
+        const guac_common_snapshot_layer* captured);
+
+/**
+ * Defers duplicating the contents of the given offscreen buffer for the given
+ * joining user until those contents are actually needed. The entire buffer is
+ * sent to that user alone just before the buffer is next used as the source
+ * of a copy or transfer to another surface, once the user has finished
+ * joining, and is never sent if it is not.
+ *
+ * @param surface
+ *     The surface whose duplication should be deferred.
+ *
+ * @param user
+ *     The joining user which has not received the surface.
+ */
+void guac_common_surface_defer_dup(guac_common_surface* surface,
+        guac_user* user);
+
+/**
+ * Forgets the given user, which is leaving, such that deferred contents of
+ * the given surface are no longer sent to that user.
+ *
+ * @param surface
+ *     The surface to update.
+ *
+ * @param user
+ *     The user which is leaving.
+ */
+void guac_common_surface_remove_user(guac_common_surface* surface,
+        guac_user* user);
+
 #endif
 
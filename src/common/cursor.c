@@ -53,6 +53,7 @@ guac_common_cursor* guac_common_cursor_alloc(guac_client* client) {
 
     /* Associate cursor with client and allocate cursor buffer */
     cursor->client = client;
+    cursor->socket = client->socket;
     cursor->buffer = guac_client_alloc_buffer(client);
 
     /* Allocate initial image buffer */
@@ -90,7 +91,7 @@ void guac_common_cursor_free(guac_common_cursor* cursor) {
         cairo_surface_destroy(surface);
 
     /* Destroy buffer within remotely-connected client */
-    guac_protocol_send_dispose(client->socket, buffer);
+    guac_protocol_send_dispose(cursor->socket, buffer);
 
     /* Return buffer to pool */
     guac_client_free_buffer(client, buffer);
@@ -99,6 +100,11 @@ void guac_common_cursor_free(guac_common_cursor* cursor) {
 
 }
 
+void guac_common_cursor_set_socket(guac_common_cursor* cursor,
+        guac_socket* socket) {
+    cursor->socket = socket;
+}
+
 void guac_common_cursor_dup(guac_common_cursor* cursor, guac_user* user,
         guac_socket* socket) {
 
@@ -229,18 +235,17 @@ void guac_common_cursor_set_argb(guac_common_cursor* cursor, int hx, int hy,
     cursor->hotspot_y = hy;
 
     /* Broadcast new cursor image to all users */
-    guac_protocol_send_size(cursor->client->socket, cursor->buffer,
-            width, height);
+    guac_protocol_send_size(cursor->socket, cursor->buffer, width, height);
 
-    guac_client_stream_png(cursor->client, cursor->client->socket,
+    guac_client_stream_png(cursor->client, cursor->socket,
             GUAC_COMP_SRC, cursor->buffer, 0, 0, cursor->surface);
 
     /* Update cursor image */
-    guac_protocol_send_cursor(cursor->client->socket,
+    guac_protocol_send_cursor(cursor->socket,
             cursor->hotspot_x, cursor->hotspot_y,
             cursor->buffer, 0, 0, cursor->width, cursor->height);
 
-    guac_socket_flush(cursor->client->socket);
+    guac_socket_flush(cursor->socket);
 
 }
 
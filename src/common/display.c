@@ -19,6 +19,9 @@
 
 #include "common/cursor.h"
 #include "common/display.h"
+#include "common/image_cache.h"
+#include "common/pipeline.h"
+#include "common/snapshot.h"
 #include "common/surface.h"
 
 #include <guacamole/client.h>
@@ -79,11 +82,12 @@ static void guac_common_display_free_layers(guac_common_display_layer* layers,
         guac_common_display_layer* next = current->next;
         guac_layer* layer = current->layer;
 
-        /* Free surface */
+        /* Free surface, destroying layer in order with its other output */
+        guac_socket* socket = current->surface->socket;
         guac_common_surface_free(current->surface);
 
         /* Destroy layer within remotely-connected client */
-        guac_protocol_send_dispose(client->socket, layer);
+        guac_protocol_send_dispose(socket, layer);
 
         /* Free layer or buffer depending on index */
         if (layer->index < 0)
@@ -138,10 +142,22 @@ guac_common_display* guac_common_display_alloc(guac_client* client,
     display->default_surface = guac_common_surface_alloc(client,
             client->socket, GUAC_DEFAULT_LAYER, width, height);
 
+    /* Draw repeated images from a shared cache, if one can be allocated */
+    display->image_cache = guac_common_image_cache_alloc(client,
+            GUAC_COMMON_IMAGE_CACHE_DEFAULT_SIZE);
+    guac_common_surface_set_image_cache(display->default_surface,
+            display->image_cache);
+
+    /* Share the work of synchronizing joining users, if possible */
+    display->snapshot = guac_common_snapshot_alloc(client);
+
     /* No initial layers or buffers */
     display->layers = NULL;
     display->buffers = NULL;
 
+    /* Output is not pipelined by default */
+    display->pipeline = NULL;
+
     return display;
 
 }
@@ -158,25 +174,232 @@ void guac_common_display_free(guac_common_display* display) {
     guac_common_display_free_layers(display->buffers, display->client);
     guac_common_display_free_layers(display->layers, display->client);
 
+    /* Send all remaining output */
+    if (display->pipeline != NULL)
+        guac_common_pipeline_free(display->pipeline);
+
+    /* Free cached images only once nothing more can be copied from them */
+    if (display->image_cache != NULL)
+        guac_common_image_cache_free(display->image_cache,
+                display->client->socket);
+
+    if (display->snapshot != NULL)
+        guac_common_snapshot_free(display->snapshot);
+
     pthread_mutex_destroy(&display->_lock);
     free(display);
 
 }
 
-void guac_common_display_dup(guac_common_display* display, guac_user* user,
+/**
+ * Captures the state of the default layer and all visible layers of the given
+ * display within the given frame. Offscreen buffers are not captured. The
+ * display must already be locked, and all pending output of the display must
+ * already have been sent, such that the frame matches the state of the display
+ * as displayed by all users.
+ *
+ * @param display
+ *     The display to capture.
+ *
+ * @param frame
+ *     The frame which should receive the state of each captured layer.
+ */
+static void guac_common_display_capture(guac_common_display* display,
+        guac_common_snapshot_frame* frame) {
+
+    guac_common_display_layer* current;
+    guac_common_snapshot_layer* captured;
+
+    captured = guac_common_snapshot_add_layer(frame);
+    if (captured == NULL
+            || guac_common_surface_capture(display->default_surface,
+                captured)) {
+        frame->failed = 1;
+        return;
+    }
+
+    for (current = display->layers; current != NULL; current = current->next) {
+        captured = guac_common_snapshot_add_layer(frame);
+        if (captured == NULL
+                || guac_common_surface_capture(current->surface, captured)) {
+            frame->failed = 1;
+            return;
+        }
+    }
+
+}
+
+/**
+ * Sends to the given socket all changes made to the visible layers of the
+ * given display since the given frame was captured, for a user which has
+ * already received that frame. Layers which have since been freed are
+ * disposed, and layers which have since been allocated are sent in full. The
+ * display must already be locked.
+ *
+ * @param display
+ *     The display whose state should be sent along the given socket.
+ *
+ * @param frame
+ *     The frame already received by the user.
+ *
+ * @param user
+ *     The user receiving the display state.
+ *
+ * @param socket
+ *     The socket over which the display state should be sent.
+ */
+static void guac_common_display_dup_changes(guac_common_display* display,
+        const guac_common_snapshot_frame* frame, guac_user* user,
         guac_socket* socket) {
 
+    guac_common_display_layer* current;
+    const guac_common_snapshot_layer* captured;
+    int i;
+
+    /* Dispose of captured layers which no longer exist */
+    for (i = 0; i < frame->layers_length; i++) {
+
+        captured = &frame->layers[i];
+        if (captured->layer.index <= 0 || !captured->realized)
+            continue;
+
+        for (current = display->layers; current != NULL;
+                current = current->next) {
+            if (current->layer->index == captured->layer.index)
+                break;
+        }
+
+        if (current == NULL)
+            guac_protocol_send_dispose(socket, &captured->layer);
+
+    }
+
+    /* Send changes to the default layer */
+    captured = guac_common_snapshot_find_layer(frame, GUAC_DEFAULT_LAYER);
+    if (captured != NULL)
+        guac_common_surface_dup_changes(display->default_surface, user,
+                socket, captured);
+    else
+        guac_common_surface_dup(display->default_surface, user, socket);
+
+    /* Send changes to all other layers, or the entire layer if new */
+    for (current = display->layers; current != NULL; current = current->next) {
+        captured = guac_common_snapshot_find_layer(frame, current->layer);
+        if (captured != NULL)
+            guac_common_surface_dup_changes(current->surface, user, socket,
+                    captured);
+        else
+            guac_common_surface_dup(current->surface, user, socket);
+    }
+
+}
+
+/**
+ * Locks the given display once all output previously added to its pipeline,
+ * if any, has been sent. Pending output is waited for only while the display
+ * is unlocked, such that a lagging client cannot stall other users of the
+ * display, and is checked again once locked in case further output was added
+ * meanwhile.
+ *
+ * @param display
+ *     The display to lock.
+ */
+static void guac_common_display_lock_sent(guac_common_display* display) {
+
     pthread_mutex_lock(&display->_lock);
 
+    while (display->pipeline != NULL
+            && !guac_common_pipeline_is_idle(display->pipeline)) {
+
+        guac_common_pipeline* pipeline = display->pipeline;
+
+        pthread_mutex_unlock(&display->_lock);
+        guac_common_pipeline_wait(pipeline);
+        pthread_mutex_lock(&display->_lock);
+
+    }
+
+}
+
+void guac_common_display_dup(guac_common_display* display, guac_user* user,
+        guac_socket* socket) {
+
+    guac_common_snapshot_frame* frame = NULL;
+    guac_common_display_layer* current;
+
+    /* Share a snapshot of all visible layers with other joining users */
+    if (display->snapshot != NULL)
+        frame = guac_common_snapshot_acquire(display->snapshot);
+
+    /* Capture a new snapshot if no recent snapshot is available, encoding
+     * that snapshot only after the display has been unlocked */
+    if (frame != NULL && !frame->ready) {
+
+        /* Capture the display as already sent to all other users */
+        guac_common_display_lock_sent(display);
+        guac_common_display_capture(display, frame);
+
+        pthread_mutex_unlock(&display->_lock);
+
+        guac_common_snapshot_encode(display->snapshot, frame);
+
+    }
+
+    /* Send snapshot before any changes made since it was captured */
+    if (frame != NULL && !frame->failed)
+        guac_common_snapshot_write(frame, socket);
+
+    /* Send pending output first, such that the new user does not receive
+     * changes already reflected in the synchronized state */
+    guac_common_display_lock_sent(display);
+
     /* Sunchronize shared cursor */
     guac_common_cursor_dup(display->cursor, user, socket);
 
-    /* Synchronize default surface */
-    guac_common_surface_dup(display->default_surface, user, socket);
+    /* Synchronize only what has changed since the snapshot */
+    if (frame != NULL && !frame->failed) {
+
+        guac_common_display_dup_changes(display, frame, user, socket);
 
-    /* Synchronize all layers and buffers */
-    guac_common_display_dup_layers(display->layers, user, socket);
-    guac_common_display_dup_layers(display->buffers, user, socket);
+        /* Send buffers only once referenced by a visible layer */
+        for (current = display->buffers; current != NULL;
+                current = current->next)
+            guac_common_surface_defer_dup(current->surface, user);
+
+    }
+
+    /* Without a snapshot, synchronize all layers and buffers in full */
+    else {
+        guac_common_surface_dup(display->default_surface, user, socket);
+        guac_common_display_dup_layers(display->layers, user, socket);
+        guac_common_display_dup_layers(display->buffers, user, socket);
+    }
+
+    /* Synchronize buffers of cached images */
+    if (display->image_cache != NULL)
+        guac_common_image_cache_dup(display->image_cache, user, socket);
+
+    pthread_mutex_unlock(&display->_lock);
+
+    if (frame != NULL)
+        guac_common_snapshot_release(display->snapshot, frame);
+
+}
+
+void guac_common_display_remove_user(guac_common_display* display,
+        guac_user* user) {
+
+    guac_common_display_layer* current;
+
+    pthread_mutex_lock(&display->_lock);
+
+    /* Update shared cursor state */
+    guac_common_cursor_remove_user(display->cursor, user);
+
+    /* Buffers not yet sent to the user are no longer needed */
+    for (current = display->buffers; current != NULL;
+            current = current->next)
+        guac_common_surface_remove_user(current->surface, user);
 
     pthread_mutex_unlock(&display->_lock);
 
@@ -200,6 +423,100 @@ void guac_common_display_flush(guac_common_display* display) {
 
 }
 
+void guac_common_display_end_frame(guac_common_display* display) {
+
+    guac_common_display_flush(display);
+
+    /* Let pipeline end frame once all prior output has been sent */
+    if (display->pipeline != NULL)
+        guac_common_pipeline_end_frame(display->pipeline);
+
+    /* Otherwise, all output has already been sent */
+    else {
+        guac_client_end_frame(display->client);
+        guac_socket_flush(display->client->socket);
+    }
+
+}
+
+/**
+ * Routes all further output of each surface within the given linked list
+ * through the given pipeline. If the provided pointer to the linked list is
+ * NULL, this function has no effect.
+ *
+ * @param layers
+ *     The head element of the linked list of layers whose output should be
+ *     pipelined, which may be NULL if the list is currently empty.
+ *
+ * @param pipeline
+ *     The pipeline to route output through.
+ */
+static void guac_common_display_pipeline_layers(
+        guac_common_display_layer* layers, guac_common_pipeline* pipeline) {
+
+    guac_common_display_layer* current = layers;
+
+    /* Pipeline each surface in given list */
+    while (current != NULL) {
+        guac_common_surface_set_pipeline(current->surface, pipeline);
+        current = current->next;
+    }
+
+}
+
+int guac_common_display_enable_pipeline(guac_common_display* display) {
+
+    int retval = 0;
+
+    pthread_mutex_lock(&display->_lock);
+
+    /* Nothing to do if already enabled */
+    if (display->pipeline != NULL)
+        goto complete;
+
+    display->pipeline = guac_common_pipeline_alloc(display->client,
+            display->client->socket);
+
+    if (display->pipeline == NULL) {
+        retval = 1;
+        goto complete;
+    }
+
+    /* Route output of all existing surfaces through pipeline */
+    guac_common_surface_set_pipeline(display->default_surface,
+            display->pipeline);
+    guac_common_display_pipeline_layers(display->layers, display->pipeline);
+    guac_common_display_pipeline_layers(display->buffers, display->pipeline);
+
+    /* Send cursor images in order with all other output */
+    guac_common_cursor_set_socket(display->cursor, display->pipeline->socket);
+
+complete:
+    pthread_mutex_unlock(&display->_lock);
+    return retval;
+
+}
+
+/**
+ * Returns the socket over which all output of the given display should be
+ * sent, which is the socket of the display's pipeline if pipelining is
+ * enabled.
+ *
+ * @param display
+ *     The display whose socket should be returned.
+ *
+ * @return
+ *     The socket over which all output of the given display should be sent.
+ */
+static guac_socket* guac_common_display_socket(guac_common_display* display) {
+
+    if (display->pipeline != NULL)
+        return display->pipeline->socket;
+
+    return display->client->socket;
+
+}
+
 /**
  * Allocates and inserts a new element into the given linked list of display
  * layers, associating it with the given layer and surface.
@@ -283,9 +600,15 @@ guac_common_display_layer* guac_common_display_alloc_layer(
     /* Allocate Guacamole layer */
     guac_layer* layer = guac_client_alloc_layer(display->client);
 
-    /* Allocate corresponding surface */
+    /* Allocate corresponding surface, routing output through pipeline if
+     * enabled */
     guac_common_surface* surface = guac_common_surface_alloc(display->client,
-            display->client->socket, layer, width, height);
+            guac_common_display_socket(display), layer, width, height);
+
+    if (display->pipeline != NULL)
+        guac_common_surface_set_pipeline(surface, display->pipeline);
+
+    guac_common_surface_set_image_cache(surface, display->image_cache);
 
     /* Add layer and surface to list */
     guac_common_display_layer* display_layer =
@@ -304,9 +627,15 @@ guac_common_display_layer* guac_common_display_alloc_buffer(
     /* Allocate Guacamole buffer */
     guac_layer* buffer = guac_client_alloc_buffer(display->client);
 
-    /* Allocate corresponding surface */
+    /* Allocate corresponding surface, routing output through pipeline if
+     * enabled */
     guac_common_surface* surface = guac_common_surface_alloc(display->client,
-            display->client->socket, buffer, width, height);
+            guac_common_display_socket(display), buffer, width, height);
+
+    if (display->pipeline != NULL)
+        guac_common_surface_set_pipeline(surface, display->pipeline);
+
+    guac_common_surface_set_image_cache(surface, display->image_cache);
 
     /* Add buffer and surface to list */
     guac_common_display_layer* display_layer =
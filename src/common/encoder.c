@@ -0,0 +1,311 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/encoder.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <unistd.h>
+
+/**
+ * A batch of encoding tasks which is being run by the encoder pool.
+ */
+typedef struct guac_common_encoder_batch {
+
+    /**
+     * The task to run for each element.
+     */
+    guac_common_encoder_task* task;
+
+    /**
+     * The first element of the array of elements.
+     */
+    char* data;
+
+    /**
+     * The size of each element, in bytes.
+     */
+    size_t size;
+
+    /**
+     * The number of elements in the array.
+     */
+    int count;
+
+    /**
+     * The index of the next element which has not yet been claimed by any
+     * thread. This is incremented atomically as elements are claimed.
+     */
+    int next;
+
+    /**
+     * The maximum number of worker threads which may join this batch.
+     */
+    int max_workers;
+
+    /**
+     * The number of worker threads which have joined this batch.
+     */
+    int joined;
+
+    /**
+     * The number of worker threads which have joined this batch but have not
+     * yet finished handling elements.
+     */
+    int active;
+
+    /**
+     * Non-zero if no further worker threads may join this batch, as the
+     * calling thread has found all elements to be claimed.
+     */
+    int closed;
+
+} guac_common_encoder_batch;
+
+/**
+ * Lock which guards all encoder pool state.
+ */
+static pthread_mutex_t __guac_common_encoder_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled when a new batch becomes available to worker
+ * threads.
+ */
+static pthread_cond_t __guac_common_encoder_batch_started =
+    PTHREAD_COND_INITIALIZER;
+
+/**
+ * Condition which is signalled when the last active worker thread has
+ * finished handling elements of the current batch.
+ */
+static pthread_cond_t __guac_common_encoder_batch_finished =
+    PTHREAD_COND_INITIALIZER;
+
+/**
+ * The current batch. Only one batch may be run by the pool at a time.
+ */
+static guac_common_encoder_batch __guac_common_encoder_batch;
+
+/**
+ * Non-zero if the current batch is still being run, zero if the pool is idle.
+ */
+static int __guac_common_encoder_busy = 0;
+
+/**
+ * Incremented each time a new batch is started, allowing worker threads to
+ * recognize batches they have not yet seen.
+ */
+static unsigned int __guac_common_encoder_generation = 0;
+
+/**
+ * The number of threads requested via guac_common_encoder_set_threads(), or
+ * zero if the number of threads should be chosen automatically.
+ */
+static int __guac_common_encoder_requested_threads = 0;
+
+/**
+ * The number of worker threads which have been started.
+ */
+static int __guac_common_encoder_workers = 0;
+
+/**
+ * Claims and handles elements of the given batch until all elements have
+ * been claimed.
+ *
+ * @param batch
+ *     The batch whose elements should be handled.
+ */
+static void __guac_common_encoder_handle(guac_common_encoder_batch* batch) {
+
+    int index;
+
+    while ((index = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED))
+            < batch->count)
+        batch->task(batch->data + index * batch->size);
+
+}
+
+/**
+ * Worker thread which joins each batch started after the thread itself was
+ * started, handling elements of that batch alongside the calling thread.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Never returns.
+ */
+static void* __guac_common_encoder_worker(void* data) {
+
+    guac_common_encoder_batch* batch = &__guac_common_encoder_batch;
+
+    pthread_mutex_lock(&__guac_common_encoder_lock);
+    unsigned int seen = __guac_common_encoder_generation;
+
+    for (;;) {
+
+        /* Wait for a batch not yet seen */
+        while (seen == __guac_common_encoder_generation)
+            pthread_cond_wait(&__guac_common_encoder_batch_started,
+                    &__guac_common_encoder_lock);
+
+        seen = __guac_common_encoder_generation;
+
+        /* Join only if the batch still needs help */
+        if (!__guac_common_encoder_busy || batch->closed
+                || batch->joined >= batch->max_workers)
+            continue;
+
+        batch->joined++;
+        batch->active++;
+
+        pthread_mutex_unlock(&__guac_common_encoder_lock);
+        __guac_common_encoder_handle(batch);
+        pthread_mutex_lock(&__guac_common_encoder_lock);
+
+        /* Notify calling thread once all workers are done */
+        if (--batch->active == 0)
+            pthread_cond_signal(&__guac_common_encoder_batch_finished);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Starts worker threads until the given number of worker threads are
+ * running. The encoder pool lock must be held.
+ *
+ * @param workers
+ *     The total number of worker threads which should be running.
+ */
+static void __guac_common_encoder_start_workers(int workers) {
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    while (__guac_common_encoder_workers < workers) {
+
+        pthread_t thread;
+
+        /* Simply use fewer threads if no more can be started */
+        if (pthread_create(&thread, &attributes,
+                    __guac_common_encoder_worker, NULL))
+            break;
+
+        __guac_common_encoder_workers++;
+
+    }
+
+    pthread_attr_destroy(&attributes);
+
+}
+
+void guac_common_encoder_set_threads(int threads) {
+
+    pthread_mutex_lock(&__guac_common_encoder_lock);
+    __guac_common_encoder_requested_threads = threads;
+    pthread_mutex_unlock(&__guac_common_encoder_lock);
+
+}
+
+int guac_common_encoder_get_threads() {
+
+    pthread_mutex_lock(&__guac_common_encoder_lock);
+    int threads = __guac_common_encoder_requested_threads;
+    pthread_mutex_unlock(&__guac_common_encoder_lock);
+
+    /* Use one thread per CPU by default */
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (threads > GUAC_COMMON_ENCODER_MAX_THREADS)
+        threads = GUAC_COMMON_ENCODER_MAX_THREADS;
+
+    if (threads < 1)
+        threads = 1;
+
+    return threads;
+
+}
+
+void guac_common_encoder_run(guac_common_encoder_task* task, void* data,
+        size_t size, int count) {
+
+    guac_common_encoder_batch* batch = &__guac_common_encoder_batch;
+    int workers = guac_common_encoder_get_threads() - 1;
+
+    /* Never use more workers than there are remaining elements */
+    if (workers > count - 1)
+        workers = count - 1;
+
+    pthread_mutex_lock(&__guac_common_encoder_lock);
+
+    /* Run serially if parallelism is not possible or not useful */
+    if (workers <= 0 || __guac_common_encoder_busy) {
+
+        pthread_mutex_unlock(&__guac_common_encoder_lock);
+
+        int i;
+        for (i = 0; i < count; i++)
+            task((char*) data + i * size);
+
+        return;
+
+    }
+
+    __guac_common_encoder_start_workers(workers);
+
+    /* Publish new batch to worker threads */
+    batch->task = task;
+    batch->data = (char*) data;
+    batch->size = size;
+    batch->count = count;
+    batch->next = 0;
+    batch->max_workers = workers;
+    batch->joined = 0;
+    batch->active = 0;
+    batch->closed = 0;
+
+    __guac_common_encoder_busy = 1;
+    __guac_common_encoder_generation++;
+    pthread_cond_broadcast(&__guac_common_encoder_batch_started);
+
+    pthread_mutex_unlock(&__guac_common_encoder_lock);
+
+    /* Handle elements alongside worker threads */
+    __guac_common_encoder_handle(batch);
+
+    /* Wait for any workers still handling their final elements */
+    pthread_mutex_lock(&__guac_common_encoder_lock);
+
+    batch->closed = 1;
+    while (batch->active > 0)
+        pthread_cond_wait(&__guac_common_encoder_batch_finished,
+                &__guac_common_encoder_lock);
+
+    __guac_common_encoder_busy = 0;
+
+    pthread_mutex_unlock(&__guac_common_encoder_lock);
+
+}
+
@@ -0,0 +1,344 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/image_cache.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/hash.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+guac_common_image_cache* guac_common_image_cache_alloc(guac_client* client,
+        size_t max_size) {
+
+    guac_common_image_cache* cache = calloc(1,
+            sizeof(guac_common_image_cache));
+    if (cache == NULL)
+        return NULL;
+
+    /* Every evicted buffer can be held for reuse */
+    cache->free_buffers = malloc(sizeof(guac_layer*)
+            * GUAC_COMMON_IMAGE_CACHE_MAX_ENTRIES);
+    if (cache->free_buffers == NULL) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->client = client;
+    cache->max_size = max_size;
+
+    pthread_mutex_init(&cache->_lock, NULL);
+
+    return cache;
+
+}
+
+void guac_common_image_cache_free(guac_common_image_cache* cache,
+        guac_socket* socket) {
+
+    guac_client* client = cache->client;
+    guac_common_image_cache_entry* current = cache->newest;
+    int i;
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Image cache: %lu hits, "
+            "%lu misses, %lu evictions.", cache->hits, cache->misses,
+            cache->evictions);
+
+    /* Free all cached images and their buffers */
+    while (current != NULL) {
+
+        guac_common_image_cache_entry* older = current->older;
+
+        guac_protocol_send_dispose(socket, current->buffer);
+        guac_client_free_buffer(client, current->buffer);
+
+        free(current->image);
+        free(current);
+
+        current = older;
+
+    }
+
+    /* Free all buffers awaiting reuse */
+    for (i = 0; i < cache->free_buffers_length; i++) {
+        guac_protocol_send_dispose(socket, cache->free_buffers[i]);
+        guac_client_free_buffer(client, cache->free_buffers[i]);
+    }
+
+    pthread_mutex_destroy(&cache->_lock);
+
+    free(cache->free_buffers);
+    free(cache);
+
+}
+
+/**
+ * Removes the given entry from the list of entries ordered by use. The cache
+ * lock must be held.
+ *
+ * @param cache
+ *     The image cache containing the entry.
+ *
+ * @param entry
+ *     The entry to remove.
+ */
+static void guac_common_image_cache_unlink(guac_common_image_cache* cache,
+        guac_common_image_cache_entry* entry) {
+
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+}
+
+/**
+ * Adds the given entry to the list of entries ordered by use as the most
+ * recently used entry. The cache lock must be held.
+ *
+ * @param cache
+ *     The image cache containing the entry.
+ *
+ * @param entry
+ *     The entry to add.
+ */
+static void guac_common_image_cache_touch(guac_common_image_cache* cache,
+        guac_common_image_cache_entry* entry) {
+
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+
+    cache->newest = entry;
+
+}
+
+/**
+ * Evicts the least recently used entry from the given cache, holding its
+ * buffer for reuse. The cache must not be empty, and the cache lock must be
+ * held.
+ *
+ * @param cache
+ *     The image cache to evict an entry from.
+ */
+static void guac_common_image_cache_evict(guac_common_image_cache* cache) {
+
+    guac_common_image_cache_entry* entry = cache->oldest;
+    guac_common_image_cache_unlink(cache, entry);
+
+    /* Remove from hash table */
+    guac_common_image_cache_entry** current =
+        &cache->buckets[entry->hash & (GUAC_COMMON_IMAGE_CACHE_BUCKETS - 1)];
+
+    while (*current != entry)
+        current = &(*current)->next_in_bucket;
+
+    *current = entry->next_in_bucket;
+
+    /* Buffer may be reused by the next cached image */
+    cache->free_buffers[cache->free_buffers_length++] = entry->buffer;
+
+    cache->size -= (size_t) entry->width * entry->height * 4;
+    cache->length--;
+    cache->evictions++;
+
+    free(entry->image);
+    free(entry);
+
+}
+
+/**
+ * Returns whether the pixel data of the given entry is identical to the given
+ * image.
+ *
+ * @param entry
+ *     The entry to compare.
+ *
+ * @param image
+ *     The first pixel of the image to compare against.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image.
+ *
+ * @return
+ *     Non-zero if the entry contains the given image, zero otherwise.
+ */
+static int guac_common_image_cache_matches(
+        guac_common_image_cache_entry* entry, const unsigned char* image,
+        int stride) {
+
+    size_t row_length = (size_t) entry->width * 4;
+    const unsigned char* cached = entry->image;
+    int y;
+
+    for (y = 0; y < entry->height; y++) {
+
+        if (memcmp(cached, image, row_length) != 0)
+            return 0;
+
+        cached += row_length;
+        image += stride;
+
+    }
+
+    return 1;
+
+}
+
+const guac_layer* guac_common_image_cache_lookup(
+        guac_common_image_cache* cache, const unsigned char* image,
+        int width, int height, int stride, int* hit) {
+
+    guac_common_image_cache_entry* entry;
+    const guac_layer* buffer = NULL;
+    int y;
+
+    /* Small images are not worth caching */
+    if (width * height < GUAC_COMMON_IMAGE_CACHE_MIN_PIXELS)
+        return NULL;
+
+    size_t row_length = (size_t) width * 4;
+    size_t size = row_length * height;
+
+    uint64_t hash = guac_hash_image(image, width, height, stride);
+    int bucket = hash & (GUAC_COMMON_IMAGE_CACHE_BUCKETS - 1);
+    int seen = hash & (GUAC_COMMON_IMAGE_CACHE_SEEN - 1);
+
+    pthread_mutex_lock(&cache->_lock);
+
+    /* Use existing copy of image if present */
+    for (entry = cache->buckets[bucket]; entry != NULL;
+            entry = entry->next_in_bucket) {
+
+        if (entry->hash == hash && entry->width == width
+                && entry->height == height
+                && guac_common_image_cache_matches(entry, image, stride)) {
+
+            guac_common_image_cache_unlink(cache, entry);
+            guac_common_image_cache_touch(cache, entry);
+
+            cache->hits++;
+            *hit = 1;
+
+            buffer = entry->buffer;
+            goto complete;
+
+        }
+
+    }
+
+    cache->misses++;
+
+    /* Cache only images which have been seen before */
+    if (cache->seen[seen] != hash) {
+        cache->seen[seen] = hash;
+        goto complete;
+    }
+
+    if (size > cache->max_size)
+        goto complete;
+
+    entry = malloc(sizeof(guac_common_image_cache_entry));
+    if (entry == NULL)
+        goto complete;
+
+    entry->image = malloc(size);
+    if (entry->image == NULL) {
+        free(entry);
+        goto complete;
+    }
+
+    /* Make room for new image */
+    while (cache->length >= GUAC_COMMON_IMAGE_CACHE_MAX_ENTRIES
+            || cache->size + size > cache->max_size)
+        guac_common_image_cache_evict(cache);
+
+    /* Reuse buffer of an evicted image if possible */
+    if (cache->free_buffers_length > 0)
+        entry->buffer = cache->free_buffers[--cache->free_buffers_length];
+    else
+        entry->buffer = guac_client_alloc_buffer(cache->client);
+
+    for (y = 0; y < height; y++)
+        memcpy(entry->image + y * row_length, image + y * stride, row_length);
+
+    entry->hash = hash;
+    entry->width = width;
+    entry->height = height;
+
+    /* Add to hash table */
+    entry->next_in_bucket = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+
+    guac_common_image_cache_touch(cache, entry);
+
+    cache->size += size;
+    cache->length++;
+    cache->seen[seen] = 0;
+
+    *hit = 0;
+    buffer = entry->buffer;
+
+complete:
+    pthread_mutex_unlock(&cache->_lock);
+    return buffer;
+
+}
+
+void guac_common_image_cache_dup(guac_common_image_cache* cache,
+        guac_user* user, guac_socket* socket) {
+
+    guac_common_image_cache_entry* current;
+
+    pthread_mutex_lock(&cache->_lock);
+
+    /* Send each cached image to its buffer */
+    for (current = cache->newest; current != NULL; current = current->older) {
+
+        cairo_surface_t* image = cairo_image_surface_create_for_data(
+                current->image, CAIRO_FORMAT_ARGB32, current->width,
+                current->height, current->width * 4);
+
+        guac_user_stream_png(user, socket, GUAC_COMP_SRC, current->buffer,
+                0, 0, image);
+        cairo_surface_destroy(image);
+
+    }
+
+    pthread_mutex_unlock(&cache->_lock);
+
+}
@@ -0,0 +1,463 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/encoder.h"
+#include "common/pipeline.h"
+
+#include <guacamole/client.h>
+#include <guacamole/error.h>
+#include <guacamole/socket.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Appends the given item to the end of the given pipeline, waking the
+ * pipeline thread. The pipeline lock must be held.
+ *
+ * @param pipeline
+ *     The pipeline to append the item to.
+ *
+ * @param item
+ *     The item to append.
+ */
+static void guac_common_pipeline_append(guac_common_pipeline* pipeline,
+        guac_common_pipeline_item* item) {
+
+    item->next = NULL;
+
+    if (pipeline->tail != NULL)
+        pipeline->tail->next = item;
+    else
+        pipeline->head = item;
+
+    pipeline->tail = item;
+    pipeline->pending_items++;
+
+    pthread_cond_signal(&pipeline->items_added);
+
+}
+
+/**
+ * Encoder task which encodes the job referenced by the given pointer.
+ *
+ * @param data
+ *     A pointer to a pointer to the guac_common_pipeline_item of the job to
+ *     encode.
+ */
+static void guac_common_pipeline_encode_job(void* data) {
+    guac_common_pipeline_item* item = *((guac_common_pipeline_item**) data);
+    item->encode_handler(item->data);
+}
+
+/**
+ * Writes or sends the given item to the target socket of the given pipeline,
+ * and frees the item. Any job within the item must already be encoded.
+ *
+ * @param pipeline
+ *     The pipeline that the item was added to.
+ *
+ * @param item
+ *     The item to process.
+ */
+static void guac_common_pipeline_process(guac_common_pipeline* pipeline,
+        guac_common_pipeline_item* item) {
+
+    guac_socket* target = pipeline->target;
+
+    switch (item->type) {
+
+        /* Write all data directly as a single unit */
+        case GUAC_COMMON_PIPELINE_DATA:
+            guac_socket_instruction_begin(target);
+            guac_socket_write(target, item->buffer, item->length);
+            guac_socket_instruction_end(target);
+            break;
+
+        /* Send encoded jobs as the job sees fit */
+        case GUAC_COMMON_PIPELINE_JOB:
+            item->send_handler(item->data, target);
+            break;
+
+        /* End frame and make it visible to users */
+        case GUAC_COMMON_PIPELINE_FRAME:
+            guac_client_end_frame(pipeline->client);
+            guac_socket_flush(target);
+            break;
+
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+
+    if (item->type == GUAC_COMMON_PIPELINE_JOB)
+        pipeline->pending_jobs--;
+    else if (item->type == GUAC_COMMON_PIPELINE_FRAME)
+        pipeline->pending_frames--;
+
+    pipeline->pending_items--;
+    pthread_cond_broadcast(&pipeline->items_processed);
+
+    pthread_mutex_unlock(&pipeline->lock);
+
+    free(item->buffer);
+    free(item);
+
+}
+
+/**
+ * Thread which repeatedly takes all items awaiting processing within the
+ * given pipeline, encodes all jobs among those items in parallel, and then
+ * processes each item in order. The thread terminates once the pipeline is
+ * being freed and all items have been processed.
+ *
+ * @param data
+ *     The guac_common_pipeline to process.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_common_pipeline_thread(void* data) {
+
+    guac_common_pipeline* pipeline = (guac_common_pipeline*) data;
+
+    guac_common_pipeline_item** jobs = NULL;
+    int jobs_available = 0;
+
+    pthread_mutex_lock(&pipeline->lock);
+
+    for (;;) {
+
+        /* Wait until there is something to do */
+        while (pipeline->head == NULL && !pipeline->stopping)
+            pthread_cond_wait(&pipeline->items_added, &pipeline->lock);
+
+        /* All items processed; stop if the pipeline is being freed */
+        if (pipeline->head == NULL)
+            break;
+
+        /* Take all items awaiting processing */
+        guac_common_pipeline_item* items = pipeline->head;
+        pipeline->head = NULL;
+        pipeline->tail = NULL;
+
+        pthread_mutex_unlock(&pipeline->lock);
+
+        guac_common_pipeline_item* current;
+        int job_count = 0;
+
+        /* Gather all jobs among taken items */
+        for (current = items; current != NULL; current = current->next) {
+
+            if (current->type != GUAC_COMMON_PIPELINE_JOB)
+                continue;
+
+            /* Grow job list as necessary */
+            if (job_count == jobs_available) {
+
+                int available = jobs_available ? jobs_available * 2 : 16;
+                guac_common_pipeline_item** grown = realloc(jobs,
+                        sizeof(guac_common_pipeline_item*) * available);
+
+                /* Encode immediately if the job cannot be gathered */
+                if (grown == NULL) {
+                    current->encode_handler(current->data);
+                    continue;
+                }
+
+                jobs = grown;
+                jobs_available = available;
+
+            }
+
+            jobs[job_count++] = current;
+
+        }
+
+        /* Encode gathered jobs in parallel */
+        guac_common_encoder_run(guac_common_pipeline_encode_job, jobs,
+                sizeof(guac_common_pipeline_item*), job_count);
+
+        /* Process all items in order */
+        while (items != NULL) {
+            guac_common_pipeline_item* next = items->next;
+            guac_common_pipeline_process(pipeline, items);
+            items = next;
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+
+    }
+
+    pthread_mutex_unlock(&pipeline->lock);
+
+    free(jobs);
+    return NULL;
+
+}
+
+/**
+ * Callback function which appends the given data to the pipeline associated
+ * with the given socket, to be written to the pipeline's target socket in
+ * order with all other output of the pipeline.
+ *
+ * @param socket
+ *     The pipeline socket to write through.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     The number of bytes written if the write was successful, or -1 if an
+ *     error occurs.
+ */
+static ssize_t guac_common_pipeline_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_common_pipeline* pipeline = (guac_common_pipeline*) socket->data;
+
+    pthread_mutex_lock(&pipeline->lock);
+
+    /* Append to the last item if it is not a job or frame boundary */
+    guac_common_pipeline_item* item = pipeline->tail;
+    if (item == NULL || item->type != GUAC_COMMON_PIPELINE_DATA) {
+
+        item = calloc(1, sizeof(guac_common_pipeline_item));
+        if (item == NULL) {
+            pthread_mutex_unlock(&pipeline->lock);
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not allocate memory for pipeline";
+            return -1;
+        }
+
+        item->type = GUAC_COMMON_PIPELINE_DATA;
+        guac_common_pipeline_append(pipeline, item);
+
+    }
+
+    /* Grow buffer as necessary */
+    if (item->length + count > item->size) {
+
+        size_t size = item->size ? item->size : 4096;
+        while (size < item->length + count)
+            size *= 2;
+
+        char* buffer = realloc(item->buffer, size);
+        if (buffer == NULL) {
+            pthread_mutex_unlock(&pipeline->lock);
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not allocate memory for pipeline";
+            return -1;
+        }
+
+        item->buffer = buffer;
+        item->size = size;
+
+    }
+
+    memcpy(item->buffer + item->length, buf, count);
+    item->length += count;
+
+    pthread_mutex_unlock(&pipeline->lock);
+    return count;
+
+}
+
+/**
+ * Acquires exclusive access to the given pipeline socket.
+ *
+ * @param socket
+ *     The pipeline socket to which exclusive access is required.
+ */
+static void guac_common_pipeline_lock_handler(guac_socket* socket) {
+    guac_common_pipeline* pipeline = (guac_common_pipeline*) socket->data;
+    pthread_mutex_lock(&pipeline->socket_lock);
+}
+
+/**
+ * Relinquishes exclusive access to the given pipeline socket.
+ *
+ * @param socket
+ *     The pipeline socket to which exclusive access is no longer required.
+ */
+static void guac_common_pipeline_unlock_handler(guac_socket* socket) {
+    guac_common_pipeline* pipeline = (guac_common_pipeline*) socket->data;
+    pthread_mutex_unlock(&pipeline->socket_lock);
+}
+
+guac_common_pipeline* guac_common_pipeline_alloc(guac_client* client,
+        guac_socket* target) {
+
+    guac_common_pipeline* pipeline = calloc(1, sizeof(guac_common_pipeline));
+    if (pipeline == NULL)
+        return NULL;
+
+    pipeline->socket = guac_socket_alloc();
+    if (pipeline->socket == NULL) {
+        free(pipeline);
+        return NULL;
+    }
+
+    pipeline->client = client;
+    pipeline->target = target;
+
+    /* Count instructions as if written to the target directly */
+    pipeline->socket->data = pipeline;
+    pipeline->socket->stats = target->stats;
+    pipeline->socket->write_handler  = guac_common_pipeline_write_handler;
+    pipeline->socket->lock_handler   = guac_common_pipeline_lock_handler;
+    pipeline->socket->unlock_handler = guac_common_pipeline_unlock_handler;
+
+    pthread_mutex_init(&pipeline->socket_lock, NULL);
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->items_added, NULL);
+    pthread_cond_init(&pipeline->items_processed, NULL);
+
+    /* Start processing output */
+    if (pthread_create(&pipeline->thread, NULL,
+                guac_common_pipeline_thread, pipeline)) {
+        pthread_cond_destroy(&pipeline->items_processed);
+        pthread_cond_destroy(&pipeline->items_added);
+        pthread_mutex_destroy(&pipeline->lock);
+        pthread_mutex_destroy(&pipeline->socket_lock);
+        guac_socket_free(pipeline->socket);
+        free(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+
+}
+
+void guac_common_pipeline_free(guac_common_pipeline* pipeline) {
+
+    /* Signal pipeline thread to finish */
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->stopping = 1;
+    pthread_cond_signal(&pipeline->items_added);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    /* Wait for remaining output to be written */
+    pthread_join(pipeline->thread, NULL);
+
+    guac_socket_free(pipeline->socket);
+
+    pthread_cond_destroy(&pipeline->items_processed);
+    pthread_cond_destroy(&pipeline->items_added);
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_mutex_destroy(&pipeline->socket_lock);
+
+    free(pipeline);
+
+}
+
+void guac_common_pipeline_submit(guac_common_pipeline* pipeline,
+        guac_common_pipeline_encode_handler* encode_handler,
+        guac_common_pipeline_send_handler* send_handler, void* data) {
+
+    guac_common_pipeline_item* item = calloc(1,
+            sizeof(guac_common_pipeline_item));
+
+    /* Encode and send immediately if the job cannot be queued */
+    if (item == NULL) {
+        guac_common_pipeline_wait(pipeline);
+        encode_handler(data);
+        send_handler(data, pipeline->target);
+        return;
+    }
+
+    item->type = GUAC_COMMON_PIPELINE_JOB;
+    item->encode_handler = encode_handler;
+    item->send_handler = send_handler;
+    item->data = data;
+
+    pthread_mutex_lock(&pipeline->lock);
+
+    /* Wait for earlier jobs to be sent if too many are pending */
+    while (pipeline->pending_jobs >= GUAC_COMMON_PIPELINE_MAX_JOBS)
+        pthread_cond_wait(&pipeline->items_processed, &pipeline->lock);
+
+    pipeline->pending_jobs++;
+    guac_common_pipeline_append(pipeline, item);
+
+    pthread_mutex_unlock(&pipeline->lock);
+
+}
+
+void guac_common_pipeline_end_frame(guac_common_pipeline* pipeline) {
+
+    int max_frames = GUAC_COMMON_PIPELINE_MAX_FRAMES;
+
+    /* Do not build further frames ahead of a lagging client */
+    if (guac_client_get_processing_lag(pipeline->client)
+            > GUAC_COMMON_PIPELINE_LAG_THRESHOLD)
+        max_frames = 0;
+
+    guac_common_pipeline_item* item = calloc(1,
+            sizeof(guac_common_pipeline_item));
+
+    pthread_mutex_lock(&pipeline->lock);
+
+    /* End frame immediately if the frame boundary cannot be queued */
+    if (item == NULL) {
+        pthread_mutex_unlock(&pipeline->lock);
+        guac_common_pipeline_wait(pipeline);
+        guac_client_end_frame(pipeline->client);
+        guac_socket_flush(pipeline->target);
+        return;
+    }
+
+    item->type = GUAC_COMMON_PIPELINE_FRAME;
+    pipeline->pending_frames++;
+    guac_common_pipeline_append(pipeline, item);
+
+    /* Wait for earlier frames to be sent if too many are pending */
+    while (pipeline->pending_frames > max_frames)
+        pthread_cond_wait(&pipeline->items_processed, &pipeline->lock);
+
+    pthread_mutex_unlock(&pipeline->lock);
+
+}
+
+void guac_common_pipeline_wait(guac_common_pipeline* pipeline) {
+
+    pthread_mutex_lock(&pipeline->lock);
+
+    /* Wait for all items to be processed */
+    while (pipeline->pending_items > 0)
+        pthread_cond_wait(&pipeline->items_processed, &pipeline->lock);
+
+    pthread_mutex_unlock(&pipeline->lock);
+
+}
+
+int guac_common_pipeline_is_idle(guac_common_pipeline* pipeline) {
+
+    pthread_mutex_lock(&pipeline->lock);
+    int idle = (pipeline->pending_items == 0);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    return idle;
+
+}
+
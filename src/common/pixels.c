@@ -0,0 +1,1333 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/pixels.h"
+
+#include <guacamole/protocol-types.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * SSE4.1 and AVX2 kernels are compiled for any x86 target using per-function
+ * target attributes, and are only selected at runtime if the CPU supports
+ * them. NEON is part of the baseline of all 64-bit ARM targets, and thus
+ * needs no runtime check.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GUAC_COMMON_PIXELS_X86
+#include <immintrin.h>
+#define GUAC_COMMON_PIXELS_SSE41 __attribute__((target("sse4.1")))
+#define GUAC_COMMON_PIXELS_AVX2  __attribute__((target("avx2")))
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define GUAC_COMMON_PIXELS_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * The alpha component of a 32-bit ARGB pixel.
+ */
+#define GUAC_COMMON_PIXELS_ALPHA 0xFF000000
+
+/**
+ * The color components of a 32-bit ARGB pixel.
+ */
+#define GUAC_COMMON_PIXELS_RGB 0x00FFFFFF
+
+/**
+ * All components of a 32-bit ARGB pixel.
+ */
+#define GUAC_COMMON_PIXELS_ALL 0xFFFFFFFF
+
+/*
+ * Every transfer function supported by guac_common_surface can be written as
+ * ((D & P) | Q) ^ R, where D is the destination pixel, and P, Q and R are
+ * each a constant combined with some masked portion of T = S ^ N, where S is
+ * the source pixel:
+ *
+ *     P = (T & PT) | PC
+ *     Q = (T & QT) | QC
+ *     R = (T & RT) ^ X
+ *
+ * The constants for each transfer function are listed below. Each kernel
+ * set defines one function per transfer function from these constants,
+ * allowing the compiler to reduce each to only the operations it needs.
+ *
+ *         name        N    PT   PC     QT   QC     RT   X
+ */
+#define GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(F)                               \
+    F(BLACK,      0,   0,   0,     0,   ALPHA, 0,   0)                        \
+    F(WHITE,      0,   0,   0,     0,   ALL,   0,   0)                        \
+    F(SRC,        0,   0,   0,     ALL, 0,     0,   0)                        \
+    F(DEST,       0,   0,   ALL,   0,   0,     0,   0)                        \
+    F(NSRC,       RGB, 0,   0,     ALL, 0,     0,   0)                        \
+    F(NDEST,      0,   0,   ALL,   0,   0,     0,   RGB)                      \
+    F(AND,        0,   ALL, ALPHA, 0,   0,     0,   0)                        \
+    F(NAND,       0,   ALL, ALPHA, 0,   0,     0,   RGB)                      \
+    F(OR,         0,   0,   ALL,   RGB, 0,     0,   0)                        \
+    F(NOR,        0,   0,   ALL,   RGB, 0,     0,   RGB)                      \
+    F(XOR,        0,   0,   ALL,   0,   0,     RGB, 0)                        \
+    F(XNOR,       0,   0,   ALL,   0,   0,     RGB, RGB)                      \
+    F(NSRC_AND,   RGB, ALL, ALPHA, 0,   0,     0,   0)                        \
+    F(NSRC_NAND,  RGB, ALL, ALPHA, 0,   0,     0,   RGB)                      \
+    F(NSRC_OR,    RGB, 0,   ALL,   RGB, 0,     0,   0)                        \
+    F(NSRC_NOR,   RGB, 0,   ALL,   RGB, 0,     0,   RGB)
+
+/**
+ * Expands a constant name from GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER() to its
+ * 32-bit value.
+ */
+#define GUAC_COMMON_PIXELS_CONST(name) GUAC_COMMON_PIXELS_CONST_##name
+#define GUAC_COMMON_PIXELS_CONST_0     0x00000000
+#define GUAC_COMMON_PIXELS_CONST_ALPHA GUAC_COMMON_PIXELS_ALPHA
+#define GUAC_COMMON_PIXELS_CONST_RGB   GUAC_COMMON_PIXELS_RGB
+#define GUAC_COMMON_PIXELS_CONST_ALL   GUAC_COMMON_PIXELS_ALL
+
+/**
+ * Defines a transfer kernel named
+ * __guac_common_pixels_transfer_NAME_ISA, which invokes the generic
+ * transfer kernel __guac_common_pixels_transfer_ISA with the constants of
+ * the transfer function NAME.
+ */
+#define GUAC_COMMON_PIXELS_DEFINE_TRANSFER(isa, attributes, name,             \
+        n, pt, pc, qt, qc, rt, x)                                             \
+    attributes static int __guac_common_pixels_transfer_##name##_##isa(       \
+            uint32_t* dst, const uint32_t* src, int width,                    \
+            int* first, int* last) {                                          \
+        return __guac_common_pixels_transfer_##isa(dst, src, width,           \
+                first, last,                                                  \
+                GUAC_COMMON_PIXELS_CONST(n),  GUAC_COMMON_PIXELS_CONST(pt),   \
+                GUAC_COMMON_PIXELS_CONST(pc), GUAC_COMMON_PIXELS_CONST(qt),   \
+                GUAC_COMMON_PIXELS_CONST(qc), GUAC_COMMON_PIXELS_CONST(rt),   \
+                GUAC_COMMON_PIXELS_CONST(x));                                 \
+    }
+
+/**
+ * Expands to a designated initializer for the entry of the transfer kernel
+ * table corresponding to the transfer function NAME.
+ */
+#define GUAC_COMMON_PIXELS_TRANSFER_ENTRY(isa, name, ...)                     \
+    [GUAC_TRANSFER_BINARY_##name] = __guac_common_pixels_transfer_##name##_##isa,
+
+#if defined(GUAC_COMMON_PIXELS_X86) || defined(GUAC_COMMON_PIXELS_NEON)
+/**
+ * Records that the pixels corresponding to the set bits of the given lane
+ * mask have changed, updating the first and last changed pixel indices
+ * accordingly.
+ *
+ * @param x
+ *     The index of the pixel corresponding to the least-significant bit of
+ *     the mask.
+ *
+ * @param mask
+ *     A non-zero mask having one bit set for each changed pixel.
+ *
+ * @param changed
+ *     Pointer to an int which is non-zero if any pixel has already been
+ *     recorded as changed. This will be set to non-zero.
+ *
+ * @param first
+ *     Pointer to the index of the first changed pixel, which will be set if
+ *     no pixel has yet been recorded as changed.
+ *
+ * @param last
+ *     Pointer to the index of the last changed pixel, which will be updated.
+ */
+static inline void __guac_common_pixels_mark(int x, unsigned int mask,
+        int* changed, int* first, int* last) {
+
+    if (!*changed) {
+        *first = x + __builtin_ctz(mask);
+        *changed = 1;
+    }
+
+    *last = x + 31 - __builtin_clz(mask);
+
+}
+#endif
+
+/**
+ * Merges the changed range of the remaining pixels of a row, as processed by
+ * a scalar kernel, into the changed range of the pixels already processed.
+ *
+ * @param x
+ *     The index of the first pixel processed by the scalar kernel.
+ *
+ * @param tail_changed
+ *     The value returned by the scalar kernel.
+ *
+ * @param tail_first
+ *     The index of the first pixel changed by the scalar kernel, relative
+ *     to x.
+ *
+ * @param tail_last
+ *     The index of the last pixel changed by the scalar kernel, relative to
+ *     x.
+ *
+ * @param changed
+ *     Non-zero if any pixel before x changed, zero otherwise.
+ *
+ * @param first
+ *     Pointer to the index of the first changed pixel of the row.
+ *
+ * @param last
+ *     Pointer to the index of the last changed pixel of the row.
+ *
+ * @return
+ *     Non-zero if any pixel of the row changed, zero otherwise.
+ */
+static inline int __guac_common_pixels_merge(int x, int tail_changed,
+        int tail_first, int tail_last, int changed, int* first, int* last) {
+
+    if (!tail_changed)
+        return changed;
+
+    if (!changed)
+        *first = x + tail_first;
+
+    *last = x + tail_last;
+    return 1;
+
+}
+
+/**
+ * Applies the Porter-Duff "over" composite operator, blending the two given
+ * color components using the given alpha value.
+ *
+ * @param dst
+ *     The destination color component.
+ *
+ * @param src
+ *     The source color component.
+ *
+ * @param alpha
+ *     The alpha value which applies to the blending operation.
+ *
+ * @return
+ *     The result of applying the Porter-Duff "over" composite operator to the
+ *     given source and destination components.
+ */
+static int __guac_common_pixels_blend_component(int dst, int src, int alpha) {
+
+    int blended = src + dst * (0xFF - alpha);
+
+    /* Do not exceed maximum component value */
+    if (blended > 0xFF)
+        return 0xFF;
+
+    return blended;
+
+}
+
+/**
+ * Applies the Porter-Duff "over" composite operator, blending each component
+ * of the two given ARGB colors.
+ *
+ * @param dst
+ *     The destination ARGB color.
+ *
+ * @param src
+ *     The source ARGB color.
+ *
+ * @return
+ *     The result of applying the Porter-Duff "over" composite operator to the
+ *     given source and destination colors.
+ */
+static uint32_t __guac_common_pixels_argb_blend(uint32_t dst, uint32_t src) {
+
+    /* Separate destination ARGB color into its components */
+    int dst_a = (dst >> 24) & 0xFF;
+    int dst_r = (dst >> 16) & 0xFF;
+    int dst_g = (dst >>  8) & 0xFF;
+    int dst_b =  dst        & 0xFF;
+
+    /* Separate source ARGB color into its components */
+    int src_a = (src >> 24) & 0xFF;
+    int src_r = (src >> 16) & 0xFF;
+    int src_g = (src >>  8) & 0xFF;
+    int src_b =  src        & 0xFF;
+
+    /* If source is fully opaque (or destination is fully transparent), the
+     * blended result is the source */
+    if (src_a == 0xFF || dst_a == 0x00)
+        return src;
+
+    /* If source is fully transparent, the blended result is the destination */
+    if (src_a == 0x00)
+        return dst;
+
+    /* Otherwise, blend each ARGB component, assuming pre-multiplied alpha */
+    int r = __guac_common_pixels_blend_component(dst_r, src_r, src_a);
+    int g = __guac_common_pixels_blend_component(dst_g, src_g, src_a);
+    int b = __guac_common_pixels_blend_component(dst_b, src_b, src_a);
+    int a = __guac_common_pixels_blend_component(dst_a, src_a, src_a);
+
+    /* Recombine blended components */
+    return ((uint32_t) a << 24) | (r << 16) | (g << 8) | b;
+
+}
+
+/*
+ * Scalar kernels.
+ */
+
+static int __guac_common_pixels_put_opaque_scalar(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    int changed = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        /* Ignore alpha channel */
+        uint32_t color = src[x] | GUAC_COMMON_PIXELS_ALPHA;
+
+        if (dst[x] != color) {
+            if (!changed) {
+                *first = x;
+                changed = 1;
+            }
+            *last = x;
+            dst[x] = color;
+        }
+
+    }
+
+    return changed;
+
+}
+
+static int __guac_common_pixels_put_blend_scalar(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    int changed = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        uint32_t color = __guac_common_pixels_argb_blend(dst[x], src[x]);
+
+        if (dst[x] != color) {
+            if (!changed) {
+                *first = x;
+                changed = 1;
+            }
+            *last = x;
+            dst[x] = color;
+        }
+
+    }
+
+    return changed;
+
+}
+
+static int __guac_common_pixels_fill_mask_scalar(uint32_t* dst,
+        const uint32_t* src, int width, uint32_t color,
+        int* first, int* last) {
+
+    int changed = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        /* Fill with color if not fully transparent */
+        if ((src[x] & GUAC_COMMON_PIXELS_ALPHA) && dst[x] != color) {
+            if (!changed) {
+                *first = x;
+                changed = 1;
+            }
+            *last = x;
+            dst[x] = color;
+        }
+
+    }
+
+    return changed;
+
+}
+
+/**
+ * Scans pixels x through width - 1 of the given row exactly as
+ * __guac_common_pixels_scan_scalar() would, accumulating the results into the
+ * given partial results. As each pixel is compared against the pixel before
+ * it, x must be at least 1.
+ *
+ * @param src
+ *     The first pixel of the row.
+ *
+ * @param x
+ *     The index of the first pixel to scan.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ *
+ * @param first
+ *     The first pixel of the row, against which all other pixels are
+ *     compared.
+ *
+ * @param same
+ *     Pointer to the number of pixels found so far to have the same color as
+ *     the pixel before them, which will be updated.
+ *
+ * @param differs
+ *     Pointer to the bitwise OR of the differences between each pixel found
+ *     so far and the first pixel, which will be updated.
+ *
+ * @param transparent
+ *     Pointer to the bitwise OR of the inverted alpha channels of each pixel
+ *     found so far, which will be updated.
+ */
+static inline void __guac_common_pixels_scan_range(const uint32_t* src,
+        int x, int width, uint32_t first, int* same, uint32_t* differs,
+        uint32_t* transparent) {
+
+    for (; x < width; x++) {
+
+        /* Ignore alpha channel when comparing neighboring pixels */
+        if ((src[x] | GUAC_COMMON_PIXELS_ALPHA)
+                == (src[x - 1] | GUAC_COMMON_PIXELS_ALPHA))
+            (*same)++;
+
+        *differs |= src[x] ^ first;
+        *transparent |= ~src[x] & GUAC_COMMON_PIXELS_ALPHA;
+
+    }
+
+}
+
+static int __guac_common_pixels_scan_scalar(const uint32_t* src, int width,
+        int* same, int* opaque) {
+
+    uint32_t differs = 0;
+    uint32_t transparent = ~src[0] & GUAC_COMMON_PIXELS_ALPHA;
+
+    *same = 0;
+    __guac_common_pixels_scan_range(src, 1, width, src[0], same, &differs,
+            &transparent);
+
+    *opaque = !transparent;
+    return !differs;
+
+}
+
+/**
+ * Generic scalar transfer kernel, transferring each source pixel to the
+ * destination using the transfer function described by the given constants.
+ * See GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER() for the meaning of each
+ * constant.
+ */
+static inline int __guac_common_pixels_transfer_scalar(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last,
+        uint32_t n, uint32_t pt, uint32_t pc, uint32_t qt, uint32_t qc,
+        uint32_t rt, uint32_t x_mask) {
+
+    int changed = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        uint32_t t = src[x] ^ n;
+        uint32_t color = ((dst[x] & ((t & pt) | pc)) | ((t & qt) | qc))
+                       ^ ((t & rt) ^ x_mask);
+
+        if (dst[x] != color) {
+            if (!changed) {
+                *first = x;
+                changed = 1;
+            }
+            *last = x;
+            dst[x] = color;
+        }
+
+    }
+
+    return changed;
+
+}
+
+#define GUAC_COMMON_PIXELS_DEFINE_TRANSFER_SCALAR(...) \
+    GUAC_COMMON_PIXELS_DEFINE_TRANSFER(scalar, , __VA_ARGS__)
+#define GUAC_COMMON_PIXELS_TRANSFER_ENTRY_SCALAR(...) \
+    GUAC_COMMON_PIXELS_TRANSFER_ENTRY(scalar, __VA_ARGS__)
+
+GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(GUAC_COMMON_PIXELS_DEFINE_TRANSFER_SCALAR)
+
+const guac_common_pixel_kernels guac_common_pixels_scalar = {
+    .name       = "scalar",
+    .put_opaque = __guac_common_pixels_put_opaque_scalar,
+    .put_blend  = __guac_common_pixels_put_blend_scalar,
+    .fill_mask  = __guac_common_pixels_fill_mask_scalar,
+    .transfer   = {
+        GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(
+                GUAC_COMMON_PIXELS_TRANSFER_ENTRY_SCALAR)
+    },
+    .scan       = __guac_common_pixels_scan_scalar
+};
+
+#ifdef GUAC_COMMON_PIXELS_X86
+
+/*
+ * SSE4.1 kernels, processing four pixels at a time.
+ */
+
+/**
+ * Returns a mask having one bit set for each of the four pixels which
+ * differ between the given vectors.
+ */
+GUAC_COMMON_PIXELS_SSE41
+static inline unsigned int __guac_common_pixels_diff_sse41(__m128i a,
+        __m128i b) {
+    return ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))) & 0xF;
+}
+
+GUAC_COMMON_PIXELS_SSE41
+static int __guac_common_pixels_put_opaque_sse41(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    const __m128i alpha = _mm_set1_epi32((int) GUAC_COMMON_PIXELS_ALPHA);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+        __m128i color = _mm_or_si128(
+                _mm_loadu_si128((const __m128i*) (src + x)), alpha);
+
+        unsigned int mask = __guac_common_pixels_diff_sse41(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm_storeu_si128((__m128i*) (dst + x), color);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_put_opaque_scalar(dst + x,
+            src + x, width - x, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+/**
+ * Blends the given 8-bit color components, widened to 16 bits, exactly as
+ * __guac_common_pixels_blend_component() would.
+ */
+GUAC_COMMON_PIXELS_SSE41
+static inline __m128i __guac_common_pixels_blend_sse41(__m128i d,
+        __m128i s, __m128i inverse_alpha) {
+
+    /* Each product is at most 0xFF * 0xFF, and thus fits in 16 bits */
+    __m128i blended = _mm_adds_epu16(s, _mm_mullo_epi16(d, inverse_alpha));
+    return _mm_min_epu16(blended, _mm_set1_epi16(0xFF));
+
+}
+
+GUAC_COMMON_PIXELS_SSE41
+static int __guac_common_pixels_put_blend_sse41(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi32((int) GUAC_COMMON_PIXELS_ALL);
+    const __m128i opaque = _mm_set1_epi32(0xFF);
+    const __m128i alpha_shuffle = _mm_setr_epi8(
+            3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+        __m128i s = _mm_loadu_si128((const __m128i*) (src + x));
+
+        /* 0xFF - source alpha, for every component of each pixel */
+        __m128i inverse = _mm_xor_si128(
+                _mm_shuffle_epi8(s, alpha_shuffle), ones);
+
+        __m128i lo = __guac_common_pixels_blend_sse41(
+                _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero),
+                _mm_unpacklo_epi8(inverse, zero));
+
+        __m128i hi = __guac_common_pixels_blend_sse41(
+                _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero),
+                _mm_unpackhi_epi8(inverse, zero));
+
+        __m128i color = _mm_packus_epi16(lo, hi);
+
+        /* Use destination if source is fully transparent, and source if
+         * source is fully opaque or destination is fully transparent */
+        __m128i src_a = _mm_srli_epi32(s, 24);
+        __m128i dst_a = _mm_srli_epi32(d, 24);
+        color = _mm_blendv_epi8(color, d, _mm_cmpeq_epi32(src_a, zero));
+        color = _mm_blendv_epi8(color, s, _mm_or_si128(
+                    _mm_cmpeq_epi32(src_a, opaque),
+                    _mm_cmpeq_epi32(dst_a, zero)));
+
+        unsigned int mask = __guac_common_pixels_diff_sse41(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm_storeu_si128((__m128i*) (dst + x), color);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_put_blend_scalar(dst + x,
+            src + x, width - x, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+GUAC_COMMON_PIXELS_SSE41
+static int __guac_common_pixels_fill_mask_sse41(uint32_t* dst,
+        const uint32_t* src, int width, uint32_t color,
+        int* first, int* last) {
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int) GUAC_COMMON_PIXELS_ALPHA);
+    const __m128i fill = _mm_set1_epi32((int) color);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+        __m128i s = _mm_loadu_si128((const __m128i*) (src + x));
+
+        /* Keep destination wherever the mask is fully transparent */
+        __m128i filled = _mm_blendv_epi8(fill, d,
+                _mm_cmpeq_epi32(_mm_and_si128(s, alpha), zero));
+
+        unsigned int mask = __guac_common_pixels_diff_sse41(d, filled);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm_storeu_si128((__m128i*) (dst + x), filled);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_fill_mask_scalar(dst + x,
+            src + x, width - x, color, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+GUAC_COMMON_PIXELS_SSE41
+static int __guac_common_pixels_scan_sse41(const uint32_t* src, int width,
+        int* same, int* opaque) {
+
+    const __m128i alpha = _mm_set1_epi32((int) GUAC_COMMON_PIXELS_ALPHA);
+    const __m128i first = _mm_set1_epi32((int) src[0]);
+
+    __m128i differs = _mm_setzero_si128();
+    __m128i transparent = _mm_andnot_si128(first, alpha);
+
+    int count = 0;
+    int x;
+
+    for (x = 1; x + 4 <= width; x += 4) {
+
+        __m128i current = _mm_loadu_si128((const __m128i*) (src + x));
+        __m128i previous = _mm_loadu_si128((const __m128i*) (src + x - 1));
+
+        /* Ignore alpha channel when comparing neighboring pixels */
+        count += 4 - __builtin_popcount(__guac_common_pixels_diff_sse41(
+                    _mm_or_si128(current, alpha),
+                    _mm_or_si128(previous, alpha)));
+
+        differs = _mm_or_si128(differs, _mm_xor_si128(current, first));
+        transparent = _mm_or_si128(transparent,
+                _mm_andnot_si128(current, alpha));
+
+    }
+
+    uint32_t tail_differs = !_mm_testz_si128(differs, differs);
+    uint32_t tail_transparent = !_mm_testz_si128(transparent, transparent);
+    __guac_common_pixels_scan_range(src, x, width, src[0], &count,
+            &tail_differs, &tail_transparent);
+
+    *same = count;
+    *opaque = !tail_transparent;
+    return !tail_differs;
+
+}
+
+/**
+ * Generic SSE4.1 transfer kernel. See __guac_common_pixels_transfer_scalar().
+ */
+GUAC_COMMON_PIXELS_SSE41
+static inline int __guac_common_pixels_transfer_sse41(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last,
+        uint32_t n, uint32_t pt, uint32_t pc, uint32_t qt, uint32_t qc,
+        uint32_t rt, uint32_t x_mask) {
+
+    const __m128i vn  = _mm_set1_epi32((int) n);
+    const __m128i vpt = _mm_set1_epi32((int) pt);
+    const __m128i vpc = _mm_set1_epi32((int) pc);
+    const __m128i vqt = _mm_set1_epi32((int) qt);
+    const __m128i vqc = _mm_set1_epi32((int) qc);
+    const __m128i vrt = _mm_set1_epi32((int) rt);
+    const __m128i vx  = _mm_set1_epi32((int) x_mask);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+        __m128i t = _mm_xor_si128(
+                _mm_loadu_si128((const __m128i*) (src + x)), vn);
+
+        __m128i p = _mm_or_si128(_mm_and_si128(t, vpt), vpc);
+        __m128i q = _mm_or_si128(_mm_and_si128(t, vqt), vqc);
+        __m128i r = _mm_xor_si128(_mm_and_si128(t, vrt), vx);
+        __m128i color = _mm_xor_si128(_mm_or_si128(_mm_and_si128(d, p), q), r);
+
+        unsigned int mask = __guac_common_pixels_diff_sse41(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm_storeu_si128((__m128i*) (dst + x), color);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_transfer_scalar(dst + x, src + x,
+            width - x, &tail_first, &tail_last, n, pt, pc, qt, qc, rt, x_mask);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+#define GUAC_COMMON_PIXELS_DEFINE_TRANSFER_SSE41(...) \
+    GUAC_COMMON_PIXELS_DEFINE_TRANSFER(sse41, GUAC_COMMON_PIXELS_SSE41, \
+            __VA_ARGS__)
+#define GUAC_COMMON_PIXELS_TRANSFER_ENTRY_SSE41(...) \
+    GUAC_COMMON_PIXELS_TRANSFER_ENTRY(sse41, __VA_ARGS__)
+
+GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(GUAC_COMMON_PIXELS_DEFINE_TRANSFER_SSE41)
+
+static const guac_common_pixel_kernels __guac_common_pixels_sse41 = {
+    .name       = "sse4.1",
+    .put_opaque = __guac_common_pixels_put_opaque_sse41,
+    .put_blend  = __guac_common_pixels_put_blend_sse41,
+    .fill_mask  = __guac_common_pixels_fill_mask_sse41,
+    .transfer   = {
+        GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(
+                GUAC_COMMON_PIXELS_TRANSFER_ENTRY_SSE41)
+    },
+    .scan       = __guac_common_pixels_scan_sse41
+};
+
+/*
+ * AVX2 kernels, processing eight pixels at a time. These mirror the SSE4.1
+ * kernels exactly. Byte shuffles, unpacking and packing all operate within
+ * each 128-bit lane, which preserves pixel order. The upper halves of the
+ * YMM registers are cleared before handing any remaining pixels to the
+ * SSE4.1 kernels, as legacy SSE instructions executed while those halves
+ * are dirty incur a state transition penalty.
+ */
+
+/**
+ * Returns a mask having one bit set for each of the eight pixels which
+ * differ between the given vectors.
+ */
+GUAC_COMMON_PIXELS_AVX2
+static inline unsigned int __guac_common_pixels_diff_avx2(__m256i a,
+        __m256i b) {
+    return ~_mm256_movemask_ps(_mm256_castsi256_ps(
+                _mm256_cmpeq_epi32(a, b))) & 0xFF;
+}
+
+GUAC_COMMON_PIXELS_AVX2
+static int __guac_common_pixels_put_opaque_avx2(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    const __m256i alpha = _mm256_set1_epi32((int) GUAC_COMMON_PIXELS_ALPHA);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+        __m256i color = _mm256_or_si256(
+                _mm256_loadu_si256((const __m256i*) (src + x)), alpha);
+
+        unsigned int mask = __guac_common_pixels_diff_avx2(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm256_storeu_si256((__m256i*) (dst + x), color);
+        }
+
+    }
+
+    _mm256_zeroupper();
+    int tail_changed = __guac_common_pixels_put_opaque_sse41(dst + x,
+            src + x, width - x, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+/**
+ * Blends the given 8-bit color components, widened to 16 bits, exactly as
+ * __guac_common_pixels_blend_component() would.
+ */
+GUAC_COMMON_PIXELS_AVX2
+static inline __m256i __guac_common_pixels_blend_avx2(__m256i d,
+        __m256i s, __m256i inverse_alpha) {
+
+    /* Each product is at most 0xFF * 0xFF, and thus fits in 16 bits */
+    __m256i blended = _mm256_adds_epu16(s, _mm256_mullo_epi16(d, inverse_alpha));
+    return _mm256_min_epu16(blended, _mm256_set1_epi16(0xFF));
+
+}
+
+GUAC_COMMON_PIXELS_AVX2
+static int __guac_common_pixels_put_blend_avx2(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi32((int) GUAC_COMMON_PIXELS_ALL);
+    const __m256i opaque = _mm256_set1_epi32(0xFF);
+    const __m256i alpha_shuffle = _mm256_setr_epi8(
+            3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+            3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+        __m256i s = _mm256_loadu_si256((const __m256i*) (src + x));
+
+        /* 0xFF - source alpha, for every component of each pixel */
+        __m256i inverse = _mm256_xor_si256(
+                _mm256_shuffle_epi8(s, alpha_shuffle), ones);
+
+        __m256i lo = __guac_common_pixels_blend_avx2(
+                _mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero),
+                _mm256_unpacklo_epi8(inverse, zero));
+
+        __m256i hi = __guac_common_pixels_blend_avx2(
+                _mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero),
+                _mm256_unpackhi_epi8(inverse, zero));
+
+        __m256i color = _mm256_packus_epi16(lo, hi);
+
+        /* Use destination if source is fully transparent, and source if
+         * source is fully opaque or destination is fully transparent */
+        __m256i src_a = _mm256_srli_epi32(s, 24);
+        __m256i dst_a = _mm256_srli_epi32(d, 24);
+        color = _mm256_blendv_epi8(color, d, _mm256_cmpeq_epi32(src_a, zero));
+        color = _mm256_blendv_epi8(color, s, _mm256_or_si256(
+                    _mm256_cmpeq_epi32(src_a, opaque),
+                    _mm256_cmpeq_epi32(dst_a, zero)));
+
+        unsigned int mask = __guac_common_pixels_diff_avx2(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm256_storeu_si256((__m256i*) (dst + x), color);
+        }
+
+    }
+
+    _mm256_zeroupper();
+    int tail_changed = __guac_common_pixels_put_blend_sse41(dst + x,
+            src + x, width - x, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+GUAC_COMMON_PIXELS_AVX2
+static int __guac_common_pixels_fill_mask_avx2(uint32_t* dst,
+        const uint32_t* src, int width, uint32_t color,
+        int* first, int* last) {
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32((int) GUAC_COMMON_PIXELS_ALPHA);
+    const __m256i fill = _mm256_set1_epi32((int) color);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+        __m256i s = _mm256_loadu_si256((const __m256i*) (src + x));
+
+        /* Keep destination wherever the mask is fully transparent */
+        __m256i filled = _mm256_blendv_epi8(fill, d,
+                _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha), zero));
+
+        unsigned int mask = __guac_common_pixels_diff_avx2(d, filled);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm256_storeu_si256((__m256i*) (dst + x), filled);
+        }
+
+    }
+
+    _mm256_zeroupper();
+    int tail_changed = __guac_common_pixels_fill_mask_sse41(dst + x,
+            src + x, width - x, color, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+GUAC_COMMON_PIXELS_AVX2
+static int __guac_common_pixels_scan_avx2(const uint32_t* src, int width,
+        int* same, int* opaque) {
+
+    const __m256i alpha = _mm256_set1_epi32((int) GUAC_COMMON_PIXELS_ALPHA);
+    const __m256i first = _mm256_set1_epi32((int) src[0]);
+
+    __m256i differs = _mm256_setzero_si256();
+    __m256i transparent = _mm256_andnot_si256(first, alpha);
+
+    int count = 0;
+    int x;
+
+    for (x = 1; x + 8 <= width; x += 8) {
+
+        __m256i current = _mm256_loadu_si256((const __m256i*) (src + x));
+        __m256i previous = _mm256_loadu_si256((const __m256i*) (src + x - 1));
+
+        /* Ignore alpha channel when comparing neighboring pixels */
+        count += 8 - __builtin_popcount(__guac_common_pixels_diff_avx2(
+                    _mm256_or_si256(current, alpha),
+                    _mm256_or_si256(previous, alpha)));
+
+        differs = _mm256_or_si256(differs, _mm256_xor_si256(current, first));
+        transparent = _mm256_or_si256(transparent,
+                _mm256_andnot_si256(current, alpha));
+
+    }
+
+    uint32_t tail_differs = !_mm256_testz_si256(differs, differs);
+    uint32_t tail_transparent = !_mm256_testz_si256(transparent, transparent);
+    __guac_common_pixels_scan_range(src, x, width, src[0], &count,
+            &tail_differs, &tail_transparent);
+
+    *same = count;
+    *opaque = !tail_transparent;
+    return !tail_differs;
+
+}
+
+/**
+ * Generic AVX2 transfer kernel. See __guac_common_pixels_transfer_scalar().
+ */
+GUAC_COMMON_PIXELS_AVX2
+static inline int __guac_common_pixels_transfer_avx2(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last,
+        uint32_t n, uint32_t pt, uint32_t pc, uint32_t qt, uint32_t qc,
+        uint32_t rt, uint32_t x_mask) {
+
+    const __m256i vn  = _mm256_set1_epi32((int) n);
+    const __m256i vpt = _mm256_set1_epi32((int) pt);
+    const __m256i vpc = _mm256_set1_epi32((int) pc);
+    const __m256i vqt = _mm256_set1_epi32((int) qt);
+    const __m256i vqc = _mm256_set1_epi32((int) qc);
+    const __m256i vrt = _mm256_set1_epi32((int) rt);
+    const __m256i vx  = _mm256_set1_epi32((int) x_mask);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+        __m256i t = _mm256_xor_si256(
+                _mm256_loadu_si256((const __m256i*) (src + x)), vn);
+
+        __m256i p = _mm256_or_si256(_mm256_and_si256(t, vpt), vpc);
+        __m256i q = _mm256_or_si256(_mm256_and_si256(t, vqt), vqc);
+        __m256i r = _mm256_xor_si256(_mm256_and_si256(t, vrt), vx);
+        __m256i color = _mm256_xor_si256(
+                _mm256_or_si256(_mm256_and_si256(d, p), q), r);
+
+        unsigned int mask = __guac_common_pixels_diff_avx2(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            _mm256_storeu_si256((__m256i*) (dst + x), color);
+        }
+
+    }
+
+    _mm256_zeroupper();
+    int tail_changed = __guac_common_pixels_transfer_sse41(dst + x, src + x,
+            width - x, &tail_first, &tail_last, n, pt, pc, qt, qc, rt, x_mask);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+#define GUAC_COMMON_PIXELS_DEFINE_TRANSFER_AVX2(...) \
+    GUAC_COMMON_PIXELS_DEFINE_TRANSFER(avx2, GUAC_COMMON_PIXELS_AVX2, \
+            __VA_ARGS__)
+#define GUAC_COMMON_PIXELS_TRANSFER_ENTRY_AVX2(...) \
+    GUAC_COMMON_PIXELS_TRANSFER_ENTRY(avx2, __VA_ARGS__)
+
+GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(GUAC_COMMON_PIXELS_DEFINE_TRANSFER_AVX2)
+
+static const guac_common_pixel_kernels __guac_common_pixels_avx2 = {
+    .name       = "avx2",
+    .put_opaque = __guac_common_pixels_put_opaque_avx2,
+    .put_blend  = __guac_common_pixels_put_blend_avx2,
+    .fill_mask  = __guac_common_pixels_fill_mask_avx2,
+    .transfer   = {
+        GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(
+                GUAC_COMMON_PIXELS_TRANSFER_ENTRY_AVX2)
+    },
+    .scan       = __guac_common_pixels_scan_avx2
+};
+
+#endif
+
+#ifdef GUAC_COMMON_PIXELS_NEON
+
+/*
+ * NEON kernels, processing four pixels at a time.
+ */
+
+/**
+ * Returns a mask having one bit set for each of the four pixels which
+ * differ between the given vectors.
+ */
+static inline unsigned int __guac_common_pixels_diff_neon(uint32x4_t a,
+        uint32x4_t b) {
+
+    static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+
+    return vaddvq_u32(vandq_u32(vmvnq_u32(vceqq_u32(a, b)),
+                vld1q_u32(lanes)));
+
+}
+
+static int __guac_common_pixels_put_opaque_neon(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    const uint32x4_t alpha = vdupq_n_u32(GUAC_COMMON_PIXELS_ALPHA);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        uint32x4_t d = vld1q_u32(dst + x);
+        uint32x4_t color = vorrq_u32(vld1q_u32(src + x), alpha);
+
+        unsigned int mask = __guac_common_pixels_diff_neon(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            vst1q_u32(dst + x, color);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_put_opaque_scalar(dst + x,
+            src + x, width - x, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+static int __guac_common_pixels_put_blend_neon(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    const uint32x4_t zero = vdupq_n_u32(0);
+    const uint32x4_t opaque = vdupq_n_u32(0xFF);
+    const uint16x8_t max = vdupq_n_u16(0xFF);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        uint32x4_t d = vld1q_u32(dst + x);
+        uint32x4_t s = vld1q_u32(src + x);
+        uint32x4_t src_a = vshrq_n_u32(s, 24);
+        uint32x4_t dst_a = vshrq_n_u32(d, 24);
+
+        uint8x16_t d8 = vreinterpretq_u8_u32(d);
+        uint8x16_t s8 = vreinterpretq_u8_u32(s);
+
+        /* 0xFF - source alpha, for every component of each pixel */
+        uint8x16_t inverse = vmvnq_u8(vreinterpretq_u8_u32(
+                    vmulq_n_u32(src_a, 0x01010101)));
+
+        /* Each product is at most 0xFF * 0xFF, and thus fits in 16 bits */
+        uint16x8_t lo = vminq_u16(vqaddq_u16(vmovl_u8(vget_low_u8(s8)),
+                    vmull_u8(vget_low_u8(d8), vget_low_u8(inverse))), max);
+        uint16x8_t hi = vminq_u16(vqaddq_u16(vmovl_high_u8(s8),
+                    vmull_high_u8(d8, inverse)), max);
+
+        uint32x4_t color = vreinterpretq_u32_u8(
+                vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+
+        /* Use destination if source is fully transparent, and source if
+         * source is fully opaque or destination is fully transparent */
+        color = vbslq_u32(vceqq_u32(src_a, zero), d, color);
+        color = vbslq_u32(vorrq_u32(vceqq_u32(src_a, opaque),
+                    vceqq_u32(dst_a, zero)), s, color);
+
+        unsigned int mask = __guac_common_pixels_diff_neon(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            vst1q_u32(dst + x, color);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_put_blend_scalar(dst + x,
+            src + x, width - x, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+static int __guac_common_pixels_fill_mask_neon(uint32_t* dst,
+        const uint32_t* src, int width, uint32_t color,
+        int* first, int* last) {
+
+    const uint32x4_t alpha = vdupq_n_u32(GUAC_COMMON_PIXELS_ALPHA);
+    const uint32x4_t fill = vdupq_n_u32(color);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        uint32x4_t d = vld1q_u32(dst + x);
+        uint32x4_t s = vld1q_u32(src + x);
+
+        /* Fill wherever the mask is not fully transparent */
+        uint32x4_t filled = vbslq_u32(vtstq_u32(s, alpha), fill, d);
+
+        unsigned int mask = __guac_common_pixels_diff_neon(d, filled);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            vst1q_u32(dst + x, filled);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_fill_mask_scalar(dst + x,
+            src + x, width - x, color, &tail_first, &tail_last);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+static int __guac_common_pixels_scan_neon(const uint32_t* src, int width,
+        int* same, int* opaque) {
+
+    const uint32x4_t alpha = vdupq_n_u32(GUAC_COMMON_PIXELS_ALPHA);
+    const uint32x4_t first = vdupq_n_u32(src[0]);
+
+    uint32x4_t differs = vdupq_n_u32(0);
+    uint32x4_t transparent = vbicq_u32(alpha, first);
+
+    int count = 0;
+    int x;
+
+    for (x = 1; x + 4 <= width; x += 4) {
+
+        uint32x4_t current = vld1q_u32(src + x);
+        uint32x4_t previous = vld1q_u32(src + x - 1);
+
+        /* Ignore alpha channel when comparing neighboring pixels */
+        count += 4 - __builtin_popcount(__guac_common_pixels_diff_neon(
+                    vorrq_u32(current, alpha), vorrq_u32(previous, alpha)));
+
+        differs = vorrq_u32(differs, veorq_u32(current, first));
+        transparent = vorrq_u32(transparent, vbicq_u32(alpha, current));
+
+    }
+
+    uint32_t tail_differs = vmaxvq_u32(differs);
+    uint32_t tail_transparent = vmaxvq_u32(transparent);
+    __guac_common_pixels_scan_range(src, x, width, src[0], &count,
+            &tail_differs, &tail_transparent);
+
+    *same = count;
+    *opaque = !tail_transparent;
+    return !tail_differs;
+
+}
+
+/**
+ * Generic NEON transfer kernel. See __guac_common_pixels_transfer_scalar().
+ */
+static inline int __guac_common_pixels_transfer_neon(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last,
+        uint32_t n, uint32_t pt, uint32_t pc, uint32_t qt, uint32_t qc,
+        uint32_t rt, uint32_t x_mask) {
+
+    const uint32x4_t vn  = vdupq_n_u32(n);
+    const uint32x4_t vpt = vdupq_n_u32(pt);
+    const uint32x4_t vpc = vdupq_n_u32(pc);
+    const uint32x4_t vqt = vdupq_n_u32(qt);
+    const uint32x4_t vqc = vdupq_n_u32(qc);
+    const uint32x4_t vrt = vdupq_n_u32(rt);
+    const uint32x4_t vx  = vdupq_n_u32(x_mask);
+
+    int changed = 0;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        uint32x4_t d = vld1q_u32(dst + x);
+        uint32x4_t t = veorq_u32(vld1q_u32(src + x), vn);
+
+        uint32x4_t p = vorrq_u32(vandq_u32(t, vpt), vpc);
+        uint32x4_t q = vorrq_u32(vandq_u32(t, vqt), vqc);
+        uint32x4_t r = veorq_u32(vandq_u32(t, vrt), vx);
+        uint32x4_t color = veorq_u32(vorrq_u32(vandq_u32(d, p), q), r);
+
+        unsigned int mask = __guac_common_pixels_diff_neon(d, color);
+        if (mask) {
+            __guac_common_pixels_mark(x, mask, &changed, first, last);
+            vst1q_u32(dst + x, color);
+        }
+
+    }
+
+    int tail_changed = __guac_common_pixels_transfer_scalar(dst + x, src + x,
+            width - x, &tail_first, &tail_last, n, pt, pc, qt, qc, rt, x_mask);
+
+    return __guac_common_pixels_merge(x, tail_changed, tail_first, tail_last,
+            changed, first, last);
+
+}
+
+#define GUAC_COMMON_PIXELS_DEFINE_TRANSFER_NEON(...) \
+    GUAC_COMMON_PIXELS_DEFINE_TRANSFER(neon, , __VA_ARGS__)
+#define GUAC_COMMON_PIXELS_TRANSFER_ENTRY_NEON(...) \
+    GUAC_COMMON_PIXELS_TRANSFER_ENTRY(neon, __VA_ARGS__)
+
+GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(GUAC_COMMON_PIXELS_DEFINE_TRANSFER_NEON)
+
+static const guac_common_pixel_kernels __guac_common_pixels_neon = {
+    .name       = "neon",
+    .put_opaque = __guac_common_pixels_put_opaque_neon,
+    .put_blend  = __guac_common_pixels_put_blend_neon,
+    .fill_mask  = __guac_common_pixels_fill_mask_neon,
+    .transfer   = {
+        GUAC_COMMON_PIXELS_FOR_EACH_TRANSFER(
+                GUAC_COMMON_PIXELS_TRANSFER_ENTRY_NEON)
+    },
+    .scan       = __guac_common_pixels_scan_neon
+};
+
+#endif
+
+/**
+ * All kernel sets supported by the current CPU, fastest first.
+ */
+static const guac_common_pixel_kernels*
+    __guac_common_pixels_supported[GUAC_COMMON_PIXELS_MAX_KERNELS];
+
+/**
+ * The number of entries within __guac_common_pixels_supported.
+ */
+static int __guac_common_pixels_supported_length = 0;
+
+/**
+ * Guard ensuring the CPU is inspected only once.
+ */
+static pthread_once_t __guac_common_pixels_init_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Inspects the current CPU, populating __guac_common_pixels_supported with
+ * all supported kernel sets.
+ */
+static void __guac_common_pixels_init() {
+
+    int length = 0;
+
+#ifdef GUAC_COMMON_PIXELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        __guac_common_pixels_supported[length++] = &__guac_common_pixels_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        __guac_common_pixels_supported[length++] = &__guac_common_pixels_sse41;
+#endif
+
+#ifdef GUAC_COMMON_PIXELS_NEON
+    __guac_common_pixels_supported[length++] = &__guac_common_pixels_neon;
+#endif
+
+    __guac_common_pixels_supported[length++] = &guac_common_pixels_scalar;
+    __guac_common_pixels_supported_length = length;
+
+}
+
+const guac_common_pixel_kernels* guac_common_pixels_get_kernels() {
+    pthread_once(&__guac_common_pixels_init_once, __guac_common_pixels_init);
+    return __guac_common_pixels_supported[0];
+}
+
+int guac_common_pixels_list_kernels(const guac_common_pixel_kernels** kernels,
+        int max) {
+
+    int i;
+
+    pthread_once(&__guac_common_pixels_init_once, __guac_common_pixels_init);
+
+    for (i = 0; i < max && i < __guac_common_pixels_supported_length; i++)
+        kernels[i] = __guac_common_pixels_supported[i];
+
+    return i;
+
+}
+
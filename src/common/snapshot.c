@@ -0,0 +1,318 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/snapshot.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+guac_common_snapshot* guac_common_snapshot_alloc(guac_client* client) {
+
+    guac_common_snapshot* snapshot = malloc(sizeof(guac_common_snapshot));
+    if (snapshot == NULL)
+        return NULL;
+
+    snapshot->client = client;
+    snapshot->current = NULL;
+
+    pthread_cond_init(&snapshot->_ready, NULL);
+    pthread_mutex_init(&snapshot->_lock, NULL);
+
+    return snapshot;
+
+}
+
+void guac_common_snapshot_free(guac_common_snapshot* snapshot) {
+
+    pthread_cond_destroy(&snapshot->_ready);
+    pthread_mutex_destroy(&snapshot->_lock);
+    free(snapshot);
+
+}
+
+/**
+ * Frees the given frame, including its captured image data and encoded
+ * instructions.
+ *
+ * @param frame
+ *     The frame to free.
+ */
+static void guac_common_snapshot_free_frame(guac_common_snapshot_frame* frame) {
+
+    int i;
+
+    for (i = 0; i < frame->layers_length; i++)
+        free(frame->layers[i].buffer);
+
+    free(frame->layers);
+    free(frame->data);
+    free(frame);
+
+}
+
+guac_common_snapshot_frame* guac_common_snapshot_acquire(
+        guac_common_snapshot* snapshot) {
+
+    guac_common_snapshot_frame* frame;
+
+    pthread_mutex_lock(&snapshot->_lock);
+
+    /* Wait for any frame currently being captured by another user */
+    while ((frame = snapshot->current) != NULL && !frame->ready)
+        pthread_cond_wait(&snapshot->_ready, &snapshot->_lock);
+
+    /* Share the current frame if it is recent enough */
+    if (frame != NULL && !frame->failed && guac_timestamp_current()
+            - frame->timestamp < GUAC_COMMON_SNAPSHOT_MAX_AGE) {
+        frame->refs++;
+        goto complete;
+    }
+
+    /* Otherwise, begin a new frame. Any older frame is freed by the last of
+     * the users still using it. */
+    frame = calloc(1, sizeof(guac_common_snapshot_frame));
+    if (frame == NULL)
+        goto complete;
+
+    frame->refs = 1;
+    frame->timestamp = guac_timestamp_current();
+    snapshot->current = frame;
+
+complete:
+    pthread_mutex_unlock(&snapshot->_lock);
+    return frame;
+
+}
+
+guac_common_snapshot_layer* guac_common_snapshot_add_layer(
+        guac_common_snapshot_frame* frame) {
+
+    /* Grow layer array as necessary */
+    if (frame->layers_length == frame->layers_available) {
+
+        int available = frame->layers_available ? frame->layers_available * 2
+                                                : 16;
+
+        guac_common_snapshot_layer* layers = realloc(frame->layers,
+                available * sizeof(guac_common_snapshot_layer));
+        if (layers == NULL) {
+            frame->failed = 1;
+            return NULL;
+        }
+
+        frame->layers = layers;
+        frame->layers_available = available;
+
+    }
+
+    guac_common_snapshot_layer* layer = &frame->layers[frame->layers_length++];
+    memset(layer, 0, sizeof(guac_common_snapshot_layer));
+    return layer;
+
+}
+
+/**
+ * Appends data written to a guac_socket to the encoded instructions of the
+ * guac_common_snapshot_frame stored within the socket's data.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or -1 if the buffer could not be grown.
+ */
+static ssize_t guac_common_snapshot_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_common_snapshot_frame* frame =
+        (guac_common_snapshot_frame*) socket->data;
+
+    /* Grow buffer as necessary */
+    if (frame->length + count > frame->size) {
+
+        size_t size = frame->size ? frame->size : 65536;
+        while (size < frame->length + count)
+            size *= 2;
+
+        char* data = realloc(frame->data, size);
+        if (data == NULL) {
+            frame->failed = 1;
+            return -1;
+        }
+
+        frame->data = data;
+        frame->size = size;
+
+    }
+
+    memcpy(frame->data + frame->length, buf, count);
+    frame->length += count;
+
+    return count;
+
+}
+
+/**
+ * Writes the instructions which reproduce the given captured layer on a
+ * newly-joined client over the given socket.
+ *
+ * @param client
+ *     The client associated with the captured display.
+ *
+ * @param socket
+ *     The socket receiving the encoded instructions.
+ *
+ * @param stream
+ *     The stream to use for the layer's image data.
+ *
+ * @param layer
+ *     The captured layer to encode.
+ */
+static void guac_common_snapshot_encode_layer(guac_client* client,
+        guac_socket* socket, guac_stream* stream,
+        const guac_common_snapshot_layer* layer) {
+
+    /* Layer properties apply only to visible, non-default layers */
+    if (layer->layer.index > 0) {
+        guac_protocol_send_shade(socket, &layer->layer, layer->opacity);
+        guac_protocol_send_move(socket, &layer->layer, &layer->parent,
+                layer->x, layer->y, layer->z);
+    }
+
+    guac_protocol_send_size(socket, &layer->layer,
+            layer->width, layer->height);
+
+    if (layer->buffer == NULL)
+        return;
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(
+            layer->buffer, CAIRO_FORMAT_ARGB32,
+            layer->width, layer->height, layer->stride);
+
+    guac_client_encode_png(client, socket, stream, GUAC_COMP_OVER,
+            &layer->layer, 0, 0, image);
+
+    cairo_surface_destroy(image);
+
+}
+
+void guac_common_snapshot_encode(guac_common_snapshot* snapshot,
+        guac_common_snapshot_frame* frame) {
+
+    int i;
+
+    if (frame->failed)
+        goto complete;
+
+    /* Capture encoded instructions in memory */
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL) {
+        frame->failed = 1;
+        goto complete;
+    }
+
+    socket->data = frame;
+    socket->write_handler = guac_common_snapshot_write_handler;
+
+    /* All images share a single stream, each closed before the next begins.
+     * The stream is released before the frame is sent, as the frame reaches
+     * each joining user before that user receives any other stream. */
+    guac_stream* stream = guac_client_alloc_stream(snapshot->client);
+    if (stream == NULL) {
+        guac_socket_free(socket);
+        frame->failed = 1;
+        goto complete;
+    }
+
+    for (i = 0; i < frame->layers_length; i++) {
+        if (frame->layers[i].realized)
+            guac_common_snapshot_encode_layer(snapshot->client, socket,
+                    stream, &frame->layers[i]);
+    }
+
+    guac_client_free_stream(snapshot->client, stream);
+    guac_socket_free(socket);
+
+complete:
+
+    /* Wake all users waiting for this frame, even if it failed */
+    pthread_mutex_lock(&snapshot->_lock);
+    frame->ready = 1;
+    pthread_cond_broadcast(&snapshot->_ready);
+    pthread_mutex_unlock(&snapshot->_lock);
+
+}
+
+const guac_common_snapshot_layer* guac_common_snapshot_find_layer(
+        const guac_common_snapshot_frame* frame, const guac_layer* layer) {
+
+    int i;
+
+    for (i = 0; i < frame->layers_length; i++) {
+        if (frame->layers[i].layer.index == layer->index)
+            return &frame->layers[i];
+    }
+
+    return NULL;
+
+}
+
+void guac_common_snapshot_write(const guac_common_snapshot_frame* frame,
+        guac_socket* socket) {
+
+    guac_socket_instruction_begin(socket);
+    guac_socket_write(socket, frame->data, frame->length);
+    guac_socket_instruction_end(socket);
+
+}
+
+void guac_common_snapshot_release(guac_common_snapshot* snapshot,
+        guac_common_snapshot_frame* frame) {
+
+    pthread_mutex_lock(&snapshot->_lock);
+
+    /* Free frame once no longer used by any joining user */
+    if (--frame->refs == 0) {
+
+        if (snapshot->current == frame)
+            snapshot->current = NULL;
+
+        guac_common_snapshot_free_frame(frame);
+
+    }
+
+    pthread_mutex_unlock(&snapshot->_lock);
+
+}
+
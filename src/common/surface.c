@@ -18,11 +18,15 @@
  */
 
 #include "config.h"
+#include "common/encoder.h"
+#include "common/image_cache.h"
+#include "common/pixels.h"
 #include "common/rect.h"
 #include "common/surface.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
+#include <guacamole/hash.h>
 #include <guacamole/layer.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
@@ -61,17 +65,18 @@
 #define GUAC_SURFACE_BASE_COST 4096
 
 /**
- * An increase in cost is negligible if it is less than
- * 1/GUAC_SURFACE_NEGLIGIBLE_INCREASE of the old cost.
+ * The minimum number of pixels within a uniform, opaque portion of a larger
+ * update for that portion to be sent as a solid rectangle rather than as part
+ * of an image. Smaller portions are cheap to encode, and are not worth
+ * splitting the surrounding image into several images.
  */
-#define GUAC_SURFACE_NEGLIGIBLE_INCREASE 4
+#define GUAC_SURFACE_FILL_MIN_SIZE 16384
 
 /**
- * If combining an update because it appears to be follow a fill pattern,
- * the combined cost must not exceed
- * GUAC_SURFACE_FILL_PATTERN_FACTOR * (total uncombined cost).
+ * The number of pixels set aside at a time when transferring a row of pixels
+ * onto an overlapping portion of itself.
  */
-#define GUAC_SURFACE_FILL_PATTERN_FACTOR 3
+#define GUAC_SURFACE_TRANSFER_BLOCK_SIZE 256
 
 /* Define cairo_format_stride_for_width() if missing */
 #ifndef HAVE_CAIRO_FORMAT_STRIDE_FOR_WIDTH
@@ -211,118 +216,126 @@ static void __guac_common_clip_rect(guac_common_surface* surface,
 }
 
 /**
- * Returns whether a rectangle within the given surface contains only fully
- * opaque pixels.
- *
- * @param surface
- *     The surface to check.
+ * Returns the mask of the damage blocks of a heat map cell which are covered
+ * by the given rectangle. The rectangle must intersect the cell.
  *
  * @param rect
- *     The rectangle to check.
+ *     The rectangle covering the blocks to include in the mask.
+ *
+ * @param cell_x
+ *     The X coordinate of the upper-left corner of the heat map cell, in
+ *     pixels.
+ *
+ * @param cell_y
+ *     The Y coordinate of the upper-left corner of the heat map cell, in
+ *     pixels.
  *
  * @return
- *     Non-zero if the rectangle contains only fully opaque pixels, zero
- *     otherwise.
+ *     The mask of all damage blocks of the cell which are at least partly
+ *     covered by the given rectangle.
  */
-static int __guac_common_surface_is_opaque(guac_common_surface* surface,
-        guac_common_rect* rect) {
-
-    int x, y;
+static uint64_t __guac_common_surface_damage_mask(const guac_common_rect* rect,
+        int cell_x, int cell_y) {
 
-    int stride = surface ->stride;
-    unsigned char* buffer =
-        surface->buffer + (stride * rect->y) + (4 * rect->x);
+    /* Determine range of covered blocks within cell */
+    int left   = rect->x - cell_x;
+    int top    = rect->y - cell_y;
+    int right  = rect->x + rect->width  - 1 - cell_x;
+    int bottom = rect->y + rect->height - 1 - cell_y;
 
-    /* For each row */
-    for (y = 0; y < rect->height; y++) {
-
-        /* Search for a non-opaque pixel */
-        uint32_t* current = (uint32_t*) buffer;
-        for (x=0; x < rect->width; x++) {
+    int min_x = left < 0 ? 0 : left / GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE;
+    int min_y = top  < 0 ? 0 : top  / GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE;
 
-            /* Rectangle is non-opaque if a single non-opaque pixel is found */
-            uint32_t color = *(current++);
-            if ((color & 0xFF000000) != 0xFF000000)
-                return 0;
-
-        }
+    int max_x = GUAC_COMMON_SURFACE_DAMAGE_BLOCKS - 1;
+    if (right < GUAC_COMMON_SURFACE_HEAT_CELL_SIZE)
+        max_x = right / GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE;
 
-        /* Next row */
-        buffer += stride;
+    int max_y = GUAC_COMMON_SURFACE_DAMAGE_BLOCKS - 1;
+    if (bottom < GUAC_COMMON_SURFACE_HEAT_CELL_SIZE)
+        max_y = bottom / GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE;
 
-    }
+    /* Repeat the covered columns within each covered row */
+    uint64_t columns = (0xFFu >> (7 - max_x)) & (0xFFu << min_x);
+    uint64_t rows = (UINT64_MAX >> (8 * (7 - max_y)))
+                  & (UINT64_MAX << (8 * min_y));
 
-    /* Rectangle is opaque */
-    return 1;
+    return (columns * 0x0101010101010101ull) & rows;
 
 }
 
-
 /**
- * Returns whether the given rectangle should be combined into the existing
- * dirty rectangle, to be eventually flushed as a "png" instruction.
+ * Returns whether the given rectangle, drawn by an operation which contains
+ * only metainformation about the rectangle (such as a copy or an opaque
+ * rectangle fill), should be combined into the existing damage of the
+ * surface, to be eventually flushed as image data. Such an operation is
+ * combined only if the image data it adds to the damage of the surface costs
+ * no more than sending the operation itself.
  *
  * @param surface The surface to be queried.
  * @param rect The update rectangle.
- * @param rect_only Non-zero if this update, by its nature, contains only
- *                  metainformation about the update's rectangle, zero if
- *                  the update also contains image data.
- * @return Non-zero if the update should be combined with any existing update,
+ * @return Non-zero if the update should be combined with any existing damage,
  *         zero otherwise.
  */
-static int __guac_common_should_combine(guac_common_surface* surface, const guac_common_rect* rect, int rect_only) {
+static int __guac_common_should_combine(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-    if (surface->dirty) {
+    /* Do not combine if there is nothing to combine with */
+    if (!surface->damaged_cells)
+        return 0;
+
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
 
-        int combined_cost, dirty_cost, update_cost;
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_x = (rect->x + rect->width - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
 
-        /* Simulate combination */
-        guac_common_rect combined = surface->dirty_rect;
-        guac_common_rect_extend(&combined, rect);
+    /* The damage added by combining must cost no more than the update */
+    int allowed = (GUAC_SURFACE_BASE_COST + rect->width * rect->height)
+                / GUAC_SURFACE_DATA_FACTOR;
 
-        /* Combine if result is still small */
-        if (combined.width <= GUAC_SURFACE_NEGLIGIBLE_WIDTH && combined.height <= GUAC_SURFACE_NEGLIGIBLE_HEIGHT)
-            return 1;
+    /* Small updates within existing damage are always combined */
+    int negligible = rect->width <= GUAC_SURFACE_NEGLIGIBLE_WIDTH
+                  && rect->height <= GUAC_SURFACE_NEGLIGIBLE_HEIGHT;
+
+    int added = 0;
+    int x, y;
 
-        /* Estimate costs of the existing update, new update, and both combined */
-        combined_cost = GUAC_SURFACE_BASE_COST + combined.width * combined.height;
-        dirty_cost    = GUAC_SURFACE_BASE_COST + surface->dirty_rect.width * surface->dirty_rect.height;
-        update_cost   = GUAC_SURFACE_BASE_COST + rect->width * rect->height;
+    for (y = min_y; y <= max_y; y++) {
+        for (x = min_x; x <= max_x; x++) {
 
-        /* Reduce cost if no image data */
-        if (rect_only)
-            update_cost /= GUAC_SURFACE_DATA_FACTOR;
+            uint64_t damage = surface->damage[y * heat_width + x].blocks;
 
-        /* Combine if cost estimate shows benefit */
-        if (combined_cost <= update_cost + dirty_cost)
-            return 1;
+            /* Negligible updates must only touch damaged cells */
+            if (negligible && !damage)
+                negligible = 0;
 
-        /* Combine if increase in cost is negligible */
-        if (combined_cost - dirty_cost <= dirty_cost / GUAC_SURFACE_NEGLIGIBLE_INCREASE)
-            return 1;
+            uint64_t mask = __guac_common_surface_damage_mask(rect,
+                    x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
 
-        if (combined_cost - update_cost <= update_cost / GUAC_SURFACE_NEGLIGIBLE_INCREASE)
-            return 1;
+            added += __builtin_popcountll(mask & ~damage)
+                * GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE
+                * GUAC_COMMON_SURFACE_DAMAGE_BLOCK_SIZE;
 
-        /* Combine if we anticipate further updates, as this update follows a common fill pattern */
-        if (rect->x == surface->dirty_rect.x && rect->y == surface->dirty_rect.y + surface->dirty_rect.height) {
-            if (combined_cost <= (dirty_cost + update_cost) * GUAC_SURFACE_FILL_PATTERN_FACTOR)
-                return 1;
-        }
+            /* Stop as soon as the outcome is known */
+            if (added > allowed && !negligible)
+                return 0;
 
+        }
     }
-    
-    /* Otherwise, do not combine */
-    return 0;
+
+    return 1;
 
 }
 
 /**
- * Expands the dirty rect of the given surface to contain the rect described by the given
- * coordinates.
+ * Adds the given rectangle to the damage of the given surface, such that it
+ * will be sent as image data when the surface is next flushed.
  *
  * @param surface The surface to mark as dirty.
- * @param rect The rectangle of the update which is dirtying the surface.
+ * @param rect The rectangle of the update which is dirtying the surface. This
+ *             rectangle must be within the bounds of the surface.
  */
 static void __guac_common_mark_dirty(guac_common_surface* surface, const guac_common_rect* rect) {
 
@@ -330,14 +343,82 @@ static void __guac_common_mark_dirty(guac_common_surface* surface, const guac_co
     if (rect->width <= 0 || rect->height <= 0)
         return;
 
-    /* If already dirty, update existing rect */
-    if (surface->dirty)
-        guac_common_rect_extend(&surface->dirty_rect, rect);
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int index_words = GUAC_COMMON_SURFACE_DAMAGE_INDEX_WORDS(heat_width);
 
-    /* Otherwise init dirty rect */
-    else {
-        surface->dirty_rect = *rect;
-        surface->dirty = 1;
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_x = (rect->x + rect->width - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    int x, y;
+
+    for (y = min_y; y <= max_y; y++) {
+
+        guac_common_surface_damage_cell* damage =
+            surface->damage + y * heat_width;
+
+        uint64_t* index = surface->damage_index + y * index_words;
+
+        for (x = min_x; x <= max_x; x++) {
+
+            guac_common_surface_damage_cell* cell = &damage[x];
+
+            /* Determine the portion of the update within this cell */
+            guac_common_rect bounds;
+            guac_common_rect_init(&bounds,
+                    x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+            guac_common_rect_constrain(&bounds, rect);
+
+            /* Newly-damaged cells must be added to the index */
+            if (!cell->blocks) {
+                index[x / 64] |= 1ull << (x % 64);
+                surface->damaged_cells++;
+                cell->rect = bounds;
+            }
+            else
+                guac_common_rect_extend(&cell->rect, &bounds);
+
+            cell->blocks |= __guac_common_surface_damage_mask(rect,
+                    x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+
+        }
+
+    }
+
+}
+
+/**
+ * Updates the record of the contents of the given surface as displayed by the
+ * client, such that the given rectangle matches the current image data of the
+ * surface. This must be invoked whenever output which draws that rectangle is
+ * sent. If motion detection is disabled, this function has no effect.
+ *
+ * @param surface
+ *     The surface whose record of displayed contents should be updated.
+ *
+ * @param rect
+ *     The rectangle which has been drawn. This rectangle must be within the
+ *     bounds of the surface.
+ */
+static void __guac_common_surface_sync_previous(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    int y;
+
+    if (surface->previous == NULL)
+        return;
+
+    size_t offset = rect->y * surface->stride + rect->x * 4;
+
+    for (y = 0; y < rect->height; y++) {
+        memcpy(surface->previous + offset, surface->buffer + offset,
+                rect->width * 4);
+        offset += surface->stride;
     }
 
 }
@@ -423,71 +504,25 @@ static unsigned int __guac_common_surface_calculate_framerate(
 }
 
  /**
- * Guesses whether a rectangle within a particular surface would be better
+ * Guesses whether an image having the given content would be better
  * compressed as PNG or using a lossy format like JPEG. Positive values
  * indicate PNG is likely to be superior, while negative values indicate the
  * opposite.
  *
- * @param surface
- *     The surface containing the image data to check.
- *
- * @param rect
- *     The rect to check within the given surface.
+ * @param content
+ *     The content of the image, as determined when the update containing the
+ *     image was scanned.
  *
  * @return
  *     Positive values if PNG compression is likely to perform better than
  *     lossy alternatives, or negative values if PNG is likely to perform
  *     worse.
  */
-static int __guac_common_surface_png_optimality(guac_common_surface* surface,
-        const guac_common_rect* rect) {
-
-    int x, y;
-
-    int num_same = 0;
-    int num_different = 1;
-
-    /* Get image/buffer metrics */
-    int width = rect->width;
-    int height = rect->height;
-    int stride = surface->stride;
-
-    /* Get buffer from surface */
-    unsigned char* buffer = surface->buffer + rect->y * stride + rect->x * 4;
-
-    /* Image must be at least 1x1 */
-    if (width < 1 || height < 1)
-        return 0;
-
-    /* For each row */
-    for (y = 0; y < height; y++) {
-
-        uint32_t* row = (uint32_t*) buffer;
-        uint32_t last_pixel = *(row++) | 0xFF000000;
-
-        /* For each pixel in current row */
-        for (x = 1; x < width; x++) {
-
-            /* Get next pixel */
-            uint32_t current_pixel = *(row++) | 0xFF000000;
-
-            /* Update same/different counts according to pixel value */
-            if (current_pixel == last_pixel)
-                num_same++;
-            else
-                num_different++;
-
-            last_pixel = current_pixel;
-
-        }
-
-        /* Advance to next row */
-        buffer += stride;
-
-    }
+static int __guac_common_surface_png_optimality(
+        const guac_common_surface_block* content) {
 
     /* Return rough approximation of optimality for PNG compression */
-    return 0x100 * num_same / num_different - 0x400;
+    return 0x100 * content->same / (content->different + 1) - 0x400;
 
 }
 
@@ -501,12 +536,17 @@ static int __guac_common_surface_png_optimality(guac_common_surface* surface,
  * @param rect
  *     The rectangle to check.
  *
+ * @param content
+ *     The content of the rectangle, as determined when the update containing
+ *     the rectangle was scanned.
+ *
  * @return
  *     Non-zero if the rectangle would be optimally encoded as JPEG, zero
  *     otherwise.
  */
 static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+        const guac_common_rect* rect,
+        const guac_common_surface_block* content) {
 
     /* Calculate the average framerate for the given rect */
     int framerate = __guac_common_surface_calculate_framerate(surface, rect);
@@ -519,7 +559,7 @@ static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
      * - PNG is not more optimal based on image contents */
     return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
         && rect_size > GUAC_SURFACE_JPEG_MIN_BITMAP_SIZE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+        && __guac_common_surface_png_optimality(content) < 0;
 
 }
 
@@ -533,12 +573,17 @@ static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
  * @param rect
  *     The rectangle to check.
  *
+ * @param content
+ *     The content of the rectangle, as determined when the update containing
+ *     the rectangle was scanned.
+ *
  * @return
  *     Non-zero if the rectangle would be optimally encoded as WebP, zero
  *     otherwise.
  */
 static int __guac_common_surface_should_use_webp(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+        const guac_common_rect* rect,
+        const guac_common_surface_block* content) {
 
     /* Do not use WebP if not supported */
     if (!guac_client_supports_webp(surface->client))
@@ -551,7 +596,7 @@ static int __guac_common_surface_should_use_webp(guac_common_surface* surface,
      * - frame rate is high enough
      * - PNG is not more optimal based on image contents */
     return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+        && __guac_common_surface_png_optimality(content) < 0;
 
 }
 
@@ -621,148 +666,161 @@ static void __guac_common_surface_touch_rect(guac_common_surface* surface,
 }
 
 /**
- * Flushes the bitmap update currently described by the dirty rectangle within the
- * given surface to that surface's bitmap queue. There MUST be space within the
- * queue.
- *
- * @param surface The surface to flush.
- */
-static void __guac_common_surface_flush_to_queue(guac_common_surface* surface) {
-
-    guac_common_surface_bitmap_rect* rect;
-
-    /* Do not flush if not dirty */
-    if (!surface->dirty)
-        return;
-
-    /* Add new rect to queue */
-    rect = &(surface->bitmap_queue[surface->bitmap_queue_length++]);
-    rect->rect = surface->dirty_rect;
-    rect->flushed = 0;
-
-    /* Surface now flushed */
-    surface->dirty = 0;
-
-}
-
-/**
- * Flushes the given surface, drawing any pending operations on the remote
- * display. Surface properties are not flushed.
+ * Updates the record of which heat map cells of the given surface display
+ * content that was sent with a lossy format, following an update of the given
+ * rectangle. Lossy updates mark every cell which they touch, while lossless
+ * updates unmark only the cells which they cover entirely.
  *
  * @param surface
- *     The surface to flush.
- */
-static void __guac_common_surface_flush(guac_common_surface* surface);
-
-/**
- * Schedules a deferred flush of the given surface. This will not immediately
- * flush the surface to the client. Instead, the result of the flush is
- * added to a queue which is reinspected and combined (if possible) with other
- * deferred flushes during the call to guac_common_surface_flush().
+ *     The surface that was updated.
+ *
+ * @param rect
+ *     The rectangle that was updated, which must lie within the bounds of
+ *     the surface.
  *
- * @param surface The surface to flush.
+ * @param lossy
+ *     Non-zero if the update was lossy, zero if the client now displays the
+ *     updated rectangle exactly.
  */
-static void __guac_common_surface_flush_deferred(guac_common_surface* surface) {
+static void __guac_common_surface_mark_lossy(guac_common_surface* surface,
+        const guac_common_rect* rect, int lossy) {
+
+    int x, y;
 
-    /* Do not flush if not dirty */
-    if (!surface->dirty)
+    if (rect->width <= 0 || rect->height <= 0)
         return;
 
-    /* Flush if queue size has reached maximum (space is reserved for the final
-     * dirty rect, as __guac_common_surface_flush() MAY add an additional rect
-     * to the queue */
-    if (surface->bitmap_queue_length == GUAC_COMMON_SURFACE_QUEUE_SIZE-1)
-        __guac_common_surface_flush(surface);
+    /* Nothing to unmark if no content is lossy */
+    if (!lossy && !surface->lossy_cells)
+        return;
 
-    /* Append dirty rect to queue */
-    __guac_common_surface_flush_to_queue(surface);
+    guac_timestamp time = lossy ? guac_timestamp_current() : 0;
 
-}
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
 
-/**
- * Transfers a single uint32_t using the given transfer function.
- *
- * @param op The transfer function to use.
- * @param src The source of the uint32_t value.
- * @param dst THe destination which will hold the result of the transfer.
- * @return Non-zero if the destination value was changed, zero otherwise.
- */
-static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_t* src, uint32_t* dst) {
+    /* Calculate minimum X/Y coordinates intersecting given rect */
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
 
-    uint32_t orig = *dst;
+    /* Calculate maximum X/Y coordinates intersecting given rect */
+    int max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
 
-    switch (op) {
+    for (y = min_y; y <= max_y; y++) {
 
-        case GUAC_TRANSFER_BINARY_BLACK:
-            *dst = 0xFF000000;
-            break;
+        guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width + min_x;
 
-        case GUAC_TRANSFER_BINARY_WHITE:
-            *dst = 0xFFFFFFFF;
-            break;
+        for (x = min_x; x <= max_x; x++, heat_cell++) {
 
-        case GUAC_TRANSFER_BINARY_SRC:
-            *dst = *src;
-            break;
+            /* Lossy updates affect any cell they touch */
+            if (lossy) {
+                if (!heat_cell->lossy)
+                    surface->lossy_cells++;
+                heat_cell->lossy = time;
+                continue;
+            }
 
-        case GUAC_TRANSFER_BINARY_DEST:
-            /* NOP */
-            break;
+            if (!heat_cell->lossy)
+                continue;
+
+            /* Lossless updates restore only cells they fully cover */
+            guac_common_rect cell;
+            guac_common_rect_init(&cell,
+                    x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+            __guac_common_bound_rect(surface, &cell, NULL, NULL);
+
+            if (cell.x >= rect->x && cell.y >= rect->y
+                    && cell.x + cell.width  <= rect->x + rect->width
+                    && cell.y + cell.height <= rect->y + rect->height) {
+                heat_cell->lossy = 0;
+                surface->lossy_cells--;
+            }
 
-        case GUAC_TRANSFER_BINARY_NSRC:
-            *dst = *src ^ 0x00FFFFFF;
-            break;
+        }
 
-        case GUAC_TRANSFER_BINARY_NDEST:
-            *dst = *dst ^ 0x00FFFFFF;
-            break;
+    }
 
-        case GUAC_TRANSFER_BINARY_AND:
-            *dst = ((*dst) & (0xFF000000 | *src));
-            break;
+}
 
-        case GUAC_TRANSFER_BINARY_NAND:
-            *dst = ((*dst) & (0xFF000000 | *src)) ^ 0x00FFFFFF;
-            break;
+/**
+ * Returns whether any part of the given rectangle of the given surface may
+ * display content that was sent with a lossy format.
+ *
+ * @param surface
+ *     The surface to test.
+ *
+ * @param rect
+ *     The rectangle to test, which must lie within the bounds of the
+ *     surface.
+ *
+ * @return
+ *     Non-zero if any heat map cell touched by the given rectangle displays
+ *     lossy content, zero otherwise.
+ */
+static int __guac_common_surface_is_lossy(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-        case GUAC_TRANSFER_BINARY_OR:
-            *dst = ((*dst) | (0x00FFFFFF & *src));
-            break;
+    int x, y;
 
-        case GUAC_TRANSFER_BINARY_NOR:
-            *dst = ((*dst) | (0x00FFFFFF & *src)) ^ 0x00FFFFFF;
-            break;
+    if (!surface->lossy_cells || rect->width <= 0 || rect->height <= 0)
+        return 0;
 
-        case GUAC_TRANSFER_BINARY_XOR:
-            *dst = ((*dst) ^ (0x00FFFFFF & *src));
-            break;
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
 
-        case GUAC_TRANSFER_BINARY_XNOR:
-            *dst = ((*dst) ^ (0x00FFFFFF & *src)) ^ 0x00FFFFFF;
-            break;
+    /* Calculate minimum X/Y coordinates intersecting given rect */
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
 
-        case GUAC_TRANSFER_BINARY_NSRC_AND:
-            *dst = ((*dst) & (0xFF000000 | (*src ^ 0x00FFFFFF)));
-            break;
+    /* Calculate maximum X/Y coordinates intersecting given rect */
+    int max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
 
-        case GUAC_TRANSFER_BINARY_NSRC_NAND:
-            *dst = ((*dst) & (0xFF000000 | (*src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
-            break;
+    for (y = min_y; y <= max_y; y++) {
 
-        case GUAC_TRANSFER_BINARY_NSRC_OR:
-            *dst = ((*dst) | (0x00FFFFFF & (*src ^ 0x00FFFFFF)));
-            break;
+        const guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width + min_x;
 
-        case GUAC_TRANSFER_BINARY_NSRC_NOR:
-            *dst = ((*dst) | (0x00FFFFFF & (*src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
-            break;
+        for (x = min_x; x <= max_x; x++, heat_cell++) {
+            if (heat_cell->lossy)
+                return 1;
+        }
 
     }
 
-    return *dst != orig;
+    return 0;
 
 }
 
+/**
+ * Flushes the given surface, drawing any pending operations on the remote
+ * display. Surface properties are not flushed.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param refresh
+ *     Non-zero if any remaining bandwidth should be used to re-send static
+ *     lossy content losslessly, zero otherwise.
+ */
+static void __guac_common_surface_flush(guac_common_surface* surface,
+        int refresh);
+
+/**
+ * Sends the entire contents of the given surface to each connected user for
+ * which duplication of the surface was deferred, and to no other user. All
+ * pending changes to the surface must already have been flushed.
+ *
+ * @param surface
+ *     The surface whose deferred duplication should be completed.
+ */
+static void __guac_common_surface_flush_dup(guac_common_surface* surface);
+
 /**
  * Assigns the given value to all pixels within a rectangle of the backing
  * surface of the given destination surface. The color of all pixels within the
@@ -849,79 +907,39 @@ static void __guac_common_surface_set(guac_common_surface* dst,
 }
 
 /**
- * Applies the Porter-Duff "over" composite operator, blending the two given
- * color components using the given alpha value.
- *
- * @param dst
- *     The destination color component.
- *
- * @param src
- *     The source color component.
+ * Restricts the given rectangle to the given range of changed pixels, where
+ * the range is relative to the upper-left corner of the rectangle. If the
+ * range is empty, the rectangle is given a width and height of zero.
  *
- * @param alpha
- *     The alpha value which applies to the blending operation.
+ * @param rect
+ *     The rectangle to restrict.
  *
- * @return
- *     The result of applying the Porter-Duff "over" composite operator to the
- *     given source and destination components.
- */
-static int guac_common_surface_blend_component(int dst, int src, int alpha) {
-
-    int blended = src + dst * (0xFF - alpha);
-
-    /* Do not exceed maximum component value */
-    if (blended > 0xFF)
-        return 0xFF;
-
-    return blended;
-
-}
-
-/**
- * Applies the Porter-Duff "over" composite operator, blending each component
- * of the two given ARGB colors.
+ * @param min_x
+ *     The X coordinate of the leftmost changed pixel.
  *
- * @param dst
- *     The destination ARGB color.
+ * @param min_y
+ *     The Y coordinate of the topmost changed pixel.
  *
- * @param src
- *     The source ARGB color.
+ * @param max_x
+ *     The X coordinate of the rightmost changed pixel.
  *
- * @return
- *     The result of applying the Porter-Duff "over" composite operator to the
- *     given source and destination colors.
+ * @param max_y
+ *     The Y coordinate of the bottommost changed pixel.
  */
-static uint32_t guac_common_surface_argb_blend(uint32_t dst, uint32_t src) {
-
-    /* Separate destination ARGB color into its components */
-    int dst_a = (dst >> 24) & 0xFF;
-    int dst_r = (dst >> 16) & 0xFF;
-    int dst_g = (dst >>  8) & 0xFF;
-    int dst_b =  dst        & 0xFF;
-
-    /* Separate source ARGB color into its components */
-    int src_a = (src >> 24) & 0xFF;
-    int src_r = (src >> 16) & 0xFF;
-    int src_g = (src >>  8) & 0xFF;
-    int src_b =  src        & 0xFF;
-
-    /* If source is fully opaque (or destination is fully transparent), the
-     * blended result is the source */
-    if (src_a == 0xFF || dst_a == 0x00)
-        return src;
-
-    /* If source is fully transparent, the blended result is the destination */
-    if (src_a == 0x00)
-        return dst;
+static void __guac_common_surface_restrict_rect(guac_common_rect* rect,
+        int min_x, int min_y, int max_x, int max_y) {
 
-    /* Otherwise, blend each ARGB component, assuming pre-multiplied alpha */
-    int r = guac_common_surface_blend_component(dst_r, src_r, src_a);
-    int g = guac_common_surface_blend_component(dst_g, src_g, src_a);
-    int b = guac_common_surface_blend_component(dst_b, src_b, src_a);
-    int a = guac_common_surface_blend_component(dst_a, src_a, src_a);
-
-    /* Recombine blended components */
-    return (a << 24) | (r << 16) | (g << 8) | b;
+    /* Restrict destination rect to only updated pixels */
+    if (max_x >= min_x && max_y >= min_y) {
+        rect->x += min_x;
+        rect->y += min_y;
+        rect->width = max_x - min_x + 1;
+        rect->height = max_y - min_y + 1;
+    }
+    else {
+        rect->width = 0;
+        rect->height = 0;
+    }
 
 }
 
@@ -944,10 +962,15 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
                                       guac_common_surface* dst, guac_common_rect* rect,
                                       int opaque) {
 
+    const guac_common_pixel_kernels* kernels = guac_common_pixels_get_kernels();
+    guac_common_pixels_span* put =
+        opaque ? kernels->put_opaque : kernels->put_blend;
+
     unsigned char* dst_buffer = dst->buffer;
     int dst_stride = dst->stride;
 
-    int x, y;
+    int y;
+    int first, last;
 
     int min_x = rect->width;
     int min_y = rect->height;
@@ -963,40 +986,13 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
-
-        /* Copy row */
-        for (x=0; x < rect->width; x++) {
-
-            uint32_t color;
-
-            /* Get source and destination color values */
-            uint32_t src_color = *src_current;
-            uint32_t dst_color = *dst_current;
-
-            /* Ignore alpha channel if opaque */
-            if (opaque)
-                color = src_color | 0xFF000000;
-
-            /* Otherwise, perform alpha blending operation */
-            else
-                color = guac_common_surface_argb_blend(dst_color, src_color);
-
-            /* If the destination color is changing, update rectangle bounds
-             * and store the new color */
-            if (dst_color != color) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-                *dst_current = color;
-            }
-
-            /* Advance to next pixel */
-            src_current++;
-            dst_current++;
-
+        /* Copy row, updating rectangle bounds if anything changed */
+        if (put((uint32_t*) dst_buffer, (const uint32_t*) src_buffer,
+                    rect->width, &first, &last)) {
+            if (first < min_x) min_x = first;
+            if (y < min_y) min_y = y;
+            if (last > max_x) max_x = last;
+            max_y = y;
         }
 
         /* Next row */
@@ -1005,17 +1001,7 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
 
     }
 
-    /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+    __guac_common_surface_restrict_rect(rect, min_x, min_y, max_x, max_y);
 
     /* Update source X/Y */
     *sx += rect->x - orig_x;
@@ -1026,7 +1012,9 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
 /**
  * Fills the given surface with color, using the given buffer as a mask. Color
  * will be added to the given surface iff the corresponding pixel within the
- * buffer is opaque.
+ * buffer is not fully transparent. The dimensions and location of the
+ * destination rectangle will be altered to remove as many unchanged pixels as
+ * possible.
  *
  * @param src_buffer The buffer to use as a mask.
  * @param src_stride The number of bytes in each row of the source buffer.
@@ -1043,11 +1031,20 @@ static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_s
                                             guac_common_surface* dst, guac_common_rect* rect,
                                             int red, int green, int blue) {
 
+    guac_common_pixels_fill* fill_mask =
+        guac_common_pixels_get_kernels()->fill_mask;
+
     unsigned char* dst_buffer = dst->buffer;
     int dst_stride = dst->stride;
 
     uint32_t color = 0xFF000000 | (red << 16) | (green << 8) | blue;
-    int x, y;
+    int y;
+    int first, last;
+
+    int min_x = rect->width;
+    int min_y = rect->height;
+    int max_x = 0;
+    int max_y = 0;
 
     src_buffer += src_stride*sy + 4*sx;
     dst_buffer += (dst_stride * rect->y) + (4 * rect->x);
@@ -1055,18 +1052,13 @@ static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_s
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
-
-        /* Stencil row */
-        for (x=0; x < rect->width; x++) {
-
-            /* Fill with color if opaque */
-            if (*src_current & 0xFF000000)
-                *dst_current = color;
-
-            src_current++;
-            dst_current++;
+        /* Stencil row, updating rectangle bounds if anything changed */
+        if (fill_mask((uint32_t*) dst_buffer, (const uint32_t*) src_buffer,
+                    rect->width, color, &first, &last)) {
+            if (first < min_x) min_x = first;
+            if (y < min_y) min_y = y;
+            if (last > max_x) max_x = last;
+            max_y = y;
         }
 
         /* Next row */
@@ -1075,6 +1067,72 @@ static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_s
 
     }
 
+    __guac_common_surface_restrict_rect(rect, min_x, min_y, max_x, max_y);
+
+}
+
+/**
+ * Transfers a row of pixels to a destination row which overlaps and begins to
+ * the right of the source row. Pixels are transferred in blocks from right to
+ * left, each block of source pixels being set aside before any destination
+ * pixel is modified, such that every source pixel is read before it can be
+ * overwritten.
+ *
+ * @param transfer
+ *     The transfer kernel to apply to each block.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param src
+ *     The first pixel of the source row.
+ *
+ * @param width
+ *     The number of pixels in each row.
+ *
+ * @param first
+ *     Pointer to an int which will receive the index of the first changed
+ *     pixel, if any pixel changed.
+ *
+ * @param last
+ *     Pointer to an int which will receive the index of the last changed
+ *     pixel, if any pixel changed.
+ *
+ * @return
+ *     Non-zero if any destination pixel changed, zero otherwise.
+ */
+static int __guac_common_surface_transfer_overlapping(
+        guac_common_pixels_span* transfer, uint32_t* dst, const uint32_t* src,
+        int width, int* first, int* last) {
+
+    uint32_t block[GUAC_SURFACE_TRANSFER_BLOCK_SIZE];
+    int block_first, block_last;
+    int changed = 0;
+    int x = width;
+
+    while (x > 0) {
+
+        int length = x < GUAC_SURFACE_TRANSFER_BLOCK_SIZE
+                   ? x : GUAC_SURFACE_TRANSFER_BLOCK_SIZE;
+        x -= length;
+
+        memcpy(block, src + x, length * sizeof(uint32_t));
+        if (transfer(dst + x, block, length, &block_first, &block_last)) {
+
+            /* Blocks are visited from right to left */
+            if (!changed) {
+                *last = x + block_last;
+                changed = 1;
+            }
+
+            *first = x + block_first;
+
+        }
+
+    }
+
+    return changed;
+
 }
 
 /**
@@ -1093,12 +1151,17 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
                                            guac_transfer_function op,
                                            guac_common_surface* dst, guac_common_rect* rect) {
 
+    guac_common_pixels_span* transfer =
+        guac_common_pixels_get_kernels()->transfer[op];
+
     unsigned char* src_buffer = src->buffer;
     unsigned char* dst_buffer = dst->buffer;
 
-    int x, y;
+    int i, y;
+    int first, last;
     int src_stride, dst_stride;
     int step = 1;
+    int overlapping;
 
     int min_x = rect->width - 1;
     int min_y = rect->height - 1;
@@ -1108,75 +1171,58 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
     int orig_x = rect->x;
     int orig_y = rect->y;
 
-    /* Copy forwards only if destination is in a different surface or is before source */
-    if (src != dst || rect->y < *sy || (rect->y == *sy && rect->x < *sx)) {
-        src_buffer += src->stride * (*sy) + 4 * (*sx);
-        dst_buffer += (dst->stride * rect->y) + (4 * rect->x);
-        src_stride = src->stride;
-        dst_stride = dst->stride;
-        step = 1;
-    }
-
-    /* Otherwise, copy backwards */
-    else {
-        src_buffer += src->stride * (*sy + rect->height - 1) + 4 * (*sx + rect->width - 1);
-        dst_buffer += dst->stride * (rect->y + rect->height - 1) + 4 * (rect->x + rect->width - 1);
-        src_stride = -src->stride;
-        dst_stride = -dst->stride;
+    src_buffer += src->stride * (*sy) + 4 * (*sx);
+    dst_buffer += (dst->stride * rect->y) + (4 * rect->x);
+    src_stride = src->stride;
+    dst_stride = dst->stride;
+    y = 0;
+
+    /* Transfer rows from the bottom up if the destination is below the
+     * source within the same surface, such that each source row is read
+     * before it can be overwritten */
+    if (src == dst && rect->y > *sy) {
+        src_buffer += src_stride * (rect->height - 1);
+        dst_buffer += dst_stride * (rect->height - 1);
+        src_stride = -src_stride;
+        dst_stride = -dst_stride;
+        y = rect->height - 1;
         step = -1;
     }
 
-    /* For each row */
-    for (y=0; y < rect->height; y++) {
-
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+    /* Rows must be transferred from right to left if the destination begins
+     * to the right of the source within the same row */
+    overlapping = (src == dst && rect->y == *sy && rect->x > *sx
+            && rect->x - *sx < rect->width);
 
-        /* Transfer each pixel in row */
-        for (x=0; x < rect->width; x++) {
+    /* For each row */
+    for (i=0; i < rect->height; i++) {
 
-            if (__guac_common_surface_transfer_int(op, src_current, dst_current)) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-            }
+        int changed;
 
-            src_current += step;
-            dst_current += step;
+        if (overlapping)
+            changed = __guac_common_surface_transfer_overlapping(transfer,
+                    (uint32_t*) dst_buffer, (const uint32_t*) src_buffer,
+                    rect->width, &first, &last);
+        else
+            changed = transfer((uint32_t*) dst_buffer,
+                    (const uint32_t*) src_buffer, rect->width, &first, &last);
+
+        /* Update rectangle bounds if anything changed */
+        if (changed) {
+            if (first < min_x) min_x = first;
+            if (y < min_y) min_y = y;
+            if (last > max_x) max_x = last;
+            if (y > max_y) max_y = y;
         }
 
         /* Next row */
         src_buffer += src_stride;
         dst_buffer += dst_stride;
+        y += step;
 
     }
 
-    /* Translate X coordinate space of moving backwards */
-    if (step < 0) {
-        int old_max_x = max_x;
-        max_x = rect->width - 1 - min_x;
-        min_x = rect->width - 1 - old_max_x;
-    }
-
-    /* Translate Y coordinate space of moving backwards */
-    if (dst_stride < 0) {
-        int old_max_y = max_y;
-        max_y = rect->height - 1 - min_y;
-        min_y = rect->height - 1 - old_max_y;
-    }
-
-    /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+    __guac_common_surface_restrict_rect(rect, min_x, min_y, max_x, max_y);
 
     /* Update source X/Y */
     *sx += rect->x - orig_x;
@@ -1211,6 +1257,23 @@ guac_common_surface* guac_common_surface_alloc(guac_client* client,
     surface->heat_map = calloc(heat_width * heat_height,
             sizeof(guac_common_surface_heat_cell));
 
+    /* Create corresponding damage grid (initially undamaged) */
+    surface->damage = calloc(heat_width * heat_height,
+            sizeof(guac_common_surface_damage_cell));
+    surface->damage_index = calloc(heat_height
+            * GUAC_COMMON_SURFACE_DAMAGE_INDEX_WORDS(heat_width),
+            sizeof(uint64_t));
+    surface->damage_rects = malloc(2 * heat_width
+            * sizeof(guac_common_surface_damage_rect));
+    surface->damage_columns = malloc(heat_width
+            * sizeof(guac_common_surface_damage_column));
+
+    /* Allocate storage for classifying the content of flushed updates */
+    surface->blocks = malloc(heat_width * heat_height
+            * sizeof(guac_common_surface_block));
+    surface->regions = malloc(heat_width
+            * sizeof(guac_common_surface_region));
+
     /* Reset clipping rect */
     guac_common_surface_reset_clip(surface);
 
@@ -1235,12 +1298,92 @@ void guac_common_surface_free(guac_common_surface* surface) {
 
     pthread_mutex_destroy(&surface->_lock);
 
+    free(surface->tiles);
+    free(surface->dup_pending);
     free(surface->heat_map);
+    free(surface->damage);
+    free(surface->damage_index);
+    free(surface->damage_rects);
+    free(surface->damage_columns);
+    free(surface->blocks);
+    free(surface->regions);
+    free(surface->previous);
     free(surface->buffer);
     free(surface);
 
 }
 
+/**
+ * Reallocates the damage grid of the given surface to match the current
+ * dimensions of the surface, preserving the damage of all heat map cells
+ * which exist at both the old and new sizes.
+ *
+ * @param surface
+ *     The surface whose damage grid should be reallocated. The dimensions of
+ *     this surface must already have been updated.
+ *
+ * @param old_width
+ *     The width of the surface prior to resizing, in pixels.
+ *
+ * @param old_height
+ *     The height of the surface prior to resizing, in pixels.
+ */
+static void __guac_common_surface_resize_damage(guac_common_surface* surface,
+        int old_width, int old_height) {
+
+    guac_common_surface_damage_cell* old_damage = surface->damage;
+    uint64_t* old_index = surface->damage_index;
+
+    int old_heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(old_width);
+    int old_heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(old_height);
+
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+    int index_words = GUAC_COMMON_SURFACE_DAMAGE_INDEX_WORDS(heat_width);
+
+    surface->damage = calloc(heat_width * heat_height,
+            sizeof(guac_common_surface_damage_cell));
+    surface->damage_index = calloc(heat_height * index_words,
+            sizeof(uint64_t));
+
+    free(surface->damage_rects);
+    surface->damage_rects = malloc(2 * heat_width
+            * sizeof(guac_common_surface_damage_rect));
+
+    free(surface->damage_columns);
+    surface->damage_columns = malloc(heat_width
+            * sizeof(guac_common_surface_damage_column));
+
+    surface->damaged_cells = 0;
+
+    /* Copy damage of cells which still exist */
+    int copy_width = old_heat_width < heat_width ? old_heat_width : heat_width;
+    int copy_height = old_heat_height < heat_height
+                    ? old_heat_height : heat_height;
+    int x, y;
+
+    for (y = 0; y < copy_height; y++) {
+        for (x = 0; x < copy_width; x++) {
+
+            guac_common_surface_damage_cell* cell =
+                &old_damage[y * old_heat_width + x];
+
+            if (!cell->blocks)
+                continue;
+
+            surface->damage[y * heat_width + x] = *cell;
+            surface->damage_index[y * index_words + x / 64] |=
+                1ull << (x % 64);
+            surface->damaged_cells++;
+
+        }
+    }
+
+    free(old_damage);
+    free(old_index);
+
+}
+
 void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
 
     pthread_mutex_lock(&surface->_lock);
@@ -1254,6 +1397,8 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
 
     unsigned char* old_buffer;
     int old_stride;
+    int old_width;
+    int old_height;
     guac_common_rect old_rect;
 
     int sx = 0;
@@ -1266,6 +1411,8 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     /* Copy old surface data */
     old_buffer = surface->buffer;
     old_stride = surface->stride;
+    old_width = surface->width;
+    old_height = surface->height;
     guac_common_rect_init(&old_rect, 0, 0, surface->width, surface->height);
 
     /* Re-initialize at new size */
@@ -1282,18 +1429,69 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     /* Free old data */
     free(old_buffer);
 
+    /* Resize record of displayed contents, which the client preserves
+     * within the bounds of both the old and new sizes */
+    if (surface->previous != NULL) {
+
+        unsigned char* old_previous = surface->previous;
+        int y;
+
+        int copy_width = old_width < w ? old_width : w;
+        int copy_height = old_height < h ? old_height : h;
+
+        surface->previous = calloc(h, surface->stride);
+        for (y = 0; y < copy_height; y++)
+            memcpy(surface->previous + y * surface->stride,
+                    old_previous + y * old_stride, copy_width * 4);
+
+        free(old_previous);
+
+    }
+
     /* Allocate completely new heat map (can safely discard old stats) */
-    free(surface->heat_map);
+    guac_common_surface_heat_cell* old_heat_map = surface->heat_map;
     surface->heat_map = calloc(heat_width * heat_height,
             sizeof(guac_common_surface_heat_cell));
 
-    /* Resize dirty rect to fit new surface dimensions */
-    if (surface->dirty) {
-        __guac_common_bound_rect(surface, &surface->dirty_rect, NULL, NULL);
-        if (surface->dirty_rect.width <= 0 || surface->dirty_rect.height <= 0)
-            surface->dirty = 0;
+    /* Retain record of lossy content which the client still displays */
+    if (surface->lossy_cells) {
+
+        int old_heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(old_width);
+        int old_heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(old_height);
+        int x, y;
+
+        surface->lossy_cells = 0;
+        for (y = 0; y < heat_height && y < old_heat_height; y++) {
+            for (x = 0; x < heat_width && x < old_heat_width; x++) {
+
+                guac_timestamp lossy =
+                    old_heat_map[y * old_heat_width + x].lossy;
+
+                if (lossy) {
+                    surface->heat_map[y * heat_width + x].lossy = lossy;
+                    surface->lossy_cells++;
+                }
+
+            }
+        }
+
     }
 
+    free(old_heat_map);
+
+    /* Reallocate storage for classifying the content of flushed updates */
+    free(surface->blocks);
+    free(surface->regions);
+    surface->blocks = malloc(heat_width * heat_height
+            * sizeof(guac_common_surface_block));
+    surface->regions = malloc(heat_width
+            * sizeof(guac_common_surface_region));
+
+    /* Allocate new damage grid, preserving damage within the bounds of both
+     * the old and new sizes (damage beyond the new bounds is clipped when
+     * flushed) */
+    __guac_common_surface_resize_damage(surface, old_width, old_height);
+
     /* Update Guacamole layer */
     if (surface->realized)
         guac_protocol_send_size(socket, layer, w, h);
@@ -1333,10 +1531,6 @@ void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_
     guac_timestamp time = guac_timestamp_current();
     __guac_common_surface_touch_rect(surface, &rect, time);
 
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        __guac_common_surface_flush_deferred(surface);
-
     /* Always defer draws */
     __guac_common_mark_dirty(surface, &rect);
 
@@ -1368,10 +1562,8 @@ void guac_common_surface_paint(guac_common_surface* surface, int x, int y,
 
     /* Update backing surface */
     __guac_common_surface_fill_mask(buffer, stride, sx, sy, surface, &rect, red, green, blue);
-
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        __guac_common_surface_flush_deferred(surface);
+    if (rect.width <= 0 || rect.height <= 0)
+        goto complete;
 
     /* Always defer draws */
     __guac_common_mark_dirty(surface, &rect);
@@ -1392,6 +1584,7 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
     guac_socket* socket = dst->socket;
     const guac_layer* src_layer = src->layer;
     const guac_layer* dst_layer = dst->layer;
+    int drawn = 0;
 
     guac_common_rect srect;
     guac_common_rect_init(&srect, sx, sy, w, h);
@@ -1422,17 +1615,30 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
     }
 
     /* Defer if combining */
-    if (__guac_common_should_combine(dst, &drect, 1))
+    if (__guac_common_should_combine(dst, &drect))
         __guac_common_mark_dirty(dst, &drect);
 
     /* Otherwise, flush and draw immediately */
     else {
-        __guac_common_surface_flush(dst);
-        __guac_common_surface_flush(src);
+        __guac_common_surface_flush(dst, 0);
+        __guac_common_surface_flush(src, 0);
+
+        /* The source must exist for joined users before being referenced */
+        if (src != dst)
+            __guac_common_surface_flush_dup(src);
+
         guac_protocol_send_copy(socket, src_layer, srect.x, srect.y,
                 drect.width, drect.height, GUAC_COMP_OVER, dst_layer,
                 drect.x, drect.y);
         dst->realized = 1;
+        drawn = 1;
+
+        /* Copied lossy content remains lossy */
+        guac_common_rect copied;
+        guac_common_rect_init(&copied, srect.x, srect.y,
+                drect.width, drect.height);
+        if (__guac_common_surface_is_lossy(src, &copied))
+            __guac_common_surface_mark_lossy(dst, &drect, 1);
     }
 
     /* Update backing surface last if drect can intersect srect */
@@ -1440,6 +1646,10 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
         __guac_common_surface_transfer(src, &srect.x, &srect.y,
                 GUAC_TRANSFER_BINARY_SRC, dst, &drect);
 
+    /* Client now displays the result of the copy */
+    if (drawn)
+        __guac_common_surface_sync_previous(dst, &drect);
+
 complete:
 
     /* Unlock both surfaces */
@@ -1460,6 +1670,7 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
     guac_socket* socket = dst->socket;
     const guac_layer* src_layer = src->layer;
     const guac_layer* dst_layer = dst->layer;
+    int drawn = 0;
 
     guac_common_rect srect;
     guac_common_rect_init(&srect, sx, sy, w, h);
@@ -1489,22 +1700,39 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
     }
 
     /* Defer if combining */
-    if (__guac_common_should_combine(dst, &drect, 1))
+    if (__guac_common_should_combine(dst, &drect))
         __guac_common_mark_dirty(dst, &drect);
 
     /* Otherwise, flush and draw immediately */
     else {
-        __guac_common_surface_flush(dst);
-        __guac_common_surface_flush(src);
+        __guac_common_surface_flush(dst, 0);
+        __guac_common_surface_flush(src, 0);
+
+        /* The source must exist for joined users before being referenced */
+        if (src != dst)
+            __guac_common_surface_flush_dup(src);
+
         guac_protocol_send_transfer(socket, src_layer, srect.x, srect.y,
                 drect.width, drect.height, op, dst_layer, drect.x, drect.y);
         dst->realized = 1;
+        drawn = 1;
+
+        /* Transferred lossy content remains lossy */
+        guac_common_rect transferred;
+        guac_common_rect_init(&transferred, srect.x, srect.y,
+                drect.width, drect.height);
+        if (__guac_common_surface_is_lossy(src, &transferred))
+            __guac_common_surface_mark_lossy(dst, &drect, 1);
     }
 
     /* Update backing surface last if drect can intersect srect */
     if (src == dst)
         __guac_common_surface_transfer(src, &srect.x, &srect.y, op, dst, &drect);
 
+    /* Client now displays the result of the transfer */
+    if (drawn)
+        __guac_common_surface_sync_previous(dst, &drect);
+
 complete:
 
     /* Unlock both surfaces */
@@ -1536,27 +1764,21 @@ void guac_common_surface_set(guac_common_surface* surface,
         goto complete;
 
     /* Handle as normal draw if non-opaque */
-    if (alpha != 0xFF) {
-
-        /* Flush if not combining */
-        if (!__guac_common_should_combine(surface, &rect, 0))
-            __guac_common_surface_flush_deferred(surface);
-
-        /* Always defer draws */
+    if (alpha != 0xFF)
         __guac_common_mark_dirty(surface, &rect);
 
-    }
-
     /* Defer if combining */
-    else if (__guac_common_should_combine(surface, &rect, 1))
+    else if (__guac_common_should_combine(surface, &rect))
         __guac_common_mark_dirty(surface, &rect);
 
     /* Otherwise, flush and draw immediately */
     else {
-        __guac_common_surface_flush(surface);
+        __guac_common_surface_flush(surface, 0);
         guac_protocol_send_rect(socket, layer, rect.x, rect.y, rect.width, rect.height);
         guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer, red, green, blue, alpha);
         surface->realized = 1;
+        __guac_common_surface_sync_previous(surface, &rect);
+        __guac_common_surface_mark_lossy(surface, &rect, 0);
     }
 
 complete:
@@ -1590,103 +1812,260 @@ void guac_common_surface_reset_clip(guac_common_surface* surface) {
 }
 
 /**
- * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as PNG data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * Returns whether images of the given format which are flushed from the given
+ * surface may need to be encoded separately for each user. Lossy images sent
+ * over the broadcast socket to multiple users are encoded at a quality chosen
+ * based on each user's lag, and thus cannot be encoded in advance.
  *
  * @param surface
- *     The surface to flush.
+ *     The surface being flushed.
  *
- * @param opaque
- *     Whether the rectangle being flushed contains only fully-opaque pixels.
+ * @param format
+ *     The format of the image being flushed.
+ *
+ * @return
+ *     Non-zero if the image may need to be encoded separately for each user,
+ *     zero if the image can be encoded once in advance.
  */
-static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
-        int opaque) {
+static int __guac_common_surface_is_per_user(guac_common_surface* surface,
+        guac_common_surface_tile_format format) {
 
-    if (surface->dirty) {
+    /* Pipelined output is ultimately written to the pipeline's target */
+    guac_socket* socket = surface->socket;
+    if (surface->pipeline != NULL)
+        socket = surface->pipeline->target;
+
+    return format != GUAC_COMMON_SURFACE_TILE_PNG
+        && socket == surface->client->socket
+        && surface->client->connected_users > 1;
+
+}
+
+/**
+ * Returns whether the given tile is drawn without image data, either by
+ * copying content which the client already has or as a solid rectangle, and
+ * thus is never encoded.
+ *
+ * @param tile
+ *     The tile to test.
+ *
+ * @return
+ *     Non-zero if the tile is drawn without image data, zero otherwise.
+ */
+static int __guac_common_surface_is_imageless(
+        const guac_common_surface_tile* tile) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
+    return tile->format == GUAC_COMMON_SURFACE_TILE_CACHED
+        || tile->format == GUAC_COMMON_SURFACE_TILE_MOVE
+        || tile->format == GUAC_COMMON_SURFACE_TILE_FILL;
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
+}
+
+/**
+ * Returns whether the given tile must be allocated its own stream and encoded
+ * in advance of being sent. Tiles which are drawn without image data are not
+ * encoded at all, while tiles which may need to be encoded separately for
+ * each user are encoded only when sent.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param tile
+ *     The tile to test.
+ *
+ * @return
+ *     Non-zero if the tile should be allocated its own stream and encoded in
+ *     advance, zero otherwise.
+ */
+static int __guac_common_surface_needs_stream(guac_common_surface* surface,
+        const guac_common_surface_tile* tile) {
+
+    return !__guac_common_surface_is_imageless(tile)
+        && !__guac_common_surface_is_per_user(surface, tile->format);
 
-        cairo_surface_t* rect;
+}
 
-        /* Use RGB24 if the image is fully opaque */
-        if (opaque)
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+/**
+ * Adds a new tile to the list of tiles awaiting encoding within the given
+ * surface, growing that list as necessary.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param rect
+ *     The rectangle covered by the new tile.
+ *
+ * @param format
+ *     The format to encode the new tile with.
+ *
+ * @param opaque
+ *     Whether the new tile contains only fully-opaque pixels.
+ *
+ * @return
+ *     The new tile, or NULL if the tile could not be added.
+ */
+static guac_common_surface_tile* __guac_common_surface_add_tile(
+        guac_common_surface* surface,
+        const guac_common_rect* rect, guac_common_surface_tile_format format,
+        int opaque) {
 
-        /* Otherwise ARGB32 is needed */
-        else {
+    /* Grow tile list as necessary */
+    if (surface->tiles_length == surface->tiles_available) {
 
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_ARGB32, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+        int available = surface->tiles_available
+            ? surface->tiles_available * 2 : 16;
 
-            /* Clear destination rect first */
-            guac_protocol_send_rect(socket, layer,
-                    surface->dirty_rect.x, surface->dirty_rect.y,
-                    surface->dirty_rect.width, surface->dirty_rect.height);
-            guac_protocol_send_cfill(socket, GUAC_COMP_ROUT, layer,
-                    0x00, 0x00, 0x00, 0xFF);
+        guac_common_surface_tile* tiles = realloc(surface->tiles,
+                sizeof(guac_common_surface_tile) * available);
 
-        }
+        /* Drop the update if no memory remains */
+        if (tiles == NULL)
+            return NULL;
 
-        /* Send PNG for rect */
-        guac_client_stream_png(surface->client, socket, GUAC_COMP_OVER,
-                layer, surface->dirty_rect.x, surface->dirty_rect.y, rect);
+        surface->tiles = tiles;
+        surface->tiles_available = available;
 
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
+    }
 
-        /* Surface is no longer dirty */
-        surface->dirty = 0;
+    guac_common_surface_tile* tile = &surface->tiles[surface->tiles_length++];
+
+    tile->client = surface->client;
+    tile->layer = *surface->layer;
+    tile->stats = surface->socket->stats;
+    tile->rect = *rect;
+    tile->image = surface->buffer + rect->y * surface->stride + rect->x * 4;
+    tile->stride = surface->stride;
+    tile->format = format;
+    tile->opaque = opaque;
+    tile->stream = NULL;
+    tile->failed = 0;
+    tile->buffer = NULL;
+    tile->length = 0;
+    tile->size = 0;
+    tile->cache_store = 0;
+
+    /* Uniform tiles are drawn using the color of any of their pixels */
+    if (format == GUAC_COMMON_SURFACE_TILE_FILL)
+        tile->color = *((uint32_t*) tile->image);
+
+    /* Draw repeated lossless images from the image cache, if any */
+    if (surface->image_cache != NULL && format == GUAC_COMMON_SURFACE_TILE_PNG
+            && opaque) {
+
+        int hit;
+        const guac_layer* buffer = guac_common_image_cache_lookup(
+                surface->image_cache, tile->image, rect->width, rect->height,
+                tile->stride, &hit);
+
+        if (buffer != NULL) {
+            tile->cache_buffer = *buffer;
+            if (hit)
+                tile->format = GUAC_COMMON_SURFACE_TILE_CACHED;
+            else
+                tile->cache_store = 1;
+        }
 
     }
 
+    /* Record which content the client will display lossily. Moved content
+     * retains the quality of its source, which is recorded by the caller. */
+    if (format == GUAC_COMMON_SURFACE_TILE_JPEG
+            || format == GUAC_COMMON_SURFACE_TILE_WEBP)
+        __guac_common_surface_mark_lossy(surface, rect, 1);
+    else if (format != GUAC_COMMON_SURFACE_TILE_MOVE && opaque)
+        __guac_common_surface_mark_lossy(surface, rect, 0);
+
+    return tile;
+
 }
 
 /**
- * Returns an appropriate quality between 0 and 100 for lossy encoding
- * depending on the current processing lag calculated for the given client.
+ * Splits the bitmap update currently described by the dirty rectangle within
+ * the given surface into tiles no larger than GUAC_COMMON_SURFACE_TILE_SIZE,
+ * adding each tile to the list of tiles awaiting encoding. Updates are split
+ * only if they may be encoded in parallel by more than one encoder thread and
+ * are at least GUAC_COMMON_SURFACE_MIN_TILED_AREA pixels in size. Lossy
+ * updates which may need to be encoded separately for each user are not
+ * split, as they cannot be encoded in advance. The surface is no longer dirty
+ * once this function returns.
  *
- * @param client
- *     The client for which the lossy quality is being calculated.
+ * @param surface
+ *     The surface to flush.
  *
- * @return
- *     A value between 0 and 100 inclusive which seems appropriate for the
- *     client based on lag measurements.
+ * @param format
+ *     The format to encode each tile with.
+ *
+ * @param opaque
+ *     Whether the rectangle being flushed contains only fully-opaque pixels.
  */
-static int guac_common_surface_suggest_quality(guac_client* client) {
+static void __guac_common_surface_add_tiles(guac_common_surface* surface,
+        guac_common_surface_tile_format format, int opaque) {
+
+    guac_common_rect* rect = &surface->dirty_rect;
+    guac_common_rect tile;
+    int x, y;
+
+    /* Solid rectangles, small images, images which cannot be encoded in
+     * advance, and images which will be encoded serially anyway gain nothing
+     * from tiling */
+    if (format == GUAC_COMMON_SURFACE_TILE_FILL
+            || rect->width * rect->height < GUAC_COMMON_SURFACE_MIN_TILED_AREA
+            || __guac_common_surface_is_per_user(surface, format)
+            || guac_common_encoder_get_threads() <= 1)
+        __guac_common_surface_add_tile(surface, rect, format, opaque);
+
+    /* Otherwise, split into tiles which may be encoded in parallel */
+    else {
+        for (y = 0; y < rect->height; y += GUAC_COMMON_SURFACE_TILE_SIZE) {
+            for (x = 0; x < rect->width; x += GUAC_COMMON_SURFACE_TILE_SIZE) {
+
+                guac_common_rect_init(&tile, rect->x + x, rect->y + y,
+                        GUAC_COMMON_SURFACE_TILE_SIZE,
+                        GUAC_COMMON_SURFACE_TILE_SIZE);
+                guac_common_rect_constrain(&tile, rect);
+
+                __guac_common_surface_add_tile(surface, &tile, format, opaque);
+
+            }
+        }
+    }
+
+    /* Client will display the flushed update once tiles are sent */
+    __guac_common_surface_sync_previous(surface, rect);
 
-    int lag = guac_client_get_processing_lag(client);
+    surface->realized = 1;
 
-    /* Scale quality linearly from 90 to 30 as lag varies from 20ms to 80ms */
-    int quality = 90 - (lag - 20);
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
 
-    /* Do not exceed 90 for quality */
-    if (quality > 90)
-        return 90;
+}
 
-    /* Do not go below 30 for quality */
-    if (quality < 30)
-        return 30;
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface as PNG data, adding the update to the list of tiles
+ * awaiting encoding. The resulting instructions will be sent over the socket
+ * associated with the given surface once all tiles have been encoded.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param opaque
+ *     Whether the rectangle being flushed contains only fully-opaque pixels.
+ */
+static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
+        int opaque) {
 
-    return quality;
+    if (surface->dirty)
+        __guac_common_surface_add_tiles(surface,
+                GUAC_COMMON_SURFACE_TILE_PNG, opaque);
 
 }
 
 /**
  * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as JPEG data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * the given surface as JPEG data, adding the update to the list of tiles
+ * awaiting encoding. The resulting instructions will be sent over the socket
+ * associated with the given surface once all tiles have been encoded.
  *
  * @param surface
  *     The surface to flush.
@@ -1695,9 +2074,6 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
 
     if (surface->dirty) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
-
         guac_common_rect max;
         guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
 
@@ -1706,25 +2082,8 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
         guac_common_rect_expand_to_grid(GUAC_SURFACE_JPEG_BLOCK_SIZE,
                                         &surface->dirty_rect, &max);
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
-
-        cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
-                CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                surface->dirty_rect.height, surface->stride);
-
-        /* Send JPEG for rect */
-        guac_client_stream_jpeg(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
-                guac_common_surface_suggest_quality(surface->client));
-
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
-
-        /* Surface is no longer dirty */
-        surface->dirty = 0;
+        __guac_common_surface_add_tiles(surface,
+                GUAC_COMMON_SURFACE_TILE_JPEG, 1);
 
     }
 
@@ -1732,9 +2091,9 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
 
 /**
  * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as WebP data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * the given surface as WebP data, adding the update to the list of tiles
+ * awaiting encoding. The resulting instructions will be sent over the socket
+ * associated with the given surface once all tiles have been encoded.
  *
  * @param surface
  *     The surface to flush.
@@ -1747,9 +2106,6 @@ static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
 
     if (surface->dirty) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
-
         guac_common_rect max;
         guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
 
@@ -1758,180 +2114,1916 @@ static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
         guac_common_rect_expand_to_grid(GUAC_SURFACE_WEBP_BLOCK_SIZE,
                                         &surface->dirty_rect, &max);
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
-
-        cairo_surface_t* rect;
-
-        /* Use RGB24 if the image is fully opaque */
-        if (opaque)
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
-
-        /* Otherwise ARGB32 is needed */
-        else
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_ARGB32, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+        __guac_common_surface_add_tiles(surface,
+                GUAC_COMMON_SURFACE_TILE_WEBP, opaque);
 
-        /* Send WebP for rect */
-        guac_client_stream_webp(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
-                guac_common_surface_suggest_quality(surface->client), 0);
+    }
 
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
+}
 
-        /* Surface is no longer dirty */
-        surface->dirty = 0;
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface as a solid rectangle, adding the update to the list of
+ * tiles awaiting encoding. Every pixel within the dirty rectangle must have
+ * the same opaque color. The resulting instructions will be sent over the
+ * socket associated with the given surface once all prior tiles have been
+ * encoded.
+ *
+ * @param surface
+ *     The surface to flush.
+ */
+static void __guac_common_surface_flush_to_fill(guac_common_surface* surface) {
 
-    }
+    if (surface->dirty)
+        __guac_common_surface_add_tiles(surface,
+                GUAC_COMMON_SURFACE_TILE_FILL, 1);
 
 }
 
 /**
- * Comparator for instances of guac_common_surface_bitmap_rect, the elements
- * which make up a surface's bitmap buffer.
+ * Socket write handler which appends all written data to the
+ * guac_common_surface_tile associated with the socket.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
  *
- * @see qsort
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or -1 if the buffer could not be grown.
  */
-static int __guac_common_surface_bitmap_rect_compare(const void* a, const void* b) {
+static ssize_t __guac_common_surface_tile_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
 
-    guac_common_surface_bitmap_rect* ra = (guac_common_surface_bitmap_rect*) a;
-    guac_common_surface_bitmap_rect* rb = (guac_common_surface_bitmap_rect*) b;
+    guac_common_surface_tile* tile = (guac_common_surface_tile*) socket->data;
 
-    /* Order roughly top to bottom, left to right */
-    if (ra->rect.y != rb->rect.y) return ra->rect.y - rb->rect.y;
-    if (ra->rect.x != rb->rect.x) return ra->rect.x - rb->rect.x;
+    /* Grow buffer as necessary */
+    if (tile->length + count > tile->size) {
 
-    /* Wider updates should come first (more likely to intersect later) */
-    if (ra->rect.width != rb->rect.width) return rb->rect.width - ra->rect.width;
+        size_t size = tile->size ? tile->size : 16384;
+        while (size < tile->length + count)
+            size *= 2;
 
-    /* Shorter updates should come first (less likely to increase cost) */
-    return ra->rect.height - rb->rect.height;
+        char* buffer = realloc(tile->buffer, size);
+        if (buffer == NULL) {
+            tile->failed = 1;
+            return -1;
+        }
 
-}
+        tile->buffer = buffer;
+        tile->size = size;
+
+    }
+
+    memcpy(tile->buffer + tile->length, buf, count);
+    tile->length += count;
+
+    return count;
+
+}
+
+/**
+ * Streams the image data covered by the given tile over the given socket,
+ * encoding that data in the tile's format. If the tile has its own stream,
+ * that stream is used and the tile's quality is chosen based on the lag of
+ * all users. Otherwise, a stream is allocated, and lossy tiles sent over the
+ * broadcast socket are encoded separately for each group of users with
+ * similar lag.
+ *
+ * @param tile
+ *     The tile to stream.
+ *
+ * @param socket
+ *     The socket over which the tile should be sent.
+ */
+static void __guac_common_surface_stream_tile(guac_common_surface_tile* tile,
+        guac_socket* socket) {
+
+    guac_client* client = tile->client;
+    const guac_layer* layer = &tile->layer;
+    guac_common_rect* rect = &tile->rect;
+
+    /* Get Cairo surface for specified rect, using RGB24 if the image is fully
+     * opaque (otherwise ARGB32 is needed) */
+    cairo_surface_t* image = cairo_image_surface_create_for_data(tile->image,
+            tile->opaque ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
+            rect->width, rect->height, tile->stride);
+
+    switch (tile->format) {
+
+        /* Send PNG for rect */
+        case GUAC_COMMON_SURFACE_TILE_PNG:
+            if (tile->stream != NULL)
+                guac_client_encode_png(client, socket, tile->stream,
+                        GUAC_COMP_OVER, layer, rect->x, rect->y, image);
+            else
+                guac_client_stream_png(client, socket, GUAC_COMP_OVER,
+                        layer, rect->x, rect->y, image);
+            break;
+
+        /* Send JPEG for rect */
+        case GUAC_COMMON_SURFACE_TILE_JPEG:
+            if (tile->stream != NULL)
+                guac_client_encode_jpeg(client, socket, tile->stream,
+                        GUAC_COMP_OVER, layer, rect->x, rect->y, image,
+                        GUAC_CLIENT_ADAPTIVE_QUALITY);
+            else
+                guac_client_stream_jpeg(client, socket, GUAC_COMP_OVER,
+                        layer, rect->x, rect->y, image,
+                        GUAC_CLIENT_ADAPTIVE_QUALITY);
+            break;
+
+        /* Send WebP for rect */
+        case GUAC_COMMON_SURFACE_TILE_WEBP:
+            if (tile->stream != NULL)
+                guac_client_encode_webp(client, socket, tile->stream,
+                        GUAC_COMP_OVER, layer, rect->x, rect->y, image,
+                        GUAC_CLIENT_ADAPTIVE_QUALITY, 0);
+            else
+                guac_client_stream_webp(client, socket, GUAC_COMP_OVER,
+                        layer, rect->x, rect->y, image,
+                        GUAC_CLIENT_ADAPTIVE_QUALITY, 0);
+            break;
+
+        /* Cached, moved and filled tiles are drawn rather than streamed */
+        case GUAC_COMMON_SURFACE_TILE_CACHED:
+        case GUAC_COMMON_SURFACE_TILE_MOVE:
+        case GUAC_COMMON_SURFACE_TILE_FILL:
+            break;
+
+    }
+
+    cairo_surface_destroy(image);
+
+}
+
+/**
+ * Encodes the given tile using the stream allocated for that tile, storing
+ * the resulting instructions within the tile's buffer. This function is a
+ * guac_common_encoder_task, and may be run concurrently for different tiles.
+ *
+ * @param data
+ *     The guac_common_surface_tile to encode.
+ */
+static void __guac_common_surface_encode_tile(void* data) {
+
+    guac_common_surface_tile* tile = (guac_common_surface_tile*) data;
+
+    /* Tiles without their own stream are encoded only when sent */
+    if (tile->stream == NULL)
+        return;
+
+    /* Capture encoded instructions in memory */
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL) {
+        tile->failed = 1;
+        return;
+    }
+
+    socket->data = tile;
+    socket->write_handler = __guac_common_surface_tile_write_handler;
+    socket->stats = tile->stats;
+
+    __guac_common_surface_stream_tile(tile, socket);
+
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Sends the given tile over the given socket, clearing the destination first
+ * if the tile is not opaque. If the tile has already been encoded, its
+ * encoded instructions are written and its stream is freed. Otherwise, the
+ * tile is encoded and streamed directly.
+ *
+ * @param tile
+ *     The tile to send.
+ *
+ * @param socket
+ *     The socket to send the tile over.
+ */
+static void __guac_common_surface_send_tile(guac_common_surface_tile* tile,
+        guac_socket* socket) {
+
+    /* Draw cached tiles from their client-side copies */
+    if (tile->format == GUAC_COMMON_SURFACE_TILE_CACHED) {
+        guac_protocol_send_copy(socket, &tile->cache_buffer, 0, 0,
+                tile->rect.width, tile->rect.height, GUAC_COMP_OVER,
+                &tile->layer, tile->rect.x, tile->rect.y);
+        return;
+    }
+
+    /* Draw moved tiles from their previous location */
+    if (tile->format == GUAC_COMMON_SURFACE_TILE_MOVE) {
+        guac_protocol_send_copy(socket, &tile->layer, tile->src_x, tile->src_y,
+                tile->rect.width, tile->rect.height, GUAC_COMP_SRC,
+                &tile->layer, tile->rect.x, tile->rect.y);
+        return;
+    }
+
+    /* Draw uniform tiles as solid rectangles */
+    if (tile->format == GUAC_COMMON_SURFACE_TILE_FILL) {
+        guac_protocol_send_rect(socket, &tile->layer,
+                tile->rect.x, tile->rect.y,
+                tile->rect.width, tile->rect.height);
+        guac_protocol_send_cfill(socket, GUAC_COMP_OVER, &tile->layer,
+                (tile->color >> 16) & 0xFF, (tile->color >> 8) & 0xFF,
+                tile->color & 0xFF, 0xFF);
+        return;
+    }
+
+    /* Clear destination rect first if PNG image is not opaque */
+    if (tile->format == GUAC_COMMON_SURFACE_TILE_PNG && !tile->opaque) {
+        guac_protocol_send_rect(socket, &tile->layer,
+                tile->rect.x, tile->rect.y,
+                tile->rect.width, tile->rect.height);
+        guac_protocol_send_cfill(socket, GUAC_COMP_ROUT, &tile->layer,
+                0x00, 0x00, 0x00, 0xFF);
+    }
+
+    /* Stream directly if not encoded in advance */
+    if (tile->stream == NULL)
+        __guac_common_surface_stream_tile(tile, socket);
+
+    /* Otherwise, write all encoded instructions as a single unit */
+    else {
+
+        if (!tile->failed) {
+            guac_socket_instruction_begin(socket);
+            guac_socket_write(socket, tile->buffer, tile->length);
+            guac_socket_instruction_end(socket);
+        }
+
+        guac_client_free_stream(tile->client, tile->stream);
+        free(tile->buffer);
+
+    }
+
+    /* Keep a client-side copy of newly-cached tiles */
+    if (tile->cache_store)
+        guac_protocol_send_copy(socket, &tile->layer,
+                tile->rect.x, tile->rect.y,
+                tile->rect.width, tile->rect.height, GUAC_COMP_SRC,
+                &tile->cache_buffer, 0, 0);
+
+}
+
+/**
+ * Sends the given pipelined tile over the given socket, freeing the tile and
+ * its copy of the image data. This function is a
+ * guac_common_pipeline_send_handler.
+ *
+ * @param data
+ *     The guac_common_surface_tile to send.
+ *
+ * @param socket
+ *     The socket to send the tile over.
+ */
+static void __guac_common_surface_send_pipelined_tile(void* data,
+        guac_socket* socket) {
+
+    guac_common_surface_tile* tile = (guac_common_surface_tile*) data;
+
+    __guac_common_surface_send_tile(tile, socket);
+
+    free(tile->image);
+    free(tile);
+
+}
+
+/**
+ * Submits all tiles awaiting encoding within the given surface to the
+ * surface's pipeline, copying the image data covered by each tile such that
+ * the surface may continue to be modified while the tiles are encoded. The
+ * list of tiles is empty once this function returns.
+ *
+ * @param surface
+ *     The surface being flushed.
+ */
+static void __guac_common_surface_submit_tiles(guac_common_surface* surface) {
+
+    int i, y;
+
+    for (i = 0; i < surface->tiles_length; i++) {
+
+        guac_common_surface_tile* tile = malloc(sizeof(guac_common_surface_tile));
+        if (tile == NULL)
+            continue;
+
+        *tile = surface->tiles[i];
+
+        /* Tiles drawn without image data need no copy of that data */
+        if (__guac_common_surface_is_imageless(tile)) {
+            tile->image = NULL;
+            guac_common_pipeline_submit(surface->pipeline,
+                    __guac_common_surface_encode_tile,
+                    __guac_common_surface_send_pipelined_tile, tile);
+            continue;
+        }
+
+        /* Copy image data covered by tile */
+        int stride = tile->rect.width * 4;
+        unsigned char* image = malloc(stride * tile->rect.height);
+        if (image == NULL) {
+            free(tile);
+            continue;
+        }
+
+        for (y = 0; y < tile->rect.height; y++)
+            memcpy(image + y * stride, tile->image + y * tile->stride, stride);
+
+        tile->image = image;
+        tile->stride = stride;
+
+        /* Tiles which may need to be encoded for each user are encoded only
+         * when sent */
+        if (__guac_common_surface_needs_stream(surface, tile))
+            tile->stream = guac_client_alloc_stream(surface->client);
+
+        guac_common_pipeline_submit(surface->pipeline,
+                __guac_common_surface_encode_tile,
+                __guac_common_surface_send_pipelined_tile, tile);
+
+    }
+
+    /* All tiles submitted */
+    surface->tiles_length = 0;
+
+}
+
+/**
+ * Encodes all tiles awaiting encoding within the given surface, using the
+ * process-wide encoder pool to encode tiles in parallel, and sends the
+ * resulting instructions in the order the tiles were added. Tiles are
+ * encoded in batches of at most GUAC_COMMON_SURFACE_MAX_PARALLEL_TILES, with
+ * each batch sent before the next is encoded. The list of tiles is empty once
+ * this function returns.
+ *
+ * @param surface
+ *     The surface being flushed.
+ */
+static void __guac_common_surface_flush_tiles(guac_common_surface* surface) {
+
+    int start, i;
+
+    /* Leave encoding and sending to the pipeline, if any */
+    if (surface->pipeline != NULL) {
+        __guac_common_surface_submit_tiles(surface);
+        return;
+    }
+
+    for (start = 0; start < surface->tiles_length;
+            start += GUAC_COMMON_SURFACE_MAX_PARALLEL_TILES) {
+
+        guac_common_surface_tile* batch = &surface->tiles[start];
+
+        int count = surface->tiles_length - start;
+        if (count > GUAC_COMMON_SURFACE_MAX_PARALLEL_TILES)
+            count = GUAC_COMMON_SURFACE_MAX_PARALLEL_TILES;
+
+        /* Allocate streams in order, such that output does not depend on
+         * the order in which tiles finish encoding. Tiles which may need to
+         * be encoded separately for each user, and tiles drawn without image
+         * data, are left without a stream. */
+        for (i = 0; i < count; i++) {
+            if (__guac_common_surface_needs_stream(surface, &batch[i]))
+                batch[i].stream = guac_client_alloc_stream(surface->client);
+        }
+
+        guac_common_encoder_run(__guac_common_surface_encode_tile, batch,
+                sizeof(guac_common_surface_tile), count);
+
+        /* Send encoded tiles in order */
+        for (i = 0; i < count; i++)
+            __guac_common_surface_send_tile(&batch[i], surface->socket);
+
+    }
+
+    /* Flush complete */
+    surface->tiles_length = 0;
+
+}
+
+/**
+ * Flushes only the properties of the given surface, such as layer location or
+ * opacity. Image state is not flushed. If the surface represents a buffer or
+ * the default layer, this function has no effect.
+ *
+ * @param surface
+ *     The surface to flush.
+ */
+static void __guac_common_surface_flush_properties(
+        guac_common_surface* surface) {
+
+    guac_socket* socket = surface->socket;
+
+    /* Only applicable to non-default visible layers */
+    if (surface->layer->index <= 0)
+        return;
+
+    /* Flush opacity */
+    if (surface->opacity_dirty) {
+        guac_protocol_send_shade(socket, surface->layer, surface->opacity);
+        surface->opacity_dirty = 0;
+    }
+
+    /* Flush location and hierarchy */
+    if (surface->location_dirty) {
+        guac_protocol_send_move(socket, surface->layer,
+                surface->parent, surface->x, surface->y, surface->z);
+        surface->location_dirty = 0;
+    }
+
+}
+
+/**
+ * Combines the content of the given block into the given content, such that
+ * the result describes both.
+ *
+ * @param content
+ *     The content to update.
+ *
+ * @param block
+ *     The block whose content should be combined into the given content.
+ */
+static void __guac_common_surface_combine_content(
+        guac_common_surface_block* content,
+        const guac_common_surface_block* block) {
+
+    content->same += block->same;
+    content->different += block->different;
+    content->opaque = content->opaque && block->opaque;
+    content->uniform = content->uniform && block->uniform
+                    && content->color == block->color;
+
+}
+
+/**
+ * Calculates the rectangle covered by the given blocks of the given update,
+ * where blocks are numbered relative to the block containing the upper-left
+ * corner of the update.
+ *
+ * @param update
+ *     The update containing the blocks.
+ *
+ * @param column
+ *     The column of the first block.
+ *
+ * @param row
+ *     The row of the blocks.
+ *
+ * @param columns
+ *     The number of consecutive blocks within the row.
+ *
+ * @param rect
+ *     The rectangle to populate with the region covered by the blocks.
+ */
+static void __guac_common_surface_block_rect(const guac_common_rect* update,
+        int column, int row, int columns, guac_common_rect* rect) {
+
+    guac_common_rect_init(rect,
+            (update->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE + column)
+                * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+            (update->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE + row)
+                * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+            columns * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+            GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+
+    guac_common_rect_constrain(rect, update);
+
+}
+
+/**
+ * Classifies the content of each block of the bitmap update currently
+ * described by the dirty rectangle within the given surface, storing the
+ * results within the blocks array of the surface in row-major order. All
+ * blocks are classified within a single pass over the image data of the
+ * update.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param columns
+ *     The number of columns of blocks intersecting the dirty rectangle.
+ *
+ * @param rows
+ *     The number of rows of blocks intersecting the dirty rectangle.
+ */
+static void __guac_common_surface_scan_dirty(guac_common_surface* surface,
+        int columns, int rows) {
+
+    const guac_common_pixel_kernels* kernels =
+        guac_common_pixels_get_kernels();
+
+    const guac_common_rect* rect = &surface->dirty_rect;
+    int right = rect->x + rect->width;
+    int bottom = rect->y + rect->height;
+    int x, y;
+
+    /* Each block is initially assumed uniform in the color of its first
+     * pixel */
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < columns; x++) {
+
+            guac_common_rect block_rect;
+            __guac_common_surface_block_rect(rect, x, y, 1, &block_rect);
+
+            guac_common_surface_block* block =
+                &surface->blocks[y * columns + x];
+
+            block->same = 0;
+            block->different = 0;
+            block->opaque = 1;
+            block->uniform = 1;
+            block->fill = 0;
+            block->color = *((uint32_t*) (surface->buffer
+                        + block_rect.y * surface->stride + block_rect.x * 4));
+
+        }
+    }
+
+    for (y = rect->y; y < bottom; y++) {
+
+        const uint32_t* row =
+            (const uint32_t*) (surface->buffer + y * surface->stride);
+
+        guac_common_surface_block* block = surface->blocks
+            + (y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE
+                    - rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE) * columns;
+
+        /* Scan the portion of the row within each block */
+        for (x = rect->x; x < right; block++) {
+
+            int end = (x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE + 1)
+                    * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+            if (end > right)
+                end = right;
+
+            int same, opaque;
+            int uniform = kernels->scan(row + x, end - x, &same, &opaque);
+
+            block->same += same;
+            block->different += end - x - 1 - same;
+
+            /* Compare the first pixel with the last pixel of the previous
+             * block, as if the row had been scanned as a whole */
+            if (x > rect->x) {
+                if ((row[x] | 0xFF000000) == (row[x - 1] | 0xFF000000))
+                    block->same++;
+                else
+                    block->different++;
+            }
+
+            if (!opaque)
+                block->opaque = 0;
+
+            if (!uniform || row[x] != block->color)
+                block->uniform = 0;
+
+            x = end;
+
+        }
+
+    }
+
+}
+
+/**
+ * Marks each block of the given row of blocks which belongs to a run of
+ * uniform, opaque blocks of the same color that is large enough to be sent as
+ * a solid rectangle.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param update
+ *     The update containing the blocks.
+ *
+ * @param row
+ *     The index of the row of blocks.
+ *
+ * @param columns
+ *     The number of blocks within each row.
+ *
+ * @return
+ *     Non-zero if any block was marked, zero otherwise.
+ */
+static int __guac_common_surface_mark_fills(guac_common_surface* surface,
+        const guac_common_rect* update, int row, int columns) {
+
+    guac_common_surface_block* blocks = surface->blocks + row * columns;
+    int marked = 0;
+    int x, i;
+
+    for (x = 0; x < columns; x++) {
+
+        if (!blocks[x].uniform || !blocks[x].opaque)
+            continue;
+
+        /* Find end of run of blocks having the same color */
+        int end = x + 1;
+        while (end < columns && blocks[end].uniform && blocks[end].opaque
+                && blocks[end].color == blocks[x].color)
+            end++;
+
+        guac_common_rect run;
+        __guac_common_surface_block_rect(update, x, row, end - x, &run);
+
+        if (run.width * run.height >= GUAC_SURFACE_FILL_MIN_SIZE) {
+            for (i = x; i < end; i++)
+                blocks[i].fill = 1;
+            marked = 1;
+        }
+
+        x = end - 1;
+
+    }
+
+    return marked;
+
+}
+
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface as an image, choosing the most appropriate image format
+ * for that update.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param content
+ *     The content of the update, as determined by scanning its blocks.
+ *
+ * @param lossy
+ *     Non-zero if the update may be encoded with a lossy format, zero if the
+ *     update must be encoded losslessly.
+ */
+static void __guac_common_surface_flush_image(guac_common_surface* surface,
+        const guac_common_surface_block* content, int lossy) {
+
+    int opaque = content->opaque;
+
+    /* Prefer WebP when reasonable */
+    if (lossy && __guac_common_surface_should_use_webp(surface,
+                &surface->dirty_rect, content))
+        __guac_common_surface_flush_to_webp(surface, opaque);
+
+    /* If not WebP, JPEG is the next best (lossy) choice */
+    else if (lossy && opaque && __guac_common_surface_should_use_jpeg(
+                surface, &surface->dirty_rect, content))
+        __guac_common_surface_flush_to_jpeg(surface);
+
+    /* Use PNG if no lossy formats are appropriate */
+    else
+        __guac_common_surface_flush_to_png(surface, opaque);
+
+}
+
+/**
+ * Flushes the given region of the update being flushed, if the region is of
+ * the requested kind.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param region
+ *     The region to flush.
+ *
+ * @param lossy
+ *     Non-zero if images may be encoded with a lossy format, zero if images
+ *     must be encoded losslessly.
+ *
+ * @param fills
+ *     Non-zero if only regions which are solid rectangles should be flushed,
+ *     zero if only regions which are images should be flushed.
+ */
+static void __guac_common_surface_flush_region(guac_common_surface* surface,
+        const guac_common_surface_region* region, int lossy, int fills) {
+
+    if (!region->content.fill != !fills)
+        return;
+
+    surface->dirty_rect = region->rect;
+    surface->dirty = 1;
+
+    if (fills)
+        __guac_common_surface_flush_to_fill(surface);
+    else
+        __guac_common_surface_flush_image(surface, &region->content, lossy);
+
+}
+
+/**
+ * Divides the given update into rectangular regions which are either solid
+ * rectangles or images, as determined by the blocks previously marked by
+ * __guac_common_surface_mark_fills(), flushing only the regions of the
+ * requested kind. Each run of blocks within a row is combined with the region
+ * directly above it if that region covers exactly the same columns and is of
+ * the same kind.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param update
+ *     The update being flushed, which must not be the dirty rectangle of the
+ *     surface itself.
+ *
+ * @param columns
+ *     The number of columns of blocks intersecting the update.
+ *
+ * @param rows
+ *     The number of rows of blocks intersecting the update.
+ *
+ * @param lossy
+ *     Non-zero if images may be encoded with a lossy format, zero if images
+ *     must be encoded losslessly.
+ *
+ * @param fills
+ *     Non-zero if only regions which are solid rectangles should be flushed,
+ *     zero if only regions which are images should be flushed.
+ */
+static void __guac_common_surface_flush_regions(guac_common_surface* surface,
+        const guac_common_rect* update, int columns, int rows, int lossy,
+        int fills) {
+
+    guac_common_surface_region* regions = surface->regions;
+    int x, y, i;
+
+    for (x = 0; x < columns; x++) {
+        regions[x].columns = 0;
+        regions[x].continued = 0;
+    }
+
+    for (y = 0; y < rows; y++) {
+
+        const guac_common_surface_block* blocks =
+            surface->blocks + y * columns;
+
+        for (x = 0; x < columns;) {
+
+            /* Find end of run of blocks of the same kind */
+            int end = x + 1;
+            while (end < columns && blocks[end].fill == blocks[x].fill
+                    && (!blocks[x].fill
+                        || blocks[end].color == blocks[x].color))
+                end++;
+
+            guac_common_rect run;
+            __guac_common_surface_block_rect(update, x, y, end - x, &run);
+
+            guac_common_surface_region* region = &regions[x];
+
+            /* Extend region above if it matches exactly */
+            if (region->columns == end - x
+                    && region->content.fill == blocks[x].fill
+                    && (!blocks[x].fill
+                        || region->content.color == blocks[x].color)) {
+                region->rect.height += run.height;
+                i = x;
+            }
+
+            /* Otherwise, begin a new region */
+            else {
+
+                if (region->columns)
+                    __guac_common_surface_flush_region(surface, region,
+                            lossy, fills);
+
+                region->columns = end - x;
+                region->rect = run;
+                region->content = blocks[x];
+                i = x + 1;
+
+            }
+
+            for (; i < end; i++)
+                __guac_common_surface_combine_content(&region->content,
+                        &blocks[i]);
+
+            region->continued = 1;
+            x = end;
+
+        }
+
+        /* Flush regions which cannot be extended further */
+        for (x = 0; x < columns; x++) {
+
+            guac_common_surface_region* region = &regions[x];
+            if (region->columns && !region->continued) {
+                __guac_common_surface_flush_region(surface, region,
+                        lossy, fills);
+                region->columns = 0;
+            }
+
+            region->continued = 0;
+
+        }
+
+    }
+
+    /* Flush all remaining regions */
+    for (x = 0; x < columns; x++) {
+        if (regions[x].columns)
+            __guac_common_surface_flush_region(surface, &regions[x],
+                    lossy, fills);
+    }
+
+}
+
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface. Updates consisting of a single opaque color are sent as
+ * a solid rectangle. Otherwise, large uniform portions of the update are sent
+ * as solid rectangles, and the remainder as images of the most appropriate
+ * format.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param lossy
+ *     Non-zero if images may be encoded with a lossy format, zero if images
+ *     must be encoded losslessly.
+ */
+static void __guac_common_surface_flush_dirty(guac_common_surface* surface,
+        int lossy) {
+
+    guac_common_rect update = surface->dirty_rect;
+    int fills = 0;
+    int i;
+
+    int columns = (update.x + update.width - 1)
+                    / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE
+                - update.x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE + 1;
+
+    int rows = (update.y + update.height - 1)
+                    / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE
+             - update.y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE + 1;
+
+    __guac_common_surface_scan_dirty(surface, columns, rows);
+
+    guac_common_surface_block content = surface->blocks[0];
+    for (i = 1; i < columns * rows; i++)
+        __guac_common_surface_combine_content(&content, &surface->blocks[i]);
+
+    /* Updates of a single opaque color need no image at all */
+    if (content.uniform && content.opaque) {
+        __guac_common_surface_flush_to_fill(surface);
+        return;
+    }
+
+    for (i = 0; i < rows; i++)
+        fills |= __guac_common_surface_mark_fills(surface, &update, i,
+                columns);
+
+    /* Send as a single image if no portion is worth sending separately */
+    if (!fills) {
+        __guac_common_surface_flush_image(surface, &content, lossy);
+        return;
+    }
+
+    /* Draw solid rectangles last, such that any lossy image which is
+     * expanded to fit its format's block size is drawn beneath them */
+    __guac_common_surface_flush_regions(surface, &update, columns, rows,
+            lossy, 0);
+    __guac_common_surface_flush_regions(surface, &update, columns, rows,
+            lossy, 1);
+
+}
+
+/**
+ * Returns a pointer to the first pixel of the given line of the given
+ * rectangle within the given image data. Lines are rows if vertical is
+ * non-zero, and columns otherwise.
+ *
+ * @param surface
+ *     The surface that the image data belongs to.
+ *
+ * @param buffer
+ *     The image data of the surface, either the surface's buffer or its
+ *     record of displayed contents.
+ *
+ * @param rect
+ *     The rectangle containing the line.
+ *
+ * @param vertical
+ *     Non-zero if lines are rows, zero if lines are columns.
+ *
+ * @param line
+ *     The index of the line relative to the rectangle.
+ *
+ * @return
+ *     A pointer to the first pixel of the requested line.
+ */
+static unsigned char* __guac_common_surface_line(guac_common_surface* surface,
+        unsigned char* buffer, const guac_common_rect* rect, int vertical,
+        int line) {
+
+    if (vertical)
+        return buffer + (rect->y + line) * surface->stride + rect->x * 4;
+
+    return buffer + rect->y * surface->stride + (rect->x + line) * 4;
+
+}
+
+/**
+ * Hashes each line of the given rectangle within the given image data, such
+ * that lines which are identical have identical hashes. Lines are rows if
+ * vertical is non-zero, and columns otherwise.
+ *
+ * @param surface
+ *     The surface that the image data belongs to.
+ *
+ * @param buffer
+ *     The image data of the surface, either the surface's buffer or its
+ *     record of displayed contents.
+ *
+ * @param rect
+ *     The rectangle whose lines should be hashed.
+ *
+ * @param vertical
+ *     Non-zero if lines are rows, zero if lines are columns.
+ *
+ * @param hashes
+ *     An array with one element for each line, which will receive the hash
+ *     of each line.
+ */
+static void __guac_common_surface_hash_lines(guac_common_surface* surface,
+        unsigned char* buffer, const guac_common_rect* rect, int vertical,
+        uint64_t* hashes) {
+
+    int i;
+
+    /* Rows are contiguous and may be hashed directly */
+    if (vertical) {
+        for (i = 0; i < rect->height; i++)
+            hashes[i] = guac_hash_image(__guac_common_surface_line(surface,
+                        buffer, rect, 1, i), rect->width, 1, surface->stride);
+    }
+
+    /* Columns are hashed a row at a time, such that memory is read in
+     * order */
+    else {
+
+        int y;
+
+        for (i = 0; i < rect->width; i++)
+            hashes[i] = 0;
+
+        for (y = 0; y < rect->height; y++) {
+            uint32_t* row = (uint32_t*) (buffer
+                    + (rect->y + y) * surface->stride + rect->x * 4);
+            for (i = 0; i < rect->width; i++) {
+                uint64_t hash = (hashes[i] ^ row[i]) * 0x9E3779B97F4A7C15ULL;
+                hashes[i] = hash ^ (hash >> 29);
+            }
+        }
+
+    }
+
+}
+
+/**
+ * Returns whether the given line of the given rectangle within the surface's
+ * buffer is identical to the given line of the same rectangle within the
+ * surface's record of displayed contents.
+ *
+ * @param surface
+ *     The surface to compare lines within.
+ *
+ * @param rect
+ *     The rectangle containing both lines.
+ *
+ * @param vertical
+ *     Non-zero if lines are rows, zero if lines are columns.
+ *
+ * @param line
+ *     The index of the line within the surface's buffer, relative to the
+ *     rectangle.
+ *
+ * @param previous_line
+ *     The index of the line within the surface's record of displayed
+ *     contents, relative to the rectangle.
+ *
+ * @return
+ *     Non-zero if the lines are identical, zero otherwise.
+ */
+static int __guac_common_surface_lines_equal(guac_common_surface* surface,
+        const guac_common_rect* rect, int vertical, int line,
+        int previous_line) {
+
+    unsigned char* current = __guac_common_surface_line(surface,
+            surface->buffer, rect, vertical, line);
+
+    unsigned char* previous = __guac_common_surface_line(surface,
+            surface->previous, rect, vertical, previous_line);
+
+    int y;
+
+    if (vertical)
+        return memcmp(current, previous, rect->width * 4) == 0;
+
+    for (y = 0; y < rect->height; y++) {
+
+        if (*((uint32_t*) current) != *((uint32_t*) previous))
+            return 0;
+
+        current += surface->stride;
+        previous += surface->stride;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Searches for the offset by which the lines of the given rectangle appear to
+ * have moved since they were last displayed by the client. Each line whose
+ * hash is distinct from its neighbours is looked up among the hashes of the
+ * displayed lines, and votes for the offset at which it was found.
+ *
+ * @param current
+ *     The hash of each line of the rectangle within the surface's buffer.
+ *
+ * @param previous
+ *     The hash of each line of the rectangle within the surface's record of
+ *     displayed contents.
+ *
+ * @param lines
+ *     The number of lines within the rectangle.
+ *
+ * @return
+ *     The offset receiving the most votes, such that line N of the current
+ *     contents is likely to be line N + offset of the displayed contents, or
+ *     zero if no motion was found.
+ */
+static int __guac_common_surface_find_offset(const uint64_t* current,
+        const uint64_t* previous, int lines) {
+
+    int i;
+    int offset = 0;
+    int best = 0;
+
+    /* Motion requires at least two lines to compare */
+    if (lines < 2)
+        return 0;
+
+    /* Hash table of displayed lines, using open addressing */
+    int table_size = 1;
+    while (table_size < lines * 2)
+        table_size *= 2;
+
+    int* table = malloc(sizeof(int) * table_size);
+    int* votes = calloc(lines * 2 - 1, sizeof(int));
+    if (table == NULL || votes == NULL)
+        goto complete;
+
+    for (i = 0; i < table_size; i++)
+        table[i] = -1;
+
+    /* Store the first occurrence of each displayed line */
+    for (i = 0; i < lines; i++) {
+
+        int slot = previous[i] & (table_size - 1);
+        while (table[slot] != -1 && previous[table[slot]] != previous[i])
+            slot = (slot + 1) & (table_size - 1);
+
+        if (table[slot] == -1)
+            table[slot] = i;
+
+    }
+
+    for (i = 0; i < lines; i++) {
+
+        /* Ignore unchanged lines, and runs of identical lines such as blank
+         * background, as they could have come from anywhere */
+        if (current[i] == previous[i]
+                || (i > 0 && current[i] == current[i - 1])
+                || (i < lines - 1 && current[i] == current[i + 1]))
+            continue;
+
+        int slot = current[i] & (table_size - 1);
+        while (table[slot] != -1 && previous[table[slot]] != current[i])
+            slot = (slot + 1) & (table_size - 1);
+
+        if (table[slot] == -1)
+            continue;
+
+        /* Vote for the offset at which this line was displayed */
+        int candidate = table[slot] - i;
+        int count = ++votes[candidate + lines - 1];
+        if (count > best) {
+            best = count;
+            offset = candidate;
+        }
+
+    }
+
+complete:
+    free(votes);
+    free(table);
+    return offset;
+
+}
+
+/**
+ * Moves the given range of lines of the given rectangle within the surface's
+ * record of displayed contents by the given offset, reflecting a copy of
+ * those lines which has been sent to the client.
+ *
+ * @param surface
+ *     The surface whose record of displayed contents should be updated.
+ *
+ * @param rect
+ *     The rectangle containing the lines.
+ *
+ * @param vertical
+ *     Non-zero if lines are rows, zero if lines are columns.
+ *
+ * @param first
+ *     The index of the first destination line, relative to the rectangle.
+ *
+ * @param last
+ *     The index of the last destination line, relative to the rectangle.
+ *
+ * @param offset
+ *     The offset of the source lines relative to the destination lines.
+ */
+static void __guac_common_surface_move_previous(guac_common_surface* surface,
+        const guac_common_rect* rect, int vertical, int first, int last,
+        int offset) {
+
+    int i;
+
+    /* Columns are moved within each row */
+    if (!vertical) {
+        for (i = 0; i < rect->height; i++) {
+            unsigned char* row = surface->previous
+                + (rect->y + i) * surface->stride + rect->x * 4;
+            memmove(row + first * 4, row + (first + offset) * 4,
+                    (last - first + 1) * 4);
+        }
+        return;
+    }
+
+    /* Rows are moved in an order which reads each row before it is
+     * overwritten */
+    for (i = 0; i <= last - first; i++) {
+        int line = offset > 0 ? first + i : last - i;
+        memcpy(__guac_common_surface_line(surface, surface->previous, rect,
+                    1, line),
+                __guac_common_surface_line(surface, surface->previous, rect,
+                    1, line + offset),
+                rect->width * 4);
+    }
+
+}
+
+/**
+ * Attempts to flush the bitmap update currently described by the dirty
+ * rectangle within the given surface as content which has moved by some
+ * offset along the given axis. If at least half of the lines of the update
+ * are found to have moved, those lines are drawn with a single copy, and
+ * only the remaining lines are encoded.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param vertical
+ *     Non-zero to search for vertical motion, zero to search for horizontal
+ *     motion.
+ *
+ * @return
+ *     Non-zero if the update was flushed, zero if no suitable motion was
+ *     found and the update remains dirty.
+ */
+static int __guac_common_surface_flush_axis_motion(
+        guac_common_surface* surface, int vertical) {
+
+    guac_common_rect rect = surface->dirty_rect;
+    int lines = vertical ? rect.height : rect.width;
+    int flushed = 0;
+    int i;
+
+    uint64_t* current = malloc(sizeof(uint64_t) * lines);
+    uint64_t* previous = malloc(sizeof(uint64_t) * lines);
+    char* moved = calloc(lines, sizeof(char));
+    if (current == NULL || previous == NULL || moved == NULL)
+        goto complete;
+
+    __guac_common_surface_hash_lines(surface, surface->buffer, &rect,
+            vertical, current);
+    __guac_common_surface_hash_lines(surface, surface->previous, &rect,
+            vertical, previous);
+
+    int offset = __guac_common_surface_find_offset(current, previous, lines);
+    if (offset == 0)
+        goto complete;
+
+    /* Verify which lines have actually moved by the chosen offset */
+    int first = -1;
+    int last = -1;
+    int count = 0;
+    for (i = 0; i < lines; i++) {
+
+        if (i + offset < 0 || i + offset >= lines)
+            continue;
+
+        if (current[i] == previous[i + offset]
+                && __guac_common_surface_lines_equal(surface, &rect,
+                    vertical, i, i + offset)) {
+
+            if (first == -1)
+                first = i;
+
+            last = i;
+            moved[i] = 1;
+            count++;
+
+        }
+
+    }
+
+    /* Not worthwhile unless most of the update has moved */
+    if (count * 2 < lines)
+        goto complete;
+
+    /* Draw moved lines by copying them from their previous location */
+    guac_common_rect move = rect;
+    if (vertical) {
+        move.y += first;
+        move.height = last - first + 1;
+    }
+    else {
+        move.x += first;
+        move.width = last - first + 1;
+    }
+
+    guac_common_surface_tile* tile = __guac_common_surface_add_tile(surface,
+            &move, GUAC_COMMON_SURFACE_TILE_MOVE, 1);
+    if (tile == NULL)
+        goto complete;
+
+    tile->src_x = move.x + (vertical ? 0 : offset);
+    tile->src_y = move.y + (vertical ? offset : 0);
+
+    /* Moved lossy content remains lossy */
+    guac_common_rect source = move;
+    source.x = tile->src_x;
+    source.y = tile->src_y;
+    if (__guac_common_surface_is_lossy(surface, &source))
+        __guac_common_surface_mark_lossy(surface, &move, 1);
+
+    __guac_common_surface_move_previous(surface, &rect, vertical, first, last,
+            offset);
+
+    /* Lines between the first and last moved lines now display content from
+     * their previous location, while all other lines are unchanged */
+    for (i = 0; i < lines; i++) {
+        if (!moved[i] && (i >= first && i <= last))
+            continue;
+        if (!moved[i] && current[i] == previous[i]
+                && __guac_common_surface_lines_equal(surface, &rect,
+                    vertical, i, i))
+            moved[i] = 1;
+    }
+
+    /* Encode each run of lines which still differ. As such content is
+     * likely to be moved again, it is always encoded losslessly. */
+    for (i = 0; i < lines; i++) {
+
+        if (moved[i])
+            continue;
+
+        int start = i;
+        while (i < lines && !moved[i])
+            i++;
+
+        guac_common_rect_init(&surface->dirty_rect,
+                rect.x + (vertical ? 0 : start),
+                rect.y + (vertical ? start : 0),
+                vertical ? rect.width : i - start,
+                vertical ? i - start : rect.height);
+
+        surface->dirty = 1;
+        __guac_common_surface_flush_dirty(surface, 0);
+
+    }
+
+    surface->realized = 1;
+    surface->dirty = 0;
+    flushed = 1;
+
+complete:
+    free(moved);
+    free(previous);
+    free(current);
+    return flushed;
+
+}
+
+/**
+ * Attempts to flush the bitmap update currently described by the dirty
+ * rectangle within the given surface as content which has moved vertically
+ * or horizontally, such as a scrolled document. If motion detection is
+ * disabled, if the update is too small, or if no suitable motion is found,
+ * the update is left for flushing as a normal bitmap update.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @return
+ *     Non-zero if the update was flushed, zero if the update remains dirty.
+ */
+static int __guac_common_surface_flush_motion(guac_common_surface* surface) {
+
+    /* Motion can only be detected relative to known displayed contents */
+    if (surface->previous == NULL || surface->previous_stale
+            || !surface->realized)
+        return 0;
+
+    if (surface->dirty_rect.width < GUAC_COMMON_SURFACE_MOTION_MIN_SIZE
+            || surface->dirty_rect.height < GUAC_COMMON_SURFACE_MOTION_MIN_SIZE)
+        return 0;
+
+    /* Scrolling is far more often vertical than horizontal */
+    return __guac_common_surface_flush_axis_motion(surface, 1)
+        || __guac_common_surface_flush_axis_motion(surface, 0);
+
+}
+
+/**
+ * Returns the estimated cost of flushing the given rectangle as a single
+ * image, including the overhead of each image regardless of its size.
+ *
+ * @param rect
+ *     The rectangle to estimate the cost of.
+ *
+ * @return
+ *     The estimated cost of flushing the given rectangle.
+ */
+static int __guac_common_surface_damage_cost(const guac_common_rect* rect) {
+    return GUAC_SURFACE_BASE_COST + rect->width * rect->height;
+}
+
+/**
+ * Returns the estimated reduction in cost achieved by flushing the given
+ * rectangles as a single image rather than as separate images. The result is
+ * negative if flushing the rectangles separately would be cheaper.
+ *
+ * @param a
+ *     The first rectangle.
+ *
+ * @param b
+ *     The second rectangle.
+ *
+ * @return
+ *     The estimated reduction in cost achieved by combining the rectangles.
+ */
+static int __guac_common_surface_combine_saving(const guac_common_rect* a,
+        const guac_common_rect* b) {
+
+    guac_common_rect combined = *a;
+    guac_common_rect_extend(&combined, b);
+
+    return __guac_common_surface_damage_cost(a)
+         + __guac_common_surface_damage_cost(b)
+         - __guac_common_surface_damage_cost(&combined);
+
+}
+
+/**
+ * Flushes the given rectangle of damage as an update, drawing any content
+ * which has merely moved with a copy and encoding everything else.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param rect
+ *     The damaged rectangle to flush. This rectangle may extend beyond the
+ *     bounds of the surface.
+ */
+static void __guac_common_surface_flush_damage_rect(
+        guac_common_surface* surface, const guac_common_rect* rect) {
+
+    surface->dirty_rect = *rect;
+
+    /* Clip update within current bounds */
+    __guac_common_bound_rect(surface, &surface->dirty_rect, NULL, NULL);
+    if (surface->dirty_rect.width <= 0 || surface->dirty_rect.height <= 0)
+        return;
+
+    surface->dirty = 1;
+    if (!__guac_common_surface_flush_motion(surface))
+        __guac_common_surface_flush_dirty(surface, 1);
+
+}
+
+/**
+ * Returns whether the given rectangle of damage may be extended to contain
+ * the given run of damage without overlapping any other rectangle of damage,
+ * whether already flushed or still being built up. Horizontally, overlap is
+ * tested at the granularity of columns of heat map cells.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param damage
+ *     The rectangle of damage which would be extended.
+ *
+ * @param run
+ *     A run of damage within the current row of heat map cells.
+ *
+ * @param next_column
+ *     The column of heat map cells at which the next run of damage within the
+ *     current row begins, or the width of the heat map if there is no such
+ *     run.
+ *
+ * @return
+ *     Non-zero if the rectangle may be extended to contain the run, zero
+ *     otherwise.
+ */
+static int __guac_common_surface_can_extend_damage(
+        guac_common_surface* surface,
+        const guac_common_surface_damage_rect* damage,
+        const guac_common_rect* run, int next_column) {
+
+    guac_common_rect combined = damage->rect;
+    guac_common_rect_extend(&combined, run);
+
+    int first = combined.x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int last = (combined.x + combined.width - 1)
+             / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    /* Runs later within this row have not yet been placed */
+    if (last >= next_column)
+        return 0;
+
+    /* No other rectangle may reach below the top of this rectangle within
+     * any column it would cover */
+    int column;
+    for (column = first; column <= last; column++) {
+        guac_common_surface_damage_column* lowest =
+            &surface->damage_columns[column];
+        if (lowest->bottom > damage->rect.y && lowest->owner != damage->id)
+            return 0;
+    }
+
+    return 1;
+
+}
+
+/**
+ * Records the given rectangle of damage as the lowest rectangle within each
+ * column of heat map cells that it covers.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param damage
+ *     The rectangle of damage which has been started or extended.
+ */
+static void __guac_common_surface_cover_damage(guac_common_surface* surface,
+        const guac_common_surface_damage_rect* damage) {
+
+    int bottom = damage->rect.y + damage->rect.height;
+
+    int first = damage->rect.x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int last = (damage->rect.x + damage->rect.width - 1)
+             / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    int column;
+    for (column = first; column <= last; column++) {
+        surface->damage_columns[column].bottom = bottom;
+        surface->damage_columns[column].owner = damage->id;
+    }
+
+}
+
+/**
+ * Extends a damage rectangle from the previous row of heat map cells to
+ * contain the given run of damage, if worthwhile and if the extended
+ * rectangle would overlap no other damage rectangle, or starts a new damage
+ * rectangle for that run. Damage rectangles which lie entirely to the left of
+ * the run can no longer be extended by this row, and are moved to the given
+ * list of rectangles for the next row if they have been extended, or flushed
+ * otherwise.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param run
+ *     A run of damage within the current row of heat map cells, to the right
+ *     of all previous runs within the same row.
+ *
+ * @param next_column
+ *     The column of heat map cells at which the next run of damage within the
+ *     same row begins, or the width of the heat map if there is no such run.
+ *
+ * @param open
+ *     The damage rectangles from the previous row of heat map cells, ordered
+ *     from left to right by the run which started or last extended each
+ *     rectangle.
+ *
+ * @param open_length
+ *     The number of damage rectangles within the open list.
+ *
+ * @param current
+ *     Pointer to the index of the first damage rectangle within the open list
+ *     which has not yet been moved or flushed.
+ *
+ * @param next
+ *     The damage rectangles which may be extended by the next row of heat
+ *     map cells.
+ *
+ * @param next_length
+ *     Pointer to the number of damage rectangles within the next list.
+ *
+ * @param last_id
+ *     Pointer to the identifier most recently assigned to a damage
+ *     rectangle.
+ */
+static void __guac_common_surface_add_damage_run(guac_common_surface* surface,
+        const guac_common_rect* run, int next_column,
+        guac_common_surface_damage_rect* open, int open_length, int* current,
+        guac_common_surface_damage_rect* next, int* next_length,
+        int* last_id) {
+
+    /* Retire any rectangles which this run cannot reach */
+    while (*current < open_length) {
+
+        guac_common_surface_damage_rect* damage = &open[*current];
+        if (damage->rect.x + damage->rect.width > run->x)
+            break;
+
+        if (damage->continued) {
+            damage->continued = 0;
+            next[(*next_length)++] = *damage;
+        }
+        else
+            __guac_common_surface_flush_damage_rect(surface, &damage->rect);
+
+        (*current)++;
+
+    }
+
+    guac_common_surface_damage_rect* best = NULL;
+    int best_saving = 0;
+    int i;
+
+    /* Find the overlapping rectangle from the previous row which would be
+     * extended most cheaply to contain this run */
+    for (i = *current; i < open_length; i++) {
+
+        guac_common_surface_damage_rect* damage = &open[i];
+        if (damage->rect.x >= run->x + run->width)
+            break;
+
+        if (damage->rect.x + damage->rect.width <= run->x)
+            continue;
+
+        int saving = __guac_common_surface_combine_saving(&damage->rect, run);
+        if (saving >= 0 && (best == NULL || saving > best_saving)
+                && __guac_common_surface_can_extend_damage(surface, damage,
+                    run, next_column)) {
+            best = damage;
+            best_saving = saving;
+        }
+
+    }
+
+    /* Extend that rectangle, if worthwhile */
+    if (best != NULL) {
+        guac_common_rect_extend(&best->rect, run);
+        best->continued = 1;
+        __guac_common_surface_cover_damage(surface, best);
+        return;
+    }
+
+    /* Otherwise, start a new rectangle */
+    guac_common_surface_damage_rect* damage = &next[(*next_length)++];
+    damage->id = ++(*last_id);
+    damage->rect = *run;
+    damage->continued = 0;
+    __guac_common_surface_cover_damage(surface, damage);
+
+}
 
 /**
- * Flushes only the properties of the given surface, such as layer location or
- * opacity. Image state is not flushed. If the surface represents a buffer or
- * the default layer, this function has no effect.
+ * Flushes all damage of the given surface as a set of non-overlapping
+ * rectangular updates. Damaged heat map cells are visited row by row,
+ * combining horizontally adjacent damage into runs and extending the runs of
+ * the previous row downward, in each case only where the estimated cost of a
+ * combined update is no more than that of separate updates, and where the
+ * combined update would not overlap any other. Each damaged cell is visited
+ * exactly once, and the surface has no damage once this function returns.
  *
  * @param surface
  *     The surface to flush.
  */
-static void __guac_common_surface_flush_properties(
-        guac_common_surface* surface) {
+static void __guac_common_surface_flush_damage(guac_common_surface* surface) {
 
-    guac_socket* socket = surface->socket;
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+    int index_words = GUAC_COMMON_SURFACE_DAMAGE_INDEX_WORDS(heat_width);
 
-    /* Only applicable to non-default visible layers */
-    if (surface->layer->index <= 0)
-        return;
+    /* Rectangles alternate between two lists, one per row of cells */
+    guac_common_surface_damage_rect* open = surface->damage_rects;
+    guac_common_surface_damage_rect* next = open + heat_width;
+    int open_length = 0;
+    int last_id = 0;
+    int y, word, i;
 
-    /* Flush opacity */
-    if (surface->opacity_dirty) {
-        guac_protocol_send_shade(socket, surface->layer, surface->opacity);
-        surface->opacity_dirty = 0;
-    }
+    /* No column is yet covered by any rectangle */
+    memset(surface->damage_columns, 0,
+            heat_width * sizeof(guac_common_surface_damage_column));
+
+    for (y = 0; y < heat_height; y++) {
+
+        guac_common_surface_damage_cell* damage =
+            surface->damage + y * heat_width;
+
+        uint64_t* index = surface->damage_index + y * index_words;
+
+        int current = 0;
+        int next_length = 0;
+        int run_length = 0;
+        guac_common_rect run;
+
+        for (word = 0; word < index_words; word++) {
+
+            /* Visit only damaged cells */
+            uint64_t cells = index[word];
+            index[word] = 0;
+
+            while (cells) {
+
+                int x = word * 64 + __builtin_ctzll(cells);
+                cells &= cells - 1;
+
+                guac_common_rect rect = damage[x].rect;
+                damage[x].blocks = 0;
+
+                /* Extend current run if worthwhile */
+                if (run_length && __guac_common_surface_combine_saving(&run,
+                            &rect) >= 0) {
+                    guac_common_rect_extend(&run, &rect);
+                    continue;
+                }
+
+                /* Otherwise, start a new run at this cell */
+                if (run_length)
+                    __guac_common_surface_add_damage_run(surface, &run, x,
+                            open, open_length, &current, next, &next_length,
+                            &last_id);
+
+                run = rect;
+                run_length = 1;
+
+            }
+
+        }
+
+        if (run_length)
+            __guac_common_surface_add_damage_run(surface, &run, heat_width,
+                    open, open_length, &current, next, &next_length,
+                    &last_id);
+
+        /* Retire any rectangles not reached by this row */
+        for (i = current; i < open_length; i++) {
+            if (open[i].continued) {
+                open[i].continued = 0;
+                next[next_length++] = open[i];
+            }
+            else
+                __guac_common_surface_flush_damage_rect(surface, &open[i].rect);
+        }
+
+        /* Rectangles for the next row become open */
+        guac_common_surface_damage_rect* swap = open;
+        open = next;
+        next = swap;
+        open_length = next_length;
 
-    /* Flush location and hierarchy */
-    if (surface->location_dirty) {
-        guac_protocol_send_move(socket, surface->layer,
-                surface->parent, surface->x, surface->y, surface->z);
-        surface->location_dirty = 0;
     }
 
+    /* Flush all remaining rectangles */
+    for (i = 0; i < open_length; i++)
+        __guac_common_surface_flush_damage_rect(surface, &open[i].rect);
+
+    surface->damaged_cells = 0;
+
 }
 
-static void __guac_common_surface_flush(guac_common_surface* surface) {
+/**
+ * Returns whether the heat map cell at the given location has been sent with
+ * a lossy format, and has remained unchanged for at least the lossless
+ * refresh interval of the given surface.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param heat_cell
+ *     The heat map cell to test.
+ *
+ * @param now
+ *     The current time.
+ *
+ * @return
+ *     Non-zero if the cell should be re-sent losslessly, zero otherwise.
+ */
+static int __guac_common_surface_should_refresh(guac_common_surface* surface,
+        const guac_common_surface_heat_cell* heat_cell, guac_timestamp now) {
 
-    /* Flush final dirty rectangle to queue. */
-    __guac_common_surface_flush_to_queue(surface);
+    if (!heat_cell->lossy
+            || now - heat_cell->lossy < surface->lossless_refresh)
+        return 0;
 
-    guac_common_surface_bitmap_rect* current = surface->bitmap_queue;
-    int i, j;
-    int original_queue_length;
-    int flushed = 0;
+    /* Calculate index of latest history entry */
+    int latest_entry = heat_cell->oldest_entry - 1;
+    if (latest_entry < 0)
+        latest_entry = GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE - 1;
 
-    original_queue_length = surface->bitmap_queue_length;
+    return now - heat_cell->history[latest_entry]
+        >= surface->lossless_refresh;
 
-    /* Sort updates to make combination less costly */
-    qsort(surface->bitmap_queue, surface->bitmap_queue_length, sizeof(guac_common_surface_bitmap_rect),
-          __guac_common_surface_bitmap_rect_compare);
+}
+
+/**
+ * Re-sends losslessly any content of the given surface which was sent with a
+ * lossy format and has since remained unchanged for at least the lossless
+ * refresh interval of the surface. Only as much content is re-sent as the
+ * refresh budget allows, after accounting for both the processing lag of the
+ * client and any other updates already part of the current flush. Remaining
+ * content is re-sent by later flushes.
+ *
+ * @param surface
+ *     The surface being flushed.
+ */
+static void __guac_common_surface_flush_refresh(guac_common_surface* surface) {
 
-    /* Flush all rects in queue */
-    for (i=0; i < surface->bitmap_queue_length; i++) {
+    int x, y, i;
+
+    if (!surface->lossless_refresh || !surface->lossy_cells
+            || !surface->realized)
+        return;
 
-        /* Get next unflushed candidate */
-        guac_common_surface_bitmap_rect* candidate = current;
-        if (!candidate->flushed) {
+    /* Refresh less as the client falls behind */
+    int lag = guac_client_get_processing_lag(surface->client);
+    if (lag >= GUAC_COMMON_SURFACE_REFRESH_MAX_LAG)
+        return;
 
-            int combined = 0;
+    int budget = GUAC_COMMON_SURFACE_REFRESH_BUDGET
+               / GUAC_COMMON_SURFACE_REFRESH_MAX_LAG
+               * (GUAC_COMMON_SURFACE_REFRESH_MAX_LAG - lag);
 
-            /* Build up rect as much as possible */
-            for (j=i; j < surface->bitmap_queue_length; j++) {
+    /* Updates already part of this flush take priority */
+    for (i = 0; i < surface->tiles_length; i++) {
+        const guac_common_surface_tile* tile = &surface->tiles[i];
+        if (!__guac_common_surface_is_imageless(tile))
+            budget -= tile->rect.width * tile->rect.height;
+    }
 
-                if (!candidate->flushed) {
+    if (budget <= 0)
+        return;
 
-                    /* Clip candidate within current bounds */
-                    __guac_common_bound_rect(surface, &candidate->rect, NULL, NULL);
-                    if (candidate->rect.width <= 0 || candidate->rect.height <= 0)
-                        candidate->flushed = 1;
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+    guac_timestamp now = guac_timestamp_current();
 
-                    /* Combine if reasonable */
-                    else if (__guac_common_should_combine(surface, &candidate->rect, 0) || !surface->dirty) {
-                        __guac_common_mark_dirty(surface, &candidate->rect);
-                        candidate->flushed = 1;
-                        combined++;
-                    }
+    for (y = 0; y < heat_height; y++) {
 
-                }
+        guac_common_surface_heat_cell* heat_row =
+            surface->heat_map + y * heat_width;
 
-                candidate++;
+        for (x = 0; x < heat_width; x++) {
 
-            }
+            if (!__guac_common_surface_should_refresh(surface,
+                        &heat_row[x], now))
+                continue;
 
-            /* Re-add to queue if there's room and this update was modified or we expect others might be */
-            if ((combined > 1 || i < original_queue_length)
-                    && surface->bitmap_queue_length < GUAC_COMMON_SURFACE_QUEUE_SIZE)
-                __guac_common_surface_flush_to_queue(surface);
+            /* Combine with all following cells of the row needing refresh */
+            int start = x;
+            while (x + 1 < heat_width && __guac_common_surface_should_refresh(
+                        surface, &heat_row[x + 1], now))
+                x++;
 
-            /* Flush as bitmap otherwise */
-            else if (surface->dirty) {
+            guac_common_rect rect;
+            guac_common_rect_init(&rect,
+                    start * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    (x + 1 - start) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+            __guac_common_bound_rect(surface, &rect, NULL, NULL);
 
-                flushed++;
+            /* Re-send only as many cells as the budget allows */
+            if (rect.width * rect.height > budget) {
 
-                int opaque = __guac_common_surface_is_opaque(surface,
-                            &surface->dirty_rect);
+                int cells = budget
+                    / (GUAC_COMMON_SURFACE_HEAT_CELL_SIZE * rect.height);
+                if (cells <= 0)
+                    return;
 
-                /* Prefer WebP when reasonable */
-                if (__guac_common_surface_should_use_webp(surface,
-                            &surface->dirty_rect))
-                    __guac_common_surface_flush_to_webp(surface, opaque);
+                x = start + cells - 1;
+                rect.width = cells * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
 
-                /* If not WebP, JPEG is the next best (lossy) choice */
-                else if (opaque && __guac_common_surface_should_use_jpeg(
-                            surface, &surface->dirty_rect))
-                    __guac_common_surface_flush_to_jpeg(surface);
+            }
 
-                /* Use PNG if no lossy formats are appropriate */
-                else
-                    __guac_common_surface_flush_to_png(surface, opaque);
+            budget -= rect.width * rect.height;
 
+            surface->dirty_rect = rect;
+            surface->dirty = 1;
+            __guac_common_surface_flush_dirty(surface, 0);
+
+            /* Refreshed cells are considered lossless even if not fully
+             * opaque (opaque cells are already unmarked as their tiles are
+             * added) */
+            for (i = start; i <= x; i++) {
+                if (heat_row[i].lossy) {
+                    heat_row[i].lossy = 0;
+                    surface->lossy_cells--;
+                }
             }
 
         }
 
-        current++;
+    }
+
+}
+
+static void __guac_common_surface_flush(guac_common_surface* surface,
+        int refresh) {
+
+    /* Flush all damage as bitmap updates */
+    if (surface->damaged_cells)
+        __guac_common_surface_flush_damage(surface);
+
+    /* Use any remaining bandwidth to re-send static lossy content */
+    if (refresh)
+        __guac_common_surface_flush_refresh(surface);
+
+    /* Encode and send all flushed updates */
+    __guac_common_surface_flush_tiles(surface);
+
+    /* All users now display the same contents */
+    surface->previous_stale = 0;
+
+}
+
+void guac_common_surface_set_pipeline(guac_common_surface* surface,
+        guac_common_pipeline* pipeline) {
+
+    pthread_mutex_lock(&surface->_lock);
+    surface->pipeline = pipeline;
+    surface->socket = pipeline->socket;
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_set_image_cache(guac_common_surface* surface,
+        guac_common_image_cache* image_cache) {
+
+    pthread_mutex_lock(&surface->_lock);
+    surface->image_cache = image_cache;
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_set_motion_detection(guac_common_surface* surface,
+        int enabled) {
+
+    pthread_mutex_lock(&surface->_lock);
 
+    /* Begin recording displayed contents. As pending updates have not yet
+     * been sent, the record is not accurate until the next flush. */
+    if (enabled && surface->previous == NULL) {
+        surface->previous = malloc(surface->height * surface->stride);
+        if (surface->previous != NULL)
+            memcpy(surface->previous, surface->buffer,
+                    surface->height * surface->stride);
+        surface->previous_stale = 1;
     }
 
-    /* Flush complete */
-    surface->bitmap_queue_length = 0;
+    /* Stop recording displayed contents */
+    else if (!enabled) {
+        free(surface->previous);
+        surface->previous = NULL;
+    }
+
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_set_lossless_refresh(guac_common_surface* surface,
+        int interval) {
+
+    pthread_mutex_lock(&surface->_lock);
+    surface->lossless_refresh = interval > 0 ? interval : 0;
+    pthread_mutex_unlock(&surface->_lock);
 
 }
 
@@ -1943,20 +4035,35 @@ void guac_common_surface_flush(guac_common_surface* surface) {
     __guac_common_surface_flush_properties(surface);
 
     /* Flush surface contents */
-    __guac_common_surface_flush(surface);
+    __guac_common_surface_flush(surface, 1);
 
     pthread_mutex_unlock(&surface->_lock);
 
 }
 
-void guac_common_surface_dup(guac_common_surface* surface, guac_user* user,
-        guac_socket* socket) {
-
-    pthread_mutex_lock(&surface->_lock);
+/**
+ * Duplicates the contents and properties of the given surface to the given
+ * socket. The surface must already be locked.
+ *
+ * @param surface
+ *     The surface to duplicate.
+ *
+ * @param user
+ *     The user receiving the surface.
+ *
+ * @param socket
+ *     The socket over which the surface contents should be sent.
+ */
+static void __guac_common_surface_dup(guac_common_surface* surface,
+        guac_user* user, guac_socket* socket) {
 
     /* Do nothing if not realized */
     if (!surface->realized)
-        goto complete;
+        return;
+
+    /* The new user will receive pending updates in full, and thus will not
+     * display the same contents as other users until the next flush */
+    surface->previous_stale = 1;
 
     /* Synchronize layer-specific properties if applicable */
     if (surface->layer->index > 0) {
@@ -1989,8 +4096,279 @@ void guac_common_surface_dup(guac_common_surface* surface, guac_user* user,
 
     }
 
+}
+
+/**
+ * Callback for guac_client_for_user() which sends the entire contents of the
+ * surface given as the callback data to the given user, if that user is
+ * connected.
+ *
+ * @param user
+ *     The user for which duplication of the surface was deferred, or NULL if
+ *     that user is not (or not yet) connected.
+ *
+ * @param data
+ *     The surface whose deferred duplication should be completed.
+ *
+ * @return
+ *     The given user, or NULL if the user is not connected.
+ */
+static void* __guac_common_surface_dup_pending(guac_user* user, void* data) {
+
+    guac_common_surface* surface = (guac_common_surface*) data;
+
+    if (user != NULL)
+        __guac_common_surface_dup(surface, user, user->socket);
+
+    return user;
+
+}
+
+static void __guac_common_surface_flush_dup(guac_common_surface* surface) {
+
+    int i;
+    int length = 0;
+
+    for (i = 0; i < surface->dup_pending_length; i++) {
+
+        guac_user* user = surface->dup_pending[i];
+
+        /* Users which are still joining receive the surface only once
+         * connected, as they would not yet receive the copy or transfer */
+        if (guac_client_for_user(surface->client, user,
+                    __guac_common_surface_dup_pending, surface) == NULL)
+            surface->dup_pending[length++] = user;
+
+    }
+
+    surface->dup_pending_length = length;
+
+}
+
+void guac_common_surface_dup(guac_common_surface* surface, guac_user* user,
+        guac_socket* socket) {
+
+    pthread_mutex_lock(&surface->_lock);
+    __guac_common_surface_dup(surface, user, socket);
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+int guac_common_surface_capture(guac_common_surface* surface,
+        guac_common_snapshot_layer* captured) {
+
+    int retval = 0;
+
+    pthread_mutex_lock(&surface->_lock);
+
+    captured->layer = *surface->layer;
+    captured->parent = *surface->parent;
+    captured->realized = surface->realized;
+    captured->x = surface->x;
+    captured->y = surface->y;
+    captured->z = surface->z;
+    captured->opacity = surface->opacity;
+    captured->width = surface->width;
+    captured->height = surface->height;
+    captured->stride = surface->stride;
+
+    /* Copy contents only if they will be sent */
+    if (surface->realized && surface->width > 0 && surface->height > 0) {
+
+        captured->buffer = malloc(surface->height * surface->stride);
+        if (captured->buffer == NULL) {
+            retval = 1;
+            goto complete;
+        }
+
+        memcpy(captured->buffer, surface->buffer,
+                surface->height * surface->stride);
+
+    }
+
+complete:
+    pthread_mutex_unlock(&surface->_lock);
+    return retval;
+
+}
+
+/**
+ * Calculates the smallest rectangle containing every pixel of the given
+ * surface which differs from the given captured contents of that surface.
+ * The captured contents must have the same dimensions as the surface.
+ *
+ * @param surface
+ *     The surface to compare.
+ *
+ * @param captured
+ *     The captured contents of the surface.
+ *
+ * @param changed
+ *     The rectangle which should receive the bounds of all changed pixels.
+ *
+ * @return
+ *     Non-zero if any pixel has changed, zero otherwise.
+ */
+static int __guac_common_surface_find_changes(guac_common_surface* surface,
+        const guac_common_snapshot_layer* captured, guac_common_rect* changed) {
+
+    int min_x = surface->width;
+    int max_x = -1;
+    int min_y = -1;
+    int max_y = -1;
+    int x, y;
+
+    for (y = 0; y < surface->height; y++) {
+
+        const uint32_t* current = (uint32_t*)
+            (surface->buffer + y * surface->stride);
+        const uint32_t* previous = (uint32_t*)
+            (captured->buffer + y * captured->stride);
+
+        /* Skip unchanged rows entirely */
+        if (memcmp(current, previous, surface->width * 4) == 0)
+            continue;
+
+        if (min_y == -1)
+            min_y = y;
+        max_y = y;
+
+        /* Widen bounds to the first and last changed pixels of the row */
+        for (x = 0; x < min_x; x++) {
+            if (current[x] != previous[x]) {
+                min_x = x;
+                break;
+            }
+        }
+
+        for (x = surface->width - 1; x > max_x; x--) {
+            if (current[x] != previous[x]) {
+                max_x = x;
+                break;
+            }
+        }
+
+    }
+
+    if (min_y == -1)
+        return 0;
+
+    guac_common_rect_init(changed, min_x, min_y,
+            max_x - min_x + 1, max_y - min_y + 1);
+    return 1;
+
+}
+
+void guac_common_surface_dup_changes(guac_common_surface* surface,
+        guac_user* user, guac_socket* socket,
+        const guac_common_snapshot_layer* captured) {
+
+    guac_common_rect changed;
+
+    pthread_mutex_lock(&surface->_lock);
+
+    /* Send everything if the user has nothing to compare against */
+    if (!captured->realized || captured->width != surface->width
+            || captured->height != surface->height) {
+        __guac_common_surface_dup(surface, user, socket);
+        goto complete;
+    }
+
+    if (!surface->realized)
+        goto complete;
+
+    /* The new user will receive pending updates in full, and thus will not
+     * display the same contents as other users until the next flush */
+    surface->previous_stale = 1;
+
+    /* Synchronize changed layer-specific properties */
+    if (surface->layer->index > 0) {
+
+        if (surface->opacity != captured->opacity)
+            guac_protocol_send_shade(socket, surface->layer,
+                    surface->opacity);
+
+        if (surface->parent->index != captured->parent.index
+                || surface->x != captured->x || surface->y != captured->y
+                || surface->z != captured->z)
+            guac_protocol_send_move(socket, surface->layer,
+                    surface->parent, surface->x, surface->y, surface->z);
+
+    }
+
+    if (captured->buffer == NULL
+            || !__guac_common_surface_find_changes(surface, captured,
+                &changed))
+        goto complete;
+
+    /* Replace changed contents entirely, including any transparency */
+    guac_protocol_send_rect(socket, surface->layer,
+            changed.x, changed.y, changed.width, changed.height);
+    guac_protocol_send_cfill(socket, GUAC_COMP_ROUT, surface->layer,
+            0x00, 0x00, 0x00, 0xFF);
+
+    cairo_surface_t* rect = cairo_image_surface_create_for_data(
+            surface->buffer + changed.y * surface->stride + changed.x * 4,
+            CAIRO_FORMAT_ARGB32, changed.width, changed.height,
+            surface->stride);
+
+    guac_user_stream_png(user, socket, GUAC_COMP_OVER, surface->layer,
+            changed.x, changed.y, rect);
+    cairo_surface_destroy(rect);
+
+complete:
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_defer_dup(guac_common_surface* surface,
+        guac_user* user) {
+
+    pthread_mutex_lock(&surface->_lock);
+
+    /* Grow list of pending users as necessary */
+    if (surface->dup_pending_length == surface->dup_pending_available) {
+
+        int available = surface->dup_pending_available
+            ? surface->dup_pending_available * 2 : 4;
+
+        guac_user** pending = realloc(surface->dup_pending,
+                sizeof(guac_user*) * available);
+
+        /* Send the surface immediately if it cannot be deferred */
+        if (pending == NULL) {
+            __guac_common_surface_dup(surface, user, user->socket);
+            goto complete;
+        }
+
+        surface->dup_pending = pending;
+        surface->dup_pending_available = available;
+
+    }
+
+    surface->dup_pending[surface->dup_pending_length++] = user;
+
 complete:
     pthread_mutex_unlock(&surface->_lock);
 
 }
 
+void guac_common_surface_remove_user(guac_common_surface* surface,
+        guac_user* user) {
+
+    int i;
+    int length = 0;
+
+    pthread_mutex_lock(&surface->_lock);
+
+    /* Never send deferred contents to a user which has left */
+    for (i = 0; i < surface->dup_pending_length; i++) {
+        if (surface->dup_pending[i] != user)
+            surface->dup_pending[length++] = surface->dup_pending[i];
+    }
+
+    surface->dup_pending_length = length;
+
+    pthread_mutex_unlock(&surface->_lock);
+
+}
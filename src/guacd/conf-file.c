@@ -31,6 +31,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -60,6 +61,40 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
             return 0;
         }
 
+        /* Listen backlog */
+        else if (strcmp(param, "listen_backlog") == 0) {
+
+            char* end;
+            long backlog = strtol(value, &end, 10);
+
+            /* Invalid backlog */
+            if (*end != '\0' || end == value || backlog < 1 || backlog > 65535) {
+                guacd_conf_parse_error = "Invalid listen backlog. The listen backlog must be between 1 and 65535 inclusive.";
+                return 1;
+            }
+
+            config->listen_backlog = backlog;
+            return 0;
+
+        }
+
+        /* Number of listening sockets */
+        else if (strcmp(param, "listeners") == 0) {
+
+            char* end;
+            long listeners = strtol(value, &end, 10);
+
+            /* Invalid number of listeners */
+            if (*end != '\0' || end == value || listeners < 1 || listeners > 64) {
+                guacd_conf_parse_error = "Invalid number of listeners. The number of listeners must be between 1 and 64 inclusive.";
+                return 1;
+            }
+
+            config->listeners = listeners;
+            return 0;
+
+        }
+
     }
 
     /* Options related to daemon startup */
@@ -89,6 +124,47 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
 
         }
 
+        /* Protocol statistics log level */
+        else if (strcmp(param, "stats_log_level") == 0) {
+
+            int level = guacd_parse_log_level(value);
+
+            /* Invalid log level */
+            if (level < 0) {
+                guacd_conf_parse_error = "Invalid log level. Valid levels are: \"trace\", \"debug\", \"info\", \"warning\", and \"error\".";
+                return 1;
+            }
+
+            /* Valid log level */
+            config->stats_log_level = level;
+            return 0;
+
+        }
+
+        /* Protocols having zygotes */
+        else if (strcmp(param, "zygote_protocols") == 0) {
+            free(config->zygote_protocols);
+            config->zygote_protocols = strdup(value);
+            return 0;
+        }
+
+        /* Number of idle processes per zygote */
+        else if (strcmp(param, "zygote_idle") == 0) {
+
+            char* end;
+            long idle = strtol(value, &end, 10);
+
+            /* Invalid number of processes */
+            if (*end != '\0' || end == value || idle < 0 || idle > 64) {
+                guacd_conf_parse_error = "Invalid number of idle processes. The number of idle processes must be between 0 and 64 inclusive.";
+                return 1;
+            }
+
+            config->zygote_idle = idle;
+            return 0;
+
+        }
+
     }
 
     /* SSL-specific options */
@@ -178,10 +254,15 @@ guacd_config* guacd_conf_load() {
     /* Load defaults */
     conf->bind_host = NULL;
     conf->bind_port = strdup("4822");
+    conf->listen_backlog = SOMAXCONN;
+    conf->listeners = 1;
     conf->pidfile = NULL;
     conf->foreground = 0;
     conf->print_version = 0;
     conf->max_log_level = GUAC_LOG_INFO;
+    conf->stats_log_level = -1;
+    conf->zygote_protocols = NULL;
+    conf->zygote_idle = 0;
 
 #ifdef ENABLE_SSL
     conf->cert_file = NULL;
@@ -39,6 +39,20 @@ typedef struct guacd_config {
      */
     char* bind_port;
 
+    /**
+     * The maximum number of connections which may be waiting to be accepted
+     * by each listening socket.
+     */
+    int listen_backlog;
+
+    /**
+     * The number of sockets listening for connections, each having its own
+     * thread accepting those connections. If greater than one, each socket
+     * is bound with SO_REUSEPORT, such that the kernel distributes new
+     * connections between them.
+     */
+    int listeners;
+
     /**
      * The file to write the PID in, if any.
      */
@@ -71,6 +85,26 @@ typedef struct guacd_config {
      */
     guac_client_log_level max_log_level;
 
+    /**
+     * The level at which the protocol statistics of each connection should
+     * be logged when that connection ends, or -1 if statistics should not be
+     * collected.
+     */
+    int stats_log_level;
+
+    /**
+     * Comma-separated list of the protocols for which zygote processes
+     * should be started, or NULL if all connection processes should be
+     * forked directly by guacd.
+     */
+    char* zygote_protocols;
+
+    /**
+     * The number of fully-initialized connection processes that each zygote
+     * should keep waiting for new connections.
+     */
+    int zygote_idle;
+
 } guacd_config;
 
 #endif
@@ -19,11 +19,15 @@
 
 #include "config.h"
 
+/* Required for splice() */
+#define _GNU_SOURCE
+
 #include "connection.h"
 #include "log.h"
 #include "move-fd.h"
 #include "proc.h"
 #include "proc-map.h"
+#include "socket-prefix.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
@@ -39,8 +43,11 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
@@ -82,6 +89,71 @@ static int __write_all(int fd, char* buffer, int length) {
 
 }
 
+#ifdef HAVE_SPLICE
+/**
+ * The maximum number of bytes to transfer through a pipe with each call to
+ * splice().
+ */
+#define GUACD_SPLICE_LENGTH 65536
+
+/**
+ * Transfers all data from one file descriptor to another using splice(),
+ * moving that data through a pipe within the kernel rather than copying it
+ * through a buffer within guacd. Transfer continues until no further data can
+ * be read or the data cannot be written.
+ *
+ * @param from_fd
+ *     The file descriptor to read data from.
+ *
+ * @param to_fd
+ *     The file descriptor to write data to.
+ *
+ * @return
+ *     Zero if all data was transferred until end-of-file, non-zero if an
+ *     error occurs.
+ */
+static int guacd_connection_splice(int from_fd, int to_fd) {
+
+    int pipe_fds[2];
+    int result = 1;
+
+    if (pipe(pipe_fds))
+        return 1;
+
+    for (;;) {
+
+        /* Move as much data as is available into the pipe */
+        ssize_t length = splice(from_fd, NULL, pipe_fds[1], NULL,
+                GUACD_SPLICE_LENGTH, SPLICE_F_MOVE);
+
+        /* Stop upon end-of-file or error */
+        if (length <= 0) {
+            result = (length < 0);
+            break;
+        }
+
+        /* Move everything in the pipe to its destination */
+        while (length > 0) {
+
+            ssize_t written = splice(pipe_fds[0], NULL, to_fd, NULL, length,
+                    SPLICE_F_MOVE);
+            if (written <= 0)
+                goto done;
+
+            length -= written;
+
+        }
+
+    }
+
+done:
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return result;
+
+}
+#endif
+
 /**
  * Continuously reads from a guac_socket, writing all data read to a file
  * descriptor. Any data already buffered from that guac_socket by a given
@@ -117,6 +189,14 @@ static void* guacd_connection_write_thread(void* data) {
     /* Parser is no longer needed */
     guac_parser_free(params->parser);
 
+#ifdef HAVE_SPLICE
+    /* Transfer directly between file descriptors if possible */
+    if (params->socket_fd != -1) {
+        guacd_connection_splice(params->socket_fd, params->fd);
+        return NULL;
+    }
+#endif
+
     /* Transfer data from file descriptor to socket */
     while ((length = guac_socket_read(params->socket, buffer, sizeof(buffer))) > 0) {
         if (__write_all(params->fd, buffer, length) < 0)
@@ -137,11 +217,27 @@ void* guacd_connection_io_thread(void* data) {
     pthread_t write_thread;
     pthread_create(&write_thread, NULL, guacd_connection_write_thread, params);
 
+#ifdef HAVE_SPLICE
+    /* Transfer directly between file descriptors if possible */
+    if (params->socket_fd != -1)
+        guacd_connection_splice(params->fd, params->socket_fd);
+
+    else
+#endif
+
     /* Transfer data from file descriptor to socket */
     while ((length = read(params->fd, buffer, sizeof(buffer))) > 0) {
+
         if (guac_socket_write(params->socket, buffer, length))
             break;
-        guac_socket_flush(params->socket);
+
+        /* Flush only once all immediately-available data has been written,
+         * such that the socket may combine that data where possible (into
+         * full-size TLS records, for example) */
+        struct pollfd fd_poll = { .fd = params->fd, .events = POLLIN };
+        if (poll(&fd_poll, 1, 0) <= 0)
+            guac_socket_flush(params->socket);
+
     }
 
     /* Wait for write thread to die */
@@ -157,10 +253,13 @@ void* guacd_connection_io_thread(void* data) {
 }
 
 /**
- * Adds the given socket as a new user to the given process, automatically
- * reading/writing from the socket via read/write threads. The given socket,
- * parser, and any associated resources will be freed unless the user is not
- * added successfully.
+ * Adds the given socket as a new user to the given process. If the
+ * connection is not encrypted by guacd, its file descriptor is handed to the
+ * process directly, along with any data already buffered by the parser.
+ * Otherwise, or if the file descriptor cannot be handed off, data is
+ * automatically read/written from the socket via read/write threads. The
+ * given socket, parser, and any associated resources will be freed unless the
+ * user is not added successfully.
  *
  * If adding the user fails for any reason, non-zero is returned. Zero is
  * returned upon success.
@@ -176,10 +275,37 @@ void* guacd_connection_io_thread(void* data) {
  *     The socket associated with the user to be added to the existing
  *     process.
  *
+ * @param socket_fd
+ *     The file descriptor underlying the given socket, if the connection is
+ *     not encrypted by guacd, or -1 otherwise.
+ *
  * @return
  *     Zero if the user was added successfully, non-zero if an error occurred.
  */
-static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* socket) {
+static int guacd_add_user(guacd_proc* proc, guac_parser* parser,
+        guac_socket* socket, int socket_fd) {
+
+    char buffer[GUACD_FD_DATA_LENGTH + 1];
+    int length = 0;
+
+    /* Hand unencrypted connections to the process directly, such that guacd
+     * need not relay their data, provided any data already buffered fits
+     * within the same message */
+    if (socket_fd != -1) {
+
+        length = guac_parser_shift(parser, buffer, sizeof(buffer));
+
+        if (length <= GUACD_FD_DATA_LENGTH && guacd_send_fd_data(
+                    proc->fd_socket, socket_fd, buffer, length)) {
+
+            /* The process now has its own copy of the file descriptor */
+            guac_parser_free(parser);
+            guac_socket_free(socket);
+            return 0;
+
+        }
+
+    }
 
     int sockets[2];
 
@@ -201,10 +327,18 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
     /* Close our end of the process file descriptor */
     close(proc_fd);
 
+    /* Data already removed from the parser must precede any data relayed */
+    if (__write_all(user_fd, buffer, length) < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to add user: %s", strerror(errno));
+        close(user_fd);
+        return 1;
+    }
+
     guacd_connection_io_thread_params* params = malloc(sizeof(guacd_connection_io_thread_params));
     params->parser = parser;
     params->socket = socket;
     params->fd = user_fd;
+    params->socket_fd = socket_fd;
 
     /* Start I/O thread */
     pthread_t io_thread;
@@ -231,11 +365,16 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
  *     The socket associated with the new connection that must be routed to
  *     a new or existing process within the given map.
  *
+ * @param socket_fd
+ *     The file descriptor underlying the given socket, if the connection is
+ *     not encrypted by guacd, or -1 otherwise.
+ *
  * @return
  *     Zero if the connection was successfully routed, non-zero if routing has
  *     failed.
  */
-static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
+static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket,
+        int socket_fd) {
 
     guac_parser* parser = guac_parser_alloc();
 
@@ -308,7 +447,7 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
     }
 
     /* Add new user (in the case of a new process, this will be the owner */
-    int add_user_failed = guacd_add_user(proc, parser, socket);
+    int add_user_failed = guacd_add_user(proc, parser, socket, socket_fd);
 
     /* If new process was created, manage that process */
     if (new_process) {
@@ -358,6 +497,65 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
 }
 
+#ifdef HAVE_KTLS
+/**
+ * Replaces the given SSL socket with an ordinary guac_socket if all further
+ * encryption and decryption of its data has been offloaded to the kernel
+ * (kTLS), such that plaintext may be read from and written to the underlying
+ * file descriptor directly. The replacement socket uses a duplicate of that
+ * file descriptor, and the SSL socket is freed without notifying the other
+ * end of the connection, as the session itself continues within the kernel.
+ * If the kernel does not handle both directions of the connection, or
+ * OpenSSL has already decrypted data which has not yet been read, the given
+ * socket is left untouched.
+ *
+ * Once OpenSSL is gone, a plain read() of the file descriptor fails with EIO
+ * for any record other than application data, and nothing remains which
+ * could process such a record. Offload is therefore restricted to TLS 1.2
+ * with renegotiation disabled, where the only other records the peer may
+ * send are alerts, which end the connection regardless. TLS 1.3 is never
+ * offloaded, as its peers may send KeyUpdate or NewSessionTicket handshake
+ * messages at any time.
+ *
+ * @param socket
+ *     A pointer to the SSL socket to replace. If the socket is replaced, this
+ *     will be updated to point to the replacement socket.
+ *
+ * @return
+ *     The file descriptor underlying the replacement socket, or -1 if the
+ *     socket was not replaced.
+ */
+static int guacd_connection_ktls(guac_socket** socket) {
+
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) (*socket)->data;
+    SSL* ssl = data->ssl;
+
+    /* Only TLS 1.2 guarantees that no further handshake records arrive
+     * after the handshake, as renegotiation is disabled */
+    if (SSL_version(ssl) != TLS1_2_VERSION)
+        return -1;
+
+    /* Both directions must be handled by the kernel, with nothing left
+     * buffered within OpenSSL */
+    if (!BIO_get_ktls_send(SSL_get_wbio(ssl))
+            || !BIO_get_ktls_recv(SSL_get_rbio(ssl))
+            || SSL_has_pending(ssl))
+        return -1;
+
+    int fd = dup(data->fd);
+    if (fd < 0)
+        return -1;
+
+    /* Free OpenSSL's copy of the session without sending close_notify */
+    SSL_set_quiet_shutdown(ssl, 1);
+    guac_socket_free(*socket);
+
+    *socket = guac_socket_open(fd);
+    return fd;
+
+}
+#endif
+
 void* guacd_connection_thread(void* data) {
 
     guacd_connection_thread_params* params = (guacd_connection_thread_params*) data;
@@ -367,19 +565,45 @@ void* guacd_connection_thread(void* data) {
 
     guac_socket* socket;
 
+    /* Unencrypted connections may be handed to their process directly */
+    int socket_fd = connected_socket_fd;
+
 #ifdef ENABLE_SSL
 
     SSL_CTX* ssl_context = params->ssl_context;
+    SSL* ssl = params->ssl;
 
     /* If SSL chosen, use it */
-    if (ssl_context != NULL) {
-        socket = guac_socket_open_secure(ssl_context, connected_socket_fd);
+    if (ssl_context != NULL || ssl != NULL) {
+
+        /* Perform SSL/TLS handshake only if not already performed */
+        if (ssl != NULL) {
+            socket = guac_socket_open_secure_accepted(ssl);
+            if (socket == NULL)
+                SSL_free(ssl);
+        }
+        else
+            socket = guac_socket_open_secure(ssl_context, connected_socket_fd);
+
         if (socket == NULL) {
             guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to set up SSL/TLS");
             close(connected_socket_fd);
+            free(params->prefix);
             free(params);
             return NULL;
         }
+
+        /* Encrypted data must pass through guacd unless the kernel handles
+         * encryption, in which case the connection can be treated as
+         * unencrypted */
+#ifdef HAVE_KTLS
+        socket_fd = guacd_connection_ktls(&socket);
+        if (socket_fd != -1)
+            guacd_log(GUAC_LOG_DEBUG, "SSL/TLS offloaded to kernel.");
+#else
+        socket_fd = -1;
+#endif
+
     }
     else
         socket = guac_socket_open(connected_socket_fd);
@@ -389,12 +613,32 @@ void* guacd_connection_thread(void* data) {
     socket = guac_socket_open(connected_socket_fd);
 #endif
 
+    /* Data already read must be read again while routing the connection */
+    if (params->prefix_length > 0) {
+
+        guac_socket* prefix_socket = guacd_socket_prefix(socket,
+                params->prefix, params->prefix_length);
+
+        if (prefix_socket == NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to allocate socket for "
+                    "connection.");
+            guac_socket_free(socket);
+            free(params->prefix);
+            free(params);
+            return NULL;
+        }
+
+        socket = prefix_socket;
+
+    }
+
+    free(params->prefix);
+
     /* Route connection according to Guacamole, creating a new process if needed */
-    if (guacd_route_connection(map, socket))
+    if (guacd_route_connection(map, socket, socket_fd))
         guac_socket_free(socket);
 
     free(params);
     return NULL;
 
 }
-
@@ -40,10 +40,18 @@ typedef struct guacd_connection_thread_params {
 
 #ifdef ENABLE_SSL
     /**
-     * SSL context for encrypted connections to guacd. If SSL is not active,
-     * this will be NULL.
+     * SSL context for encrypted connections to guacd, if the SSL/TLS
+     * handshake has not yet been performed. If SSL is not active, or the
+     * handshake has already been performed, this will be NULL.
      */
     SSL_CTX* ssl_context;
+
+    /**
+     * The SSL connection of the newly-accepted connection, if the SSL/TLS
+     * handshake has already been performed. If SSL is not active, or the
+     * handshake has not yet been performed, this will be NULL.
+     */
+    SSL* ssl;
 #endif
 
     /**
@@ -51,6 +59,19 @@ typedef struct guacd_connection_thread_params {
      */
     int connected_socket_fd;
 
+    /**
+     * Data which has already been read from the newly-accepted connection,
+     * and must be handled before any further data is read, or NULL if no
+     * data has yet been read. This data will be freed automatically by the
+     * connection thread.
+     */
+    char* prefix;
+
+    /**
+     * The number of bytes of data within prefix.
+     */
+    int prefix_length;
+
 } guacd_connection_thread_params;
 
 /**
@@ -66,8 +87,9 @@ typedef struct guacd_connection_thread_params {
  *     shared overall map of currently-connected processes, the file
  *     descriptor associated with the newly-established connection that is to
  *     be either (1) associated with a new process or (2) passed on to an
- *     existing process, and the SSL context for the encryption surrounding
- *     that connection (if any).
+ *     existing process, the SSL context or SSL connection for the encryption
+ *     surrounding that connection (if any), and any data already read from
+ *     that connection.
  *
  * @return
  *     Always NULL.
@@ -98,6 +120,13 @@ typedef struct guacd_connection_io_thread_params {
      */
     int fd;
 
+    /**
+     * The file descriptor underlying the guacd-side guac_socket, if data can
+     * be transferred to and from that file descriptor directly (the
+     * connection is not encrypted by guacd), or -1 otherwise.
+     */
+    int socket_fd;
+
 } guacd_connection_io_thread_params;
 
 /**
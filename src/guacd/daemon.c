@@ -23,8 +23,11 @@
 #include "conf-args.h"
 #include "conf-file.h"
 #include "connection.h"
+#include "handshake.h"
 #include "log.h"
+#include "proc.h"
 #include "proc-map.h"
+#include "zygote.h"
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -45,6 +48,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #define GUACD_DEV_NULL "/dev/null"
 #define GUACD_ROOT     "/"
 
@@ -245,15 +252,179 @@ static void guacd_openssl_free_locks(int count) {
 #endif
 #endif
 
+/**
+ * Creates a new socket bound to the given address, logging any failure.
+ *
+ * @param address
+ *     The address to bind to.
+ *
+ * @param bound_address
+ *     The human-readable numeric host of the given address, for logging.
+ *
+ * @param bound_port
+ *     The human-readable numeric port of the given address, for logging.
+ *
+ * @param reuse_port
+ *     Non-zero if other sockets may be bound to the same address and port
+ *     (SO_REUSEPORT), zero otherwise.
+ *
+ * @return
+ *     The file descriptor of the newly-bound socket, or -1 if the socket
+ *     could not be bound.
+ */
+static int guacd_bind(const struct addrinfo* address,
+        const char* bound_address, const char* bound_port, int reuse_port) {
+
+    int opt_on = 1;
+
+    /* Get socket */
+    int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (socket_fd < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Error opening socket: %s", strerror(errno));
+        return -1;
+    }
+
+    /* Allow socket reuse */
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR,
+                (void*) &opt_on, sizeof(opt_on))) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to set socket options for reuse: %s",
+                strerror(errno));
+    }
+
+    /* Allow multiple listeners on the same port */
+    if (reuse_port) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT,
+                    (void*) &opt_on, sizeof(opt_on))) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to set socket options for "
+                    "multiple listeners: %s", strerror(errno));
+            close(socket_fd);
+            return -1;
+        }
+#else
+        guacd_log(GUAC_LOG_ERROR, "Multiple listeners are not supported on "
+                "this platform.");
+        close(socket_fd);
+        return -1;
+#endif
+    }
+
+    /* Attempt to bind socket to address */
+    if (bind(socket_fd, address->ai_addr, address->ai_addrlen)) {
+        guacd_log(GUAC_LOG_DEBUG, "Unable to bind socket to "
+                "host %s, port %s: %s",
+                bound_address, bound_port, strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    guacd_log(GUAC_LOG_DEBUG, "Successfully bound socket to "
+            "host %s, port %s", bound_address, bound_port);
+
+    return socket_fd;
+
+}
+
+#ifdef HAVE_EPOLL
+/**
+ * Parameters required by each acceptor thread.
+ */
+typedef struct guacd_acceptor_params {
+
+    /**
+     * The listening socket from which connections should be accepted.
+     */
+    int socket_fd;
+
+    /**
+     * The pool of threads which will perform the handshakes of accepted
+     * connections.
+     */
+    guacd_handshake_pool* pool;
+
+} guacd_acceptor_params;
+
+/**
+ * Accepts connections from a listening socket until guacd terminates, adding
+ * each connection to a pool of handshake threads. All connections waiting on
+ * the listening socket are accepted each time it becomes readable.
+ *
+ * @param data
+ *     A pointer to a guacd_acceptor_params structure describing the listening
+ *     socket and handshake pool.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_acceptor_thread(void* data) {
+
+    guacd_acceptor_params* params = (guacd_acceptor_params*) data;
+    int socket_fd = params->socket_fd;
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to create epoll instance: %s",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.fd = socket_fd
+    };
+
+    /* Accept connections only when available */
+    fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_fd, &event)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to wait for connections: %s",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+
+        if (epoll_wait(epoll_fd, &event, 1, -1) < 0) {
+            if (errno != EINTR)
+                guacd_log(GUAC_LOG_ERROR, "Unable to wait for connections: "
+                        "%s", strerror(errno));
+            continue;
+        }
+
+        /* Accept all waiting connections */
+        for (;;) {
+
+            int connected_socket_fd = accept(socket_fd, NULL, NULL);
+            if (connected_socket_fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    guacd_log(GUAC_LOG_ERROR, "Could not accept client "
+                            "connection: %s", strerror(errno));
+                break;
+            }
+
+            /* Perform handshake on handshake threads */
+            if (guacd_handshake_pool_add(params->pool, connected_socket_fd)) {
+                guacd_log(GUAC_LOG_ERROR, "Could not begin handshake: %s",
+                        strerror(errno));
+                close(connected_socket_fd);
+            }
+
+        }
+
+    }
+
+    return NULL;
+
+}
+#endif
+
 int main(int argc, char* argv[]) {
 
     /* Server */
-    int socket_fd;
+    int socket_fd = -1;
     struct addrinfo* addresses;
     struct addrinfo* current_address;
     char bound_address[1024];
     char bound_port[64];
-    int opt_on = 1;
 
     struct addrinfo hints = {
         .ai_family   = AF_UNSPEC,
@@ -261,10 +432,12 @@ int main(int argc, char* argv[]) {
         .ai_protocol = IPPROTO_TCP
     };
 
+#ifndef HAVE_EPOLL
     /* Client */
     struct sockaddr_in client_addr;
     socklen_t client_addr_len;
     int connected_socket_fd;
+#endif
 
 #ifdef ENABLE_SSL
     SSL_CTX* ssl_context = NULL;
@@ -289,6 +462,7 @@ int main(int argc, char* argv[]) {
 
     /* Init logging as early as possible */
     guacd_log_level = config->max_log_level;
+    guacd_stats_log_level = config->stats_log_level;
     openlog(GUACD_LOG_NAME, LOG_PID, LOG_DAEMON);
 
     /* Log start */
@@ -304,20 +478,6 @@ int main(int argc, char* argv[]) {
 
     }
 
-    /* Get socket */
-    socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd < 0) {
-        guacd_log(GUAC_LOG_ERROR, "Error opening socket: %s", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-
-    /* Allow socket reuse */
-    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR,
-                (void*) &opt_on, sizeof(opt_on))) {
-        guacd_log(GUAC_LOG_WARNING, "Unable to set socket options for reuse: %s",
-                strerror(errno));
-    }
-
     /* Attempt binding of each address until success */
     current_address = addresses;
     while (current_address != NULL) {
@@ -333,25 +493,12 @@ int main(int argc, char* argv[]) {
             guacd_log(GUAC_LOG_ERROR, "Unable to resolve host: %s",
                     gai_strerror(retval));
 
-        /* Attempt to bind socket to address */
-        if (bind(socket_fd,
-                    current_address->ai_addr,
-                    current_address->ai_addrlen) == 0) {
-
-            guacd_log(GUAC_LOG_DEBUG, "Successfully bound socket to "
-                    "host %s, port %s", bound_address, bound_port);
-
-            /* Done if successful bind */
+        /* Done if successful bind */
+        socket_fd = guacd_bind(current_address, bound_address, bound_port,
+                config->listeners > 1);
+        if (socket_fd >= 0)
             break;
 
-        }
-
-        /* Otherwise log information regarding bind failure */
-        else
-            guacd_log(GUAC_LOG_DEBUG, "Unable to bind socket to "
-                    "host %s, port %s: %s",
-                    bound_address, bound_port, strerror(errno));
-
         current_address = current_address->ai_next;
 
     }
@@ -362,6 +509,35 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
+#ifndef HAVE_EPOLL
+    /* Only a single listener is supported without epoll */
+    if (config->listeners > 1) {
+        guacd_log(GUAC_LOG_ERROR, "Multiple listeners are not supported on "
+                "this platform.");
+        exit(EXIT_FAILURE);
+    }
+#endif
+
+    /* Bind any additional listeners to the same address */
+    int* socket_fds = malloc(sizeof(int) * config->listeners);
+    if (socket_fds == NULL) {
+        guacd_log(GUAC_LOG_ERROR, "Could not allocate listeners: %s",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    socket_fds[0] = socket_fd;
+
+    int i;
+    for (i = 1; i < config->listeners; i++) {
+        socket_fds[i] = guacd_bind(current_address, bound_address,
+                bound_port, 1);
+        if (socket_fds[i] < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to bind additional listeners.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
 #ifdef ENABLE_SSL
     /* Init SSL if enabled */
     if (config->key_file != NULL || config->cert_file != NULL) {
@@ -380,6 +556,16 @@ int main(int argc, char* argv[]) {
         SSL_load_error_strings();
         ssl_context = SSL_CTX_new(SSLv23_server_method());
 
+#ifdef HAVE_KTLS
+        /* Offload encryption to the kernel after the handshake, if the kernel
+         * and negotiated cipher allow it, such that encrypted connections can
+         * be handed to their processes like unencrypted connections. Once
+         * offloaded, nothing remains to handle a renegotiation, so TLS 1.2
+         * renegotiation is refused outright. */
+        SSL_CTX_set_options(ssl_context,
+                SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION);
+#endif
+
         /* Load key */
         if (config->key_file != NULL) {
             guacd_log(GUAC_LOG_INFO, "Using PEM keyfile %s", config->key_file);
@@ -446,6 +632,10 @@ int main(int argc, char* argv[]) {
                 "Child processes may pile up in the process table.");
     }
 
+    /* Start zygotes for requested protocols */
+    if (config->zygote_protocols != NULL)
+        guacd_zygote_start(config->zygote_protocols, config->zygote_idle);
+
     /* Log listening status */
     guacd_log(GUAC_LOG_INFO, "Listening on host %s, port %s", bound_address, bound_port);
 
@@ -453,11 +643,58 @@ int main(int argc, char* argv[]) {
     freeaddrinfo(addresses);
 
     /* Listen for connections */
-    if (listen(socket_fd, 5) < 0) {
-        guacd_log(GUAC_LOG_ERROR, "Could not listen on socket: %s", strerror(errno));
-        return 3;
+    for (i = 0; i < config->listeners; i++) {
+        if (listen(socket_fds[i], config->listen_backlog) < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Could not listen on socket: %s", strerror(errno));
+            return 3;
+        }
     }
 
+#ifdef HAVE_EPOLL
+
+    /* Perform handshakes of all connections on a fixed pool of threads */
+    guacd_handshake_pool* pool = guacd_handshake_pool_alloc(map, GUACD_TIMEOUT);
+    if (pool == NULL)
+        exit(EXIT_FAILURE);
+
+#ifdef ENABLE_SSL
+    pool->ssl_context = ssl_context;
+#endif
+
+    guacd_acceptor_params* acceptors =
+        malloc(sizeof(guacd_acceptor_params) * config->listeners);
+    if (acceptors == NULL) {
+        guacd_log(GUAC_LOG_ERROR, "Could not allocate acceptors: %s",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Accept connections from each additional listener on its own thread */
+    for (i = 0; i < config->listeners; i++) {
+
+        acceptors[i].socket_fd = socket_fds[i];
+        acceptors[i].pool = pool;
+
+        if (i > 0) {
+            pthread_t acceptor_thread;
+            int result = pthread_create(&acceptor_thread, NULL,
+                    guacd_acceptor_thread, &(acceptors[i]));
+            if (result) {
+                guacd_log(GUAC_LOG_ERROR, "Could not create acceptor "
+                        "thread: %s", strerror(result));
+                exit(EXIT_FAILURE);
+            }
+
+            pthread_detach(acceptor_thread);
+        }
+
+    }
+
+    /* Accept connections from first listener until terminated */
+    guacd_acceptor_thread(&(acceptors[0]));
+
+#else
+
     /* Daemon loop */
     for (;;) {
 
@@ -482,9 +719,12 @@ int main(int argc, char* argv[]) {
 
         params->map = map;
         params->connected_socket_fd = connected_socket_fd;
+        params->prefix = NULL;
+        params->prefix_length = 0;
 
 #ifdef ENABLE_SSL
         params->ssl_context = ssl_context;
+        params->ssl = NULL;
 #endif
 
         /* Spawn thread to handle connection */
@@ -493,12 +733,18 @@ int main(int argc, char* argv[]) {
 
     }
 
-    /* Close socket */
-    if (close(socket_fd) < 0) {
-        guacd_log(GUAC_LOG_ERROR, "Could not close socket: %s", strerror(errno));
-        return 3;
+#endif
+
+    /* Close sockets */
+    for (i = 0; i < config->listeners; i++) {
+        if (close(socket_fds[i]) < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Could not close socket: %s", strerror(errno));
+            return 3;
+        }
     }
 
+    free(socket_fds);
+
 #ifdef ENABLE_SSL
     if (ssl_context != NULL) {
 #ifdef OPENSSL_REQUIRES_THREADING_CALLBACKS
@@ -0,0 +1,715 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "connection.h"
+#include "handshake.h"
+#include "log.h"
+
+#include <guacamole/error.h>
+#include <guacamole/parser-constants.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/unicode.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+
+/**
+ * The result of advancing the handshake of a connection.
+ */
+typedef enum guacd_handshake_result {
+
+    /**
+     * The handshake cannot advance further until the connection is ready
+     * for reading or writing.
+     */
+    GUACD_HANDSHAKE_WAITING,
+
+    /**
+     * The handshake has completed, and the connection can be routed.
+     */
+    GUACD_HANDSHAKE_COMPLETE,
+
+    /**
+     * The handshake has failed, and the connection must be closed. The reason
+     * for failure is stored in guac_error.
+     */
+    GUACD_HANDSHAKE_FAILED
+
+} guacd_handshake_result;
+
+/**
+ * Tests whether the given data contains a complete Guacamole instruction,
+ * beginning at the start of that data. Only the lengths of the elements of
+ * that instruction are parsed. The instruction itself is parsed later with
+ * a guac_parser.
+ *
+ * @param data
+ *     The data to test.
+ *
+ * @param length
+ *     The number of bytes of data.
+ *
+ * @return
+ *     A positive value if the data contains a complete instruction, zero if
+ *     more data is needed, or a negative value if the data is not a valid
+ *     Guacamole instruction.
+ */
+static int guacd_handshake_scan(const char* data, int length) {
+
+    int i = 0;
+
+    while (i < length) {
+
+        /* Parse element length */
+        int element_length = 0;
+        while (i < length && data[i] >= '0' && data[i] <= '9') {
+            element_length = element_length * 10 + data[i++] - '0';
+            if (element_length > GUAC_INSTRUCTION_MAX_LENGTH)
+                return -1;
+        }
+
+        if (i == length)
+            return 0;
+
+        if (data[i++] != '.')
+            return -1;
+
+        /* Skip element content, the length of which is in characters */
+        while (element_length > 0) {
+
+            if (i >= length)
+                return 0;
+
+            i += guac_utf8_charsize((unsigned char) data[i]);
+            element_length--;
+
+        }
+
+        if (i >= length)
+            return 0;
+
+        /* Instruction is complete at the first semicolon */
+        if (data[i] == ';')
+            return 1;
+
+        if (data[i++] != ',')
+            return -1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Waits for the connection of the given handshake to become ready for
+ * reading or writing, replacing any previous wait.
+ *
+ * @param worker
+ *     The worker handling the given handshake.
+ *
+ * @param handshake
+ *     The handshake whose connection should be waited for.
+ *
+ * @param events
+ *     The epoll events to wait for, such as EPOLLIN or EPOLLOUT.
+ *
+ * @return
+ *     GUACD_HANDSHAKE_WAITING if the wait was set up successfully,
+ *     GUACD_HANDSHAKE_FAILED otherwise.
+ */
+static guacd_handshake_result guacd_handshake_wait(
+        guacd_handshake_worker* worker, guacd_handshake* handshake,
+        int events) {
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = handshake
+    };
+
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, handshake->fd, &event)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to wait for connection";
+        return GUACD_HANDSHAKE_FAILED;
+    }
+
+    return GUACD_HANDSHAKE_WAITING;
+
+}
+
+#ifdef ENABLE_SSL
+/**
+ * Handles the result of an SSL_accept() or SSL_read() which did not succeed,
+ * waiting for the connection to become ready if OpenSSL requires it.
+ *
+ * @param worker
+ *     The worker handling the given handshake.
+ *
+ * @param handshake
+ *     The handshake whose SSL connection was used.
+ *
+ * @param retval
+ *     The value returned by SSL_accept() or SSL_read().
+ *
+ * @return
+ *     GUACD_HANDSHAKE_WAITING if the operation should be retried once the
+ *     connection is ready, GUACD_HANDSHAKE_FAILED otherwise.
+ */
+static guacd_handshake_result guacd_handshake_ssl_wait(
+        guacd_handshake_worker* worker, guacd_handshake* handshake,
+        int retval) {
+
+    switch (SSL_get_error(handshake->ssl, retval)) {
+
+        case SSL_ERROR_WANT_READ:
+            return guacd_handshake_wait(worker, handshake, EPOLLIN);
+
+        case SSL_ERROR_WANT_WRITE:
+            return guacd_handshake_wait(worker, handshake, EPOLLOUT);
+
+        case SSL_ERROR_ZERO_RETURN:
+            guac_error = GUAC_STATUS_CLOSED;
+            guac_error_message = "Connection closed during handshake";
+            return GUACD_HANDSHAKE_FAILED;
+
+    }
+
+    guac_error = GUAC_STATUS_INTERNAL_ERROR;
+    guac_error_message = "SSL/TLS error during handshake";
+    return GUACD_HANDSHAKE_FAILED;
+
+}
+#endif
+
+/**
+ * Advances the handshake of the given connection as far as possible without
+ * blocking.
+ *
+ * @param worker
+ *     The worker handling the given handshake.
+ *
+ * @param handshake
+ *     The handshake to advance.
+ *
+ * @return
+ *     The result of advancing the handshake.
+ */
+static guacd_handshake_result guacd_handshake_continue(
+        guacd_handshake_worker* worker, guacd_handshake* handshake) {
+
+#ifdef ENABLE_SSL
+    /* Complete SSL/TLS handshake first, if SSL is active */
+    if (handshake->state == GUACD_HANDSHAKE_TLS) {
+
+        int retval = SSL_accept(handshake->ssl);
+        if (retval <= 0)
+            return guacd_handshake_ssl_wait(worker, handshake, retval);
+
+        handshake->state = GUACD_HANDSHAKE_SELECT;
+
+    }
+#endif
+
+    /* Read until the "select" instruction is complete */
+    while (handshake->length < GUACD_HANDSHAKE_BUFFER_SIZE) {
+
+        char* buffer = handshake->data + handshake->length;
+        int available = GUACD_HANDSHAKE_BUFFER_SIZE - handshake->length;
+        int retval;
+
+#ifdef ENABLE_SSL
+        if (handshake->ssl != NULL) {
+            retval = SSL_read(handshake->ssl, buffer, available);
+            if (retval <= 0)
+                return guacd_handshake_ssl_wait(worker, handshake, retval);
+        }
+        else
+#endif
+        retval = read(handshake->fd, buffer, available);
+
+        /* Wait for further data if none is available */
+        if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return guacd_handshake_wait(worker, handshake, EPOLLIN);
+
+        if (retval < 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error reading data from socket";
+            return GUACD_HANDSHAKE_FAILED;
+        }
+
+        if (retval == 0) {
+            guac_error = GUAC_STATUS_CLOSED;
+            guac_error_message = "Connection closed during handshake";
+            return GUACD_HANDSHAKE_FAILED;
+        }
+
+        handshake->length += retval;
+
+        /* Route connection only once "select" has been received */
+        int complete = guacd_handshake_scan(handshake->data,
+                handshake->length);
+
+        if (complete > 0)
+            return GUACD_HANDSHAKE_COMPLETE;
+
+        if (complete < 0) {
+            guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+            guac_error_message = "Instruction parse error";
+            return GUACD_HANDSHAKE_FAILED;
+        }
+
+    }
+
+    guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+    guac_error_message = "Instruction too long";
+    return GUACD_HANDSHAKE_FAILED;
+
+}
+
+/**
+ * Removes the given handshake from the given worker, freeing the handshake.
+ * The connection of the handshake is closed unless the handshake completed,
+ * in which case the connection is handed to a new connection thread.
+ *
+ * @param worker
+ *     The worker handling the given handshake.
+ *
+ * @param handshake
+ *     The handshake to remove.
+ *
+ * @param complete
+ *     Non-zero if the handshake completed successfully, zero otherwise.
+ */
+static void guacd_handshake_remove(guacd_handshake_worker* worker,
+        guacd_handshake* handshake, int complete) {
+
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, handshake->fd, NULL);
+
+    /* Remove from list of handshakes in progress */
+    if (handshake->prev != NULL)
+        handshake->prev->next = handshake->next;
+    else
+        worker->handshakes = handshake->next;
+
+    if (handshake->next != NULL)
+        handshake->next->prev = handshake->prev;
+
+    guacd_connection_thread_params* params = NULL;
+    if (complete) {
+
+        params = malloc(sizeof(guacd_connection_thread_params));
+        char* prefix = malloc(handshake->length);
+
+        if (params == NULL || prefix == NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Could not create connection thread: "
+                    "%s", strerror(errno));
+            free(params);
+            free(prefix);
+            params = NULL;
+        }
+
+        else {
+
+            /* The connection thread uses ordinary blocking I/O */
+            fcntl(handshake->fd, F_SETFL,
+                    fcntl(handshake->fd, F_GETFL) & ~O_NONBLOCK);
+
+            memcpy(prefix, handshake->data, handshake->length);
+
+            params->map = worker->pool->map;
+            params->connected_socket_fd = handshake->fd;
+            params->prefix = prefix;
+            params->prefix_length = handshake->length;
+
+#ifdef ENABLE_SSL
+            params->ssl_context = NULL;
+            params->ssl = handshake->ssl;
+#endif
+
+            /* Spawn thread to route connection */
+            pthread_t child_thread;
+            if (pthread_create(&child_thread, NULL, guacd_connection_thread,
+                        params)) {
+                guacd_log(GUAC_LOG_ERROR, "Could not create connection "
+                        "thread.");
+                free(prefix);
+                free(params);
+                params = NULL;
+            }
+            else
+                pthread_detach(child_thread);
+
+        }
+
+    }
+
+    /* Close connection if it was not handed to a connection thread */
+    if (params == NULL) {
+#ifdef ENABLE_SSL
+        if (handshake->ssl != NULL)
+            SSL_free(handshake->ssl);
+#endif
+        close(handshake->fd);
+    }
+
+    free(handshake);
+
+}
+
+/**
+ * Begins the handshake of the given newly-accepted connection on the given
+ * worker. If the handshake cannot be begun, the connection is closed.
+ *
+ * @param worker
+ *     The worker which should handle the handshake.
+ *
+ * @param fd
+ *     The file descriptor of the newly-accepted connection.
+ *
+ * @return
+ *     The newly-allocated handshake of the given connection, or NULL if the
+ *     handshake could not be begun.
+ */
+static guacd_handshake* guacd_handshake_begin(guacd_handshake_worker* worker,
+        int fd) {
+
+    guacd_handshake* handshake = malloc(sizeof(guacd_handshake));
+    if (handshake == NULL) {
+        guacd_log(GUAC_LOG_ERROR, "Could not allocate handshake: %s",
+                strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    handshake->fd = fd;
+    handshake->state = GUACD_HANDSHAKE_SELECT;
+    handshake->deadline = guac_timestamp_current() + worker->pool->timeout;
+    handshake->length = 0;
+
+#ifdef ENABLE_SSL
+    handshake->ssl = NULL;
+
+    /* Begin with SSL/TLS handshake if SSL is active */
+    SSL_CTX* ssl_context = worker->pool->ssl_context;
+    if (ssl_context != NULL) {
+
+        handshake->ssl = SSL_new(ssl_context);
+        if (handshake->ssl == NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to set up SSL/TLS");
+            close(fd);
+            free(handshake);
+            return NULL;
+        }
+
+        SSL_set_fd(handshake->ssl, fd);
+        handshake->state = GUACD_HANDSHAKE_TLS;
+
+    }
+#endif
+
+    /* Wait for data on connection without blocking */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = handshake
+    };
+
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to wait for connection: %s",
+                strerror(errno));
+#ifdef ENABLE_SSL
+        if (handshake->ssl != NULL)
+            SSL_free(handshake->ssl);
+#endif
+        close(fd);
+        free(handshake);
+        return NULL;
+    }
+
+    /* Add to list of handshakes in progress */
+    handshake->prev = NULL;
+    handshake->next = worker->handshakes;
+    if (worker->handshakes != NULL)
+        worker->handshakes->prev = handshake;
+    worker->handshakes = handshake;
+
+    return handshake;
+
+}
+
+/**
+ * Handles an event for the given handshake, advancing that handshake as far
+ * as possible and removing it from the given worker if it has completed or
+ * failed.
+ *
+ * @param worker
+ *     The worker handling the given handshake.
+ *
+ * @param handshake
+ *     The handshake whose connection is ready.
+ */
+static void guacd_handshake_handle(guacd_handshake_worker* worker,
+        guacd_handshake* handshake) {
+
+    /* Reset guac_error */
+    guac_error = GUAC_STATUS_SUCCESS;
+    guac_error_message = NULL;
+
+    switch (guacd_handshake_continue(worker, handshake)) {
+
+        case GUACD_HANDSHAKE_WAITING:
+            break;
+
+        case GUACD_HANDSHAKE_COMPLETE:
+            guacd_handshake_remove(worker, handshake, 1);
+            break;
+
+        case GUACD_HANDSHAKE_FAILED:
+            guacd_log_handshake_failure();
+            guacd_log_guac_error(GUAC_LOG_DEBUG, "Error during handshake");
+            guacd_handshake_remove(worker, handshake, 0);
+            break;
+
+    }
+
+}
+
+/**
+ * Closes all connections of the given worker whose handshakes have not
+ * completed in time, returning the number of milliseconds until the next
+ * handshake will time out.
+ *
+ * @param worker
+ *     The worker whose handshakes should be checked.
+ *
+ * @return
+ *     The number of milliseconds until the next handshake will time out, or
+ *     -1 if the worker has no handshakes in progress.
+ */
+static int guacd_handshake_expire(guacd_handshake_worker* worker) {
+
+    guac_timestamp now = guac_timestamp_current();
+    int timeout = -1;
+
+    guacd_handshake* current = worker->handshakes;
+    while (current != NULL) {
+
+        guacd_handshake* next = current->next;
+
+        /* Close connections which have timed out */
+        if (current->deadline <= now) {
+            guac_error = GUAC_STATUS_TIMEOUT;
+            guac_error_message = "Timeout while waiting for \"select\"";
+            guacd_log_handshake_failure();
+            guacd_handshake_remove(worker, current, 0);
+        }
+
+        /* Otherwise, wait no longer than the soonest timeout */
+        else if (timeout == -1 || current->deadline - now < timeout)
+            timeout = current->deadline - now;
+
+        current = next;
+
+    }
+
+    return timeout;
+
+}
+
+/**
+ * Accepts new connections from the queue of the given worker, beginning
+ * their handshakes.
+ *
+ * @param worker
+ *     The worker whose queue should be read.
+ */
+static void guacd_handshake_dequeue(guacd_handshake_worker* worker) {
+
+    int fds[GUACD_HANDSHAKE_EVENTS];
+    int length;
+
+    /* File descriptors are written atomically, and so are read whole */
+    while ((length = read(worker->queue[0], fds, sizeof(fds))) > 0) {
+
+        int i;
+        for (i = 0; i < length / (int) sizeof(int); i++) {
+
+            /* Data may already be available */
+            guacd_handshake* handshake = guacd_handshake_begin(worker, fds[i]);
+            if (handshake != NULL)
+                guacd_handshake_handle(worker, handshake);
+
+        }
+
+    }
+
+}
+
+/**
+ * Performs the handshakes of all connections sent to the given worker, until
+ * guacd terminates.
+ *
+ * @param data
+ *     The guacd_handshake_worker to run.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_handshake_worker_thread(void* data) {
+
+    guacd_handshake_worker* worker = (guacd_handshake_worker*) data;
+    struct epoll_event events[GUACD_HANDSHAKE_EVENTS];
+
+    for (;;) {
+
+        int timeout = guacd_handshake_expire(worker);
+
+        int count = epoll_wait(worker->epoll_fd, events,
+                GUACD_HANDSHAKE_EVENTS, timeout);
+
+        if (count < 0 && errno != EINTR) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to wait for connections: %s",
+                    strerror(errno));
+            break;
+        }
+
+        int i;
+        for (i = 0; i < count; i++) {
+
+            /* New connections are queued along the pipe, which has no
+             * associated handshake */
+            if (events[i].data.ptr == NULL)
+                guacd_handshake_dequeue(worker);
+            else
+                guacd_handshake_handle(worker, events[i].data.ptr);
+
+        }
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Initializes the given worker, starting its thread.
+ *
+ * @param pool
+ *     The pool containing the given worker.
+ *
+ * @param worker
+ *     The worker to initialize.
+ *
+ * @return
+ *     Zero if the worker was started, non-zero otherwise.
+ */
+static int guacd_handshake_worker_init(guacd_handshake_pool* pool,
+        guacd_handshake_worker* worker) {
+
+    worker->pool = pool;
+    worker->handshakes = NULL;
+
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd < 0)
+        return 1;
+
+    if (pipe(worker->queue)) {
+        close(worker->epoll_fd);
+        return 1;
+    }
+
+    /* Never block while reading the queue */
+    fcntl(worker->queue[0], F_SETFL, O_NONBLOCK);
+    fcntl(worker->queue[0], F_SETFD, FD_CLOEXEC);
+    fcntl(worker->queue[1], F_SETFD, FD_CLOEXEC);
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = NULL
+    };
+
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->queue[0], &event)
+            || pthread_create(&(worker->thread), NULL,
+                guacd_handshake_worker_thread, worker)) {
+        close(worker->queue[0]);
+        close(worker->queue[1]);
+        close(worker->epoll_fd);
+        return 1;
+    }
+
+    pthread_detach(worker->thread);
+    return 0;
+
+}
+
+guacd_handshake_pool* guacd_handshake_pool_alloc(guacd_proc_map* map,
+        int timeout) {
+
+    guacd_handshake_pool* pool = malloc(sizeof(guacd_handshake_pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->map = map;
+    pool->timeout = timeout;
+    pool->next_worker = 0;
+
+#ifdef ENABLE_SSL
+    pool->ssl_context = NULL;
+#endif
+
+    int i;
+    for (i = 0; i < GUACD_HANDSHAKE_THREADS; i++) {
+        if (guacd_handshake_worker_init(pool, &(pool->workers[i]))) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to start handshake thread: %s",
+                    strerror(errno));
+            return NULL;
+        }
+    }
+
+    return pool;
+
+}
+
+int guacd_handshake_pool_add(guacd_handshake_pool* pool, int fd) {
+
+    /* Distribute connections between workers evenly */
+    unsigned int index = __atomic_fetch_add(&(pool->next_worker), 1,
+            __ATOMIC_RELAXED) % GUACD_HANDSHAKE_THREADS;
+
+    guacd_handshake_worker* worker = &(pool->workers[index]);
+
+    if (write(worker->queue[1], &fd, sizeof(fd)) != sizeof(fd))
+        return 1;
+
+    return 0;
+
+}
+
+#endif
+
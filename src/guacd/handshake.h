@@ -0,0 +1,240 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_HANDSHAKE_H
+#define GUACD_HANDSHAKE_H
+
+#include "config.h"
+
+#include "proc-map.h"
+
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+
+#ifdef ENABLE_SSL
+#include <openssl/ssl.h>
+#endif
+
+/**
+ * The number of threads performing the handshakes of new connections. Each
+ * thread handles any number of connections at once.
+ */
+#define GUACD_HANDSHAKE_THREADS 4
+
+/**
+ * The maximum number of bytes which may be received along a new connection
+ * before its "select" instruction is complete. This must not exceed
+ * GUAC_INSTRUCTION_BUFFER_SIZE, such that all data received during the
+ * handshake can be read by a single guac_parser_read().
+ */
+#define GUACD_HANDSHAKE_BUFFER_SIZE 8192
+
+/**
+ * The maximum number of events handled by each handshake thread at once.
+ */
+#define GUACD_HANDSHAKE_EVENTS 64
+
+/**
+ * The stages of the handshake of a new connection, in the order that they
+ * occur.
+ */
+typedef enum guacd_handshake_state {
+
+    /**
+     * The SSL/TLS handshake is in progress.
+     */
+    GUACD_HANDSHAKE_TLS,
+
+    /**
+     * Data is being read until the "select" instruction is complete.
+     */
+    GUACD_HANDSHAKE_SELECT
+
+} guacd_handshake_state;
+
+/**
+ * A new connection whose handshake is in progress.
+ */
+typedef struct guacd_handshake {
+
+    /**
+     * The file descriptor of the connection.
+     */
+    int fd;
+
+    /**
+     * The current stage of the handshake.
+     */
+    guacd_handshake_state state;
+
+#ifdef ENABLE_SSL
+    /**
+     * The SSL connection, or NULL if SSL is not active.
+     */
+    SSL* ssl;
+#endif
+
+    /**
+     * The time after which the handshake will be abandoned and the connection
+     * closed, if it has not yet completed.
+     */
+    guac_timestamp deadline;
+
+    /**
+     * The (unencrypted) data received thus far.
+     */
+    char data[GUACD_HANDSHAKE_BUFFER_SIZE];
+
+    /**
+     * The number of bytes of data received thus far.
+     */
+    int length;
+
+    /**
+     * The previous handshake handled by the same thread, or NULL if this is
+     * the first.
+     */
+    struct guacd_handshake* prev;
+
+    /**
+     * The next handshake handled by the same thread, or NULL if this is the
+     * last.
+     */
+    struct guacd_handshake* next;
+
+} guacd_handshake;
+
+typedef struct guacd_handshake_pool guacd_handshake_pool;
+
+/**
+ * A thread which performs the handshakes of new connections, waiting for
+ * all such connections at once using epoll.
+ */
+typedef struct guacd_handshake_worker {
+
+    /**
+     * The pool containing this worker.
+     */
+    guacd_handshake_pool* pool;
+
+    /**
+     * The epoll instance used to wait for new connections and for data along
+     * connections whose handshakes are in progress.
+     */
+    int epoll_fd;
+
+    /**
+     * The pipe along which the file descriptors of new connections are sent
+     * to this worker. File descriptors are written to the second element and
+     * read from the first.
+     */
+    int queue[2];
+
+    /**
+     * All connections whose handshakes are in progress on this worker, or
+     * NULL if there are none.
+     */
+    guacd_handshake* handshakes;
+
+    /**
+     * The thread of this worker.
+     */
+    pthread_t thread;
+
+} guacd_handshake_worker;
+
+/**
+ * A fixed pool of threads performing the handshakes of new connections.
+ * Each connection is routed by guacd_connection_thread() only once its
+ * "select" instruction has been received in full.
+ */
+struct guacd_handshake_pool {
+
+    /**
+     * The shared map of all connected clients.
+     */
+    guacd_proc_map* map;
+
+#ifdef ENABLE_SSL
+    /**
+     * SSL context for encrypted connections to guacd. If SSL is not active,
+     * this will be NULL.
+     */
+    SSL_CTX* ssl_context;
+#endif
+
+    /**
+     * The number of milliseconds that each connection may take to complete
+     * its handshake.
+     */
+    int timeout;
+
+    /**
+     * The index of the worker which will receive the next connection.
+     */
+    unsigned int next_worker;
+
+    /**
+     * All workers of this pool.
+     */
+    guacd_handshake_worker workers[GUACD_HANDSHAKE_THREADS];
+
+};
+
+/**
+ * Allocates a new pool of threads which will perform the handshakes of
+ * new connections, starting all threads of that pool. If SSL is active, the
+ * ssl_context of the returned pool must be set before any connections are
+ * added.
+ *
+ * @param map
+ *     The shared map of all connected clients, to which connections will be
+ *     routed once their handshakes complete.
+ *
+ * @param timeout
+ *     The number of milliseconds that each connection may take to complete
+ *     its handshake.
+ *
+ * @return
+ *     A newly-allocated pool of running handshake threads, or NULL if the
+ *     pool could not be created.
+ */
+guacd_handshake_pool* guacd_handshake_pool_alloc(guacd_proc_map* map,
+        int timeout);
+
+/**
+ * Adds the given newly-accepted connection to the given pool, such that its
+ * handshake is performed by one of the threads of that pool. The connection
+ * will be closed automatically if its handshake fails or times out.
+ *
+ * @param pool
+ *     The pool to add the connection to.
+ *
+ * @param fd
+ *     The file descriptor of the newly-accepted connection.
+ *
+ * @return
+ *     Zero if the connection was added, non-zero otherwise, in which case
+ *     the connection has not been closed.
+ */
+int guacd_handshake_pool_add(guacd_handshake_pool* pool, int fd);
+
+#endif
+
@@ -30,6 +30,8 @@
 
 int guacd_log_level = GUAC_LOG_INFO;
 
+int guacd_stats_log_level = -1;
+
 void vguacd_log(guac_client_log_level level, const char* format,
         va_list args) {
 
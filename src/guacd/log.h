@@ -31,6 +31,12 @@
  */
 extern int guacd_log_level;
 
+/**
+ * The level at which the protocol statistics of each connection are logged
+ * when that connection ends, or -1 if statistics are not collected.
+ */
+extern int guacd_stats_log_level;
+
 /**
  * The string to prepend to all log messages.
  */
@@ -32,16 +32,31 @@
 #include <unistd.h>
 
 int guacd_send_fd(int sock, int fd) {
+    return guacd_send_fd_data(sock, fd, NULL, 0);
+}
+
+int guacd_recv_fd(int sock) {
+
+    char data[GUACD_FD_DATA_LENGTH];
+    int length;
+
+    return guacd_recv_fd_data(sock, data, &length);
+
+}
+
+int guacd_send_fd_data(int sock, int fd, const void* data, int length) {
 
     struct msghdr message = {0};
     char message_data[] = {'G'};
 
-    /* Assign data buffer */
-    struct iovec io_vector[1];
+    /* Assign data buffers */
+    struct iovec io_vector[2];
     io_vector[0].iov_base = message_data;
     io_vector[0].iov_len  = sizeof(message_data);
+    io_vector[1].iov_base = (void*) data;
+    io_vector[1].iov_len  = length;
     message.msg_iov    = io_vector;
-    message.msg_iovlen = 1;
+    message.msg_iovlen = 2;
 
     /* Assign ancillary data buffer */
     char buffer[CMSG_SPACE(sizeof(fd))] = {0};
@@ -58,23 +73,26 @@ int guacd_send_fd(int sock, int fd) {
     memcpy(CMSG_DATA(control), &fd, sizeof(fd));
 
     /* Send file descriptor */
-    return (sendmsg(sock, &message, 0) == sizeof(message_data));
+    return (sendmsg(sock, &message, 0)
+            == (ssize_t) (sizeof(message_data) + length));
 
 }
 
-int guacd_recv_fd(int sock) {
+int guacd_recv_fd_data(int sock, void* data, int* length) {
 
     int fd;
 
     struct msghdr message = {0};
     char message_data[1];
 
-    /* Assign data buffer */
-    struct iovec io_vector[1];
+    /* Assign data buffers */
+    struct iovec io_vector[2];
     io_vector[0].iov_base = message_data;
     io_vector[0].iov_len  = sizeof(message_data);
+    io_vector[1].iov_base = data;
+    io_vector[1].iov_len  = GUACD_FD_DATA_LENGTH;
     message.msg_iov    = io_vector;
-    message.msg_iovlen = 1;
+    message.msg_iovlen = 2;
 
 
     /* Assign ancillary data buffer */
@@ -83,7 +101,8 @@ int guacd_recv_fd(int sock) {
     message.msg_controllen = sizeof(buffer);
 
     /* Receive file descriptor */
-    if (recvmsg(sock, &message, 0) == sizeof(message_data)) {
+    ssize_t received = recvmsg(sock, &message, 0);
+    if (received >= (ssize_t) sizeof(message_data)) {
 
         /* Validate payload */
         if (message_data[0] != 'G') {
@@ -91,6 +110,8 @@ int guacd_recv_fd(int sock) {
             return -1;
         }
 
+        *length = received - sizeof(message_data);
+
         /* Iterate control headers, looking for the sent file descriptor */
         struct cmsghdr* control;
         for (control = CMSG_FIRSTHDR(&message); control != NULL; control = CMSG_NXTHDR(&message, control)) {
@@ -22,6 +22,12 @@
 
 #include "config.h"
 
+/**
+ * The maximum number of bytes of data which may accompany a file descriptor
+ * sent with guacd_send_fd_data().
+ */
+#define GUACD_FD_DATA_LENGTH 8192
+
 /**
  * Sends the given file descriptor along the given socket, allowing the
  * receiving process to use that file descriptor normally. Returns non-zero on
@@ -55,5 +61,55 @@ int guacd_send_fd(int sock, int fd);
  */
 int guacd_recv_fd(int sock);
 
+/**
+ * Sends the given file descriptor along the given socket, as
+ * guacd_send_fd() does, together with the given data. The data is delivered
+ * in the same message as the file descriptor, and must be received with
+ * guacd_recv_fd_data().
+ *
+ * @param sock
+ *     The file descriptor of an open UNIX domain socket along which the file
+ *     descriptor specified by fd should be sent.
+ *
+ * @param fd
+ *     The file descriptor to send along the given UNIX domain socket.
+ *
+ * @param data
+ *     The data to send with the file descriptor.
+ *
+ * @param length
+ *     The number of bytes of data to send, which may be zero and must not
+ *     exceed GUACD_FD_DATA_LENGTH.
+ *
+ * @return
+ *     Non-zero if the send operation succeeded, zero on error.
+ */
+int guacd_send_fd_data(int sock, int fd, const void* data, int length);
+
+/**
+ * Waits for a file descriptor on the given socket, returning the received file
+ * descriptor and storing any data sent along with that file descriptor. The
+ * file descriptor must have been sent via guacd_send_fd() or
+ * guacd_send_fd_data(). If an error occurs, -1 is returned, and errno will be
+ * set appropriately.
+ *
+ * @param sock
+ *     The file descriptor of an open UNIX domain socket along which the file
+ *     descriptor will be sent.
+ *
+ * @param data
+ *     A buffer of at least GUACD_FD_DATA_LENGTH bytes which will receive the
+ *     data sent with the file descriptor.
+ *
+ * @param length
+ *     Pointer to an int which will be set to the number of bytes of data
+ *     received.
+ *
+ * @return
+ *     The received file descriptor, or -1 if an error occurs preventing
+ *     receipt of the file descriptor.
+ */
+int guacd_recv_fd_data(int sock, void* data, int* length);
+
 #endif
 
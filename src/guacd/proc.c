@@ -23,6 +23,8 @@
 #include "move-fd.h"
 #include "proc.h"
 #include "proc-map.h"
+#include "socket-prefix.h"
+#include "zygote.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
@@ -63,6 +65,17 @@ typedef struct guacd_user_thread_params {
      */
     int owner;
 
+    /**
+     * Data already read by guacd from the joining user's connection, which
+     * must be read before any further data from that connection.
+     */
+    char data[GUACD_FD_DATA_LENGTH];
+
+    /**
+     * The number of bytes within data.
+     */
+    int length;
+
 } guacd_user_thread_params;
 
 /**
@@ -88,6 +101,22 @@ static void* guacd_user_thread(void* data) {
     if (socket == NULL)
         return NULL;
 
+    /* Read any data already read by guacd before the rest of the connection */
+    if (params->length > 0) {
+
+        guac_socket* prefixed = guacd_socket_prefix(socket, params->data,
+                params->length);
+
+        if (prefixed == NULL) {
+            guac_socket_free(socket);
+            free(params);
+            return NULL;
+        }
+
+        socket = prefixed;
+
+    }
+
     /* Create skeleton user */
     guac_user* user = guac_user_alloc();
     user->socket = socket;
@@ -127,13 +156,23 @@ static void* guacd_user_thread(void* data) {
  * @param owner
  *     Non-zero if the user is the owner of the connection being joined (they
  *     are the first user to join), or zero otherwise.
+ *
+ * @param data
+ *     Data already read by guacd from the user's network connection, which
+ *     must be handled before any further data from that connection.
+ *
+ * @param length
+ *     The number of bytes of data already read by guacd, which may be zero.
  */
-static void guacd_proc_add_user(guacd_proc* proc, int fd, int owner) {
+static void guacd_proc_add_user(guacd_proc* proc, int fd, int owner,
+        const char* data, int length) {
 
     guacd_user_thread_params* params = malloc(sizeof(guacd_user_thread_params));
     params->proc = proc;
     params->fd = fd;
     params->owner = owner;
+    params->length = length;
+    memcpy(params->data, data, length);
 
     /* Start user thread */
     pthread_t user_thread;
@@ -287,34 +326,10 @@ static int guacd_timed_client_free(guac_client* client, int timeout) {
 
 }
 
-/**
- * Starts protocol-specific handling on the given process by loading the client
- * plugin for that protocol. This function does NOT return. It initializes the
- * process with protocol-specific handlers and then runs until the guacd_proc's
- * fd_socket is closed, adding any file descriptors received along fd_socket as
- * new users.
- *
- * @param proc
- *     The process that any new users received along fd_socket should be added
- *     to (after the process has been initialized for the given protocol).
- *
- * @param protocol
- *     The protocol to initialize the given process for.
- */
-static void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
-
-    int result = 1;
-   
-    /* Set process group ID to match PID */ 
-    if (setpgid(0, 0)) {
-        guacd_log(GUAC_LOG_ERROR, "Cannot set PGID for connection process: %s",
-                strerror(errno));
-        goto cleanup_process;
-    }
+int guacd_proc_load_plugin(guacd_proc* proc, const char* protocol) {
 
     /* Init client for selected protocol */
-    guac_client* client = proc->client;
-    if (guac_client_load_plugin(client, protocol)) {
+    if (guac_client_load_plugin(proc->client, protocol)) {
 
         /* Log error */
         if (guac_error == GUAC_STATUS_NOT_FOUND)
@@ -324,17 +339,41 @@ static void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
             guacd_log_guac_error(GUAC_LOG_ERROR,
                     "Unable to load client plugin");
 
-        goto cleanup_client;
+        return 1;
     }
 
+    return 0;
+
+}
+
+void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
+
+    int result = 1;
+   
+    /* Set process group ID to match PID */ 
+    if (setpgid(0, 0)) {
+        guacd_log(GUAC_LOG_ERROR, "Cannot set PGID for connection process: %s",
+                strerror(errno));
+        goto cleanup_process;
+    }
+
+    /* Init client for selected protocol, if not already initialized */
+    guac_client* client = proc->client;
+    if (protocol != NULL && guacd_proc_load_plugin(proc, protocol))
+        goto cleanup_client;
+
     /* The first file descriptor is the owner */
     int owner = 1;
 
+    char data[GUACD_FD_DATA_LENGTH];
+    int length;
+
     /* Add each received file descriptor as a new user */
     int received_fd;
-    while ((received_fd = guacd_recv_fd(proc->fd_socket)) != -1) {
+    while ((received_fd = guacd_recv_fd_data(proc->fd_socket,
+                    data, &length)) != -1) {
 
-        guacd_proc_add_user(proc, received_fd, owner);
+        guacd_proc_add_user(proc, received_fd, owner, data, length);
 
         /* Future file descriptors are not owners */
         owner = 0;
@@ -419,6 +458,43 @@ guacd_proc* guacd_create_proc(const char* protocol) {
     /* Init logging */
     proc->client->log_handler = guacd_client_log;
 
+    /* Collect protocol statistics if requested */
+    if (guacd_stats_log_level >= 0
+            && guac_client_enable_stats(proc->client, guacd_stats_log_level))
+        guacd_log_guac_error(GUAC_LOG_WARNING,
+                "Unable to enable protocol statistics");
+
+    /* Use a process forked by the zygote of this protocol, if any */
+    pid_t zygote_pid = guacd_zygote_spawn(protocol,
+            proc->client->connection_id, child_socket, parent_socket);
+
+    if (zygote_pid > 0) {
+        proc->pid = zygote_pid;
+        proc->fd_socket = child_socket;
+        close(parent_socket);
+        return proc;
+    }
+
+    /* Replace sockets which may have been received by a process which
+     * failed to report to guacd */
+    if (zygote_pid < 0) {
+
+        shutdown(child_socket, SHUT_RDWR);
+        close(parent_socket);
+        close(child_socket);
+
+        if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Error opening socket pair: %s", strerror(errno));
+            guac_client_free(proc->client);
+            free(proc);
+            return NULL;
+        }
+
+        parent_socket = sockets[0];
+        child_socket = sockets[1];
+
+    }
+
     /* Fork */
     proc->pid = fork();
     if (proc->pid < 0) {
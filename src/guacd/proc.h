@@ -96,6 +96,39 @@ typedef struct guacd_proc {
  */
 guacd_proc* guacd_create_proc(const char* protocol);
 
+/**
+ * Initializes the client of the given process for the given protocol by
+ * loading the client plugin for that protocol, logging any failure.
+ *
+ * @param proc
+ *     The process whose client should be initialized.
+ *
+ * @param protocol
+ *     The protocol to initialize the client for.
+ *
+ * @return
+ *     Zero if the client was initialized, non-zero otherwise.
+ */
+int guacd_proc_load_plugin(guacd_proc* proc, const char* protocol);
+
+/**
+ * Starts protocol-specific handling on the given process. This function does
+ * NOT return. It initializes the process with protocol-specific handlers, if
+ * not already initialized, and then runs until the guacd_proc's fd_socket is
+ * closed, adding any file descriptors received along fd_socket as new users.
+ * This function must only be invoked within the connection process itself.
+ *
+ * @param proc
+ *     The process that any new users received along fd_socket should be added
+ *     to (after the process has been initialized for the given protocol).
+ *
+ * @param protocol
+ *     The protocol to initialize the given process for, or NULL if the client
+ *     of the process has already been initialized with
+ *     guacd_proc_load_plugin().
+ */
+void guacd_exec_proc(guacd_proc* proc, const char* protocol);
+
 /**
  * Signals the given process to stop accepting new users and clean up. This
  * will eventually cause the child process to exit.
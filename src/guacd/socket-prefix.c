@@ -0,0 +1,272 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "socket-prefix.h"
+
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Data specific to the prefix implementation of guac_socket.
+ */
+typedef struct guacd_socket_prefix_data {
+
+    /**
+     * The guac_socket to which all socket operations should be delegated
+     * once the prefix has been read.
+     */
+    guac_socket* socket;
+
+    /**
+     * The data to be read before any data of the wrapped socket.
+     */
+    char* prefix;
+
+    /**
+     * The number of bytes of the prefix which have not yet been read.
+     */
+    int remaining;
+
+    /**
+     * The offset of the first unread byte of the prefix.
+     */
+    int offset;
+
+} guacd_socket_prefix_data;
+
+/**
+ * Callback function which reads from the prefix, if any of the prefix remains
+ * unread, and from the wrapped socket otherwise.
+ *
+ * @param socket
+ *     The prefix socket to read from.
+ *
+ * @param buf
+ *     The buffer to read data into.
+ *
+ * @param count
+ *     The maximum number of bytes to read into the given buffer.
+ *
+ * @return
+ *     The number of bytes read, or the value returned by guac_socket_read()
+ *     when invoked on the wrapped socket with the given parameters.
+ */
+static ssize_t guacd_socket_prefix_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guacd_socket_prefix_data* data = (guacd_socket_prefix_data*) socket->data;
+
+    /* Delegate read to wrapped socket once prefix is exhausted */
+    if (data->remaining == 0)
+        return guac_socket_read(data->socket, buf, count);
+
+    if (count > (size_t) data->remaining)
+        count = data->remaining;
+
+    memcpy(buf, data->prefix + data->offset, count);
+    data->offset += count;
+    data->remaining -= count;
+
+    return count;
+
+}
+
+/**
+ * Callback function which delegates the write operation to the wrapped
+ * socket.
+ *
+ * @param socket
+ *     The prefix socket to write through.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     The number of bytes written if the write was successful, or -1 if an
+ *     error occurs.
+ */
+static ssize_t guacd_socket_prefix_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guacd_socket_prefix_data* data = (guacd_socket_prefix_data*) socket->data;
+
+    /* Delegate write to wrapped socket */
+    if (guac_socket_write(data->socket, buf, count))
+        return -1;
+
+    /* All data written successfully */
+    return count;
+
+}
+
+/**
+ * Callback function which delegates the flush operation to the wrapped
+ * socket.
+ *
+ * @param socket
+ *     The prefix socket to flush.
+ *
+ * @return
+ *     The value returned by guac_socket_flush() when invoked on the wrapped
+ *     socket.
+ */
+static ssize_t guacd_socket_prefix_flush_handler(guac_socket* socket) {
+
+    guacd_socket_prefix_data* data = (guacd_socket_prefix_data*) socket->data;
+
+    /* Delegate flush to wrapped socket */
+    return guac_socket_flush(data->socket);
+
+}
+
+/**
+ * Callback function which delegates the lock operation to the wrapped
+ * socket.
+ *
+ * @param socket
+ *     The prefix socket on which guac_socket_instruction_begin() was invoked.
+ */
+static void guacd_socket_prefix_lock_handler(guac_socket* socket) {
+
+    guacd_socket_prefix_data* data = (guacd_socket_prefix_data*) socket->data;
+
+    /* Delegate lock to wrapped socket */
+    guac_socket_instruction_begin(data->socket);
+
+}
+
+/**
+ * Callback function which delegates the unlock operation to the wrapped
+ * socket.
+ *
+ * @param socket
+ *     The prefix socket on which guac_socket_instruction_end() was invoked.
+ */
+static void guacd_socket_prefix_unlock_handler(guac_socket* socket) {
+
+    guacd_socket_prefix_data* data = (guacd_socket_prefix_data*) socket->data;
+
+    /* Delegate unlock to wrapped socket */
+    guac_socket_instruction_end(data->socket);
+
+}
+
+/**
+ * Callback function which reports data as immediately available while any
+ * of the prefix remains unread, delegating the select operation to the
+ * wrapped socket otherwise.
+ *
+ * @param socket
+ *     The prefix socket on which guac_socket_select() was invoked.
+ *
+ * @param usec_timeout
+ *     The timeout to specify when invoking guac_socket_select() on the
+ *     wrapped socket.
+ *
+ * @return
+ *     A positive value if unread prefix data remains, or the value returned
+ *     by guac_socket_select() when invoked with the given parameters on the
+ *     wrapped socket.
+ */
+static int guacd_socket_prefix_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guacd_socket_prefix_data* data = (guacd_socket_prefix_data*) socket->data;
+
+    /* Prefix data can always be read immediately */
+    if (data->remaining > 0)
+        return 1;
+
+    /* Delegate select to wrapped socket */
+    return guac_socket_select(data->socket, usec_timeout);
+
+}
+
+/**
+ * Callback function which frees all underlying data associated with the
+ * given prefix socket, including the wrapped socket.
+ *
+ * @param socket
+ *     The prefix socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guacd_socket_prefix_free_handler(guac_socket* socket) {
+
+    guacd_socket_prefix_data* data = (guacd_socket_prefix_data*) socket->data;
+
+    /* Free underlying socket */
+    guac_socket_free(data->socket);
+
+    free(data->prefix);
+    free(data);
+    return 0;
+
+}
+
+guac_socket* guacd_socket_prefix(guac_socket* socket, const void* data,
+        int length) {
+
+    guacd_socket_prefix_data* prefix_data =
+        malloc(sizeof(guacd_socket_prefix_data));
+    if (prefix_data == NULL)
+        return NULL;
+
+    prefix_data->prefix = malloc(length);
+    if (prefix_data->prefix == NULL) {
+        free(prefix_data);
+        return NULL;
+    }
+
+    memcpy(prefix_data->prefix, data, length);
+    prefix_data->socket = socket;
+    prefix_data->remaining = length;
+    prefix_data->offset = 0;
+
+    /* Associate prefix-specific data with new socket */
+    guac_socket* prefix_socket = guac_socket_alloc();
+    if (prefix_socket == NULL) {
+        free(prefix_data->prefix);
+        free(prefix_data);
+        return NULL;
+    }
+
+    prefix_socket->data = prefix_data;
+
+    /* Assign handlers */
+    prefix_socket->read_handler   = guacd_socket_prefix_read_handler;
+    prefix_socket->write_handler  = guacd_socket_prefix_write_handler;
+    prefix_socket->select_handler = guacd_socket_prefix_select_handler;
+    prefix_socket->flush_handler  = guacd_socket_prefix_flush_handler;
+    prefix_socket->lock_handler   = guacd_socket_prefix_lock_handler;
+    prefix_socket->unlock_handler = guacd_socket_prefix_unlock_handler;
+    prefix_socket->free_handler   = guacd_socket_prefix_free_handler;
+
+    return prefix_socket;
+
+}
+
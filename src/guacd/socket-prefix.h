@@ -0,0 +1,55 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_SOCKET_PREFIX_H
+#define GUACD_SOCKET_PREFIX_H
+
+#include "config.h"
+
+#include <guacamole/socket.h>
+
+/**
+ * Allocates and initializes a new guac_socket which delegates all socket
+ * operations to the given socket, except that the given data is read before
+ * any data is read from the given socket. This allows data which guacd has
+ * already read from a user's connection to be received by the connection
+ * process along with that connection. Freeing the returned guac_socket will
+ * free the given socket.
+ *
+ * @param socket
+ *     The guac_socket to which all socket operations should be delegated.
+ *
+ * @param data
+ *     The data to read before reading from the given socket. This data is
+ *     copied, and need not remain valid after this function returns.
+ *
+ * @param length
+ *     The number of bytes of data to read before reading from the given
+ *     socket.
+ *
+ * @return
+ *     A newly allocated guac_socket object which reads the given data before
+ *     the data of the given socket, or NULL if an error occurs while
+ *     allocating the guac_socket object.
+ */
+guac_socket* guacd_socket_prefix(guac_socket* socket, const void* data,
+        int length);
+
+#endif
+
@@ -0,0 +1,515 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "move-fd.h"
+#include "proc.h"
+#include "zygote.h"
+
+#include <guacamole/client.h>
+#include <guacamole/plugin.h>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifdef HAVE_PR_SET_CHILD_SUBREAPER
+#include <sys/prctl.h>
+#endif
+
+/**
+ * All zygotes started by guacd_zygote_start().
+ */
+static guacd_zygote* guacd_zygotes = NULL;
+
+/**
+ * The number of zygotes within the guacd_zygotes array.
+ */
+static int guacd_zygote_count = 0;
+
+#ifdef HAVE_PR_SET_CHILD_SUBREAPER
+
+/* Zygotes require that guacd adopt the processes they fork */
+
+/**
+ * Runs a single connection process forked by a zygote. If the process is to
+ * remain idle until a connection is assigned, the client plugin is fully
+ * initialized before waiting for that assignment. This function does NOT
+ * return.
+ *
+ * @param protocol
+ *     The protocol of the connection.
+ *
+ * @param guacd_pid
+ *     The process ID of guacd, which must adopt this process before this
+ *     process reports its own process ID to guacd.
+ *
+ * @param fd_socket
+ *     The file descriptor which this process must use to communicate with
+ *     guacd, or -1 if this process is idle and must receive that file
+ *     descriptor from assign_socket.
+ *
+ * @param assign_socket
+ *     The file descriptor of the UNIX domain socket shared by all idle
+ *     processes of the zygote, along which the fd_socket of each new
+ *     connection is sent, or -1 if this process is not idle.
+ */
+static void guacd_zygote_exec_worker(const char* protocol, pid_t guacd_pid,
+        int fd_socket, int assign_socket) {
+
+    /* Wait for adoption by guacd, which must be able to wait on this
+     * process exactly as if guacd had forked it */
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 1000000 };
+    while (getppid() != guacd_pid) {
+
+        /* Give up if guacd has terminated */
+        if (getppid() == 1)
+            exit(EXIT_FAILURE);
+
+        nanosleep(&delay, NULL);
+
+    }
+
+    guacd_proc* proc = calloc(1, sizeof(guacd_proc));
+    if (proc == NULL)
+        exit(EXIT_FAILURE);
+
+    proc->client = guac_client_alloc();
+    if (proc->client == NULL) {
+        guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to create client");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Init logging */
+    proc->client->log_handler = guacd_client_log;
+
+    /* Collect protocol statistics if requested */
+    if (guacd_stats_log_level >= 0
+            && guac_client_enable_stats(proc->client, guacd_stats_log_level))
+        guacd_log_guac_error(GUAC_LOG_WARNING,
+                "Unable to enable protocol statistics");
+
+    /* Idle processes are fully initialized before any connection arrives */
+    if (assign_socket != -1) {
+
+        if (guacd_proc_load_plugin(proc, protocol)) {
+            guac_client_free(proc->client);
+            exit(EXIT_FAILURE);
+        }
+
+        /* Wait for assignment of a connection, exiting if the zygote has
+         * terminated */
+        fd_socket = guacd_recv_fd(assign_socket);
+        close(assign_socket);
+
+        if (fd_socket == -1) {
+            guac_client_stop(proc->client);
+            guac_client_free(proc->client);
+            exit(EXIT_SUCCESS);
+        }
+
+    }
+
+    /* Read the connection ID assigned by guacd */
+    char connection_id[256];
+    int length = recv(fd_socket, connection_id, sizeof(connection_id) - 1, 0);
+    if (length <= 0)
+        exit(EXIT_FAILURE);
+
+    connection_id[length] = '\0';
+
+    free(proc->client->connection_id);
+    proc->client->connection_id = strdup(connection_id);
+
+    /* Report our PID, completing creation of the connection process */
+    pid_t pid = getpid();
+    if (send(fd_socket, &pid, sizeof(pid), 0) != sizeof(pid))
+        exit(EXIT_FAILURE);
+
+    /* Handle users exactly as a process forked by guacd would */
+    proc->fd_socket = fd_socket;
+    guacd_exec_proc(proc, assign_socket != -1 ? NULL : protocol);
+
+}
+
+/**
+ * Forks a new connection process from within a zygote. The new process is
+ * orphaned immediately, and is thus adopted by guacd.
+ *
+ * @param protocol
+ *     The protocol of the zygote.
+ *
+ * @param guacd_pid
+ *     The process ID of guacd.
+ *
+ * @param zygote_socket
+ *     The file descriptor of the socket along which the zygote receives
+ *     requests from guacd.
+ *
+ * @param assign_sockets
+ *     The file descriptors of both ends of the socket pair used to assign
+ *     connections to idle processes, where the first is used by the zygote
+ *     and the second by idle processes, or -1 for each if the zygote does not
+ *     maintain idle processes.
+ *
+ * @param fd_socket
+ *     The file descriptor which the new process must use to communicate with
+ *     guacd, or -1 if the new process must remain idle until a connection is
+ *     assigned.
+ */
+static void guacd_zygote_fork(const char* protocol, pid_t guacd_pid,
+        int zygote_socket, int assign_sockets[2], int fd_socket) {
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Zygote for protocol \"%s\" cannot fork "
+                "child process: %s", protocol, strerror(errno));
+        return;
+    }
+
+    /* Fork the actual connection process, leaving it orphaned */
+    else if (pid == 0) {
+
+        pid_t worker_pid = fork();
+        if (worker_pid == 0) {
+
+            /* Connection processes do not communicate with the zygote */
+            close(zygote_socket);
+            if (assign_sockets[0] != -1)
+                close(assign_sockets[0]);
+
+            /* Only idle processes wait for assignment */
+            int assign_socket = assign_sockets[1];
+            if (fd_socket != -1 && assign_socket != -1) {
+                close(assign_socket);
+                assign_socket = -1;
+            }
+
+            guacd_zygote_exec_worker(protocol, guacd_pid, fd_socket,
+                    assign_socket);
+
+        }
+
+        _exit(worker_pid < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+    }
+
+    /* Wait for the intermediate process, which exits immediately */
+    waitpid(pid, NULL, 0);
+
+}
+
+/**
+ * Runs a zygote for the given protocol, forking a connection process for
+ * each request received from guacd until guacd closes its end of the given
+ * socket. As the zygote is single-threaded, these forks are not subject to
+ * the locks held by other threads of guacd. This function does NOT return.
+ *
+ * @param protocol
+ *     The protocol of the zygote.
+ *
+ * @param zygote_socket
+ *     The file descriptor of the socket along which the zygote receives
+ *     requests from guacd.
+ *
+ * @param idle
+ *     The number of fully-initialized processes to keep waiting for new
+ *     connections.
+ */
+static void guacd_zygote_run(const char* protocol, int zygote_socket,
+        int idle) {
+
+    pid_t guacd_pid = getppid();
+
+    /* Terminate along with guacd */
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    /* Pluggable client */
+    char protocol_lib[GUAC_PROTOCOL_LIBRARY_LIMIT] =
+        GUAC_PROTOCOL_LIBRARY_PREFIX;
+
+    strncat(protocol_lib, protocol, GUAC_PROTOCOL_NAME_LIMIT-1);
+    strcat(protocol_lib, GUAC_PROTOCOL_LIBRARY_SUFFIX);
+
+    /* Load client plugin and all libraries it depends on once, such that
+     * each forked process need not. The plugin remains loaded for the
+     * lifetime of the zygote. */
+    if (dlopen(protocol_lib, RTLD_NOW) == NULL) {
+        guacd_log(GUAC_LOG_WARNING, "Support for protocol \"%s\" is not "
+                "installed: %s", protocol, dlerror());
+        exit(EXIT_FAILURE);
+    }
+
+    int assign_sockets[2] = { -1, -1 };
+
+    /* Open socket pair shared by all idle processes, if any */
+    if (idle > 0 && socketpair(AF_UNIX, SOCK_SEQPACKET, 0,
+                assign_sockets) < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Zygote for protocol \"%s\" cannot "
+                "maintain idle processes: %s", protocol, strerror(errno));
+        idle = 0;
+    }
+
+    int i;
+    for (i = 0; i < idle; i++)
+        guacd_zygote_fork(protocol, guacd_pid, zygote_socket,
+                assign_sockets, -1);
+
+    /* Provide a process for each request */
+    int fd_socket;
+    while ((fd_socket = guacd_recv_fd(zygote_socket)) != -1) {
+
+        /* Assign connection to an idle process, replacing that process */
+        if (idle > 0 && guacd_send_fd(assign_sockets[0], fd_socket)) {
+            guacd_zygote_fork(protocol, guacd_pid, zygote_socket,
+                    assign_sockets, -1);
+        }
+
+        /* Otherwise fork a new process for the connection */
+        else
+            guacd_zygote_fork(protocol, guacd_pid, zygote_socket,
+                    assign_sockets, fd_socket);
+
+        close(fd_socket);
+
+    }
+
+    /* Closing our end of the shared socket terminates all idle processes */
+    exit(EXIT_SUCCESS);
+
+}
+
+/**
+ * Starts a zygote for the given protocol, storing its details within the
+ * given structure.
+ *
+ * @param zygote
+ *     The structure to populate with the details of the new zygote.
+ *
+ * @param protocol
+ *     The protocol to start a zygote for.
+ *
+ * @param idle
+ *     The number of fully-initialized processes that the zygote should keep
+ *     waiting for new connections.
+ *
+ * @return
+ *     Zero if the zygote was started, non-zero otherwise.
+ */
+static int guacd_zygote_init(guacd_zygote* zygote, const char* protocol,
+        int idle) {
+
+    int sockets[2];
+
+    /* Open UNIX socket pair */
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Error opening socket pair: %s",
+                strerror(errno));
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Cannot fork zygote process: %s",
+                strerror(errno));
+        close(sockets[0]);
+        close(sockets[1]);
+        return 1;
+    }
+
+    /* Child */
+    else if (pid == 0) {
+
+        close(sockets[0]);
+
+        /* Do not hold the sockets of other zygotes open, such that each
+         * zygote sees its socket close once guacd terminates */
+        int i;
+        for (i = 0; i < guacd_zygote_count; i++)
+            close(guacd_zygotes[i].socket);
+
+        guacd_zygote_run(protocol, sockets[1], idle);
+
+    }
+
+    /* Parent */
+    close(sockets[1]);
+
+    zygote->protocol = strdup(protocol);
+    zygote->pid = pid;
+    zygote->socket = sockets[0];
+    pthread_mutex_init(&zygote->lock, NULL);
+
+    return 0;
+
+}
+
+#endif
+
+int guacd_zygote_start(const char* protocols, int idle) {
+
+#ifdef HAVE_PR_SET_CHILD_SUBREAPER
+
+    /* Adopt connection processes forked by zygotes */
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to adopt processes forked by "
+                "zygotes: %s. All connection processes will be forked "
+                "directly.", strerror(errno));
+        return 1;
+    }
+
+    char* list = strdup(protocols);
+    if (list == NULL)
+        return 1;
+
+    /* Allocate space for each listed protocol */
+    int available = 1;
+    char* current;
+    for (current = list; *current != '\0'; current++) {
+        if (*current == ',')
+            available++;
+    }
+
+    guacd_zygotes = calloc(available, sizeof(guacd_zygote));
+    if (guacd_zygotes == NULL) {
+        free(list);
+        return 1;
+    }
+
+    int failed = 0;
+
+    /* Start one zygote per protocol */
+    char* saveptr;
+    char* protocol = strtok_r(list, ",", &saveptr);
+    while (protocol != NULL) {
+
+        guacd_zygote* zygote = &guacd_zygotes[guacd_zygote_count];
+        if (guacd_zygote_init(zygote, protocol, idle))
+            failed = 1;
+
+        else {
+            guacd_log(GUAC_LOG_INFO, "Started zygote for protocol \"%s\" "
+                    "(PID %i)", protocol, zygote->pid);
+            guacd_zygote_count++;
+        }
+
+        protocol = strtok_r(NULL, ",", &saveptr);
+
+    }
+
+    free(list);
+    return failed;
+
+#else
+    guacd_log(GUAC_LOG_WARNING, "Zygotes are not supported on this "
+            "platform. All connection processes will be forked directly.");
+    return 1;
+#endif
+
+}
+
+/**
+ * Returns the zygote for the given protocol.
+ *
+ * @param protocol
+ *     The protocol to find the zygote of.
+ *
+ * @return
+ *     The zygote for the given protocol, or NULL if no zygote was started for
+ *     that protocol.
+ */
+static guacd_zygote* guacd_zygote_find(const char* protocol) {
+
+    int i;
+    for (i = 0; i < guacd_zygote_count; i++) {
+        if (strcmp(guacd_zygotes[i].protocol, protocol) == 0)
+            return &guacd_zygotes[i];
+    }
+
+    return NULL;
+
+}
+
+pid_t guacd_zygote_spawn(const char* protocol, const char* connection_id,
+        int fd_socket, int proc_fd_socket) {
+
+    guacd_zygote* zygote = guacd_zygote_find(protocol);
+    if (zygote == NULL)
+        return 0;
+
+    pthread_mutex_lock(&zygote->lock);
+
+    /* Request new process, stopping use of the zygote if it has terminated */
+    int requested = zygote->socket != -1
+        && guacd_send_fd(zygote->socket, proc_fd_socket);
+
+    if (!requested && zygote->socket != -1) {
+        guacd_log(GUAC_LOG_WARNING, "Zygote for protocol \"%s\" has "
+                "terminated. Connection processes for this protocol will be "
+                "forked directly.", protocol);
+        close(zygote->socket);
+        zygote->socket = -1;
+    }
+
+    pthread_mutex_unlock(&zygote->lock);
+
+    /* The sockets were not received by any process if the request failed */
+    if (!requested)
+        return 0;
+
+    /* Provide connection ID, which the new process reads before reporting
+     * its PID */
+    if (send(fd_socket, connection_id, strlen(connection_id), 0) < 0)
+        return -1;
+
+    struct timeval timeout = {
+        .tv_sec  = GUACD_ZYGOTE_TIMEOUT / 1000,
+        .tv_usec = (GUACD_ZYGOTE_TIMEOUT % 1000) * 1000
+    };
+
+    /* Wait a finite amount of time for the PID of the new process */
+    pid_t pid;
+    setsockopt(fd_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int length = recv(fd_socket, &pid, sizeof(pid), 0);
+
+    /* Restore default (infinite) timeout */
+    timeout.tv_sec = timeout.tv_usec = 0;
+    setsockopt(fd_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (length != sizeof(pid) || pid <= 0) {
+        guacd_log(GUAC_LOG_WARNING, "Zygote for protocol \"%s\" did not "
+                "provide a process in a timely manner.", protocol);
+        return -1;
+    }
+
+    return pid;
+
+}
+
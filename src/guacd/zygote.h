@@ -0,0 +1,118 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_ZYGOTE_H
+#define GUACD_ZYGOTE_H
+
+#include "config.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * The number of milliseconds to wait for a zygote to provide a process for a
+ * new connection before falling back to forking that process directly.
+ */
+#define GUACD_ZYGOTE_TIMEOUT 5000
+
+/**
+ * A pre-initialized process which has already loaded the client plugin of a
+ * single protocol, along with all libraries that plugin depends on, and which
+ * forks processes for new connections using that protocol on request.
+ */
+typedef struct guacd_zygote {
+
+    /**
+     * The protocol whose client plugin has been loaded by the zygote.
+     */
+    char* protocol;
+
+    /**
+     * The process ID of the zygote.
+     */
+    pid_t pid;
+
+    /**
+     * The file descriptor of the UNIX domain socket used to send requests for
+     * new processes to the zygote. Each request consists of the file
+     * descriptor which the new process must use as its fd_socket.
+     */
+    int socket;
+
+    /**
+     * Lock which is acquired whenever a request is being sent to the zygote.
+     */
+    pthread_mutex_t lock;
+
+} guacd_zygote;
+
+/**
+ * Starts one zygote for each of the given protocols. Connection processes
+ * forked by a zygote are reparented to guacd, such that guacd may manage
+ * those processes exactly as if it had forked them itself. This requires
+ * guacd to become a child subreaper, and no zygotes are started if that is
+ * not supported by the platform. This function must be invoked at most once,
+ * after guacd has daemonized.
+ *
+ * @param protocols
+ *     A comma-separated list of the protocols to start zygotes for.
+ *
+ * @param idle
+ *     The number of fully-initialized processes that each zygote should keep
+ *     waiting for new connections, or zero if processes should only be forked
+ *     once a connection is requested.
+ *
+ * @return
+ *     Zero if all requested zygotes were started, non-zero otherwise.
+ */
+int guacd_zygote_start(const char* protocols, int idle);
+
+/**
+ * Requests a new connection process for the given protocol from the zygote
+ * of that protocol, if any. The new process will have the given connection
+ * ID, and will communicate with guacd over the given pair of sockets exactly
+ * as a process forked by guacd_create_proc() would.
+ *
+ * @param protocol
+ *     The protocol of the new connection.
+ *
+ * @param connection_id
+ *     The connection ID which the new process must use.
+ *
+ * @param fd_socket
+ *     The file descriptor which guacd will use to communicate with the new
+ *     process.
+ *
+ * @param proc_fd_socket
+ *     The file descriptor which the new process must use to communicate with
+ *     guacd. This file descriptor remains open within guacd and must be
+ *     closed by the caller.
+ *
+ * @return
+ *     The process ID of the new process, zero if there is no zygote for the
+ *     given protocol, or -1 if the zygote failed to provide a process in a
+ *     timely manner. If -1 is returned, the given sockets may have been
+ *     received by a process that has not yet reported, and must not be used
+ *     further.
+ */
+pid_t guacd_zygote_spawn(const char* protocol, const char* connection_id,
+        int fd_socket, int proc_fd_socket);
+
+#endif
+
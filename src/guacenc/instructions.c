@@ -24,51 +24,36 @@
 
 #include <guacamole/client.h>
 
-#include <string.h>
-
-guacenc_instruction_handler_mapping guacenc_instruction_handler_map[] = {
-    {"blob",     guacenc_handle_blob},
-    {"img",      guacenc_handle_img},
-    {"end",      guacenc_handle_end},
-    {"mouse",    guacenc_handle_mouse},
-    {"sync",     guacenc_handle_sync},
-    {"cursor",   guacenc_handle_cursor},
-    {"copy",     guacenc_handle_copy},
-    {"transfer", guacenc_handle_transfer},
-    {"size",     guacenc_handle_size},
-    {"rect",     guacenc_handle_rect},
-    {"cfill",    guacenc_handle_cfill},
-    {"move",     guacenc_handle_move},
-    {"shade",    guacenc_handle_shade},
-    {"dispose",  guacenc_handle_dispose},
-    {NULL,       NULL}
+#include <guacamole/protocol.h>
+
+guacenc_instruction_handler* const
+    guacenc_instruction_handler_map[GUAC_PROTOCOL_OPCODE_COUNT] = {
+    [GUAC_PROTOCOL_OPCODE_BLOB]     = guacenc_handle_blob,
+    [GUAC_PROTOCOL_OPCODE_IMG]      = guacenc_handle_img,
+    [GUAC_PROTOCOL_OPCODE_END]      = guacenc_handle_end,
+    [GUAC_PROTOCOL_OPCODE_MOUSE]    = guacenc_handle_mouse,
+    [GUAC_PROTOCOL_OPCODE_SYNC]     = guacenc_handle_sync,
+    [GUAC_PROTOCOL_OPCODE_CURSOR]   = guacenc_handle_cursor,
+    [GUAC_PROTOCOL_OPCODE_COPY]     = guacenc_handle_copy,
+    [GUAC_PROTOCOL_OPCODE_TRANSFER] = guacenc_handle_transfer,
+    [GUAC_PROTOCOL_OPCODE_SIZE]     = guacenc_handle_size,
+    [GUAC_PROTOCOL_OPCODE_RECT]     = guacenc_handle_rect,
+    [GUAC_PROTOCOL_OPCODE_CFILL]    = guacenc_handle_cfill,
+    [GUAC_PROTOCOL_OPCODE_MOVE]     = guacenc_handle_move,
+    [GUAC_PROTOCOL_OPCODE_SHADE]    = guacenc_handle_shade,
+    [GUAC_PROTOCOL_OPCODE_DISPOSE]  = guacenc_handle_dispose,
 };
 
 int guacenc_handle_instruction(guacenc_display* display, const char* opcode,
         int argc, char** argv) {
 
-    /* Search through mapping for instruction handler having given opcode */
-    guacenc_instruction_handler_mapping* current = guacenc_instruction_handler_map;
-    while (current->opcode != NULL) {
-
-        /* Invoke handler if opcode matches (if defined) */
-        if (strcmp(current->opcode, opcode) == 0) {
-
-            /* Invoke defined handler */
-            guacenc_instruction_handler* handler = current->handler;
-            if (handler != NULL)
-                return handler(display, argc, argv);
-
-            /* Log defined but unimplemented instructions */
-            guacenc_log(GUAC_LOG_DEBUG, "\"%s\" not implemented", opcode);
-            return 0;
-
-        }
-
-        /* Next candidate handler */
-        current++;
+    /* Look up handler by opcode */
+    guacenc_instruction_handler* handler =
+        guacenc_instruction_handler_map[guac_protocol_get_opcode(opcode)];
 
-    } /* end opcode search */
+    /* Invoke handler if defined */
+    if (handler != NULL)
+        return handler(display, argc, argv);
 
     /* Ignore any unknown instructions */
     return 0;
@@ -22,38 +22,23 @@
 #include "instructions.h"
 #include "log.h"
 
-#include <string.h>
+#include <guacamole/protocol.h>
 
-guaclog_instruction_handler_mapping guaclog_instruction_handler_map[] = {
-    {"key", guaclog_handle_key},
-    {NULL,  NULL}
+guaclog_instruction_handler* const
+    guaclog_instruction_handler_map[GUAC_PROTOCOL_OPCODE_COUNT] = {
+    [GUAC_PROTOCOL_OPCODE_KEY] = guaclog_handle_key,
 };
 
 int guaclog_handle_instruction(guaclog_state* state, const char* opcode,
         int argc, char** argv) {
 
-    /* Search through mapping for instruction handler having given opcode */
-    guaclog_instruction_handler_mapping* current = guaclog_instruction_handler_map;
-    while (current->opcode != NULL) {
+    /* Look up handler by opcode */
+    guaclog_instruction_handler* handler =
+        guaclog_instruction_handler_map[guac_protocol_get_opcode(opcode)];
 
-        /* Invoke handler if opcode matches (if defined) */
-        if (strcmp(current->opcode, opcode) == 0) {
-
-            /* Invoke defined handler */
-            guaclog_instruction_handler* handler = current->handler;
-            if (handler != NULL)
-                return handler(state, argc, argv);
-
-            /* Log defined but unimplemented instructions */
-            guaclog_log(GUAC_LOG_DEBUG, "\"%s\" not implemented", opcode);
-            return 0;
-
-        }
-
-        /* Next candidate handler */
-        current++;
-
-    } /* end opcode search */
+    /* Invoke handler if defined */
+    if (handler != NULL)
+        return handler(state, argc, argv);
 
     /* Ignore any unknown instructions */
     return 0;
@@ -23,6 +23,8 @@
 #include "config.h"
 #include "state.h"
 
+#include <guacamole/protocol-types.h>
+
 /**
  * A callback function which, when invoked, handles a particular Guacamole
  * instruction. The opcode of the instruction is implied (as it is expected
@@ -49,30 +51,12 @@ typedef int guaclog_instruction_handler(guaclog_state* state,
         int argc, char** argv);
 
 /**
- * Mapping of instruction opcode to corresponding handler function.
- */
-typedef struct guaclog_instruction_handler_mapping {
-
-    /**
-     * The opcode of the instruction that the associated handler function
-     * should be invoked for.
-     */
-    const char* opcode;
-
-    /**
-     * The handler function to invoke whenever an instruction having the
-     * associated opcode is parsed.
-     */
-    guaclog_instruction_handler* handler;
-
-} guaclog_instruction_handler_mapping;
-
-/**
- * Array of all opcode/handler mappings for all supported opcodes, terminated
- * by an entry with a NULL opcode. All opcodes not listed here can be safely
- * ignored.
+ * Lookup table of handlers for all supported opcodes. Each element corresponds
+ * to the guac_protocol_opcode value of the same index. All opcodes whose
+ * element is NULL can be safely ignored.
  */
-extern guaclog_instruction_handler_mapping guaclog_instruction_handler_map[];
+extern guaclog_instruction_handler* const
+    guaclog_instruction_handler_map[GUAC_PROTOCOL_OPCODE_COUNT];
 
 /**
  * Handles the instruction having the given opcode and arguments, updating
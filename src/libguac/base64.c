@@ -0,0 +1,392 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "base64.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * SSSE3 and AVX2 encoders are compiled for any x86 target using per-function
+ * target attributes, and are only selected at runtime if the CPU supports
+ * them. NEON is part of the baseline of all 64-bit ARM targets, and thus
+ * needs no runtime check.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GUAC_BASE64_X86
+#include <immintrin.h>
+#define GUAC_BASE64_SSSE3 __attribute__((target("ssse3")))
+#define GUAC_BASE64_AVX2  __attribute__((target("avx2")))
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define GUAC_BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * The base64 alphabet, indexed by the value of each group of six bits.
+ */
+static const char __guac_base64_alphabet[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Encodes the given number of complete triplets of bytes as base64 using only
+ * portable C, one triplet at a time. This encoder is supported by all CPUs,
+ * and also encodes any triplets remaining after the vectorized encoders have
+ * consumed all complete blocks.
+ *
+ * @param output
+ *     The buffer in which the base64 characters should be stored. This buffer
+ *     must be at least (triplets * 4) bytes in size.
+ *
+ * @param input
+ *     The buffer containing the data to encode. This buffer must contain at
+ *     least (triplets * 3) bytes.
+ *
+ * @param triplets
+ *     The number of complete triplets to encode.
+ */
+static void __guac_base64_encode_scalar(char* output,
+        const unsigned char* input, size_t triplets) {
+
+    while (triplets > 0) {
+
+        /* Pack triplet into 24 bits: AAAAAAAA BBBBBBBB CCCCCCCC */
+        uint32_t value = (input[0] << 16) | (input[1] << 8) | input[2];
+
+        /* Split into four groups of six bits: AAAAAA AABBBB BBBBCC CCCCCC */
+        output[0] = __guac_base64_alphabet[(value >> 18) & 0x3F];
+        output[1] = __guac_base64_alphabet[(value >> 12) & 0x3F];
+        output[2] = __guac_base64_alphabet[(value >>  6) & 0x3F];
+        output[3] = __guac_base64_alphabet[ value        & 0x3F];
+
+        input  += 3;
+        output += 4;
+        triplets--;
+
+    }
+
+}
+
+const guac_base64_encoder guac_base64_scalar = {
+    .name   = "scalar",
+    .encode = __guac_base64_encode_scalar
+};
+
+#ifdef GUAC_BASE64_X86
+
+/*
+ * The x86 encoders convert 12 bytes of input at a time within each 128-bit
+ * lane. Each triplet is first shuffled into its own 32-bit element, with the
+ * bytes of the triplet arranged such that each group of six bits can be
+ * moved into its own byte using a pair of 16-bit multiplies. Each resulting
+ * six-bit value is then translated into its base64 character by adding an
+ * offset chosen with a byte shuffle, as the alphabet consists of five
+ * contiguous ranges of characters:
+ *
+ *     0-25  -> 'A'-'Z'    offset 'A'
+ *     26-51 -> 'a'-'z'    offset 'a' - 26
+ *     52-61 -> '0'-'9'    offset '0' - 52
+ *     62    -> '+'        offset '+' - 62
+ *     63    -> '/'        offset '/' - 63
+ */
+
+/**
+ * The byte shuffle, in _mm_setr_epi8() order, which arranges each of the
+ * four triplets within a 128-bit lane such that triplet bytes A, B and C are
+ * stored as B, A, C, B within their 32-bit element.
+ */
+#define GUAC_BASE64_SHUFFLE \
+    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10
+
+/**
+ * The offsets, in _mm_setr_epi8() order, added to each six-bit value to
+ * produce its base64 character, indexed by the reduced range of that value.
+ */
+#define GUAC_BASE64_OFFSETS                                                   \
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,               \
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,               \
+    '/' - 63, 'A', 0, 0
+
+/**
+ * Encodes the four triplets within the first twelve bytes of the given
+ * vector, returning the resulting sixteen base64 characters.
+ */
+GUAC_BASE64_SSSE3 static __m128i __guac_base64_encode_lane_ssse3(
+        __m128i in) {
+
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(GUAC_BASE64_SHUFFLE));
+
+    /* Move bits 0-5 and 6-11 of each 24-bit value into bytes 0 and 1... */
+    __m128i high = _mm_mulhi_epu16(
+            _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)),
+            _mm_set1_epi32(0x04000040));
+
+    /* ...and bits 12-17 and 18-23 into bytes 2 and 3 */
+    __m128i low = _mm_mullo_epi16(
+            _mm_and_si128(in, _mm_set1_epi32(0x003F03F0)),
+            _mm_set1_epi32(0x01000010));
+
+    __m128i indices = _mm_or_si128(high, low);
+
+    /* Reduce each six-bit value to the index of its offset: 0 for 26-51,
+     * 1-10 for 52-61, 11 for 62, 12 for 63, and 13 for 0-25 */
+    __m128i ranges = _mm_or_si128(
+            _mm_subs_epu8(indices, _mm_set1_epi8(51)),
+            _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices),
+                _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(
+                _mm_setr_epi8(GUAC_BASE64_OFFSETS), ranges));
+
+}
+
+/**
+ * Encodes the four triplets within the first twelve bytes of each 128-bit
+ * lane of the given vector, returning the resulting thirty-two base64
+ * characters. This is identical to __guac_base64_encode_lane_ssse3(), but
+ * operates on both lanes at once.
+ */
+GUAC_BASE64_AVX2 static __m256i __guac_base64_encode_lanes_avx2(
+        __m256i in) {
+
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+                GUAC_BASE64_SHUFFLE, GUAC_BASE64_SHUFFLE));
+
+    __m256i high = _mm256_mulhi_epu16(
+            _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)),
+            _mm256_set1_epi32(0x04000040));
+
+    __m256i low = _mm256_mullo_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)),
+            _mm256_set1_epi32(0x01000010));
+
+    __m256i indices = _mm256_or_si256(high, low);
+
+    __m256i ranges = _mm256_or_si256(
+            _mm256_subs_epu8(indices, _mm256_set1_epi8(51)),
+            _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                _mm256_set1_epi8(13)));
+
+    return _mm256_add_epi8(indices, _mm256_shuffle_epi8(
+                _mm256_setr_epi8(GUAC_BASE64_OFFSETS, GUAC_BASE64_OFFSETS),
+                ranges));
+
+}
+
+/**
+ * Encodes the given number of complete triplets of bytes as base64 using
+ * SSSE3. See __guac_base64_encode_scalar().
+ */
+GUAC_BASE64_SSSE3 static void __guac_base64_encode_ssse3(char* output,
+        const unsigned char* input, size_t triplets) {
+
+    /* Each iteration loads 16 bytes but consumes only 12, and thus requires
+     * at least 16 bytes to remain */
+    while (triplets >= 6) {
+
+        __m128i in = _mm_loadu_si128((const __m128i*) input);
+        _mm_storeu_si128((__m128i*) output,
+                __guac_base64_encode_lane_ssse3(in));
+
+        input    += 12;
+        output   += 16;
+        triplets -= 4;
+
+    }
+
+    __guac_base64_encode_scalar(output, input, triplets);
+
+}
+
+static const guac_base64_encoder __guac_base64_ssse3 = {
+    .name   = "ssse3",
+    .encode = __guac_base64_encode_ssse3
+};
+
+/**
+ * Encodes the given number of complete triplets of bytes as base64 using
+ * AVX2. See __guac_base64_encode_scalar().
+ */
+GUAC_BASE64_AVX2 static void __guac_base64_encode_avx2(char* output,
+        const unsigned char* input, size_t triplets) {
+
+    /* Each iteration loads 16 bytes at offsets 0 and 12, consuming only 24,
+     * and thus requires at least 28 bytes to remain */
+    while (triplets >= 10) {
+
+        __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i*) input)),
+                _mm_loadu_si128((const __m128i*) (input + 12)), 1);
+
+        _mm256_storeu_si256((__m256i*) output,
+                __guac_base64_encode_lanes_avx2(in));
+
+        input    += 24;
+        output   += 32;
+        triplets -= 8;
+
+    }
+
+    /* Encode any remaining groups of four triplets within this function,
+     * such that they are VEX-encoded and do not incur the penalty of mixing
+     * AVX with legacy SSE instructions */
+    while (triplets >= 6) {
+
+        __m128i in = _mm_loadu_si128((const __m128i*) input);
+        _mm_storeu_si128((__m128i*) output,
+                __guac_base64_encode_lane_ssse3(in));
+
+        input    += 12;
+        output   += 16;
+        triplets -= 4;
+
+    }
+
+    _mm256_zeroupper();
+    __guac_base64_encode_scalar(output, input, triplets);
+
+}
+
+static const guac_base64_encoder __guac_base64_avx2 = {
+    .name   = "avx2",
+    .encode = __guac_base64_encode_avx2
+};
+
+#endif
+
+#ifdef GUAC_BASE64_NEON
+
+/**
+ * Encodes the given number of complete triplets of bytes as base64 using
+ * NEON. See __guac_base64_encode_scalar().
+ */
+static void __guac_base64_encode_neon(char* output,
+        const unsigned char* input, size_t triplets) {
+
+    /* Table lookup covers the entire 64-character alphabet at once */
+    uint8x16x4_t alphabet = {{
+        vld1q_u8((const uint8_t*) __guac_base64_alphabet),
+        vld1q_u8((const uint8_t*) __guac_base64_alphabet + 16),
+        vld1q_u8((const uint8_t*) __guac_base64_alphabet + 32),
+        vld1q_u8((const uint8_t*) __guac_base64_alphabet + 48)
+    }};
+
+    uint8x16_t mask = vdupq_n_u8(0x3F);
+
+    while (triplets >= 16) {
+
+        /* Deinterleave sixteen triplets into bytes A, B and C */
+        uint8x16x3_t in = vld3q_u8(input);
+        uint8x16x4_t out;
+
+        /* Split into four groups of six bits: AAAAAA AABBBB BBBBCC CCCCCC */
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                    vshrq_n_u8(in.val[1], 4)), mask);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                    vshrq_n_u8(in.val[2], 6)), mask);
+        out.val[3] = vandq_u8(in.val[2], mask);
+
+        out.val[0] = vqtbl4q_u8(alphabet, out.val[0]);
+        out.val[1] = vqtbl4q_u8(alphabet, out.val[1]);
+        out.val[2] = vqtbl4q_u8(alphabet, out.val[2]);
+        out.val[3] = vqtbl4q_u8(alphabet, out.val[3]);
+
+        /* Interleave characters back into groups of four */
+        vst4q_u8((uint8_t*) output, out);
+
+        input    += 48;
+        output   += 64;
+        triplets -= 16;
+
+    }
+
+    __guac_base64_encode_scalar(output, input, triplets);
+
+}
+
+static const guac_base64_encoder __guac_base64_neon = {
+    .name   = "neon",
+    .encode = __guac_base64_encode_neon
+};
+
+#endif
+
+/**
+ * All encoders supported by the current CPU, fastest first.
+ */
+static const guac_base64_encoder*
+    __guac_base64_supported[GUAC_BASE64_MAX_ENCODERS];
+
+/**
+ * The number of entries within __guac_base64_supported.
+ */
+static int __guac_base64_supported_length = 0;
+
+/**
+ * Guard ensuring the CPU is inspected only once.
+ */
+static pthread_once_t __guac_base64_init_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Inspects the current CPU, populating __guac_base64_supported with all
+ * supported encoders.
+ */
+static void __guac_base64_init() {
+
+    int length = 0;
+
+#ifdef GUAC_BASE64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        __guac_base64_supported[length++] = &__guac_base64_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+        __guac_base64_supported[length++] = &__guac_base64_ssse3;
+#endif
+
+#ifdef GUAC_BASE64_NEON
+    __guac_base64_supported[length++] = &__guac_base64_neon;
+#endif
+
+    __guac_base64_supported[length++] = &guac_base64_scalar;
+    __guac_base64_supported_length = length;
+
+}
+
+const guac_base64_encoder* guac_base64_get_encoder() {
+    pthread_once(&__guac_base64_init_once, __guac_base64_init);
+    return __guac_base64_supported[0];
+}
+
+int guac_base64_list_encoders(const guac_base64_encoder** encoders, int max) {
+
+    int i;
+
+    pthread_once(&__guac_base64_init_once, __guac_base64_init);
+
+    for (i = 0; i < max && i < __guac_base64_supported_length; i++)
+        encoders[i] = __guac_base64_supported[i];
+
+    return i;
+
+}
+
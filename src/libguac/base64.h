@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_BASE64_H
+#define GUAC_BASE64_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * The maximum number of base64 characters to encode before writing those
+ * characters to a socket as a single block. This value must be a multiple of
+ * four.
+ */
+#define GUAC_BASE64_BLOCK_SIZE 8192
+
+/**
+ * The maximum number of base64 encoders that may be supported by any one
+ * CPU.
+ */
+#define GUAC_BASE64_MAX_ENCODERS 4
+
+/**
+ * Encodes the given number of complete triplets of bytes as base64, storing
+ * exactly four base64 characters for each triplet in the given output buffer.
+ * No padding is ever required, as only complete triplets are encoded.
+ *
+ * @param output
+ *     The buffer in which the base64 characters should be stored. This buffer
+ *     must be at least (triplets * 4) bytes in size.
+ *
+ * @param input
+ *     The buffer containing the data to encode. This buffer must contain at
+ *     least (triplets * 3) bytes.
+ *
+ * @param triplets
+ *     The number of complete triplets to encode.
+ */
+typedef void guac_base64_encode_block(char* output,
+        const unsigned char* input, size_t triplets);
+
+/**
+ * A base64 encoder implemented using a particular instruction set.
+ */
+typedef struct guac_base64_encoder {
+
+    /**
+     * The name of the instruction set used by this encoder, such as "avx2"
+     * or "scalar".
+     */
+    const char* name;
+
+    /**
+     * Encodes complete triplets of bytes as base64.
+     */
+    guac_base64_encode_block* encode;
+
+} guac_base64_encoder;
+
+/**
+ * The portable base64 encoder, which is supported by all CPUs.
+ */
+extern const guac_base64_encoder guac_base64_scalar;
+
+/**
+ * Returns the fastest base64 encoder supported by the current CPU. The CPU
+ * is inspected only once, the first time this function or
+ * guac_base64_list_encoders() is invoked.
+ *
+ * @return
+ *     The fastest base64 encoder supported by the current CPU.
+ */
+const guac_base64_encoder* guac_base64_get_encoder();
+
+/**
+ * Stores all base64 encoders supported by the current CPU in the given
+ * array, fastest first. The last encoder stored is always guac_base64_scalar.
+ *
+ * @param encoders
+ *     The array in which the supported encoders should be stored.
+ *
+ * @param max
+ *     The maximum number of encoders to store. GUAC_BASE64_MAX_ENCODERS is
+ *     always sufficient.
+ *
+ * @return
+ *     The number of encoders stored.
+ */
+int guac_base64_list_encoders(const guac_base64_encoder** encoders, int max);
+
+#endif
+
@@ -29,7 +29,10 @@
 #include "pool.h"
 #include "plugin.h"
 #include "protocol.h"
+#include "quality.h"
 #include "socket.h"
+#include "socket-broadcast.h"
+#include "stats.h"
 #include "stream.h"
 #include "timestamp.h"
 #include "user.h"
@@ -38,6 +41,7 @@
 #include <inttypes.h>
 #include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -98,13 +102,11 @@ guac_stream* guac_client_alloc_stream(guac_client* client) {
     guac_stream* allocd_stream;
     int stream_index;
 
-    /* Refuse to allocate beyond maximum */
-    if (client->__stream_pool->active == GUAC_CLIENT_MAX_STREAMS)
+    /* Allocate stream, refusing to allocate beyond maximum */
+    stream_index = guac_pool_next_int_below(client->__stream_pool, GUAC_CLIENT_MAX_STREAMS);
+    if (stream_index == -1)
         return NULL;
 
-    /* Allocate stream */
-    stream_index = guac_pool_next_int(client->__stream_pool);
-
     /* Initialize stream with odd index (even indices are user-level) */
     allocd_stream = &(client->__output_streams[stream_index]);
     allocd_stream->index = (stream_index * 2) + 1;
@@ -195,6 +197,18 @@ void guac_client_free(guac_client* client) {
 
     }
 
+    /* Report and free statistics, if collected */
+    if (client->stats != NULL) {
+
+        guac_stats_log(client->stats, client, client->stats_log_level);
+
+        if (client->stats_handler)
+            client->stats_handler(client, client->stats);
+
+        guac_stats_free(client->stats);
+
+    }
+
     /* Free socket */
     guac_socket_free(client->socket);
 
@@ -280,10 +294,25 @@ int guac_client_add_user(guac_client* client, guac_user* user, int argc, char**
 
     int retval = 0;
 
+    /* Count all instructions sent to the user, if collecting statistics */
+    user->socket->stats = client->stats;
+
     /* Call handler, if defined */
     if (client->join_handler)
         retval = client->join_handler(user, argc, argv);
 
+    /* Queue all further output to the user, such that a user which is slow to
+     * receive data cannot block other users of the same connection */
+    if (retval == 0) {
+        guac_socket* queue = guac_socket_queue(user->socket,
+                GUAC_USER_MAX_QUEUED_OUTPUT);
+        if (queue != NULL) {
+            queue->stats = client->stats;
+            user->__raw_socket = user->socket;
+            user->socket = queue;
+        }
+    }
+
     pthread_rwlock_wrlock(&(client->__users_lock));
 
     /* Add to list if join was successful */
@@ -338,6 +367,13 @@ void guac_client_remove_user(guac_client* client, guac_user* user) {
     else if (client->leave_handler)
         client->leave_handler(user);
 
+    /* Write any remaining queued output, restoring the original socket */
+    if (user->__raw_socket != NULL) {
+        guac_socket_free(user->socket);
+        user->socket = user->__raw_socket;
+        user->__raw_socket = NULL;
+    }
+
 }
 
 void guac_client_foreach_user(guac_client* client, guac_user_callback* callback, void* data) {
@@ -510,6 +546,26 @@ int guac_client_get_processing_lag(guac_client* client) {
 
 }
 
+int guac_client_enable_stats(guac_client* client,
+        guac_client_log_level level) {
+
+    /* Statistics need only be allocated once */
+    if (client->stats == NULL) {
+
+        client->stats = guac_stats_alloc();
+        if (client->stats == NULL)
+            return 1;
+
+        /* Count all instructions broadcast to users */
+        client->socket->stats = client->stats;
+
+    }
+
+    client->stats_log_level = level;
+    return 0;
+
+}
+
 void guac_client_stream_png(guac_client* client, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
         cairo_surface_t* surface) {
@@ -517,17 +573,410 @@ void guac_client_stream_png(guac_client* client, guac_socket* socket,
     /* Allocate new stream for image */
     guac_stream* stream = guac_client_alloc_stream(client);
 
+    /* Refuse to stream if no streams remain */
+    if (stream == NULL)
+        return;
+
+    guac_client_encode_png(client, socket, stream, mode, layer, x, y,
+            surface);
+
+    /* Free allocated stream */
+    guac_client_free_stream(client, stream);
+
+}
+
+void guac_client_encode_png(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface) {
+
+    /* Compress according to the lag of all users */
+    int level = guac_quality_get_tier_compression(
+            guac_quality_get_tier(guac_client_get_processing_lag(client)));
+
     /* Declare stream as containing image data */
     guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y);
 
     /* Write PNG data */
-    guac_png_write(socket, stream, surface);
+    uint64_t start = guac_stats_start(client->stats);
+    guac_png_write(socket, stream, surface, level);
+    guac_stats_record_encode(client->stats, GUAC_STATS_FORMAT_PNG, start);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
 
+}
+
+/**
+ * Lossy image data which has been encoded at the quality of a particular
+ * quality tier, including the "img" and "end" instructions which declare and
+ * terminate its stream.
+ */
+typedef struct __guac_client_tier_image {
+
+    /**
+     * Whether encoding has been attempted for this tier.
+     */
+    int encoded;
+
+    /**
+     * Whether an error occurred while encoding for this tier, in which case
+     * no data is sent to users of this tier.
+     */
+    int failed;
+
+    /**
+     * The encoded instructions.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of encoded instructions within buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for buffer.
+     */
+    size_t size;
+
+} __guac_client_tier_image;
+
+/**
+ * An image which must be sent to all users of a client, encoded at most once
+ * per quality tier in use.
+ */
+typedef struct __guac_client_tiered_image {
+
+    /**
+     * The stream to use for the image. The same stream index is used for all
+     * tiers, as each user receives only one of them.
+     */
+    guac_stream* stream;
+
+    /**
+     * The composite mode to use when rendering the image.
+     */
+    guac_composite_mode mode;
+
+    /**
+     * The destination layer.
+     */
+    const guac_layer* layer;
+
+    /**
+     * The X coordinate of the upper-left corner of the destination
+     * rectangle.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the destination
+     * rectangle.
+     */
+    int y;
+
+    /**
+     * The image data to encode.
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * Non-zero if the image should be encoded as WebP, zero for JPEG.
+     */
+    int webp;
+
+    /**
+     * The statistics of the client streaming the image, or NULL if
+     * statistics are not being collected.
+     */
+    guac_stats* stats;
+
+    /**
+     * The image data encoded for each quality tier, if needed.
+     */
+    __guac_client_tier_image tiers[GUAC_QUALITY_TIERS];
+
+} __guac_client_tiered_image;
+
+/**
+ * Socket write handler which appends all written data to the
+ * __guac_client_tier_image associated with the socket.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or -1 if the buffer could not be grown.
+ */
+static ssize_t __guac_client_tier_image_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    __guac_client_tier_image* image = (__guac_client_tier_image*) socket->data;
+
+    /* Grow buffer as necessary */
+    if (image->length + count > image->size) {
+
+        size_t size = image->size ? image->size : 65536;
+        while (size < image->length + count)
+            size *= 2;
+
+        char* buffer = realloc(image->buffer, size);
+        if (buffer == NULL) {
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Insufficient memory to buffer image";
+            return -1;
+        }
+
+        image->buffer = buffer;
+        image->size = size;
+
+    }
+
+    memcpy(image->buffer + image->length, buf, count);
+    image->length += count;
+
+    return count;
+
+}
+
+/**
+ * Encodes the given tiered image at the quality of the given tier, storing
+ * the resulting instructions within that tier's __guac_client_tier_image.
+ *
+ * @param image
+ *     The image to encode.
+ *
+ * @param tier
+ *     The quality tier to encode the image for.
+ */
+static void __guac_client_encode_tier(__guac_client_tiered_image* image,
+        int tier) {
+
+    __guac_client_tier_image* tier_image = &(image->tiers[tier]);
+    int quality = guac_quality_get_tier_quality(tier);
+
+    tier_image->encoded = 1;
+
+    /* Capture encoded instructions in memory */
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL) {
+        tier_image->failed = 1;
+        return;
+    }
+
+    socket->data = tier_image;
+    socket->write_handler = __guac_client_tier_image_write_handler;
+    socket->stats = image->stats;
+
+    /* Declare stream as containing image data */
+    if (guac_protocol_send_img(socket, image->stream, image->mode,
+                image->layer, image->webp ? "image/webp" : "image/jpeg",
+                image->x, image->y))
+        tier_image->failed = 1;
+
+    /* Write image data */
+#ifdef ENABLE_WEBP
+    else if (image->webp) {
+        uint64_t start = guac_stats_start(image->stats);
+        if (guac_webp_write(socket, image->stream, image->surface, quality, 0))
+            tier_image->failed = 1;
+        guac_stats_record_encode(image->stats, GUAC_STATS_FORMAT_WEBP, start);
+    }
+#endif
+    else if (!image->webp) {
+        uint64_t start = guac_stats_start(image->stats);
+        if (guac_jpeg_write(socket, image->stream, image->surface, quality))
+            tier_image->failed = 1;
+        guac_stats_record_encode(image->stats, GUAC_STATS_FORMAT_JPEG, start);
+    }
+
+    /* Terminate stream */
+    if (guac_protocol_send_end(socket, image->stream))
+        tier_image->failed = 1;
+
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Callback invoked by guac_client_foreach_user() which records the quality
+ * tier of the given user.
+ *
+ * @param user
+ *     The user whose quality tier should be recorded.
+ *
+ * @param data
+ *     A pointer to an int bitmask in which the bit corresponding to each
+ *     quality tier in use is set.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __guac_client_mark_tier(guac_user* user, void* data) {
+
+    int* tiers = (int*) data;
+    *tiers |= 1 << guac_quality_get_tier(user->processing_lag);
+
+    return NULL;
+
+}
+
+/**
+ * Callback invoked by guac_client_foreach_user() which sends a tiered image
+ * to the given user at the quality of that user's tier. If the user has
+ * changed tiers since the image was encoded, the nearest tier which was
+ * encoded is used instead, preferring lower quality. If the write fails, the
+ * user is signalled to stop with guac_user_stop().
+ *
+ * @param user
+ *     The user to send the image to.
+ *
+ * @param data
+ *     A pointer to the __guac_client_tiered_image to send.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __guac_client_write_tier(guac_user* user, void* data) {
+
+    __guac_client_tiered_image* image = (__guac_client_tiered_image*) data;
+
+    int tier = guac_quality_get_tier(user->processing_lag);
+    __guac_client_tier_image* tier_image = NULL;
+
+    /* Find nearest encoded tier, first trying lower quality */
+    int distance;
+    for (distance = 0; distance < GUAC_QUALITY_TIERS; distance++) {
+
+        if (tier + distance < GUAC_QUALITY_TIERS
+                && image->tiers[tier + distance].encoded) {
+            tier_image = &(image->tiers[tier + distance]);
+            break;
+        }
+
+        if (tier - distance >= 0 && image->tiers[tier - distance].encoded) {
+            tier_image = &(image->tiers[tier - distance]);
+            break;
+        }
+
+    }
+
+    if (tier_image == NULL || tier_image->failed)
+        return NULL;
+
+    /* Write all instructions as a single unit, disconnect on failure */
+    guac_socket_instruction_begin(user->socket);
+    if (guac_socket_write(user->socket, tier_image->buffer,
+                tier_image->length))
+        guac_user_stop(user);
+    guac_socket_instruction_end(user->socket);
+
+    return NULL;
+
+}
+
+/**
+ * Streams the given image to all users of the given client, encoding the
+ * image separately for each quality tier in use. If all users share the same
+ * tier, the image is written to the given broadcast socket directly. Each
+ * tier is encoded before its data is sent to any user, such that the lock
+ * guarding the list of users is not held while encoding. The image is always
+ * lossy.
+ *
+ * @param client
+ *     The client whose users should receive the image.
+ *
+ * @param socket
+ *     The broadcast socket of the given client.
+ *
+ * @param mode
+ *     The composite mode to use when rendering the image over the given layer.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param surface
+ *     A Cairo surface containing the image data to be streamed.
+ *
+ * @param webp
+ *     Non-zero to encode the image as WebP, zero to encode as JPEG.
+ */
+static void __guac_client_stream_tiered(guac_client* client,
+        guac_socket* socket, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int webp) {
+
+    int i;
+    int tiers = 0;
+
+    /* Determine which quality tiers are in use */
+    guac_client_foreach_user(client, __guac_client_mark_tier, &tiers);
+
+    /* Encode only once if all users share the same tier */
+    for (i = 0; i < GUAC_QUALITY_TIERS; i++) {
+        if (tiers == (1 << i)) {
+
+            int quality = guac_quality_get_tier_quality(i);
+
+            if (webp)
+                guac_client_stream_webp(client, socket, mode, layer, x, y,
+                        surface, quality, 0);
+            else
+                guac_client_stream_jpeg(client, socket, mode, layer, x, y,
+                        surface, quality);
+
+            return;
+
+        }
+    }
+
+    /* Nothing to do if there are no users */
+    if (tiers == 0)
+        return;
+
+    __guac_client_tiered_image image = {
+        .stream  = guac_client_alloc_stream(client),
+        .mode    = mode,
+        .layer   = layer,
+        .x       = x,
+        .y       = y,
+        .surface = surface,
+        .webp    = webp,
+        .stats   = client->stats
+    };
+
+    /* Refuse to stream if no streams remain */
+    if (image.stream == NULL)
+        return;
+
+    /* Encode once per tier in use */
+    for (i = 0; i < GUAC_QUALITY_TIERS; i++) {
+        if (tiers & (1 << i))
+            __guac_client_encode_tier(&image, i);
+    }
+
+    /* Send to each user */
+    guac_client_foreach_user(client, __guac_client_write_tier, &image);
+
+    for (i = 0; i < GUAC_QUALITY_TIERS; i++)
+        free(image.tiers[i].buffer);
+
     /* Free allocated stream */
-    guac_client_free_stream(client, stream);
+    guac_client_free_stream(client, image.stream);
 
 }
 
@@ -535,21 +984,53 @@ void guac_client_stream_jpeg(guac_client* client, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
         cairo_surface_t* surface, int quality) {
 
+    /* Choose quality independently for each user if requested. Only the
+     * broadcast socket reaches users of differing tiers, and a wrapped
+     * broadcast socket (such as one which is also writing a session
+     * recording) must receive the same data as the users. */
+    if (quality == GUAC_CLIENT_ADAPTIVE_QUALITY && socket == client->socket
+            && guac_socket_is_broadcast(socket)) {
+        __guac_client_stream_tiered(client, socket, mode, layer, x, y,
+                surface, 0);
+        return;
+    }
+
     /* Allocate new stream for image */
     guac_stream* stream = guac_client_alloc_stream(client);
 
+    /* Refuse to stream if no streams remain */
+    if (stream == NULL)
+        return;
+
+    guac_client_encode_jpeg(client, socket, stream, mode, layer, x, y,
+            surface, quality);
+
+    /* Free allocated stream */
+    guac_client_free_stream(client, stream);
+
+}
+
+void guac_client_encode_jpeg(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality) {
+
+    /* Account for the lag of all users if quality is adaptive */
+    if (quality == GUAC_CLIENT_ADAPTIVE_QUALITY)
+        quality = guac_quality_get_tier_quality(
+                guac_quality_get_tier(guac_client_get_processing_lag(client)));
+
     /* Declare stream as containing image data */
     guac_protocol_send_img(socket, stream, mode, layer, "image/jpeg", x, y);
 
     /* Write JPEG data */
+    uint64_t start = guac_stats_start(client->stats);
     guac_jpeg_write(socket, stream, surface, quality);
+    guac_stats_record_encode(client->stats, GUAC_STATS_FORMAT_JPEG, start);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
 
-    /* Free allocated stream */
-    guac_client_free_stream(client, stream);
-
 }
 
 void guac_client_stream_webp(guac_client* client, guac_socket* socket,
@@ -557,20 +1038,57 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
         cairo_surface_t* surface, int quality, int lossless) {
 
 #ifdef ENABLE_WEBP
+    /* Choose quality independently for each user if requested. Only the
+     * broadcast socket reaches users of differing tiers, a wrapped broadcast
+     * socket (such as one which is also writing a session recording) must
+     * receive the same data as the users, and lossless images are identical
+     * regardless of tier. */
+    if (quality == GUAC_CLIENT_ADAPTIVE_QUALITY && socket == client->socket
+            && guac_socket_is_broadcast(socket) && !lossless) {
+        __guac_client_stream_tiered(client, socket, mode, layer, x, y,
+                surface, 1);
+        return;
+    }
+
     /* Allocate new stream for image */
     guac_stream* stream = guac_client_alloc_stream(client);
 
+    /* Refuse to stream if no streams remain */
+    if (stream == NULL)
+        return;
+
+    guac_client_encode_webp(client, socket, stream, mode, layer, x, y,
+            surface, quality, lossless);
+
+    /* Free allocated stream */
+    guac_client_free_stream(client, stream);
+#else
+    /* Do nothing if WebP support is not built in */
+#endif
+
+}
+
+void guac_client_encode_webp(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless) {
+
+#ifdef ENABLE_WEBP
+    /* Account for the lag of all users if quality is adaptive */
+    if (quality == GUAC_CLIENT_ADAPTIVE_QUALITY)
+        quality = guac_quality_get_tier_quality(
+                guac_quality_get_tier(guac_client_get_processing_lag(client)));
+
     /* Declare stream as containing image data */
     guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
 
     /* Write WebP data */
+    uint64_t start = guac_stats_start(client->stats);
     guac_webp_write(socket, stream, surface, quality, lossless);
+    guac_stats_record_encode(client->stats, GUAC_STATS_FORMAT_WEBP, start);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
-
-    /* Free allocated stream */
-    guac_client_free_stream(client, stream);
 #else
     /* Do nothing if WebP support is not built in */
 #endif
@@ -23,12 +23,14 @@
 #include "error.h"
 #include "palette.h"
 #include "protocol.h"
+#include "scratch.h"
 #include "stream.h"
 
 #include <cairo/cairo.h>
 #include <jpeglib.h>
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -164,6 +166,104 @@ static void jpeg_guac_dest(j_compress_ptr cinfo, guac_socket* socket,
 
 }
 
+/**
+ * Encoder state which is retained between images by each thread. Unlike
+ * libpng, libjpeg allows a single compression structure to be reused for any
+ * number of images, retaining its destination manager and tables.
+ */
+typedef struct guac_jpeg_context {
+
+    /**
+     * The libjpeg compression structure used for all images.
+     */
+    struct jpeg_compress_struct cinfo;
+
+    /**
+     * The libjpeg error handler associated with cinfo.
+     */
+    struct jpeg_error_mgr jerr;
+
+    /**
+     * Buffer receiving each scanline converted to RGB, if libjpeg cannot
+     * read Cairo image data directly.
+     */
+    guac_scratch scanline;
+
+} guac_jpeg_context;
+
+/**
+ * The key used to store the guac_jpeg_context of each thread.
+ */
+static pthread_key_t guac_jpeg_context_key;
+
+/**
+ * Guard ensuring guac_jpeg_context_key is created only once.
+ */
+static pthread_once_t guac_jpeg_context_key_init = PTHREAD_ONCE_INIT;
+
+/**
+ * Frees the given guac_jpeg_context and all associated resources. This
+ * function is invoked automatically as each thread exits.
+ *
+ * @param data
+ *     The guac_jpeg_context to free.
+ */
+static void guac_jpeg_free_context(void* data) {
+
+    guac_jpeg_context* context = (guac_jpeg_context*) data;
+
+    jpeg_destroy_compress(&context->cinfo);
+    guac_scratch_free(&context->scanline);
+    free(context);
+
+}
+
+/**
+ * Creates guac_jpeg_context_key. This function is invoked only once, via
+ * pthread_once().
+ */
+static void guac_jpeg_alloc_context_key() {
+
+    /* Create key, destroy any allocated context on thread exit */
+    pthread_key_create(&guac_jpeg_context_key, guac_jpeg_free_context);
+
+}
+
+/**
+ * Returns the encoder context of the current thread, allocating that context
+ * if it does not yet exist.
+ *
+ * @return
+ *     The encoder context of the current thread, or NULL if the context
+ *     could not be allocated.
+ */
+static guac_jpeg_context* guac_jpeg_get_context() {
+
+    /* Init context key, if not already initialized */
+    pthread_once(&guac_jpeg_context_key_init, guac_jpeg_alloc_context_key);
+
+    /* Retrieve thread-local context */
+    guac_jpeg_context* context =
+        (guac_jpeg_context*) pthread_getspecific(guac_jpeg_context_key);
+
+    /* Allocate thread-local context if not already allocated */
+    if (context == NULL) {
+
+        context = calloc(1, sizeof(guac_jpeg_context));
+        if (context == NULL)
+            return NULL;
+
+        context->cinfo.err = jpeg_std_error(&context->jerr);
+        jpeg_create_compress(&context->cinfo);
+
+        pthread_setspecific(guac_jpeg_context_key, context);
+
+    }
+
+    return context;
+
+}
+
 int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         cairo_surface_t* surface, int quality) {
 
@@ -185,48 +285,57 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Prepare JPEG bits */
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+    /* Reuse the JPEG compression state of this thread */
+    guac_jpeg_context* context = guac_jpeg_get_context();
+    if (context == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory for JPEG encoder";
+        return -1;
+    }
+
+    j_compress_ptr cinfo = &context->cinfo;
 
     /* Write JPEG directly to given stream */
-    jpeg_guac_dest(&cinfo, socket, stream);
+    jpeg_guac_dest(cinfo, socket, stream);
 
-    cinfo.image_width = width; /* image width and height, in pixels */
-    cinfo.image_height = height;
-    cinfo.arith_code = TRUE;
+    cinfo->image_width = width; /* image width and height, in pixels */
+    cinfo->image_height = height;
+    cinfo->arith_code = TRUE;
 
 #ifdef JCS_EXTENSIONS
     /* The Turbo JPEG extentions allows us to use the Cairo surface
      * (BGRx) as input without converting it */
-    cinfo.input_components = 4;
-    cinfo.in_color_space = JCS_EXT_BGRX;
+    cinfo->input_components = 4;
+    cinfo->in_color_space = JCS_EXT_BGRX;
 #else
     /* Standard JPEG supports RGB as input so we will have to convert
      * the contents of the Cairo surface from (BGRx) to RGB */
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
 
-    /* Create a buffer for the write scan line which is where we will
+    /* Reserve a buffer for the write scan line which is where we will
      * put the converted pixels (BGRx -> RGB) */
-    int write_stride = cinfo.image_width * cinfo.input_components;
-    unsigned char *scanline_data = malloc(write_stride);
-    memset(scanline_data, 0, write_stride);
+    int write_stride = cinfo->image_width * cinfo->input_components;
+    unsigned char *scanline_data = guac_scratch_reserve(&context->scanline,
+            write_stride);
+    if (scanline_data == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory for JPEG scanline";
+        return -1;
+    }
 #endif
 
     /* Initialize the JPEG compressor */
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    jpeg_start_compress(cinfo, TRUE);
 
     JSAMPROW row_pointer[1]; /* pointer to a single row */
 
     /* Write scanlines to be used in JPEG compression */
-    while (cinfo.next_scanline < cinfo.image_height) {
+    while (cinfo->next_scanline < cinfo->image_height) {
 
-        int row_offset = stride * cinfo.next_scanline;
+        int row_offset = stride * cinfo->next_scanline;
 
 #ifdef JCS_EXTENSIONS
         /* In Turbo JPEG we can use the raw BGRx scanline  */
@@ -250,19 +359,16 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         row_pointer[0] = scanline_data;
 #endif
 
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        jpeg_write_scanlines(cinfo, row_pointer, 1);
     }
 
 #ifndef JCS_EXTENSIONS
-    free(scanline_data);
+    guac_scratch_trim(&context->scanline);
 #endif
 
-    /* Finalize compression */
-    jpeg_finish_compress(&cinfo);
-
-    /* Clean up */
-    jpeg_destroy_compress(&cinfo);
+    /* Finalize compression, leaving the compression structure ready for
+     * the next image */
+    jpeg_finish_compress(cinfo);
     return 0;
 
 }
-
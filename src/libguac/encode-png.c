@@ -23,6 +23,7 @@
 #include "error.h"
 #include "palette.h"
 #include "protocol.h"
+#include "scratch.h"
 #include "stream.h"
 
 #include <png.h>
@@ -33,10 +34,120 @@
 #endif
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <setjmp.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+
+/**
+ * The highest zlib compression level at which opaque images which cannot use
+ * a palette are encoded using a single, fast filter and run-length encoding,
+ * rather than libpng's default adaptive filtering.
+ */
+#define GUAC_PNG_FAST_LEVEL 2
+
+/**
+ * The alignment of each block of memory allocated from the arena of a
+ * guac_png_context, in bytes.
+ */
+#define GUAC_PNG_ARENA_ALIGNMENT 16
+
+/**
+ * The libpng transformations which convert each row of CAIRO_FORMAT_RGB24
+ * image data, as laid out in memory on the current platform, to 24-bit RGB.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define GUAC_PNG_RGB24_TRANSFORMS PNG_TRANSFORM_STRIP_FILLER_BEFORE
+#else
+#define GUAC_PNG_RGB24_TRANSFORMS \
+    (PNG_TRANSFORM_STRIP_FILLER_AFTER | PNG_TRANSFORM_BGR)
+#endif
+
+/**
+ * Encoder state which is retained between images by each thread, such that
+ * encoding an image allocates no memory once that state has grown to
+ * accommodate the images being encoded.
+ */
+typedef struct guac_png_context {
+
+    /**
+     * The palette used for images having few enough colors, reset for each
+     * image.
+     */
+    guac_palette* palette;
+
+    /**
+     * The array of row pointers passed to libpng.
+     */
+    guac_scratch rows;
+
+    /**
+     * Image data converted to the form required by libpng, if the image
+     * cannot be written directly.
+     */
+    guac_scratch data;
+
+    /**
+     * Memory from which all allocations by libpng and zlib are made. The
+     * arena is reclaimed as a whole once each image has been written, as
+     * libpng write structures cannot themselves be reused.
+     */
+    guac_scratch arena;
+
+    /**
+     * The number of bytes of the arena allocated for the current image.
+     */
+    size_t arena_used;
+
+    /**
+     * The total number of bytes requested by libpng and zlib for the
+     * current image, whether or not those requests fit within the arena.
+     */
+    size_t arena_needed;
+
+} guac_png_context;
+
+/**
+ * The key used to store the guac_png_context of each thread.
+ */
+static pthread_key_t guac_png_context_key;
+
+/**
+ * Guard ensuring guac_png_context_key is created only once.
+ */
+static pthread_once_t guac_png_context_key_init = PTHREAD_ONCE_INIT;
+
+/**
+ * Frees the given guac_png_context and all associated resources. This
+ * function is invoked automatically as each thread exits.
+ *
+ * @param data
+ *     The guac_png_context to free.
+ */
+static void guac_png_free_context(void* data) {
+
+    guac_png_context* context = (guac_png_context*) data;
+
+    guac_palette_free(context->palette);
+    guac_scratch_free(&context->rows);
+    guac_scratch_free(&context->data);
+    guac_scratch_free(&context->arena);
+    free(context);
+
+}
+
+/**
+ * Creates guac_png_context_key. This function is invoked only once, via
+ * pthread_once().
+ */
+static void guac_png_alloc_context_key() {
+
+    /* Create key, destroy any allocated context on thread exit */
+    pthread_key_create(&guac_png_context_key, guac_png_free_context);
+
+}
 
 /**
  * Data describing the current write state of PNG data.
@@ -265,15 +376,279 @@ static void guac_png_flush_handler(png_structp png) {
 
 }
 
+/**
+ * Returns the encoder context of the current thread, allocating that context
+ * if it does not yet exist.
+ *
+ * @return
+ *     The encoder context of the current thread, or NULL if the context
+ *     could not be allocated.
+ */
+static guac_png_context* guac_png_get_context() {
+
+    /* Init context key, if not already initialized */
+    pthread_once(&guac_png_context_key_init, guac_png_alloc_context_key);
+
+    /* Retrieve thread-local context */
+    guac_png_context* context =
+        (guac_png_context*) pthread_getspecific(guac_png_context_key);
+
+    /* Allocate thread-local context if not already allocated */
+    if (context == NULL) {
+
+        context = calloc(1, sizeof(guac_png_context));
+        if (context == NULL)
+            return NULL;
+
+        context->palette = guac_palette_alloc();
+        if (context->palette == NULL) {
+            free(context);
+            return NULL;
+        }
+
+        pthread_setspecific(guac_png_context_key, context);
+
+    }
+
+    return context;
+
+}
+
+#ifdef PNG_USER_MEM_SUPPORTED
+/**
+ * Allocates memory for libpng (including the zlib state used by libpng) from
+ * the arena of the encoder context associated with the given PNG write
+ * structure, falling back to malloc() if the arena is exhausted. This handler
+ * is called by libpng for all allocations.
+ *
+ * @param png
+ *     The PNG write structure requesting memory, whose memory pointer is the
+ *     guac_png_context of the current thread.
+ *
+ * @param size
+ *     The number of bytes required.
+ *
+ * @return
+ *     A pointer to the allocated memory, or NULL if allocation fails.
+ */
+static png_voidp guac_png_arena_malloc(png_structp png,
+        png_alloc_size_t size) {
+
+    guac_png_context* context = (guac_png_context*) png_get_mem_ptr(png);
+
+    size_t aligned = (size + GUAC_PNG_ARENA_ALIGNMENT - 1)
+                   & ~((size_t) GUAC_PNG_ARENA_ALIGNMENT - 1);
+
+    /* Record requirements of this image, such that the arena can be grown
+     * to accommodate similar images */
+    context->arena_needed += aligned;
+
+    if (context->arena_used + aligned <= context->arena.size) {
+        png_voidp memory = (char*) context->arena.data + context->arena_used;
+        context->arena_used += aligned;
+        return memory;
+    }
+
+    return malloc(size);
+
+}
+
+/**
+ * Frees memory allocated by guac_png_arena_malloc(). Memory within the arena
+ * is reclaimed only once the entire image has been written, and is thus
+ * ignored here. This handler is called by libpng for all deallocations.
+ *
+ * @param png
+ *     The PNG write structure freeing memory, whose memory pointer is the
+ *     guac_png_context of the current thread.
+ *
+ * @param memory
+ *     The memory to free.
+ */
+static void guac_png_arena_free(png_structp png, png_voidp memory) {
+
+    guac_png_context* context = (guac_png_context*) png_get_mem_ptr(png);
+
+    uintptr_t address = (uintptr_t) memory;
+    uintptr_t arena = (uintptr_t) context->arena.data;
+
+    if (address < arena || address >= arena + context->arena.size)
+        free(memory);
+
+}
+#endif
+
+/**
+ * Releases the per-image resources of the given encoder context once an
+ * image has been written, reclaiming the entire arena and growing it if the
+ * image needed more memory than the arena provided.
+ *
+ * @param context
+ *     The encoder context to release.
+ */
+static void guac_png_release_context(guac_png_context* context) {
+
+    if (context->arena_needed > context->arena.size
+            && context->arena_needed <= GUAC_SCRATCH_MAX_RETAINED)
+        guac_scratch_reserve(&context->arena, context->arena_needed);
+
+    context->arena_used = 0;
+    context->arena_needed = 0;
+
+    guac_scratch_trim(&context->rows);
+    guac_scratch_trim(&context->data);
+
+}
+
+/**
+ * Converts the given opaque image data into palette indices using the
+ * palette of the given encoder context, pointing each of the given rows at
+ * the converted data.
+ *
+ * @param context
+ *     The encoder context whose palette and scratch buffers should be used.
+ *
+ * @param data
+ *     The image data to convert, in the format of a CAIRO_FORMAT_RGB24
+ *     surface.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of image data.
+ *
+ * @param rows
+ *     An array of height row pointers which will be pointed at each row of
+ *     converted data.
+ *
+ * @return
+ *     Zero if the image was converted, non-zero if the image has too many
+ *     colors for a palette or memory could not be allocated.
+ */
+static int guac_png_index(guac_png_context* context, unsigned char* data,
+        int width, int height, int stride, png_byte** rows) {
+
+    int y;
+
+    png_byte* indices = guac_scratch_reserve(&context->data,
+            (size_t) width * height);
+    if (indices == NULL)
+        return -1;
+
+    guac_palette_reset(context->palette);
+
+    for (y = 0; y < height; y++) {
+
+        rows[y] = indices;
+
+        if (guac_palette_index_row(context->palette, (uint32_t*) data,
+                    width, indices))
+            return -1;
+
+        /* Advance to next data row */
+        data += stride;
+        indices += width;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Converts the given image data, which uses premultiplied alpha, into
+ * non-premultiplied RGBA as required by PNG, pointing each of the given rows
+ * at the converted data.
+ *
+ * @param context
+ *     The encoder context whose scratch buffers should be used.
+ *
+ * @param data
+ *     The image data to convert, in the format of a CAIRO_FORMAT_ARGB32
+ *     surface.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of image data.
+ *
+ * @param rows
+ *     An array of height row pointers which will be pointed at each row of
+ *     converted data.
+ *
+ * @return
+ *     Zero if the image was converted, non-zero if memory could not be
+ *     allocated.
+ */
+static int guac_png_unpremultiply(guac_png_context* context,
+        unsigned char* data, int width, int height, int stride,
+        png_byte** rows) {
+
+    int x, y;
+
+    png_byte* converted = guac_scratch_reserve(&context->data,
+            (size_t) width * height * 4);
+    if (converted == NULL)
+        return -1;
+
+    for (y = 0; y < height; y++) {
+
+        uint32_t* src = (uint32_t*) data;
+        png_byte* dst = converted;
+
+        rows[y] = converted;
+
+        for (x = 0; x < width; x++) {
+
+            uint32_t pixel = *(src++);
+            unsigned int alpha = pixel >> 24;
+
+            /* Fully-transparent pixels have no meaningful color */
+            if (alpha == 0) {
+                dst[0] = dst[1] = dst[2] = dst[3] = 0;
+            }
+
+            /* Undo premultiplication, rounding as Cairo does */
+            else {
+                dst[0] = (((pixel >> 16) & 0xFF) * 255 + alpha / 2) / alpha;
+                dst[1] = (((pixel >>  8) & 0xFF) * 255 + alpha / 2) / alpha;
+                dst[2] = (( pixel        & 0xFF) * 255 + alpha / 2) / alpha;
+                dst[3] = alpha;
+            }
+
+            dst += 4;
+
+        }
+
+        /* Advance to next data row */
+        data += stride;
+        converted += width * 4;
+
+    }
+
+    return 0;
+
+}
+
 int guac_png_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface) {
+        cairo_surface_t* surface, int level) {
 
     png_structp png;
     png_infop png_info;
     png_byte** png_rows;
+    int color_type;
+    int transforms;
     int bpp;
 
-    int x, y;
+    int y;
 
     guac_png_write_state write_state;
 
@@ -284,30 +659,75 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     int stride = cairo_image_surface_get_stride(surface);
     unsigned char* data = cairo_image_surface_get_data(surface);
 
-    /* If not RGB24, use Cairo PNG writer */
-    if (format != CAIRO_FORMAT_RGB24 || data == NULL)
+    /* If neither RGB24 nor ARGB32, use Cairo PNG writer */
+    if ((format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32)
+            || data == NULL || width <= 0 || height <= 0)
         return guac_png_cairo_write(socket, stream, surface);
 
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Attempt to build palette */
-    guac_palette* palette = guac_palette_alloc(surface);
+    /* Resort to Cairo PNG writer if encoder state cannot be allocated */
+    guac_png_context* context = guac_png_get_context();
+    if (context == NULL)
+        return guac_png_cairo_write(socket, stream, surface);
 
-    /* If not possible, resort to Cairo PNG writer */
-    if (palette == NULL)
+    png_rows = guac_scratch_reserve(&context->rows,
+            sizeof(png_byte*) * height);
+    if (png_rows == NULL)
         return guac_png_cairo_write(socket, stream, surface);
 
-    /* Calculate BPP from palette size */
-    if      (palette->size <= 2)  bpp = 1;
-    else if (palette->size <= 4)  bpp = 2;
-    else if (palette->size <= 16) bpp = 4;
-    else                          bpp = 8;
+    /* Use a palette for opaque images if possible */
+    if (format == CAIRO_FORMAT_RGB24
+            && guac_png_index(context, data, width, height, stride,
+                png_rows) == 0) {
+
+        color_type = PNG_COLOR_TYPE_PALETTE;
+        transforms = PNG_TRANSFORM_PACKING;
+
+        /* Calculate BPP from palette size */
+        if      (context->palette->size <= 2)  bpp = 1;
+        else if (context->palette->size <= 4)  bpp = 2;
+        else if (context->palette->size <= 16) bpp = 4;
+        else                                   bpp = 8;
+
+    }
+
+    /* Otherwise, write opaque image data directly, letting libpng strip the
+     * unused byte of each pixel */
+    else if (format == CAIRO_FORMAT_RGB24) {
+
+        for (y = 0; y < height; y++)
+            png_rows[y] = data + y * stride;
+
+        color_type = PNG_COLOR_TYPE_RGB;
+        transforms = GUAC_PNG_RGB24_TRANSFORMS;
+        bpp = 8;
+
+    }
+
+    /* Image data with alpha must first be unpremultiplied */
+    else {
+
+        if (guac_png_unpremultiply(context, data, width, height, stride,
+                    png_rows))
+            return guac_png_cairo_write(socket, stream, surface);
+
+        color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+        transforms = PNG_TRANSFORM_IDENTITY;
+        bpp = 8;
+
+    }
 
     /* Set up PNG writer */
+#ifdef PNG_USER_MEM_SUPPORTED
+    png = png_create_write_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+            context, guac_png_arena_malloc, guac_png_arena_free);
+#else
     png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+#endif
     if (!png) {
-        guac_palette_free(palette);
+        guac_png_release_context(context);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create write structure";
         return -1;
@@ -316,7 +736,7 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     png_info = png_create_info_struct(png);
     if (!png_info) {
         png_destroy_write_struct(&png, NULL);
-        guac_palette_free(palette);
+        guac_png_release_context(context);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create info structure";
         return -1;
@@ -325,7 +745,7 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     /* Set error handler */
     if (setjmp(png_jmpbuf(png))) {
         png_destroy_write_struct(&png, &png_info);
-        guac_palette_free(palette);
+        guac_png_release_context(context);
         guac_error = GUAC_STATUS_IO_ERROR;
         guac_error_message = "libpng output error";
         return -1;
@@ -341,28 +761,20 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
             guac_png_write_handler,
             guac_png_flush_handler);
 
-    /* Copy data from surface into PNG data */
-    png_rows = (png_byte**) malloc(sizeof(png_byte*) * height);
-    for (y=0; y<height; y++) {
+    png_set_compression_level(png, level);
 
-        /* Allocate new PNG row */
-        png_byte* row = (png_byte*) malloc(sizeof(png_byte) * width);
-        png_rows[y] = row;
-
-        /* Copy data from surface into current row */
-        for (x=0; x<width; x++) {
-
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
-
-            /* Set index in row */
-            row[x] = guac_palette_find(palette, color);
-
-        }
-
-        /* Advance to next data row */
-        data += stride;
+    /* Palette indices do not benefit from filtering, while repeated runs of
+     * indices are matched well by the default strategy */
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+        png_set_compression_strategy(png, Z_DEFAULT_STRATEGY);
+    }
 
+    /* When encoding quickly, avoid the cost of trying every filter, and
+     * compress the filtered data as runs alone */
+    else if (level >= 0 && level <= GUAC_PNG_FAST_LEVEL) {
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+        png_set_compression_strategy(png, Z_RLE);
     }
 
     /* Write image info */
@@ -372,33 +784,27 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
         width,
         height,
         bpp,
-        PNG_COLOR_TYPE_PALETTE,
+        color_type,
         PNG_INTERLACE_NONE,
         PNG_COMPRESSION_TYPE_DEFAULT,
         PNG_FILTER_TYPE_DEFAULT
     );
 
     /* Write palette */
-    png_set_PLTE(png, png_info, palette->colors, palette->size);
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_PLTE(png, png_info, context->palette->colors,
+                context->palette->size);
 
     /* Write image */
     png_set_rows(png, png_info, png_rows);
-    png_write_png(png, png_info, PNG_TRANSFORM_PACKING, NULL);
+    png_write_png(png, png_info, transforms, NULL);
 
     /* Finish write */
     png_destroy_write_struct(&png, &png_info);
-
-    /* Free palette */
-    guac_palette_free(palette);
-
-    /* Free PNG data */
-    for (y=0; y<height; y++)
-        free(png_rows[y]);
-    free(png_rows);
+    guac_png_release_context(context);
 
     /* Ensure all data is written */
     guac_png_flush_data(&write_state);
     return 0;
 
 }
-
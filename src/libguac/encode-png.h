@@ -40,11 +40,17 @@
  * @param surface
  *     The Cairo surface to write to the given stream and socket as PNG blobs.
  *
+ * @param level
+ *     The zlib compression level to use, from 0 (no compression) to 9 (best
+ *     compression), or -1 to compress using libpng's default level, filters
+ *     and strategy. This is typically as returned by
+ *     guac_quality_get_tier_compression().
+ *
  * @return
  *     Zero if the encoding operation is successful, non-zero otherwise.
  */
 int guac_png_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface);
+        cairo_surface_t* surface, int level);
 
 #endif
 
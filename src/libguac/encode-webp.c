@@ -206,8 +206,15 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     picture.width = width;
     picture.height = height;
 
-    /* Allocate and init writer */
-    WebPPictureAlloc(&picture);
+    /* Allocate the ARGB buffer of the picture, which libwebp owns and frees
+     * within WebPPictureFree() */
+    if (!WebPPictureAlloc(&picture)) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory for WebP picture";
+        return -1;
+    }
+
+    /* Init writer */
     picture.writer = guac_webp_stream_write;
     picture.custom_ptr = &writer;
     guac_webp_stream_writer_init(&writer, socket, stream);
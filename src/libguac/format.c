@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "format.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The decimal representations of all integers from 0 through 99, each padded
+ * to two digits, allowing two digits to be produced per division.
+ */
+static const char __guac_format_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int guac_format_int(char* buffer, int64_t value) {
+
+    char digits[GUAC_FORMAT_INT_MAX_LENGTH];
+    char* current = digits + sizeof(digits);
+
+    /* Work with magnitude, avoiding overflow for the most negative value */
+    uint64_t magnitude = value < 0 ? -((uint64_t) value) : (uint64_t) value;
+
+    /* Produce two digits at a time, least significant first */
+    while (magnitude >= 100) {
+        const char* pair = __guac_format_digit_pairs + (magnitude % 100) * 2;
+        magnitude /= 100;
+        *(--current) = pair[1];
+        *(--current) = pair[0];
+    }
+
+    /* Produce remaining one or two digits */
+    if (magnitude >= 10) {
+        const char* pair = __guac_format_digit_pairs + magnitude * 2;
+        *(--current) = pair[1];
+        *(--current) = pair[0];
+    }
+    else
+        *(--current) = '0' + magnitude;
+
+    if (value < 0)
+        *(--current) = '-';
+
+    int length = digits + sizeof(digits) - current;
+    memcpy(buffer, current, length);
+    return length;
+
+}
+
@@ -0,0 +1,59 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_FORMAT_H
+#define GUAC_FORMAT_H
+
+/**
+ * Fast formatting of integers as decimal strings, used when writing
+ * instructions. This is used only internally within libguac, and is not
+ * installed along with the library.
+ *
+ * @file format.h
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+
+/**
+ * The maximum number of characters required to represent any 64-bit signed
+ * integer in decimal, including the sign.
+ */
+#define GUAC_FORMAT_INT_MAX_LENGTH 20
+
+/**
+ * Writes the decimal representation of the given integer into the given
+ * buffer. The buffer is not null-terminated. This is equivalent to formatting
+ * the integer with snprintf() and PRIi64, but considerably faster.
+ *
+ * @param buffer
+ *     The buffer to write to, which must be at least
+ *     GUAC_FORMAT_INT_MAX_LENGTH bytes long.
+ *
+ * @param value
+ *     The integer to format.
+ *
+ * @return
+ *     The number of characters written to the buffer.
+ */
+int guac_format_int(char* buffer, int64_t value);
+
+#endif
+
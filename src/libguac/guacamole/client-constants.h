@@ -75,6 +75,16 @@
  */
 #define GUAC_CLIENT_MOUSE_SCROLL_DOWN 0x10
 
+/**
+ * Special quality value which may be given to guac_client_stream_jpeg(),
+ * guac_client_stream_webp(), guac_user_stream_jpeg() or
+ * guac_user_stream_webp() to request that the lossy image quality be chosen
+ * automatically based on the processing lag of the receiving user(s). When
+ * streaming to all users of a client, users with differing processing lag may
+ * receive the image at differing qualities.
+ */
+#define GUAC_CLIENT_ADAPTIVE_QUALITY -1
+
 /**
  * The minimum number of buffers to create before allowing free'd buffers to
  * be reclaimed. In the case a protocol rapidly creates, uses, and destroys
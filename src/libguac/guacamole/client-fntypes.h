@@ -30,6 +30,7 @@
 #include "client-types.h"
 #include "object-types.h"
 #include "protocol-types.h"
+#include "stats-types.h"
 #include "stream-types.h"
 #include "user-types.h"
 
@@ -79,5 +80,20 @@ typedef void guac_client_log_handler(guac_client* client,
  */
 typedef int guac_client_init_handler(guac_client* client);
 
+/**
+ * Handler which receives the statistics collected for a guac_client when that
+ * client is freed, allowing those statistics to be aggregated elsewhere.
+ *
+ * @param client
+ *     The guac_client being freed.
+ *
+ * @param stats
+ *     The statistics collected over the lifetime of the given client. These
+ *     statistics are freed after the handler returns, and must be copied if
+ *     they are needed afterwards.
+ */
+typedef void guac_client_stats_handler(guac_client* client,
+        const guac_stats* stats);
+
 #endif
 
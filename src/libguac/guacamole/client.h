@@ -33,6 +33,7 @@
 #include "object-types.h"
 #include "pool-types.h"
 #include "socket-types.h"
+#include "stats-types.h"
 #include "stream-types.h"
 #include "timestamp-types.h"
 #include "user-fntypes.h"
@@ -257,6 +258,33 @@ struct guac_client {
      */
     void* __plugin_handle;
 
+    /*
+     * All members below were added after __plugin_handle, such that the
+     * layout of all members above is unchanged.
+     */
+
+    /**
+     * Protocol and encoding statistics collected for this connection, or NULL
+     * if statistics are not being collected. Statistics are collected only
+     * once enabled with guac_client_enable_stats().
+     */
+    guac_stats* stats;
+
+    /**
+     * The level at which collected statistics are logged when this client is
+     * freed. This is only relevant if statistics have been enabled with
+     * guac_client_enable_stats().
+     */
+    guac_client_log_level stats_log_level;
+
+    /**
+     * Handler which will be invoked with the collected statistics when this
+     * client is freed, or NULL if statistics need only be logged. This is
+     * only relevant if statistics have been enabled with
+     * guac_client_enable_stats().
+     */
+    guac_client_stats_handler* stats_handler;
+
 };
 
 /**
@@ -548,6 +576,27 @@ int guac_client_load_plugin(guac_client* client, const char* protocol);
  */
 int guac_client_get_processing_lag(guac_client* client);
 
+/**
+ * Enables collection of per-opcode protocol statistics and timing histograms
+ * for the given client. Statistics are logged at the given level when the
+ * client is freed, and are additionally passed to the client's stats_handler,
+ * if defined. This function must be invoked before any users are added to
+ * the client. If statistics are never enabled, the cost of instrumentation is
+ * limited to a NULL check at each point statistics would be collected.
+ *
+ * @param client
+ *     The guac_client to enable statistics for.
+ *
+ * @param level
+ *     The level at which collected statistics should be logged when the
+ *     client is freed.
+ *
+ * @return
+ *     Zero if statistics were enabled successfully, non-zero otherwise.
+ */
+int guac_client_enable_stats(guac_client* client,
+        guac_client_log_level level);
+
 /**
  * Streams the image data of the given surface over an image stream ("img"
  * instruction) as PNG-encoded data. The image stream will be automatically
@@ -613,7 +662,10 @@ void guac_client_stream_png(guac_client* client, guac_socket* socket,
  * @param quality
  *     The JPEG image quality, which must be an integer value between 0 and 100
  *     inclusive. Larger values indicate improving quality at the expense of
- *     larger file size.
+ *     larger file size. If GUAC_CLIENT_ADAPTIVE_QUALITY is given, quality is
+ *     chosen based on processing lag, and, if the given socket is the
+ *     client's broadcast socket, the image is encoded separately for each
+ *     group of users with similar lag.
  */
 void guac_client_stream_jpeg(guac_client* client, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
@@ -655,7 +707,10 @@ void guac_client_stream_jpeg(guac_client* client, guac_socket* socket,
  *     inclusive. For lossy images, larger values indicate improving quality at
  *     the expense of larger file size. For lossless images, this dictates the
  *     quality of compression, with larger values producing smaller files at
- *     the expense of speed.
+ *     the expense of speed. If GUAC_CLIENT_ADAPTIVE_QUALITY is given, quality
+ *     is chosen based on processing lag, and, if the given socket is the
+ *     client's broadcast socket and the image is lossy, the image is encoded
+ *     separately for each group of users with similar lag.
  *
  * @param lossless
  *     Zero to encode a lossy image, non-zero to encode losslessly.
@@ -664,6 +719,143 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
         cairo_surface_t* surface, int quality, int lossless);
 
+/**
+ * Writes the image data of the given surface as PNG-encoded data over the
+ * given, already-allocated image stream, including the "img" and "end"
+ * instructions which declare and terminate that stream. Unlike
+ * guac_client_stream_png(), the stream is neither allocated nor freed, and
+ * no other state of the client is modified, thus this function may safely be
+ * invoked from threads other than those handling the client, so long as the
+ * given socket is not shared between them.
+ *
+ * @param client
+ *     The Guacamole client which allocated the given stream.
+ *
+ * @param socket
+ *     The socket over which instructions associated with the image stream
+ *     should be sent.
+ *
+ * @param stream
+ *     The stream to use for the image, which must have been allocated with
+ *     guac_client_alloc_stream() and not yet freed.
+ *
+ * @param mode
+ *     The composite mode to use when rendering the image over the given layer.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param surface
+ *     A Cairo surface containing the image data to be encoded.
+ */
+void guac_client_encode_png(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface);
+
+/**
+ * Writes the image data of the given surface as JPEG-encoded data over the
+ * given, already-allocated image stream, including the "img" and "end"
+ * instructions which declare and terminate that stream. As with
+ * guac_client_encode_png(), this function may safely be invoked from threads
+ * other than those handling the client.
+ *
+ * @param client
+ *     The Guacamole client which allocated the given stream.
+ *
+ * @param socket
+ *     The socket over which instructions associated with the image stream
+ *     should be sent.
+ *
+ * @param stream
+ *     The stream to use for the image, which must have been allocated with
+ *     guac_client_alloc_stream() and not yet freed.
+ *
+ * @param mode
+ *     The composite mode to use when rendering the image over the given layer.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param surface
+ *     A Cairo surface containing the image data to be encoded.
+ *
+ * @param quality
+ *     The JPEG image quality, which must be an integer value between 0 and 100
+ *     inclusive. If GUAC_CLIENT_ADAPTIVE_QUALITY is given, quality is chosen
+ *     based on the processing lag of all users. The image is never encoded
+ *     separately for each group of users.
+ */
+void guac_client_encode_jpeg(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality);
+
+/**
+ * Writes the image data of the given surface as WebP-encoded data over the
+ * given, already-allocated image stream, including the "img" and "end"
+ * instructions which declare and terminate that stream. As with
+ * guac_client_encode_png(), this function may safely be invoked from threads
+ * other than those handling the client. If the server cannot encode WebP,
+ * this function has no effect.
+ *
+ * @param client
+ *     The Guacamole client which allocated the given stream.
+ *
+ * @param socket
+ *     The socket over which instructions associated with the image stream
+ *     should be sent.
+ *
+ * @param stream
+ *     The stream to use for the image, which must have been allocated with
+ *     guac_client_alloc_stream() and not yet freed.
+ *
+ * @param mode
+ *     The composite mode to use when rendering the image over the given layer.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param surface
+ *     A Cairo surface containing the image data to be encoded.
+ *
+ * @param quality
+ *     The WebP image quality, which must be an integer value between 0 and 100
+ *     inclusive. If GUAC_CLIENT_ADAPTIVE_QUALITY is given, quality is chosen
+ *     based on the processing lag of all users. The image is never encoded
+ *     separately for each group of users.
+ *
+ * @param lossless
+ *     Zero to encode a lossy image, non-zero to encode losslessly.
+ */
+void guac_client_encode_webp(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless);
+
 /**
  * Returns whether all users of the given client support WebP. If any user does
  * not support WebP, or the server cannot encode WebP images, zero is returned.
@@ -30,6 +30,8 @@
 
 #include <cairo/cairo.h>
 
+#include <stdint.h>
+
 /**
  * Produces a 24-bit hash value from all pixels of the given surface. The
  * surface provided must be RGB or ARGB with each pixel stored in 32 bits.
@@ -55,5 +57,31 @@ unsigned int guac_hash_surface(cairo_surface_t* surface);
  */
 int guac_surface_cmp(cairo_surface_t* a, cairo_surface_t* b);
 
+/**
+ * Produces a 64-bit hash value from the given rectangle of 32-bit pixels.
+ * Unlike guac_hash_surface(), the pixel data is consumed several 64-bit words
+ * at a time, and the dimensions of the rectangle contribute to the hash, such
+ * that the result is suitable as the key of a cache of images. Any padding
+ * between rows is ignored.
+ *
+ * @param data
+ *     The first pixel of the rectangle to hash.
+ *
+ * @param width
+ *     The width of the rectangle, in pixels.
+ *
+ * @param height
+ *     The height of the rectangle, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of pixel data.
+ *
+ * @return
+ *     An arbitrary 64-bit unsigned integer value intended to be well
+ *     distributed across different images.
+ */
+uint64_t guac_hash_image(const unsigned char* data, int width, int height,
+        int stride);
+
 #endif
 
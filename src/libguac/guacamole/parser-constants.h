@@ -27,10 +27,19 @@
  */
 
 /**
- * The maximum number of characters per instruction.
+ * The maximum number of characters per instruction element, unless a
+ * different limit is given with guac_parser_alloc_max_length().
  */
 #define GUAC_INSTRUCTION_MAX_LENGTH 8192
 
+/**
+ * The size of the instruction buffer within each guac_parser, in bytes.
+ * Instructions which do not fit within this buffer can be read only if the
+ * parser's maximum element length allows it, in which case a larger buffer
+ * is borrowed for the duration of that instruction.
+ */
+#define GUAC_INSTRUCTION_BUFFER_SIZE 32768
+
 /**
  * The maximum number of digits to allow per length prefix.
  */
@@ -84,7 +84,46 @@ struct guac_parser {
      * provided as a convenience to be used to buffer instructions until
      * those instructions are complete and ready to be parsed.
      */
-    char __instructionbuf[32768];
+    char __instructionbuf[GUAC_INSTRUCTION_BUFFER_SIZE];
+
+    /*
+     * All members below were added after __instructionbuf, such that the
+     * layout of all members above is unchanged. Parsers must therefore only
+     * be allocated with guac_parser_alloc() or guac_parser_alloc_max_length().
+     */
+
+    /**
+     * The buffer currently in use by this parser. This is __instructionbuf
+     * unless an instruction too long to fit within __instructionbuf is being
+     * read, in which case a larger buffer is borrowed from a pool shared by
+     * all parsers until that instruction has been handled.
+     */
+    char* __buffer;
+
+    /**
+     * The size of the buffer currently in use by this parser, in bytes.
+     */
+    int __buffer_size;
+
+    /**
+     * The maximum size of any larger buffer borrowed by this parser, in
+     * bytes. If this is no larger than GUAC_INSTRUCTION_BUFFER_SIZE, no larger
+     * buffer will ever be borrowed.
+     */
+    int __buffer_max_size;
+
+    /**
+     * The maximum number of characters permitted within any one element of
+     * an instruction.
+     */
+    int __max_element_length;
+
+    /**
+     * The number of bytes of the current instruction which have been parsed
+     * by guac_parser_read(), including all element lengths, separators, and
+     * the terminator.
+     */
+    int __instruction_length;
 
 };
 
@@ -96,6 +135,29 @@ struct guac_parser {
  */
 guac_parser* guac_parser_alloc();
 
+/**
+ * Allocates a new parser which accepts instruction elements of up to the
+ * given number of characters. Instructions are read into a buffer of
+ * GUAC_INSTRUCTION_BUFFER_SIZE bytes within the parser. Only while an
+ * instruction too long for that buffer is being read does the parser borrow
+ * a larger buffer from a pool shared by all parsers. That buffer is doubled in
+ * size as often as the instruction requires, up to four bytes per allowed
+ * character, and is returned to the pool once the instruction has been
+ * handled and the next instruction is read. Calling this function with
+ * GUAC_INSTRUCTION_MAX_LENGTH is equivalent to calling guac_parser_alloc().
+ *
+ * @param max_length
+ *     The maximum number of characters to allow within any one element of
+ *     an instruction. Instructions containing longer elements result in a
+ *     parse error.
+ *
+ * @return
+ *     The newly allocated parser, or NULL if an error occurs during
+ *     allocation or the given maximum length is invalid, in which case
+ *     guac_error will be set appropriately.
+ */
+guac_parser* guac_parser_alloc_max_length(int max_length);
+
 /**
  * Appends data from the given buffer to the given parser. The data will be
  * appended, if possible, to the in-progress instruction as a reference and
@@ -31,6 +31,13 @@
 
 #include <pthread.h>
 
+/**
+ * A pool of integers. Only min_size and active may be accessed directly; all
+ * other members are internal. The members following __next_value differ from
+ * those of libguac releases prior to the lock-free ring (libtool interface
+ * version 16 and older), thus pools must only be allocated with
+ * guac_pool_alloc().
+ */
 struct guac_pool {
 
     /**
@@ -41,31 +48,74 @@ struct guac_pool {
     int min_size;
 
     /**
-     * The number of integers currently in use.
+     * The number of integers currently in use. This value is updated
+     * atomically.
      */
     int active;
 
     /**
      * The next integer to be released (after no more integers remain in the
-     * pool.
+     * pool. This value is updated atomically.
      */
     int __next_value;
 
     /**
-     * The first integer in the pool, if any.
+     * The number of entries within __ints. This is always a power of two.
+     */
+    unsigned int __capacity;
+
+    /**
+     * Ring buffer of all freed integers awaiting reuse, in the order they
+     * were freed. The ring is preallocated when the pool is allocated, and
+     * integers are added and removed using atomic operations only.
+     */
+    guac_pool_int* __ints;
+
+    /**
+     * The position within __ints of the next integer to be removed from the
+     * pool. Only the lowest bits of this value are significant as an index;
+     * the remainder distinguishes successive passes over the ring.
      */
-    guac_pool_int* __head;
+    unsigned int __head;
 
     /**
-     * The last integer in the pool, if any.
+     * The position within __ints at which the next freed integer will be
+     * stored. Only the lowest bits of this value are significant as an index;
+     * the remainder distinguishes successive passes over the ring.
      */
-    guac_pool_int* __tail;
+    unsigned int __tail;
 
     /**
-     * Lock which is acquired when the pool is being modified or accessed.
+     * Lock which is acquired when the overflow queue is being modified or
+     * accessed. The ring itself is never guarded by this lock.
      */
     pthread_mutex_t __lock;
 
+    /**
+     * Circular queue of freed integers which could not be stored in the ring
+     * because the ring was full, in the order they were freed. This queue is
+     * grown as needed and is drained back into the ring as integers are
+     * removed from the pool.
+     */
+    int* __overflow;
+
+    /**
+     * The number of entries allocated within __overflow.
+     */
+    unsigned int __overflow_capacity;
+
+    /**
+     * The index within __overflow of the least recently freed integer.
+     */
+    unsigned int __overflow_head;
+
+    /**
+     * The number of integers currently stored within __overflow. This value
+     * is updated only while __lock is held, but may be read atomically
+     * without acquiring __lock.
+     */
+    unsigned int __overflow_length;
+
 };
 
 struct guac_pool_int {
@@ -76,10 +126,12 @@ struct guac_pool_int {
     int value;
 
     /**
-     * The next available (unused) guac_pool_int in the list of
-     * allocated but free'd ints.
+     * The position at which this entry becomes ready for the next operation.
+     * If equal to the position being stored to, the entry is empty and may
+     * receive a freed integer. If one greater than the position being read
+     * from, the entry contains a freed integer which may be removed.
      */
-    guac_pool_int* __next;
+    unsigned int __sequence;
 
 };
 
@@ -89,7 +141,8 @@ struct guac_pool_int {
  * @param size The minimum number of integers which must have been returned by
  *             guac_pool_next_int before freed integers (previously used
  *             integers) are allowed to be returned.
- * @return A new, empty guac_pool, having the given minimum size.
+ * @return A new, empty guac_pool, having the given minimum size, or NULL if
+ *         the pool cannot be allocated.
  */
 guac_pool* guac_pool_alloc(int size);
 
@@ -115,6 +168,28 @@ void guac_pool_free(guac_pool* pool);
  */
 int guac_pool_next_int(guac_pool* pool);
 
+/**
+ * Returns the next available integer from the given guac_pool, as
+ * guac_pool_next_int() would, but only if fewer than the given number of
+ * integers are currently in use. The check and the allocation are performed
+ * atomically, thus concurrent callers can never collectively exceed the given
+ * limit. This operation is threadsafe.
+ *
+ * @param pool
+ *     The guac_pool to retrieve an integer from.
+ *
+ * @param limit
+ *     The maximum number of integers which may be in use at any one time.
+ *     If the pool contains only integers less than this limit, and its
+ *     minimum size does not exceed this limit, all integers returned will
+ *     also be less than this limit.
+ *
+ * @return
+ *     The next available integer, or -1 if the given number of integers are
+ *     already in use.
+ */
+int guac_pool_next_int_below(guac_pool* pool, int limit);
+
 /**
  * Frees the given integer back into the given guac_pool. The integer given
  * will be available for future calls to guac_pool_next_int.  This operation is
@@ -276,5 +276,307 @@ typedef enum guac_line_join_style {
     GUAC_LINE_JOIN_ROUND = 0x2
 } guac_line_join_style;
 
+/**
+ * Accumulates one or more instructions within a contiguous buffer, writing
+ * that buffer to a guac_socket only when full or when building is finished.
+ */
+typedef struct guac_protocol_builder guac_protocol_builder;
+
+/**
+ * Every opcode defined by the Guacamole protocol, as returned by
+ * guac_protocol_get_opcode(). Each value is suitable for use as an index into
+ * an array of GUAC_PROTOCOL_OPCODE_COUNT elements, allowing instruction
+ * handlers to be looked up directly rather than by comparing opcode strings.
+ */
+typedef enum guac_protocol_opcode {
+
+    /**
+     * Any opcode not defined by the Guacamole protocol.
+     */
+    GUAC_PROTOCOL_OPCODE_UNKNOWN = 0,
+
+    /**
+     * The "ack" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_ACK,
+
+    /**
+     * The "arc" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_ARC,
+
+    /**
+     * The "args" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_ARGS,
+
+    /**
+     * The "argv" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_ARGV,
+
+    /**
+     * The "audio" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_AUDIO,
+
+    /**
+     * The "blob" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_BLOB,
+
+    /**
+     * The "body" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_BODY,
+
+    /**
+     * The "cfill" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CFILL,
+
+    /**
+     * The "clip" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CLIP,
+
+    /**
+     * The "clipboard" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CLIPBOARD,
+
+    /**
+     * The "close" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CLOSE,
+
+    /**
+     * The "connect" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CONNECT,
+
+    /**
+     * The "copy" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_COPY,
+
+    /**
+     * The "cstroke" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CSTROKE,
+
+    /**
+     * The "cursor" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CURSOR,
+
+    /**
+     * The "curve" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_CURVE,
+
+    /**
+     * The "disconnect" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_DISCONNECT,
+
+    /**
+     * The "dispose" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_DISPOSE,
+
+    /**
+     * The "distort" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_DISTORT,
+
+    /**
+     * The "end" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_END,
+
+    /**
+     * The "error" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_ERROR,
+
+    /**
+     * The "file" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_FILE,
+
+    /**
+     * The "filesystem" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_FILESYSTEM,
+
+    /**
+     * The "get" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_GET,
+
+    /**
+     * The "identity" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_IDENTITY,
+
+    /**
+     * The "image" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_IMAGE,
+
+    /**
+     * The "img" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_IMG,
+
+    /**
+     * The "key" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_KEY,
+
+    /**
+     * The "lfill" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_LFILL,
+
+    /**
+     * The "line" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_LINE,
+
+    /**
+     * The "log" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_LOG,
+
+    /**
+     * The "lstroke" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_LSTROKE,
+
+    /**
+     * The "mouse" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_MOUSE,
+
+    /**
+     * The "move" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_MOVE,
+
+    /**
+     * The "name" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_NAME,
+
+    /**
+     * The "nest" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_NEST,
+
+    /**
+     * The "nop" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_NOP,
+
+    /**
+     * The "pipe" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_PIPE,
+
+    /**
+     * The "pop" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_POP,
+
+    /**
+     * The "push" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_PUSH,
+
+    /**
+     * The "put" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_PUT,
+
+    /**
+     * The "ready" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_READY,
+
+    /**
+     * The "rect" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_RECT,
+
+    /**
+     * The "reset" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_RESET,
+
+    /**
+     * The "select" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_SELECT,
+
+    /**
+     * The "set" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_SET,
+
+    /**
+     * The "shade" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_SHADE,
+
+    /**
+     * The "size" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_SIZE,
+
+    /**
+     * The "start" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_START,
+
+    /**
+     * The "sync" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_SYNC,
+
+    /**
+     * The "timezone" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_TIMEZONE,
+
+    /**
+     * The "transfer" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_TRANSFER,
+
+    /**
+     * The "transform" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_TRANSFORM,
+
+    /**
+     * The "undefine" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_UNDEFINE,
+
+    /**
+     * The "video" instruction.
+     */
+    GUAC_PROTOCOL_OPCODE_VIDEO,
+
+    /**
+     * The number of values within this enum, including
+     * GUAC_PROTOCOL_OPCODE_UNKNOWN. This is not itself a valid opcode.
+     */
+    GUAC_PROTOCOL_OPCODE_COUNT
+
+} guac_protocol_opcode;
+
 #endif
 
@@ -30,6 +30,7 @@
 
 #include "layer-types.h"
 #include "object-types.h"
+#include "protocol-constants.h"
 #include "protocol-types.h"
 #include "socket-types.h"
 #include "stream-types.h"
@@ -37,6 +38,156 @@
 
 #include <cairo/cairo.h>
 #include <stdarg.h>
+#include <stdint.h>
+
+struct guac_protocol_builder {
+
+    /**
+     * The socket to which all built instructions will be written.
+     */
+    guac_socket* socket;
+
+    /**
+     * Whether an instruction has been started with
+     * guac_protocol_builder_opcode() but not yet terminated.
+     */
+    int open;
+
+    /**
+     * Whether any write to the socket has failed.
+     */
+    int failed;
+
+    /**
+     * The number of bytes of instruction data currently within buffer.
+     */
+    int length;
+
+    /**
+     * The opcode of the instruction currently being built. This is only
+     * tracked if the socket is collecting statistics.
+     */
+    guac_protocol_opcode opcode;
+
+    /**
+     * The total number of bytes of instruction data already written to the
+     * socket by this builder.
+     */
+    uint64_t written;
+
+    /**
+     * The offset of the start of the instruction currently being built,
+     * relative to the first byte written by this builder.
+     */
+    uint64_t instruction_start;
+
+    /**
+     * Instruction data which has not yet been written to the socket.
+     */
+    char buffer[GUAC_PROTOCOL_BUILDER_BUFFER_SIZE];
+
+};
+
+/* INSTRUCTION BUILDING */
+
+/**
+ * Begins building one or more instructions to be written to the given socket.
+ * The socket is locked for exclusive use with guac_socket_instruction_begin()
+ * until guac_protocol_builder_finish() is called, thus all instructions built
+ * are written contiguously. Instruction data is accumulated within the builder
+ * and written to the socket in as few writes as possible.
+ *
+ * @param builder
+ *     The builder to initialize. This will typically be allocated on the
+ *     stack.
+ *
+ * @param socket
+ *     The socket to which built instructions should be written.
+ */
+void guac_protocol_builder_init(guac_protocol_builder* builder,
+        guac_socket* socket);
+
+/**
+ * Begins a new instruction having the given opcode, terminating the previous
+ * instruction, if any.
+ *
+ * @param builder
+ *     The builder to add the instruction to.
+ *
+ * @param opcode
+ *     The opcode of the new instruction.
+ */
+void guac_protocol_builder_opcode(guac_protocol_builder* builder,
+        const char* opcode);
+
+/**
+ * Appends an integer argument to the current instruction.
+ *
+ * @param builder
+ *     The builder containing the instruction.
+ *
+ * @param value
+ *     The integer to append, which will be represented in decimal.
+ */
+void guac_protocol_builder_int(guac_protocol_builder* builder,
+        int64_t value);
+
+/**
+ * Appends a floating-point argument to the current instruction.
+ *
+ * @param builder
+ *     The builder containing the instruction.
+ *
+ * @param value
+ *     The value to append.
+ */
+void guac_protocol_builder_double(guac_protocol_builder* builder,
+        double value);
+
+/**
+ * Appends a string argument to the current instruction.
+ *
+ * @param builder
+ *     The builder containing the instruction.
+ *
+ * @param value
+ *     The null-terminated UTF-8 string to append.
+ */
+void guac_protocol_builder_string(guac_protocol_builder* builder,
+        const char* value);
+
+/**
+ * Appends the given binary data as a base64-encoded argument to the current
+ * instruction.
+ *
+ * @param builder
+ *     The builder containing the instruction.
+ *
+ * @param data
+ *     The data to encode and append.
+ *
+ * @param count
+ *     The number of bytes of data.
+ */
+void guac_protocol_builder_base64(guac_protocol_builder* builder,
+        const void* data, int count);
+
+/**
+ * Terminates the current instruction, if any, writes all remaining
+ * instruction data to the socket, and releases the socket for use by other
+ * threads.
+ *
+ * If an error occurred while writing any of the built instructions, a
+ * non-zero value is returned, and guac_error is set appropriately.
+ *
+ * @param builder
+ *     The builder to finish.
+ *
+ * @return
+ *     Zero if all instructions were written successfully, non-zero
+ *     otherwise.
+ */
+int guac_protocol_builder_finish(guac_protocol_builder* builder);
 
 /* CONTROL INSTRUCTIONS */
 
@@ -934,6 +1085,36 @@ int guac_protocol_send_clipboard(guac_socket* socket, const guac_stream* stream,
  */
 int guac_protocol_send_name(guac_socket* socket, const char* name);
 
+/**
+ * Returns the guac_protocol_opcode value corresponding to the given opcode
+ * string. The lookup is performed with a precomputed perfect hash of the
+ * opcode's length and characters, and requires at most one string comparison
+ * regardless of the number of opcodes defined.
+ *
+ * @param opcode
+ *     The opcode of the instruction, as parsed by guac_parser.
+ *
+ * @return
+ *     The guac_protocol_opcode value corresponding to the given opcode, or
+ *     GUAC_PROTOCOL_OPCODE_UNKNOWN if the opcode is not defined by the
+ *     Guacamole protocol.
+ */
+guac_protocol_opcode guac_protocol_get_opcode(const char* opcode);
+
+/**
+ * Returns the opcode string corresponding to the given guac_protocol_opcode
+ * value.
+ *
+ * @param opcode
+ *     The guac_protocol_opcode value to look up.
+ *
+ * @return
+ *     The opcode string corresponding to the given value, or NULL if the
+ *     value is GUAC_PROTOCOL_OPCODE_UNKNOWN or is otherwise not a valid
+ *     opcode.
+ */
+const char* guac_protocol_get_opcode_name(guac_protocol_opcode opcode);
+
 /**
  * Decodes the given base64-encoded string in-place. The base64 string must
  * be NULL-terminated.
@@ -31,6 +31,15 @@
  */
 #define GUAC_SOCKET_OUTPUT_BUFFER_SIZE 8192
 
+/**
+ * The default maximum number of bytes that a socket writing to a file
+ * descriptor may buffer before flushing. The output buffer of such a socket
+ * starts at GUAC_SOCKET_OUTPUT_BUFFER_SIZE bytes and grows as needed up to
+ * this limit, such that an entire frame is typically written with a single
+ * system call when the socket is flushed.
+ */
+#define GUAC_SOCKET_MAX_OUTPUT_BUFFER_SIZE 1048576
+
 /**
  * The number of milliseconds to wait between keep-alive pings on a socket
  * with keep-alive enabled.
@@ -73,5 +73,22 @@ typedef struct guac_socket_ssl_data {
  */
 guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd);
 
+/**
+ * Creates a new guac_socket which will use the given SSL connection for all
+ * communication. The SSL/TLS handshake of the given connection must already
+ * have completed. Freeing this guac_socket will automatically free the given
+ * SSL connection and close its associated file descriptor.
+ *
+ * @param ssl
+ *     The SSL connection to use for all communication, for which
+ *     SSL_accept() has already succeeded.
+ *
+ * @return
+ *     A newly-allocated guac_socket which will transparently use the given
+ *     SSL connection for all communication, or NULL if the guac_socket could
+ *     not be allocated. The SSL connection is not freed if NULL is returned.
+ */
+guac_socket* guac_socket_open_secure_accepted(SSL* ssl);
+
 #endif
 
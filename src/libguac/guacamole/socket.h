@@ -30,6 +30,7 @@
 #include "socket-constants.h"
 #include "socket-fntypes.h"
 #include "socket-types.h"
+#include "stats-types.h"
 #include "timestamp-types.h"
 
 #include <pthread.h>
@@ -113,6 +114,18 @@ struct guac_socket {
      */
     pthread_t __keep_alive_thread;
 
+    /*
+     * All members below were added after __keep_alive_thread, such that the
+     * layout of all members above is unchanged.
+     */
+
+    /**
+     * The statistics which should be updated with each instruction written to
+     * this guac_socket using the guac_protocol_send_*() functions, or NULL if
+     * no statistics are being collected. This is NULL by default.
+     */
+    guac_stats* stats;
+
 };
 
 /**
@@ -160,7 +173,9 @@ void guac_socket_instruction_end(guac_socket* socket);
 /**
  * Allocates and initializes a new guac_socket object with the given open
  * file descriptor. The file descriptor will be automatically closed when
- * the allocated guac_socket is freed.
+ * the allocated guac_socket is freed. Up to GUAC_SOCKET_MAX_OUTPUT_BUFFER_SIZE
+ * bytes are buffered before data is written to the file descriptor, as with
+ * guac_socket_open_buffered().
  *
  * If an error occurs while allocating the guac_socket object, NULL is returned,
  * and guac_error is set appropriately.
@@ -172,6 +187,34 @@ void guac_socket_instruction_end(guac_socket* socket);
  */
 guac_socket* guac_socket_open(int fd);
 
+/**
+ * Allocates and initializes a new guac_socket object with the given open
+ * file descriptor, buffering at most the given number of bytes before data
+ * is written to the file descriptor. Written data is otherwise held until the
+ * socket is flushed, such as at the end of each frame, and is then written
+ * in a single operation. The buffer grows only as large as frames require,
+ * and is gradually shrunk again once frames become smaller. The file
+ * descriptor will be automatically closed when the allocated guac_socket is
+ * freed.
+ *
+ * If an error occurs while allocating the guac_socket object, NULL is
+ * returned, and guac_error is set appropriately.
+ *
+ * @param fd
+ *     An open file descriptor that this guac_socket object should manage.
+ *
+ * @param max_buffer_size
+ *     The maximum number of bytes to buffer before writing to the file
+ *     descriptor. If this is less than GUAC_SOCKET_OUTPUT_BUFFER_SIZE,
+ *     GUAC_SOCKET_OUTPUT_BUFFER_SIZE bytes are buffered.
+ *
+ * @return
+ *     A newly allocated guac_socket object associated with the given file
+ *     descriptor, or NULL if an error occurs while allocating the guac_socket
+ *     object.
+ */
+guac_socket* guac_socket_open_buffered(int fd, size_t max_buffer_size);
+
 /**
  * Allocates and initializes a new guac_socket which writes all data via
  * nest instructions to the given existing, open guac_socket. Freeing the
@@ -193,7 +236,9 @@ guac_socket* guac_socket_nest(guac_socket* parent, int index);
  * Allocates and initializes a new guac_socket which delegates all socket
  * operations to the given primary socket, while simultaneously duplicating all
  * written data to the secondary socket. Freeing the returned guac_socket will
- * free both primary and secondary sockets.
+ * free both primary and secondary sockets. Instructions written to the
+ * returned guac_socket are counted within the statistics of the primary
+ * socket, if any.
  *
  * Return values (error codes) will come only from the primary socket. Locks
  * (like those used by guac_socket_instruction_begin() and
@@ -221,6 +266,44 @@ guac_socket* guac_socket_nest(guac_socket* parent, int index);
  */
 guac_socket* guac_socket_tee(guac_socket* primary, guac_socket* secondary);
 
+/**
+ * Allocates and initializes a new guac_socket which queues all written data
+ * in memory, writing that data to the given target socket from a separate,
+ * dedicated thread. Writes to the returned socket never block on the target
+ * socket, and flushes merely request that the target socket be flushed once
+ * all data queued thus far has been written. All read and select operations
+ * are delegated to the target socket. Freeing the returned guac_socket waits
+ * a limited time for all queued data to be written, but does not free the
+ * target socket.
+ *
+ * The queue is bounded, and its memory grows only as data is queued. If a
+ * write would cause more than the given number of bytes to be queued, that
+ * write fails with guac_error set to GUAC_STATUS_NO_SPACE, any queued data is
+ * discarded, and all further writes and flushes fail. The same occurs if a
+ * write to the target socket fails, or if queued data cannot be written
+ * before the queue is freed. Once the queue has failed, a target socket
+ * created with guac_socket_open() on a network socket is shut down, such that
+ * any write blocked on that socket is interrupted.
+ *
+ * While the returned socket is in use, data must not be written directly to
+ * the target socket.
+ *
+ * If an error occurs while allocating the guac_socket object, NULL is returned,
+ * and guac_error is set appropriately.
+ *
+ * @param target
+ *     The guac_socket to which all queued data should be written.
+ *
+ * @param size
+ *     The maximum number of bytes which may be queued at any one time.
+ *
+ * @return
+ *     A newly allocated guac_socket object which queues all written data for
+ *     the given target socket, or NULL if an error occurs while allocating the
+ *     guac_socket object.
+ */
+guac_socket* guac_socket_queue(guac_socket* target, size_t size);
+
 /**
  * Allocates and initializes a new guac_socket which duplicates all
  * instructions written across the sockets of each connected user of the given
@@ -0,0 +1,38 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _GUAC_STATS_CONSTANTS_H
+#define _GUAC_STATS_CONSTANTS_H
+
+/**
+ * Constants related to the collection of protocol and encoding statistics.
+ *
+ * @file stats-constants.h
+ */
+
+/**
+ * The number of buckets within each guac_stats_histogram. The first bucket
+ * counts durations of zero microseconds, each following bucket counts
+ * durations up to twice as long as the previous bucket, and the final bucket
+ * counts all remaining durations.
+ */
+#define GUAC_STATS_HISTOGRAM_BUCKETS 32
+
+#endif
+
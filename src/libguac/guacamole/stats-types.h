@@ -0,0 +1,95 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _GUAC_STATS_TYPES_H
+#define _GUAC_STATS_TYPES_H
+
+/**
+ * Type definitions related to the collection of protocol and encoding
+ * statistics.
+ *
+ * @file stats-types.h
+ */
+
+/**
+ * The direction in which an instruction counted by guac_stats traveled.
+ */
+typedef enum guac_stats_direction {
+
+    /**
+     * The instruction was sent from the server to the client.
+     */
+    GUAC_STATS_SENT,
+
+    /**
+     * The instruction was received by the server from the client.
+     */
+    GUAC_STATS_RECEIVED
+
+} guac_stats_direction;
+
+/**
+ * The image formats for which encoding time is recorded by guac_stats.
+ */
+typedef enum guac_stats_format {
+
+    /**
+     * PNG images, as written by guac_client_stream_png() or
+     * guac_user_stream_png().
+     */
+    GUAC_STATS_FORMAT_PNG,
+
+    /**
+     * JPEG images, as written by guac_client_stream_jpeg() or
+     * guac_user_stream_jpeg().
+     */
+    GUAC_STATS_FORMAT_JPEG,
+
+    /**
+     * WebP images, as written by guac_client_stream_webp() or
+     * guac_user_stream_webp().
+     */
+    GUAC_STATS_FORMAT_WEBP,
+
+    /**
+     * The number of image formats defined. This is not itself an image
+     * format.
+     */
+    GUAC_STATS_FORMAT_COUNT
+
+} guac_stats_format;
+
+/**
+ * The number of instructions and bytes of instruction data associated with a
+ * single opcode.
+ */
+typedef struct guac_stats_counter guac_stats_counter;
+
+/**
+ * A histogram of durations, grouped into buckets by powers of two.
+ */
+typedef struct guac_stats_histogram guac_stats_histogram;
+
+/**
+ * Protocol and encoding statistics for a single connection.
+ */
+typedef struct guac_stats guac_stats;
+
+#endif
+
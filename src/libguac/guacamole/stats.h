@@ -0,0 +1,221 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _GUAC_STATS_H
+#define _GUAC_STATS_H
+
+/**
+ * Provides functions and structures for collecting per-opcode protocol
+ * statistics and timing histograms for a connection. Statistics are
+ * collected only if enabled with guac_client_enable_stats(), and all
+ * instrumentation points reduce to a single NULL check otherwise.
+ *
+ * @file stats.h
+ */
+
+#include "client-types.h"
+#include "protocol-types.h"
+#include "stats-constants.h"
+#include "stats-types.h"
+
+#include <stdint.h>
+
+struct guac_stats_counter {
+
+    /**
+     * The total number of instructions.
+     */
+    uint64_t instructions;
+
+    /**
+     * The total number of bytes within those instructions, including the
+     * opcode, all arguments, and all length prefixes and delimiters.
+     */
+    uint64_t bytes;
+
+};
+
+struct guac_stats_histogram {
+
+    /**
+     * The total number of durations recorded.
+     */
+    uint64_t count;
+
+    /**
+     * The sum of all durations recorded, in microseconds.
+     */
+    uint64_t total;
+
+    /**
+     * The number of durations recorded within each bucket. Bucket zero
+     * counts durations of zero microseconds, and each bucket N thereafter
+     * counts durations of at least 2^(N-1) but less than 2^N microseconds.
+     * The final bucket additionally counts all longer durations.
+     */
+    uint64_t buckets[GUAC_STATS_HISTOGRAM_BUCKETS];
+
+};
+
+struct guac_stats {
+
+    /**
+     * Counts of all instructions sent, indexed by guac_protocol_opcode.
+     */
+    guac_stats_counter sent[GUAC_PROTOCOL_OPCODE_COUNT];
+
+    /**
+     * Counts of all instructions received, indexed by guac_protocol_opcode.
+     */
+    guac_stats_counter received[GUAC_PROTOCOL_OPCODE_COUNT];
+
+    /**
+     * The time taken to encode each image, indexed by guac_stats_format.
+     */
+    guac_stats_histogram encode[GUAC_STATS_FORMAT_COUNT];
+
+    /**
+     * The time elapsed between each frame being sent and that frame being
+     * acknowledged by a user with a "sync" instruction.
+     */
+    guac_stats_histogram sync;
+
+};
+
+/**
+ * Allocates a new guac_stats with all counters and histograms zeroed.
+ *
+ * @return
+ *     A newly-allocated guac_stats, or NULL if allocation fails.
+ */
+guac_stats* guac_stats_alloc();
+
+/**
+ * Frees the given guac_stats.
+ *
+ * @param stats
+ *     The guac_stats to free.
+ */
+void guac_stats_free(guac_stats* stats);
+
+/**
+ * Counts a single instruction having the given opcode and length. This
+ * function is lock-free and may be called from any number of threads
+ * concurrently. If the given guac_stats is NULL, this function has no effect.
+ *
+ * @param stats
+ *     The guac_stats to update, or NULL if statistics are disabled.
+ *
+ * @param direction
+ *     The direction in which the instruction traveled.
+ *
+ * @param opcode
+ *     The opcode of the instruction.
+ *
+ * @param bytes
+ *     The total length of the instruction, in bytes.
+ */
+void guac_stats_count_instruction(guac_stats* stats,
+        guac_stats_direction direction, guac_protocol_opcode opcode,
+        uint64_t bytes);
+
+/**
+ * Records the given duration within the given histogram. This function is
+ * lock-free and may be called from any number of threads concurrently.
+ *
+ * @param histogram
+ *     The histogram to update.
+ *
+ * @param usec
+ *     The duration to record, in microseconds.
+ */
+void guac_stats_record(guac_stats_histogram* histogram, uint64_t usec);
+
+/**
+ * Returns an opaque starting point for measuring the duration of an
+ * operation with guac_stats_record_encode(). If the given guac_stats is NULL,
+ * the current time is not read and zero is returned.
+ *
+ * @param stats
+ *     The guac_stats which will receive the measured duration, or NULL if
+ *     statistics are disabled.
+ *
+ * @return
+ *     The value to pass to guac_stats_record_encode() once the operation
+ *     being measured has completed.
+ */
+uint64_t guac_stats_start(guac_stats* stats);
+
+/**
+ * Records the time taken to encode an image of the given format, measured
+ * from the given starting point. If the given guac_stats is NULL, this
+ * function has no effect.
+ *
+ * @param stats
+ *     The guac_stats to update, or NULL if statistics are disabled.
+ *
+ * @param format
+ *     The format of the encoded image.
+ *
+ * @param start
+ *     The value returned by guac_stats_start() immediately before encoding
+ *     began.
+ */
+void guac_stats_record_encode(guac_stats* stats, guac_stats_format format,
+        uint64_t start);
+
+/**
+ * Returns the duration below which the given proportion of all durations
+ * recorded within the given histogram fall. As durations are grouped into
+ * buckets by powers of two, the value returned is the upper bound of the
+ * bucket containing the requested percentile.
+ *
+ * @param histogram
+ *     The histogram to inspect.
+ *
+ * @param percentile
+ *     The proportion of recorded durations, between 0 and 1 inclusive.
+ *
+ * @return
+ *     The duration, in microseconds, below which at least the given
+ *     proportion of recorded durations fall, or zero if no durations have
+ *     been recorded.
+ */
+uint64_t guac_stats_percentile(const guac_stats_histogram* histogram,
+        double percentile);
+
+/**
+ * Logs a summary of the given statistics using the logging facilities of
+ * the given client. Only opcodes and histograms for which at least one value
+ * has been recorded are included.
+ *
+ * @param stats
+ *     The statistics to log.
+ *
+ * @param client
+ *     The client whose logging facilities should be used.
+ *
+ * @param level
+ *     The level at which the summary should be logged.
+ */
+void guac_stats_log(const guac_stats* stats, guac_client* client,
+        guac_client_log_level level);
+
+#endif
+
@@ -42,6 +42,24 @@
  */
 #define GUAC_USER_CLOSED_STREAM_INDEX -1
 
+/**
+ * The maximum number of bytes of outbound data which may be queued for any
+ * one guac_user which has joined a connection. A user which falls further
+ * behind than this is disconnected, rather than being allowed to stall the
+ * connection for all other users.
+ */
+#define GUAC_USER_MAX_QUEUED_OUTPUT 8388608
+
+/**
+ * The maximum number of characters within any one element of an instruction
+ * received from a user. This allows a single "blob" instruction to carry up
+ * to 192 KB of data, such that uploads, clipboard data and audio input need
+ * not be divided into many small instructions. Only an instruction which is
+ * actually this long requires a correspondingly large buffer, borrowed for
+ * the duration of that instruction (see guac_parser_alloc_max_length()).
+ */
+#define GUAC_USER_MAX_ELEMENT_LENGTH 262144
+
 /**
  * The maximum number of objects supported by any one guac_client.
  */
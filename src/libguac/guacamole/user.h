@@ -496,6 +496,20 @@ struct guac_user {
      */
     guac_user_argv_handler* argv_handler;
 
+    /*
+     * All members below were added after argv_handler, such that the layout
+     * of all members above is unchanged.
+     */
+
+    /**
+     * The socket originally assigned to this user, if that socket has been
+     * replaced by a queue (see guac_socket_queue()) while the user is joined
+     * to its guac_client, or NULL otherwise. All data written to the queue is
+     * eventually written to this socket by a dedicated thread, such that a
+     * slow user cannot block writes to other users of the same connection.
+     */
+    guac_socket* __raw_socket;
+
 };
 
 /**
@@ -734,7 +748,8 @@ void guac_user_stream_png(guac_user* user, guac_socket* socket,
  * @param quality
  *     The JPEG image quality, which must be an integer value between 0 and 100
  *     inclusive. Larger values indicate improving quality at the expense of
- *     larger file size.
+ *     larger file size. If GUAC_CLIENT_ADAPTIVE_QUALITY is given, quality is
+ *     chosen based on the processing lag of the given user.
  */
 void guac_user_stream_jpeg(guac_user* user, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
@@ -777,7 +792,8 @@ void guac_user_stream_jpeg(guac_user* user, guac_socket* socket,
  *     inclusive. For lossy images, larger values indicate improving quality at
  *     the expense of larger file size. For lossless images, this dictates the
  *     quality of compression, with larger values producing smaller files at
- *     the expense of speed.
+ *     the expense of speed. If GUAC_CLIENT_ADAPTIVE_QUALITY is given, quality
+ *     is chosen based on the processing lag of the given user.
  *
  * @param lossless
  *     Zero to encode a lossy image, non-zero to encode losslessly.
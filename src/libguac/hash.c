@@ -18,6 +18,7 @@
  */
 
 #include "config.h"
+#include "guacamole/hash.h"
 
 #include <cairo/cairo.h>
 
@@ -58,6 +59,107 @@ unsigned int _guac_rotate(unsigned int value, int amount) {
 
 }
 
+/**
+ * Multiplier used to mix each 64-bit word of image data into a lane of
+ * guac_hash_image(). This is the 64-bit golden ratio constant.
+ */
+#define GUAC_HASH_IMAGE_PRIME 0x9E3779B97F4A7C15ULL
+
+/**
+ * Mixes the given 64-bit word of image data into the given hash lane.
+ *
+ * @param lane
+ *     The current value of the hash lane.
+ *
+ * @param value
+ *     The word of image data to mix in.
+ *
+ * @return
+ *     The new value of the hash lane.
+ */
+static uint64_t _guac_hash_image_mix(uint64_t lane, uint64_t value) {
+    lane ^= value * GUAC_HASH_IMAGE_PRIME;
+    lane = (lane << 31) | (lane >> 33);
+    return lane * GUAC_HASH_IMAGE_PRIME;
+}
+
+/**
+ * Reads a 64-bit word from the given possibly-unaligned location.
+ *
+ * @param data
+ *     The location to read from.
+ *
+ * @return
+ *     The 64-bit word at the given location.
+ */
+static uint64_t _guac_hash_image_read(const unsigned char* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t guac_hash_image(const unsigned char* data, int width, int height,
+        int stride) {
+
+    /* Independent lanes allow several words to be mixed at once */
+    uint64_t lane_a = 0x243F6A8885A308D3ULL;
+    uint64_t lane_b = 0x13198A2E03707344ULL;
+    uint64_t lane_c = 0xA4093822299F31D0ULL;
+    uint64_t lane_d = 0x082EFA98EC4E6C89ULL;
+
+    size_t row_length = (size_t) width * 4;
+    int y;
+
+    for (y = 0; y < height; y++) {
+
+        const unsigned char* current = data;
+        const unsigned char* end = data + row_length;
+
+        /* Mix four words at a time */
+        while (end - current >= 32) {
+            lane_a = _guac_hash_image_mix(lane_a, _guac_hash_image_read(current));
+            lane_b = _guac_hash_image_mix(lane_b, _guac_hash_image_read(current + 8));
+            lane_c = _guac_hash_image_mix(lane_c, _guac_hash_image_read(current + 16));
+            lane_d = _guac_hash_image_mix(lane_d, _guac_hash_image_read(current + 24));
+            current += 32;
+        }
+
+        /* Mix remaining whole words */
+        while (end - current >= 8) {
+            lane_a = _guac_hash_image_mix(lane_a, _guac_hash_image_read(current));
+            current += 8;
+        }
+
+        /* Mix final pixel of odd-width rows */
+        if (current != end) {
+            uint32_t pixel;
+            memcpy(&pixel, current, sizeof(pixel));
+            lane_b = _guac_hash_image_mix(lane_b, pixel);
+        }
+
+        /* Next row */
+        data += stride;
+
+    }
+
+    /* Combine lanes with dimensions */
+    uint64_t hash = ((uint64_t) width << 32) | (uint32_t) height;
+    hash = _guac_hash_image_mix(hash, lane_a);
+    hash = _guac_hash_image_mix(hash, lane_b);
+    hash = _guac_hash_image_mix(hash, lane_c);
+    hash = _guac_hash_image_mix(hash, lane_d);
+
+    /* Final avalanche (the finalizer of MurmurHash3) */
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+
+}
+
 unsigned int guac_hash_surface(cairo_surface_t* surface) {
 
     /* Init to zero */
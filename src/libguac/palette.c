@@ -21,83 +21,82 @@
 
 #include "palette.h"
 
-#include <cairo/cairo.h>
-
 #include <stdint.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-    int x, y;
+guac_palette* guac_palette_alloc() {
 
-    int width = cairo_image_surface_get_width(surface);
-    int height = cairo_image_surface_get_height(surface);
-    int stride = cairo_image_surface_get_stride(surface);
-    unsigned char* data = cairo_image_surface_get_data(surface);
+    /* Allocate palette, with all entries initially empty (generation 0) */
+    guac_palette* palette = (guac_palette*) calloc(1, sizeof(guac_palette));
+    if (palette == NULL)
+        return NULL;
 
-    /* Allocate palette */
-    guac_palette* palette = (guac_palette*) malloc(sizeof(guac_palette));
-    memset(palette, 0, sizeof(guac_palette));
+    palette->generation = 1;
+    return palette;
 
-    for (y=0; y<height; y++) {
-        for (x=0; x<width; x++) {
+}
 
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
+void guac_palette_reset(guac_palette* palette) {
 
-            /* Calculate hash code */
-            int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+    palette->size = 0;
 
-            guac_palette_entry* entry;
+    /* Entries need be cleared only if the generation wraps around */
+    if (++palette->generation == 0) {
+        memset(palette->entries, 0, sizeof(palette->entries));
+        palette->generation = 1;
+    }
 
-            /* Search for open palette entry */
-            for (;;) {
-                
-                entry = &(palette->entries[hash]);
+}
 
-                /* If we've found a free space, use it */
-                if (entry->index == 0) {
+int guac_palette_add(guac_palette* palette, int color) {
 
-                    png_color* c;
+    /* Calculate hash code */
+    int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
 
-                    /* Stop if already at capacity */
-                    if (palette->size == 256) {
-                        guac_palette_free(palette);
-                        return NULL;
-                    }
+    guac_palette_entry* entry;
+
+    /* Search for open palette entry */
+    for (;;) {
 
-                    /* Store in palette */
-                    c = &(palette->colors[palette->size]);
-                    c->blue  = (color      ) & 0xFF;
-                    c->green = (color >> 8 ) & 0xFF;
-                    c->red   = (color >> 16) & 0xFF;
+        entry = &(palette->entries[hash]);
+
+        /* If we've found a free space, use it */
+        if (entry->generation != palette->generation) {
 
-                    /* Add color to map */
-                    entry->index = ++palette->size;
-                    entry->color = color;
+            png_color* c;
 
-                    break;
+            /* Stop if already at capacity */
+            if (palette->size == GUAC_PALETTE_MAX_SIZE)
+                return -1;
 
-                }
+            /* Store in palette */
+            c = &(palette->colors[palette->size]);
+            c->blue  = (color      ) & 0xFF;
+            c->green = (color >> 8 ) & 0xFF;
+            c->red   = (color >> 16) & 0xFF;
 
-                /* Otherwise, if already stored here, done */
-                if (entry->color == color)
-                    break;
+            /* Add color to map */
+            entry->index = palette->size++;
+            entry->color = color;
+            entry->generation = palette->generation;
 
-                /* Otherwise, collision. Move on to another bucket */
-                hash = (hash+1) & 0xFFF;
+            return entry->index;
 
-            }
         }
 
-        /* Advance to next data row */
-        data += stride;
+        /* Otherwise, if already stored here, done */
+        if (entry->color == color)
+            return entry->index;
 
-    }
+        /* Otherwise, collision. Move on to another bucket */
+        hash = (hash+1) & (GUAC_PALETTE_ENTRIES - 1);
 
-    return palette;
+    }
 
 }
 
@@ -110,24 +109,98 @@ int guac_palette_find(guac_palette* palette, int color) {
 
     /* Search for palette entry */
     for (;;) {
-        
+
         entry = &(palette->entries[hash]);
 
         /* If we've found a free space, color not stored. */
-        if (entry->index == 0)
+        if (entry->generation != palette->generation)
             return -1;
 
         /* Otherwise, if color indeed stored here, done */
         if (entry->color == color)
-            return entry->index - 1;
+            return entry->index;
 
         /* Otherwise, collision. Move on to another bucket */
-        hash = (hash+1) & 0xFFF;
+        hash = (hash+1) & (GUAC_PALETTE_ENTRIES - 1);
 
     }
 
 }
 
+/**
+ * Returns the number of leading pixels within the given row having the given
+ * 24-bit RGB color, ignoring the highest-order byte of each pixel.
+ *
+ * @param row
+ *     The first pixel of the row.
+ *
+ * @param width
+ *     The number of pixels within the row.
+ *
+ * @param color
+ *     The 24-bit RGB color to compare each pixel against.
+ *
+ * @return
+ *     The number of leading pixels having the given color.
+ */
+static int guac_palette_run_length(const uint32_t* row, int width,
+        int color) {
+
+    int length = 0;
+
+#ifdef __SSE2__
+    /* Compare four pixels at a time (SSE2 is always available where defined,
+     * such as on all x86-64 processors, and thus needs no runtime check) */
+    __m128i mask = _mm_set1_epi32(0xFFFFFF);
+    __m128i expected = _mm_set1_epi32(color);
+
+    while (length + 4 <= width) {
+
+        __m128i pixels = _mm_and_si128(mask,
+                _mm_loadu_si128((const __m128i*) (row + length)));
+
+        int equal = _mm_movemask_epi8(_mm_cmpeq_epi32(pixels, expected));
+        if (equal != 0xFFFF)
+            return length + __builtin_ctz(~equal) / 4;
+
+        length += 4;
+
+    }
+#endif
+
+    while (length < width && (int) (row[length] & 0xFFFFFF) == color)
+        length++;
+
+    return length;
+
+}
+
+int guac_palette_index_row(guac_palette* palette, const uint32_t* row,
+        int width, unsigned char* indices) {
+
+    int x = 0;
+
+    while (x < width) {
+
+        int color = row[x] & 0xFFFFFF;
+
+        int index = guac_palette_add(palette, color);
+        if (index < 0)
+            return -1;
+
+        /* Following pixels of the same color need no lookup */
+        int length = 1 + guac_palette_run_length(row + x + 1,
+                width - x - 1, color);
+
+        memset(indices + x, index, length);
+        x += length;
+
+    }
+
+    return 0;
+
+}
+
 void guac_palette_free(guac_palette* palette) {
     free(palette);
 }
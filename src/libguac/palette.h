@@ -21,26 +21,130 @@
 #ifndef __GUAC_PALETTE_H
 #define __GUAC_PALETTE_H
 
-#include <cairo/cairo.h>
 #include <png.h>
 
+#include <stdint.h>
+
+/**
+ * The number of entries within the hash table of each palette.
+ */
+#define GUAC_PALETTE_ENTRIES 0x1000
+
+/**
+ * The maximum number of colors which may be stored within a palette.
+ */
+#define GUAC_PALETTE_MAX_SIZE 256
+
 typedef struct guac_palette_entry {
 
     int index;
     int color;
 
+    /**
+     * The generation of the palette in which this entry was stored. The entry
+     * is empty unless this matches the current generation of the palette.
+     */
+    unsigned int generation;
+
 } guac_palette_entry;
 
 typedef struct guac_palette {
 
-    guac_palette_entry entries[0x1000];
-    png_color colors[256];
+    guac_palette_entry entries[GUAC_PALETTE_ENTRIES];
+    png_color colors[GUAC_PALETTE_MAX_SIZE];
     int size;
 
+    /**
+     * The current generation of this palette, incremented each time the
+     * palette is reset such that stale hash table entries need not be
+     * cleared individually.
+     */
+    unsigned int generation;
+
 } guac_palette;
 
-guac_palette* guac_palette_alloc(cairo_surface_t* surface);
+/**
+ * Allocates a new, empty palette. The palette may be reused for any number of
+ * images via guac_palette_reset().
+ *
+ * @return
+ *     A newly-allocated, empty palette, or NULL if allocation fails.
+ */
+guac_palette* guac_palette_alloc();
+
+/**
+ * Removes all colors from the given palette, such that it may be reused for
+ * another image.
+ *
+ * @param palette
+ *     The palette to reset.
+ */
+void guac_palette_reset(guac_palette* palette);
+
+/**
+ * Returns the index of the given color within the given palette, adding the
+ * color to the palette if not already present.
+ *
+ * @param palette
+ *     The palette to search.
+ *
+ * @param color
+ *     The 24-bit RGB color to find or add.
+ *
+ * @return
+ *     The index of the color within the palette, or -1 if the color is not
+ *     present and the palette is already full.
+ */
+int guac_palette_add(guac_palette* palette, int color);
+
+/**
+ * Returns the index of the given color within the given palette.
+ *
+ * @param palette
+ *     The palette to search.
+ *
+ * @param color
+ *     The 24-bit RGB color to find.
+ *
+ * @return
+ *     The index of the color within the palette, or -1 if the color is not
+ *     present.
+ */
 int guac_palette_find(guac_palette* palette, int color);
+
+/**
+ * Converts a row of 32-bit RGB pixels into palette indices, adding each
+ * color to the given palette as necessary. The palette is built and the row
+ * converted in the same pass, with runs of identically-colored pixels
+ * converted without further palette lookups.
+ *
+ * @param palette
+ *     The palette to convert the row with.
+ *
+ * @param row
+ *     The first pixel of the row. The highest-order byte of each pixel is
+ *     ignored.
+ *
+ * @param width
+ *     The number of pixels within the row.
+ *
+ * @param indices
+ *     The buffer which should receive the palette index of each pixel. This
+ *     buffer must have space for at least width bytes.
+ *
+ * @return
+ *     Zero if the entire row was converted, or -1 if the row contains more
+ *     colors than the palette can hold.
+ */
+int guac_palette_index_row(guac_palette* palette, const uint32_t* row,
+        int width, unsigned char* indices);
+
+/**
+ * Frees the given palette.
+ *
+ * @param palette
+ *     The palette to free.
+ */
 void guac_palette_free(guac_palette* palette);
 
 #endif
@@ -24,19 +24,210 @@
 #include "socket.h"
 #include "unicode.h"
 
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+/**
+ * Returns the number of bytes at the beginning of the given buffer which are
+ * ASCII characters (have their high bit clear), up to the given length. As
+ * each such byte is a complete, single-byte UTF-8 character, this is also the
+ * number of characters within that span. The buffer is tested eight bytes at
+ * a time where possible.
+ *
+ * @param buffer
+ *     The buffer to test.
+ *
+ * @param length
+ *     The maximum number of bytes to test.
+ *
+ * @return
+ *     The number of leading ASCII bytes within the given buffer, which will
+ *     not exceed the given length.
+ */
+static int guac_parser_ascii_length(const char* buffer, int length) {
+
+    int i = 0;
+
+    /* Skip eight bytes at a time while no high bits are set */
+    while (i + 8 <= length) {
+
+        uint64_t block;
+        memcpy(&block, buffer + i, sizeof(block));
+
+        if (block & 0x8080808080808080ULL)
+            break;
+
+        i += 8;
+
+    }
+
+    /* Test remaining bytes individually */
+    while (i < length && !(buffer[i] & 0x80))
+        i++;
+
+    return i;
+
+}
+
+/**
+ * The maximum number of unused large instruction buffers retained for reuse
+ * by future instructions which are too long for the buffer within their
+ * parser.
+ */
+#define GUAC_PARSER_POOL_SIZE 4
+
+/**
+ * Large instruction buffers which are not currently in use by any parser.
+ */
+static char* guac_parser_pool[GUAC_PARSER_POOL_SIZE];
+
+/**
+ * The size of each buffer within guac_parser_pool, in bytes.
+ */
+static int guac_parser_pool_sizes[GUAC_PARSER_POOL_SIZE];
+
+/**
+ * The number of buffers within guac_parser_pool.
+ */
+static int guac_parser_pool_length = 0;
+
+/**
+ * Lock which guards access to guac_parser_pool.
+ */
+static pthread_mutex_t guac_parser_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Borrows a buffer of at least the given size from the pool of unused large
+ * instruction buffers, allocating a new buffer if no such buffer is
+ * available. The smallest suitable buffer within the pool is chosen. The
+ * buffer must eventually be returned with guac_parser_pool_return().
+ *
+ * @param size
+ *     A pointer to the minimum size of the buffer, in bytes. This value is
+ *     updated to the actual size of the buffer returned.
+ *
+ * @return
+ *     A buffer of at least the given size, or NULL if no such buffer could be
+ *     allocated.
+ */
+static char* guac_parser_pool_borrow(int* size) {
+
+    char* buffer = NULL;
+    int best = -1;
+    int i;
+
+    pthread_mutex_lock(&guac_parser_pool_lock);
+
+    for (i = 0; i < guac_parser_pool_length; i++) {
+        if (guac_parser_pool_sizes[i] >= *size && (best == -1
+                    || guac_parser_pool_sizes[i] < guac_parser_pool_sizes[best]))
+            best = i;
+    }
+
+    if (best != -1) {
+
+        buffer = guac_parser_pool[best];
+        *size = guac_parser_pool_sizes[best];
+
+        /* Fill gap with last buffer in pool */
+        guac_parser_pool_length--;
+        guac_parser_pool[best] = guac_parser_pool[guac_parser_pool_length];
+        guac_parser_pool_sizes[best] =
+            guac_parser_pool_sizes[guac_parser_pool_length];
+
+    }
+
+    pthread_mutex_unlock(&guac_parser_pool_lock);
+
+    if (buffer == NULL)
+        buffer = malloc(*size);
+
+    return buffer;
+
+}
+
+/**
+ * Returns a buffer borrowed with guac_parser_pool_borrow() to the pool of
+ * unused large instruction buffers, freeing the buffer if the pool is full.
+ *
+ * @param buffer
+ *     The buffer to return.
+ *
+ * @param size
+ *     The size of the buffer, in bytes.
+ */
+static void guac_parser_pool_return(char* buffer, int size) {
+
+    pthread_mutex_lock(&guac_parser_pool_lock);
+
+    if (guac_parser_pool_length < GUAC_PARSER_POOL_SIZE) {
+        guac_parser_pool[guac_parser_pool_length] = buffer;
+        guac_parser_pool_sizes[guac_parser_pool_length] = size;
+        guac_parser_pool_length++;
+        buffer = NULL;
+    }
+
+    pthread_mutex_unlock(&guac_parser_pool_lock);
+
+    free(buffer);
+
+}
+
+/**
+ * Moves any unparsed data back into the buffer within the given parser,
+ * returning the larger buffer borrowed by that parser to the pool. If the
+ * parser has not borrowed a buffer, or the unparsed data does not fit
+ * within the buffer of the parser, this function has no effect. This
+ * function must not be invoked while an instruction is being read.
+ *
+ * @param parser
+ *     The parser whose borrowed buffer should be returned.
+ */
+static void guac_parser_return_buffer(guac_parser* parser) {
+
+    char* start = parser->__instructionbuf_unparsed_start;
+    char* end = parser->__instructionbuf_unparsed_end;
+
+    if (parser->__buffer == parser->__instructionbuf
+            || end - start > GUAC_INSTRUCTION_BUFFER_SIZE)
+        return;
+
+    memcpy(parser->__instructionbuf, start, end - start);
+    guac_parser_pool_return(parser->__buffer, parser->__buffer_size);
+
+    parser->__buffer = parser->__instructionbuf;
+    parser->__buffer_size = GUAC_INSTRUCTION_BUFFER_SIZE;
+    parser->__instructionbuf_unparsed_start = parser->__instructionbuf;
+    parser->__instructionbuf_unparsed_end =
+        parser->__instructionbuf + (end - start);
+
+}
+
 static void guac_parser_reset(guac_parser* parser) {
     parser->opcode = NULL;
     parser->argc = 0;
     parser->state = GUAC_PARSE_LENGTH;
     parser->__elementc = 0;
     parser->__element_length = 0;
+    parser->__instruction_length = 0;
 }
 
 guac_parser* guac_parser_alloc() {
+    return guac_parser_alloc_max_length(GUAC_INSTRUCTION_MAX_LENGTH);
+}
+
+guac_parser* guac_parser_alloc_max_length(int max_length) {
+
+    /* Each character may require up to four bytes */
+    if (max_length <= 0 || max_length > INT_MAX / 4) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Invalid maximum instruction length";
+        return NULL;
+    }
 
     /* Allocate space for parser */
     guac_parser* parser = malloc(sizeof(guac_parser));
@@ -46,6 +237,16 @@ guac_parser* guac_parser_alloc() {
         return NULL;
     }
 
+    parser->__buffer = parser->__instructionbuf;
+    parser->__buffer_size = GUAC_INSTRUCTION_BUFFER_SIZE;
+    parser->__max_element_length = max_length;
+
+    /* Allow a larger buffer to be borrowed if the longest element would not
+     * otherwise fit */
+    parser->__buffer_max_size = max_length * 4;
+    if (parser->__buffer_max_size < GUAC_INSTRUCTION_BUFFER_SIZE)
+        parser->__buffer_max_size = GUAC_INSTRUCTION_BUFFER_SIZE;
+
     /* Init parse start/end markers */
     parser->__instructionbuf_unparsed_start = parser->__instructionbuf;
     parser->__instructionbuf_unparsed_end = parser->__instructionbuf;
@@ -97,7 +298,7 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
         }
 
         /* If too long, parse error */
-        if (parsed_length > GUAC_INSTRUCTION_MAX_LENGTH) {
+        if (parsed_length > parser->__max_element_length) {
             parser->state = GUAC_PARSE_ERROR;
             return 0;
         }
@@ -112,6 +313,27 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
         while (bytes_parsed < length && parser->__element_length >= 0) {
 
+            /* Skip any run of ASCII characters within the element at once,
+             * as each is exactly one byte in length */
+            if (parser->__element_length > 0) {
+
+                int available = length - bytes_parsed;
+                if (available > parser->__element_length)
+                    available = parser->__element_length;
+
+                int ascii_length = guac_parser_ascii_length(char_buffer,
+                        available);
+
+                parser->__element_length -= ascii_length;
+                bytes_parsed += ascii_length;
+                char_buffer += ascii_length;
+
+                /* Stop if all available data has been consumed */
+                if (bytes_parsed == length)
+                    break;
+
+            }
+
             /* Get length of current character */
             char c = *char_buffer;
             int char_length = guac_utf8_charsize((unsigned char) c);
@@ -165,14 +387,17 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
 int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout) {
 
+    /* Begin next instruction if previous was ended, returning any borrowed
+     * buffer now that the previous instruction has been handled */
+    if (parser->state == GUAC_PARSE_COMPLETE) {
+        guac_parser_return_buffer(parser);
+        guac_parser_reset(parser);
+    }
+
     char* unparsed_end   = parser->__instructionbuf_unparsed_end;
     char* unparsed_start = parser->__instructionbuf_unparsed_start;
     char* instr_start    = parser->__instructionbuf_unparsed_start;
-    char* buffer_end     = parser->__instructionbuf + sizeof(parser->__instructionbuf);
-
-    /* Begin next instruction if previous was ended */
-    if (parser->state == GUAC_PARSE_COMPLETE)
-        guac_parser_reset(parser);
+    char* buffer_end     = parser->__buffer + parser->__buffer_size;
 
     while (parser->state != GUAC_PARSE_COMPLETE
         && parser->state != GUAC_PARSE_ERROR) {
@@ -189,19 +414,19 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
             if (unparsed_end == buffer_end) {
 
                 /* Shift backward if possible */
-                if (instr_start != parser->__instructionbuf) {
+                if (instr_start != parser->__buffer) {
 
                     int i;
 
                     /* Shift buffer */
-                    int offset = instr_start - parser->__instructionbuf;
-                    memmove(parser->__instructionbuf, instr_start,
+                    int offset = instr_start - parser->__buffer;
+                    memmove(parser->__buffer, instr_start,
                             unparsed_end - instr_start);
 
                     /* Update tracking pointers */
                     unparsed_end -= offset;
                     unparsed_start -= offset;
-                    instr_start = parser->__instructionbuf;
+                    instr_start = parser->__buffer;
 
                     /* Update parsed elements, if any */
                     for (i=0; i < parser->__elementc; i++)
@@ -209,6 +434,49 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
 
                 }
 
+                /* Otherwise, borrow a larger buffer if allowed, doubling the
+                 * size of the current buffer such that memory is used only
+                 * in proportion to the length of the instruction */
+                else if (parser->__buffer_size < parser->__buffer_max_size) {
+
+                    int i;
+
+                    int size = parser->__buffer_max_size;
+                    if (parser->__buffer_size <= size / 2)
+                        size = parser->__buffer_size * 2;
+
+                    char* buffer = guac_parser_pool_borrow(&size);
+                    if (buffer == NULL) {
+                        guac_error = GUAC_STATUS_NO_MEMORY;
+                        guac_error_message = "Insufficient memory to grow "
+                                             "instruction buffer";
+                        return -1;
+                    }
+
+                    /* Move instruction thus far into new buffer */
+                    memcpy(buffer, instr_start, unparsed_end - instr_start);
+
+                    /* Update parsed elements, if any */
+                    for (i=0; i < parser->__elementc; i++)
+                        parser->__elementv[i] = buffer
+                            + (parser->__elementv[i] - instr_start);
+
+                    /* Update tracking pointers */
+                    unparsed_start = buffer + (unparsed_start - instr_start);
+                    unparsed_end = buffer + (unparsed_end - instr_start);
+                    instr_start = buffer;
+                    buffer_end = buffer + size;
+
+                    /* Return any buffer previously borrowed */
+                    if (parser->__buffer != parser->__instructionbuf)
+                        guac_parser_pool_return(parser->__buffer,
+                                parser->__buffer_size);
+
+                    parser->__buffer = buffer;
+                    parser->__buffer_size = size;
+
+                }
+
                 /* Otherwise, no memory to read */
                 else {
                     guac_error = GUAC_STATUS_NO_MEMORY;
@@ -248,8 +516,10 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
         }
 
         /* If data was parsed, advance buffer */
-        else
+        else {
             unparsed_start += parsed;
+            parser->__instruction_length += parsed;
+        }
 
     } /* end while parsing data */
 
@@ -313,6 +583,12 @@ int guac_parser_shift(guac_parser* parser, void* buffer, int length) {
 }
 
 void guac_parser_free(guac_parser* parser) {
+
+    /* Return any borrowed buffer */
+    if (parser->__buffer != parser->__instructionbuf)
+        guac_parser_pool_return(parser->__buffer, parser->__buffer_size);
+
     free(parser);
+
 }
 
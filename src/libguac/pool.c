@@ -21,28 +21,63 @@
 
 #include "pool.h"
 
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 
+/**
+ * The minimum number of freed integers that the ring of any guac_pool can
+ * hold awaiting reuse. Integers freed while the ring already holds this many
+ * (or the pool's minimum size, if larger) are stored in the pool's overflow
+ * queue instead. This must be a power of two.
+ */
+#define GUAC_POOL_MIN_CAPACITY 4096
+
+/**
+ * The number of entries initially allocated for the overflow queue of any
+ * guac_pool once that queue is first needed.
+ */
+#define GUAC_POOL_OVERFLOW_INITIAL_CAPACITY 1024
+
 guac_pool* guac_pool_alloc(int size) {
 
-    pthread_mutexattr_t lock_attributes;
+    unsigned int i;
     guac_pool* pool = malloc(sizeof(guac_pool));
 
     /* If unable to allocate, just return NULL. */
     if (pool == NULL)
         return NULL;
 
+    /* Ring must be able to hold at least the minimum size */
+    unsigned int capacity = GUAC_POOL_MIN_CAPACITY;
+    while (capacity < (unsigned int) size)
+        capacity *= 2;
+
+    /* Preallocate ring of freed integers */
+    pool->__ints = malloc(sizeof(guac_pool_int) * capacity);
+    if (pool->__ints == NULL) {
+        free(pool);
+        return NULL;
+    }
+
+    /* Each entry is initially empty and ready to be stored to */
+    for (i = 0; i < capacity; i++)
+        pool->__ints[i].__sequence = i;
+
     /* Initialize empty pool */
     pool->min_size = size;
     pool->active = 0;
     pool->__next_value = 0;
-    pool->__head = NULL;
-    pool->__tail = NULL;
+    pool->__capacity = capacity;
+    pool->__head = 0;
+    pool->__tail = 0;
 
-    /* Init lock */
-    pthread_mutexattr_init(&lock_attributes);
-    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&(pool->__lock), &lock_attributes);
+    /* Overflow queue is allocated only when needed */
+    pthread_mutex_init(&(pool->__lock), NULL);
+    pool->__overflow = NULL;
+    pool->__overflow_capacity = 0;
+    pool->__overflow_head = 0;
+    pool->__overflow_length = 0;
 
     return pool;
 
@@ -50,86 +85,367 @@ guac_pool* guac_pool_alloc(int size) {
 
 void guac_pool_free(guac_pool* pool) {
 
-    /* Free all ints in pool */
-    guac_pool_int* current = pool->__head;
-    while (current != NULL) {
+    /* Free overflow queue, ring, and pool */
+    pthread_mutex_destroy(&(pool->__lock));
+    free(pool->__overflow);
+    free(pool->__ints);
+    free(pool);
+
+}
+
+/**
+ * Returns a new integer which has never before been returned by the given
+ * pool, but only if that integer would be less than the given limit.
+ *
+ * @param pool
+ *     The guac_pool to retrieve a new integer from.
+ *
+ * @param limit
+ *     The value that the returned integer must be less than.
+ *
+ * @return
+ *     A new integer, or -1 if all integers less than the given limit have
+ *     already been returned.
+ */
+static int __guac_pool_next_new_int(guac_pool* pool, int limit) {
 
-        guac_pool_int* old = current;
-        current = current->__next;
+    int value = __atomic_load_n(&(pool->__next_value), __ATOMIC_RELAXED);
 
-        free(old);
+    /* Claim next value only if within limit */
+    while (value < limit) {
+        if (__atomic_compare_exchange_n(&(pool->__next_value), &value,
+                    value + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return value;
     }
 
-    /* Destroy lock */
-    pthread_mutex_destroy(&(pool->__lock));
+    return -1;
 
-    /* Free pool */
-    free(pool);
+}
+
+/**
+ * Removes and returns the integer which was least recently stored in the
+ * ring of the given pool.
+ *
+ * @param pool
+ *     The guac_pool to retrieve a freed integer from.
+ *
+ * @return
+ *     The least recently stored integer, or -1 if the ring is empty.
+ */
+static int __guac_pool_ring_remove(guac_pool* pool) {
+
+    unsigned int mask = pool->__capacity - 1;
+    unsigned int position = __atomic_load_n(&(pool->__head), __ATOMIC_RELAXED);
+
+    for (;;) {
+
+        guac_pool_int* entry = &(pool->__ints[position & mask]);
+        unsigned int sequence = __atomic_load_n(&(entry->__sequence),
+                __ATOMIC_ACQUIRE);
+
+        int difference = (int) (sequence - (position + 1));
+
+        /* Entry contains a freed integer; attempt to claim it */
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&(pool->__head), &position,
+                        position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+
+                int value = entry->value;
+
+                /* Mark entry as ready to be stored to on next pass */
+                __atomic_store_n(&(entry->__sequence), position + mask + 1,
+                        __ATOMIC_RELEASE);
+
+                return value;
+
+            }
+        }
+
+        /* Entry not yet stored to; pool is empty */
+        else if (difference < 0)
+            return -1;
+
+        /* Another thread claimed this entry first; try again */
+        else
+            position = __atomic_load_n(&(pool->__head), __ATOMIC_RELAXED);
+
+    }
 
 }
 
-int guac_pool_next_int(guac_pool* pool) {
+/**
+ * Stores the given freed integer in the ring of the given pool, unless the
+ * ring is full.
+ *
+ * @param pool
+ *     The guac_pool whose ring should receive the given integer.
+ *
+ * @param value
+ *     The integer to store.
+ *
+ * @return
+ *     Zero if the integer was stored, non-zero if the ring is full.
+ */
+static int __guac_pool_ring_store(guac_pool* pool, int value) {
 
-    int value;
+    unsigned int mask = pool->__capacity - 1;
+    unsigned int position = __atomic_load_n(&(pool->__tail), __ATOMIC_RELAXED);
 
-    /* Acquire exclusive access */
-    pthread_mutex_lock(&(pool->__lock));
+    for (;;) {
 
-    pool->active++;
+        guac_pool_int* entry = &(pool->__ints[position & mask]);
+        unsigned int sequence = __atomic_load_n(&(entry->__sequence),
+                __ATOMIC_ACQUIRE);
+
+        int difference = (int) (sequence - position);
+
+        /* Entry is empty; attempt to claim it */
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&(pool->__tail), &position,
+                        position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+
+                entry->value = value;
+
+                /* Mark entry as ready to be removed */
+                __atomic_store_n(&(entry->__sequence), position + 1,
+                        __ATOMIC_RELEASE);
+
+                return 0;
+
+            }
+        }
+
+        /* Entry still in use */
+        else if (difference < 0) {
+
+            /* Ring is full */
+            unsigned int head = __atomic_load_n(&(pool->__head),
+                    __ATOMIC_RELAXED);
+            if (position - head >= pool->__capacity)
+                return 1;
+
+            /* Otherwise, the entry is still being removed by another thread */
+            sched_yield();
+            position = __atomic_load_n(&(pool->__tail), __ATOMIC_RELAXED);
+
+        }
+
+        /* Another thread claimed this entry first; try again */
+        else
+            position = __atomic_load_n(&(pool->__tail), __ATOMIC_RELAXED);
+
+    }
+
+}
+
+/**
+ * Appends the given freed integer to the overflow queue of the given pool,
+ * growing the queue if necessary. The pool's lock must be held.
+ *
+ * @param pool
+ *     The guac_pool whose overflow queue should receive the given integer.
+ *
+ * @param value
+ *     The integer to append.
+ *
+ * @return
+ *     Zero if the integer was appended, non-zero if the queue could not be
+ *     grown.
+ */
+static int __guac_pool_overflow_append(guac_pool* pool, int value) {
+
+    unsigned int length = pool->__overflow_length;
+
+    /* Grow queue if full, unwrapping its contents into the new space */
+    if (length == pool->__overflow_capacity) {
+
+        unsigned int capacity = pool->__overflow_capacity * 2;
+        if (capacity == 0)
+            capacity = GUAC_POOL_OVERFLOW_INITIAL_CAPACITY;
+
+        int* overflow = malloc(sizeof(int) * capacity);
+        if (overflow == NULL)
+            return 1;
+
+        unsigned int i;
+        for (i = 0; i < length; i++)
+            overflow[i] = pool->__overflow[(pool->__overflow_head + i)
+                % pool->__overflow_capacity];
+
+        free(pool->__overflow);
+        pool->__overflow = overflow;
+        pool->__overflow_capacity = capacity;
+        pool->__overflow_head = 0;
 
-    /* If more integers are needed, return a new one. */
-    if (pool->__head == NULL || pool->__next_value < pool->min_size) {
-        value = pool->__next_value++;
-        pthread_mutex_unlock(&(pool->__lock));
-        return value;
     }
 
-    /* Otherwise, remove first integer. */
-    value = pool->__head->value;
+    pool->__overflow[(pool->__overflow_head + length)
+        % pool->__overflow_capacity] = value;
+
+    __atomic_store_n(&(pool->__overflow_length), length + 1,
+            __ATOMIC_RELEASE);
+
+    return 0;
+
+}
+
+/**
+ * Removes and returns the integer at the head of the overflow queue of the
+ * given pool. The pool's lock must be held, and the queue must not be empty.
+ *
+ * @param pool
+ *     The guac_pool to remove an integer from.
+ *
+ * @return
+ *     The least recently appended integer.
+ */
+static int __guac_pool_overflow_remove(guac_pool* pool) {
+
+    int value = pool->__overflow[pool->__overflow_head];
+
+    pool->__overflow_head = (pool->__overflow_head + 1)
+        % pool->__overflow_capacity;
+
+    __atomic_store_n(&(pool->__overflow_length),
+            pool->__overflow_length - 1, __ATOMIC_RELEASE);
+
+    return value;
 
-    /* If only one element exists, reset pool to empty. */
-    if (pool->__tail == pool->__head) {
-        free(pool->__head);
-        pool->__head = NULL;
-        pool->__tail = NULL;
+}
+
+/**
+ * Removes and returns the integer which was least recently freed into the
+ * given pool. Integers within the ring are always older than those within the
+ * overflow queue, thus the overflow queue is used only once the ring is empty,
+ * at which point as much of the overflow queue as possible is moved back into
+ * the ring.
+ *
+ * @param pool
+ *     The guac_pool to retrieve a freed integer from.
+ *
+ * @return
+ *     The least recently freed integer, or -1 if no freed integers are
+ *     available.
+ */
+static int __guac_pool_next_freed_int(guac_pool* pool) {
+
+    int value = __guac_pool_ring_remove(pool);
+    if (value != -1)
+        return value;
+
+    /* Ring is empty; fall back to overflow queue, if in use */
+    if (__atomic_load_n(&(pool->__overflow_length), __ATOMIC_ACQUIRE) == 0)
+        return -1;
+
+    pthread_mutex_lock(&(pool->__lock));
+
+    /* Another thread may have drained the queue into the ring first */
+    if (pool->__overflow_length == 0) {
+        pthread_mutex_unlock(&(pool->__lock));
+        return __guac_pool_ring_remove(pool);
     }
 
-    /* Otherwise, advance head. */
-    else {
-        guac_pool_int* old_head = pool->__head;
-        pool->__head = old_head->__next;
-        free(old_head);
+    value = __guac_pool_overflow_remove(pool);
+
+    /* Drain as much of the remaining queue as possible back into the ring */
+    while (pool->__overflow_length > 0) {
+
+        int next = pool->__overflow[pool->__overflow_head];
+        if (__guac_pool_ring_store(pool, next))
+            break;
+
+        __guac_pool_overflow_remove(pool);
+
     }
 
-    /* Return retrieved value. */
     pthread_mutex_unlock(&(pool->__lock));
     return value;
+
+}
+
+int guac_pool_next_int(guac_pool* pool) {
+
+    int value;
+
+    __atomic_add_fetch(&(pool->active), 1, __ATOMIC_RELAXED);
+
+    /* If more integers are needed, return a new one. */
+    value = __guac_pool_next_new_int(pool, pool->min_size);
+    if (value != -1)
+        return value;
+
+    /* Otherwise, reuse the least recently freed integer, if any. */
+    value = __guac_pool_next_freed_int(pool);
+    if (value != -1)
+        return value;
+
+    /* No freed integers are available */
+    return __atomic_fetch_add(&(pool->__next_value), 1, __ATOMIC_RELAXED);
+
+}
+
+int guac_pool_next_int_below(guac_pool* pool, int limit) {
+
+    int value;
+    int active = __atomic_load_n(&(pool->active), __ATOMIC_RELAXED);
+
+    /* Reserve one of the available integers, if any */
+    do {
+        if (active >= limit)
+            return -1;
+    } while (!__atomic_compare_exchange_n(&(pool->active), &active,
+                active + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    /* If more integers are needed, return a new one. */
+    value = __guac_pool_next_new_int(pool,
+            pool->min_size < limit ? pool->min_size : limit);
+    if (value != -1)
+        return value;
+
+    /* Otherwise, reuse a freed integer or return a new one within the limit.
+     * As integers are freed into the pool before they stop being counted as
+     * active, one of these must eventually succeed. */
+    for (;;) {
+
+        value = __guac_pool_next_freed_int(pool);
+        if (value != -1)
+            return value;
+
+        value = __guac_pool_next_new_int(pool, limit);
+        if (value != -1)
+            return value;
+
+        /* A concurrently freed integer has not yet been fully stored */
+        sched_yield();
+
+    }
+
 }
 
 void guac_pool_free_int(guac_pool* pool, int value) {
 
-    /* Allocate and initialize new returned value */
-    guac_pool_int* pool_int = malloc(sizeof(guac_pool_int));
-    pool_int->value = value;
-    pool_int->__next = NULL;
+    /* Store in ring unless overflow queue is in use, in which case the ring
+     * must be emptied first to preserve ordering */
+    if (__atomic_load_n(&(pool->__overflow_length), __ATOMIC_ACQUIRE) != 0
+            || __guac_pool_ring_store(pool, value)) {
 
-    /* Acquire exclusive access */
-    pthread_mutex_lock(&(pool->__lock));
+        pthread_mutex_lock(&(pool->__lock));
+
+        /* If the queue was drained in the meantime, the ring may have room */
+        if (pool->__overflow_length != 0
+                || __guac_pool_ring_store(pool, value)) {
 
-    pool->active--;
+            /* If even the queue cannot be grown, the value is simply not
+             * reused */
+            __guac_pool_overflow_append(pool, value);
 
-    /* If pool empty, store as sole entry. */
-    if (pool->__tail == NULL)
-        pool->__head = pool->__tail = pool_int;
+        }
+
+        pthread_mutex_unlock(&(pool->__lock));
 
-    /* Otherwise, append to end of pool. */
-    else {
-        pool->__tail->__next = pool_int;
-        pool->__tail = pool_int;
     }
 
     /* Value has been freed */
-    pthread_mutex_unlock(&(pool->__lock));
+    __atomic_sub_fetch(&(pool->active), 1, __ATOMIC_RELEASE);
 
 }
-
@@ -20,17 +20,18 @@
 #include "config.h"
 
 #include "error.h"
+#include "format.h"
 #include "layer.h"
 #include "object.h"
 #include "palette.h"
 #include "protocol.h"
 #include "socket.h"
+#include "stats.h"
 #include "stream.h"
 #include "unicode.h"
 
 #include <cairo/cairo.h>
 
-#include <inttypes.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -39,84 +40,267 @@
 #include <string.h>
 #include <sys/types.h>
 
-/* Output formatting functions */
+/* Instruction building functions */
 
-ssize_t __guac_socket_write_length_string(guac_socket* socket, const char* str) {
+/**
+ * Writes all data currently buffered within the given builder to the
+ * builder's socket, emptying the builder's buffer. If the write fails, the
+ * builder is marked as failed.
+ *
+ * @param builder
+ *     The builder to flush.
+ */
+static void __guac_protocol_builder_flush(guac_protocol_builder* builder) {
+
+    if (builder->length == 0)
+        return;
+
+    if (guac_socket_write(builder->socket, builder->buffer, builder->length))
+        builder->failed = 1;
 
-    return
-           guac_socket_write_int(socket, guac_utf8_strlen(str))
-        || guac_socket_write_string(socket, ".")
-        || guac_socket_write_string(socket, str);
+    builder->written += builder->length;
+    builder->length = 0;
 
 }
 
-ssize_t __guac_socket_write_length_int(guac_socket* socket, int64_t i) {
+/**
+ * Ensures that at least the given number of bytes are available within the
+ * given builder's buffer, flushing the buffer if necessary. The number of
+ * bytes requested must not exceed GUAC_PROTOCOL_BUILDER_BUFFER_SIZE.
+ *
+ * @param builder
+ *     The builder to reserve space within.
+ *
+ * @param length
+ *     The number of bytes required.
+ *
+ * @return
+ *     A pointer to the first available byte within the builder's buffer.
+ */
+static char* __guac_protocol_builder_reserve(guac_protocol_builder* builder,
+        int length) {
 
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%"PRIi64, i);
-    return __guac_socket_write_length_string(socket, buffer);
+    if (builder->length + length > GUAC_PROTOCOL_BUILDER_BUFFER_SIZE)
+        __guac_protocol_builder_flush(builder);
+
+    return builder->buffer + builder->length;
 
 }
 
-ssize_t __guac_socket_write_length_double(guac_socket* socket, double d) {
+/**
+ * Appends the given data to the given builder. Data which is too large to
+ * fit within the builder's buffer is written directly to the socket.
+ *
+ * @param builder
+ *     The builder to append to.
+ *
+ * @param data
+ *     The data to append.
+ *
+ * @param length
+ *     The number of bytes of data to append.
+ */
+static void __guac_protocol_builder_append(guac_protocol_builder* builder,
+        const char* data, int length) {
+
+    /* Write large data directly, following anything already buffered */
+    if (length > GUAC_PROTOCOL_BUILDER_BUFFER_SIZE) {
+        __guac_protocol_builder_flush(builder);
+        if (guac_socket_write(builder->socket, data, length))
+            builder->failed = 1;
+        builder->written += length;
+        return;
+    }
 
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%.16g", d);
-    return __guac_socket_write_length_string(socket, buffer);
+    memcpy(__guac_protocol_builder_reserve(builder, length), data, length);
+    builder->length += length;
 
 }
 
-/* Protocol functions */
+/**
+ * Appends the length prefix of an element having the given length, including
+ * the separating comma if the element is an argument.
+ *
+ * @param builder
+ *     The builder to append to.
+ *
+ * @param length
+ *     The length of the element, in Unicode characters.
+ *
+ * @param argument
+ *     Non-zero if the element is an argument, zero if the element is the
+ *     opcode.
+ */
+static void __guac_protocol_builder_prefix(guac_protocol_builder* builder,
+        int length, int argument) {
 
-int guac_protocol_send_ack(guac_socket* socket, guac_stream* stream,
-        const char* error, guac_protocol_status status) {
+    char* start = __guac_protocol_builder_reserve(builder,
+            GUAC_FORMAT_INT_MAX_LENGTH + 2);
+    char* current = start;
 
-    int ret_val;
+    if (argument)
+        *(current++) = ',';
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.ack,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, error)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, status)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    current += guac_format_int(current, length);
+    *(current++) = '.';
+
+    builder->length += current - start;
 
 }
 
-static int __guac_protocol_send_args(guac_socket* socket, const char** args) {
+/**
+ * Terminates the instruction currently being built, if any, counting that
+ * instruction within the statistics of the builder's socket if those
+ * statistics are being collected.
+ *
+ * @param builder
+ *     The builder containing the instruction to terminate.
+ */
+static void __guac_protocol_builder_terminate(guac_protocol_builder* builder) {
 
-    int i;
+    if (!builder->open)
+        return;
+
+    __guac_protocol_builder_append(builder, ";", 1);
+    builder->open = 0;
+
+    /* Count instruction only if statistics are enabled */
+    if (builder->socket->stats != NULL)
+        guac_stats_count_instruction(builder->socket->stats, GUAC_STATS_SENT,
+                builder->opcode, builder->written + builder->length
+                    - builder->instruction_start);
 
-    if (guac_socket_write_string(socket, "4.args")) return -1;
+}
+
+void guac_protocol_builder_init(guac_protocol_builder* builder,
+        guac_socket* socket) {
+
+    builder->socket = socket;
+    builder->open = 0;
+    builder->failed = 0;
+    builder->length = 0;
+    builder->written = 0;
+
+    guac_socket_instruction_begin(socket);
 
-    for (i=0; args[i] != NULL; i++) {
+}
+
+void guac_protocol_builder_opcode(guac_protocol_builder* builder,
+        const char* opcode) {
 
-        if (guac_socket_write_string(socket, ","))
-            return -1;
+    int length = strlen(opcode);
 
-        if (__guac_socket_write_length_string(socket, args[i]))
-            return -1;
+    /* Terminate any previous instruction */
+    __guac_protocol_builder_terminate(builder);
 
+    /* Note start of instruction for sake of statistics */
+    if (builder->socket->stats != NULL) {
+        builder->opcode = guac_protocol_get_opcode(opcode);
+        builder->instruction_start = builder->written + builder->length;
     }
 
-    return guac_socket_write_string(socket, ";");
+    __guac_protocol_builder_prefix(builder, length, 0);
+    __guac_protocol_builder_append(builder, opcode, length);
+    builder->open = 1;
+
+}
+
+void guac_protocol_builder_int(guac_protocol_builder* builder,
+        int64_t value) {
+
+    /* Reserve enough space for the prefix and digits of any integer */
+    char* start = __guac_protocol_builder_reserve(builder,
+            GUAC_FORMAT_INT_MAX_LENGTH + 4);
+    char* current = start;
+
+    /* Format digits after space for the prefix, which is at most "20." */
+    int length = guac_format_int(start + 4, value);
+
+    *(current++) = ',';
+    current += guac_format_int(current, length);
+    *(current++) = '.';
+
+    /* Move digits to immediately follow the prefix */
+    memmove(current, start + 4, length);
+    current += length;
+
+    builder->length += current - start;
+
+}
+
+void guac_protocol_builder_double(guac_protocol_builder* builder,
+        double value) {
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%.16g", value);
+    guac_protocol_builder_string(builder, buffer);
+
+}
+
+void guac_protocol_builder_string(guac_protocol_builder* builder,
+        const char* value) {
+
+    __guac_protocol_builder_prefix(builder, guac_utf8_strlen(value), 1);
+    __guac_protocol_builder_append(builder, value, strlen(value));
+
+}
+
+void guac_protocol_builder_base64(guac_protocol_builder* builder,
+        const void* data, int count) {
+
+    __guac_protocol_builder_prefix(builder, (count + 2) / 3 * 4, 1);
+
+    /* Encode directly to the socket, following anything already buffered */
+    __guac_protocol_builder_flush(builder);
+    if (guac_socket_write_base64(builder->socket, data, count)
+            || guac_socket_flush_base64(builder->socket))
+        builder->failed = 1;
+
+    builder->written += (count + 2) / 3 * 4;
+
+}
+
+int guac_protocol_builder_finish(guac_protocol_builder* builder) {
+
+    /* Terminate final instruction */
+    __guac_protocol_builder_terminate(builder);
+
+    __guac_protocol_builder_flush(builder);
+    guac_socket_instruction_end(builder->socket);
+
+    return builder->failed;
+
+}
+
+/* Protocol functions */
+
+int guac_protocol_send_ack(guac_socket* socket, guac_stream* stream,
+        const char* error, guac_protocol_status status) {
+
+    guac_protocol_builder builder;
+
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "ack");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_string(&builder, error);
+    guac_protocol_builder_int(&builder, status);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_args(guac_socket* socket, const char** args) {
 
-    int ret_val;
+    int i;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = __guac_protocol_send_args(socket, args);
-    guac_socket_instruction_end(socket);
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "args");
 
-    return ret_val;
+    for (i=0; args[i] != NULL; i++)
+        guac_protocol_builder_string(&builder, args[i]);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -124,91 +308,63 @@ int guac_protocol_send_arc(guac_socket* socket, const guac_layer* layer,
         int x, int y, int radius, double startAngle, double endAngle,
         int negative) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.arc,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, radius)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, startAngle)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, endAngle)
-        || guac_socket_write_string(socket, ",")
-        || guac_socket_write_string(socket, negative ? "1.1" : "1.0")
-        || guac_socket_write_string(socket, ";");
-    guac_socket_instruction_end(socket);
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "arc");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+    guac_protocol_builder_int(&builder, radius);
+    guac_protocol_builder_double(&builder, startAngle);
+    guac_protocol_builder_double(&builder, endAngle);
+    guac_protocol_builder_int(&builder, negative ? 1 : 0);
 
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_audio(guac_socket* socket, const guac_stream* stream,
         const char* mimetype) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "5.audio,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ";");
-    guac_socket_instruction_end(socket);
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "audio");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_string(&builder, mimetype);
 
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_blob(guac_socket* socket, const guac_stream* stream,
         const void* data, int count) {
 
-    int base64_length = (count + 2) / 3 * 4;
+    guac_protocol_builder builder;
 
-    int ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "blob");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_base64(&builder, data, count);
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.blob,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || guac_socket_write_int(socket, base64_length)
-        || guac_socket_write_string(socket, ".")
-        || guac_socket_write_base64(socket, data, count)
-        || guac_socket_flush_base64(socket)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_body(guac_socket* socket, const guac_object* object,
         const guac_stream* stream, const char* mimetype, const char* name) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.body,")
-        || __guac_socket_write_length_int(socket, object->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "body");
+    guac_protocol_builder_int(&builder, object->index);
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_string(&builder, mimetype);
+    guac_protocol_builder_string(&builder, name);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -216,106 +372,71 @@ int guac_protocol_send_cfill(guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer,
         int r, int g, int b, int a) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.cfill,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "cfill");
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, r);
+    guac_protocol_builder_int(&builder, g);
+    guac_protocol_builder_int(&builder, b);
+    guac_protocol_builder_int(&builder, a);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_close(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.close,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "close");
+    guac_protocol_builder_int(&builder, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
-static int __guac_protocol_send_connect(guac_socket* socket, const char** args) {
+int guac_protocol_send_connect(guac_socket* socket, const char** args) {
 
     int i;
+    guac_protocol_builder builder;
 
-    if (guac_socket_write_string(socket, "7.connect")) return -1;
-
-    for (i=0; args[i] != NULL; i++) {
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "connect");
 
-        if (guac_socket_write_string(socket, ","))
-            return -1;
+    for (i=0; args[i] != NULL; i++)
+        guac_protocol_builder_string(&builder, args[i]);
 
-        if (__guac_socket_write_length_string(socket, args[i]))
-            return -1;
-
-    }
-
-    return guac_socket_write_string(socket, ";");
-
-}
-
-int guac_protocol_send_connect(guac_socket* socket, const char** args) {
-
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val = __guac_protocol_send_connect(socket, args);
-    guac_socket_instruction_end(socket);
-
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_clip(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.clip,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "clip");
+    guac_protocol_builder_int(&builder, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_clipboard(guac_socket* socket, const guac_stream* stream,
         const char* mimetype) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "9.clipboard,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "clipboard");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_string(&builder, mimetype);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -323,32 +444,21 @@ int guac_protocol_send_copy(guac_socket* socket,
         const guac_layer* srcl, int srcx, int srcy, int w, int h,
         guac_composite_mode mode, const guac_layer* dstl, int dstx, int dsty) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.copy,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "copy");
+    guac_protocol_builder_int(&builder, srcl->index);
+    guac_protocol_builder_int(&builder, srcx);
+    guac_protocol_builder_int(&builder, srcy);
+    guac_protocol_builder_int(&builder, w);
+    guac_protocol_builder_int(&builder, h);
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, dstl->index);
+    guac_protocol_builder_int(&builder, dstx);
+    guac_protocol_builder_int(&builder, dsty);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -357,112 +467,80 @@ int guac_protocol_send_cstroke(guac_socket* socket,
         guac_line_cap_style cap, guac_line_join_style join, int thickness,
         int r, int g, int b, int a) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "7.cstroke,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cap)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, join)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, thickness)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "cstroke");
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, cap);
+    guac_protocol_builder_int(&builder, join);
+    guac_protocol_builder_int(&builder, thickness);
+    guac_protocol_builder_int(&builder, r);
+    guac_protocol_builder_int(&builder, g);
+    guac_protocol_builder_int(&builder, b);
+    guac_protocol_builder_int(&builder, a);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_cursor(guac_socket* socket, int x, int y,
         const guac_layer* srcl, int srcx, int srcy, int w, int h) {
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "6.cursor,")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "cursor");
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+    guac_protocol_builder_int(&builder, srcl->index);
+    guac_protocol_builder_int(&builder, srcx);
+    guac_protocol_builder_int(&builder, srcy);
+    guac_protocol_builder_int(&builder, w);
+    guac_protocol_builder_int(&builder, h);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_curve(guac_socket* socket, const guac_layer* layer,
         int cp1x, int cp1y, int cp2x, int cp2y, int x, int y) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.curve,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp1x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp1y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp2x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp2y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "curve");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, cp1x);
+    guac_protocol_builder_int(&builder, cp1y);
+    guac_protocol_builder_int(&builder, cp2x);
+    guac_protocol_builder_int(&builder, cp2y);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_disconnect(guac_socket* socket) {
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = guac_socket_write_string(socket, "10.disconnect;");
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "disconnect");
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_dispose(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "7.dispose,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "dispose");
+    guac_protocol_builder_int(&builder, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -470,82 +548,63 @@ int guac_protocol_send_distort(guac_socket* socket, const guac_layer* layer,
         double a, double b, double c,
         double d, double e, double f) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "7.distort,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, a)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, c)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, d)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, e)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, f)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "distort");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_double(&builder, a);
+    guac_protocol_builder_double(&builder, b);
+    guac_protocol_builder_double(&builder, c);
+    guac_protocol_builder_double(&builder, d);
+    guac_protocol_builder_double(&builder, e);
+    guac_protocol_builder_double(&builder, f);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_end(guac_socket* socket, const guac_stream* stream) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.end,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "end");
+    guac_protocol_builder_int(&builder, stream->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_error(guac_socket* socket, const char* error,
         guac_protocol_status status) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.error,")
-        || __guac_socket_write_length_string(socket, error)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, status)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "error");
+    guac_protocol_builder_string(&builder, error);
+    guac_protocol_builder_int(&builder, status);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int vguac_protocol_send_log(guac_socket* socket, const char* format,
         va_list args) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
     /* Copy log message into buffer */
     char message[4096];
     vsnprintf(message, sizeof(message), format, args);
 
     /* Log to instruction */
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.log,")
-        || __guac_socket_write_length_string(socket, message)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "log");
+    guac_protocol_builder_string(&builder, message);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -565,71 +624,56 @@ int guac_protocol_send_log(guac_socket* socket, const char* format, ...) {
 int guac_protocol_send_file(guac_socket* socket, const guac_stream* stream,
         const char* mimetype, const char* name) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.file,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "file");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_string(&builder, mimetype);
+    guac_protocol_builder_string(&builder, name);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_filesystem(guac_socket* socket,
         const guac_object* object, const char* name) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "10.filesystem,")
-        || __guac_socket_write_length_int(socket, object->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "filesystem");
+    guac_protocol_builder_int(&builder, object->index);
+    guac_protocol_builder_string(&builder, name);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_identity(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.identity,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "identity");
+    guac_protocol_builder_int(&builder, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_key(guac_socket* socket, int keysym, int pressed,
         guac_timestamp timestamp) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.key,")
-        || __guac_socket_write_length_int(socket, keysym)
-        || guac_socket_write_string(socket, pressed ? ",1.1," : ",1.0,")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "key");
+    guac_protocol_builder_int(&builder, keysym);
+    guac_protocol_builder_int(&builder, pressed ? 1 : 0);
+    guac_protocol_builder_int(&builder, timestamp);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -637,40 +681,30 @@ int guac_protocol_send_lfill(guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer,
         const guac_layer* srcl) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.lfill,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "lfill");
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, srcl->index);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_line(guac_socket* socket, const guac_layer* layer,
         int x, int y) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.line,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "line");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -679,137 +713,103 @@ int guac_protocol_send_lstroke(guac_socket* socket,
         guac_line_cap_style cap, guac_line_join_style join, int thickness,
         const guac_layer* srcl) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "7.lstroke,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cap)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, join)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, thickness)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "lstroke");
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, cap);
+    guac_protocol_builder_int(&builder, join);
+    guac_protocol_builder_int(&builder, thickness);
+    guac_protocol_builder_int(&builder, srcl->index);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_mouse(guac_socket* socket, int x, int y,
         int button_mask, guac_timestamp timestamp) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.mouse,")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, button_mask)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "mouse");
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+    guac_protocol_builder_int(&builder, button_mask);
+    guac_protocol_builder_int(&builder, timestamp);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_move(guac_socket* socket, const guac_layer* layer,
         const guac_layer* parent, int x, int y, int z) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.move,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, parent->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, z)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "move");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, parent->index);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+    guac_protocol_builder_int(&builder, z);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_name(guac_socket* socket, const char* name) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.name,")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "name");
+    guac_protocol_builder_string(&builder, name);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_nest(guac_socket* socket, int index,
         const char* data) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.nest,")
-        || __guac_socket_write_length_int(socket, index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, data)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "nest");
+    guac_protocol_builder_int(&builder, index);
+    guac_protocol_builder_string(&builder, data);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_nop(guac_socket* socket) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = guac_socket_write_string(socket, "3.nop;");
-    guac_socket_instruction_end(socket);
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "nop");
 
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_pipe(guac_socket* socket, const guac_stream* stream,
         const char* mimetype, const char* name) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.pipe,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "pipe");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_string(&builder, mimetype);
+    guac_protocol_builder_string(&builder, name);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -817,218 +817,166 @@ int guac_protocol_send_img(guac_socket* socket, const guac_stream* stream,
         guac_composite_mode mode, const guac_layer* layer,
         const char* mimetype, int x, int y) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.img,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "img");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_int(&builder, mode);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_string(&builder, mimetype);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_pop(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.pop,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "pop");
+    guac_protocol_builder_int(&builder, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_push(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.push,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "push");
+    guac_protocol_builder_int(&builder, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_ready(guac_socket* socket, const char* id) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.ready,")
-        || __guac_socket_write_length_string(socket, id)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "ready");
+    guac_protocol_builder_string(&builder, id);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_rect(guac_socket* socket,
         const guac_layer* layer, int x, int y, int width, int height) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.rect,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, width)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, height)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "rect");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+    guac_protocol_builder_int(&builder, width);
+    guac_protocol_builder_int(&builder, height);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_reset(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.reset,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "reset");
+    guac_protocol_builder_int(&builder, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_set(guac_socket* socket, const guac_layer* layer,
         const char* name, const char* value) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.set,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, value)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "set");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_string(&builder, name);
+    guac_protocol_builder_string(&builder, value);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_select(guac_socket* socket, const char* protocol) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "6.select,")
-        || __guac_socket_write_length_string(socket, protocol)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "select");
+    guac_protocol_builder_string(&builder, protocol);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_shade(guac_socket* socket, const guac_layer* layer,
         int a) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.shade,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "shade");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, a);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_size(guac_socket* socket, const guac_layer* layer,
         int w, int h) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.size,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "size");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, w);
+    guac_protocol_builder_int(&builder, h);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_start(guac_socket* socket, const guac_layer* layer,
         int x, int y) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.start,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "start");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_int(&builder, x);
+    guac_protocol_builder_int(&builder, y);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_sync(guac_socket* socket, guac_timestamp timestamp) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "4.sync,")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "sync");
+    guac_protocol_builder_int(&builder, timestamp);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -1036,32 +984,21 @@ int guac_protocol_send_transfer(guac_socket* socket,
         const guac_layer* srcl, int srcx, int srcy, int w, int h,
         guac_transfer_function fn, const guac_layer* dstl, int dstx, int dsty) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.transfer,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, fn)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "transfer");
+    guac_protocol_builder_int(&builder, srcl->index);
+    guac_protocol_builder_int(&builder, srcx);
+    guac_protocol_builder_int(&builder, srcy);
+    guac_protocol_builder_int(&builder, w);
+    guac_protocol_builder_int(&builder, h);
+    guac_protocol_builder_int(&builder, fn);
+    guac_protocol_builder_int(&builder, dstl->index);
+    guac_protocol_builder_int(&builder, dstx);
+    guac_protocol_builder_int(&builder, dsty);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -1069,64 +1006,47 @@ int guac_protocol_send_transform(guac_socket* socket, const guac_layer* layer,
         double a, double b, double c,
         double d, double e, double f) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "9.transform,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, a)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, c)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, d)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, e)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, f)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "transform");
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_double(&builder, a);
+    guac_protocol_builder_double(&builder, b);
+    guac_protocol_builder_double(&builder, c);
+    guac_protocol_builder_double(&builder, d);
+    guac_protocol_builder_double(&builder, e);
+    guac_protocol_builder_double(&builder, f);
+
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_undefine(guac_socket* socket,
         const guac_object* object) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.undefine,")
-        || __guac_socket_write_length_int(socket, object->index)
-        || guac_socket_write_string(socket, ";");
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "undefine");
+    guac_protocol_builder_int(&builder, object->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
 int guac_protocol_send_video(guac_socket* socket, const guac_stream* stream,
         const guac_layer* layer, const char* mimetype) {
 
-    int ret_val;
+    guac_protocol_builder builder;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "5.video,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ";");
-    guac_socket_instruction_end(socket);
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "video");
+    guac_protocol_builder_int(&builder, stream->index);
+    guac_protocol_builder_int(&builder, layer->index);
+    guac_protocol_builder_string(&builder, mimetype);
 
-    return ret_val;
+    return guac_protocol_builder_finish(&builder);
 
 }
 
@@ -1189,3 +1109,179 @@ int guac_protocol_decode_base64(char* base64) {
 
 }
 
+/**
+ * Hashes the length and selected characters of an opcode into an index within
+ * __guac_protocol_opcode_table. The multipliers were chosen such that no two
+ * opcodes defined by the Guacamole protocol share the same hash, making this
+ * a perfect hash for the set of known opcodes.
+ *
+ * @param length
+ *     The length of the opcode, in bytes.
+ *
+ * @param first
+ *     The first character of the opcode.
+ *
+ * @param second
+ *     The second character of the opcode.
+ *
+ * @param last
+ *     The last character of the opcode.
+ */
+#define GUAC_PROTOCOL_OPCODE_HASH(length, first, second, last) \
+    (((length) + (first) * 4 + (second) * 9 + (last) * 11) & 0xFF)
+
+/**
+ * The opcode string corresponding to each guac_protocol_opcode value.
+ */
+static const char* __guac_protocol_opcode_names[GUAC_PROTOCOL_OPCODE_COUNT] = {
+    [GUAC_PROTOCOL_OPCODE_ACK]        = "ack",
+    [GUAC_PROTOCOL_OPCODE_ARC]        = "arc",
+    [GUAC_PROTOCOL_OPCODE_ARGS]       = "args",
+    [GUAC_PROTOCOL_OPCODE_ARGV]       = "argv",
+    [GUAC_PROTOCOL_OPCODE_AUDIO]      = "audio",
+    [GUAC_PROTOCOL_OPCODE_BLOB]       = "blob",
+    [GUAC_PROTOCOL_OPCODE_BODY]       = "body",
+    [GUAC_PROTOCOL_OPCODE_CFILL]      = "cfill",
+    [GUAC_PROTOCOL_OPCODE_CLIP]       = "clip",
+    [GUAC_PROTOCOL_OPCODE_CLIPBOARD]  = "clipboard",
+    [GUAC_PROTOCOL_OPCODE_CLOSE]      = "close",
+    [GUAC_PROTOCOL_OPCODE_CONNECT]    = "connect",
+    [GUAC_PROTOCOL_OPCODE_COPY]       = "copy",
+    [GUAC_PROTOCOL_OPCODE_CSTROKE]    = "cstroke",
+    [GUAC_PROTOCOL_OPCODE_CURSOR]     = "cursor",
+    [GUAC_PROTOCOL_OPCODE_CURVE]      = "curve",
+    [GUAC_PROTOCOL_OPCODE_DISCONNECT] = "disconnect",
+    [GUAC_PROTOCOL_OPCODE_DISPOSE]    = "dispose",
+    [GUAC_PROTOCOL_OPCODE_DISTORT]    = "distort",
+    [GUAC_PROTOCOL_OPCODE_END]        = "end",
+    [GUAC_PROTOCOL_OPCODE_ERROR]      = "error",
+    [GUAC_PROTOCOL_OPCODE_FILE]       = "file",
+    [GUAC_PROTOCOL_OPCODE_FILESYSTEM] = "filesystem",
+    [GUAC_PROTOCOL_OPCODE_GET]        = "get",
+    [GUAC_PROTOCOL_OPCODE_IDENTITY]   = "identity",
+    [GUAC_PROTOCOL_OPCODE_IMAGE]      = "image",
+    [GUAC_PROTOCOL_OPCODE_IMG]        = "img",
+    [GUAC_PROTOCOL_OPCODE_KEY]        = "key",
+    [GUAC_PROTOCOL_OPCODE_LFILL]      = "lfill",
+    [GUAC_PROTOCOL_OPCODE_LINE]       = "line",
+    [GUAC_PROTOCOL_OPCODE_LOG]        = "log",
+    [GUAC_PROTOCOL_OPCODE_LSTROKE]    = "lstroke",
+    [GUAC_PROTOCOL_OPCODE_MOUSE]      = "mouse",
+    [GUAC_PROTOCOL_OPCODE_MOVE]       = "move",
+    [GUAC_PROTOCOL_OPCODE_NAME]       = "name",
+    [GUAC_PROTOCOL_OPCODE_NEST]       = "nest",
+    [GUAC_PROTOCOL_OPCODE_NOP]        = "nop",
+    [GUAC_PROTOCOL_OPCODE_PIPE]       = "pipe",
+    [GUAC_PROTOCOL_OPCODE_POP]        = "pop",
+    [GUAC_PROTOCOL_OPCODE_PUSH]       = "push",
+    [GUAC_PROTOCOL_OPCODE_PUT]        = "put",
+    [GUAC_PROTOCOL_OPCODE_READY]      = "ready",
+    [GUAC_PROTOCOL_OPCODE_RECT]       = "rect",
+    [GUAC_PROTOCOL_OPCODE_RESET]      = "reset",
+    [GUAC_PROTOCOL_OPCODE_SELECT]     = "select",
+    [GUAC_PROTOCOL_OPCODE_SET]        = "set",
+    [GUAC_PROTOCOL_OPCODE_SHADE]      = "shade",
+    [GUAC_PROTOCOL_OPCODE_SIZE]       = "size",
+    [GUAC_PROTOCOL_OPCODE_START]      = "start",
+    [GUAC_PROTOCOL_OPCODE_SYNC]       = "sync",
+    [GUAC_PROTOCOL_OPCODE_TIMEZONE]   = "timezone",
+    [GUAC_PROTOCOL_OPCODE_TRANSFER]   = "transfer",
+    [GUAC_PROTOCOL_OPCODE_TRANSFORM]  = "transform",
+    [GUAC_PROTOCOL_OPCODE_UNDEFINE]   = "undefine",
+    [GUAC_PROTOCOL_OPCODE_VIDEO]      = "video",
+};
+
+/**
+ * Mapping of the hash of each known opcode, as produced by
+ * GUAC_PROTOCOL_OPCODE_HASH, to its guac_protocol_opcode value. All other
+ * entries are GUAC_PROTOCOL_OPCODE_UNKNOWN.
+ */
+static const unsigned char __guac_protocol_opcode_table[256] = {
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'a', 'c', 'k')] = GUAC_PROTOCOL_OPCODE_ACK,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'a', 'r', 'c')] = GUAC_PROTOCOL_OPCODE_ARC,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'a', 'r', 's')] = GUAC_PROTOCOL_OPCODE_ARGS,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'a', 'r', 'v')] = GUAC_PROTOCOL_OPCODE_ARGV,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'a', 'u', 'o')] = GUAC_PROTOCOL_OPCODE_AUDIO,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'b', 'l', 'b')] = GUAC_PROTOCOL_OPCODE_BLOB,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'b', 'o', 'y')] = GUAC_PROTOCOL_OPCODE_BODY,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'c', 'f', 'l')] = GUAC_PROTOCOL_OPCODE_CFILL,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'c', 'l', 'p')] = GUAC_PROTOCOL_OPCODE_CLIP,
+    [GUAC_PROTOCOL_OPCODE_HASH(9, 'c', 'l', 'd')] = GUAC_PROTOCOL_OPCODE_CLIPBOARD,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'c', 'l', 'e')] = GUAC_PROTOCOL_OPCODE_CLOSE,
+    [GUAC_PROTOCOL_OPCODE_HASH(7, 'c', 'o', 't')] = GUAC_PROTOCOL_OPCODE_CONNECT,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'c', 'o', 'y')] = GUAC_PROTOCOL_OPCODE_COPY,
+    [GUAC_PROTOCOL_OPCODE_HASH(7, 'c', 's', 'e')] = GUAC_PROTOCOL_OPCODE_CSTROKE,
+    [GUAC_PROTOCOL_OPCODE_HASH(6, 'c', 'u', 'r')] = GUAC_PROTOCOL_OPCODE_CURSOR,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'c', 'u', 'e')] = GUAC_PROTOCOL_OPCODE_CURVE,
+    [GUAC_PROTOCOL_OPCODE_HASH(10, 'd', 'i', 't')] = GUAC_PROTOCOL_OPCODE_DISCONNECT,
+    [GUAC_PROTOCOL_OPCODE_HASH(7, 'd', 'i', 'e')] = GUAC_PROTOCOL_OPCODE_DISPOSE,
+    [GUAC_PROTOCOL_OPCODE_HASH(7, 'd', 'i', 't')] = GUAC_PROTOCOL_OPCODE_DISTORT,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'e', 'n', 'd')] = GUAC_PROTOCOL_OPCODE_END,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'e', 'r', 'r')] = GUAC_PROTOCOL_OPCODE_ERROR,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'f', 'i', 'e')] = GUAC_PROTOCOL_OPCODE_FILE,
+    [GUAC_PROTOCOL_OPCODE_HASH(10, 'f', 'i', 'm')] = GUAC_PROTOCOL_OPCODE_FILESYSTEM,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'g', 'e', 't')] = GUAC_PROTOCOL_OPCODE_GET,
+    [GUAC_PROTOCOL_OPCODE_HASH(8, 'i', 'd', 'y')] = GUAC_PROTOCOL_OPCODE_IDENTITY,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'i', 'm', 'e')] = GUAC_PROTOCOL_OPCODE_IMAGE,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'i', 'm', 'g')] = GUAC_PROTOCOL_OPCODE_IMG,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'k', 'e', 'y')] = GUAC_PROTOCOL_OPCODE_KEY,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'l', 'f', 'l')] = GUAC_PROTOCOL_OPCODE_LFILL,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'l', 'i', 'e')] = GUAC_PROTOCOL_OPCODE_LINE,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'l', 'o', 'g')] = GUAC_PROTOCOL_OPCODE_LOG,
+    [GUAC_PROTOCOL_OPCODE_HASH(7, 'l', 's', 'e')] = GUAC_PROTOCOL_OPCODE_LSTROKE,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'm', 'o', 'e')] = GUAC_PROTOCOL_OPCODE_MOUSE,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'm', 'o', 'e')] = GUAC_PROTOCOL_OPCODE_MOVE,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'n', 'a', 'e')] = GUAC_PROTOCOL_OPCODE_NAME,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'n', 'e', 't')] = GUAC_PROTOCOL_OPCODE_NEST,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'n', 'o', 'p')] = GUAC_PROTOCOL_OPCODE_NOP,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'p', 'i', 'e')] = GUAC_PROTOCOL_OPCODE_PIPE,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'p', 'o', 'p')] = GUAC_PROTOCOL_OPCODE_POP,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'p', 'u', 'h')] = GUAC_PROTOCOL_OPCODE_PUSH,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 'p', 'u', 't')] = GUAC_PROTOCOL_OPCODE_PUT,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'r', 'e', 'y')] = GUAC_PROTOCOL_OPCODE_READY,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 'r', 'e', 't')] = GUAC_PROTOCOL_OPCODE_RECT,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'r', 'e', 't')] = GUAC_PROTOCOL_OPCODE_RESET,
+    [GUAC_PROTOCOL_OPCODE_HASH(6, 's', 'e', 't')] = GUAC_PROTOCOL_OPCODE_SELECT,
+    [GUAC_PROTOCOL_OPCODE_HASH(3, 's', 'e', 't')] = GUAC_PROTOCOL_OPCODE_SET,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 's', 'h', 'e')] = GUAC_PROTOCOL_OPCODE_SHADE,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 's', 'i', 'e')] = GUAC_PROTOCOL_OPCODE_SIZE,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 's', 't', 't')] = GUAC_PROTOCOL_OPCODE_START,
+    [GUAC_PROTOCOL_OPCODE_HASH(4, 's', 'y', 'c')] = GUAC_PROTOCOL_OPCODE_SYNC,
+    [GUAC_PROTOCOL_OPCODE_HASH(8, 't', 'i', 'e')] = GUAC_PROTOCOL_OPCODE_TIMEZONE,
+    [GUAC_PROTOCOL_OPCODE_HASH(8, 't', 'r', 'r')] = GUAC_PROTOCOL_OPCODE_TRANSFER,
+    [GUAC_PROTOCOL_OPCODE_HASH(9, 't', 'r', 'm')] = GUAC_PROTOCOL_OPCODE_TRANSFORM,
+    [GUAC_PROTOCOL_OPCODE_HASH(8, 'u', 'n', 'e')] = GUAC_PROTOCOL_OPCODE_UNDEFINE,
+    [GUAC_PROTOCOL_OPCODE_HASH(5, 'v', 'i', 'o')] = GUAC_PROTOCOL_OPCODE_VIDEO,
+};
+
+const char* guac_protocol_get_opcode_name(guac_protocol_opcode opcode) {
+
+    if ((int) opcode < 0 || opcode >= GUAC_PROTOCOL_OPCODE_COUNT)
+        return NULL;
+
+    return __guac_protocol_opcode_names[opcode];
+
+}
+
+guac_protocol_opcode guac_protocol_get_opcode(const char* opcode) {
+
+    const unsigned char* str = (const unsigned char*) opcode;
+    size_t length = strlen(opcode);
+
+    /* All defined opcodes are at least two characters */
+    if (length < 2)
+        return GUAC_PROTOCOL_OPCODE_UNKNOWN;
+
+    /* Look up the only opcode which could possibly match */
+    guac_protocol_opcode candidate = __guac_protocol_opcode_table[
+        GUAC_PROTOCOL_OPCODE_HASH(length, str[0], str[1], str[length - 1])];
+
+    /* Verify candidate with a single comparison */
+    if (candidate == GUAC_PROTOCOL_OPCODE_UNKNOWN
+            || strcmp(opcode, __guac_protocol_opcode_names[candidate]) != 0)
+        return GUAC_PROTOCOL_OPCODE_UNKNOWN;
+
+    return candidate;
+
+}
+
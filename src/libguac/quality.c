@@ -0,0 +1,54 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "quality.h"
+
+int guac_quality_get_tier(int processing_lag) {
+
+    /* Lag of up to one tier's worth is the best tier */
+    int tier = (processing_lag - 1) / GUAC_QUALITY_TIER_LAG;
+    if (tier < 0)
+        return 0;
+
+    /* All remaining lag shares the worst tier */
+    if (tier >= GUAC_QUALITY_TIERS)
+        return GUAC_QUALITY_TIERS - 1;
+
+    return tier;
+
+}
+
+int guac_quality_get_tier_quality(int tier) {
+
+    /* Scale quality linearly across all tiers */
+    return GUAC_QUALITY_MAX - tier * (GUAC_QUALITY_MAX - GUAC_QUALITY_MIN)
+                                   / (GUAC_QUALITY_TIERS - 1);
+
+}
+
+int guac_quality_get_tier_compression(int tier) {
+
+    /* Only users who are lagging need faster compression */
+    if (tier == 0)
+        return GUAC_QUALITY_COMPRESSION_DEFAULT;
+
+    return GUAC_QUALITY_COMPRESSION_FAST;
+
+}
@@ -0,0 +1,111 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_QUALITY_H
+#define GUAC_QUALITY_H
+
+/**
+ * Functions for grouping users into lossy image quality tiers based on their
+ * measured processing lag. This is used only internally within libguac, and
+ * is not installed along with the library.
+ *
+ * @file quality.h
+ */
+
+#include "config.h"
+
+/**
+ * The number of distinct lossy image quality tiers. Users whose processing
+ * lag falls within the same tier receive identical lossy image data.
+ */
+#define GUAC_QUALITY_TIERS 4
+
+/**
+ * The amount of processing lag covered by each quality tier beyond the first,
+ * in milliseconds.
+ */
+#define GUAC_QUALITY_TIER_LAG 20
+
+/**
+ * The lossy image quality used for the first (best) quality tier.
+ */
+#define GUAC_QUALITY_MAX 90
+
+/**
+ * The lossy image quality used for the last (worst) quality tier.
+ */
+#define GUAC_QUALITY_MIN 30
+
+/**
+ * The zlib compression level used for lossless images sent to the first
+ * quality tier, which is zlib's default level. Users with little lag are sent
+ * images compressed exactly as libpng would compress them by default.
+ */
+#define GUAC_QUALITY_COMPRESSION_DEFAULT -1
+
+/**
+ * The zlib compression level used for lossless images sent to all quality
+ * tiers beyond the first. Users who are lagging are sent images which are
+ * encoded as quickly as possible, such that encoding adds as little as
+ * possible to that lag.
+ */
+#define GUAC_QUALITY_COMPRESSION_FAST 1
+
+/**
+ * Returns the quality tier appropriate for a user experiencing the given
+ * amount of processing lag. Tier zero is the highest quality tier.
+ *
+ * @param processing_lag
+ *     The processing lag of the user, in milliseconds.
+ *
+ * @return
+ *     The quality tier for the given lag, between zero and
+ *     GUAC_QUALITY_TIERS - 1 inclusive.
+ */
+int guac_quality_get_tier(int processing_lag);
+
+/**
+ * Returns the lossy image quality which should be used for all images sent
+ * to users within the given quality tier.
+ *
+ * @param tier
+ *     The quality tier, as returned by guac_quality_get_tier().
+ *
+ * @return
+ *     A lossy image quality between GUAC_QUALITY_MIN and GUAC_QUALITY_MAX
+ *     inclusive, suitable for guac_jpeg_write() or guac_webp_write().
+ */
+int guac_quality_get_tier_quality(int tier);
+
+/**
+ * Returns the zlib compression level which should be used for all lossless
+ * images sent to users within the given quality tier.
+ *
+ * @param tier
+ *     The quality tier, as returned by guac_quality_get_tier().
+ *
+ * @return
+ *     GUAC_QUALITY_COMPRESSION_DEFAULT for the first quality tier, or
+ *     GUAC_QUALITY_COMPRESSION_FAST for all other tiers, suitable for
+ *     guac_png_write().
+ */
+int guac_quality_get_tier_compression(int tier);
+
+#endif
+
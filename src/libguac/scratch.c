@@ -0,0 +1,50 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "scratch.h"
+
+#include <stdlib.h>
+
+void* guac_scratch_reserve(guac_scratch* scratch, size_t size) {
+
+    /* Reuse existing memory whenever possible */
+    if (size <= scratch->size)
+        return scratch->data;
+
+    /* Contents need not be preserved, so avoid copying via realloc() */
+    free(scratch->data);
+    scratch->data = malloc(size);
+    scratch->size = (scratch->data != NULL) ? size : 0;
+
+    return scratch->data;
+
+}
+
+void guac_scratch_trim(guac_scratch* scratch) {
+    if (scratch->size > GUAC_SCRATCH_MAX_RETAINED)
+        guac_scratch_free(scratch);
+}
+
+void guac_scratch_free(guac_scratch* scratch) {
+    free(scratch->data);
+    scratch->data = NULL;
+    scratch->size = 0;
+}
+
@@ -0,0 +1,98 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SCRATCH_H
+#define GUAC_SCRATCH_H
+
+/**
+ * Reusable scratch buffers, allowing the image encoders to avoid allocating
+ * memory for each image encoded. This is used only internally within
+ * libguac, and is not installed along with the library.
+ *
+ * @file scratch.h
+ */
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * The largest scratch buffer which will be retained between uses, in bytes.
+ * Larger buffers, needed only for unusually large images, are freed once no
+ * longer needed rather than occupying memory indefinitely.
+ */
+#define GUAC_SCRATCH_MAX_RETAINED 1048576
+
+/**
+ * A buffer of memory which grows as needed, and which is retained between
+ * uses. A zero-initialized guac_scratch is a valid, empty buffer.
+ */
+typedef struct guac_scratch {
+
+    /**
+     * The memory currently allocated for the buffer, or NULL if no memory
+     * has yet been allocated.
+     */
+    void* data;
+
+    /**
+     * The number of bytes allocated for data.
+     */
+    size_t size;
+
+} guac_scratch;
+
+/**
+ * Returns a pointer to at least the given number of bytes of memory within
+ * the given scratch buffer, growing the buffer if necessary. The contents of
+ * the buffer are not preserved when the buffer grows.
+ *
+ * @param scratch
+ *     The scratch buffer to reserve memory within.
+ *
+ * @param size
+ *     The number of bytes required.
+ *
+ * @return
+ *     A pointer to the reserved memory, or NULL if the buffer could not be
+ *     grown.
+ */
+void* guac_scratch_reserve(guac_scratch* scratch, size_t size);
+
+/**
+ * Frees the memory of the given scratch buffer if that buffer has grown
+ * beyond GUAC_SCRATCH_MAX_RETAINED. This function should be invoked whenever
+ * the buffer is no longer immediately needed.
+ *
+ * @param scratch
+ *     The scratch buffer to trim.
+ */
+void guac_scratch_trim(guac_scratch* scratch);
+
+/**
+ * Frees all memory associated with the given scratch buffer, leaving the
+ * buffer empty but still usable.
+ *
+ * @param scratch
+ *     The scratch buffer to free.
+ */
+void guac_scratch_free(guac_scratch* scratch);
+
+#endif
+
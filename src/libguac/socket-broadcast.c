@@ -22,6 +22,7 @@
 #include "client.h"
 #include "error.h"
 #include "socket.h"
+#include "socket-broadcast.h"
 #include "user.h"
 
 #include <pthread.h>
@@ -375,3 +376,7 @@ guac_socket* guac_socket_broadcast(guac_client* client) {
 
 }
 
+int guac_socket_is_broadcast(guac_socket* socket) {
+    return socket->free_handler == __guac_socket_broadcast_free_handler;
+}
+
@@ -0,0 +1,43 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_BROADCAST_H
+#define GUAC_SOCKET_BROADCAST_H
+
+#include "config.h"
+
+#include "socket-types.h"
+
+/**
+ * Returns whether the given guac_socket was created with
+ * guac_socket_broadcast(), and thus writes only to the users of its client.
+ * A socket which wraps a broadcast socket, such as the guac_socket_tee() used
+ * for session recordings, is not itself a broadcast socket.
+ *
+ * @param socket
+ *     The guac_socket to test.
+ *
+ * @return
+ *     Non-zero if the given guac_socket is a broadcast socket, zero
+ *     otherwise.
+ */
+int guac_socket_is_broadcast(guac_socket* socket);
+
+#endif
+
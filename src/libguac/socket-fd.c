@@ -21,6 +21,7 @@
 
 #include "error.h"
 #include "socket.h"
+#include "socket-fd.h"
 #include "wait-fd.h"
 
 #include <pthread.h>
@@ -28,11 +29,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
 
 #ifdef ENABLE_WINSOCK
 #include <winsock2.h>
+#else
+#include <sys/socket.h>
 #endif
 
 /**
@@ -45,16 +49,51 @@ typedef struct guac_socket_fd_data {
      */
     int fd;
 
+    /**
+     * Whether the associated file descriptor is a network socket, and thus
+     * supports send() flags.
+     */
+    int is_socket;
+
     /**
      * The number of bytes currently in the main write buffer.
      */
-    int written;
+    size_t written;
+
+    /**
+     * The current size of the main write buffer, in bytes.
+     */
+    size_t size;
+
+    /**
+     * The size that the main write buffer may grow to before its contents
+     * must be written to the file descriptor, even though the socket has not
+     * been flushed.
+     */
+    size_t max_size;
 
     /**
      * The main write buffer. Bytes written go here before being flushed
-     * to the open file descriptor.
+     * to the open file descriptor. This buffer grows as necessary up to
+     * max_size bytes, such that each frame is written at once.
+     */
+    char* out_buf;
+
+    /**
+     * Non-zero while an instruction is being written, such that any data
+     * sent in the meantime is known to be only part of an instruction.
+     * This value is accessed atomically.
+     */
+    int instruction_pending;
+
+    /**
+     * Non-zero if the socket was flushed while an instruction was being
+     * written, in which case the data sent was marked as incomplete, and the
+     * flush must be completed once the instruction has been written. This
+     * value is modified only while buffer_lock is held, but may be read
+     * atomically without acquiring buffer_lock.
      */
-    char out_buf[GUAC_SOCKET_OUTPUT_BUFFER_SIZE];
+    int flush_pending;
 
     /**
      * Lock which is acquired when an instruction is being written, and
@@ -85,12 +124,17 @@ typedef struct guac_socket_fd_data {
  * @param count
  *     The number of bytes within the given buffer.
  *
+ * @param more
+ *     Non-zero if more data belonging to the same frame will be written
+ *     shortly, in which case the data may be held back by the network stack
+ *     to avoid sending partially-filled packets, zero otherwise.
+ *
  * @return
  *     The number of bytes written, which will be exactly the size of the given
  *     buffer, or a negative value if an error occurs.
  */
 ssize_t guac_socket_fd_write(guac_socket* socket,
-        const void* buf, size_t count) {
+        const void* buf, size_t count, int more) {
 
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
     const char* buffer = buf;
@@ -104,6 +148,12 @@ ssize_t guac_socket_fd_write(guac_socket* socket,
         /* WSA only works with send() */
         retval = send(data->fd, buffer, count, 0);
 #else
+#ifdef MSG_MORE
+        /* Hint that more of the frame follows, if possible */
+        if (more && data->is_socket)
+            retval = send(data->fd, buffer, count, MSG_MORE);
+        else
+#endif
         /* Use write() for all other platforms */
         retval = write(data->fd, buffer, count);
 #endif
@@ -174,10 +224,14 @@ static ssize_t guac_socket_fd_read_handler(guac_socket* socket,
  * @param socket
  *     The guac_socket to flush.
  *
+ * @param more
+ *     Non-zero if the buffer is being flushed only because it is full, and
+ *     more data belonging to the same frame will follow, zero otherwise.
+ *
  * @return
  *     Zero if the flush operation was successful, non-zero otherwise.
  */
-static ssize_t guac_socket_fd_flush(guac_socket* socket) {
+static ssize_t guac_socket_fd_flush(guac_socket* socket, int more) {
 
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
 
@@ -185,7 +239,7 @@ static ssize_t guac_socket_fd_flush(guac_socket* socket) {
     if (data->written > 0) {
 
         /* Write ALL bytes in buffer immediately */
-        if (guac_socket_fd_write(socket, data->out_buf, data->written))
+        if (guac_socket_fd_write(socket, data->out_buf, data->written, more))
             return 1;
 
         data->written = 0;
@@ -195,9 +249,76 @@ static ssize_t guac_socket_fd_flush(guac_socket* socket) {
 
 }
 
+/**
+ * Flushes all but the final byte of the output buffer of the given socket,
+ * marking the data sent as incomplete, without first locking access to the
+ * output buffer. The byte retained guarantees that the data sent will be
+ * followed by at least one send which is not marked as incomplete. This
+ * function must ONLY be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation was successful, non-zero otherwise.
+ */
+static ssize_t guac_socket_fd_flush_partial(guac_socket* socket) {
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+
+    /* Nothing can be sent if only the retained byte is buffered */
+    if (data->written <= 1)
+        return 0;
+
+    if (guac_socket_fd_write(socket, data->out_buf, data->written - 1, 1))
+        return 1;
+
+    data->out_buf[0] = data->out_buf[data->written - 1];
+    data->written = 1;
+
+    return 0;
+
+}
+
+/**
+ * Shrinks the output buffer of the given socket if the data most recently
+ * flushed used only a small portion of it, releasing memory which was needed
+ * only for an unusually large frame. The buffer is halved at most once per
+ * flush, such that frames which are consistently large do not cause the
+ * buffer to be repeatedly shrunk and regrown. The buffer lock must already be
+ * held, and the buffer must be empty.
+ *
+ * @param data
+ *     The data associated with the socket whose buffer may be shrunk.
+ *
+ * @param used
+ *     The number of bytes of the buffer which were used by the data most
+ *     recently flushed.
+ */
+static void guac_socket_fd_shrink(guac_socket_fd_data* data, size_t used) {
+
+    /* Shrink only buffers which are mostly unused */
+    if (data->size <= GUAC_SOCKET_OUTPUT_BUFFER_SIZE || used > data->size / 4)
+        return;
+
+    size_t new_size = data->size / 2;
+    if (new_size < GUAC_SOCKET_OUTPUT_BUFFER_SIZE)
+        new_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+
+    /* Continue using the larger buffer if it cannot be reallocated */
+    char* new_buf = realloc(data->out_buf, new_size);
+    if (new_buf != NULL) {
+        data->out_buf = new_buf;
+        data->size = new_size;
+    }
+
+}
+
 /**
  * Flushes the internal buffer of the given guac_socket, writing all data
- * to the underlying file descriptor.
+ * to the underlying file descriptor. If an instruction is still being
+ * written, the data is sent marked as incomplete, and the flush is completed
+ * once the instruction has been written.
  *
  * @param socket
  *     The guac_socket to flush.
@@ -213,8 +334,30 @@ static ssize_t guac_socket_fd_flush_handler(guac_socket* socket) {
     /* Acquire exclusive access to buffer */
     pthread_mutex_lock(&(data->buffer_lock));
 
-    /* Flush contents of buffer */
-    retval = guac_socket_fd_flush(socket);
+    size_t used = data->written;
+
+    /* Flush contents of buffer if no instruction is being written */
+    if (!__atomic_load_n(&(data->instruction_pending), __ATOMIC_SEQ_CST))
+        retval = guac_socket_fd_flush(socket, 0);
+
+    /* Otherwise, send what is available, leaving completion of the flush to
+     * the end of the instruction unless the instruction has already ended */
+    else {
+
+        retval = guac_socket_fd_flush_partial(socket);
+        __atomic_store_n(&(data->flush_pending), 1, __ATOMIC_SEQ_CST);
+
+        if (!__atomic_load_n(&(data->instruction_pending), __ATOMIC_SEQ_CST)) {
+            if (retval == 0)
+                retval = guac_socket_fd_flush(socket, 0);
+            __atomic_store_n(&(data->flush_pending), 0, __ATOMIC_RELAXED);
+        }
+
+    }
+
+    /* Release memory needed only for earlier, larger frames */
+    if (retval == 0 && data->written == 0)
+        guac_socket_fd_shrink(data, used);
 
     /* Relinquish exclusive access to buffer */
     pthread_mutex_unlock(&(data->buffer_lock));
@@ -252,14 +395,30 @@ static ssize_t guac_socket_fd_write_buffered(guac_socket* socket,
     /* Append to buffer, flush if necessary */
     while (count > 0) {
 
-        int chunk_size;
-        int remaining = sizeof(data->out_buf) - data->written;
+        size_t chunk_size;
+        size_t remaining = data->size - data->written;
 
-        /* If no space left in buffer, flush and retry */
+        /* If no space left in buffer, grow or flush and retry */
         if (remaining == 0) {
 
+            /* Grow buffer rather than split the current frame, if allowed */
+            if (data->size < data->max_size) {
+
+                size_t new_size = data->size * 2;
+                if (new_size > data->max_size)
+                    new_size = data->max_size;
+
+                char* new_buf = realloc(data->out_buf, new_size);
+                if (new_buf != NULL) {
+                    data->out_buf = new_buf;
+                    data->size = new_size;
+                    continue;
+                }
+
+            }
+
             /* Abort if error occurs during flush */
-            if (guac_socket_fd_flush(socket))
+            if (guac_socket_fd_flush(socket, 1))
                 return -1;
 
             /* Retry buffer append */
@@ -382,6 +541,7 @@ static int guac_socket_fd_free_handler(guac_socket* socket) {
     /* Close file descriptor */
     close(data->fd);
 
+    free(data->out_buf);
     free(data);
     return 0;
 
@@ -400,6 +560,9 @@ static void guac_socket_fd_lock_handler(guac_socket* socket) {
     /* Acquire exclusive access to socket */
     pthread_mutex_lock(&(data->socket_lock));
 
+    /* Note that only part of an instruction may be buffered until released */
+    __atomic_store_n(&(data->instruction_pending), 1, __ATOMIC_RELAXED);
+
 }
 
 /**
@@ -412,22 +575,88 @@ static void guac_socket_fd_unlock_handler(guac_socket* socket) {
 
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
 
+    /* Instruction is now complete */
+    __atomic_store_n(&(data->instruction_pending), 0, __ATOMIC_SEQ_CST);
+
+    /* Complete any flush which was requested mid-instruction, sending the
+     * remainder of the instruction (always at least one byte) */
+    if (__atomic_load_n(&(data->flush_pending), __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&(data->buffer_lock));
+        if (data->flush_pending) {
+            guac_socket_fd_flush(socket, 0);
+            __atomic_store_n(&(data->flush_pending), 0, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&(data->buffer_lock));
+    }
+
     /* Relinquish exclusive access to socket */
     pthread_mutex_unlock(&(data->socket_lock));
 
 }
 
+int guac_socket_fd_shutdown(guac_socket* socket) {
+
+    /* Only sockets created by this implementation can be shut down */
+    if (socket->free_handler != guac_socket_fd_free_handler)
+        return 1;
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+    if (!data->is_socket)
+        return 1;
+
+#ifdef ENABLE_WINSOCK
+    return shutdown(data->fd, SD_BOTH) != 0;
+#else
+    return shutdown(data->fd, SHUT_RDWR) != 0;
+#endif
+
+}
+
 guac_socket* guac_socket_open(int fd) {
+    return guac_socket_open_buffered(fd, GUAC_SOCKET_MAX_OUTPUT_BUFFER_SIZE);
+}
+
+guac_socket* guac_socket_open_buffered(int fd, size_t max_buffer_size) {
 
     pthread_mutexattr_t lock_attributes;
+    struct stat fd_stat;
 
-    /* Allocate socket and associated data */
-    guac_socket* socket = guac_socket_alloc();
+    /* Always buffer at least the initial buffer size */
+    if (max_buffer_size < GUAC_SOCKET_OUTPUT_BUFFER_SIZE)
+        max_buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+
+    /* Allocate associated data, including initial output buffer */
     guac_socket_fd_data* data = malloc(sizeof(guac_socket_fd_data));
+    if (data == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket";
+        return NULL;
+    }
+
+    data->out_buf = malloc(GUAC_SOCKET_OUTPUT_BUFFER_SIZE);
+    if (data->out_buf == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket buffer";
+        free(data);
+        return NULL;
+    }
+
+    /* Allocate socket */
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL) {
+        free(data->out_buf);
+        free(data);
+        return NULL;
+    }
 
     /* Store file descriptor as socket data */
     data->fd = fd;
+    data->is_socket = fstat(fd, &fd_stat) == 0 && S_ISSOCK(fd_stat.st_mode);
     data->written = 0;
+    data->instruction_pending = 0;
+    data->flush_pending = 0;
+    data->size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    data->max_size = max_buffer_size;
     socket->data = data;
 
     pthread_mutexattr_init(&lock_attributes);
@@ -0,0 +1,45 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_FD_H
+#define GUAC_SOCKET_FD_H
+
+#include "config.h"
+
+#include "socket-types.h"
+
+/**
+ * Shuts down both directions of the network connection underlying the given
+ * guac_socket, if that guac_socket was created with guac_socket_open() or
+ * guac_socket_open_buffered() and its file descriptor is a network socket.
+ * Any thread blocked reading from or writing to the connection is woken, and
+ * all further reads and writes fail. The file descriptor itself remains open
+ * until the guac_socket is freed.
+ *
+ * @param socket
+ *     The guac_socket to shut down.
+ *
+ * @return
+ *     Zero if the connection was shut down, non-zero if the given guac_socket
+ *     is not backed by a network socket and could not be shut down.
+ */
+int guac_socket_fd_shutdown(guac_socket* socket);
+
+#endif
+
@@ -0,0 +1,644 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "error.h"
+#include "socket.h"
+#include "socket-fd.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The maximum amount of time that freeing a queue socket will wait for the
+ * remaining queued data to be written to the target socket, in milliseconds.
+ * If the target socket is not accepting data quickly enough for the queue to
+ * drain within this time, the remaining data is discarded.
+ */
+#define GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT 5000
+
+/**
+ * Data specific to the queue implementation of guac_socket.
+ */
+typedef struct guac_socket_queue_data {
+
+    /**
+     * The guac_socket to which all queued data is eventually written, and to
+     * which all read and select operations are delegated.
+     */
+    guac_socket* target;
+
+    /**
+     * Circular buffer containing all data written to the queue socket which
+     * has not yet been written to the target socket. This buffer starts
+     * small and grows as necessary, up to max_size bytes.
+     */
+    char* buffer;
+
+    /**
+     * The current size of the circular buffer, in bytes.
+     */
+    size_t size;
+
+    /**
+     * The maximum number of bytes which may be queued at any one time.
+     */
+    size_t max_size;
+
+    /**
+     * A previous circular buffer which was replaced by a larger buffer while
+     * the writer thread was still writing from it, or NULL if there is no
+     * such buffer. The writer thread frees this buffer once its write has
+     * completed.
+     */
+    char* retired;
+
+    /**
+     * Non-zero if the writer thread is currently writing a chunk of the
+     * circular buffer to the target socket without holding the queue lock,
+     * zero otherwise.
+     */
+    int writing;
+
+    /**
+     * The offset within the circular buffer of the first byte which has not
+     * yet been written to the target socket.
+     */
+    size_t start;
+
+    /**
+     * The number of bytes currently queued, beginning at the start offset
+     * and wrapping around the end of the circular buffer as necessary.
+     */
+    size_t length;
+
+    /**
+     * Non-zero if a flush has been requested which the writer thread has not
+     * yet performed, zero otherwise.
+     */
+    int flush_requested;
+
+    /**
+     * Non-zero if the queue socket is being freed, in which case the writer
+     * thread must write all remaining data and then terminate.
+     */
+    int stopping;
+
+    /**
+     * Non-zero if the queue has failed, either because the target socket
+     * returned an error or because the queue overflowed. Once failed, all
+     * further writes and flushes fail, and any queued data is discarded.
+     */
+    int failed;
+
+    /**
+     * Non-zero if the writer thread has terminated, zero otherwise.
+     */
+    int stopped;
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which guards all queue state (offsets, flags) within this
+     * structure. This lock is never held while writing to the target socket.
+     */
+    pthread_mutex_t queue_lock;
+
+    /**
+     * Condition which is signalled whenever the queue state changes, such as
+     * when data is appended, a flush is requested, the socket is being freed,
+     * or the writer thread terminates.
+     */
+    pthread_cond_t queue_modified;
+
+    /**
+     * The thread which drains the queue, writing its contents to the target
+     * socket.
+     */
+    pthread_t writer_thread;
+
+} guac_socket_queue_data;
+
+/**
+ * Marks the given queue as failed, discarding any queued data and shutting
+ * down the target socket, such that a writer thread blocked on a target which
+ * has stopped accepting data is woken. The queue lock must already be held.
+ *
+ * @param data
+ *     The guac_socket_queue_data associated with the queue socket that has
+ *     failed.
+ */
+static void guac_socket_queue_fail(guac_socket_queue_data* data) {
+
+    if (data->failed)
+        return;
+
+    data->failed = 1;
+    pthread_cond_broadcast(&(data->queue_modified));
+
+    /* Interrupt any write in progress. Only targets backed by network
+     * sockets can be interrupted; writes to other targets must complete. */
+    guac_socket_fd_shutdown(data->target);
+
+}
+
+/**
+ * Copies all queued data into a newly-allocated circular buffer of the given
+ * size, such that the queued data begins at the start of the new buffer. If
+ * the writer thread is currently writing from the old buffer, the old buffer
+ * is retired to be freed by the writer thread, and is otherwise freed
+ * immediately. The queue lock must already be held.
+ *
+ * @param data
+ *     The guac_socket_queue_data whose circular buffer should be replaced.
+ *
+ * @param new_size
+ *     The size of the new circular buffer, in bytes. This must be at least
+ *     the number of bytes currently queued.
+ *
+ * @return
+ *     Zero if the buffer was replaced, non-zero if the new buffer could not
+ *     be allocated, in which case the queue is unchanged.
+ */
+static int guac_socket_queue_resize(guac_socket_queue_data* data,
+        size_t new_size) {
+
+    char* new_buffer = malloc(new_size);
+    if (new_buffer == NULL)
+        return 1;
+
+    /* Copy queued data, unwrapping it as necessary */
+    size_t first = data->size - data->start;
+    if (first > data->length)
+        first = data->length;
+
+    memcpy(new_buffer, data->buffer + data->start, first);
+    memcpy(new_buffer + first, data->buffer, data->length - first);
+
+    /* The writer thread is only ever writing from the buffer it started
+     * with, so any buffer allocated since may be freed immediately */
+    if (data->writing && data->retired == NULL)
+        data->retired = data->buffer;
+    else
+        free(data->buffer);
+
+    data->buffer = new_buffer;
+    data->size = new_size;
+    data->start = 0;
+
+    return 0;
+
+}
+
+/**
+ * Thread which writes all data within the queue of the given queue socket to
+ * the underlying target socket as it becomes available, flushing the target
+ * socket whenever the queue has been emptied and a flush was requested. The
+ * thread terminates once the queue socket is being freed and all queued data
+ * has been written, or immediately if the queue has failed.
+ *
+ * @param arg
+ *     The guac_socket_queue_data associated with the queue socket being
+ *     drained.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_socket_queue_writer_thread(void* arg) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) arg;
+
+    pthread_mutex_lock(&(data->queue_lock));
+
+    for (;;) {
+
+        /* Wait until there is something to do */
+        while (!data->failed && !data->stopping && !data->flush_requested
+                && data->length == 0)
+            pthread_cond_wait(&(data->queue_modified), &(data->queue_lock));
+
+        /* Abandon any remaining data if the queue has failed */
+        if (data->failed)
+            break;
+
+        /* Write as much contiguous data as possible from the queue */
+        if (data->length > 0) {
+
+            const char* chunk = data->buffer + data->start;
+
+            /* Do not read beyond the end of the circular buffer */
+            size_t chunk_size = data->length;
+            if (chunk_size > data->size - data->start)
+                chunk_size = data->size - data->start;
+
+            /* Writers only ever append past the queued region, and retire
+             * rather than free a buffer which is being written, so the chunk
+             * may be written without holding the queue lock */
+            data->writing = 1;
+            pthread_mutex_unlock(&(data->queue_lock));
+            guac_socket_instruction_begin(data->target);
+            int retval = guac_socket_write(data->target, chunk, chunk_size);
+            guac_socket_instruction_end(data->target);
+            pthread_mutex_lock(&(data->queue_lock));
+            data->writing = 0;
+
+            /* Free the buffer written from if it has since been replaced */
+            free(data->retired);
+            data->retired = NULL;
+
+            if (retval) {
+                guac_socket_queue_fail(data);
+                break;
+            }
+
+            /* Advance past written data, rewinding to the beginning of the
+             * buffer when empty to avoid touching more memory than needed */
+            data->length -= chunk_size;
+            if (data->length == 0)
+                data->start = 0;
+            else
+                data->start = (data->start + chunk_size) % data->size;
+
+            continue;
+
+        }
+
+        /* Queue is now empty - flush target if requested */
+        if (data->flush_requested) {
+
+            data->flush_requested = 0;
+
+            pthread_mutex_unlock(&(data->queue_lock));
+            int retval = guac_socket_flush(data->target);
+            pthread_mutex_lock(&(data->queue_lock));
+
+            if (retval) {
+                guac_socket_queue_fail(data);
+                break;
+            }
+
+            /* Release memory used by any large frame once it has been sent */
+            if (data->length == 0 && data->size > GUAC_SOCKET_OUTPUT_BUFFER_SIZE)
+                guac_socket_queue_resize(data, GUAC_SOCKET_OUTPUT_BUFFER_SIZE);
+
+            continue;
+
+        }
+
+        /* All data written and flushed; stop if the socket is being freed */
+        if (data->stopping)
+            break;
+
+    }
+
+    /* Notify guac_socket_queue_free_handler() that writing has ended */
+    data->stopped = 1;
+    pthread_cond_broadcast(&(data->queue_modified));
+
+    pthread_mutex_unlock(&(data->queue_lock));
+    return NULL;
+
+}
+
+/**
+ * Callback function which reads only from the target socket.
+ *
+ * @param socket
+ *     The queue socket to read from.
+ *
+ * @param buf
+ *     The buffer to read data into.
+ *
+ * @param count
+ *     The maximum number of bytes to read into the given buffer.
+ *
+ * @return
+ *     The value returned by guac_socket_read() when invoked on the target
+ *     socket with the given parameters.
+ */
+static ssize_t guac_socket_queue_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Delegate read to wrapped socket */
+    return guac_socket_read(data->target, buf, count);
+
+}
+
+/**
+ * Callback function which appends the given data to the queue, to be written
+ * to the target socket by the writer thread. The circular buffer of the queue
+ * grows as necessary. If the queue cannot hold the given data without
+ * exceeding its maximum size, the queue is marked as failed, all queued data
+ * is discarded, the target socket is shut down, and the write fails.
+ *
+ * @param socket
+ *     The queue socket to write through.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     The number of bytes written if the write was successful, or -1 if an
+ *     error occurs.
+ */
+static ssize_t guac_socket_queue_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+    const char* source = (const char*) buf;
+
+    pthread_mutex_lock(&(data->queue_lock));
+
+    /* Fail immediately if the queue is no longer usable */
+    if (data->failed) {
+        pthread_mutex_unlock(&(data->queue_lock));
+        guac_error = GUAC_STATUS_IO_ERROR;
+        guac_error_message = "Queued output could not be written";
+        return -1;
+    }
+
+    /* Fail if the reader has fallen too far behind */
+    if (count > data->max_size - data->length) {
+        guac_socket_queue_fail(data);
+        pthread_mutex_unlock(&(data->queue_lock));
+        guac_error = GUAC_STATUS_NO_SPACE;
+        guac_error_message = "Output queue is full";
+        return -1;
+    }
+
+    /* Grow circular buffer if the data would not otherwise fit */
+    if (count > data->size - data->length) {
+
+        size_t new_size = data->size;
+        while (count > new_size - data->length)
+            new_size *= 2;
+
+        if (new_size > data->max_size)
+            new_size = data->max_size;
+
+        if (guac_socket_queue_resize(data, new_size)) {
+            guac_socket_queue_fail(data);
+            pthread_mutex_unlock(&(data->queue_lock));
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not grow socket queue";
+            return -1;
+        }
+
+    }
+
+    /* Append data after the queued region, wrapping as necessary */
+    size_t end = (data->start + data->length) % data->size;
+    size_t first = data->size - end;
+    if (first > count)
+        first = count;
+
+    memcpy(data->buffer + end, source, first);
+    memcpy(data->buffer, source + first, count - first);
+    data->length += count;
+
+    /* Wake writer thread */
+    pthread_cond_broadcast(&(data->queue_modified));
+    pthread_mutex_unlock(&(data->queue_lock));
+
+    return count;
+
+}
+
+/**
+ * Callback function which requests that the writer thread flush the target
+ * socket once all currently-queued data has been written. This function does
+ * not wait for the flush to occur.
+ *
+ * @param socket
+ *     The queue socket to flush.
+ *
+ * @return
+ *     Zero if the flush was successfully requested, non-zero if the queue has
+ *     failed.
+ */
+static ssize_t guac_socket_queue_flush_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    pthread_mutex_lock(&(data->queue_lock));
+
+    /* Fail immediately if the queue is no longer usable */
+    if (data->failed) {
+        pthread_mutex_unlock(&(data->queue_lock));
+        guac_error = GUAC_STATUS_IO_ERROR;
+        guac_error_message = "Queued output could not be written";
+        return 1;
+    }
+
+    /* Request flush after all currently-queued data */
+    data->flush_requested = 1;
+    pthread_cond_broadcast(&(data->queue_modified));
+
+    pthread_mutex_unlock(&(data->queue_lock));
+    return 0;
+
+}
+
+/**
+ * Acquires exclusive access to the given queue socket. Only the queue socket
+ * is locked; the target socket is written solely by the writer thread.
+ *
+ * @param socket
+ *     The queue socket to which exclusive access is required.
+ */
+static void guac_socket_queue_lock_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Acquire exclusive access to socket */
+    pthread_mutex_lock(&(data->socket_lock));
+
+}
+
+/**
+ * Relinquishes exclusive access to the given queue socket.
+ *
+ * @param socket
+ *     The queue socket to which exclusive access is no longer required.
+ */
+static void guac_socket_queue_unlock_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Relinquish exclusive access to socket */
+    pthread_mutex_unlock(&(data->socket_lock));
+
+}
+
+/**
+ * Callback function which delegates the select operation to the target
+ * socket.
+ *
+ * @param socket
+ *     The queue socket on which guac_socket_select() was invoked.
+ *
+ * @param usec_timeout
+ *     The timeout to specify when invoking guac_socket_select() on the
+ *     target socket.
+ *
+ * @return
+ *     The value returned by guac_socket_select() when invoked with the
+ *     given parameters on the target socket.
+ */
+static int guac_socket_queue_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Delegate select to wrapped socket */
+    return guac_socket_select(data->target, usec_timeout);
+
+}
+
+/**
+ * Callback function which waits for the writer thread to write all remaining
+ * queued data to the target socket, and then frees all data associated with
+ * the given queue socket. The target socket is not freed. If the queue has
+ * failed, or the remaining data cannot be written within
+ * GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT milliseconds, that data is discarded and
+ * the target socket is shut down rather than waiting any further.
+ *
+ * @param socket
+ *     The queue socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_socket_queue_free_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  +=  GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT / 1000;
+    deadline.tv_nsec += (GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    /* Signal writer thread to finish */
+    pthread_mutex_lock(&(data->queue_lock));
+    data->stopping = 1;
+    pthread_cond_broadcast(&(data->queue_modified));
+
+    /* Wait a limited time for remaining data to be written */
+    while (!data->stopped && !data->failed) {
+        if (pthread_cond_timedwait(&(data->queue_modified),
+                    &(data->queue_lock), &deadline))
+            break;
+    }
+
+    /* Abandon remaining data, waking the writer thread if it is blocked */
+    if (!data->stopped)
+        guac_socket_queue_fail(data);
+
+    pthread_mutex_unlock(&(data->queue_lock));
+
+    pthread_join(data->writer_thread, NULL);
+
+    /* Destroy locks */
+    pthread_cond_destroy(&(data->queue_modified));
+    pthread_mutex_destroy(&(data->queue_lock));
+    pthread_mutex_destroy(&(data->socket_lock));
+
+    free(data->buffer);
+    free(data);
+    return 0;
+
+}
+
+guac_socket* guac_socket_queue(guac_socket* target, size_t size) {
+
+    /* Allocate queue-specific data, including initial circular buffer */
+    guac_socket_queue_data* data = calloc(1, sizeof(guac_socket_queue_data));
+    if (data == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for queue socket";
+        return NULL;
+    }
+
+    size_t initial_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    if (initial_size > size)
+        initial_size = size;
+
+    data->buffer = malloc(initial_size);
+    if (data->buffer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket queue";
+        free(data);
+        return NULL;
+    }
+
+    data->target = target;
+    data->size = initial_size;
+    data->max_size = size;
+
+    /* Init locks */
+    pthread_mutex_init(&(data->socket_lock), NULL);
+    pthread_mutex_init(&(data->queue_lock), NULL);
+    pthread_cond_init(&(data->queue_modified), NULL);
+
+    /* Start draining queue to target socket */
+    if (pthread_create(&(data->writer_thread), NULL,
+                guac_socket_queue_writer_thread, data)) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "Could not start socket queue writer thread";
+        pthread_cond_destroy(&(data->queue_modified));
+        pthread_mutex_destroy(&(data->queue_lock));
+        pthread_mutex_destroy(&(data->socket_lock));
+        free(data->buffer);
+        free(data);
+        return NULL;
+    }
+
+    /* Associate queue-specific data with new socket */
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = data;
+
+    /* Assign handlers */
+    socket->read_handler   = guac_socket_queue_read_handler;
+    socket->write_handler  = guac_socket_queue_write_handler;
+    socket->select_handler = guac_socket_queue_select_handler;
+    socket->flush_handler  = guac_socket_queue_flush_handler;
+    socket->lock_handler   = guac_socket_queue_lock_handler;
+    socket->unlock_handler = guac_socket_queue_unlock_handler;
+    socket->free_handler   = guac_socket_queue_free_handler;
+
+    return socket;
+
+}
+
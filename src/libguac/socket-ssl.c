@@ -24,10 +24,58 @@
 #include "socket.h"
 #include "wait-fd.h"
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <openssl/ssl.h>
 
+/**
+ * The size of the output buffer of each SSL socket, in bytes. This is the
+ * maximum amount of plaintext which can be sent within a single TLS record,
+ * such that flushing a full buffer produces exactly one full-size record.
+ */
+#define GUAC_SOCKET_SSL_OUTPUT_BUFFER_SIZE 16384
+
+/**
+ * The internal state of an SSL socket. The public guac_socket_ssl_data is
+ * the first member, such that the data of an SSL socket can still be used as
+ * a guac_socket_ssl_data, while output buffering remains private to this
+ * file and does not change the layout of that public structure.
+ */
+typedef struct guac_socket_ssl_state {
+
+    /**
+     * The file descriptor, context, and connection of the socket.
+     */
+    guac_socket_ssl_data data;
+
+    /**
+     * The number of bytes currently in the output buffer.
+     */
+    size_t written;
+
+    /**
+     * The output buffer. Bytes written go here before being encrypted and
+     * sent along the SSL connection, such that small writes are combined into
+     * as few TLS records as possible.
+     */
+    char out_buf[GUAC_SOCKET_SSL_OUTPUT_BUFFER_SIZE];
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which protects access to the output buffer of this socket,
+     * guaranteeing atomicity of writes and flushes.
+     */
+    pthread_mutex_t buffer_lock;
+
+} guac_socket_ssl_state;
+
 static ssize_t __guac_socket_ssl_read_handler(guac_socket* socket,
         void* buf, size_t count) {
 
@@ -47,28 +95,175 @@ static ssize_t __guac_socket_ssl_read_handler(guac_socket* socket,
 
 }
 
-static ssize_t __guac_socket_ssl_write_handler(guac_socket* socket,
+/**
+ * Encrypts and sends the entire contents of the given buffer along the SSL
+ * connection of the given socket, aborting if an error occurs. The output
+ * buffer of the socket is not used.
+ *
+ * @param socket
+ *     The guac_socket whose SSL connection the given buffer should be written
+ *     to.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes within the given buffer.
+ *
+ * @return
+ *     Zero if the entire buffer was written, non-zero otherwise.
+ */
+static int __guac_socket_ssl_write(guac_socket* socket,
         const void* buf, size_t count) {
 
-    /* Write data to socket */
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
-    int retval;
+    const char* buffer = buf;
 
-    retval = SSL_write(data->ssl, buf, count);
+    /* Write until completely written */
+    while (count > 0) {
 
-    /* Record errors in guac_error */
-    if (retval <= 0) {
-        guac_error = GUAC_STATUS_SEE_ERRNO;
-        guac_error_message = "Error writing data to secure socket";
+        int retval = SSL_write(data->ssl, buffer, count);
+
+        /* Record errors in guac_error */
+        if (retval <= 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error writing data to secure socket";
+            return 1;
+        }
+
+        /* Advance buffer to next chunk */
+        buffer += retval;
+        count  -= retval;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Sends the contents of the output buffer of the given socket as a single
+ * TLS record, without first locking access to the output buffer. This
+ * function must ONLY be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation was successful, non-zero otherwise.
+ */
+static int __guac_socket_ssl_flush(guac_socket* socket) {
+
+    guac_socket_ssl_state* state = (guac_socket_ssl_state*) socket->data;
+
+    /* Flush remaining bytes in buffer */
+    if (state->written > 0) {
+
+        if (__guac_socket_ssl_write(socket, state->out_buf, state->written))
+            return 1;
+
+        state->written = 0;
     }
 
+    return 0;
+
+}
+
+static ssize_t __guac_socket_ssl_flush_handler(guac_socket* socket) {
+
+    int retval;
+    guac_socket_ssl_state* state = (guac_socket_ssl_state*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(state->buffer_lock));
+
+    /* Flush contents of buffer */
+    retval = __guac_socket_ssl_flush(socket);
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(state->buffer_lock));
+
     return retval;
 
 }
 
+static ssize_t __guac_socket_ssl_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_ssl_state* state = (guac_socket_ssl_state*) socket->data;
+
+    size_t original_count = count;
+    const char* current = buf;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(state->buffer_lock));
+
+    /* Append to buffer, sending a full record each time the buffer fills */
+    while (count > 0) {
+
+        size_t chunk_size = sizeof(state->out_buf) - state->written;
+
+        /* If no space left in buffer, flush and retry */
+        if (chunk_size == 0) {
+
+            /* Abort if error occurs during flush */
+            if (__guac_socket_ssl_flush(socket)) {
+                pthread_mutex_unlock(&(state->buffer_lock));
+                return -1;
+            }
+
+            continue;
+
+        }
+
+        /* Calculate size of chunk to be written to buffer */
+        if (chunk_size > count)
+            chunk_size = count;
+
+        /* Update output buffer */
+        memcpy(state->out_buf + state->written, current, chunk_size);
+        state->written += chunk_size;
+
+        /* Update provided buffer */
+        current += chunk_size;
+        count   -= chunk_size;
+
+    }
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(state->buffer_lock));
+
+    /* All bytes have been written, possibly some to the internal buffer */
+    return original_count;
+
+}
+
+static void __guac_socket_ssl_lock_handler(guac_socket* socket) {
+
+    guac_socket_ssl_state* state = (guac_socket_ssl_state*) socket->data;
+
+    /* Acquire exclusive access to socket */
+    pthread_mutex_lock(&(state->socket_lock));
+
+}
+
+static void __guac_socket_ssl_unlock_handler(guac_socket* socket) {
+
+    guac_socket_ssl_state* state = (guac_socket_ssl_state*) socket->data;
+
+    /* Relinquish exclusive access to socket */
+    pthread_mutex_unlock(&(state->socket_lock));
+
+}
+
 static int __guac_socket_ssl_select_handler(guac_socket* socket, int usec_timeout) {
 
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+
+    /* Data already decrypted by OpenSSL can be read immediately */
+    if (SSL_pending(data->ssl) > 0)
+        return 1;
+
     int retval = guac_wait_for_fd(data->fd, usec_timeout);
 
     /* Properly set guac_error */
@@ -89,14 +284,18 @@ static int __guac_socket_ssl_select_handler(guac_socket* socket, int usec_timeou
 static int __guac_socket_ssl_free_handler(guac_socket* socket) {
 
     /* Shutdown SSL */
-    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
-    SSL_shutdown(data->ssl);
-    SSL_free(data->ssl);
+    guac_socket_ssl_state* state = (guac_socket_ssl_state*) socket->data;
+    SSL_shutdown(state->data.ssl);
+    SSL_free(state->data.ssl);
+
+    /* Destroy locks */
+    pthread_mutex_destroy(&(state->socket_lock));
+    pthread_mutex_destroy(&(state->buffer_lock));
 
     /* Close file descriptor */
-    close(data->fd);
+    close(state->data.fd);
 
-    free(data);
+    free(state);
     return 0;
 }
 
@@ -107,14 +306,7 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
     if (ssl == NULL)
         return NULL;
 
-    /* Allocate socket and associated data */
-    guac_socket* socket = guac_socket_alloc();
-    guac_socket_ssl_data* data = malloc(sizeof(guac_socket_ssl_data));
-
-    /* Init SSL */
-    data->context = context;
-    data->ssl = ssl;
-    SSL_set_fd(data->ssl, fd);
+    SSL_set_fd(ssl, fd);
 
     /* Accept SSL connection, handle errors */
     if (SSL_accept(ssl) <= 0) {
@@ -122,23 +314,54 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "SSL accept failed";
 
-        free(data);
-        guac_socket_free(socket);
         SSL_free(ssl);
         return NULL;
     }
 
-    /* Store file descriptor as socket data */
-    data->fd = fd;
-    socket->data = data;
+    guac_socket* socket = guac_socket_open_secure_accepted(ssl);
+    if (socket == NULL)
+        SSL_free(ssl);
+
+    return socket;
+
+}
+
+guac_socket* guac_socket_open_secure_accepted(SSL* ssl) {
+
+    /* Allocate socket and associated data */
+    guac_socket_ssl_state* state = malloc(sizeof(guac_socket_ssl_state));
+    if (state == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket";
+        return NULL;
+    }
+
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL) {
+        free(state);
+        return NULL;
+    }
+
+    /* Store SSL connection and file descriptor as socket data */
+    state->data.context = SSL_get_SSL_CTX(ssl);
+    state->data.ssl = ssl;
+    state->data.fd = SSL_get_fd(ssl);
+    state->written = 0;
+    socket->data = state;
+
+    /* Init locks */
+    pthread_mutex_init(&(state->socket_lock), NULL);
+    pthread_mutex_init(&(state->buffer_lock), NULL);
 
     /* Set read/write handlers */
     socket->read_handler   = __guac_socket_ssl_read_handler;
     socket->write_handler  = __guac_socket_ssl_write_handler;
     socket->select_handler = __guac_socket_ssl_select_handler;
+    socket->lock_handler   = __guac_socket_ssl_lock_handler;
+    socket->unlock_handler = __guac_socket_ssl_unlock_handler;
+    socket->flush_handler  = __guac_socket_ssl_flush_handler;
     socket->free_handler   = __guac_socket_ssl_free_handler;
 
     return socket;
 
 }
-
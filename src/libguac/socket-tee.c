@@ -218,6 +218,10 @@ guac_socket* guac_socket_tee(guac_socket* primary, guac_socket* secondary) {
     guac_socket* socket = guac_socket_alloc();
     socket->data = data;
 
+    /* Count instructions as the primary socket would have, such that output
+     * is still counted after being wrapped for a session recording */
+    socket->stats = primary->stats;
+
     /* Assign handlers */
     socket->read_handler   = __guac_socket_tee_read_handler;
     socket->write_handler  = __guac_socket_tee_write_handler;
@@ -19,7 +19,9 @@
 
 #include "config.h"
 
+#include "base64.h"
 #include "error.h"
+#include "format.h"
 #include "protocol.h"
 #include "socket.h"
 #include "timestamp.h"
@@ -150,6 +152,9 @@ guac_socket* guac_socket_alloc() {
     socket->state = GUAC_SOCKET_OPEN;
     socket->last_write_timestamp = guac_timestamp_current();
 
+    /* No statistics by default */
+    socket->stats = NULL;
+
     /* No keep alive ping by default */
     socket->__keep_alive_enabled = 0;
 
@@ -211,11 +216,11 @@ void guac_socket_free(guac_socket* socket) {
 
 ssize_t guac_socket_write_int(guac_socket* socket, int64_t i) {
 
-    char buffer[128];
+    char buffer[GUAC_FORMAT_INT_MAX_LENGTH];
     int length;
 
     /* Write provided integer as a string */
-    length = snprintf(buffer, sizeof(buffer), "%"PRIi64, i);
+    length = guac_format_int(buffer, i);
     return guac_socket_write(socket, buffer, length);
 
 }
@@ -321,14 +326,42 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
     int retval;
 
     const unsigned char* char_buf = (const unsigned char*) buf;
-    const unsigned char* end = char_buf + count;
+    char output[GUAC_BASE64_BLOCK_SIZE];
 
-    while (char_buf < end) {
+    /* Complete any partial triplet left over from a previous write */
+    while (socket->__ready > 0 && count > 0) {
 
         retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
         if (retval < 0)
             return retval;
 
+        count--;
+
+    }
+
+    /* Encode all remaining complete triplets in blocks, writing each block
+     * with a single call to guac_socket_write() */
+    const guac_base64_encoder* encoder = guac_base64_get_encoder();
+    while (count >= 3) {
+
+        /* Encode only as many triplets as will fit in the output block */
+        size_t triplets = count / 3;
+        if (triplets > sizeof(output) / 4)
+            triplets = sizeof(output) / 4;
+
+        encoder->encode(output, char_buf, triplets);
+        if (guac_socket_write(socket, output, triplets * 4))
+            return -1;
+
+        char_buf += triplets * 3;
+        count    -= triplets * 3;
+
+    }
+
+    /* Buffer any trailing bytes until more data is written or flushed */
+    while (count > 0) {
+        socket->__ready_buf[socket->__ready++] = *(char_buf++);
+        count--;
     }
 
     return 0;
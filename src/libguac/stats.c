@@ -0,0 +1,228 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "error.h"
+#include "protocol.h"
+#include "stats.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CLOCK_GETTIME
+#include <time.h>
+#endif
+
+/**
+ * Returns the current time in microseconds. Only differences between values
+ * returned by this function are meaningful.
+ *
+ * @return
+ *     The current time, in microseconds.
+ */
+static uint64_t __guac_stats_current_usec() {
+
+#ifdef HAVE_CLOCK_GETTIME
+
+    struct timespec current;
+
+    /* Get current time, monotonically increasing */
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &current);
+#else
+    clock_gettime(CLOCK_REALTIME, &current);
+#endif
+
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_nsec / 1000;
+
+#else
+
+    struct timeval current;
+
+    /* Get current time */
+    gettimeofday(&current, NULL);
+
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_usec;
+
+#endif
+
+}
+
+guac_stats* guac_stats_alloc() {
+
+    guac_stats* stats = calloc(1, sizeof(guac_stats));
+    if (stats == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for statistics";
+        return NULL;
+    }
+
+    return stats;
+
+}
+
+void guac_stats_free(guac_stats* stats) {
+    free(stats);
+}
+
+void guac_stats_count_instruction(guac_stats* stats,
+        guac_stats_direction direction, guac_protocol_opcode opcode,
+        uint64_t bytes) {
+
+    if (stats == NULL)
+        return;
+
+    guac_stats_counter* counter = (direction == GUAC_STATS_SENT)
+        ? &(stats->sent[opcode]) : &(stats->received[opcode]);
+
+    __atomic_add_fetch(&(counter->instructions), 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&(counter->bytes), bytes, __ATOMIC_RELAXED);
+
+}
+
+void guac_stats_record(guac_stats_histogram* histogram, uint64_t usec) {
+
+    /* Bucket N holds durations with exactly N significant bits */
+    int bucket = (usec == 0) ? 0 : 64 - __builtin_clzll(usec);
+    if (bucket >= GUAC_STATS_HISTOGRAM_BUCKETS)
+        bucket = GUAC_STATS_HISTOGRAM_BUCKETS - 1;
+
+    __atomic_add_fetch(&(histogram->buckets[bucket]), 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&(histogram->total), usec, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&(histogram->count), 1, __ATOMIC_RELAXED);
+
+}
+
+uint64_t guac_stats_start(guac_stats* stats) {
+
+    /* Avoid reading the clock entirely if statistics are disabled */
+    if (stats == NULL)
+        return 0;
+
+    return __guac_stats_current_usec();
+
+}
+
+void guac_stats_record_encode(guac_stats* stats, guac_stats_format format,
+        uint64_t start) {
+
+    if (stats == NULL)
+        return;
+
+    guac_stats_record(&(stats->encode[format]),
+            __guac_stats_current_usec() - start);
+
+}
+
+uint64_t guac_stats_percentile(const guac_stats_histogram* histogram,
+        double percentile) {
+
+    int bucket;
+    uint64_t seen = 0;
+
+    if (histogram->count == 0)
+        return 0;
+
+    /* Find first bucket at which the requested proportion is reached */
+    for (bucket = 0; bucket < GUAC_STATS_HISTOGRAM_BUCKETS - 1; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= percentile * histogram->count)
+            break;
+    }
+
+    /* Bucket zero contains only durations of zero */
+    if (bucket == 0)
+        return 0;
+
+    return (uint64_t) 1 << bucket;
+
+}
+
+/**
+ * Logs a summary of the given histogram, including the number of durations
+ * recorded and the approximate mean, median, and 99th percentile.
+ *
+ * @param histogram
+ *     The histogram to summarize.
+ *
+ * @param client
+ *     The client whose logging facilities should be used.
+ *
+ * @param level
+ *     The level at which the summary should be logged.
+ *
+ * @param name
+ *     A human-readable name describing the durations within the histogram.
+ */
+static void __guac_stats_log_histogram(const guac_stats_histogram* histogram,
+        guac_client* client, guac_client_log_level level, const char* name) {
+
+    if (histogram->count == 0)
+        return;
+
+    guac_client_log(client, level, "%s: %" PRIu64 " total, "
+            "mean %" PRIu64 "us, p50 <%" PRIu64 "us, p99 <%" PRIu64 "us",
+            name, histogram->count, histogram->total / histogram->count,
+            guac_stats_percentile(histogram, 0.50),
+            guac_stats_percentile(histogram, 0.99));
+
+}
+
+void guac_stats_log(const guac_stats* stats, guac_client* client,
+        guac_client_log_level level) {
+
+    int i;
+
+    for (i = 0; i < GUAC_PROTOCOL_OPCODE_COUNT; i++) {
+
+        const char* name = guac_protocol_get_opcode_name(i);
+        if (name == NULL)
+            name = "(unknown)";
+
+        if (stats->sent[i].instructions != 0)
+            guac_client_log(client, level, "Sent \"%s\": %" PRIu64
+                    " instructions, %" PRIu64 " bytes", name,
+                    stats->sent[i].instructions, stats->sent[i].bytes);
+
+        if (stats->received[i].instructions != 0)
+            guac_client_log(client, level, "Received \"%s\": %" PRIu64
+                    " instructions, %" PRIu64 " bytes", name,
+                    stats->received[i].instructions,
+                    stats->received[i].bytes);
+
+    }
+
+    __guac_stats_log_histogram(&(stats->encode[GUAC_STATS_FORMAT_PNG]),
+            client, level, "PNG encoding time");
+
+    __guac_stats_log_histogram(&(stats->encode[GUAC_STATS_FORMAT_JPEG]),
+            client, level, "JPEG encoding time");
+
+    __guac_stats_log_histogram(&(stats->encode[GUAC_STATS_FORMAT_WEBP]),
+            client, level, "WebP encoding time");
+
+    __guac_stats_log_histogram(&(stats->sync), client, level,
+            "Frame round trip time");
+
+}
+
@@ -22,6 +22,7 @@
 #include "client.h"
 #include "object.h"
 #include "protocol.h"
+#include "stats.h"
 #include "stream.h"
 #include "timestamp.h"
 #include "user.h"
@@ -34,23 +35,23 @@
 
 /* Guacamole instruction handler map */
 
-__guac_instruction_handler_mapping __guac_instruction_handler_map[] = {
-   {"sync",       __guac_handle_sync},
-   {"mouse",      __guac_handle_mouse},
-   {"key",        __guac_handle_key},
-   {"clipboard",  __guac_handle_clipboard},
-   {"disconnect", __guac_handle_disconnect},
-   {"size",       __guac_handle_size},
-   {"file",       __guac_handle_file},
-   {"pipe",       __guac_handle_pipe},
-   {"ack",        __guac_handle_ack},
-   {"blob",       __guac_handle_blob},
-   {"end",        __guac_handle_end},
-   {"get",        __guac_handle_get},
-   {"put",        __guac_handle_put},
-   {"audio",      __guac_handle_audio},
-   {"argv",       __guac_handle_argv},
-   {NULL,         NULL}
+__guac_instruction_handler* const
+    __guac_instruction_handler_map[GUAC_PROTOCOL_OPCODE_COUNT] = {
+    [GUAC_PROTOCOL_OPCODE_SYNC]       = __guac_handle_sync,
+    [GUAC_PROTOCOL_OPCODE_MOUSE]      = __guac_handle_mouse,
+    [GUAC_PROTOCOL_OPCODE_KEY]        = __guac_handle_key,
+    [GUAC_PROTOCOL_OPCODE_CLIPBOARD]  = __guac_handle_clipboard,
+    [GUAC_PROTOCOL_OPCODE_DISCONNECT] = __guac_handle_disconnect,
+    [GUAC_PROTOCOL_OPCODE_SIZE]       = __guac_handle_size,
+    [GUAC_PROTOCOL_OPCODE_FILE]       = __guac_handle_file,
+    [GUAC_PROTOCOL_OPCODE_PIPE]       = __guac_handle_pipe,
+    [GUAC_PROTOCOL_OPCODE_ACK]        = __guac_handle_ack,
+    [GUAC_PROTOCOL_OPCODE_BLOB]       = __guac_handle_blob,
+    [GUAC_PROTOCOL_OPCODE_END]        = __guac_handle_end,
+    [GUAC_PROTOCOL_OPCODE_GET]        = __guac_handle_get,
+    [GUAC_PROTOCOL_OPCODE_PUT]        = __guac_handle_put,
+    [GUAC_PROTOCOL_OPCODE_AUDIO]      = __guac_handle_audio,
+    [GUAC_PROTOCOL_OPCODE_ARGV]       = __guac_handle_argv,
 };
 
 /**
@@ -106,6 +107,11 @@ int __guac_handle_sync(guac_user* user, int argc, char** argv) {
         /* Calculate length of frame, including network and processing lag */
         frame_duration = current - timestamp;
 
+        /* Record round trip time of frame, if collecting statistics */
+        if (user->client->stats != NULL && frame_duration >= 0)
+            guac_stats_record(&(user->client->stats->sync),
+                    (uint64_t) frame_duration * 1000);
+
         /* Update lag statistics if at least one frame has been rendered */
         if (user->last_frame_duration != 0) {
 
@@ -32,6 +32,7 @@
 #include "config.h"
 
 #include "client.h"
+#include "protocol-types.h"
 #include "timestamp.h"
 
 /**
@@ -54,23 +55,6 @@
  */
 typedef int __guac_instruction_handler(guac_user* user, int argc, char** argv);
 
-/**
- * Structure mapping an instruction opcode to an instruction handler.
- */
-typedef struct __guac_instruction_handler_mapping {
-
-    /**
-     * The instruction opcode which maps to a specific handler.
-     */
-    char* opcode;
-
-    /**
-     * The handler which maps to a specific opcode.
-     */
-    __guac_instruction_handler* handler;
-
-} __guac_instruction_handler_mapping;
-
 /**
  * Internal initial handler for the sync instruction. When a sync instruction
  * is received, this handler will be called. Sync instructions are automatically
@@ -178,12 +162,12 @@ __guac_instruction_handler __guac_handle_size;
 __guac_instruction_handler __guac_handle_disconnect;
 
 /**
- * Instruction handler mapping table. This is a NULL-terminated array of
- * __guac_instruction_handler_mapping structures, each mapping an opcode
- * to a __guac_instruction_handler. The end of the array must be marked
- * with a __guac_instruction_handler_mapping with the opcode set to
- * NULL (the NULL terminator).
+ * Instruction handler lookup table. Each element corresponds to the
+ * guac_protocol_opcode value of the same index, and points to the
+ * __guac_instruction_handler for that opcode, or is NULL if instructions with
+ * that opcode are ignored.
  */
-extern __guac_instruction_handler_mapping __guac_instruction_handler_map[];
+extern __guac_instruction_handler* const
+    __guac_instruction_handler_map[GUAC_PROTOCOL_OPCODE_COUNT];
 
 #endif
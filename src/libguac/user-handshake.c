@@ -24,6 +24,7 @@
 #include "parser.h"
 #include "protocol.h"
 #include "socket.h"
+#include "stats.h"
 #include "user.h"
 
 #include <pthread.h>
@@ -213,6 +214,13 @@ static void* guac_user_input_thread(void* data) {
             return NULL;
         }
 
+        /* Count received instruction exactly as read, if collecting
+         * statistics */
+        if (client->stats != NULL)
+            guac_stats_count_instruction(client->stats, GUAC_STATS_RECEIVED,
+                    guac_protocol_get_opcode(parser->opcode),
+                    parser->__instruction_length);
+
         /* Reset guac_error and guac_error_message (user/client handlers are not
          * guaranteed to set these) */
         guac_error = GUAC_STATUS_SUCCESS;
@@ -303,7 +311,9 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
         return 1;
     }
 
-    guac_parser* parser = guac_parser_alloc();
+    /* Allow the user to send large blobs in a single instruction */
+    guac_parser* parser = guac_parser_alloc_max_length(
+            GUAC_USER_MAX_ELEMENT_LENGTH);
 
     /* Get optimal screen size */
     if (guac_parser_expect(parser, socket, usec_timeout, "size")) {
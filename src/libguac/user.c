@@ -27,7 +27,9 @@
 #include "object.h"
 #include "pool.h"
 #include "protocol.h"
+#include "quality.h"
 #include "socket.h"
+#include "stats.h"
 #include "stream.h"
 #include "timestamp.h"
 #include "user.h"
@@ -35,6 +37,7 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -105,13 +108,11 @@ guac_stream* guac_user_alloc_stream(guac_user* user) {
     guac_stream* allocd_stream;
     int stream_index;
 
-    /* Refuse to allocate beyond maximum */
-    if (user->__stream_pool->active == GUAC_USER_MAX_STREAMS)
+    /* Allocate stream, refusing to allocate beyond maximum */
+    stream_index = guac_pool_next_int_below(user->__stream_pool, GUAC_USER_MAX_STREAMS);
+    if (stream_index == -1)
         return NULL;
 
-    /* Allocate stream */
-    stream_index = guac_pool_next_int(user->__stream_pool);
-
     /* Initialize stream with even index (odd indices are client-level) */
     allocd_stream = &(user->__output_streams[stream_index]);
     allocd_stream->index = stream_index * 2;
@@ -139,13 +140,11 @@ guac_object* guac_user_alloc_object(guac_user* user) {
     guac_object* allocd_object;
     int object_index;
 
-    /* Refuse to allocate beyond maximum */
-    if (user->__object_pool->active == GUAC_USER_MAX_OBJECTS)
+    /* Allocate object, refusing to allocate beyond maximum */
+    object_index = guac_pool_next_int_below(user->__object_pool, GUAC_USER_MAX_OBJECTS);
+    if (object_index == -1)
         return NULL;
 
-    /* Allocate object */
-    object_index = guac_pool_next_int(user->__object_pool);
-
     /* Initialize object */
     allocd_object = &(user->__objects[object_index]);
     allocd_object->index = object_index;
@@ -169,16 +168,13 @@ void guac_user_free_object(guac_user* user, guac_object* object) {
 
 int guac_user_handle_instruction(guac_user* user, const char* opcode, int argc, char** argv) {
 
-    /* For each defined instruction */
-    __guac_instruction_handler_mapping* current = __guac_instruction_handler_map;
-    while (current->opcode != NULL) {
+    /* Look up handler by opcode */
+    __guac_instruction_handler* handler =
+        __guac_instruction_handler_map[guac_protocol_get_opcode(opcode)];
 
-        /* If recognized, call handler */
-        if (strcmp(opcode, current->opcode) == 0)
-            return current->handler(user, argc, argv);
-
-        current++;
-    }
+    /* If recognized, call handler */
+    if (handler != NULL)
+        return handler(user, argc, argv);
 
     /* If unrecognized, ignore */
     return 0;
@@ -250,8 +246,15 @@ void guac_user_stream_png(guac_user* user, guac_socket* socket,
     /* Declare stream as containing image data */
     guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y);
 
+    /* Compress according to the lag of this user */
+    int level = guac_quality_get_tier_compression(
+            guac_quality_get_tier(user->processing_lag));
+
     /* Write PNG data */
-    guac_png_write(socket, stream, surface);
+    guac_stats* stats = user->client->stats;
+    uint64_t start = guac_stats_start(stats);
+    guac_png_write(socket, stream, surface, level);
+    guac_stats_record_encode(stats, GUAC_STATS_FORMAT_PNG, start);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -265,6 +268,11 @@ void guac_user_stream_jpeg(guac_user* user, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
         cairo_surface_t* surface, int quality) {
 
+    /* Choose quality based on lag if requested */
+    if (quality == GUAC_CLIENT_ADAPTIVE_QUALITY)
+        quality = guac_quality_get_tier_quality(
+                guac_quality_get_tier(user->processing_lag));
+
     /* Allocate new stream for image */
     guac_stream* stream = guac_user_alloc_stream(user);
 
@@ -272,7 +280,10 @@ void guac_user_stream_jpeg(guac_user* user, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/jpeg", x, y);
 
     /* Write JPEG data */
+    guac_stats* stats = user->client->stats;
+    uint64_t start = guac_stats_start(stats);
     guac_jpeg_write(socket, stream, surface, quality);
+    guac_stats_record_encode(stats, GUAC_STATS_FORMAT_JPEG, start);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -287,6 +298,11 @@ void guac_user_stream_webp(guac_user* user, guac_socket* socket,
         cairo_surface_t* surface, int quality, int lossless) {
 
 #ifdef ENABLE_WEBP
+    /* Choose quality based on lag if requested */
+    if (quality == GUAC_CLIENT_ADAPTIVE_QUALITY)
+        quality = guac_quality_get_tier_quality(
+                guac_quality_get_tier(user->processing_lag));
+
     /* Allocate new stream for image */
     guac_stream* stream = guac_user_alloc_stream(user);
 
@@ -294,7 +310,10 @@ void guac_user_stream_webp(guac_user* user, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
 
     /* Write WebP data */
+    guac_stats* stats = user->client->stats;
+    uint64_t start = guac_stats_start(stats);
     guac_webp_write(socket, stream, surface, quality, lossless);
+    guac_stats_record_encode(stats, GUAC_STATS_FORMAT_WEBP, start);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -682,6 +682,22 @@ static int guac_rdp_handle_connection(guac_client* client) {
             rdp_client->settings->width,
             rdp_client->settings->height);
 
+    /* Encode and send each frame while the next is being received */
+    if (guac_common_display_enable_pipeline(rdp_client->display))
+        guac_client_log(client, GUAC_LOG_WARNING, "Display updates cannot "
+                "be pipelined. Each frame will be encoded and sent before "
+                "the next is received.");
+
+    /* Send scrolled or moved content as a copy unless disabled */
+    if (!rdp_client->settings->disable_motion_detection)
+        guac_common_surface_set_motion_detection(
+                rdp_client->display->default_surface, 1);
+
+    /* Re-send lossy content losslessly once it stops changing */
+    guac_common_surface_set_lossless_refresh(
+            rdp_client->display->default_surface,
+            rdp_client->settings->lossless_refresh);
+
     rdp_client->current_surface = rdp_client->display->default_surface;
 
     rdp_client->requested_clipboard_format = CB_FORMAT_TEXT;
@@ -842,11 +858,8 @@ static int guac_rdp_handle_connection(guac_client* client) {
                     "Connection closed.");
 
         /* Flush frame only if successful */
-        else {
-            guac_common_display_flush(rdp_client->display);
-            guac_client_end_frame(client);
-            guac_socket_flush(client->socket);
-        }
+        else
+            guac_common_display_end_frame(rdp_client->display);
 
     }
 
@@ -77,6 +77,8 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "disable-bitmap-caching",
     "disable-offscreen-caching",
     "disable-glyph-caching",
+    "disable-motion-detection",
+    "lossless-refresh",
     "preconnection-id",
     "preconnection-blob",
 
@@ -343,6 +345,19 @@ enum RDP_ARGS_IDX {
      */
     IDX_DISABLE_GLYPH_CACHING,
 
+    /**
+     * "true" if scrolled or moved screen content should not be detected and
+     * sent as a copy, "false" or blank to leave motion detection enabled.
+     */
+    IDX_DISABLE_MOTION_DETECTION,
+
+    /**
+     * The number of milliseconds that screen content sent with a lossy format
+     * must remain unchanged before it is re-sent losslessly, or "0" to never
+     * re-send lossy content. If blank, a default interval is used.
+     */
+    IDX_LOSSLESS_REFRESH,
+
     /**
      * The preconnection ID to send within the preconnection PDU when
      * initiating an RDP connection, if any.
@@ -753,6 +768,14 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
                 IDX_DISABLE_GLYPH_CACHING, 0);
 
+    settings->disable_motion_detection =
+        guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_DISABLE_MOTION_DETECTION, 0);
+
+    settings->lossless_refresh =
+        guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_LOSSLESS_REFRESH, GUAC_RDP_DEFAULT_LOSSLESS_REFRESH);
+
     /* Session color depth */
     settings->color_depth = 
         guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
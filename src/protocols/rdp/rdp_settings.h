@@ -58,6 +58,12 @@
  */
 #define GUAC_RDP_DEFAULT_RECORDING_NAME "recording"
 
+/**
+ * The number of milliseconds that screen content sent with a lossy format
+ * must remain unchanged before it is re-sent losslessly, if not specified.
+ */
+#define GUAC_RDP_DEFAULT_LOSSLESS_REFRESH 1000
+
 /**
  * All supported combinations of security types.
  */
@@ -327,6 +333,20 @@ typedef struct guac_rdp_settings {
      */
     int disable_glyph_caching;
 
+    /**
+     * Whether detection of scrolled or moved screen content should be
+     * disabled. By default it is enabled - this allows users to explicitly
+     * disable it.
+     */
+    int disable_motion_detection;
+
+    /**
+     * The number of milliseconds that screen content sent with a lossy format
+     * must remain unchanged before it is re-sent losslessly, or zero if lossy
+     * content should never be re-sent.
+     */
+    int lossless_refresh;
+
     /**
      * The preconnection ID to send within the preconnection PDU when
      * initiating an RDP connection, if any. If no preconnection ID is
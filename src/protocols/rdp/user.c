@@ -149,8 +149,8 @@ int guac_rdp_user_leave_handler(guac_user* user) {
 
     guac_rdp_client* rdp_client = (guac_rdp_client*) user->client->data;
 
-    /* Update shared cursor state */
-    guac_common_cursor_remove_user(rdp_client->display->cursor, user);
+    /* Update shared cursor and display state */
+    guac_common_display_remove_user(rdp_client->display, user);
 
     /* Free settings if not owner (owner settings will be freed with client) */
     if (!user->owner) {
@@ -41,6 +41,8 @@ const char* GUAC_VNC_CLIENT_ARGS[] = {
     "cursor",
     "autoretry",
     "clipboard-encoding",
+    "disable-motion-detection",
+    "lossless-refresh",
 
 #ifdef ENABLE_VNC_REPEATER
     "dest-host",
@@ -144,6 +146,19 @@ enum VNC_ARGS_IDX {
      */
     IDX_CLIPBOARD_ENCODING,
 
+    /**
+     * "true" if scrolled or moved screen content should not be detected and
+     * sent as a copy, "false" or blank to leave motion detection enabled.
+     */
+    IDX_DISABLE_MOTION_DETECTION,
+
+    /**
+     * The number of milliseconds that screen content sent with a lossy format
+     * must remain unchanged before it is re-sent losslessly, or "0" to never
+     * re-send lossy content. If blank, a default interval is used.
+     */
+    IDX_LOSSLESS_REFRESH,
+
 #ifdef ENABLE_VNC_REPEATER
     /**
      * The VNC host to connect to, if using a repeater.
@@ -406,6 +421,16 @@ guac_vnc_settings* guac_vnc_parse_args(guac_user* user,
         guac_user_parse_args_string(user, GUAC_VNC_CLIENT_ARGS, argv,
                 IDX_CLIPBOARD_ENCODING, NULL);
 
+    /* Motion detection enable/disable */
+    settings->disable_motion_detection =
+        guac_user_parse_args_boolean(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_DISABLE_MOTION_DETECTION, false);
+
+    /* Lossless refresh interval */
+    settings->lossless_refresh =
+        guac_user_parse_args_int(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_LOSSLESS_REFRESH, GUAC_VNC_DEFAULT_LOSSLESS_REFRESH);
+
 #ifdef ENABLE_COMMON_SSH
     /* SFTP enable/disable */
     settings->enable_sftp =
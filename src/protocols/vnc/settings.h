@@ -30,6 +30,12 @@
  */
 #define GUAC_VNC_DEFAULT_RECORDING_NAME "recording"
 
+/**
+ * The number of milliseconds that screen content sent with a lossy format
+ * must remain unchanged before it is re-sent losslessly, if not specified.
+ */
+#define GUAC_VNC_DEFAULT_LOSSLESS_REFRESH 1000
+
 /**
  * VNC-specific client data.
  */
@@ -127,6 +133,19 @@ typedef struct guac_vnc_settings {
      */
     char* clipboard_encoding;
 
+    /**
+     * Whether detection of scrolled or moved screen content should be
+     * disabled.
+     */
+    bool disable_motion_detection;
+
+    /**
+     * The number of milliseconds that screen content sent with a lossy format
+     * must remain unchanged before it is re-sent losslessly, or zero if lossy
+     * content should never be re-sent.
+     */
+    int lossless_refresh;
+
 #ifdef ENABLE_COMMON_SSH
     /**
      * Whether SFTP should be enabled for the VNC connection.
@@ -113,8 +113,8 @@ int guac_vnc_user_leave_handler(guac_user* user) {
     guac_vnc_client* vnc_client = (guac_vnc_client*) user->client->data;
 
     if (vnc_client->display) {
-        /* Update shared cursor state */
-        guac_common_cursor_remove_user(vnc_client->display->cursor, user);
+        /* Update shared cursor and display state */
+        guac_common_display_remove_user(vnc_client->display, user);
     }
 
     /* Free settings if not owner (owner settings will be freed with client) */
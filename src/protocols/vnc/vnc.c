@@ -317,6 +317,21 @@ void* guac_vnc_client_thread(void* data) {
     vnc_client->display = guac_common_display_alloc(client,
             rfb_client->width, rfb_client->height);
 
+    /* Encode and send each frame while the next is being received */
+    if (guac_common_display_enable_pipeline(vnc_client->display))
+        guac_client_log(client, GUAC_LOG_WARNING, "Display updates cannot "
+                "be pipelined. Each frame will be encoded and sent before "
+                "the next is received.");
+
+    /* Send scrolled or moved content as a copy unless disabled */
+    if (!settings->disable_motion_detection)
+        guac_common_surface_set_motion_detection(
+                vnc_client->display->default_surface, 1);
+
+    /* Re-send lossy content losslessly once it stops changing */
+    guac_common_surface_set_lossless_refresh(
+            vnc_client->display->default_surface, settings->lossless_refresh);
+
     /* If not read-only, set an appropriate cursor */
     if (settings->read_only == 0) {
         if (settings->remote_cursor)
@@ -391,9 +406,7 @@ void* guac_vnc_client_thread(void* data) {
             guac_client_abort(client, GUAC_PROTOCOL_STATUS_UPSTREAM_ERROR, "Connection closed.");
 
         /* Flush frame */
-        guac_common_surface_flush(vnc_client->display->default_surface);
-        guac_client_end_frame(client);
-        guac_socket_flush(client->socket);
+        guac_common_display_end_frame(vnc_client->display);
 
     }
 
@@ -0,0 +1,142 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark comparing each base64 encoder supported by the current CPU across
+ * a range of input sizes, as well as the complete guac_socket_write_base64()
+ * path using the fastest encoder. This is not run as part of "make check",
+ * and must be built explicitly with "make bench_base64".
+ */
+
+#include "config.h"
+
+#include "base64.h"
+
+#include <guacamole/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * The approximate number of bytes encoded for each input size, such that all
+ * measurements take a similar amount of time.
+ */
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+/**
+ * The number of benchmarked input sizes.
+ */
+#define BENCH_SIZES 5
+
+/**
+ * The size of each benchmarked input, in bytes. These correspond roughly to
+ * a small glyph, a typical audio packet, a typical blob, and large images.
+ */
+static const int bench_sizes[BENCH_SIZES] = {
+    48, 768, 6144, 65536, 1048576
+};
+
+/**
+ * The total number of bytes written to the discarding socket, stored such
+ * that the work done cannot be optimized away.
+ */
+static volatile size_t bench_written = 0;
+
+/**
+ * Returns the current time in seconds, as measured by a monotonic clock.
+ */
+static double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Write handler which counts and then discards all written data.
+ */
+static ssize_t bench_discard_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+    bench_written += count;
+    return count;
+}
+
+int main() {
+
+    const guac_base64_encoder* encoders[GUAC_BASE64_MAX_ENCODERS];
+    int count = guac_base64_list_encoders(encoders, GUAC_BASE64_MAX_ENCODERS);
+
+    int max_size = bench_sizes[BENCH_SIZES - 1];
+    unsigned char* input = malloc(max_size);
+    char* output = malloc(max_size / 3 * 4 + 4);
+    int i, j, size, k;
+
+    for (i = 0; i < max_size; i++)
+        input[i] = (i * 2654435761u) >> 24;
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->write_handler = bench_discard_write_handler;
+
+    printf("%-10s", "size");
+    for (k = 0; k < count; k++)
+        printf(" %12s", encoders[k]->name);
+    printf(" %12s   (MB/second of input)\n", "socket");
+
+    for (size = 0; size < BENCH_SIZES; size++) {
+
+        int length = bench_sizes[size];
+        int passes = BENCH_BYTES / length;
+        printf("%-10d", length);
+
+        /* Each encoder alone */
+        for (k = 0; k < count; k++) {
+
+            double start = bench_now();
+
+            for (j = 0; j < passes; j++) {
+                encoders[k]->encode(output, input, length / 3);
+                bench_written += output[j % (length / 3 * 4)];
+            }
+
+            double elapsed = bench_now() - start;
+            printf(" %12.1f", (double) passes * length / elapsed / 1e6);
+
+        }
+
+        /* Complete path through a socket, including buffering of trailing
+         * bytes and padding */
+        double start = bench_now();
+
+        for (j = 0; j < passes; j++) {
+            guac_socket_write_base64(socket, input, length);
+            guac_socket_flush_base64(socket);
+        }
+
+        double elapsed = bench_now() - start;
+        printf(" %12.1f\n", (double) passes * length / elapsed / 1e6);
+
+    }
+
+    guac_socket_free(socket);
+    free(output);
+    free(input);
+    return 0;
+
+}
+
@@ -0,0 +1,303 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark measuring the CPU time and output size of drawing and flushing
+ * several typical patterns of surface updates. This is not run as part of
+ * "make check", and must be built explicitly with "make bench_damage".
+ */
+
+#include "config.h"
+
+#include "common/encoder.h"
+#include "common/surface.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The width of the benchmarked surface, in pixels.
+ */
+#define BENCH_WIDTH 1920
+
+/**
+ * The height of the benchmarked surface, in pixels.
+ */
+#define BENCH_HEIGHT 1080
+
+/**
+ * The number of frames drawn and flushed for each pattern.
+ */
+#define BENCH_FRAMES 20
+
+/**
+ * Output statistics gathered from a socket which discards all data.
+ */
+typedef struct bench_output {
+
+    /**
+     * The total number of bytes written.
+     */
+    size_t bytes;
+
+    /**
+     * The total number of "img" instructions written.
+     */
+    int images;
+
+} bench_output;
+
+/**
+ * Write handler which counts, then discards, all written data.
+ */
+static ssize_t bench_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    bench_output* output = (bench_output*) socket->data;
+    const char* data = (const char*) buf;
+    size_t i;
+
+    output->bytes += count;
+
+    /* Instructions are rarely split across writes, so this count is close */
+    for (i = 0; i + 6 <= count; i++) {
+        if (memcmp(data + i, "3.img,", 6) == 0)
+            output->images++;
+    }
+
+    return count;
+
+}
+
+/**
+ * State of the pseudo-random number generator used to produce all updates,
+ * such that every run draws identical content.
+ */
+static uint32_t bench_seed;
+
+/**
+ * Returns the next pseudo-random number.
+ */
+static uint32_t bench_random() {
+    bench_seed = bench_seed * 1664525 + 1013904223;
+    return bench_seed >> 8;
+}
+
+/**
+ * Draws a rectangle of pseudo-random two-color content resembling text or
+ * user interface elements, consisting of short runs of flat color.
+ */
+static void bench_draw(guac_common_surface* surface, int x, int y,
+        int width, int height) {
+
+    int i;
+
+    uint32_t colors[2] = {
+        0xFF000000 | bench_random(),
+        0xFF000000 | bench_random()
+    };
+
+    int stride = width * 4;
+    uint32_t* data = malloc(stride * height);
+    for (i = 0; i < width * height; ) {
+
+        /* Each run has a random length and color */
+        int length = 4 + bench_random() % 28;
+        uint32_t color = colors[bench_random() & 1];
+
+        while (length-- > 0 && i < width * height)
+            data[i++] = color;
+
+    }
+
+    cairo_surface_t* update = cairo_image_surface_create_for_data(
+            (unsigned char*) data, CAIRO_FORMAT_RGB24, width, height, stride);
+
+    guac_common_surface_draw(surface, x, y, update);
+
+    cairo_surface_destroy(update);
+    free(data);
+
+}
+
+/**
+ * Draws one frame of typing: a row of glyphs appended to each of a few
+ * lines of text.
+ */
+static void bench_typing(guac_common_surface* surface, int frame) {
+
+    int line, glyph;
+
+    for (line = 0; line < 4; line++) {
+        for (glyph = 0; glyph < 6; glyph++)
+            bench_draw(surface, 40 + (frame * 6 + glyph) * 9,
+                    200 + line * 180, 9, 16);
+    }
+
+}
+
+/**
+ * Draws one frame of small updates scattered across the entire surface,
+ * such as blinking cursors, clocks and status icons.
+ */
+static void bench_scattered(guac_common_surface* surface, int frame) {
+
+    int i;
+
+    for (i = 0; i < 200; i++)
+        bench_draw(surface, bench_random() % (BENCH_WIDTH - 16),
+                bench_random() % (BENCH_HEIGHT - 16), 16, 16);
+
+}
+
+/**
+ * Draws one frame of a redrawn window: a dense block of small updates
+ * covering a single large region, drawn in no particular order.
+ */
+static void bench_window(guac_common_surface* surface, int frame) {
+
+    int i;
+
+    for (i = 0; i < 400; i++)
+        bench_draw(surface, 300 + bench_random() % 800,
+                200 + bench_random() % 600, 8 + bench_random() % 120,
+                8 + bench_random() % 40);
+
+}
+
+/**
+ * Draws one frame of mixed updates: a few large widgets and many small ones.
+ */
+static void bench_mixed(guac_common_surface* surface, int frame) {
+
+    int i;
+
+    for (i = 0; i < 20; i++)
+        bench_draw(surface, bench_random() % (BENCH_WIDTH - 300),
+                bench_random() % (BENCH_HEIGHT - 300),
+                32 + bench_random() % 268, 32 + bench_random() % 268);
+
+    bench_scattered(surface, frame);
+
+}
+
+/**
+ * Draws one frame of a full-surface update, drawn as horizontal strips.
+ */
+static void bench_full(guac_common_surface* surface, int frame) {
+
+    int y;
+
+    for (y = 0; y < BENCH_HEIGHT; y += 64)
+        bench_draw(surface, 0, y, BENCH_WIDTH,
+                BENCH_HEIGHT - y < 64 ? BENCH_HEIGHT - y : 64);
+
+}
+
+/**
+ * A function which draws one frame of a benchmarked pattern of updates.
+ */
+typedef void bench_pattern(guac_common_surface* surface, int frame);
+
+/**
+ * Returns the CPU time consumed by this process, in seconds.
+ */
+static double bench_cpu() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Draws and flushes all frames of the given pattern, printing the CPU time
+ * spent drawing and flushing along with the resulting output.
+ */
+static void bench_run(const char* name, bench_pattern* pattern) {
+
+    int frame;
+    double draw = 0;
+    double flush = 0;
+    bench_output output = { 0 };
+
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = &output;
+    socket->write_handler = bench_write_handler;
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, BENCH_WIDTH, BENCH_HEIGHT);
+
+    /* Start with an opaque background, as would a remote desktop */
+    guac_common_surface_set(surface, 0, 0, BENCH_WIDTH, BENCH_HEIGHT,
+            0x40, 0x40, 0x40, 0xFF);
+    guac_common_surface_flush(surface);
+
+    bench_seed = 1;
+    output.bytes = 0;
+    output.images = 0;
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+
+        double start = bench_cpu();
+        pattern(surface, frame);
+
+        double drawn = bench_cpu();
+        guac_common_surface_flush(surface);
+        guac_socket_flush(socket);
+
+        flush += bench_cpu() - drawn;
+        draw += drawn - start;
+
+    }
+
+    printf("%-10s %10.2f %10.2f %10d %12zu\n", name,
+            draw * 1000 / BENCH_FRAMES, flush * 1000 / BENCH_FRAMES,
+            output.images / BENCH_FRAMES, output.bytes / BENCH_FRAMES);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+int main() {
+
+    /* Encode serially such that CPU time reflects all work done */
+    guac_common_encoder_set_threads(1);
+
+    printf("%-10s %10s %10s %10s %12s   (per frame)\n",
+            "pattern", "draw (ms)", "flush (ms)", "images", "bytes");
+
+    bench_run("typing", bench_typing);
+    bench_run("scattered", bench_scattered);
+    bench_run("window", bench_window);
+    bench_run("mixed", bench_mixed);
+    bench_run("full", bench_full);
+
+    return 0;
+
+}
+
@@ -0,0 +1,213 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark measuring the CPU time and output size of encoding small tiles of
+ * typical content as PNG and JPEG. This is not run as part of "make check",
+ * and must be built explicitly with "make bench_encode".
+ */
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * The approximate number of pixels encoded for each combination of content
+ * and tile size, such that all measurements take a similar amount of time.
+ */
+#define BENCH_PIXELS (16 * 1024 * 1024)
+
+/**
+ * The number of benchmarked tile sizes.
+ */
+#define BENCH_SIZES 3
+
+/**
+ * The width and height of each benchmarked tile, in pixels.
+ */
+static const int bench_sizes[BENCH_SIZES] = { 16, 64, 256 };
+
+/**
+ * The kinds of content benchmarked.
+ */
+typedef enum bench_content {
+
+    /**
+     * Text-like content consisting of two colors, encoded as PNG.
+     */
+    BENCH_TEXT_PNG,
+
+    /**
+     * Photographic content having many colors, encoded as PNG.
+     */
+    BENCH_PHOTO_PNG,
+
+    /**
+     * Photographic content having many colors, encoded as JPEG.
+     */
+    BENCH_PHOTO_JPEG,
+
+    BENCH_CONTENTS
+
+} bench_content;
+
+/**
+ * Human-readable names of each kind of content, indexed by bench_content.
+ */
+static const char* bench_content_names[BENCH_CONTENTS] = {
+    "text (png)",
+    "photo (png)",
+    "photo (jpeg)"
+};
+
+/**
+ * Write handler which counts, then discards, all written data.
+ */
+static ssize_t bench_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+    *((size_t*) socket->data) += count;
+    return count;
+}
+
+/**
+ * State of the pseudo-random number generator used to produce all content,
+ * such that every run encodes identical content.
+ */
+static uint32_t bench_seed;
+
+/**
+ * Returns the next pseudo-random number.
+ */
+static uint32_t bench_random() {
+    bench_seed = bench_seed * 1664525 + 1013904223;
+    return bench_seed >> 8;
+}
+
+/**
+ * Creates a tile of the given size containing the given kind of content.
+ */
+static cairo_surface_t* bench_create_tile(bench_content content, int size) {
+
+    int x, y;
+
+    cairo_surface_t* tile = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            size, size);
+
+    unsigned char* data = cairo_image_surface_get_data(tile);
+    int stride = cairo_image_surface_get_stride(tile);
+
+    for (y = 0; y < size; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+
+        for (x = 0; x < size; x++) {
+
+            /* Dark strokes on a light background */
+            if (content == BENCH_TEXT_PNG)
+                row[x] = (bench_random() % 4 == 0) ? 0x202020 : 0xF0F0F0;
+
+            /* Smooth gradient with noise */
+            else
+                row[x] = ((x * 255 / size) << 16) | ((y * 255 / size) << 8)
+                       | (bench_random() & 0x3F);
+
+        }
+
+    }
+
+    cairo_surface_mark_dirty(tile);
+    return tile;
+
+}
+
+/**
+ * Returns the CPU time consumed by this process, in seconds.
+ */
+static double bench_cpu() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main() {
+
+    int content, size, i;
+
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_alloc();
+    size_t bytes;
+
+    socket->data = &bytes;
+    socket->write_handler = bench_write_handler;
+
+    printf("%-14s %-10s %14s %12s   (per image)\n",
+            "content", "size", "time (us)", "bytes");
+
+    for (content = 0; content < BENCH_CONTENTS; content++) {
+        for (size = 0; size < BENCH_SIZES; size++) {
+
+            int dimension = bench_sizes[size];
+            int images = BENCH_PIXELS / (dimension * dimension);
+            char dimensions[32];
+
+            bench_seed = 1;
+            cairo_surface_t* tile = bench_create_tile(content, dimension);
+
+            bytes = 0;
+            double start = bench_cpu();
+
+            for (i = 0; i < images; i++) {
+
+                if (content == BENCH_PHOTO_JPEG)
+                    guac_client_stream_jpeg(client, socket, GUAC_COMP_OVER,
+                            GUAC_DEFAULT_LAYER, 0, 0, tile, 80);
+                else
+                    guac_client_stream_png(client, socket, GUAC_COMP_OVER,
+                            GUAC_DEFAULT_LAYER, 0, 0, tile);
+
+                guac_socket_flush(socket);
+
+            }
+
+            double elapsed = bench_cpu() - start;
+
+            snprintf(dimensions, sizeof(dimensions), "%dx%d",
+                    dimension, dimension);
+            printf("%-14s %-10s %14.2f %12zu\n", bench_content_names[content],
+                    dimensions, elapsed * 1e6 / images, bytes / images);
+
+            cairo_surface_destroy(tile);
+
+        }
+    }
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+    return 0;
+
+}
+
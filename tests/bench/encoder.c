@@ -0,0 +1,219 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark measuring the wall-clock time of flushing full-surface updates at
+ * 1080p and 4K using increasing numbers of encoder threads. This is not run
+ * as part of "make check", and must be built explicitly with
+ * "make bench_encoder".
+ */
+
+#include "config.h"
+
+#include "common/encoder.h"
+#include "common/surface.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of frames drawn and flushed for each size and number of
+ * threads.
+ */
+#define BENCH_FRAMES 10
+
+/**
+ * The number of benchmarked surface sizes.
+ */
+#define BENCH_SIZES 2
+
+/**
+ * The dimensions of each benchmarked surface.
+ */
+static const int bench_sizes[BENCH_SIZES][2] = {
+    { 1920, 1080 },
+    { 3840, 2160 }
+};
+
+/**
+ * Output statistics gathered from a socket which discards all data.
+ */
+typedef struct bench_output {
+
+    /**
+     * The total number of bytes written.
+     */
+    size_t bytes;
+
+    /**
+     * The total number of "img" instructions written.
+     */
+    int images;
+
+} bench_output;
+
+/**
+ * Write handler which counts, then discards, all written data.
+ */
+static ssize_t bench_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    bench_output* output = (bench_output*) socket->data;
+    const char* data = (const char*) buf;
+    size_t i;
+
+    output->bytes += count;
+
+    /* Instructions are rarely split across writes, so this count is close */
+    for (i = 0; i + 6 <= count; i++) {
+        if (memcmp(data + i, "3.img,", 6) == 0)
+            output->images++;
+    }
+
+    return count;
+
+}
+
+/**
+ * Returns the current time in seconds, as measured by a monotonic clock.
+ */
+static double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Returns a new image of the given size containing a gradient overlaid with
+ * fine detail, such that the image compresses roughly as a typical desktop
+ * would, and such that images having different seeds differ everywhere.
+ */
+static cairo_surface_t* bench_image(int width, int height, uint32_t seed) {
+
+    int x, y;
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            width, height);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    for (y = 0; y < height; y++) {
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (x = 0; x < width; x++) {
+            uint32_t detail = ((x ^ y) * 2654435761u + seed) >> 29;
+            row[x] = 0xFF000000
+                   | (((x + seed) & 0xFF) << 16)
+                   | ((y & 0xFF) << 8)
+                   | (((x + y) & 0xF8) | detail);
+        }
+    }
+
+    cairo_surface_mark_dirty(image);
+    return image;
+
+}
+
+/**
+ * Draws and flushes BENCH_FRAMES full-surface updates of the given size using
+ * the given number of encoder threads, printing the wall-clock time taken
+ * per frame. The time taken using a single thread is stored in, or compared
+ * against, the given baseline.
+ */
+static void bench_run(int width, int height, int threads, double* baseline) {
+
+    bench_output output = { 0 };
+    cairo_surface_t* images[2];
+    int frame;
+
+    guac_client* client = guac_client_alloc();
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = &output;
+    socket->write_handler = bench_write_handler;
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, width, height);
+
+    /* Alternate between two images such that every frame changes */
+    images[0] = bench_image(width, height, 0);
+    images[1] = bench_image(width, height, 1);
+
+    guac_common_encoder_set_threads(threads);
+
+    double start = bench_now();
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+        guac_common_surface_draw(surface, 0, 0, images[frame % 2]);
+        guac_common_surface_flush(surface);
+        guac_socket_flush(socket);
+    }
+
+    double elapsed = (bench_now() - start) / BENCH_FRAMES;
+
+    if (threads == 1)
+        *baseline = elapsed;
+
+    char dimensions[32];
+    snprintf(dimensions, sizeof(dimensions), "%dx%d", width, height);
+
+    printf("%-10s %8d %10.2f %10.2f %8d %12zu\n", dimensions, threads,
+            elapsed * 1000, *baseline / elapsed,
+            output.images / BENCH_FRAMES, output.bytes / BENCH_FRAMES);
+
+    cairo_surface_destroy(images[0]);
+    cairo_surface_destroy(images[1]);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+int main() {
+
+    int size, threads;
+
+    printf("%-10s %8s %10s %10s %8s %12s   (per frame)\n",
+            "size", "threads", "time (ms)", "speedup", "images", "bytes");
+
+    for (size = 0; size < BENCH_SIZES; size++) {
+
+        double baseline = 0;
+
+        for (threads = 1; threads <= GUAC_COMMON_ENCODER_MAX_THREADS;
+                threads *= 2)
+            bench_run(bench_sizes[size][0], bench_sizes[size][1], threads,
+                    &baseline);
+
+    }
+
+    /* Restore default */
+    guac_common_encoder_set_threads(0);
+
+    return 0;
+
+}
@@ -0,0 +1,210 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark comparing the instruction builder with writing each element of
+ * an instruction to the socket separately, formatting integers with
+ * snprintf(), as instructions were previously sent. This is not run as part
+ * of "make check", and must be built explicitly with "make bench_instruction".
+ */
+
+#include "config.h"
+
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of instructions sent for each benchmarked method.
+ */
+#define BENCH_INSTRUCTIONS (4 * 1024 * 1024)
+
+/**
+ * The number of instructions added to each builder when batching.
+ */
+#define BENCH_BATCH_SIZE 64
+
+/**
+ * A layer having an index typical of an off-screen buffer.
+ */
+static const guac_layer bench_buffer = { .index = -12 };
+
+/**
+ * A visible layer.
+ */
+static const guac_layer bench_layer = { .index = 3 };
+
+/**
+ * Returns the current time in seconds, as measured by a monotonic clock.
+ */
+static double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the given integer to the given socket as an instruction element,
+ * including its length prefix, as was previously done for every integer.
+ */
+static int bench_legacy_write_int(guac_socket* socket, int64_t i) {
+
+    char buffer[128];
+    char length[16];
+
+    snprintf(buffer, sizeof(buffer), "%"PRIi64, i);
+    snprintf(length, sizeof(length), "%i.", (int) strlen(buffer));
+
+    return guac_socket_write_string(socket, length)
+        || guac_socket_write_string(socket, buffer);
+
+}
+
+/**
+ * Sends a "copy" instruction by writing each element to the socket
+ * separately, as guac_protocol_send_copy() previously did.
+ */
+static int bench_legacy_send_copy(guac_socket* socket,
+        const guac_layer* srcl, int srcx, int srcy, int w, int h,
+        guac_composite_mode mode, const guac_layer* dstl, int dstx, int dsty) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+    ret_val =
+           guac_socket_write_string(socket, "4.copy,")
+        || bench_legacy_write_int(socket, srcl->index)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, srcx)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, srcy)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, w)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, h)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, mode)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, dstl->index)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, dstx)
+        || guac_socket_write_string(socket, ",")
+        || bench_legacy_write_int(socket, dsty)
+        || guac_socket_write_string(socket, ";");
+    guac_socket_instruction_end(socket);
+
+    return ret_val;
+
+}
+
+/**
+ * Sends BENCH_INSTRUCTIONS "copy" instructions to the given socket using the
+ * given method, returning the average time taken per instruction, in
+ * nanoseconds. Method 0 writes each element separately, method 1 uses
+ * guac_protocol_send_copy(), and method 2 adds BENCH_BATCH_SIZE instructions
+ * to each guac_protocol_builder.
+ */
+static double bench_run(guac_socket* socket, int method) {
+
+    guac_protocol_builder builder;
+    int i, j;
+
+    double start = bench_now();
+
+    for (i = 0; i < BENCH_INSTRUCTIONS; i += BENCH_BATCH_SIZE) {
+
+        if (method == 0) {
+            for (j = 0; j < BENCH_BATCH_SIZE; j++)
+                bench_legacy_send_copy(socket, &bench_buffer, j * 16, 480,
+                        64, 64, GUAC_COMP_OVER, &bench_layer, 1024 + j, 768);
+        }
+
+        else if (method == 1) {
+            for (j = 0; j < BENCH_BATCH_SIZE; j++)
+                guac_protocol_send_copy(socket, &bench_buffer, j * 16, 480,
+                        64, 64, GUAC_COMP_OVER, &bench_layer, 1024 + j, 768);
+        }
+
+        else {
+
+            guac_protocol_builder_init(&builder, socket);
+
+            for (j = 0; j < BENCH_BATCH_SIZE; j++) {
+                guac_protocol_builder_opcode(&builder, "copy");
+                guac_protocol_builder_int(&builder, bench_buffer.index);
+                guac_protocol_builder_int(&builder, j * 16);
+                guac_protocol_builder_int(&builder, 480);
+                guac_protocol_builder_int(&builder, 64);
+                guac_protocol_builder_int(&builder, 64);
+                guac_protocol_builder_int(&builder, GUAC_COMP_OVER);
+                guac_protocol_builder_int(&builder, bench_layer.index);
+                guac_protocol_builder_int(&builder, 1024 + j);
+                guac_protocol_builder_int(&builder, 768);
+            }
+
+            guac_protocol_builder_finish(&builder);
+
+        }
+
+        /* Flush as often as frames would typically end */
+        guac_socket_flush(socket);
+
+    }
+
+    return (bench_now() - start) / BENCH_INSTRUCTIONS * 1e9;
+
+}
+
+int main() {
+
+    /* Discard all output, still passing through the buffered socket */
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd == -1) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    guac_socket* socket = guac_socket_open(fd);
+    if (socket == NULL) {
+        fprintf(stderr, "Unable to open socket.\n");
+        return 1;
+    }
+
+    double legacy = bench_run(socket, 0);
+    double send = bench_run(socket, 1);
+    double batched = bench_run(socket, 2);
+
+    printf("%-22s %10s %10s\n", "method", "ns/instr", "speedup");
+    printf("%-22s %10.1f %10.2f\n", "separate writes", legacy, 1.0);
+    printf("%-22s %10.1f %10.2f\n", "guac_protocol_send_*", send,
+            legacy / send);
+    printf("%-22s %10.1f %10.2f\n", "batched builder", batched,
+            legacy / batched);
+
+    guac_socket_free(socket);
+    return 0;
+
+}
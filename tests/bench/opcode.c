@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark comparing opcode lookup via guac_protocol_get_opcode() with a
+ * linear search of opcode strings, as instruction handlers were previously
+ * looked up. This is not run as part of "make check", and must be built
+ * explicitly with "make bench_opcode".
+ */
+
+#include "config.h"
+
+#include <guacamole/protocol.h>
+#include <guacamole/protocol-types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of lookups performed for each workload and lookup method.
+ */
+#define BENCH_LOOKUPS (16 * 1024 * 1024)
+
+/**
+ * The number of opcodes within each generated workload. Lookups cycle
+ * through the workload repeatedly.
+ */
+#define BENCH_WORKLOAD_SIZE 4096
+
+/**
+ * The maximum length of any opcode within a workload, including null
+ * terminator.
+ */
+#define BENCH_OPCODE_LENGTH 32
+
+/**
+ * The opcodes handled by guac_user_handle_instruction(), in the order they
+ * were previously searched.
+ */
+static const char* bench_user_opcodes[] = {
+    "sync", "mouse", "key", "clipboard", "disconnect", "size", "file", "pipe",
+    "ack", "blob", "end", "get", "put", "audio", "argv", NULL
+};
+
+/**
+ * The opcodes received from a typical interactive user, weighted by how
+ * often each is received relative to the others.
+ */
+static const struct {
+    const char* opcode;
+    int weight;
+} bench_user_mix[] = {
+    { "mouse",  50 },
+    { "sync",   20 },
+    { "key",    15 },
+    { "blob",    5 },
+    { "ack",     4 },
+    { "end",     2 },
+    { "size",    2 },
+    { "nop",     2 },
+    { NULL,      0 }
+};
+
+/**
+ * The total of all values returned by each lookup, stored such that the
+ * work done cannot be optimized away.
+ */
+static volatile int bench_total = 0;
+
+/**
+ * Returns the current time in seconds, as measured by a monotonic clock.
+ */
+static double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Returns the index of the given opcode within the given NULL-terminated
+ * array of opcodes, comparing each in turn, or -1 if the opcode is not
+ * present.
+ */
+static int bench_linear_lookup(const char** opcodes, const char* opcode) {
+
+    int i;
+    for (i = 0; opcodes[i] != NULL; i++) {
+        if (strcmp(opcodes[i], opcode) == 0)
+            return i;
+    }
+
+    return -1;
+
+}
+
+/**
+ * Looks up every opcode of the given workload repeatedly using either a
+ * linear search of the given opcodes or guac_protocol_get_opcode(),
+ * returning the average time taken per lookup, in nanoseconds.
+ */
+static double bench_run(char (*workload)[BENCH_OPCODE_LENGTH],
+        const char** opcodes, int hashed) {
+
+    int total = 0;
+    int i;
+
+    double start = bench_now();
+
+    for (i = 0; i < BENCH_LOOKUPS; i++) {
+        const char* opcode = workload[i % BENCH_WORKLOAD_SIZE];
+        if (hashed)
+            total += guac_protocol_get_opcode(opcode);
+        else
+            total += bench_linear_lookup(opcodes, opcode);
+    }
+
+    double elapsed = bench_now() - start;
+    bench_total += total;
+
+    return elapsed / BENCH_LOOKUPS * 1e9;
+
+}
+
+/**
+ * Prints the time taken per lookup of the given workload for both lookup
+ * methods.
+ */
+static void bench_print(const char* name,
+        char (*workload)[BENCH_OPCODE_LENGTH], const char** opcodes) {
+
+    double linear = bench_run(workload, opcodes, 0);
+    double hashed = bench_run(workload, opcodes, 1);
+
+    printf("%-14s %12.2f %12.2f %10.2f\n", name, linear, hashed,
+            linear / hashed);
+
+}
+
+int main() {
+
+    static char workload[BENCH_WORKLOAD_SIZE][BENCH_OPCODE_LENGTH];
+    const char* all_opcodes[GUAC_PROTOCOL_OPCODE_COUNT];
+    int count = 0;
+    int weights = 0;
+    int i, j;
+
+    /* Gather every opcode defined by the protocol */
+    for (i = GUAC_PROTOCOL_OPCODE_UNKNOWN + 1; i < GUAC_PROTOCOL_OPCODE_COUNT;
+            i++)
+        all_opcodes[count++] = guac_protocol_get_opcode_name(i);
+    all_opcodes[count] = NULL;
+
+    for (i = 0; bench_user_mix[i].opcode != NULL; i++)
+        weights += bench_user_mix[i].weight;
+
+    printf("%-14s %12s %12s %10s   (nanoseconds/lookup)\n",
+            "workload", "linear", "hashed", "speedup");
+
+    /* Opcodes as received from a typical user, copied into separate buffers
+     * as the parser would provide them */
+    srand(1);
+    for (i = 0; i < BENCH_WORKLOAD_SIZE; i++) {
+
+        int choice = rand() % weights;
+        for (j = 0; choice >= bench_user_mix[j].weight; j++)
+            choice -= bench_user_mix[j].weight;
+
+        strcpy(workload[i], bench_user_mix[j].opcode);
+
+    }
+
+    bench_print("user input", workload, bench_user_opcodes);
+
+    /* Every opcode equally often, as when replaying a recording */
+    for (i = 0; i < BENCH_WORKLOAD_SIZE; i++)
+        strcpy(workload[i], all_opcodes[rand() % count]);
+
+    bench_print("all opcodes", workload, all_opcodes);
+
+    /* Opcodes which are not defined by the protocol at all */
+    for (i = 0; i < BENCH_WORKLOAD_SIZE; i++)
+        snprintf(workload[i], BENCH_OPCODE_LENGTH, "x%s",
+                all_opcodes[rand() % count]);
+
+    bench_print("unknown", workload, all_opcodes);
+
+    return 0;
+
+}
@@ -0,0 +1,222 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark comparing each set of pixel kernels supported by the current CPU
+ * across a range of rectangle sizes. This is not run as part of "make check",
+ * and must be built explicitly with "make bench_pixels".
+ */
+
+#include "config.h"
+
+#include "common/pixels.h"
+
+#include <guacamole/protocol-types.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * The approximate number of pixels processed by each kernel for each
+ * rectangle size, such that all measurements take a similar amount of time.
+ */
+#define BENCH_PIXELS (64 * 1024 * 1024)
+
+/**
+ * The number of benchmarked rectangle sizes.
+ */
+#define BENCH_SIZES 5
+
+/**
+ * The dimensions of each benchmarked rectangle.
+ */
+static const int bench_sizes[BENCH_SIZES][2] = {
+    {   16,   16 },
+    {   64,   64 },
+    {  256,  256 },
+    { 1024,  768 },
+    { 1920, 1080 }
+};
+
+/**
+ * The operations benchmarked for each kernel set.
+ */
+typedef enum bench_op {
+    BENCH_PUT_OPAQUE,
+    BENCH_PUT_BLEND,
+    BENCH_FILL_MASK,
+    BENCH_TRANSFER_SRC,
+    BENCH_TRANSFER_XOR,
+    BENCH_SCAN,
+    BENCH_OPS
+} bench_op;
+
+/**
+ * Human-readable names of each benchmarked operation, indexed by bench_op.
+ */
+static const char* bench_op_names[BENCH_OPS] = {
+    "put (opaque)",
+    "put (blend)",
+    "fill mask",
+    "transfer SRC",
+    "transfer XOR",
+    "scan"
+};
+
+/**
+ * The total number of rows changed by all benchmarked operations, stored
+ * such that the work done cannot be optimized away.
+ */
+static volatile int bench_changed = 0;
+
+/**
+ * Returns the current time in seconds, as measured by a monotonic clock.
+ */
+static double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Applies the given operation to every row of a rectangle, returning the
+ * number of rows changed.
+ */
+static int bench_rect(const guac_common_pixel_kernels* kernels, bench_op op,
+        uint32_t* dst, const uint32_t* src, int width, int height) {
+
+    int first, last;
+    int changed = 0;
+    int y;
+
+    for (y = 0; y < height; y++) {
+
+        uint32_t* dst_row = dst + y * width;
+        const uint32_t* src_row = src + y * width;
+
+        switch (op) {
+
+            case BENCH_PUT_OPAQUE:
+                changed += kernels->put_opaque(dst_row, src_row, width,
+                        &first, &last);
+                break;
+
+            case BENCH_PUT_BLEND:
+                changed += kernels->put_blend(dst_row, src_row, width,
+                        &first, &last);
+                break;
+
+            case BENCH_FILL_MASK:
+                changed += kernels->fill_mask(dst_row, src_row, width,
+                        0xFF336699 + y, &first, &last);
+                break;
+
+            case BENCH_TRANSFER_SRC:
+                changed += kernels->transfer[GUAC_TRANSFER_BINARY_SRC](
+                        dst_row, src_row, width, &first, &last);
+                break;
+
+            case BENCH_TRANSFER_XOR:
+                changed += kernels->transfer[GUAC_TRANSFER_BINARY_XOR](
+                        dst_row, src_row, width, &first, &last);
+                break;
+
+            case BENCH_SCAN:
+                changed += kernels->scan(src_row, width, &first, &last);
+                break;
+
+            default:
+                break;
+
+        }
+
+    }
+
+    return changed;
+
+}
+
+int main() {
+
+    const guac_common_pixel_kernels* kernels[GUAC_COMMON_PIXELS_MAX_KERNELS];
+    int count = guac_common_pixels_list_kernels(kernels,
+            GUAC_COMMON_PIXELS_MAX_KERNELS);
+
+    int max_pixels = 1920 * 1080;
+    uint32_t* dst = malloc(max_pixels * sizeof(uint32_t));
+    uint32_t* src[2];
+    int i, j, size, op, k;
+
+    /* Alternate between two different sources such that every pass changes
+     * the destination */
+    src[0] = malloc(max_pixels * sizeof(uint32_t));
+    src[1] = malloc(max_pixels * sizeof(uint32_t));
+    for (i = 0; i < max_pixels; i++) {
+        uint32_t value = (uint32_t) i * 2654435761u;
+        src[0][i] = value;
+        src[1][i] = ~value;
+        dst[i] = value ^ 0x00808080;
+    }
+
+    printf("%-14s %-10s", "operation", "size");
+    for (k = 0; k < count; k++)
+        printf(" %12s", kernels[k]->name);
+    printf("   (megapixels/second)\n");
+
+    for (op = 0; op < BENCH_OPS; op++) {
+        for (size = 0; size < BENCH_SIZES; size++) {
+
+            int width = bench_sizes[size][0];
+            int height = bench_sizes[size][1];
+            int passes = BENCH_PIXELS / (width * height);
+            char dimensions[32];
+
+            snprintf(dimensions, sizeof(dimensions), "%dx%d", width, height);
+            printf("%-14s %-10s", bench_op_names[op], dimensions);
+
+            for (k = 0; k < count; k++) {
+
+                int changed = 0;
+                double start = bench_now();
+
+                for (j = 0; j < passes; j++)
+                    changed += bench_rect(kernels[k], op, dst, src[j % 2],
+                            width, height);
+
+                double elapsed = bench_now() - start;
+                bench_changed += changed;
+                printf(" %12.1f", (double) passes * width * height
+                        / elapsed / 1e6);
+
+            }
+
+            printf("\n");
+
+        }
+    }
+
+    free(src[0]);
+    free(src[1]);
+    free(dst);
+    return 0;
+
+}
+
@@ -0,0 +1,267 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark measuring the wall-clock time between connecting to a running
+ * guacd and receiving "ready" for a new connection, optionally with many
+ * connections beginning at once. Comparing the results for guacd with and
+ * without zygote_protocols set for the benchmarked protocol shows the effect
+ * of zygotes on connection setup. This is not run as part of "make check",
+ * and must be built explicitly with "make bench_ready".
+ *
+ * Usage: bench_ready HOST PORT PROTOCOL [CONNECTIONS [CONCURRENCY]]
+ */
+
+#include "config.h"
+
+#include <guacamole/parser.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * The number of microseconds to wait for each instruction from guacd.
+ */
+#define BENCH_USEC_TIMEOUT 15000000
+
+/**
+ * The handshake instructions sent between receiving "args" and sending
+ * "connect", describing a client which supports no audio or video.
+ */
+#define BENCH_HANDSHAKE "4.size,4.1024,3.768,2.96;5.audio;5.video;5.image;"
+
+/**
+ * The connections made by a single benchmark thread.
+ */
+typedef struct bench_thread {
+
+    /**
+     * The address of guacd.
+     */
+    struct addrinfo* address;
+
+    /**
+     * The protocol of each connection.
+     */
+    const char* protocol;
+
+    /**
+     * The time taken by each connection, in milliseconds, or a negative value
+     * if the connection failed.
+     */
+    double* times;
+
+    /**
+     * The number of connections to make.
+     */
+    int connections;
+
+} bench_thread;
+
+/**
+ * Returns the current wall-clock time, in milliseconds.
+ */
+static double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/**
+ * Connects to guacd and performs the handshake of a new connection,
+ * returning the time taken to receive "ready".
+ *
+ * @param address
+ *     The address of guacd.
+ *
+ * @param protocol
+ *     The protocol of the new connection.
+ *
+ * @return
+ *     The time taken, in milliseconds, or -1 if the connection failed.
+ */
+static double bench_connect(struct addrinfo* address, const char* protocol) {
+
+    double start = bench_now();
+    double elapsed = -1;
+    int i;
+
+    int fd = socket(address->ai_family, address->ai_socktype,
+            address->ai_protocol);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, address->ai_addr, address->ai_addrlen)) {
+        close(fd);
+        return -1;
+    }
+
+    guac_socket* socket = guac_socket_open(fd);
+    guac_parser* parser = guac_parser_alloc();
+
+    if (guac_protocol_send_select(socket, protocol)
+            || guac_socket_flush(socket)
+            || guac_parser_expect(parser, socket, BENCH_USEC_TIMEOUT, "args"))
+        goto cleanup;
+
+    /* Leave all parameters blank */
+    const char** args = calloc(parser->argc + 1, sizeof(char*));
+    for (i = 0; i < parser->argc; i++)
+        args[i] = "";
+
+    int failed = guac_socket_write_string(socket, BENCH_HANDSHAKE)
+        || guac_protocol_send_connect(socket, args)
+        || guac_socket_flush(socket);
+
+    free(args);
+
+    if (!failed && !guac_parser_expect(parser, socket, BENCH_USEC_TIMEOUT,
+                "ready"))
+        elapsed = bench_now() - start;
+
+cleanup:
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    return elapsed;
+
+}
+
+/**
+ * Makes each of the connections of a benchmark thread in sequence.
+ *
+ * @param data
+ *     The bench_thread describing the connections to make.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* bench_run(void* data) {
+
+    bench_thread* thread = (bench_thread*) data;
+
+    int i;
+    for (i = 0; i < thread->connections; i++)
+        thread->times[i] = bench_connect(thread->address, thread->protocol);
+
+    return NULL;
+
+}
+
+/**
+ * Compares two times for qsort().
+ */
+static int bench_compare(const void* a, const void* b) {
+    double time_a = *((const double*) a);
+    double time_b = *((const double*) b);
+    return (time_a > time_b) - (time_a < time_b);
+}
+
+int main(int argc, char* argv[]) {
+
+    int i;
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s HOST PORT PROTOCOL "
+                "[CONNECTIONS [CONCURRENCY]]\n", argv[0]);
+        return 1;
+    }
+
+    int connections = argc > 4 ? atoi(argv[4]) : 50;
+    int concurrency = argc > 5 ? atoi(argv[5]) : 1;
+    if (connections <= 0 || concurrency <= 0 || concurrency > connections) {
+        fprintf(stderr, "Invalid number of connections or concurrency.\n");
+        return 1;
+    }
+
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM
+    };
+
+    struct addrinfo* address;
+    if (getaddrinfo(argv[1], argv[2], &hints, &address)) {
+        fprintf(stderr, "Unable to resolve %s:%s\n", argv[1], argv[2]);
+        return 1;
+    }
+
+    double* times = malloc(connections * sizeof(double));
+    bench_thread* threads = calloc(concurrency, sizeof(bench_thread));
+    pthread_t* thread_ids = malloc(concurrency * sizeof(pthread_t));
+
+    /* Divide connections between threads, which all begin at once */
+    int offset = 0;
+    for (i = 0; i < concurrency; i++) {
+
+        threads[i].address = address;
+        threads[i].protocol = argv[3];
+        threads[i].times = times + offset;
+        threads[i].connections = connections / concurrency
+            + (i < connections % concurrency);
+
+        offset += threads[i].connections;
+        pthread_create(&thread_ids[i], NULL, bench_run, &threads[i]);
+
+    }
+
+    for (i = 0; i < concurrency; i++)
+        pthread_join(thread_ids[i], NULL);
+
+    /* Failed connections sort first */
+    qsort(times, connections, sizeof(double), bench_compare);
+
+    int failed = 0;
+    double total = 0;
+    for (i = 0; i < connections; i++) {
+        if (times[i] < 0)
+            failed++;
+        else
+            total += times[i];
+    }
+
+    int succeeded = connections - failed;
+    double* ready = times + failed;
+
+    printf("%-12s %8s %8s %10s %10s %10s %10s\n", "protocol", "ok",
+            "failed", "min (ms)", "mean (ms)", "p95 (ms)", "max (ms)");
+
+    if (succeeded > 0)
+        printf("%-12s %8i %8i %10.2f %10.2f %10.2f %10.2f\n", argv[3],
+                succeeded, failed, ready[0], total / succeeded,
+                ready[(succeeded * 95 + 99) / 100 - 1],
+                ready[succeeded - 1]);
+    else
+        printf("%-12s %8i %8i\n", argv[3], succeeded, failed);
+
+    free(thread_ids);
+    free(threads);
+    free(times);
+    freeaddrinfo(address);
+    return failed != 0;
+
+}
+
@@ -0,0 +1,348 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Benchmark measuring the CPU time and bytes on the wire of sending typical
+ * Guacamole protocol output through an SSL guac_socket over a local TLS
+ * loopback connection. The buffered SSL socket is compared against writing
+ * each guac_socket_write() directly with SSL_write(), as SSL sockets did
+ * before they were buffered. This is not run as part of "make check", and
+ * must be built explicitly with "make bench_ssl".
+ *
+ * Usage: bench_ssl CERTIFICATE KEY [FRAMES]
+ */
+
+#include "config.h"
+
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/socket-ssl.h>
+#include <guacamole/stream.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/**
+ * The number of rectangles filled within each frame.
+ */
+#define BENCH_RECTS 64
+
+/**
+ * The number of bytes of image data sent as a blob within each frame.
+ */
+#define BENCH_BLOB_SIZE 6144
+
+/**
+ * The size of the header of each TLS record, in bytes.
+ */
+#define BENCH_RECORD_HEADER 5
+
+/**
+ * The receiving end of the loopback connection, which counts the bytes and
+ * TLS records received as well as the plaintext they contain.
+ */
+typedef struct bench_receiver {
+
+    /**
+     * The SSL context to use when connecting.
+     */
+    SSL_CTX* context;
+
+    /**
+     * The file descriptor of the receiving end of the connection.
+     */
+    int fd;
+
+    /**
+     * The number of bytes received after the handshake completed.
+     */
+    long wire_bytes;
+
+    /**
+     * The number of complete TLS records received after the handshake
+     * completed.
+     */
+    long records;
+
+    /**
+     * The number of bytes of plaintext received.
+     */
+    long plaintext_bytes;
+
+} bench_receiver;
+
+/**
+ * Returns the CPU time consumed by the calling thread, in milliseconds.
+ */
+static double bench_cpu_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/**
+ * Completes the TLS handshake on the receiving end of the connection, and
+ * then reads all data until the connection is closed, counting each TLS
+ * record by its header before decrypting it from memory.
+ *
+ * @param data
+ *     The bench_receiver describing the receiving end of the connection.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* bench_receive(void* data) {
+
+    bench_receiver* receiver = (bench_receiver*) data;
+
+    unsigned char buffer[65536];
+    unsigned char header[BENCH_RECORD_HEADER];
+    int header_length = 0;
+    long record_remaining = 0;
+
+    SSL* ssl = SSL_new(receiver->context);
+    SSL_set_fd(ssl, receiver->fd);
+    if (SSL_connect(ssl) <= 0) {
+        fprintf(stderr, "TLS handshake failed.\n");
+        SSL_free(ssl);
+        return NULL;
+    }
+
+    /* Read all further data via memory, such that it can be counted */
+    BIO* input = BIO_new(BIO_s_mem());
+    SSL_set0_rbio(ssl, input);
+
+    int length;
+    while ((length = read(receiver->fd, buffer, sizeof(buffer))) > 0) {
+
+        receiver->wire_bytes += length;
+
+        /* Count records by walking their headers */
+        int i;
+        for (i = 0; i < length; i++) {
+
+            if (record_remaining > 0) {
+                long skip = length - i;
+                if (skip > record_remaining)
+                    skip = record_remaining;
+                record_remaining -= skip;
+                i += skip - 1;
+                continue;
+            }
+
+            header[header_length++] = buffer[i];
+            if (header_length == BENCH_RECORD_HEADER) {
+                record_remaining = (header[3] << 8) | header[4];
+                header_length = 0;
+                receiver->records++;
+            }
+
+        }
+
+        /* Decrypt everything received so far */
+        BIO_write(input, buffer, length);
+        while ((length = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+            receiver->plaintext_bytes += length;
+
+    }
+
+    SSL_free(ssl);
+    return NULL;
+
+}
+
+/**
+ * Writes the given data directly to the SSL connection of the given socket,
+ * exactly as all SSL sockets did before their output was buffered.
+ */
+static ssize_t bench_unbuffered_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+
+    return SSL_write(data->ssl, buf, count);
+
+}
+
+/**
+ * Sends the given number of frames of typical Guacamole protocol output over
+ * a new TLS loopback connection, printing the measurements taken.
+ *
+ * @param server_context
+ *     The SSL context to use for the sending end of the connection.
+ *
+ * @param client_context
+ *     The SSL context to use for the receiving end of the connection.
+ *
+ * @param frames
+ *     The number of frames to send.
+ *
+ * @param buffered
+ *     Non-zero if the SSL socket should be used as-is, zero if each write
+ *     should be sent immediately with its own SSL_write().
+ *
+ * @return
+ *     Zero if the benchmark completed, non-zero otherwise.
+ */
+static int bench_run(SSL_CTX* server_context, SSL_CTX* client_context,
+        int frames, int buffered) {
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    socklen_t address_length = sizeof(address);
+
+    /* Establish loopback connection on an arbitrary port */
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0
+            || bind(listen_fd, (struct sockaddr*) &address, sizeof(address))
+            || listen(listen_fd, 1)
+            || getsockname(listen_fd, (struct sockaddr*) &address,
+                &address_length)) {
+        perror("Unable to listen on loopback");
+        return 1;
+    }
+
+    bench_receiver receiver = {
+        .context = client_context,
+        .fd = socket(AF_INET, SOCK_STREAM, 0)
+    };
+
+    if (connect(receiver.fd, (struct sockaddr*) &address, sizeof(address))) {
+        perror("Unable to connect to loopback");
+        return 1;
+    }
+
+    int fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+
+    pthread_t receiver_thread;
+    pthread_create(&receiver_thread, NULL, bench_receive, &receiver);
+
+    guac_socket* socket = guac_socket_open_secure(server_context, fd);
+    if (socket == NULL) {
+        fprintf(stderr, "TLS handshake failed.\n");
+        return 1;
+    }
+
+    if (!buffered) {
+        socket->write_handler  = bench_unbuffered_write_handler;
+        socket->flush_handler  = NULL;
+        socket->lock_handler   = NULL;
+        socket->unlock_handler = NULL;
+    }
+
+    char blob[BENCH_BLOB_SIZE];
+    memset(blob, 0x5A, sizeof(blob));
+
+    guac_layer layer = { .index = 1 };
+    guac_stream stream = { .index = 3 };
+
+    double start = bench_cpu_now();
+
+    int frame, i;
+    for (frame = 0; frame < frames; frame++) {
+
+        /* Many small drawing operations */
+        for (i = 0; i < BENCH_RECTS; i++) {
+            guac_protocol_send_rect(socket, &layer, (i % 16) * 64,
+                    (i / 16) * 64, 64, 64);
+            guac_protocol_send_cfill(socket, GUAC_COMP_OVER, &layer,
+                    i * 3, frame & 0xFF, 0x80, 0xFF);
+        }
+
+        /* One image update */
+        guac_protocol_send_img(socket, &stream, GUAC_COMP_OVER, &layer,
+                "image/png", 0, 0);
+        guac_protocol_send_blob(socket, &stream, blob, sizeof(blob));
+        guac_protocol_send_end(socket, &stream);
+
+        guac_protocol_send_sync(socket, frame);
+        guac_socket_flush(socket);
+
+    }
+
+    double elapsed = bench_cpu_now() - start;
+
+    /* Close without close_notify, such that only the frames are counted */
+    SSL_set_quiet_shutdown(((guac_socket_ssl_data*) socket->data)->ssl, 1);
+    guac_socket_free(socket);
+
+    pthread_join(receiver_thread, NULL);
+    close(receiver.fd);
+
+    printf("%-12s %12li %12li %10li %9.1f%% %10.2f %12.1f\n",
+            buffered ? "buffered" : "unbuffered",
+            receiver.plaintext_bytes, receiver.wire_bytes, receiver.records,
+            100.0 * (receiver.wire_bytes - receiver.plaintext_bytes)
+                / receiver.plaintext_bytes,
+            elapsed, receiver.plaintext_bytes / elapsed / 1e3);
+
+    return 0;
+
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s CERTIFICATE KEY [FRAMES]\n", argv[0]);
+        return 1;
+    }
+
+    int frames = argc > 3 ? atoi(argv[3]) : 2000;
+    if (frames <= 0) {
+        fprintf(stderr, "Invalid number of frames.\n");
+        return 1;
+    }
+
+    SSL_library_init();
+    SSL_load_error_strings();
+
+    SSL_CTX* server_context = SSL_CTX_new(SSLv23_server_method());
+    SSL_CTX* client_context = SSL_CTX_new(SSLv23_client_method());
+
+    if (!SSL_CTX_use_certificate_chain_file(server_context, argv[1])
+            || !SSL_CTX_use_PrivateKey_file(server_context, argv[2],
+                SSL_FILETYPE_PEM)) {
+        fprintf(stderr, "Unable to load certificate or key.\n");
+        return 1;
+    }
+
+    printf("%-12s %12s %12s %10s %10s %10s %12s\n", "mode", "plaintext",
+            "wire bytes", "records", "overhead", "cpu (ms)", "MB/cpu-s");
+
+    int failed = bench_run(server_context, client_context, frames, 0)
+              || bench_run(server_context, client_context, frames, 1);
+
+    SSL_CTX_free(client_context);
+    SSL_CTX_free(server_context);
+    return failed;
+
+}
+
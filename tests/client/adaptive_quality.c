@@ -0,0 +1,222 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+/**
+ * The width and height of the test image, in pixels.
+ */
+#define TEST_IMAGE_SIZE 64
+
+/**
+ * The maximum number of bytes of output expected for any one user.
+ */
+#define TEST_OUTPUT_SIZE 65536
+
+/**
+ * A user joined to the test client, along with the file descriptor from
+ * which data sent to that user can be read.
+ */
+typedef struct test_user {
+
+    /**
+     * The joined user.
+     */
+    guac_user* user;
+
+    /**
+     * The file descriptor from which data sent to the user can be read.
+     */
+    int fd;
+
+    /**
+     * All data read from fd once the user has left.
+     */
+    char output[TEST_OUTPUT_SIZE];
+
+    /**
+     * The number of bytes within output.
+     */
+    int length;
+
+} test_user;
+
+/**
+ * Joins a new user having the given processing lag to the given client.
+ */
+static void test_join_user(guac_client* client, test_user* joined, int lag) {
+
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    joined->fd = fd[0];
+    joined->user = guac_user_alloc();
+    joined->user->socket = guac_socket_open(fd[1]);
+    joined->user->client = client;
+
+    CU_ASSERT_EQUAL(guac_client_add_user(client, joined->user, 0, NULL), 0);
+    joined->user->processing_lag = lag;
+
+}
+
+/**
+ * Removes the given user from the given client, reading everything that was
+ * sent to that user.
+ */
+static void test_leave_user(guac_client* client, test_user* joined) {
+
+    int result;
+
+    guac_client_remove_user(client, joined->user);
+    guac_socket_free(joined->user->socket);
+    guac_user_free(joined->user);
+
+    /* Read all data sent */
+    joined->length = 0;
+    while ((result = read(joined->fd, joined->output + joined->length,
+                    sizeof(joined->output) - joined->length)) > 0)
+        joined->length += result;
+
+    close(joined->fd);
+
+}
+
+/**
+ * Returns a new noisy image, such that quality affects the encoded result.
+ */
+static cairo_surface_t* test_noisy_surface() {
+
+    unsigned char* data;
+    int stride;
+    int i;
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            TEST_IMAGE_SIZE, TEST_IMAGE_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    data = cairo_image_surface_get_data(surface);
+    stride = cairo_image_surface_get_stride(surface);
+
+    unsigned int seed = 1;
+    for (i = 0; i < stride * TEST_IMAGE_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (seed >> 16) & 0xFF;
+    }
+
+    cairo_surface_mark_dirty(surface);
+    return surface;
+
+}
+
+void test_adaptive_quality() {
+
+    static test_user fast_a;
+    static test_user fast_b;
+    static test_user slow;
+    static test_user recorded;
+
+    static char recording[TEST_OUTPUT_SIZE];
+    int recording_length = 0;
+    int result;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* Two users with no lag, and one with considerable lag */
+    test_join_user(client, &fast_a, 0);
+    test_join_user(client, &fast_b, 5);
+    test_join_user(client, &slow, 200);
+
+    cairo_surface_t* surface = test_noisy_surface();
+
+    /* Stream to all users, choosing quality per user */
+    guac_client_stream_jpeg(client, client->socket, GUAC_COMP_OVER,
+            GUAC_DEFAULT_LAYER, 0, 0, surface, GUAC_CLIENT_ADAPTIVE_QUALITY);
+    guac_socket_flush(client->socket);
+
+    cairo_surface_destroy(surface);
+
+    test_leave_user(client, &fast_a);
+    test_leave_user(client, &fast_b);
+    test_leave_user(client, &slow);
+
+    guac_client_free(client);
+
+    /* Every user must have received an image */
+    CU_ASSERT(fast_a.length > 0);
+    CU_ASSERT(slow.length > 0);
+
+    /* Users within the same tier must receive identical data */
+    CU_ASSERT_EQUAL_FATAL(fast_a.length, fast_b.length);
+    CU_ASSERT_EQUAL(memcmp(fast_a.output, fast_b.output, fast_a.length), 0);
+
+    /* The lagging user must receive a smaller, lower-quality image */
+    CU_ASSERT(slow.length < fast_a.length);
+
+    client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* Record all output as a session recording would */
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+    client->socket = guac_socket_tee(client->socket, guac_socket_open(fd[1]));
+
+    test_join_user(client, &fast_a, 0);
+    test_join_user(client, &recorded, 200);
+
+    surface = test_noisy_surface();
+
+    guac_client_stream_jpeg(client, client->socket, GUAC_COMP_OVER,
+            GUAC_DEFAULT_LAYER, 0, 0, surface, GUAC_CLIENT_ADAPTIVE_QUALITY);
+    guac_socket_flush(client->socket);
+
+    cairo_surface_destroy(surface);
+
+    test_leave_user(client, &fast_a);
+    test_leave_user(client, &recorded);
+
+    guac_client_free(client);
+
+    while ((result = read(fd[0], recording + recording_length,
+                    sizeof(recording) - recording_length)) > 0)
+        recording_length += result;
+
+    close(fd[0]);
+
+    /* The recording must contain exactly the image sent to all users */
+    CU_ASSERT(recording_length > 0);
+    CU_ASSERT_EQUAL_FATAL(fast_a.length, recording_length);
+    CU_ASSERT_EQUAL_FATAL(recorded.length, recording_length);
+    CU_ASSERT_EQUAL(memcmp(fast_a.output, recording, recording_length), 0);
+    CU_ASSERT_EQUAL(memcmp(recorded.output, recording, recording_length), 0);
+
+}
+
@@ -43,8 +43,12 @@ int register_client_suite() {
 
     /* Add tests */
     if (
-        CU_add_test(suite, "layer-pool", test_layer_pool) == NULL
+        CU_add_test(suite, "adaptive-quality", test_adaptive_quality) == NULL
+     || CU_add_test(suite, "layer-pool", test_layer_pool) == NULL
      || CU_add_test(suite, "buffer-pool", test_buffer_pool) == NULL
+     || CU_add_test(suite, "protocol-stats", test_protocol_stats) == NULL
+     || CU_add_test(suite, "slow-user", test_slow_user) == NULL
+     || CU_add_test(suite, "png-encode", test_png_encode) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
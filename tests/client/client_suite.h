@@ -25,8 +25,12 @@
 
 int register_client_suite();
 
+void test_adaptive_quality();
 void test_layer_pool();
+void test_protocol_stats();
 void test_buffer_pool();
+void test_slow_user();
+void test_png_encode();
 
 #endif
 
@@ -0,0 +1,287 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+#include "common/fixture.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/parser.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * A buffer of data which grows as data is appended, and from which data may
+ * be read back in order.
+ */
+typedef struct test_buffer {
+
+    /**
+     * The buffered data.
+     */
+    char* data;
+
+    /**
+     * The number of bytes of buffered data.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for data.
+     */
+    size_t size;
+
+    /**
+     * The offset of the next byte to be read.
+     */
+    size_t offset;
+
+} test_buffer;
+
+/**
+ * Appends the given data to the given buffer.
+ */
+static void test_buffer_append(test_buffer* buffer, const void* data,
+        size_t length) {
+
+    while (buffer->length + length > buffer->size) {
+        buffer->size = buffer->size ? buffer->size * 2 : 65536;
+        buffer->data = realloc(buffer->data, buffer->size);
+    }
+
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+
+}
+
+/**
+ * Cairo read function which reads data from the test_buffer given as the
+ * closure.
+ */
+static cairo_status_t test_buffer_read(void* closure, unsigned char* data,
+        unsigned int length) {
+
+    test_buffer* buffer = (test_buffer*) closure;
+
+    if (buffer->offset + length > buffer->length)
+        return CAIRO_STATUS_READ_ERROR;
+
+    memcpy(data, buffer->data + buffer->offset, length);
+    buffer->offset += length;
+    return CAIRO_STATUS_SUCCESS;
+
+}
+
+/**
+ * Handler which decodes the image data sent within the given instruction,
+ * if that instruction is a blob, appending the decoded data to the
+ * test_buffer given as the handler data.
+ */
+static void test_extract_blob(guac_parser* parser, void* data) {
+
+    test_buffer* image = (test_buffer*) data;
+
+    if (strcmp(parser->opcode, "blob") != 0 || parser->argc != 2)
+        return;
+
+    int length = guac_protocol_decode_base64(parser->argv[1]);
+    test_buffer_append(image, parser->argv[1], length);
+
+}
+
+/**
+ * Sends the given surface as PNG using the given client, verifying that the
+ * image decoded from the resulting blobs is identical to the surface. Colors
+ * of translucent pixels may differ by one due to rounding of premultiplied
+ * alpha.
+ */
+static void test_png_roundtrip(guac_client* client, cairo_surface_t* surface) {
+
+    test_capture output;
+    test_buffer image = { 0 };
+    int x, y;
+
+    test_capture_init(&output);
+    guac_client_stream_png(client, output.socket, GUAC_COMP_OVER,
+            GUAC_DEFAULT_LAYER, 0, 0, surface);
+
+    CU_ASSERT(test_capture_parse(&output, test_extract_blob, &image) > 0);
+    CU_ASSERT_FATAL(image.length > 0);
+    test_capture_free(&output);
+
+    cairo_surface_t* decoded = cairo_image_surface_create_from_png_stream(
+            test_buffer_read, &image);
+    CU_ASSERT_EQUAL_FATAL(cairo_surface_status(decoded),
+            CAIRO_STATUS_SUCCESS);
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    CU_ASSERT_EQUAL_FATAL(cairo_image_surface_get_width(decoded), width);
+    CU_ASSERT_EQUAL_FATAL(cairo_image_surface_get_height(decoded), height);
+
+    int opaque = cairo_image_surface_get_format(surface) == CAIRO_FORMAT_RGB24;
+    int mismatched = 0;
+
+    for (y = 0; y < height; y++) {
+
+        const uint32_t* expected = (uint32_t*) (cairo_image_surface_get_data(
+                    surface) + y * cairo_image_surface_get_stride(surface));
+
+        const uint32_t* actual = (uint32_t*) (cairo_image_surface_get_data(
+                    decoded) + y * cairo_image_surface_get_stride(decoded));
+
+        for (x = 0; x < width; x++) {
+
+            uint32_t a = actual[x] | (opaque ? 0xFF000000 : 0);
+            uint32_t e = expected[x] | (opaque ? 0xFF000000 : 0);
+            int shift;
+
+            if ((a >> 24) != (e >> 24)) {
+                mismatched++;
+                continue;
+            }
+
+            for (shift = 0; shift < 24; shift += 8) {
+                int difference = (int) ((a >> shift) & 0xFF)
+                               - (int) ((e >> shift) & 0xFF);
+                if (difference > 1 || difference < -1
+                        || (opaque && difference != 0)) {
+                    mismatched++;
+                    break;
+                }
+            }
+
+        }
+
+    }
+
+    CU_ASSERT_EQUAL(mismatched, 0);
+
+    cairo_surface_destroy(decoded);
+    free(image.data);
+
+}
+
+/**
+ * Creates a new surface of the given format and size, with each pixel set
+ * to a pseudo-random color chosen from the given number of colors. If the
+ * format has an alpha channel, each color has a pseudo-random alpha.
+ */
+static cairo_surface_t* test_create_surface(cairo_format_t format,
+        int width, int height, int colors) {
+
+    int x, y;
+
+    cairo_surface_t* surface = cairo_image_surface_create(format,
+            width, height);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+
+    unsigned int seed = width * 31 + height;
+    for (y = 0; y < height; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+
+        for (x = 0; x < width; x++) {
+
+            seed = seed * 1103515245 + 12345;
+            uint32_t color = ((seed >> 8) % colors) * 0x10307;
+
+            /* Premultiply by a random alpha, including fully transparent
+             * and fully opaque pixels */
+            if (format == CAIRO_FORMAT_ARGB32) {
+                unsigned int alpha = (seed >> 20) & 0xFF;
+                if (alpha < 32) alpha = 0;
+                else if (alpha > 224) alpha = 255;
+                color = (alpha << 24)
+                      | ((((color >> 16) & 0xFF) * alpha / 255) << 16)
+                      | ((((color >>  8) & 0xFF) * alpha / 255) <<  8)
+                      |  (((color      ) & 0xFF) * alpha / 255);
+            }
+
+            /* Keep runs of identical pixels, as in typical screen content */
+            if (x > 0 && (seed >> 28) < 8)
+                color = row[x - 1];
+
+            row[x] = color;
+
+        }
+
+    }
+
+    cairo_surface_mark_dirty(surface);
+    return surface;
+
+}
+
+/**
+ * Encodes and decodes images of varying format, size and number of colors,
+ * such that each path of the PNG encoder is exercised, and such that state
+ * reused between images is reused across differing images.
+ */
+void test_png_encode() {
+
+    static const int sizes[][2] = {
+        {   1,   1 },
+        {  64,  64 },
+        { 257,  13 },
+        {   7, 300 },
+        { 600, 600 },
+        {  64,  64 }
+    };
+
+    static const int colors[] = { 1, 2, 16, 200, 256, 257, 100000 };
+
+    unsigned int size, i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    for (size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+        for (i = 0; i < sizeof(colors) / sizeof(colors[0]); i++) {
+
+            cairo_surface_t* surface;
+
+            /* Opaque images use a palette where possible */
+            surface = test_create_surface(CAIRO_FORMAT_RGB24,
+                    sizes[size][0], sizes[size][1], colors[i]);
+            test_png_roundtrip(client, surface);
+            cairo_surface_destroy(surface);
+
+            surface = test_create_surface(CAIRO_FORMAT_ARGB32,
+                    sizes[size][0], sizes[size][1], colors[i]);
+            test_png_roundtrip(client, surface);
+            cairo_surface_destroy(surface);
+
+        }
+    }
+
+    guac_client_free(client);
+
+}
+
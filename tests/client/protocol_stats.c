@@ -0,0 +1,166 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/parser.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stats.h>
+#include <guacamole/stream.h>
+
+/**
+ * The total number of bytes written to the counting socket.
+ */
+static uint64_t test_bytes_written;
+
+/**
+ * The number of "sync" instructions reported to test_stats_handler(), or -1
+ * if the handler has not been invoked.
+ */
+static int64_t test_reported_syncs = -1;
+
+/**
+ * Write handler which discards all written data, counting the number of
+ * bytes written within test_bytes_written.
+ */
+static ssize_t test_count_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+    test_bytes_written += count;
+    return count;
+}
+
+/**
+ * Statistics handler which records the number of "sync" instructions sent
+ * within test_reported_syncs.
+ */
+static void test_stats_handler(guac_client* client, const guac_stats* stats) {
+    test_reported_syncs =
+        stats->sent[GUAC_PROTOCOL_OPCODE_SYNC].instructions;
+}
+
+void test_protocol_stats() {
+
+    guac_protocol_builder builder;
+    guac_stream stream = { .index = 0 };
+    int fd[2];
+
+    /* Statistics are collected only once enabled */
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NULL(client->stats);
+    CU_ASSERT_EQUAL(guac_stats_start(client->stats), 0);
+
+    CU_ASSERT_EQUAL_FATAL(guac_client_enable_stats(client, GUAC_LOG_DEBUG), 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client->stats);
+    CU_ASSERT_PTR_EQUAL(client->socket->stats, client->stats);
+    client->stats_handler = test_stats_handler;
+
+    guac_stats* stats = client->stats;
+
+    /* Count instructions sent through a socket sharing those statistics */
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = test_count_write_handler;
+    socket->stats = stats;
+
+    guac_protocol_send_sync(socket, 12345);  /* 4.sync,5.12345; */
+    guac_protocol_send_blob(socket, &stream, "abc", 3); /* 4.blob,1.0,4.YWJj; */
+
+    guac_protocol_builder_init(&builder, socket);
+    guac_protocol_builder_opcode(&builder, "nop"); /* 3.nop; */
+    guac_protocol_builder_opcode(&builder, "sync"); /* 4.sync,1.1; */
+    guac_protocol_builder_int(&builder, 1);
+    CU_ASSERT_EQUAL(guac_protocol_builder_finish(&builder), 0);
+
+    guac_socket_free(socket);
+
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_SYNC].instructions, 2);
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_SYNC].bytes, 15 + 11);
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_BLOB].instructions, 1);
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_BLOB].bytes, 18);
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_NOP].instructions, 1);
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_NOP].bytes, 6);
+    CU_ASSERT_EQUAL(test_bytes_written, 15 + 11 + 18 + 6);
+
+    /* Instructions wrapped for a session recording are still counted */
+    guac_socket* recording = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(recording);
+    recording->write_handler = test_count_write_handler;
+
+    client->socket = guac_socket_tee(client->socket, recording);
+    CU_ASSERT_PTR_EQUAL(client->socket->stats, stats);
+
+    guac_protocol_send_nop(client->socket); /* 3.nop; */
+    guac_socket_flush(client->socket);
+
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_NOP].instructions, 2);
+    CU_ASSERT_EQUAL(stats->sent[GUAC_PROTOCOL_OPCODE_NOP].bytes, 12);
+    CU_ASSERT_EQUAL(test_bytes_written, 15 + 11 + 18 + 6 + 6);
+
+    /* Received instructions are measured exactly as read, including any
+     * multibyte characters */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+    CU_ASSERT_EQUAL_FATAL(write(fd[1], "3.nop;3.xyz,5.h\xC3\xA9llo;", 21), 21);
+    close(fd[1]);
+
+    guac_socket* input = guac_socket_open(fd[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(input);
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, input, 1000000), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "nop");
+    CU_ASSERT_EQUAL(parser->__instruction_length, 6);
+
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, input, 1000000), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "xyz");
+    CU_ASSERT_EQUAL(parser->__instruction_length, 15);
+
+    guac_parser_free(parser);
+    guac_socket_free(input);
+
+    /* Durations are grouped by powers of two */
+    guac_stats_record(&(stats->sync), 0);
+    guac_stats_record(&(stats->sync), 1);
+    guac_stats_record(&(stats->sync), 3);
+    guac_stats_record(&(stats->sync), 1000);
+
+    CU_ASSERT_EQUAL(stats->sync.count, 4);
+    CU_ASSERT_EQUAL(stats->sync.total, 1004);
+    CU_ASSERT_EQUAL(guac_stats_percentile(&(stats->sync), 0.25), 0);
+    CU_ASSERT_EQUAL(guac_stats_percentile(&(stats->sync), 0.50), 2);
+    CU_ASSERT_EQUAL(guac_stats_percentile(&(stats->sync), 0.75), 4);
+    CU_ASSERT_EQUAL(guac_stats_percentile(&(stats->sync), 1.0), 1024);
+
+    /* Statistics must be reported when the client is freed */
+    guac_client_free(client);
+    CU_ASSERT_EQUAL(test_reported_syncs, 2);
+
+}
+
@@ -0,0 +1,314 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/parser.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/user.h>
+
+/**
+ * The number of frames to broadcast to all users.
+ */
+#define TEST_FRAMES 64
+
+/**
+ * The number of blob instructions to send within each frame.
+ */
+#define TEST_BLOBS_PER_FRAME 32
+
+/**
+ * The number of bytes of data within each blob instruction. Each frame is
+ * thus roughly 175 KB once base64-encoded, and all frames together exceed
+ * GUAC_USER_MAX_QUEUED_OUTPUT.
+ */
+#define TEST_BLOB_SIZE 4096
+
+/**
+ * The number of microseconds between the start of each frame.
+ */
+#define TEST_FRAME_INTERVAL 10000
+
+/**
+ * The number of milliseconds by which the mean latency of frames received by
+ * a user may exceed twice the mean latency observed while no other user is
+ * stalled.
+ */
+#define TEST_LATENCY_TOLERANCE 50
+
+/**
+ * The maximum number of milliseconds that removing a stalled user from a
+ * connection may take.
+ */
+#define TEST_MAX_LEAVE_DURATION 1000
+
+/**
+ * Measurements of the frames received by a single user.
+ */
+typedef struct test_frame_stats {
+
+    /**
+     * The file descriptor from which the user's data is read.
+     */
+    int fd;
+
+    /**
+     * The number of frames received.
+     */
+    int frames;
+
+    /**
+     * The sum of the latencies of all received frames, in milliseconds. The
+     * latency of a frame is the time between the end of that frame being
+     * sent with guac_client_end_frame() and its "sync" instruction being
+     * received.
+     */
+    guac_timestamp total_latency;
+
+    /**
+     * The latency of the slowest frame received, in milliseconds.
+     */
+    guac_timestamp max_latency;
+
+    /**
+     * The time that the first frame was received.
+     */
+    guac_timestamp first_frame;
+
+    /**
+     * The time that the last frame was received.
+     */
+    guac_timestamp last_frame;
+
+} test_frame_stats;
+
+/**
+ * Reads instructions from a file descriptor until the end of the stream is
+ * reached, measuring the latency of each received frame using the timestamp
+ * of its "sync" instruction.
+ *
+ * @param data
+ *     The test_frame_stats containing the file descriptor to read, which
+ *     will be updated with measurements of all frames received.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* test_read_frames(void* data) {
+
+    test_frame_stats* stats = (test_frame_stats*) data;
+
+    guac_socket* socket = guac_socket_open(stats->fd);
+    guac_parser* parser = guac_parser_alloc();
+
+    while (guac_parser_read(parser, socket, 10000000) == 0) {
+
+        if (strcmp(parser->opcode, "sync") != 0 || parser->argc < 1)
+            continue;
+
+        guac_timestamp now = guac_timestamp_current();
+        guac_timestamp latency = now - atoll(parser->argv[0]);
+
+        if (stats->frames == 0)
+            stats->first_frame = now;
+
+        stats->last_frame = now;
+        stats->total_latency += latency;
+        if (latency > stats->max_latency)
+            stats->max_latency = latency;
+
+        stats->frames++;
+
+    }
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+
+    return NULL;
+
+}
+
+/**
+ * Allocates a new user which writes to the given file descriptor, adding
+ * that user to the given client.
+ *
+ * @param client
+ *     The client that the new user should join.
+ *
+ * @param fd
+ *     The file descriptor to which data sent to the new user should be
+ *     written.
+ *
+ * @return
+ *     The newly-allocated user.
+ */
+static guac_user* test_join_user(guac_client* client, int fd) {
+
+    guac_user* user = guac_user_alloc();
+    user->socket = guac_socket_open(fd);
+    user->client = client;
+
+    CU_ASSERT_EQUAL(guac_client_add_user(client, user, 0, NULL), 0);
+    return user;
+
+}
+
+/**
+ * Removes the given user from the given client, freeing the user and closing
+ * the user's socket.
+ *
+ * @param client
+ *     The client that the user should leave.
+ *
+ * @param user
+ *     The user to remove and free.
+ */
+static void test_leave_user(guac_client* client, guac_user* user) {
+    guac_client_remove_user(client, user);
+    guac_socket_free(user->socket);
+    guac_user_free(user);
+}
+
+/**
+ * Broadcasts TEST_FRAMES frames at a steady rate to a user which reads
+ * everything, measuring the frames received by that user. If requested, a
+ * second user which never reads anything is joined to the same connection
+ * for the duration of the test, and is verified to be disconnected without
+ * affecting the first user.
+ *
+ * @param stats
+ *     The test_frame_stats to populate with measurements of the frames
+ *     received by the user which reads everything.
+ *
+ * @param stalled
+ *     Non-zero if a user which never reads anything should also be joined,
+ *     zero otherwise.
+ */
+static void test_broadcast_frames(test_frame_stats* stats, int stalled) {
+
+    int fast_fd[2];
+    int slow_fd[2];
+    int i, j;
+
+    char blob[TEST_BLOB_SIZE] = { 0 };
+    pthread_t reader;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* Join one user which reads everything */
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fast_fd), 0);
+    guac_user* fast_user = test_join_user(client, fast_fd[1]);
+
+    /* Optionally join one user which reads nothing */
+    guac_user* slow_user = NULL;
+    if (stalled) {
+        CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, slow_fd), 0);
+        slow_user = test_join_user(client, slow_fd[1]);
+    }
+
+    memset(stats, 0, sizeof(test_frame_stats));
+    stats->fd = fast_fd[0];
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&reader, NULL, test_read_frames,
+                stats), 0);
+
+    guac_stream* stream = guac_client_alloc_stream(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stream);
+
+    /* Broadcast far more data than a stalled user can hold */
+    for (i = 0; i < TEST_FRAMES; i++) {
+
+        for (j = 0; j < TEST_BLOBS_PER_FRAME; j++)
+            guac_protocol_send_blob(client->socket, stream, blob,
+                    sizeof(blob));
+
+        guac_client_end_frame(client);
+        guac_socket_flush(client->socket);
+
+        usleep(TEST_FRAME_INTERVAL);
+
+    }
+
+    guac_client_free_stream(client, stream);
+
+    /* Only the stalled user should have been stopped */
+    CU_ASSERT_TRUE(fast_user->active);
+
+    if (slow_user != NULL) {
+
+        CU_ASSERT_FALSE(slow_user->active);
+
+        /* Removing the stalled user must not wait for it to read anything */
+        guac_timestamp leave_start = guac_timestamp_current();
+        test_leave_user(client, slow_user);
+        CU_ASSERT(guac_timestamp_current() - leave_start
+                < TEST_MAX_LEAVE_DURATION);
+
+        close(slow_fd[0]);
+
+    }
+
+    test_leave_user(client, fast_user);
+    pthread_join(reader, NULL);
+
+    guac_client_free(client);
+
+}
+
+void test_slow_user() {
+
+    test_frame_stats normal;
+    test_frame_stats stalled;
+
+    /* The stalled user is disconnected by shutting down its socket */
+    signal(SIGPIPE, SIG_IGN);
+
+    test_broadcast_frames(&normal, 0);
+    test_broadcast_frames(&stalled, 1);
+
+    /* Every frame must have reached the other user in both cases */
+    CU_ASSERT_EQUAL(normal.frames, TEST_FRAMES);
+    CU_ASSERT_EQUAL_FATAL(stalled.frames, TEST_FRAMES);
+
+    /* Frames must not be delayed by the stalled user */
+    guac_timestamp normal_latency = normal.total_latency / TEST_FRAMES;
+    guac_timestamp stalled_latency = stalled.total_latency / TEST_FRAMES;
+    CU_ASSERT(stalled_latency <= normal_latency * 2 + TEST_LATENCY_TOLERANCE);
+
+    /* Nor may the rate that frames are received be reduced */
+    guac_timestamp normal_duration = normal.last_frame - normal.first_frame;
+    guac_timestamp stalled_duration = stalled.last_frame - stalled.first_frame;
+    CU_ASSERT(stalled_duration <= normal_duration * 2
+            + TEST_LATENCY_TOLERANCE);
+
+}
+
@@ -46,6 +46,15 @@ int register_common_suite() {
         CU_add_test(suite, "guac-iconv", test_guac_iconv)  == NULL
      || CU_add_test(suite, "guac-string", test_guac_string) == NULL
      || CU_add_test(suite, "guac-rect", test_guac_rect) == NULL
+     || CU_add_test(suite, "guac-surface-flush", test_guac_surface_flush) == NULL
+     || CU_add_test(suite, "guac-surface-damage", test_guac_surface_damage) == NULL
+     || CU_add_test(suite, "guac-surface-motion", test_guac_surface_motion) == NULL
+     || CU_add_test(suite, "guac-surface-refresh", test_guac_surface_refresh) == NULL
+     || CU_add_test(suite, "guac-surface-fill", test_guac_surface_fill) == NULL
+     || CU_add_test(suite, "guac-display-snapshot", test_guac_display_snapshot) == NULL
+     || CU_add_test(suite, "guac-pipeline", test_guac_pipeline) == NULL
+     || CU_add_test(suite, "guac-image-cache", test_guac_image_cache) == NULL
+     || CU_add_test(suite, "guac-pixels", test_guac_pixels) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
@@ -51,5 +51,51 @@ void test_guac_iconv();
  */
 void test_guac_rect();
 
+/**
+ * Unit test for parallel encoding of flushed surface updates.
+ */
+void test_guac_surface_flush();
+
+/**
+ * Unit test for tracking and flushing of surface damage.
+ */
+void test_guac_surface_damage();
+
+/**
+ * Unit test for ordering of pipelined output.
+ */
+void test_guac_pipeline();
+
+/**
+ * Unit test for the hash and lookup behavior of guac_common_image_cache.
+ */
+void test_guac_image_cache();
+
+/**
+ * Unit test which verifies that all pixel kernels supported by the current
+ * CPU produce results bit-identical to the scalar kernels.
+ */
+void test_guac_pixels();
+
+/**
+ * Unit test for detection of scrolled surface contents.
+ */
+void test_guac_surface_motion();
+
+/**
+ * Unit test for lossless refresh of static content sent with a lossy format.
+ */
+void test_guac_surface_refresh();
+
+/**
+ * Unit test for detection of uniform regions within flushed updates.
+ */
+void test_guac_surface_fill();
+
+/**
+ * Unit test for the shared snapshot of a display sent to joining users.
+ */
+void test_guac_display_snapshot();
+
 #endif
 
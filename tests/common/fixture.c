@@ -0,0 +1,286 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+/**
+ * The number of bytes initially allocated for captured data.
+ */
+#define TEST_CAPTURE_INITIAL_SIZE 65536
+
+/**
+ * The criteria of a search for instructions within captured data, along with
+ * the results of that search.
+ */
+typedef struct test_capture_search {
+
+    /**
+     * The opcode of matching instructions.
+     */
+    const char* opcode;
+
+    /**
+     * The number of leading arguments which must match.
+     */
+    int argc;
+
+    /**
+     * The values of the leading arguments of matching instructions, where
+     * "*" matches any value.
+     */
+    const char* argv[GUAC_INSTRUCTION_MAX_ELEMENTS];
+
+    /**
+     * The number of instructions searched thus far.
+     */
+    int position;
+
+    /**
+     * The number of matching instructions found thus far.
+     */
+    int count;
+
+    /**
+     * The position of the first matching instruction, or -1 if no matching
+     * instruction has yet been found.
+     */
+    int first;
+
+} test_capture_search;
+
+/**
+ * Write handler which appends all written data to the test_capture
+ * associated with the socket.
+ */
+static ssize_t test_capture_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    test_capture* capture = (test_capture*) socket->data;
+
+    /* Grow buffer as necessary */
+    while (capture->length + count > capture->size) {
+        capture->size *= 2;
+        capture->buffer = realloc(capture->buffer, capture->size);
+    }
+
+    memcpy(capture->buffer + capture->length, buf, count);
+    capture->length += count;
+    capture->writes++;
+    return count;
+
+}
+
+/**
+ * Read handler which reads back the data captured by the test_capture
+ * associated with the socket, such that captured instructions can be read
+ * with guac_parser_read().
+ */
+static ssize_t test_capture_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    test_capture* capture = (test_capture*) socket->data;
+
+    size_t remaining = capture->length - capture->offset;
+    if (count > remaining)
+        count = remaining;
+
+    memcpy(buf, capture->buffer + capture->offset, count);
+    capture->offset += count;
+    return count;
+
+}
+
+void test_capture_init(test_capture* capture) {
+
+    memset(capture, 0, sizeof(test_capture));
+
+    capture->size = TEST_CAPTURE_INITIAL_SIZE;
+    capture->buffer = malloc(capture->size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(capture->buffer);
+
+    capture->socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(capture->socket);
+    capture->socket->data = capture;
+    capture->socket->read_handler = test_capture_read_handler;
+    capture->socket->write_handler = test_capture_write_handler;
+
+}
+
+void test_capture_free(test_capture* capture) {
+    guac_socket_free(capture->socket);
+    free(capture->buffer);
+}
+
+void test_capture_clear(test_capture* capture) {
+    guac_socket_flush(capture->socket);
+    capture->length = 0;
+    capture->writes = 0;
+}
+
+int test_capture_parse(test_capture* capture, test_capture_handler* handler,
+        void* data) {
+
+    int count = 0;
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    guac_socket_flush(capture->socket);
+    capture->offset = 0;
+
+    /* Read instructions until no data remains, whether captured or already
+     * buffered by the parser */
+    while (capture->offset < capture->length
+            || guac_parser_length(parser) > 0) {
+
+        if (guac_parser_read(parser, capture->socket, 0)) {
+            count = -1;
+            break;
+        }
+
+        if (handler != NULL)
+            handler(parser, data);
+
+        count++;
+
+    }
+
+    guac_parser_free(parser);
+    return count;
+
+}
+
+/**
+ * Handler which updates the given test_capture_search with the given parsed
+ * instruction.
+ */
+static void test_capture_search_handler(guac_parser* parser, void* data) {
+
+    test_capture_search* search = (test_capture_search*) data;
+    int i;
+
+    int position = search->position++;
+
+    if (strcmp(parser->opcode, search->opcode) != 0
+            || parser->argc < search->argc)
+        return;
+
+    for (i = 0; i < search->argc; i++) {
+        if (strcmp(search->argv[i], "*") != 0
+                && strcmp(search->argv[i], parser->argv[i]) != 0)
+            return;
+    }
+
+    if (search->first == -1)
+        search->first = position;
+
+    search->count++;
+
+}
+
+/**
+ * Searches all captured instructions for those matching the given opcode
+ * and NULL-terminated list of leading arguments, storing the results within
+ * the given test_capture_search. The current test fails if the captured data
+ * cannot be parsed.
+ */
+static void test_capture_search_all(test_capture* capture,
+        test_capture_search* search, const char* opcode, va_list args) {
+
+    const char* value;
+
+    memset(search, 0, sizeof(test_capture_search));
+    search->opcode = opcode;
+    search->first = -1;
+
+    while ((value = va_arg(args, const char*)) != NULL) {
+        CU_ASSERT_FATAL(search->argc < GUAC_INSTRUCTION_MAX_ELEMENTS);
+        search->argv[search->argc++] = value;
+    }
+
+    CU_ASSERT(test_capture_parse(capture, test_capture_search_handler,
+                search) >= 0);
+
+}
+
+int test_capture_count(test_capture* capture, const char* opcode, ...) {
+
+    test_capture_search search;
+    va_list args;
+
+    va_start(args, opcode);
+    test_capture_search_all(capture, &search, opcode, args);
+    va_end(args);
+
+    return search.count;
+
+}
+
+int test_capture_find(test_capture* capture, const char* opcode, ...) {
+
+    test_capture_search search;
+    va_list args;
+
+    va_start(args, opcode);
+    test_capture_search_all(capture, &search, opcode, args);
+    va_end(args);
+
+    return search.first;
+
+}
+
+void test_surface_init(test_surface* test, int width, int height) {
+
+    test->client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(test->client);
+
+    test_capture_init(&test->capture);
+
+    test->surface = guac_common_surface_alloc(test->client,
+            test->capture.socket, GUAC_DEFAULT_LAYER, width, height);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(test->surface);
+
+    test_capture_clear(&test->capture);
+
+}
+
+void test_surface_free(test_surface* test) {
+    guac_common_surface_free(test->surface);
+    guac_client_free(test->client);
+    test_capture_free(&test->capture);
+}
+
+void test_surface_flush(test_surface* test) {
+    test_capture_clear(&test->capture);
+    guac_common_surface_flush(test->surface);
+}
+
@@ -0,0 +1,239 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef _GUAC_TEST_COMMON_FIXTURE_H
+#define _GUAC_TEST_COMMON_FIXTURE_H
+
+/**
+ * Fixtures shared by unit tests which verify the data or instructions written
+ * to a guac_socket.
+ *
+ * @file fixture.h
+ */
+
+#include "config.h"
+#include "common/surface.h"
+
+#include <stddef.h>
+
+#include <guacamole/client.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+/**
+ * A socket which stores all data written to it in memory.
+ */
+typedef struct test_capture {
+
+    /**
+     * The socket whose output is captured.
+     */
+    guac_socket* socket;
+
+    /**
+     * All data written to the socket since the capture was last cleared.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of captured data.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for buffer.
+     */
+    size_t size;
+
+    /**
+     * The number of calls made to the write handler of the socket since the
+     * capture was last cleared.
+     */
+    int writes;
+
+    /**
+     * The offset within buffer of the next byte to be read while parsing
+     * the captured data.
+     */
+    size_t offset;
+
+} test_capture;
+
+/**
+ * Handler which is invoked for each instruction parsed from captured data.
+ *
+ * @param parser
+ *     The parser containing the instruction parsed.
+ *
+ * @param data
+ *     The arbitrary data passed to test_capture_parse().
+ */
+typedef void test_capture_handler(guac_parser* parser, void* data);
+
+/**
+ * Allocates a new socket whose output is captured within the given
+ * test_capture. If allocation fails, the current test is aborted.
+ *
+ * @param capture
+ *     The test_capture to initialize.
+ */
+void test_capture_init(test_capture* capture);
+
+/**
+ * Frees the socket of the given test_capture, along with all captured data.
+ *
+ * @param capture
+ *     The test_capture to free.
+ */
+void test_capture_free(test_capture* capture);
+
+/**
+ * Flushes the socket of the given test_capture, discarding all data
+ * captured thus far.
+ *
+ * @param capture
+ *     The test_capture to clear.
+ */
+void test_capture_clear(test_capture* capture);
+
+/**
+ * Flushes the socket of the given test_capture and parses everything
+ * captured since the capture was last cleared, invoking the given handler
+ * for each complete instruction.
+ *
+ * @param capture
+ *     The test_capture whose data should be parsed.
+ *
+ * @param handler
+ *     The handler to invoke for each instruction, or NULL if instructions
+ *     should only be counted.
+ *
+ * @param data
+ *     Arbitrary data to pass to the handler.
+ *
+ * @return
+ *     The number of instructions parsed, or -1 if the captured data is not
+ *     entirely made up of complete, valid instructions.
+ */
+int test_capture_parse(test_capture* capture, test_capture_handler* handler,
+        void* data);
+
+/**
+ * Returns the number of instructions captured since the capture was last
+ * cleared which have the given opcode and begin with the given arguments.
+ * The arguments are given as a NULL-terminated list of strings, where the
+ * string "*" matches any value. Instructions may have further arguments
+ * beyond those listed.
+ *
+ * @param capture
+ *     The test_capture whose data should be searched.
+ *
+ * @param opcode
+ *     The opcode of the instructions to count.
+ *
+ * @param ...
+ *     The values of the leading arguments of the instructions to count,
+ *     followed by NULL.
+ *
+ * @return
+ *     The number of matching instructions.
+ */
+int test_capture_count(test_capture* capture, const char* opcode, ...);
+
+/**
+ * Returns the position of the first instruction captured since the capture
+ * was last cleared which has the given opcode and begins with the given
+ * arguments, matched as by test_capture_count().
+ *
+ * @param capture
+ *     The test_capture whose data should be searched.
+ *
+ * @param opcode
+ *     The opcode of the instruction to find.
+ *
+ * @param ...
+ *     The values of the leading arguments of the instruction to find,
+ *     followed by NULL.
+ *
+ * @return
+ *     The zero-based position of the first matching instruction among all
+ *     captured instructions, or -1 if there is no such instruction.
+ */
+int test_capture_find(test_capture* capture, const char* opcode, ...);
+
+/**
+ * A surface whose output is captured, along with the client associated with
+ * that surface.
+ */
+typedef struct test_surface {
+
+    /**
+     * The client associated with the surface.
+     */
+    guac_client* client;
+
+    /**
+     * All output of the surface.
+     */
+    test_capture capture;
+
+    /**
+     * The surface under test.
+     */
+    guac_common_surface* surface;
+
+} test_surface;
+
+/**
+ * Allocates a surface of the given size whose output is captured, discarding
+ * the output produced by allocating the surface itself. If allocation fails,
+ * the current test is aborted.
+ *
+ * @param test
+ *     The test_surface to initialize.
+ *
+ * @param width
+ *     The width of the surface, in pixels.
+ *
+ * @param height
+ *     The height of the surface, in pixels.
+ */
+void test_surface_init(test_surface* test, int width, int height);
+
+/**
+ * Frees the surface of the given test_surface and all associated resources.
+ *
+ * @param test
+ *     The test_surface to free.
+ */
+void test_surface_free(test_surface* test);
+
+/**
+ * Flushes the surface of the given test_surface, discarding any output
+ * captured prior to the flush, such that only the output of the flush
+ * remains.
+ *
+ * @param test
+ *     The test_surface to flush.
+ */
+void test_surface_flush(test_surface* test);
+
+#endif
+
@@ -0,0 +1,357 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/display.h"
+#include "common/snapshot.h"
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+/**
+ * The width of the display used by each test, in pixels.
+ */
+#define TEST_WIDTH 256
+
+/**
+ * The height of the display used by each test, in pixels.
+ */
+#define TEST_HEIGHT 192
+
+/**
+ * The width and height of the layer and buffer used by each test, in pixels.
+ */
+#define TEST_LAYER_SIZE 64
+
+/**
+ * The criteria of a search for instructions referencing a layer, along with
+ * the number of such instructions found.
+ */
+typedef struct test_reference_search {
+
+    /**
+     * The index of the layer, as it would appear within an instruction.
+     */
+    char index[16];
+
+    /**
+     * The number of instructions found which reference the layer.
+     */
+    int count;
+
+} test_reference_search;
+
+/**
+ * Handler which counts the given instruction within the given
+ * test_reference_search if any of its arguments is the index of the layer
+ * being searched for.
+ */
+static void test_reference_handler(guac_parser* parser, void* data) {
+
+    test_reference_search* search = (test_reference_search*) data;
+    int i;
+
+    for (i = 0; i < parser->argc; i++) {
+        if (strcmp(parser->argv[i], search->index) == 0) {
+            search->count++;
+            return;
+        }
+    }
+
+}
+
+/**
+ * Returns the number of instructions captured since the capture was last
+ * cleared which have the index of the given layer as any argument.
+ */
+static int test_count_references(test_capture* capture,
+        const guac_layer* layer) {
+
+    test_reference_search search;
+    snprintf(search.index, sizeof(search.index), "%d", layer->index);
+    search.count = 0;
+
+    CU_ASSERT(test_capture_parse(capture, test_reference_handler,
+                &search) >= 0);
+
+    return search.count;
+
+}
+
+/**
+ * Draws a rectangle of opaque noise to the given surface, such that the
+ * rectangle can only be sent as an image.
+ */
+static void test_draw_noise(guac_common_surface* surface, int x, int y,
+        int width, int height, unsigned int seed) {
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            width, height);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(image);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    int i, j;
+
+    for (i = 0; i < height; i++) {
+        uint32_t* row = (uint32_t*) (data + i * stride);
+        for (j = 0; j < width; j++) {
+            seed = seed * 1103515245 + 12345;
+            row[j] = 0xFF000000 | (seed >> 8);
+        }
+    }
+
+    cairo_surface_mark_dirty(image);
+    guac_common_surface_draw(surface, x, y, image);
+    cairo_surface_destroy(image);
+
+}
+
+/**
+ * Joins a new user to the given display and to its client, capturing
+ * everything sent to that user within the given test_capture. The user
+ * remains connected until passed to test_leave().
+ */
+static guac_user* test_join(guac_common_display* display,
+        test_capture* output) {
+
+    guac_user* user = guac_user_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(user);
+    user->client = display->client;
+    user->socket = output->socket;
+
+    guac_common_display_dup(display, user, output->socket);
+    guac_socket_flush(output->socket);
+
+    CU_ASSERT_EQUAL(guac_client_add_user(display->client, user, 0, NULL), 0);
+    return user;
+
+}
+
+/**
+ * Removes the given user, previously joined with test_join(), from the given
+ * display and its client, writing any output still queued for that user to
+ * its test_capture before freeing the user.
+ */
+static void test_leave(guac_common_display* display, guac_user* user) {
+    guac_client_remove_user(display->client, user);
+    guac_common_display_remove_user(display, user);
+    guac_user_free(user);
+}
+
+/**
+ * Verifies that a frame is shared by all users acquiring it while it is in
+ * use, and is freed once released by all of them.
+ */
+static void test_snapshot_sharing() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_common_snapshot* snapshot = guac_common_snapshot_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(snapshot);
+
+    /* First user must capture a new frame */
+    guac_common_snapshot_frame* first = guac_common_snapshot_acquire(snapshot);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(first);
+    CU_ASSERT_FALSE(first->ready);
+
+    guac_common_snapshot_layer* layer = guac_common_snapshot_add_layer(first);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(layer);
+    layer->layer.index = 0;
+    layer->realized = 1;
+    layer->width = TEST_LAYER_SIZE;
+    layer->height = TEST_LAYER_SIZE;
+    layer->stride = TEST_LAYER_SIZE * 4;
+    layer->buffer = calloc(TEST_LAYER_SIZE, TEST_LAYER_SIZE * 4);
+
+    guac_common_snapshot_encode(snapshot, first);
+    CU_ASSERT_TRUE(first->ready);
+    CU_ASSERT_FALSE(first->failed);
+    CU_ASSERT(first->length > 0);
+
+    /* Users joining while the frame is in use share it */
+    guac_common_snapshot_frame* second = guac_common_snapshot_acquire(snapshot);
+    CU_ASSERT_PTR_EQUAL(second, first);
+    CU_ASSERT_EQUAL(first->refs, 2);
+
+    guac_layer default_layer = { 0 };
+    guac_layer other_layer = { 1 };
+    CU_ASSERT_PTR_EQUAL(guac_common_snapshot_find_layer(first, &default_layer),
+            layer);
+    CU_ASSERT_PTR_NULL(guac_common_snapshot_find_layer(first, &other_layer));
+
+    /* Frame is freed only once released by all users */
+    guac_common_snapshot_release(snapshot, first);
+    CU_ASSERT_PTR_EQUAL(snapshot->current, second);
+    guac_common_snapshot_release(snapshot, second);
+    CU_ASSERT_PTR_NULL(snapshot->current);
+
+    guac_common_snapshot_free(snapshot);
+    guac_client_free(client);
+
+}
+
+/**
+ * Verifies that joining users receive the visible layers of the display in
+ * full, followed by only the changes made since the snapshot they received
+ * was captured, and that buffers are sent only once referenced, and then
+ * only to users which have joined and not yet left.
+ */
+static void test_snapshot_join() {
+
+    test_capture broadcast;
+    test_capture first;
+    test_capture second;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* Capture all output of the display sent to existing users */
+    test_capture_init(&broadcast);
+    guac_socket* client_socket = client->socket;
+    client->socket = broadcast.socket;
+
+    guac_common_display* display = guac_common_display_alloc(client,
+            TEST_WIDTH, TEST_HEIGHT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display->snapshot);
+
+    guac_common_display_layer* layer = guac_common_display_alloc_layer(
+            display, TEST_LAYER_SIZE, TEST_LAYER_SIZE);
+    guac_common_display_layer* removed = guac_common_display_alloc_layer(
+            display, TEST_LAYER_SIZE, TEST_LAYER_SIZE);
+    guac_common_display_layer* buffer = guac_common_display_alloc_buffer(
+            display, TEST_LAYER_SIZE, TEST_LAYER_SIZE);
+
+    test_draw_noise(display->default_surface, 0, 0,
+            TEST_WIDTH, TEST_HEIGHT, 1);
+    test_draw_noise(layer->surface, 0, 0,
+            TEST_LAYER_SIZE, TEST_LAYER_SIZE, 2);
+    test_draw_noise(buffer->surface, 0, 0,
+            TEST_LAYER_SIZE, TEST_LAYER_SIZE, 3);
+
+    guac_common_display_flush(display);
+    guac_common_surface_flush(buffer->surface);
+
+    char buffer_index[16];
+    snprintf(buffer_index, sizeof(buffer_index), "%d", buffer->layer->index);
+
+    /* Hold a snapshot captured before further changes, as if another user
+     * were still joining */
+    guac_common_snapshot_frame* frame =
+        guac_common_snapshot_acquire(display->snapshot);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(frame);
+    CU_ASSERT_EQUAL_FATAL(frame->ready, 0);
+
+    guac_common_surface_capture(display->default_surface,
+            guac_common_snapshot_add_layer(frame));
+    guac_common_surface_capture(layer->surface,
+            guac_common_snapshot_add_layer(frame));
+    guac_common_surface_capture(removed->surface,
+            guac_common_snapshot_add_layer(frame));
+    guac_common_snapshot_encode(display->snapshot, frame);
+
+    /* A joining user receives every visible layer, but no buffer */
+    test_capture_init(&first);
+    guac_user* first_user = test_join(display, &first);
+    CU_ASSERT_EQUAL(test_capture_count(&first, "img", NULL), 3);
+    CU_ASSERT_EQUAL(test_capture_count(&first, "dispose", NULL), 0);
+    CU_ASSERT_EQUAL(test_count_references(&first, buffer->layer), 0);
+    CU_ASSERT_EQUAL(memcmp(first.buffer, frame->data, frame->length),
+            0);
+
+    /* Change part of the layer, and free another layer */
+    test_draw_noise(layer->surface, 10, 20, 8, 4, 4);
+    guac_common_display_flush(display);
+    guac_common_display_free_layer(display, removed);
+
+    /* Users joining later receive the same snapshot, followed by only the
+     * changed part of the layer */
+    test_capture_init(&second);
+    guac_user* second_user = test_join(display, &second);
+    CU_ASSERT_EQUAL(memcmp(second.buffer, frame->data, frame->length),
+            0);
+    CU_ASSERT_EQUAL(test_capture_count(&second, "img", NULL), 4);
+    CU_ASSERT_EQUAL(test_capture_count(&second, "img",
+                "*", "*", "*", "*", "10", "20", NULL), 1);
+    CU_ASSERT_EQUAL(test_capture_count(&second, "dispose", NULL), 1);
+    CU_ASSERT_EQUAL(test_count_references(&second, buffer->layer), 0);
+
+    guac_common_snapshot_release(display->snapshot, frame);
+
+    /* The first user leaves before the buffer is referenced */
+    test_leave(display, first_user);
+    test_capture_clear(&first);
+    test_capture_clear(&second);
+
+    /* The buffer is sent only to the remaining joined user just before it is
+     * first referenced, and never to users which already have it */
+    test_capture_clear(&broadcast);
+    guac_common_surface_copy(buffer->surface, 0, 0,
+            TEST_LAYER_SIZE, TEST_LAYER_SIZE, layer->surface, 0, 0);
+
+    CU_ASSERT_EQUAL(test_count_references(&broadcast, buffer->layer), 1);
+    CU_ASSERT_EQUAL(test_capture_count(&broadcast, "copy", buffer_index,
+                NULL), 1);
+
+    /* Later references need not send the buffer again */
+    guac_common_surface_copy(buffer->surface, 0, 0,
+            TEST_LAYER_SIZE, TEST_LAYER_SIZE, display->default_surface,
+            TEST_LAYER_SIZE, TEST_LAYER_SIZE);
+    CU_ASSERT_EQUAL(test_capture_count(&broadcast, "img", NULL), 0);
+    CU_ASSERT_EQUAL(test_capture_count(&broadcast, "copy", NULL), 2);
+
+    test_leave(display, second_user);
+
+    CU_ASSERT_EQUAL(test_capture_count(&second, "img",
+                "*", "*", buffer_index, NULL), 1);
+    CU_ASSERT_EQUAL(test_capture_count(&second, "size", buffer_index,
+                NULL), 1);
+    CU_ASSERT_EQUAL(test_count_references(&first, buffer->layer), 0);
+
+    guac_common_display_free(display);
+
+    client->socket = client_socket;
+    guac_client_free(client);
+
+    test_capture_free(&first);
+    test_capture_free(&second);
+    test_capture_free(&broadcast);
+
+}
+
+void test_guac_display_snapshot() {
+    test_snapshot_sharing();
+    test_snapshot_join();
+}
+
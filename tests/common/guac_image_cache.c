@@ -0,0 +1,131 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/image_cache.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/hash.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of each test image, in pixels.
+ */
+#define TEST_SIZE 32
+
+/**
+ * The number of bytes in each row of the padded copy of each test image.
+ */
+#define TEST_STRIDE (TEST_SIZE * 4 + 64)
+
+/**
+ * Fills the given image with a pattern unique to the given seed, using the
+ * given stride.
+ */
+static void test_fill(unsigned char* image, int stride, int seed) {
+
+    int x, y;
+
+    for (y = 0; y < TEST_SIZE; y++) {
+        uint32_t* row = (uint32_t*) (image + y * stride);
+        for (x = 0; x < TEST_SIZE; x++)
+            row[x] = 0xFF000000 | (seed * 7919 + x * 31 + y * 131);
+    }
+
+}
+
+void test_guac_image_cache() {
+
+    unsigned char image_a[TEST_SIZE * TEST_SIZE * 4];
+    unsigned char image_b[TEST_SIZE * TEST_SIZE * 4];
+    unsigned char padded_a[TEST_SIZE * TEST_STRIDE];
+    int hit;
+
+    test_fill(image_a, TEST_SIZE * 4, 1);
+    test_fill(image_b, TEST_SIZE * 4, 2);
+    test_fill(padded_a, TEST_STRIDE, 1);
+
+    /* Hash depends only on pixels and dimensions, not on padding */
+    uint64_t hash_a = guac_hash_image(image_a, TEST_SIZE, TEST_SIZE,
+            TEST_SIZE * 4);
+    CU_ASSERT_EQUAL(hash_a, guac_hash_image(padded_a, TEST_SIZE, TEST_SIZE,
+                TEST_STRIDE));
+    CU_ASSERT_NOT_EQUAL(hash_a, guac_hash_image(image_b, TEST_SIZE,
+                TEST_SIZE, TEST_SIZE * 4));
+    CU_ASSERT_NOT_EQUAL(hash_a, guac_hash_image(image_a, TEST_SIZE * 2,
+                TEST_SIZE / 2, TEST_SIZE * 8));
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Allow only a single image to be cached at a time */
+    guac_common_image_cache* cache = guac_common_image_cache_alloc(client,
+            TEST_SIZE * TEST_SIZE * 4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Images are not cached when first seen */
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, image_a,
+                TEST_SIZE, TEST_SIZE, TEST_SIZE * 4, &hit));
+
+    /* Images are cached when seen again, even with different padding */
+    const guac_layer* buffer = guac_common_image_cache_lookup(cache,
+            padded_a, TEST_SIZE, TEST_SIZE, TEST_STRIDE, &hit);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    CU_ASSERT_EQUAL(hit, 0);
+    CU_ASSERT(buffer->index < 0);
+
+    /* Cached images are found thereafter */
+    CU_ASSERT_PTR_EQUAL(guac_common_image_cache_lookup(cache, image_a,
+                TEST_SIZE, TEST_SIZE, TEST_SIZE * 4, &hit), buffer);
+    CU_ASSERT_EQUAL(hit, 1);
+
+    /* Caching a different image evicts the first, reusing its buffer */
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, image_b,
+                TEST_SIZE, TEST_SIZE, TEST_SIZE * 4, &hit));
+    CU_ASSERT_PTR_EQUAL(guac_common_image_cache_lookup(cache, image_b,
+                TEST_SIZE, TEST_SIZE, TEST_SIZE * 4, &hit), buffer);
+    CU_ASSERT_EQUAL(hit, 0);
+    CU_ASSERT_EQUAL(cache->length, 1);
+
+    /* Small images are never cached */
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, image_a,
+                4, 4, TEST_SIZE * 4, &hit));
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, image_a,
+                4, 4, TEST_SIZE * 4, &hit));
+
+    CU_ASSERT_EQUAL(cache->hits, 1);
+    CU_ASSERT_EQUAL(cache->misses, 4);
+    CU_ASSERT_EQUAL(cache->evictions, 1);
+
+    guac_common_image_cache_free(cache, socket);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
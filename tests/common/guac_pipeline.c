@@ -0,0 +1,210 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/cursor.h"
+#include "common/display.h"
+#include "common/encoder.h"
+#include "common/pipeline.h"
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+/**
+ * The number of jobs to submit to the pipeline, which is deliberately larger
+ * than GUAC_COMMON_PIPELINE_MAX_JOBS.
+ */
+#define TEST_JOBS 100
+
+/**
+ * A job which produces text identifying itself once encoded.
+ */
+typedef struct test_job {
+
+    /**
+     * The index of this job.
+     */
+    int index;
+
+    /**
+     * The encoded text.
+     */
+    char encoded[16];
+
+} test_job;
+
+/**
+ * Encode handler which takes a varying amount of time to produce the text of
+ * the given test_job, such that jobs finish encoding out of order.
+ */
+static void test_encode_handler(void* data) {
+
+    test_job* job = (test_job*) data;
+
+    usleep((TEST_JOBS - job->index) % 7 * 100);
+    snprintf(job->encoded, sizeof(job->encoded), "J%i;", job->index);
+
+}
+
+/**
+ * Send handler which writes the text of the given test_job and frees the job.
+ */
+static void test_send_handler(void* data, guac_socket* socket) {
+
+    test_job* job = (test_job*) data;
+
+    guac_socket_write_string(socket, job->encoded);
+    free(job);
+
+}
+
+/**
+ * Verifies that all output added to a pipeline, whether written directly or
+ * submitted as jobs, is written to the target socket in the order it was
+ * added.
+ */
+static void test_pipeline_order() {
+
+    char expected[TEST_JOBS * 32];
+    test_capture target;
+    int expected_length = 0;
+    int i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    test_capture_init(&target);
+
+    guac_common_encoder_set_threads(4);
+
+    guac_common_pipeline* pipeline = guac_common_pipeline_alloc(client,
+            target.socket);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pipeline);
+
+    /* Interleave directly-written data with jobs and frame boundaries */
+    for (i = 0; i < TEST_JOBS; i++) {
+
+        test_job* job = malloc(sizeof(test_job));
+        job->index = i;
+
+        guac_socket_write_string(pipeline->socket, "D;");
+        guac_common_pipeline_submit(pipeline, test_encode_handler,
+                test_send_handler, job);
+
+        expected_length += sprintf(expected + expected_length, "D;J%i;", i);
+
+        if (i % 10 == 9)
+            guac_common_pipeline_end_frame(pipeline);
+
+    }
+
+    /* All output must be written in the order it was added */
+    guac_common_pipeline_wait(pipeline);
+    CU_ASSERT_TRUE(guac_common_pipeline_is_idle(pipeline));
+    CU_ASSERT_EQUAL_FATAL(target.length, expected_length);
+    CU_ASSERT_EQUAL(memcmp(target.buffer, expected, expected_length), 0);
+
+    /* Any remaining output must be written when freed */
+    guac_socket_write_string(pipeline->socket, "END;");
+    guac_common_pipeline_free(pipeline);
+    CU_ASSERT_EQUAL(target.length, expected_length + 4);
+
+    test_capture_free(&target);
+    guac_client_free(client);
+
+    /* Restore default */
+    guac_common_encoder_set_threads(0);
+
+}
+
+/**
+ * Verifies that cursor images of a pipelined display are sent through the
+ * pipeline in order with all other output of the display, and that users
+ * joining a pipelined display receive its current state.
+ */
+static void test_pipeline_display() {
+
+    test_capture output;
+    test_capture joined;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* Capture all output of the display sent to existing users */
+    test_capture_init(&output);
+    guac_socket* client_socket = client->socket;
+    client->socket = output.socket;
+
+    guac_common_display* display = guac_common_display_alloc(client, 64, 64);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+    CU_ASSERT_EQUAL_FATAL(guac_common_display_enable_pipeline(display), 0);
+    CU_ASSERT_PTR_EQUAL(display->cursor->socket, display->pipeline->socket);
+
+    /* A cursor image set after drawing must be sent after that drawing */
+    test_capture_clear(&output);
+    guac_common_surface_set(display->default_surface, 0, 0, 64, 64,
+            0x11, 0x22, 0x33, 0xFF);
+    guac_common_display_flush(display);
+    guac_common_cursor_set_pointer(display->cursor);
+    guac_common_display_end_frame(display);
+    guac_common_pipeline_wait(display->pipeline);
+
+    int fill = test_capture_find(&output, "cfill", NULL);
+    int cursor = test_capture_find(&output, "cursor", NULL);
+    CU_ASSERT(fill >= 0);
+    CU_ASSERT(cursor > fill);
+
+    /* Joining users receive the current cursor */
+    test_capture_init(&joined);
+
+    guac_user* user = guac_user_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(user);
+    user->client = client;
+    user->socket = joined.socket;
+
+    guac_common_display_dup(display, user, joined.socket);
+    CU_ASSERT_EQUAL(test_capture_count(&joined, "cursor", NULL), 1);
+
+    guac_user_free(user);
+    guac_common_display_free(display);
+
+    client->socket = client_socket;
+    guac_client_free(client);
+
+    test_capture_free(&joined);
+    test_capture_free(&output);
+
+}
+
+void test_guac_pipeline() {
+    test_pipeline_order();
+    test_pipeline_display();
+}
+
@@ -0,0 +1,430 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/pixels.h"
+#include "common/surface.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/protocol-types.h>
+#include <guacamole/socket.h>
+
+/**
+ * The largest row width tested, in pixels.
+ */
+#define TEST_MAX_WIDTH 1030
+
+/**
+ * The number of random rows tested for each kernel and width.
+ */
+#define TEST_ROWS 8
+
+/**
+ * The width and height of the test surface, in pixels. This is large enough
+ * that overlapping rows are transferred in several blocks.
+ */
+#define TEST_SURFACE_SIZE 600
+
+/**
+ * The state of the pseudo-random number generator used to produce test
+ * pixels, such that all test runs are identical.
+ */
+static uint32_t test_random_state;
+
+/**
+ * Returns the next value from a simple xorshift pseudo-random number
+ * generator.
+ */
+static uint32_t test_random() {
+    test_random_state ^= test_random_state << 13;
+    test_random_state ^= test_random_state >> 17;
+    test_random_state ^= test_random_state << 5;
+    return test_random_state;
+}
+
+/**
+ * Returns a random pixel whose alpha component is frequently fully
+ * transparent or fully opaque, as those values are handled specially.
+ */
+static uint32_t test_random_pixel() {
+
+    uint32_t pixel = test_random();
+
+    switch (test_random() % 4) {
+        case 0: return pixel & 0x00FFFFFF;
+        case 1: return pixel | 0xFF000000;
+        default: return pixel;
+    }
+
+}
+
+/**
+ * Fills the given source and destination rows with random pixels. Runs of
+ * destination pixels are randomly copied from the source, such that some
+ * portions of the row are left unchanged by most kernels.
+ */
+static void test_random_rows(uint32_t* src, uint32_t* dst, int width) {
+
+    int x;
+
+    for (x = 0; x < width; x++) {
+        src[x] = test_random_pixel();
+        dst[x] = test_random_pixel();
+    }
+
+    for (x = 0; x < width; x++) {
+        if (test_random() % 3 == 0) {
+            int length = test_random() % 32;
+            while (length-- > 0 && x < width) {
+                dst[x] = src[x] | 0xFF000000;
+                x++;
+            }
+        }
+    }
+
+}
+
+/**
+ * Returns the result of transferring the given source pixel onto the given
+ * destination pixel, as defined by the guac_transfer_function documentation.
+ * Each transfer function is evaluated individually, independently of the way
+ * the kernels are implemented.
+ */
+static uint32_t test_reference_transfer(guac_transfer_function op,
+        uint32_t src, uint32_t dst) {
+
+    switch (op) {
+        case GUAC_TRANSFER_BINARY_BLACK:     return 0xFF000000;
+        case GUAC_TRANSFER_BINARY_WHITE:     return 0xFFFFFFFF;
+        case GUAC_TRANSFER_BINARY_SRC:       return src;
+        case GUAC_TRANSFER_BINARY_DEST:      return dst;
+        case GUAC_TRANSFER_BINARY_NSRC:      return src ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_NDEST:     return dst ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_AND:       return dst & (0xFF000000 | src);
+        case GUAC_TRANSFER_BINARY_NAND:      return (dst & (0xFF000000 | src)) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_OR:        return dst | (0x00FFFFFF & src);
+        case GUAC_TRANSFER_BINARY_NOR:       return (dst | (0x00FFFFFF & src)) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_XOR:       return dst ^ (0x00FFFFFF & src);
+        case GUAC_TRANSFER_BINARY_XNOR:      return (dst ^ (0x00FFFFFF & src)) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_NSRC_AND:  return dst & (0xFF000000 | (src ^ 0x00FFFFFF));
+        case GUAC_TRANSFER_BINARY_NSRC_NAND: return (dst & (0xFF000000 | (src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_NSRC_OR:   return dst | (0x00FFFFFF & (src ^ 0x00FFFFFF));
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:  return (dst | (0x00FFFFFF & (src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
+    }
+
+    return dst;
+
+}
+
+/**
+ * Verifies that each scalar transfer kernel implements its transfer function
+ * exactly, including the changed range it reports.
+ */
+static void test_scalar_transfer() {
+
+    uint32_t src[64];
+    uint32_t dst[64];
+    uint32_t expected[64];
+    int first, last, expected_first, expected_last, changed, x;
+    guac_transfer_function op;
+
+    test_random_state = 0x87654321;
+
+    for (op = 0; op < GUAC_COMMON_PIXELS_TRANSFER_FUNCTIONS; op++) {
+
+        test_random_rows(src, dst, 64);
+
+        expected_first = -1;
+        expected_last = -1;
+        for (x = 0; x < 64; x++) {
+            expected[x] = test_reference_transfer(op, src[x], dst[x]);
+            if (expected[x] != dst[x]) {
+                if (expected_first == -1) expected_first = x;
+                expected_last = x;
+            }
+        }
+
+        changed = guac_common_pixels_scalar.transfer[op](dst, src, 64,
+                &first, &last);
+
+        CU_ASSERT_EQUAL(memcmp(dst, expected, sizeof(dst)), 0);
+        CU_ASSERT_EQUAL(!changed, expected_first == -1);
+        if (changed) {
+            CU_ASSERT_EQUAL(first, expected_first);
+            CU_ASSERT_EQUAL(last, expected_last);
+        }
+
+    }
+
+}
+
+/**
+ * Verifies that the given kernel produces exactly the same destination row,
+ * return value and changed range as the equivalent scalar kernel. Exactly one
+ * of span/fill is used, depending on which pair is non-NULL.
+ */
+static void test_row(guac_common_pixels_span* span,
+        guac_common_pixels_span* scalar_span, guac_common_pixels_fill* fill,
+        guac_common_pixels_fill* scalar_fill, int width, int offset) {
+
+    uint32_t src[TEST_MAX_WIDTH + 4];
+    uint32_t expected[TEST_MAX_WIDTH + 4];
+    uint32_t actual[TEST_MAX_WIDTH + 4];
+
+    int expected_first = -1, expected_last = -1;
+    int actual_first = -1, actual_last = -1;
+    int expected_changed, actual_changed;
+
+    uint32_t color = test_random_pixel() | 0xFF000000;
+
+    /* Offset rows such that unaligned access is also tested */
+    test_random_rows(src + offset, expected + offset, width);
+    memcpy(actual, expected, sizeof(actual));
+
+    if (span != NULL) {
+        expected_changed = scalar_span(expected + offset, src + offset,
+                width, &expected_first, &expected_last);
+        actual_changed = span(actual + offset, src + offset,
+                width, &actual_first, &actual_last);
+    }
+    else {
+        expected_changed = scalar_fill(expected + offset, src + offset,
+                width, color, &expected_first, &expected_last);
+        actual_changed = fill(actual + offset, src + offset,
+                width, color, &actual_first, &actual_last);
+    }
+
+    CU_ASSERT_EQUAL(memcmp(actual, expected, sizeof(actual)), 0);
+    CU_ASSERT_EQUAL(!actual_changed, !expected_changed);
+
+    if (expected_changed) {
+        CU_ASSERT_EQUAL(actual_first, expected_first);
+        CU_ASSERT_EQUAL(actual_last, expected_last);
+    }
+
+}
+
+/**
+ * Verifies that the given scan kernel classifies a random row exactly as the
+ * scalar scan kernel does, and that the scalar scan kernel classifies the
+ * same row correctly. Rows are frequently uniform, opaque, or made of runs of
+ * repeated pixels, such that every result is exercised.
+ */
+static void test_scan_row(guac_common_pixels_scan* scan, int width,
+        int offset) {
+
+    uint32_t src[TEST_MAX_WIDTH + 4];
+    int expected_same = 0, actual_same = -1, scalar_same = -1;
+    int expected_opaque = 1, actual_opaque = -1, scalar_opaque = -1;
+    int expected_uniform = 1;
+    int x;
+
+    uint32_t* row = src + offset;
+    uint32_t pixel = test_random_pixel();
+    int kind = test_random() % 4;
+
+    for (x = 0; x < width; x++) {
+
+        /* Uniform rows, or runs of repeated pixels */
+        if (kind != 0 && (kind == 1 || test_random() % 8 == 0))
+            pixel = test_random_pixel();
+
+        /* Occasionally vary alpha only */
+        row[x] = pixel;
+        if (kind == 3 && test_random() % 8 == 0)
+            row[x] ^= 0xFF000000;
+
+        if (kind == 2)
+            row[x] |= 0xFF000000;
+
+    }
+
+    for (x = 0; x < width; x++) {
+        if (x > 0 && (row[x] | 0xFF000000) == (row[x - 1] | 0xFF000000))
+            expected_same++;
+        if ((row[x] & 0xFF000000) != 0xFF000000)
+            expected_opaque = 0;
+        if (row[x] != row[0])
+            expected_uniform = 0;
+    }
+
+    int scalar_uniform = guac_common_pixels_scalar.scan(row, width,
+            &scalar_same, &scalar_opaque);
+    int actual_uniform = scan(row, width, &actual_same, &actual_opaque);
+
+    CU_ASSERT_EQUAL(!scalar_uniform, !expected_uniform);
+    CU_ASSERT_EQUAL(!scalar_opaque, !expected_opaque);
+    CU_ASSERT_EQUAL(scalar_same, expected_same);
+
+    CU_ASSERT_EQUAL(!actual_uniform, !expected_uniform);
+    CU_ASSERT_EQUAL(!actual_opaque, !expected_opaque);
+    CU_ASSERT_EQUAL(actual_same, expected_same);
+
+}
+
+/**
+ * Verifies that every kernel of the given kernel set produces results which
+ * are bit-identical to the scalar kernels, for all row widths up to
+ * TEST_MAX_WIDTH.
+ */
+static void test_kernels(const guac_common_pixel_kernels* kernels) {
+
+    const guac_common_pixel_kernels* scalar = &guac_common_pixels_scalar;
+
+    int width, row, op;
+
+    test_random_state = 0x12345678;
+
+    for (width = 0; width <= TEST_MAX_WIDTH;
+            width += (width < 72) ? 1 : 61) {
+
+        for (row = 0; row < TEST_ROWS; row++) {
+
+            int offset = row % 4;
+
+            test_row(kernels->put_opaque, scalar->put_opaque, NULL, NULL,
+                    width, offset);
+
+            test_row(kernels->put_blend, scalar->put_blend, NULL, NULL,
+                    width, offset);
+
+            test_row(NULL, NULL, kernels->fill_mask, scalar->fill_mask,
+                    width, offset);
+
+            for (op = 0; op < GUAC_COMMON_PIXELS_TRANSFER_FUNCTIONS; op++)
+                test_row(kernels->transfer[op], scalar->transfer[op],
+                        NULL, NULL, width, offset);
+
+            if (width > 0)
+                test_scan_row(kernels->scan, width, offset);
+
+        }
+
+    }
+
+}
+
+/**
+ * Write handler which discards all data.
+ */
+static ssize_t test_discard_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+    return count;
+}
+
+/**
+ * Transfers a rectangle of a surface onto an overlapping rectangle of the
+ * same surface, verifying that the result is identical to transferring
+ * from an untouched copy of the original surface contents.
+ */
+static void test_overlapping_transfer(guac_common_surface* surface,
+        guac_transfer_function op, int dx, int dy) {
+
+    int x, y, first, last;
+
+    int size = surface->stride * surface->height;
+    unsigned char* original = malloc(size);
+    unsigned char* expected = malloc(size);
+
+    int sx = 16, sy = 16;
+    int w = TEST_SURFACE_SIZE - 40, h = TEST_SURFACE_SIZE - 40;
+
+    /* Fill surface with random pixels */
+    for (y = 0; y < surface->height; y++) {
+        uint32_t* row = (uint32_t*) (surface->buffer + y * surface->stride);
+        for (x = 0; x < surface->width; x++)
+            row[x] = test_random_pixel();
+    }
+
+    memcpy(original, surface->buffer, size);
+    memcpy(expected, surface->buffer, size);
+
+    /* Calculate expected result row by row from the untouched copy */
+    for (y = 0; y < h; y++)
+        guac_common_pixels_scalar.transfer[op](
+                (uint32_t*) (expected + (sy + dy + y) * surface->stride)
+                    + sx + dx,
+                (const uint32_t*) (original + (sy + y) * surface->stride)
+                    + sx, w, &first, &last);
+
+    guac_common_surface_transfer(surface, sx, sy, w, h, op, surface,
+            sx + dx, sy + dy);
+
+    CU_ASSERT_EQUAL(memcmp(surface->buffer, expected, size), 0);
+
+    free(expected);
+    free(original);
+
+}
+
+/**
+ * Verifies that every kernel set supported by the current CPU is bit-identical
+ * to the scalar kernels, and that the surface transfers correctly onto
+ * overlapping regions of itself in every direction.
+ */
+void test_guac_pixels() {
+
+    const guac_common_pixel_kernels* kernels[GUAC_COMMON_PIXELS_MAX_KERNELS];
+    int count, i, op;
+
+    /* The scalar kernels must always be supported, and be the slowest */
+    count = guac_common_pixels_list_kernels(kernels,
+            GUAC_COMMON_PIXELS_MAX_KERNELS);
+    CU_ASSERT_FATAL(count >= 1);
+    CU_ASSERT_PTR_EQUAL(kernels[count - 1], &guac_common_pixels_scalar);
+    CU_ASSERT_PTR_EQUAL(guac_common_pixels_get_kernels(), kernels[0]);
+
+    test_scalar_transfer();
+
+    for (i = 0; i < count; i++)
+        test_kernels(kernels[i]);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = test_discard_write_handler;
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_SURFACE_SIZE, TEST_SURFACE_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    for (op = 0; op < GUAC_COMMON_PIXELS_TRANSFER_FUNCTIONS; op++) {
+        test_overlapping_transfer(surface, op,  5,  0);
+        test_overlapping_transfer(surface, op, -5,  0);
+        test_overlapping_transfer(surface, op,  0,  7);
+        test_overlapping_transfer(surface, op,  0, -7);
+        test_overlapping_transfer(surface, op,  3,  3);
+        test_overlapping_transfer(surface, op, -3, -3);
+    }
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
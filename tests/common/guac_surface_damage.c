@@ -0,0 +1,328 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/parser.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width of the surface used by each test, in pixels.
+ */
+#define TEST_WIDTH 1024
+
+/**
+ * The height of the surface used by each test, in pixels.
+ */
+#define TEST_HEIGHT 768
+
+/**
+ * The maximum number of images tracked by a test_image_list.
+ */
+#define TEST_MAX_IMAGES 64
+
+/**
+ * The images sent by a single flush, as described by their img instructions
+ * and by the PNG headers of their first blobs.
+ */
+typedef struct test_image_list {
+
+    /**
+     * The stream index, location and dimensions of each image. Dimensions
+     * are zero until the first blob of the image is received.
+     */
+    struct {
+        char stream[16];
+        int x;
+        int y;
+        int width;
+        int height;
+    } images[TEST_MAX_IMAGES];
+
+    /**
+     * The number of images within the list.
+     */
+    int length;
+
+} test_image_list;
+
+/**
+ * Handler which adds the image begun by the given instruction, if that
+ * instruction is an img, to the test_image_list given as the handler data,
+ * reading the dimensions of the image from the header of its first PNG blob.
+ */
+static void test_image_handler(guac_parser* parser, void* data) {
+
+    test_image_list* list = (test_image_list*) data;
+    int i;
+
+    if (strcmp(parser->opcode, "img") == 0 && parser->argc == 6) {
+
+        if (list->length == TEST_MAX_IMAGES)
+            return;
+
+        CU_ASSERT_STRING_EQUAL(parser->argv[3], "image/png");
+
+        strncpy(list->images[list->length].stream, parser->argv[0],
+                sizeof(list->images[0].stream) - 1);
+        list->images[list->length].x = atoi(parser->argv[4]);
+        list->images[list->length].y = atoi(parser->argv[5]);
+        list->images[list->length].width = 0;
+        list->images[list->length].height = 0;
+        list->length++;
+        return;
+
+    }
+
+    if (strcmp(parser->opcode, "blob") != 0 || parser->argc != 2)
+        return;
+
+    for (i = list->length - 1; i >= 0; i--) {
+
+        if (strcmp(list->images[i].stream, parser->argv[0]) != 0)
+            continue;
+
+        /* Only the first blob contains the IHDR chunk */
+        if (list->images[i].width != 0)
+            return;
+
+        unsigned char* png = (unsigned char*) parser->argv[1];
+        int length = guac_protocol_decode_base64(parser->argv[1]);
+        CU_ASSERT_FATAL(length >= 24);
+
+        list->images[i].width = (png[16] << 24) | (png[17] << 16)
+                              | (png[18] << 8)  |  png[19];
+        list->images[i].height = (png[20] << 24) | (png[21] << 16)
+                               | (png[22] << 8)  |  png[23];
+        return;
+
+    }
+
+}
+
+/**
+ * Flushes the given surface, returning the number of images sent by that
+ * flush alone.
+ */
+static int test_flush_images(test_surface* test) {
+    test_surface_flush(test);
+    return test_capture_count(&test->capture, "img", NULL);
+}
+
+/**
+ * Draws an opaque rectangle based on the given color using image data, as
+ * would be received from a remote desktop server. The color of each pixel is
+ * varied slightly, such that the rectangle is not sent as a solid color.
+ */
+static void test_draw(test_surface* test, int x, int y, int width,
+        int height, uint32_t color) {
+
+    int i;
+
+    int stride = width * 4;
+    uint32_t* data = malloc(stride * height);
+    for (i = 0; i < width * height; i++)
+        data[i] = color ^ (i & 0x3);
+
+    cairo_surface_t* update = cairo_image_surface_create_for_data(
+            (unsigned char*) data, CAIRO_FORMAT_RGB24, width, height, stride);
+
+    guac_common_surface_draw(test->surface, x, y, update);
+
+    cairo_surface_destroy(update);
+    free(data);
+
+}
+
+/**
+ * Verifies that many small updates within a single region are combined into a
+ * single image, regardless of the order in which they were drawn.
+ */
+static void test_damage_combined() {
+
+    test_surface test;
+    int x, y;
+
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    /* Draw a 128x64 region as 8x8 blocks, bottom to top */
+    for (y = 7; y >= 0; y--) {
+        for (x = 0; x < 16; x++)
+            test_draw(&test, 64 + x * 8, 128 + y * 8, 8, 8,
+                    0xFF000000 | (x << 16) | (y << 8));
+    }
+
+    CU_ASSERT_EQUAL(test_flush_images(&test), 1);
+
+    /* Draw a 64x256 column as horizontal strips spanning several cells */
+    for (y = 0; y < 32; y++)
+        test_draw(&test, 512, y * 8, 64, 8, 0xFF000000 | y);
+
+    CU_ASSERT_EQUAL(test_flush_images(&test), 1);
+
+    /* Nothing further remains to be flushed */
+    CU_ASSERT_EQUAL(test_flush_images(&test), 0);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that small updates which are far apart are flushed as separate
+ * images.
+ */
+static void test_damage_separate() {
+
+    test_surface test;
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    /* Opposite corners */
+    test_draw(&test, 0, 0, 16, 16, 0xFF123456);
+    test_draw(&test, TEST_WIDTH - 16, TEST_HEIGHT - 16, 16, 16, 0xFF654321);
+    CU_ASSERT_EQUAL(test_flush_images(&test), 2);
+
+    /* Same row, far apart */
+    test_draw(&test, 8, 300, 8, 8, 0xFFABCDEF);
+    test_draw(&test, 900, 300, 8, 8, 0xFFFEDCBA);
+    CU_ASSERT_EQUAL(test_flush_images(&test), 2);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that copies are combined into existing damage only when they add
+ * little image data.
+ */
+static void test_damage_copy() {
+
+    test_surface test;
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    /* A copy entirely within existing damage adds no image data */
+    test_capture_clear(&test.capture);
+    test_draw(&test, 0, 0, 256, 256, 0xFF102030);
+    guac_common_surface_copy(test.surface, 0, 0, 64, 64,
+            test.surface, 128, 128);
+    CU_ASSERT_EQUAL(test_capture_count(&test.capture, "copy", NULL), 0);
+    CU_ASSERT_EQUAL(test_flush_images(&test), 1);
+
+    /* A large copy into undamaged space is sent as a copy, after flushing
+     * the existing damage */
+    test_capture_clear(&test.capture);
+    test_draw(&test, 0, 0, 8, 8, 0xFF405060);
+    guac_common_surface_copy(test.surface, 0, 0, 256, 256,
+            test.surface, 512, 256);
+    CU_ASSERT_EQUAL(test_capture_count(&test.capture, "img", NULL), 1);
+    CU_ASSERT_EQUAL(test_capture_count(&test.capture, "copy", NULL), 1);
+    CU_ASSERT_EQUAL(test_flush_images(&test), 0);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that damage is preserved within the bounds of a resized surface.
+ */
+static void test_damage_resize() {
+
+    test_surface test;
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    /* Damage both inside and outside the bounds of the new size */
+    test_draw(&test, 16, 16, 32, 32, 0xFF778899);
+    test_draw(&test, 900, 700, 32, 32, 0xFF998877);
+    guac_common_surface_resize(test.surface, 200, 100);
+    CU_ASSERT_EQUAL(test_flush_images(&test), 1);
+
+    /* Damage is tracked correctly at the new size */
+    test_draw(&test, 190, 90, 10, 10, 0xFF111111);
+    CU_ASSERT_EQUAL(test_flush_images(&test), 1);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that damage extended downward is never combined into a rectangle
+ * which overlaps another rectangle of the same flush, such that no pixel is
+ * sent twice.
+ */
+static void test_damage_disjoint() {
+
+    test_surface test;
+    test_image_list list;
+    int a, b;
+
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    /* A small update at the bottom of the first row of cells, to the left of
+     * a wide update within the same row, both above a single update spanning
+     * both in the second row */
+    test_draw(&test, 0, 56, 8, 8, 0xFF202020);
+    test_draw(&test, 100, 0, 100, 60, 0xFF404040);
+    test_draw(&test, 0, 64, 200, 8, 0xFF606060);
+
+    test_surface_flush(&test);
+
+    list.length = 0;
+    CU_ASSERT(test_capture_parse(&test.capture, test_image_handler,
+                &list) > 0);
+    CU_ASSERT(list.length > 0);
+
+    /* No two images may overlap */
+    for (a = 0; a < list.length; a++) {
+        CU_ASSERT(list.images[a].width > 0);
+        CU_ASSERT(list.images[a].height > 0);
+        for (b = a + 1; b < list.length; b++) {
+            CU_ASSERT(list.images[a].x + list.images[a].width
+                        <= list.images[b].x
+                   || list.images[b].x + list.images[b].width
+                        <= list.images[a].x
+                   || list.images[a].y + list.images[a].height
+                        <= list.images[b].y
+                   || list.images[b].y + list.images[b].height
+                        <= list.images[a].y);
+        }
+    }
+
+    test_surface_free(&test);
+
+}
+
+void test_guac_surface_damage() {
+    test_damage_combined();
+    test_damage_separate();
+    test_damage_copy();
+    test_damage_resize();
+    test_damage_disjoint();
+}
+
@@ -0,0 +1,170 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/rect.h"
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width of the surface used by each test, in pixels.
+ */
+#define TEST_WIDTH 1024
+
+/**
+ * The height of the surface used by each test, in pixels.
+ */
+#define TEST_HEIGHT 768
+
+/**
+ * Returns the number of instructions having the given opcode which were sent
+ * by the most recent flush.
+ */
+static int test_count(test_surface* test, const char* opcode) {
+    return test_capture_count(&test->capture, opcode, NULL);
+}
+
+/**
+ * Draws a rectangle of image data, as would be received from a remote desktop
+ * server, where each pixel within the given uniform rectangle is the given
+ * opaque color and all other pixels are opaque noise.
+ */
+static void test_draw(test_surface* test, int x, int y, int width,
+        int height, const guac_common_rect* uniform, uint32_t color) {
+
+    int i, j;
+
+    int stride = width * 4;
+    uint32_t* data = malloc(stride * height);
+    for (i = 0; i < height; i++) {
+        for (j = 0; j < width; j++) {
+
+            uint32_t* pixel = &data[i * width + j];
+
+            if (uniform != NULL
+                    && j >= uniform->x && j < uniform->x + uniform->width
+                    && i >= uniform->y && i < uniform->y + uniform->height)
+                *pixel = 0xFF000000 | color;
+            else
+                *pixel = 0xFF000000 | (rand() & 0xFFFFFF);
+
+        }
+    }
+
+    cairo_surface_t* update = cairo_image_surface_create_for_data(
+            (unsigned char*) data, CAIRO_FORMAT_RGB24, width, height, stride);
+
+    guac_common_surface_draw(test->surface, x, y, update);
+
+    cairo_surface_destroy(update);
+    free(data);
+
+}
+
+/**
+ * Verifies that an update consisting of a single opaque color is sent as a
+ * solid rectangle rather than as an image.
+ */
+static void test_fill_uniform() {
+
+    test_surface test;
+    guac_common_rect uniform;
+
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    guac_common_rect_init(&uniform, 0, 0, 200, 100);
+    test_draw(&test, 10, 10, 200, 100, &uniform, 0x336699);
+
+    test_surface_flush(&test);
+    CU_ASSERT_EQUAL(test_count(&test, "rect"), 1);
+    CU_ASSERT_EQUAL(test_count(&test, "cfill"), 1);
+    CU_ASSERT_EQUAL(test_count(&test, "img"), 0);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that a large uniform portion of an update is sent as a solid
+ * rectangle, with only the remainder of the update sent as an image, while
+ * small uniform portions remain part of the image.
+ */
+static void test_fill_partial() {
+
+    test_surface test;
+    guac_common_rect uniform;
+
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    /* The right half of the update is a single color */
+    guac_common_rect_init(&uniform, 256, 0, 256, 512);
+    test_draw(&test, 0, 0, 512, 512, &uniform, 0x336699);
+
+    test_surface_flush(&test);
+    CU_ASSERT_EQUAL(test_count(&test, "cfill"), 1);
+    CU_ASSERT(test_count(&test, "img") > 0);
+    CU_ASSERT(test_capture_count(&test.capture, "img",
+                "*", "*", "*", "image/png", NULL) > 0);
+
+    /* A uniform portion too small to be worth sending separately */
+    guac_common_rect_init(&uniform, 0, 0, 64, 64);
+    test_draw(&test, 0, 0, 512, 512, &uniform, 0x336699);
+
+    test_surface_flush(&test);
+    CU_ASSERT_EQUAL(test_count(&test, "cfill"), 0);
+    CU_ASSERT(test_count(&test, "img") > 0);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that an update without any uniform portion is sent as an image.
+ */
+static void test_fill_none() {
+
+    test_surface test;
+    test_surface_init(&test, TEST_WIDTH, TEST_HEIGHT);
+
+    test_draw(&test, 0, 0, 300, 200, NULL, 0);
+
+    test_surface_flush(&test);
+    CU_ASSERT_EQUAL(test_count(&test, "cfill"), 0);
+    CU_ASSERT(test_count(&test, "img") > 0);
+
+    test_surface_free(&test);
+
+}
+
+void test_guac_surface_fill() {
+    test_fill_uniform();
+    test_fill_partial();
+    test_fill_none();
+}
+
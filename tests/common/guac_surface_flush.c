@@ -0,0 +1,134 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/encoder.h"
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * Draws a synthetic full-surface update of the given size, flushes that
+ * update using the given number of encoder threads, and stores all resulting
+ * instructions within a new capture, which must later be freed with
+ * test_capture_free().
+ */
+static void test_flush_update(test_capture* capture, int width, int height,
+        int threads) {
+
+    int x, y;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    test_capture_init(capture);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client,
+            capture->socket, GUAC_DEFAULT_LAYER, width, height);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /* Fill update with a gradient which varies across every tile */
+    int stride = width * 4;
+    unsigned char* data = malloc(stride * height);
+    for (y = 0; y < height; y++) {
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (x = 0; x < width; x++)
+            row[x] = 0xFF000000 | ((x & 0xFF) << 16) | ((y & 0xFF) << 8)
+                   | ((x + y) & 0xFF);
+    }
+
+    cairo_surface_t* update = cairo_image_surface_create_for_data(data,
+            CAIRO_FORMAT_RGB24, width, height, stride);
+
+    guac_common_encoder_set_threads(threads);
+    guac_common_surface_draw(surface, 0, 0, update);
+    guac_common_surface_flush(surface);
+    guac_socket_flush(capture->socket);
+
+    cairo_surface_destroy(update);
+    free(data);
+
+    guac_common_surface_free(surface);
+    guac_client_free(client);
+
+}
+
+/**
+ * Verifies that flushing a full-surface update of the given size produces
+ * one image per tile when encoded in parallel, that the output is identical
+ * regardless of the number of encoder threads, and that the update is sent
+ * as a single image when encoded serially.
+ */
+static void test_flush_size(int width, int height) {
+
+    test_capture serial;
+    test_capture parallel_2;
+    test_capture parallel_4;
+
+    int tiles =
+          ((width  + GUAC_COMMON_SURFACE_TILE_SIZE - 1) / GUAC_COMMON_SURFACE_TILE_SIZE)
+        * ((height + GUAC_COMMON_SURFACE_TILE_SIZE - 1) / GUAC_COMMON_SURFACE_TILE_SIZE);
+
+    /* Updates too small to benefit are never split */
+    if (width * height < GUAC_COMMON_SURFACE_MIN_TILED_AREA)
+        tiles = 1;
+
+    test_flush_update(&serial, width, height, 1);
+    test_flush_update(&parallel_2, width, height, 2);
+    test_flush_update(&parallel_4, width, height, 4);
+
+    /* Serially-encoded updates gain nothing from tiling */
+    CU_ASSERT_EQUAL(test_capture_count(&serial, "img", NULL), 1);
+    CU_ASSERT_EQUAL(test_capture_count(&serial, "end", NULL), 1);
+
+    /* Every tile must be sent as its own complete image */
+    CU_ASSERT_EQUAL(test_capture_count(&parallel_4, "img", NULL), tiles);
+    CU_ASSERT_EQUAL(test_capture_count(&parallel_4, "end", NULL), tiles);
+
+    /* The number of threads must not change the output */
+    CU_ASSERT_EQUAL_FATAL(parallel_2.length, parallel_4.length);
+    CU_ASSERT_EQUAL(memcmp(parallel_2.buffer, parallel_4.buffer,
+                parallel_4.length), 0);
+
+    test_capture_free(&serial);
+    test_capture_free(&parallel_2);
+    test_capture_free(&parallel_4);
+
+}
+
+void test_guac_surface_flush() {
+
+    /* Neither a whole number of tiles, and one too small to split */
+    test_flush_size(640, 480);
+    test_flush_size(300, 200);
+
+    /* Restore default */
+    guac_common_encoder_set_threads(0);
+
+}
@@ -0,0 +1,162 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/encoder.h"
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of the test surface, in pixels.
+ */
+#define TEST_SIZE 512
+
+/**
+ * Draws the portion of a synthetic document which begins at the given row
+ * and column, filling the entire surface. Every row and every column of the
+ * document is distinct.
+ */
+static void test_draw_document(guac_common_surface* surface, int row,
+        int column) {
+
+    int x, y;
+
+    int stride = TEST_SIZE * 4;
+    unsigned char* data = malloc(stride * TEST_SIZE);
+    for (y = 0; y < TEST_SIZE; y++) {
+        uint32_t* pixel = (uint32_t*) (data + y * stride);
+        for (x = 0; x < TEST_SIZE; x++) {
+            uint32_t value = (uint32_t) (y + row) * 2654435761u
+                           ^ (uint32_t) (x + column) * 40503u;
+            pixel[x] = 0xFF000000 | (value & 0xFFFFFF);
+        }
+    }
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(data,
+            CAIRO_FORMAT_RGB24, TEST_SIZE, TEST_SIZE, stride);
+
+    guac_common_surface_draw(surface, 0, 0, image);
+    guac_common_surface_flush(surface);
+
+    cairo_surface_destroy(image);
+    free(data);
+
+}
+
+/**
+ * Draws a synthetic document, scrolls that document vertically and then
+ * horizontally by redrawing it as plain bitmaps, and verifies the
+ * instructions sent for each scroll.
+ */
+static void test_scroll(int motion_detection) {
+
+    test_capture capture;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    test_capture_init(&capture);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client,
+            capture.socket, GUAC_DEFAULT_LAYER, TEST_SIZE, TEST_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    guac_common_surface_set_motion_detection(surface, motion_detection);
+
+    /* Encode serially, such that each update is sent as a single image */
+    guac_common_encoder_set_threads(1);
+
+    /* Initial contents must be sent in full */
+    test_draw_document(surface, 0, 0);
+    CU_ASSERT_EQUAL(test_capture_count(&capture, "copy", NULL), 0);
+    CU_ASSERT_EQUAL(test_capture_count(&capture, "img", NULL), 1);
+
+    /* Scroll down by 37 rows */
+    test_capture_clear(&capture);
+    test_draw_document(surface, 37, 0);
+
+    if (motion_detection) {
+
+        /* Remaining rows must be moved up, with only the newly-exposed rows
+         * at the bottom sent as an image */
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "copy",
+                    "0", "0", "37", "512", "475", "12", "0", "0", "0",
+                    NULL), 1);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "copy", NULL), 1);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "img", NULL), 1);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "img",
+                    "*", "*", "*", "*", "0", "475", NULL), 1);
+
+    }
+    else {
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "copy", NULL), 0);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "img", NULL), 1);
+    }
+
+    /* Scroll right by 50 columns */
+    test_capture_clear(&capture);
+    test_draw_document(surface, 37, 50);
+
+    if (motion_detection) {
+
+        /* Remaining columns must be moved left, with only the newly-exposed
+         * columns at the right sent as an image */
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "copy",
+                    "0", "50", "0", "462", "512", "12", "0", "0", "0",
+                    NULL), 1);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "copy", NULL), 1);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "img", NULL), 1);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "img",
+                    "*", "*", "*", "*", "462", "0", NULL), 1);
+
+    }
+    else {
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "copy", NULL), 0);
+        CU_ASSERT_EQUAL(test_capture_count(&capture, "img", NULL), 1);
+    }
+
+    /* Contents which have not moved at all must not be resent */
+    test_capture_clear(&capture);
+    test_draw_document(surface, 37, 50);
+    CU_ASSERT_EQUAL(test_capture_parse(&capture, NULL, NULL), 0);
+
+    guac_common_surface_free(surface);
+    guac_client_free(client);
+    test_capture_free(&capture);
+
+    /* Restore default */
+    guac_common_encoder_set_threads(0);
+
+}
+
+void test_guac_surface_motion() {
+    test_scroll(1);
+    test_scroll(0);
+}
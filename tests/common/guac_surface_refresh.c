@@ -0,0 +1,224 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "common/surface.h"
+#include "fixture.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width of the surface used by each test, in pixels.
+ */
+#define TEST_WIDTH 1024
+
+/**
+ * The height of the surface used by each test, in pixels.
+ */
+#define TEST_HEIGHT 768
+
+/**
+ * The lossless refresh interval used by each test, in milliseconds.
+ */
+#define TEST_REFRESH_INTERVAL 100
+
+/**
+ * The number of milliseconds between each frame while content is animating.
+ */
+#define TEST_FRAME_DURATION 20
+
+/**
+ * Allocates a surface whose output is captured, with lossless refresh
+ * enabled at TEST_REFRESH_INTERVAL.
+ */
+static void test_refresh_init(test_surface* test) {
+    test_surface_init(test, TEST_WIDTH, TEST_HEIGHT);
+    guac_common_surface_set_lossless_refresh(test->surface,
+            TEST_REFRESH_INTERVAL);
+}
+
+/**
+ * Returns the number of images of the given mimetype sent since the capture
+ * was last cleared, where the mimetype "*" matches images of any type.
+ */
+static int test_count_images(test_surface* test, const char* mimetype) {
+    return test_capture_count(&test->capture, "img", "*", "*", "*", mimetype,
+            NULL);
+}
+
+/**
+ * Flushes the given surface, returning the number of images of the given
+ * mimetype sent by that flush alone, where the mimetype "*" matches images
+ * of any type.
+ */
+static int test_flush_images(test_surface* test, const char* mimetype) {
+    test_surface_flush(test);
+    return test_count_images(test, mimetype);
+}
+
+/**
+ * Draws a rectangle of opaque noise using image data, as would be received
+ * from a remote desktop server.
+ */
+static void test_draw_noise(test_surface* test, int x, int y, int width,
+        int height) {
+
+    int i;
+
+    int stride = width * 4;
+    uint32_t* data = malloc(stride * height);
+    for (i = 0; i < width * height; i++)
+        data[i] = 0xFF000000 | (rand() & 0xFFFFFF);
+
+    cairo_surface_t* update = cairo_image_surface_create_for_data(
+            (unsigned char*) data, CAIRO_FORMAT_RGB24, width, height, stride);
+
+    guac_common_surface_draw(test->surface, x, y, update);
+
+    cairo_surface_destroy(update);
+    free(data);
+
+}
+
+/**
+ * Repeatedly redraws the given rectangle with noise, flushing each frame,
+ * until the rectangle is sent with a lossy format.
+ */
+static void test_animate(test_surface* test, int x, int y, int width,
+        int height) {
+
+    int frame;
+
+    for (frame = 0; frame < 10; frame++) {
+
+        test_draw_noise(test, x, y, width, height);
+        if (test_flush_images(test, "image/jpeg") > 0)
+            return;
+
+        usleep(TEST_FRAME_DURATION * 1000);
+
+    }
+
+    CU_FAIL("Animated content was never sent as JPEG");
+
+}
+
+/**
+ * Verifies that content sent as JPEG is re-sent as PNG only once it has
+ * remained unchanged for the refresh interval, and only once.
+ */
+static void test_refresh_static() {
+
+    test_surface test;
+    test_refresh_init(&test);
+
+    test_animate(&test, 128, 128, 256, 256);
+    CU_ASSERT(test.surface->lossy_cells > 0);
+
+    /* Content which has only just changed is not refreshed */
+    CU_ASSERT_EQUAL(test_flush_images(&test, "*"), 0);
+
+    /* Static content is refreshed losslessly */
+    usleep(TEST_REFRESH_INTERVAL * 2 * 1000);
+    test_surface_flush(&test);
+    CU_ASSERT(test_count_images(&test, "image/png") > 0);
+    CU_ASSERT_EQUAL(test_count_images(&test, "image/jpeg"), 0);
+    CU_ASSERT_EQUAL(test.surface->lossy_cells, 0);
+
+    /* Refreshed content is not sent again */
+    CU_ASSERT_EQUAL(test_flush_images(&test, "*"), 0);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that refreshing a large lossy region is spread across several
+ * flushes, according to the refresh budget.
+ */
+static void test_refresh_budget() {
+
+    test_surface test;
+    int flushes;
+
+    test_refresh_init(&test);
+
+    test_animate(&test, 0, 0, TEST_WIDTH, TEST_HEIGHT);
+    usleep(TEST_REFRESH_INTERVAL * 2 * 1000);
+
+    for (flushes = 0; flushes < 10 && test.surface->lossy_cells; flushes++) {
+        test_surface_flush(&test);
+        CU_ASSERT(test_count_images(&test, "image/png") > 0);
+    }
+
+    CU_ASSERT_EQUAL(test.surface->lossy_cells, 0);
+    CU_ASSERT(flushes >= TEST_WIDTH * TEST_HEIGHT
+            / GUAC_COMMON_SURFACE_REFRESH_BUDGET);
+
+    test_surface_free(&test);
+
+}
+
+/**
+ * Verifies that lossy content which is replaced losslessly, or copied, is
+ * tracked accordingly.
+ */
+static void test_refresh_replaced() {
+
+    test_surface test;
+    test_refresh_init(&test);
+
+    test_animate(&test, 0, 0, 256, 256);
+
+    /* A copy of lossy content is also lossy (the copied area covers 4x4
+     * heat map cells) */
+    int lossy_cells = test.surface->lossy_cells;
+    guac_common_surface_copy(test.surface, 0, 0, 256, 256,
+            test.surface, 512, 0);
+    CU_ASSERT_EQUAL(test_capture_count(&test.capture, "copy", NULL), 1);
+    CU_ASSERT_EQUAL(test.surface->lossy_cells, lossy_cells + 16);
+
+    /* Lossy content which is replaced with a solid color is not lossy. JPEG
+     * updates are aligned to a grid, and may extend beyond the drawn area. */
+    guac_common_surface_set(test.surface, 0, 0, 320, 320, 0, 0, 0, 0xFF);
+    guac_common_surface_set(test.surface, 512, 0, 256, 256, 0, 0, 0, 0xFF);
+    CU_ASSERT_EQUAL(test.surface->lossy_cells, 0);
+
+    usleep(TEST_REFRESH_INTERVAL * 2 * 1000);
+    CU_ASSERT_EQUAL(test_flush_images(&test, "*"), 0);
+
+    test_surface_free(&test);
+
+}
+
+void test_guac_surface_refresh() {
+    test_refresh_static();
+    test_refresh_budget();
+    test_refresh_replaced();
+}
+
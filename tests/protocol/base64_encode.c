@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "base64.h"
+#include "common/fixture.h"
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/socket.h>
+
+/**
+ * The size of the largest test input, in bytes. This is deliberately not a
+ * multiple of three, and is large enough to span several encoding blocks.
+ */
+#define TEST_INPUT_SIZE 20000
+
+/**
+ * The base64 alphabet, used by the reference encoder.
+ */
+static const char test_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Straightforward reference base64 encoder, encoding the given input into the
+ * given output buffer, including padding, and returning the number of
+ * characters written.
+ */
+static size_t test_reference_encode(char* output,
+        const unsigned char* input, size_t length) {
+
+    size_t i;
+    char* current = output;
+
+    for (i = 0; i < length; i += 3) {
+
+        int a = input[i];
+        int b = (i + 1 < length) ? input[i + 1] : 0;
+        int c = (i + 2 < length) ? input[i + 2] : 0;
+
+        *(current++) = test_alphabet[a >> 2];
+        *(current++) = test_alphabet[((a & 0x03) << 4) | (b >> 4)];
+        *(current++) = (i + 1 < length)
+            ? test_alphabet[((b & 0x0F) << 2) | (c >> 6)] : '=';
+        *(current++) = (i + 2 < length) ? test_alphabet[c & 0x3F] : '=';
+
+    }
+
+    return current - output;
+
+}
+
+/**
+ * Encodes the given input with guac_socket_write_base64(), splitting the
+ * input into writes of the given size, and verifies that the output is
+ * byte-for-byte identical to the output of the reference encoder.
+ */
+static void test_encode_split(const unsigned char* input, size_t length,
+        size_t split) {
+
+    static char expected[TEST_INPUT_SIZE * 2];
+    size_t expected_length = test_reference_encode(expected, input, length);
+    size_t offset;
+
+    test_capture capture;
+    test_capture_init(&capture);
+
+    /* Write input in chunks of the requested size */
+    for (offset = 0; offset < length; offset += split) {
+
+        size_t chunk = length - offset;
+        if (chunk > split)
+            chunk = split;
+
+        CU_ASSERT_EQUAL(guac_socket_write_base64(capture.socket,
+                    input + offset, chunk), 0);
+
+    }
+
+    CU_ASSERT_EQUAL(guac_socket_flush_base64(capture.socket), 0);
+    guac_socket_flush(capture.socket);
+
+    CU_ASSERT_EQUAL_FATAL(capture.length, expected_length);
+    CU_ASSERT_EQUAL(memcmp(capture.buffer, expected, expected_length), 0);
+
+    test_capture_free(&capture);
+
+}
+
+void test_base64_encode() {
+
+    static unsigned char input[TEST_INPUT_SIZE];
+    size_t splits[] = { 1, 2, 4, 5, 7, 3072, 6143, TEST_INPUT_SIZE };
+    size_t lengths[] = { 0, 1, 2, 3, 4, 5, 6143, 6144, 6145,
+        TEST_INPUT_SIZE };
+
+    unsigned int i, j;
+    unsigned int seed = 1;
+
+    /* Fill input with deterministic pseudo-random data */
+    for (i = 0; i < sizeof(input); i++) {
+        seed = seed * 1103515245 + 12345;
+        input[i] = (seed >> 16) & 0xFF;
+    }
+
+    /* Verify every combination of input length and write size */
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        for (j = 0; j < sizeof(splits) / sizeof(splits[0]); j++)
+            test_encode_split(input, lengths[i], splits[j]);
+    }
+
+}
+
+void test_base64_encoders() {
+
+    const guac_base64_encoder* encoders[GUAC_BASE64_MAX_ENCODERS];
+    int count = guac_base64_list_encoders(encoders, GUAC_BASE64_MAX_ENCODERS);
+
+    static unsigned char input[TEST_INPUT_SIZE + 16];
+    static char expected[TEST_INPUT_SIZE * 2];
+    static char output[TEST_INPUT_SIZE * 2];
+
+    unsigned int i;
+    unsigned int seed = 7;
+    int k;
+
+    /* The scalar encoder must always be available */
+    CU_ASSERT_FATAL(count >= 1);
+    CU_ASSERT_PTR_EQUAL(encoders[count - 1], &guac_base64_scalar);
+
+    for (i = 0; i < sizeof(input); i++) {
+        seed = seed * 1103515245 + 12345;
+        input[i] = (seed >> 16) & 0xFF;
+    }
+
+    /* Every encoder must produce exactly the reference output for any number
+     * of triplets at any alignment, without writing past its output */
+    for (k = 0; k < count; k++) {
+
+        size_t offset, triplets;
+        for (offset = 0; offset < 16; offset += 5) {
+            for (triplets = 0; triplets <= 200; triplets++) {
+
+                const unsigned char* current = input + offset;
+
+                test_reference_encode(expected, current, triplets * 3);
+                memset(output, '!', triplets * 4 + 1);
+                encoders[k]->encode(output, current, triplets);
+
+                CU_ASSERT_EQUAL(memcmp(output, expected, triplets * 4), 0);
+                CU_ASSERT_EQUAL(output[triplets * 4], '!');
+
+            }
+        }
+
+        /* Also verify a large block spanning every byte value */
+        test_reference_encode(expected, input, TEST_INPUT_SIZE / 3 * 3);
+        encoders[k]->encode(output, input, TEST_INPUT_SIZE / 3);
+        CU_ASSERT_EQUAL(memcmp(output, expected, TEST_INPUT_SIZE / 3 * 4), 0);
+
+    }
+
+}
+
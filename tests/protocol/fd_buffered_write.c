@@ -0,0 +1,134 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * The maximum number of bytes to buffer when testing the buffer limit.
+ */
+#define TEST_BUFFER_LIMIT 16384
+
+/**
+ * The number of bytes to write when testing the buffer limit.
+ */
+#define TEST_WRITE_SIZE 40000
+
+/**
+ * Returns whether data is available for reading on the given file
+ * descriptor, without waiting.
+ */
+static int test_readable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * Reads all available data from the given file descriptor, returning the
+ * number of bytes read.
+ */
+static int test_drain(int fd) {
+
+    char buffer[8192];
+    int total = 0;
+
+    while (test_readable(fd)) {
+        int length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        total += length;
+    }
+
+    return total;
+
+}
+
+void test_fd_buffered_write() {
+
+    int fd[2];
+    int i;
+
+    static char data[TEST_WRITE_SIZE];
+    memset(data, 'x', sizeof(data));
+
+    /* Data exceeding the initial buffer must be held until flushed */
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fd), 0);
+    guac_socket* socket = guac_socket_open(fd[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    for (i = 0; i < 2000; i++)
+        guac_protocol_send_sync(socket, 1000000 + i); /* 4.sync,7.1xxxxxx; */
+
+    CU_ASSERT_FALSE(test_readable(fd[1]));
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    CU_ASSERT_EQUAL(test_drain(fd[1]), 2000 * 17);
+
+    guac_socket_free(socket);
+    close(fd[1]);
+
+    /* Data must be written once the buffer limit is reached */
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fd), 0);
+    socket = guac_socket_open_buffered(fd[0], TEST_BUFFER_LIMIT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    CU_ASSERT_EQUAL(guac_socket_write(socket, data, sizeof(data)), 0);
+    CU_ASSERT_TRUE(test_readable(fd[1]));
+
+    int length = test_drain(fd[1]);
+    CU_ASSERT_TRUE(length >= TEST_WRITE_SIZE - TEST_BUFFER_LIMIT);
+    CU_ASSERT_TRUE(length < TEST_WRITE_SIZE);
+
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    CU_ASSERT_EQUAL(length + test_drain(fd[1]), TEST_WRITE_SIZE);
+
+    guac_socket_free(socket);
+    close(fd[1]);
+
+    /* Flushing mid-instruction must complete once the instruction ends */
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fd), 0);
+    socket = guac_socket_open(fd[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_socket_instruction_begin(socket);
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, "4.sync,"), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+
+    length = test_drain(fd[1]);
+    CU_ASSERT_TRUE(length > 0);
+    CU_ASSERT_TRUE(length < 7);
+
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, "1.0;"), 0);
+    guac_socket_instruction_end(socket);
+    CU_ASSERT_EQUAL(length + test_drain(fd[1]), 11);
+
+    guac_socket_free(socket);
+    close(fd[1]);
+
+}
+
@@ -0,0 +1,106 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common/fixture.h"
+#include "suite.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * Verifies that everything written to the given capture is identical to the
+ * given null-terminated string.
+ */
+static void test_assert_output(test_capture* capture, const char* expected) {
+    guac_socket_flush(capture->socket);
+    CU_ASSERT_EQUAL_FATAL(capture->length, strlen(expected));
+    CU_ASSERT_EQUAL(memcmp(capture->buffer, expected, capture->length), 0);
+}
+
+void test_instruction_build() {
+
+    guac_protocol_builder builder;
+    test_capture capture;
+    int i;
+
+    /* Several instructions must be built with a single write */
+    test_capture_init(&capture);
+    guac_protocol_builder_init(&builder, capture.socket);
+    guac_protocol_builder_opcode(&builder, "size");
+    guac_protocol_builder_int(&builder, -1);
+    guac_protocol_builder_int(&builder, 0);
+    guac_protocol_builder_int(&builder, 1024);
+    guac_protocol_builder_opcode(&builder, "name");
+    guac_protocol_builder_string(&builder, "a" UTF8_4 "b");
+    guac_protocol_builder_opcode(&builder, "test");
+    guac_protocol_builder_int(&builder, INT64_MAX);
+    guac_protocol_builder_int(&builder, INT64_MIN);
+    guac_protocol_builder_double(&builder, 0.5);
+    guac_protocol_builder_base64(&builder, "abcd", 4);
+    guac_protocol_builder_opcode(&builder, "nop");
+    CU_ASSERT_EQUAL(guac_protocol_builder_finish(&builder), 0);
+
+    test_assert_output(&capture,
+            "4.size,2.-1,1.0,4.1024;"
+            "4.name,6.a" UTF8_4 "b;"
+            "4.test,19.9223372036854775807,20.-9223372036854775808,"
+                "3.0.5,8.YWJjZA==;"
+            "3.nop;");
+
+    test_capture_free(&capture);
+
+    /* Data exceeding the builder's buffer must be written in order */
+    test_capture_init(&capture);
+    guac_protocol_builder_init(&builder, capture.socket);
+    for (i = 0; i < 10000; i++) {
+        guac_protocol_builder_opcode(&builder, "sync");
+        guac_protocol_builder_int(&builder, i);
+    }
+    CU_ASSERT_EQUAL(guac_protocol_builder_finish(&builder), 0);
+
+    CU_ASSERT_TRUE(capture.writes > 1);
+    CU_ASSERT_EQUAL(test_capture_count(&capture, "sync", NULL), 10000);
+    CU_ASSERT_EQUAL(test_capture_find(&capture, "sync", "0", NULL), 0);
+    CU_ASSERT_EQUAL(test_capture_find(&capture, "sync", "9999", NULL), 9999);
+
+    test_capture_free(&capture);
+
+    /* Instructions sent individually must use the same format */
+    test_capture_init(&capture);
+    guac_protocol_send_key(capture.socket, 65, 1, 12345);
+    guac_protocol_send_mouse(capture.socket, -5, 10, 1, 0);
+    guac_protocol_send_disconnect(capture.socket);
+    guac_protocol_send_log(capture.socket, "%s=%i", "x", 42);
+
+    test_assert_output(&capture,
+            "3.key,2.65,1.1,5.12345;"
+            "5.mouse,2.-5,2.10,1.1,1.0;"
+            "10.disconnect;"
+            "3.log,4.x=42;");
+
+    test_capture_free(&capture);
+
+}
+
@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/parser.h>
+
+/**
+ * Parses the given instruction, appending at most the given number of bytes
+ * at a time, and returns the resulting parse state. The parser is left
+ * containing the parsed instruction, if any.
+ */
+static guac_parse_state test_parse_chunked(guac_parser* parser,
+        char* buffer, int length, int chunk) {
+
+    int remaining = length;
+
+    while (remaining > 0 && parser->state != GUAC_PARSE_COMPLETE
+            && parser->state != GUAC_PARSE_ERROR) {
+
+        /* Only make the next chunk of data available */
+        int available = remaining;
+        if (available > chunk)
+            available = chunk;
+
+        /* Stop if parser cannot make progress */
+        int parsed = guac_parser_append(parser, buffer, available);
+        if (parsed == 0 && available == remaining)
+            break;
+
+        /* Extend chunk if a partial character must be completed */
+        if (parsed == 0) {
+            chunk++;
+            continue;
+        }
+
+        buffer += parsed;
+        remaining -= parsed;
+
+    }
+
+    return parser->state;
+
+}
+
+void test_instruction_parse_long() {
+
+    /* Long element mixing ASCII runs with multibyte characters */
+    char element[] =
+        "abcdefghijklmnopqrstuvwxyz0123456789" UTF8_4 "ABCDEFGH"
+        "abcdefghijklmnopqrstuvwxyz0123456789" UTF8_8 "IJKL"
+        UTF8_1 "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUV";
+
+    /* Number of characters (not bytes) within element */
+    int element_length = 36 + 4 + 8 + 36 + 8 + 4 + 1 + 58;
+
+    char instruction[512];
+    char copy[512];
+    int chunk;
+
+    int length = snprintf(instruction, sizeof(instruction),
+            "4.blob,1.0,%i.%s;", element_length, element);
+
+    /* Parse must succeed identically regardless of how data is split */
+    for (chunk = 1; chunk <= length; chunk++) {
+
+        guac_parser* parser = guac_parser_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+        memcpy(copy, instruction, length);
+        CU_ASSERT_EQUAL(test_parse_chunked(parser, copy, length, chunk),
+                GUAC_PARSE_COMPLETE);
+
+        CU_ASSERT_STRING_EQUAL(parser->opcode, "blob");
+        CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+        CU_ASSERT_STRING_EQUAL(parser->argv[0], "0");
+        CU_ASSERT_STRING_EQUAL(parser->argv[1], element);
+
+        guac_parser_free(parser);
+
+    }
+
+    /* Element shorter than declared length must fail */
+    for (chunk = 1; chunk <= 16; chunk++) {
+
+        char invalid[] = "4.test,12.abcdefghijk;XYZ;";
+
+        guac_parser* parser = guac_parser_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+        CU_ASSERT_EQUAL(test_parse_chunked(parser, invalid,
+                    sizeof(invalid) - 1, chunk), GUAC_PARSE_ERROR);
+
+        guac_parser_free(parser);
+
+    }
+
+    /* Element longer than declared length must fail */
+    for (chunk = 1; chunk <= 16; chunk++) {
+
+        char invalid[] = "4.test,3." UTF8_4 ";";
+
+        guac_parser* parser = guac_parser_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+        CU_ASSERT_EQUAL(test_parse_chunked(parser, invalid,
+                    sizeof(invalid) - 1, chunk), GUAC_PARSE_ERROR);
+
+        guac_parser_free(parser);
+
+    }
+
+}
+
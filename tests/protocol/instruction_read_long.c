@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+/**
+ * The number of characters within the long element of the test instruction.
+ * This is well beyond both GUAC_INSTRUCTION_MAX_LENGTH and the initial size
+ * of the parser's instruction buffer.
+ */
+#define TEST_ELEMENT_LENGTH 100000
+
+/**
+ * An instruction to be written to a file descriptor by
+ * test_write_instruction().
+ */
+typedef struct test_write_data {
+
+    /**
+     * The file descriptor to write to. This file descriptor is closed once
+     * the instruction has been written.
+     */
+    int fd;
+
+    /**
+     * The instruction to write.
+     */
+    const char* instruction;
+
+    /**
+     * The length of the instruction, in bytes.
+     */
+    int length;
+
+} test_write_data;
+
+/**
+ * Writes the instruction described by the given test_write_data, closing
+ * the file descriptor afterwards.
+ */
+static void* test_write_instruction(void* data) {
+
+    test_write_data* write_data = (test_write_data*) data;
+
+    const char* current = write_data->instruction;
+    int remaining = write_data->length;
+
+    while (remaining > 0) {
+
+        int written = write(write_data->fd, current, remaining);
+        if (written <= 0)
+            break;
+
+        current += written;
+        remaining -= written;
+
+    }
+
+    close(write_data->fd);
+    return NULL;
+
+}
+
+/**
+ * Reads the given number of instructions from the given data through a pipe
+ * using the given parser, returning the result of the last call to
+ * guac_parser_read(), or of the first call which failed.
+ */
+static int test_read_instructions(guac_parser* parser,
+        const char* instruction, int length, int count) {
+
+    int fd[2];
+    int result;
+    pthread_t writer;
+
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    test_write_data write_data = {
+        .fd          = fd[1],
+        .instruction = instruction,
+        .length      = length
+    };
+
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&writer, NULL,
+                test_write_instruction, &write_data), 0);
+
+    guac_socket* socket = guac_socket_open(fd[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    do {
+        result = guac_parser_read(parser, socket, 1000000);
+    } while (result == 0 && --count > 0);
+
+    /* Unblock writer if instruction was rejected */
+    guac_socket_free(socket);
+    pthread_join(writer, NULL);
+
+    return result;
+
+}
+
+/**
+ * Reads the given instruction through a pipe using the given parser,
+ * returning the result of guac_parser_read().
+ */
+static int test_read_instruction(guac_parser* parser,
+        const char* instruction, int length) {
+    return test_read_instructions(parser, instruction, length, 1);
+}
+
+void test_instruction_read_long() {
+
+    /* Rejected instructions leave the writer with no reader */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Instruction is "4.blob,1.0,100000.xxx...;" */
+    int length = 18 + TEST_ELEMENT_LENGTH + 1;
+    char* instruction = malloc(length + 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(instruction);
+
+    memcpy(instruction, "4.blob,1.0,100000.", 18);
+    memset(instruction + 18, 'x', TEST_ELEMENT_LENGTH);
+    instruction[length - 1] = ';';
+    instruction[length] = '\0';
+
+    /* Default limits must reject the instruction */
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_NOT_EQUAL(test_read_instruction(parser, instruction, length), 0);
+    guac_parser_free(parser);
+
+    /* A raised limit must accept it, growing the buffer as needed */
+    parser = guac_parser_alloc_max_length(TEST_ELEMENT_LENGTH);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_EQUAL_FATAL(test_read_instruction(parser, instruction, length), 0);
+
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "blob");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "0");
+    CU_ASSERT_EQUAL(strlen(parser->argv[1]), TEST_ELEMENT_LENGTH);
+    CU_ASSERT_EQUAL(memcmp(parser->argv[1], instruction + 18,
+                TEST_ELEMENT_LENGTH), 0);
+
+    /* The larger buffer must be borrowed only while the long instruction is
+     * being handled */
+    CU_ASSERT(parser->__buffer != parser->__instructionbuf);
+
+    /* The borrowed buffer must grow only as far as the instruction requires,
+     * not to the size permitted by the limit */
+    CU_ASSERT(parser->__buffer_size < length * 2);
+    CU_ASSERT(parser->__buffer_size < parser->__buffer_max_size);
+    guac_parser_free(parser);
+
+    /* Follow the long instruction with a short one */
+    char* instructions = malloc(length + 11);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(instructions);
+    memcpy(instructions, instruction, length);
+    memcpy(instructions + length, "4.sync,1.0;", 11);
+
+    parser = guac_parser_alloc_max_length(TEST_ELEMENT_LENGTH);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_EQUAL_FATAL(test_read_instructions(parser, instructions,
+                length + 11, 2), 0);
+
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "sync");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "0");
+    CU_ASSERT_PTR_EQUAL(parser->__buffer, parser->__instructionbuf);
+
+    guac_parser_free(parser);
+    free(instructions);
+
+    /* Limits which cannot be honored must be refused */
+    CU_ASSERT_PTR_NULL(guac_parser_alloc_max_length(0));
+
+    free(instruction);
+
+}
+
@@ -0,0 +1,138 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <CUnit/Basic.h>
+#include <guacamole/protocol.h>
+#include <guacamole/protocol-types.h>
+
+/**
+ * An opcode string and the guac_protocol_opcode value it must resolve to.
+ */
+typedef struct test_opcode_mapping {
+
+    /**
+     * The opcode string.
+     */
+    const char* opcode;
+
+    /**
+     * The expected result of passing the opcode string to
+     * guac_protocol_get_opcode().
+     */
+    guac_protocol_opcode value;
+
+} test_opcode_mapping;
+
+/**
+ * Every opcode defined by the Guacamole protocol.
+ */
+static const test_opcode_mapping test_opcodes[] = {
+    { "ack",        GUAC_PROTOCOL_OPCODE_ACK },
+    { "arc",        GUAC_PROTOCOL_OPCODE_ARC },
+    { "args",       GUAC_PROTOCOL_OPCODE_ARGS },
+    { "argv",       GUAC_PROTOCOL_OPCODE_ARGV },
+    { "audio",      GUAC_PROTOCOL_OPCODE_AUDIO },
+    { "blob",       GUAC_PROTOCOL_OPCODE_BLOB },
+    { "body",       GUAC_PROTOCOL_OPCODE_BODY },
+    { "cfill",      GUAC_PROTOCOL_OPCODE_CFILL },
+    { "clip",       GUAC_PROTOCOL_OPCODE_CLIP },
+    { "clipboard",  GUAC_PROTOCOL_OPCODE_CLIPBOARD },
+    { "close",      GUAC_PROTOCOL_OPCODE_CLOSE },
+    { "connect",    GUAC_PROTOCOL_OPCODE_CONNECT },
+    { "copy",       GUAC_PROTOCOL_OPCODE_COPY },
+    { "cstroke",    GUAC_PROTOCOL_OPCODE_CSTROKE },
+    { "cursor",     GUAC_PROTOCOL_OPCODE_CURSOR },
+    { "curve",      GUAC_PROTOCOL_OPCODE_CURVE },
+    { "disconnect", GUAC_PROTOCOL_OPCODE_DISCONNECT },
+    { "dispose",    GUAC_PROTOCOL_OPCODE_DISPOSE },
+    { "distort",    GUAC_PROTOCOL_OPCODE_DISTORT },
+    { "end",        GUAC_PROTOCOL_OPCODE_END },
+    { "error",      GUAC_PROTOCOL_OPCODE_ERROR },
+    { "file",       GUAC_PROTOCOL_OPCODE_FILE },
+    { "filesystem", GUAC_PROTOCOL_OPCODE_FILESYSTEM },
+    { "get",        GUAC_PROTOCOL_OPCODE_GET },
+    { "identity",   GUAC_PROTOCOL_OPCODE_IDENTITY },
+    { "image",      GUAC_PROTOCOL_OPCODE_IMAGE },
+    { "img",        GUAC_PROTOCOL_OPCODE_IMG },
+    { "key",        GUAC_PROTOCOL_OPCODE_KEY },
+    { "lfill",      GUAC_PROTOCOL_OPCODE_LFILL },
+    { "line",       GUAC_PROTOCOL_OPCODE_LINE },
+    { "log",        GUAC_PROTOCOL_OPCODE_LOG },
+    { "lstroke",    GUAC_PROTOCOL_OPCODE_LSTROKE },
+    { "mouse",      GUAC_PROTOCOL_OPCODE_MOUSE },
+    { "move",       GUAC_PROTOCOL_OPCODE_MOVE },
+    { "name",       GUAC_PROTOCOL_OPCODE_NAME },
+    { "nest",       GUAC_PROTOCOL_OPCODE_NEST },
+    { "nop",        GUAC_PROTOCOL_OPCODE_NOP },
+    { "pipe",       GUAC_PROTOCOL_OPCODE_PIPE },
+    { "pop",        GUAC_PROTOCOL_OPCODE_POP },
+    { "push",       GUAC_PROTOCOL_OPCODE_PUSH },
+    { "put",        GUAC_PROTOCOL_OPCODE_PUT },
+    { "ready",      GUAC_PROTOCOL_OPCODE_READY },
+    { "rect",       GUAC_PROTOCOL_OPCODE_RECT },
+    { "reset",      GUAC_PROTOCOL_OPCODE_RESET },
+    { "select",     GUAC_PROTOCOL_OPCODE_SELECT },
+    { "set",        GUAC_PROTOCOL_OPCODE_SET },
+    { "shade",      GUAC_PROTOCOL_OPCODE_SHADE },
+    { "size",       GUAC_PROTOCOL_OPCODE_SIZE },
+    { "start",      GUAC_PROTOCOL_OPCODE_START },
+    { "sync",       GUAC_PROTOCOL_OPCODE_SYNC },
+    { "timezone",   GUAC_PROTOCOL_OPCODE_TIMEZONE },
+    { "transfer",   GUAC_PROTOCOL_OPCODE_TRANSFER },
+    { "transform",  GUAC_PROTOCOL_OPCODE_TRANSFORM },
+    { "undefine",   GUAC_PROTOCOL_OPCODE_UNDEFINE },
+    { "video",      GUAC_PROTOCOL_OPCODE_VIDEO },
+};
+
+void test_opcode_lookup() {
+
+    int seen[GUAC_PROTOCOL_OPCODE_COUNT] = { 0 };
+    unsigned int i;
+
+    /* Every defined opcode must resolve to its own distinct value */
+    for (i = 0; i < sizeof(test_opcodes) / sizeof(test_opcodes[0]); i++) {
+
+        guac_protocol_opcode value =
+            guac_protocol_get_opcode(test_opcodes[i].opcode);
+
+        CU_ASSERT_EQUAL(value, test_opcodes[i].value);
+        CU_ASSERT_NOT_EQUAL_FATAL(value, GUAC_PROTOCOL_OPCODE_UNKNOWN);
+        CU_ASSERT_EQUAL(seen[value]++, 0);
+
+    }
+
+    /* Every value must be covered */
+    CU_ASSERT_EQUAL(i, GUAC_PROTOCOL_OPCODE_COUNT - 1);
+
+    /* Undefined opcodes must not resolve, even if similar to defined ones */
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode(""), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode("a"), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode("syn"), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode("syncs"), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode("SYNC"), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode("sYnc"), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode("mouze"), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+    CU_ASSERT_EQUAL(guac_protocol_get_opcode("\xe7\x8a\xac"), GUAC_PROTOCOL_OPCODE_UNKNOWN);
+
+}
+
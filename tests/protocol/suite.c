@@ -44,10 +44,17 @@ int register_protocol_suite() {
     /* Add tests */
     if (
         CU_add_test(suite, "base64-decode", test_base64_decode) == NULL
+     || CU_add_test(suite, "base64-encode", test_base64_encode) == NULL
+     || CU_add_test(suite, "base64-encoders", test_base64_encoders) == NULL
+     || CU_add_test(suite, "fd-buffered-write", test_fd_buffered_write) == NULL
+     || CU_add_test(suite, "instruction-build", test_instruction_build) == NULL
      || CU_add_test(suite, "instruction-parse", test_instruction_parse) == NULL
+     || CU_add_test(suite, "instruction-parse-long", test_instruction_parse_long) == NULL
      || CU_add_test(suite, "instruction-read", test_instruction_read) == NULL
+     || CU_add_test(suite, "instruction-read-long", test_instruction_read_long) == NULL
      || CU_add_test(suite, "instruction-write", test_instruction_write) == NULL
      || CU_add_test(suite, "nest-write", test_nest_write) == NULL
+     || CU_add_test(suite, "opcode-lookup", test_opcode_lookup) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
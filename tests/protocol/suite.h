@@ -34,10 +34,17 @@
 int register_protocol_suite();
 
 void test_base64_decode();
+void test_base64_encode();
+void test_base64_encoders();
+void test_fd_buffered_write();
+void test_instruction_build();
 void test_instruction_parse();
+void test_instruction_parse_long();
 void test_instruction_read();
+void test_instruction_read_long();
 void test_instruction_write();
 void test_nest_write();
+void test_opcode_lookup();
 
 #endif
 
@@ -30,6 +30,13 @@
 
 #define POOL_SIZE 128
 
+/**
+ * The number of integers freed at once when verifying that freed integers
+ * are always reused. This is deliberately larger than the number of freed
+ * integers that the pool can hold without growing.
+ */
+#define FREED_COUNT 20000
+
 void test_guac_pool() {
 
     guac_pool* pool;
@@ -85,5 +92,26 @@ void test_guac_pool() {
     /* Free pool */
     guac_pool_free(pool);
 
+    /* Get pool with no minimum size */
+    pool = guac_pool_alloc(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+
+    /* Allocate many integers before freeing any */
+    for (i=0; i<FREED_COUNT; i++)
+        CU_ASSERT_EQUAL_FATAL(i, guac_pool_next_int(pool));
+
+    for (i=0; i<FREED_COUNT; i++)
+        guac_pool_free_int(pool, i);
+
+    /* ALL freed integers should be reused, in the order they were freed */
+    for (i=0; i<FREED_COUNT; i++)
+        CU_ASSERT_EQUAL_FATAL(i, guac_pool_next_int(pool));
+
+    /* Only once all are in use should a new integer be returned */
+    CU_ASSERT_EQUAL(FREED_COUNT, guac_pool_next_int(pool));
+
+    /* Free pool */
+    guac_pool_free(pool);
+
 }
 
@@ -0,0 +1,127 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "util_suite.h"
+
+#include <pthread.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/pool.h>
+
+/**
+ * The maximum number of integers that may be in use at any one time.
+ */
+#define TEST_LIMIT 16
+
+/**
+ * The number of threads concurrently allocating and freeing integers. This is
+ * deliberately larger than TEST_LIMIT such that allocations are refused.
+ */
+#define TEST_THREADS 24
+
+/**
+ * The number of times each thread attempts to allocate an integer.
+ */
+#define TEST_ITERATIONS 20000
+
+/**
+ * The pool shared by all threads.
+ */
+static guac_pool* test_pool;
+
+/**
+ * The number of threads currently holding each integer. This must never
+ * exceed one.
+ */
+static int test_owners[TEST_LIMIT];
+
+/**
+ * Non-zero if any thread received an integer which was out of range or
+ * already held by another thread.
+ */
+static int test_failed;
+
+/**
+ * Repeatedly allocates and frees integers from test_pool, recording any
+ * integer which is out of range or held by more than one thread at once.
+ */
+static void* test_use_pool(void* data) {
+
+    int i;
+
+    for (i = 0; i < TEST_ITERATIONS; i++) {
+
+        int value = guac_pool_next_int_below(test_pool, TEST_LIMIT);
+
+        /* Allocation may be refused only because of the limit */
+        if (value == -1)
+            continue;
+
+        if (value < 0 || value >= TEST_LIMIT) {
+            __atomic_store_n(&test_failed, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* No other thread may hold the same integer */
+        if (__atomic_add_fetch(&test_owners[value], 1, __ATOMIC_RELAXED) != 1)
+            __atomic_store_n(&test_failed, 1, __ATOMIC_RELAXED);
+
+        __atomic_sub_fetch(&test_owners[value], 1, __ATOMIC_RELAXED);
+        guac_pool_free_int(test_pool, value);
+
+    }
+
+    return NULL;
+
+}
+
+void test_guac_pool_threaded() {
+
+    pthread_t threads[TEST_THREADS];
+    int i;
+
+    test_pool = guac_pool_alloc(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(test_pool);
+
+    for (i = 0; i < TEST_THREADS; i++)
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&threads[i], NULL,
+                    test_use_pool, NULL), 0);
+
+    for (i = 0; i < TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    CU_ASSERT_FALSE(test_failed);
+
+    /* All integers must have been returned */
+    CU_ASSERT_EQUAL(test_pool->active, 0);
+
+    /* Allocation must be refused once the limit is reached */
+    for (i = 0; i < TEST_LIMIT; i++) {
+        int value = guac_pool_next_int_below(test_pool, TEST_LIMIT);
+        CU_ASSERT(value >= 0 && value < TEST_LIMIT);
+    }
+
+    CU_ASSERT_EQUAL(guac_pool_next_int_below(test_pool, TEST_LIMIT), -1);
+
+    guac_pool_free(test_pool);
+
+}
+
@@ -64,6 +64,13 @@ int register_util_suite();
  */
 void test_guac_pool();
 
+/**
+ * Unit test for concurrent use of the guac_pool structure. This test checks
+ * that integers obtained with guac_pool_next_int_below() from many threads at
+ * once are never handed out twice and never reach the requested limit.
+ */
+void test_guac_pool_threaded();
+
 /**
  * Unit test for libguac's Unicode convenience functions. This test checks that
  * the functions provided for determining string length, character length, and